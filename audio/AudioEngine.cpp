@@ -12,7 +12,6 @@ Copyright Glare Technologies Limited 2021 -
 #include "../rtaudio/RtAudio.h"
 #include <resonance_audio/api/resonance_audio_api.h>
 #include <utils/MessageableThread.h>
-#include <utils/CircularBuffer.h>
 #include <utils/ConPrint.h>
 #include <utils/StringUtils.h>
 #include <utils/PlatformUtils.h>
@@ -27,7 +26,7 @@ namespace glare
 
 AudioSource::AudioSource()
 :	resonance_handle(0), cur_read_i(0), type(SourceType_Looping), spatial_type(SourceSpatialType_Spatial), remove_on_finish(true), volume(1.f), mute_volume_factor(1.f), mute_change_start_time(-2), mute_change_end_time(-1), mute_vol_fac_start(1.f),
-	mute_vol_fac_end(1.f), pos(0,0,0,1), num_occlusions(0), userdata_1(0), doppler_factor(1), smoothed_cur_level(0), sampling_rate(44100)
+	mute_vol_fac_end(1.f), pos(0,0,0,1), num_occlusions(0), userdata_1(0), doppler_factor(1), smoothed_cur_level(0), sampling_rate(44100), streamed_sampling_rate(0)
 {}
 
 
@@ -126,7 +125,9 @@ float SoundFile::minVal() const
 AudioEngine::AudioEngine()
 :	audio(NULL),
 	resonance(NULL),
-	initialised(false)
+	initialised(false),
+	source_commands(/*capacity=*/4096),
+	finished_sources(/*capacity=*/1024)
 {
 
 }
@@ -212,8 +213,10 @@ static int rtAudioCallback(void* output_buffer, void* input_buffer, unsigned int
 		}
 	}
 #else
+	// NOTE: This is called on the real-time audio thread, so don't lock or allocate here.
 	{
-		Lock lock(data->buffer_mutex);
+		if(status & RTAUDIO_OUTPUT_UNDERFLOW)
+			data->num_xruns.increment();
 
 		if(data->buffer.size() >= n_buffer_frames*2)
 		{
@@ -227,6 +230,8 @@ static int rtAudioCallback(void* output_buffer, void* input_buffer, unsigned int
 		else
 		{
 			//conPrint("rtAudioCallback: not enough data in queue.");
+			data->num_xruns.increment();
+
 			// Just write zeroes to output_buffer
 			for(unsigned int i=0; i<n_buffer_frames*2; ++i)
 				output_buffer_f[i] = 0.f;
@@ -247,6 +252,7 @@ static void zeroBuffer(js::Vector<float, 16>& v)
 
 // Gets buffered audio data from audio sources, copies it to resonance buffers.
 // Then gets mixed data from resonance, puts on queue to rtAudioCallback.
+// Keeps its own list of the sources being mixed, updated from AudioEngine::source_commands, so doesn't need to lock AudioEngine::mutex.
 class ResonanceThread : public MessageableThread
 {
 public:
@@ -260,11 +266,9 @@ public:
 		{
 			while(die == 0)
 			{
-				size_t num_samples_buffered;
-				{
-					Lock lock(callback_data->buffer_mutex);
-					num_samples_buffered = callback_data->buffer.size();
-				}
+				processSourceCommands();
+
+				size_t num_samples_buffered = callback_data->buffer.size();
 
 				// 512/2 samples per buffer / 48000.0 samples/s = 0.00533 s / buffer.
 				// So we will aim for N of these buffers being queued, resulting in N * 0.00533 s latency.
@@ -273,14 +277,20 @@ public:
 				{
 					bool filled_valid_buffer = false;
 					{
-						Lock lock(engine->mutex);
-
 						// Set resonance audio buffers for all audio sources
-						for(auto it = engine->audio_sources.begin(); it != engine->audio_sources.end(); )
+						for(size_t z=0; z<sources.size(); )
 						{
-							AudioSource* source = it->ptr();
+							AudioSource* source = sources[z].ptr();
 							bool remove_source = false;
 
+							// If the producer thread has changed the sampling rate of the streamed data, re-init the resampler.
+							const int streamed_sampling_rate = (int)(int64)source->streamed_sampling_rate;
+							if(streamed_sampling_rate != 0 && streamed_sampling_rate != source->sampling_rate)
+							{
+								source->sampling_rate = streamed_sampling_rate;
+								source->resampler.init(/*src rate=*/streamed_sampling_rate, /*dest rate*/engine->getSampleRate());
+							}
+
 							const int source_sampling_rate = source->sampling_rate;
 							const int resonance_sampling_rate = engine->getSampleRate();
 
@@ -389,6 +399,9 @@ public:
 								}
 								else
 								{
+									if(source->voice_stream.nonNull()) // If this is a voice chat source, decode frames from the jitter buffer as needed.  This clocks the voice playout by the audio device.
+										source->voice_stream->decodeFramesInto(source->buffer, src_samples_needed, source->smoothed_cur_level);
+
 									if(source->buffer.size() >= src_samples_needed) // If there is sufficient data in the circular buffer:
 									{
 										// Copy data to temp_buf before we pop it from the source buffer.  NOTE: Could optimise by popping later, after we process the data, to avoid copying to temp_buf.
@@ -417,7 +430,7 @@ public:
 								// Resample audio to the audio engine and Resonance sampling rate.
 								resampled_buf.resizeNoCopy(frames_per_buffer);
 								
-								source->resampler.resample(resampled_buf.data(), frames_per_buffer, contiguous_data_ptr, src_samples_needed, temp_resampling_buf);
+								source->resampler.resample(resampled_buf.data(), frames_per_buffer, contiguous_data_ptr, src_samples_needed);
 
 								const float* bufptr = resampled_buf.data();
 								resonance->SetPlanarBuffer(source->resonance_handle, &bufptr, /*num channels=*/1, frames_per_buffer);
@@ -427,10 +440,16 @@ public:
 							if(remove_source)
 							{
 								resonance->DestroySource(source->resonance_handle);
-								it = engine->audio_sources.erase(it); // Remove currently iterated to source, advance iterator.
+
+								// Tell the engine the source has finished, so it can be removed from AudioEngine::audio_sources.
+								finished_sources.push_back(sources[z]);
+
+								// Remove from our list, by swapping with the last source.
+								sources[z] = sources.back();
+								sources.pop_back();
 							}
 							else
-								++it;
+								++z;
 						}
 
 						// Get mixed/filtered data from Resonance.
@@ -451,17 +470,20 @@ public:
 						//printVar(filled_valid_buffer);
 						if(!filled_valid_buffer)
 							break; // break while loop
-					} // End engine->mutex scope
+					}
 
 					// Push mixed/filtered data onto back of buffer that feeds to rtAudioCallback.
 					if(filled_valid_buffer)
 					{
-						Lock lock(callback_data->buffer_mutex);
 						callback_data->buffer.pushBackNItems(temp_buf.data(), frames_per_buffer * 2);
 						num_samples_buffered = callback_data->buffer.size();
 					}
 				}
 
+				// Pass finished sources back to the engine.  If the queue is full, try again next time.
+				while(!finished_sources.empty() && engine->finished_sources.tryPush(finished_sources.back()))
+					finished_sources.pop_back();
+
 				PlatformUtils::Sleep(1);
 			}
 		}
@@ -476,6 +498,33 @@ public:
 		die = 1;
 	}
 
+	void processSourceCommands()
+	{
+		AudioEngine::SourceCommand command;
+		while(engine->source_commands.tryPop(command))
+		{
+			if(command.type == AudioEngine::SourceCommand::Type_Add)
+			{
+				sources.push_back(command.source);
+			}
+			else if(command.type == AudioEngine::SourceCommand::Type_Remove)
+			{
+				for(size_t i=0; i<sources.size(); ++i)
+					if(sources[i] == command.source)
+					{
+						resonance->DestroySource(command.source->resonance_handle);
+						sources[i] = sources.back();
+						sources.pop_back();
+						break;
+					}
+			}
+			else if(command.type == AudioEngine::SourceCommand::Type_SetVoiceStream)
+			{
+				command.source->voice_stream = command.voice_stream;
+			}
+		}
+	}
+
 	AudioEngine* engine;
 	vraudio::ResonanceAudioApi* resonance;
 	AudioCallbackData* callback_data;
@@ -485,8 +534,10 @@ public:
 	uint64 buffers_processed;
 
 	js::Vector<float, 16> temp_buf;
-	js::Vector<float, 16> temp_resampling_buf;
 	js::Vector<float, 16> resampled_buf;
+
+	std::vector<AudioSourceRef> sources; // Sources being mixed.  Only accessed by this thread.
+	std::vector<AudioSourceRef> finished_sources; // Finished sources not yet passed back to the engine.
 };
 
 
@@ -603,6 +654,9 @@ void AudioEngine::init()
 		thread_manager.addThread(t);
 	}
 
+	// The mixing thread keeps around 512 * 4 samples queued, allow plenty of headroom above that.
+	callback_data.buffer.init(myMax<size_t>(16384, (size_t)buffer_frames * 2 * 16));
+
 	{
 		Reference<StreamerThread> t = new StreamerThread(this);
 		thread_manager.addThread(t);
@@ -708,8 +762,43 @@ void AudioEngine::addSource(AudioSourceRef source)
 
 	source->resampler.init(/*src rate=*/source->sampling_rate, this->sample_rate);
 
-	Lock lock(mutex);
-	audio_sources.insert(source);
+	if(source->type == AudioSource::SourceType_Streaming && source->buffer.capacity() == 0)
+		source->buffer.init(/*min capacity=*/1 << 14);
+
+	{
+		Lock lock(mutex);
+		removeFinishedSources();
+		audio_sources.insert(source);
+	}
+
+	pushSourceCommand(SourceCommand(SourceCommand::Type_Add, source));
+}
+
+
+void AudioEngine::removeFinishedSources()
+{
+	AudioSourceRef source;
+	while(finished_sources.tryPop(source))
+		audio_sources.erase(source);
+}
+
+
+void AudioEngine::pushSourceCommand(const SourceCommand& command)
+{
+	// The queue should only be full if the mixing thread has stalled, in which case wait for it.
+	while(!source_commands.tryPush(command))
+		PlatformUtils::Sleep(1);
+}
+
+
+void AudioEngine::setSourceVoiceStream(AudioSourceRef source, VoiceStreamDecoderRef voice_stream)
+{
+	if(!initialised)
+		return;
+
+	SourceCommand command(SourceCommand::Type_SetVoiceStream, source);
+	command.voice_stream = voice_stream;
+	pushSourceCommand(command);
 }
 
 
@@ -718,7 +807,7 @@ void AudioEngine::removeSource(AudioSourceRef source)
 	if(!initialised)
 		return;
 
-	resonance->DestroySource(source->resonance_handle);
+	pushSourceCommand(SourceCommand(SourceCommand::Type_Remove, source)); // The mixing thread will destroy the resonance source.
 
 	{
 		Lock lock(mutex);
@@ -913,7 +1002,11 @@ AudioSourceRef AudioEngine::addSourceFromStreamingSoundFile(const std::string& s
 		{
 			AudioSourceRef first_source = *first_source_it;
 
-			source->buffer = first_source->buffer;
+			// StreamerThread only pushes to the buffers while holding the mutex, so we can peek at first_source's buffer here.
+			source->buffer.init(first_source->buffer.capacity());
+			std::vector<float> temp(first_source->buffer.size());
+			const size_t num_copied = first_source->buffer.peekFrontNItems(temp.data(), temp.size());
+			source->buffer.pushBackNItems(temp.data(), num_copied);
 		}
 
 		sources_playing_streams[streamer].insert(source); // Add this audio source as a user of this stream.
@@ -938,8 +1031,124 @@ AudioSourceRef AudioEngine::addSourceFromStreamingSoundFile(const std::string& s
 #include "../utils/TestUtils.h"
 
 
+// Feeds a sine wave to some streaming sources, at roughly real-time rate, like StreamerThread or EmbeddedBrowser.
+class StressTestProducerThread : public MyThread
+{
+public:
+	StressTestProducerThread(const std::vector<glare::AudioSourceRef>& sources_, uint32 sample_rate_) : sources(sources_), sample_rate(sample_rate_), die(0) {}
+
+	virtual void run()
+	{
+		std::vector<float> samples(sample_rate / 100); // 10 ms of audio
+		double phase = 0;
+		while(die == 0)
+		{
+			for(size_t i=0; i<samples.size(); ++i)
+			{
+				samples[i] = (float)(0.01 * std::sin(phase));
+				phase += 2 * 3.14159265358979 * 440.0 / sample_rate;
+			}
+
+			for(size_t i=0; i<sources.size(); ++i)
+				if(sources[i]->buffer.freeSpace() >= samples.size())
+					sources[i]->buffer.pushBackNItems(samples.data(), samples.size());
+
+			PlatformUtils::Sleep(10);
+		}
+	}
+
+	std::vector<glare::AudioSourceRef> sources;
+	uint32 sample_rate;
+	glare::AtomicInt die;
+};
+
+
+// Holds AudioEngine::mutex for long periods, like a slow main thread.  This shouldn't cause xruns, as neither the mixer or the audio callback take the mutex.
+class StressTestMutexHogThread : public MyThread
+{
+public:
+	StressTestMutexHogThread(glare::AudioEngine* engine_) : engine(engine_), die(0) {}
+
+	virtual void run()
+	{
+		while(die == 0)
+		{
+			{
+				Lock lock(engine->mutex);
+				PlatformUtils::Sleep(50);
+			}
+			PlatformUtils::Sleep(1);
+		}
+	}
+
+	glare::AudioEngine* engine;
+	glare::AtomicInt die;
+};
+
+
+// Plays 200 streaming sources for a few seconds, while other threads feed them and hog the engine mutex, and reports the number of xruns.
+static void stressTestStreamingSources()
+{
+	glare::AudioEngine engine;
+	engine.init();
+
+	const int num_sources = 200;
+	const int num_producer_threads = 4;
+
+	std::vector<std::vector<glare::AudioSourceRef>> thread_sources(num_producer_threads);
+	for(int i=0; i<num_sources; ++i)
+	{
+		glare::AudioSourceRef source = new glare::AudioSource();
+		source->type = glare::AudioSource::SourceType_Streaming;
+		source->pos = Vec4f((float)(i % 20), (float)(i / 20), 0, 1);
+		source->sampling_rate = engine.getSampleRate();
+		engine.addSource(source);
+		thread_sources[i % num_producer_threads].push_back(source);
+	}
+
+	std::vector<Reference<StressTestProducerThread>> producers;
+	for(int i=0; i<num_producer_threads; ++i)
+	{
+		producers.push_back(new StressTestProducerThread(thread_sources[i], engine.getSampleRate()));
+		producers.back()->launch();
+	}
+
+	Reference<StressTestMutexHogThread> hog_thread = new StressTestMutexHogThread(&engine);
+	hog_thread->launch();
+
+	const uint64 initial_xruns = engine.getNumXRuns(); // Ignore xruns while starting up.
+	Timer timer;
+	while(timer.elapsed() < 5.0)
+		PlatformUtils::Sleep(10);
+	const uint64 num_xruns = engine.getNumXRuns() - initial_xruns;
+
+	hog_thread->die = 1;
+	hog_thread->join();
+	for(size_t i=0; i<producers.size(); ++i)
+	{
+		producers[i]->die = 1;
+		producers[i]->join();
+	}
+
+	for(size_t i=0; i<thread_sources.size(); ++i)
+		for(size_t z=0; z<thread_sources[i].size(); ++z)
+			engine.removeSource(thread_sources[i][z]);
+
+	conPrint("AudioEngine stress test: " + toString(num_sources) + " streaming sources, " + toString(timer.elapsed()) + " s, num xruns: " + toString(num_xruns));
+}
+
+
 void glare::AudioEngine::test()
 {
+	try
+	{
+		stressTestStreamingSources();
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
 	try
 	{
 		AudioEngine engine;
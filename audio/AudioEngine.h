@@ -7,13 +7,16 @@ Copyright Glare Technologies Limited 2021 -
 
 
 #include "AudioResampler.h"
+#include "VoiceJitterBuffer.h"
+#include "SPSCRingBuffer.h"
+#include "BoundedLockFreeQueue.h"
 #include "../maths/vec3.h"
 #include "../maths/vec2.h"
 #include "../maths/matrix3.h"
 #include "../maths/Quat.h"
 #include "../physics/jscol_aabbox.h"
-#include <utils/CircularBuffer.h>
 #include <utils/Mutex.h>
+#include <utils/AtomicInt.h>
 #include <utils/ThreadManager.h>
 #include <utils/Vector.h>
 #include <utils/VRef.h>
@@ -102,13 +105,21 @@ public:
 	int sampling_rate;
 	
 	// Audio data can either be in buffer or shared_buffer.
-	CircularBuffer<float> buffer; // Read from front, enqueue to back.  Used for type SourceType_Streaming only.
+	// buffer is read from the front by the mixing thread, and enqueued to the back by a single producer thread (e.g. StreamerThread).  Used for type SourceType_Streaming only.
+	// Allocated in AudioEngine::addSource().
+	SPSCRingBuffer<float> buffer;
+
+	// Set by the producer thread for buffer when the sampling rate of the data it enqueues changes, e.g. once StreamerThread has decoded the first MP3 frame.
+	// The mixing thread then updates sampling_rate and the resampler.  0 if not set.
+	glare::AtomicInt streamed_sampling_rate;
 
 	AudioBufferRef shared_buffer; // Used for SourceType_Looping and SourceType_OneShot types only.
 	size_t cur_read_i; // Current read index in shared_buffer.
 
 	std::vector<MixSource> mix_sources; // If this is non-empty, this audio source mixes pitch-shifted and volume-scaled sounds together.  Used for type SourceType_Streaming.
 
+	VoiceStreamDecoderRef voice_stream; // If non-null, buffer is filled with decoded voice chat audio from this as it is consumed.  Used for type SourceType_Streaming.
+
 	SourceType type;
 	SourceSpatialType spatial_type; // Default is SourceSpatialType_Spatial
 	bool remove_on_finish; // for SourceType_OneShot
@@ -141,8 +152,8 @@ typedef Reference<AudioSource> AudioSourceRef;
 
 struct AudioCallbackData
 {
-	Mutex buffer_mutex; // protects buffer
-	CircularBuffer<float> buffer			GUARDED_BY(buffer_mutex);
+	SPSCRingBuffer<float> buffer; // Mixed, interleaved stereo samples.  Written by ResonanceThread, read by rtAudioCallback without locking.
+	glare::AtomicInt num_xruns; // Number of times rtAudioCallback didn't have enough mixed data, or the device reported an underflow.
 
 	//ThreadSafeQueue<Reference<AudioBuffer>> audio_buffer_queue;
 	vraudio::ResonanceAudioApi* resonance;
@@ -169,6 +180,11 @@ public:
 
 	void removeSource(AudioSourceRef source);
 
+	// Sets the voice chat stream that a streaming source pulls audio from (see AudioSource::voice_stream).  voice_stream may be NULL.
+	void setSourceVoiceStream(AudioSourceRef source, VoiceStreamDecoderRef voice_stream);
+
+	uint64 getNumXRuns() const { return (uint64)callback_data.num_xruns; }
+
 	//AudioSourceRef addSourceFromSoundFile(const std::string& sound_file_path);
 
 	AudioSourceRef addSourceFromStreamingSoundFile(const std::string& sound_file_path, const Vec4f& pos, float source_volume, double global_time);
@@ -193,9 +209,32 @@ public:
 	SoundFileRef getOrLoadSoundFile(const std::string& sound_file_path);
 
 	static void test();
+
+	// Changes to the set of sources being mixed, and to mixing state, are sent to the mixing thread (ResonanceThread) through source_commands,
+	// so that it doesn't have to lock anything.
+	struct SourceCommand
+	{
+		enum Type
+		{
+			Type_Add,
+			Type_Remove,
+			Type_SetVoiceStream
+		};
+
+		SourceCommand() : type(Type_Add) {}
+		SourceCommand(Type type_, const AudioSourceRef& source_) : type(type_), source(source_) {}
+
+		Type type;
+		AudioSourceRef source;
+		VoiceStreamDecoderRef voice_stream; // For Type_SetVoiceStream
+	};
+
 private:
 	SoundFileRef loadSoundFile(const std::string& sound_file_path);
 
+	void pushSourceCommand(const SourceCommand& command);
+	void removeFinishedSources();
+
 	RtAudio* audio;
 	vraudio::ResonanceAudioApi* resonance;
 
@@ -204,8 +243,11 @@ private:
 	bool initialised;
 
 public:
-	Mutex mutex; // Guards access to audio_sources, and resonance
-	std::set<AudioSourceRef> audio_sources			GUARDED_BY(mutex);
+	Mutex mutex; // Guards access to audio_sources, and the MP3 streams.  Not taken by the mixing thread or the real-time audio callback.
+	std::set<AudioSourceRef> audio_sources			GUARDED_BY(mutex); // Sources that have been added and not removed or finished.  The mixing thread keeps its own list.
+
+	BoundedLockFreeQueue<SourceCommand> source_commands; // Consumed by ResonanceThread.
+	BoundedLockFreeQueue<AudioSourceRef> finished_sources; // One-shot sources that ResonanceThread has finished playing, to be removed from audio_sources.
 
 	ThreadManager thread_manager; // Manages: ResonanceThread, StreamerThread
 
@@ -9,195 +9,419 @@ Copyright Glare Technologies Limited 2023 -
 #include <utils/ConPrint.h>
 #include <utils/StringUtils.h>
 #include <utils/PlatformUtils.h>
+#include <utils/Mutex.h>
+#include <utils/Lock.h>
+#include <maths/mathstypes.h>
+#include <map>
+#include <cstring>
+#include <cmath>
+
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RESAMPLER_X86 1
+#include <immintrin.h>
+#if defined(_WIN32)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC allows AVX2 intrinsics without compiling the whole file for AVX2, so we can detect support at runtime.
+// With GCC and Clang we only use AVX2 if the file is compiled with it enabled.  (Our Linux and Mac builds define __NO_AVX__)
+#if RESAMPLER_X86 && !defined(__NO_AVX__) && (defined(_WIN32) || defined(__AVX2__))
+#define RESAMPLER_AVX2_SUPPORT 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define RESAMPLER_NEON 1
+#include <arm_neon.h>
+#endif
 
 
 namespace glare
 {
-	
 
-AudioResampler::AudioResampler()
+
+static const int BASE_NUM_TAPS = 48; // Number of filter taps when upsampling.  Must be a multiple of 8.
+static const int MAX_NUM_TAPS = 256;
+static const double STOPBAND_ATTENUATION_DB = 80;
+
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window.
+static double besselI0(double x)
 {
-	init(48000, 48000);
+	double sum = 1;
+	double term = 1;
+	for(int k=1; k<50; ++k)
+	{
+		const double a = x / (2 * k);
+		term *= a * a;
+		sum += term;
+		if(term < sum * 1.0e-12)
+			break;
+	}
+	return sum;
 }
 
 
-void AudioResampler::init(int src_rate_, int dest_rate_)
+static double sinc(double x)
 {
-	src_rate = src_rate_;
-	dest_rate = dest_rate_;
-	prev_dest_dst_coords = -1;
-
-	prev_samples_0_src_coords = -2;
-	prev_samples[0] = 0;
-	prev_samples[1] = 0;
+	if(x == 0)
+		return 1;
+	const double pi_x = 3.14159265358979323846 * x;
+	return std::sin(pi_x) / pi_x;
 }
 
 
-// Use coordinates x such that:
-// Src samples are spaced uniformly at x=0, x=1, x=2 etc.
-// Dest samples are at x=dest_0_x, dest_0_x+dest_w, dest_0_x+2*dest_w  etc.
-//
-// Currently just doing linear interpolation between source samples (e.g. tent filter).
-//
-// In the example below, evaluating the signal at dest index 0, we interpolate between the value
-// at src sample at x=1 and the src sample at x=2.
-// If num_dest = 4, then we are evaluating up to dest_3, so should have src samples at x=0 to x=4. (e.g. num_src should be >= 5)
-//
-//                     dest index=0       1       2       3       4       5       6
-//                                |-------|-------|-------|-------|-------|-------|-------|-> dest coords
-//                    
-//                             
-//   |-----------------|----------|----|--|-----------|---|-----------|-------------|----->   src coords
-//  x=0               x=1         |   x=2 |           x=3 |           x=4           x=5
-//                     |          |       |               |
-//                     d_i    dext_0_x   dest_1_x       dest_3_x
-//                                |       |
-//                                |<----->|
-//                                 dest_w
-static void resampleFromContiguousBuffer(float* dest_samples, size_t num_dest, const float* src_samples, size_t num_src, double dest_x_0, double dest_w)
+static int64 gcd(int64 a, int64 b)
 {
-	assert(dest_x_0 >= 0);
-	assert((size_t)std::ceil(dest_x_0 + (num_dest - 1) * dest_w) <= num_src);
-	double dest_i_x = dest_x_0; // x coordinate (source coordinate relative to source sample 0) of destination sample i.
-	const int max_src_i = (int)num_src - 1;
-	for(size_t i=0; i<num_dest; ++i)
+	while(b != 0)
 	{
-		const int d_i = (int)dest_i_x;
-		const float frac = (float)(dest_i_x - d_i);
+		const int64 t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
 
-		const int d_i_plus_1 = d_i + 1;
 
-		dest_i_x += dest_w;
-		const float val = src_samples[myClamp(d_i, 0, max_src_i)] * (1 - frac) + src_samples[myClamp(d_i_plus_1, 0, max_src_i)] * frac;
-		dest_samples[i] = val;
+// Resampling ratio is src_rate / dest_rate = M / L.
+static ResamplingFilterBankRef computeFilterBank(int64 L, int64 M)
+{
+	ResamplingFilterBankRef bank = new ResamplingFilterBank();
+
+	// When downsampling, widen the kernel in proportion to the ratio, so that the transition band is the same relative to the output Nyquist frequency.
+	int num_taps = BASE_NUM_TAPS;
+	if(M > L)
+		num_taps = (int)std::ceil(BASE_NUM_TAPS * (double)M / (double)L);
+	num_taps = myMin(MAX_NUM_TAPS, (num_taps + 7) / 8 * 8);
+
+	const double A = STOPBAND_ATTENUATION_DB;
+	const double beta = 0.1102 * (A - 8.7);
+	const double transition_width = (A - 7.95) / (14.36 * (num_taps - 1)); // Kaiser's estimate, in cycles per source sample.
+
+	// Place the stopband edge at the lower of the two Nyquist frequencies.
+	const double nyquist = 0.5 * myMin(1.0, (double)L / (double)M);
+	const double cutoff = myMax(nyquist - 0.5 * transition_width, 0.5 * nyquist); // Cutoff frequency in cycles per source sample.  Clamp for the case where num_taps was capped.
+
+	bank->num_taps = num_taps;
+	bank->exact_phases = L <= AudioResampler::MAX_EXACT_PHASES;
+	bank->num_phases = bank->exact_phases ? (int)L : AudioResampler::NUM_INTERPOLATED_PHASES;
+	bank->coeffs.resize((bank->num_phases + 1) * num_taps); // The extra phase is for interpolating between phases.
+
+	const double half_width = num_taps / 2;
+	const double inv_I0_beta = 1 / besselI0(beta);
+	for(int p=0; p<=bank->num_phases; ++p)
+	{
+		// Tap k is for the source sample at offset d = k - (num_taps/2 - 1) - frac from the destination sample position.
+		const double frac = (double)p / bank->num_phases;
+		float* const phase_coeffs = &bank->coeffs[p * num_taps];
+
+		double sum = 0;
+		for(int k=0; k<num_taps; ++k)
+		{
+			const double d = k - (half_width - 1) - frac;
+			const double x = d / half_width;
+			const double window = (std::fabs(x) < 1) ? besselI0(beta * std::sqrt(1 - x*x)) * inv_I0_beta : 0.0;
+			const double val = 2 * cutoff * sinc(2 * cutoff * d) * window;
+			phase_coeffs[k] = (float)val;
+			sum += val;
+		}
+
+		// Normalise so that each phase has unit gain at DC.
+		const float scale = (float)(1 / sum);
+		for(int k=0; k<num_taps; ++k)
+			phase_coeffs[k] *= scale;
 	}
+
+	return bank;
 }
 
 
-size_t AudioResampler::numSrcSamplesNeeded(size_t dest_num_samples)
+static Mutex filter_banks_mutex;
+static std::map<std::pair<int64, int64>, ResamplingFilterBankRef> filter_banks; // Map from (L, M) to filter bank.
+
+
+static ResamplingFilterBankRef getResamplingFilterBank(int64 L, int64 M)
 {
-	const int64 max_dest_dst_coords = prev_dest_dst_coords + dest_num_samples; // Get destination coordinate for largest destination sample to be computed
-	const double max_dest_x_src_coords  = max_dest_dst_coords * (double)src_rate / (double)dest_rate; // Source coordinates for the new rightmost destination sample.
+	Lock lock(filter_banks_mutex);
 
-	const int64 prev_samples_1_src_coords = this->prev_samples_0_src_coords + 1; // Source coordinates for prev_samples[1]
+	auto res = filter_banks.find(std::make_pair(L, M));
+	if(res != filter_banks.end())
+		return res->second;
 
-	const size_t num_needed = (size_t)std::ceil(max_dest_x_src_coords) - prev_samples_1_src_coords;
-	return num_needed;
+	ResamplingFilterBankRef bank = computeFilterBank(L, M);
+	filter_banks[std::make_pair(L, M)] = bank;
+	return bank;
 }
 
 
-void AudioResampler::resample(float* dest_samples, size_t dest_samples_size, const float* src_samples, size_t src_samples_size, js::Vector<float, 16>& temp_buf)
+static bool isAVX2Supported()
 {
-#if 1
-	// Simpler code that just forms a temporary buffer of source samples.  Less efficient due to copying of samples to the temp buffer.
-	
-	// Form a contiguous buffer of source samples
-	temp_buf.resizeNoCopy(src_samples_size + 2);
-	temp_buf[0] = prev_samples[0];
-	temp_buf[1] = prev_samples[1];
-	for(size_t i=0; i<src_samples_size; ++i)
-		temp_buf[2 + i] = src_samples[i];
-
-	const int64 dest_0_dest_coords = prev_dest_dst_coords + 1;
-	const double dest_0_src_coords = dest_0_dest_coords * (double)src_rate / (double)dest_rate;
-	const double dest_0_x = dest_0_src_coords - prev_samples_0_src_coords;
-	resampleFromContiguousBuffer(dest_samples, dest_samples_size, temp_buf.data(), temp_buf.size(), 
-		dest_0_x, // dest_0 x coord (in source coords where source sample 0 has x = 0)
-		(double)src_rate / (double)dest_rate // dest_w (in source coords where source coord 0 has x = 0)
-	);
-
-	prev_dest_dst_coords += dest_samples_size;
-	prev_samples_0_src_coords += src_samples_size;
-
-	prev_samples[0] = temp_buf[temp_buf.size() - 2];
-	prev_samples[1] = temp_buf[temp_buf.size() - 1];
+#if RESAMPLER_AVX2_SUPPORT
+#if defined(_WIN32)
+	int info[4];
+	__cpuid(info, 1);
+	const bool os_saves_ymm = (info[2] & (1 << 27)) != 0; // OSXSAVE
+	const bool fma = (info[2] & (1 << 12)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if(!(os_saves_ymm && fma && avx) || ((_xgetbv(0) & 0x6) != 0x6))
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0; // AVX2
 #else
-	// More effcient (in theory) but more complicated code.  Not sure worth the complexity.
-
-// 
-//  Suppose 200 was the last dest coord evaluated.
-//  To evaluate it we need source sample at coord 100 and 101.  So we need to keep those around to evaluate dest coord 201 in the next call of resample.
-// 
-// --------prefix-------------------->|<---------------suffix-----------------------
-//         200      201     202     203    204     205     206
-//       ----|-------|-------|-------|-------|-------|-------|-------|-> dest coords
-//                    
-//                             
-//   |-------|---------|--------------|-------------|--------------|-------------|----->   src coords
-//  100      |        101            102            103            104           105
-// prev_samples_0    prev_samples_1
-//  x=0      |        x=1            x=2           x=3            x=4            x=5
-//         dest_0_x
-//          
-// Lets say we have 2 prev_samples at src coords 100 and 101.  For destination samples to be a function of them, they must have src_coords <= 102, e.g src_coords <= prev_samples_0_src_coords + 2
-// The largest dest sample meeting this requirement is 203.
-// So if 200 was the last dest coord evaluated, we need to use a prefix of 3 samples (201, 202, 203) to evaluate all samples which are a function of src samples 100 and 101.
-	
-	const size_t prefix_num_src = (src_samples_size == 0) ? 2 : 3;
-
-	temp_buf.resizeNoCopy(prefix_num_src);
-	temp_buf[0] = prev_samples[0];
-	temp_buf[1] = prev_samples[1];
-	for(size_t i=0; i<prefix_num_src - 2; ++i)
-		temp_buf[2 + i] = src_samples[i];
-
-
-	const size_t prefix_max_src = prev_samples_0_src_coords + 2;
-	const double prefix_max_dest = prefix_max_src * (double)dest_rate / (double)src_rate;
-	const int64 prefix_max_dest_int = (int64)prefix_max_dest;
-	
-	const size_t prefix_num_dest = myMin<size_t>(prefix_max_dest_int - prev_dest_dst_coords, dest_samples_size);
-
-	const double dest_w_src_coords = (double)src_rate / (double)dest_rate;
-
-	if(prefix_num_dest > 0) // If prefix has non-zero length:
+	return true; // Compiled with AVX2 enabled.
+#endif
+#else
+	return false;
+#endif
+}
+
+
+// Inner products of num_taps filter coefficients (aligned) with source samples (unaligned).  num_taps is a multiple of 8.
+
+struct ScalarDotProduct
+{
+	static inline float dot(const float* coeffs, const float* data, int num_taps)
 	{
-		const int64 dest_0_dest_coords = prev_dest_dst_coords + 1;
-		const double dest_0_src_coords = dest_0_dest_coords * dest_w_src_coords;
-		const double dest_0_x = dest_0_src_coords - prev_samples_0_src_coords;
-		resampleFromContiguousBuffer(dest_samples, prefix_num_dest, temp_buf.data(), temp_buf.size(), 
-			dest_0_x, // dest_0 x coord (in source coords where source sample 0 has x = 0)
-			dest_w_src_coords // dest_w (in source coords where source coord 0 has x = 0)
-		);
+		float sum = 0;
+		for(int i=0; i<num_taps; ++i)
+			sum += coeffs[i] * data[i];
+		return sum;
 	}
-	
-	if(dest_samples_size > prefix_num_dest) // If suffix has non-zero length:
+};
+
+#if RESAMPLER_X86
+struct SSEDotProduct
+{
+	static inline float dot(const float* coeffs, const float* data, int num_taps)
 	{
-		// Do the suffix destination samples, that don't depend on prev_samples.
-		// 
-		//   ------prefix-------------------->|<---------------suffix-----------------------
-		//         200      201     202     203    204     205     206
-		//       ----|-------|-------|-------|-------|-------|-------|-------|-> dest coords
-		//                    
-		//                             
-		//   |-----------------|--------------|-------------|--------------|-------------|----->   src coords
-		//  100               101            102            103            104           105
-		// prev_samples_0    prev_samples_1  x=0            x=1            x=2           x=3
-		//                                           |
-		//                                         dest_0_x
-		const int64 suffix_dest_0_dst_coords = prefix_max_dest_int + 1;
-		const double suffix_dest_0_src_coords = suffix_dest_0_dst_coords * dest_w_src_coords;
-		const double suffix_dest_0_x = suffix_dest_0_src_coords - (prev_samples_0_src_coords + 2);
-		resampleFromContiguousBuffer(dest_samples + prefix_num_dest, dest_samples_size - prefix_num_dest, src_samples, src_samples_size, 
-			suffix_dest_0_x, // dest_0 x coord (in source coords where source sample 0 has x = 0)
-			dest_w_src_coords
-		);
+		__m128 sum_0 = _mm_setzero_ps();
+		__m128 sum_1 = _mm_setzero_ps();
+		for(int i=0; i<num_taps; i += 8)
+		{
+			sum_0 = _mm_add_ps(sum_0, _mm_mul_ps(_mm_load_ps(coeffs + i),     _mm_loadu_ps(data + i)));
+			sum_1 = _mm_add_ps(sum_1, _mm_mul_ps(_mm_load_ps(coeffs + i + 4), _mm_loadu_ps(data + i + 4)));
+		}
+		__m128 sum = _mm_add_ps(sum_0, sum_1);
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum)); // Add upper 2 lanes to lower 2 lanes
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		return _mm_cvtss_f32(sum);
 	}
+};
+#endif
 
-	prev_dest_dst_coords += dest_samples_size;
-	prev_samples_0_src_coords += src_samples_size;
+#if RESAMPLER_AVX2_SUPPORT
+struct AVX2DotProduct
+{
+	static inline float dot(const float* coeffs, const float* data, int num_taps)
+	{
+		__m256 sum = _mm256_setzero_ps();
+		for(int i=0; i<num_taps; i += 8)
+			sum = _mm256_fmadd_ps(_mm256_load_ps(coeffs + i), _mm256_loadu_ps(data + i), sum);
+
+		__m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+		sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+		sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+		return _mm_cvtss_f32(sum4);
+	}
+};
+#endif
+
+#if RESAMPLER_NEON
+struct NEONDotProduct
+{
+	static inline float dot(const float* coeffs, const float* data, int num_taps)
+	{
+		float32x4_t sum_0 = vdupq_n_f32(0);
+		float32x4_t sum_1 = vdupq_n_f32(0);
+		for(int i=0; i<num_taps; i += 8)
+		{
+#if defined(__aarch64__) || defined(_M_ARM64)
+			sum_0 = vfmaq_f32(sum_0, vld1q_f32(coeffs + i),     vld1q_f32(data + i));
+			sum_1 = vfmaq_f32(sum_1, vld1q_f32(coeffs + i + 4), vld1q_f32(data + i + 4));
+#else
+			sum_0 = vmlaq_f32(sum_0, vld1q_f32(coeffs + i),     vld1q_f32(data + i));
+			sum_1 = vmlaq_f32(sum_1, vld1q_f32(coeffs + i + 4), vld1q_f32(data + i + 4));
+#endif
+		}
+		const float32x4_t sum = vaddq_f32(sum_0, sum_1);
+#if defined(__aarch64__) || defined(_M_ARM64)
+		return vaddvq_f32(sum);
+#else
+		const float32x2_t sum2 = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+		return vget_lane_f32(vpadd_f32(sum2, sum2), 0);
+#endif
+	}
+};
+#endif
+
+
+struct ResampleLoopArgs
+{
+	const ResamplingFilterBank* bank;
+	int64 L, M_div_L, M_mod_L;
+
+	const float* history; // Source samples before src, followed by the first num_taps - 1 samples of src.
+	int64 history_start; // Padded index of history[0]
+	const float* src;
+	int64 src_start; // Padded index of src[0]
+	int64 src_end; // Padded index of the end of src.
+};
+
+
+template <class DotProduct>
+static void resampleLoop(float* dest_samples, size_t dest_samples_size, const ResampleLoopArgs& args, int64& base, int64& phase)
+{
+	const int num_taps = args.bank->num_taps;
+	const float* const coeffs = args.bank->coeffs.data();
+	const bool exact_phases = args.bank->exact_phases;
+	const float phase_scale = (float)args.bank->num_phases / (float)args.L; // Converts phase to an interpolated phase index.
+
+	for(size_t i=0; i<dest_samples_size; ++i)
+	{
+		float val;
+		if(base + num_taps > args.src_end) // If not enough source samples were passed in.  Shouldn't happen.
+		{
+			val = 0;
+		}
+		else
+		{
+			assert(base >= args.history_start);
+			// Kernels that straddle the previous and current source chunks read from history, others read directly from src.
+			const float* const data = (base < args.src_start) ? (args.history + (base - args.history_start)) : (args.src + (base - args.src_start));
+
+			if(exact_phases)
+				val = DotProduct::dot(coeffs + phase * num_taps, data, num_taps);
+			else
+			{
+				const float p = (float)phase * phase_scale;
+				const int p_i = myMin((int)p, args.bank->num_phases - 1);
+				const float t = p - (float)p_i;
+				val = DotProduct::dot(coeffs + p_i * num_taps, data, num_taps) * (1 - t) + DotProduct::dot(coeffs + (p_i + 1) * num_taps, data, num_taps) * t;
+			}
+		}
+		dest_samples[i] = val;
+
+		// Advance source position by M / L.
+		base += args.M_div_L;
+		phase += args.M_mod_L;
+		if(phase >= args.L)
+		{
+			phase -= args.L;
+			base++;
+		}
+	}
+}
 
-	if(src_samples_size >= 2)
+
+AudioResampler::AudioResampler()
+{
+	use_avx2 = isAVX2Supported();
+	init(48000, 48000);
+}
+
+
+void AudioResampler::init(int src_rate_, int dest_rate_)
+{
+	src_rate = src_rate_;
+	dest_rate = dest_rate_;
+	passthrough = src_rate == dest_rate;
+
+	const int64 g = gcd(src_rate, dest_rate);
+	L = dest_rate / g;
+	const int64 M = src_rate / g;
+	M_div_L = M / L;
+	M_mod_L = M % L;
+
+	if(passthrough)
+	{
+		filter_bank = NULL;
+		num_taps = 0;
+		history.clearAndFreeMem();
+	}
+	else
 	{
-		prev_samples[0] = src_samples[src_samples_size - 2];
-		prev_samples[1] = src_samples[src_samples_size - 1];
+		filter_bank = getResamplingFilterBank(L, M);
+		num_taps = filter_bank->num_taps;
+
+		history.resizeNoCopy(2 * num_taps - 1);
+		for(size_t i=0; i<history.size(); ++i)
+			history[i] = 0;
 	}
-	else if(src_samples_size >= 1)
+
+	next_base = 0;
+	next_phase = 0;
+	num_padded_consumed = num_taps - 1; // The padding zeroes are in history already.
+}
+
+
+size_t AudioResampler::numSrcSamplesNeeded(size_t dest_num_samples) const
+{
+	if(passthrough)
+		return dest_num_samples;
+	if(dest_num_samples == 0)
+		return 0;
+
+	// Work out the kernel window for the last destination sample.
+	const int64 last_phase_sum = next_phase + (int64)(dest_num_samples - 1) * M_mod_L;
+	const int64 last_base = next_base + (int64)(dest_num_samples - 1) * M_div_L + last_phase_sum / L;
+
+	return (size_t)myMax<int64>(0, last_base + num_taps - num_padded_consumed);
+}
+
+
+void AudioResampler::resample(float* dest_samples, size_t dest_samples_size, const float* src_samples, size_t src_samples_size)
+{
+	if(passthrough)
 	{
-		prev_samples[0] = prev_samples[1];
-		prev_samples[1] = src_samples[src_samples_size - 1];
+		assert(src_samples_size == dest_samples_size);
+		const size_t num = myMin(src_samples_size, dest_samples_size);
+		std::memcpy(dest_samples, src_samples, num * sizeof(float));
+		for(size_t i=num; i<dest_samples_size; ++i)
+			dest_samples[i] = 0;
+		return;
 	}
+
+	assert(src_samples_size == numSrcSamplesNeeded(dest_samples_size));
+
+	// Append the first few samples of src to history, so kernels that straddle the two can read contiguous data.
+	float* const history_data = history.data();
+	const size_t num_src_in_history = myMin(src_samples_size, (size_t)num_taps - 1);
+	if(num_src_in_history > 0)
+		std::memcpy(history_data + num_taps, src_samples, num_src_in_history * sizeof(float));
+
+	ResampleLoopArgs args;
+	args.bank = filter_bank.ptr();
+	args.L = L;
+	args.M_div_L = M_div_L;
+	args.M_mod_L = M_mod_L;
+	args.history = history_data;
+	args.history_start = num_padded_consumed - num_taps;
+	args.src = src_samples;
+	args.src_start = num_padded_consumed;
+	args.src_end = num_padded_consumed + (int64)src_samples_size;
+
+#if RESAMPLER_AVX2_SUPPORT
+	if(use_avx2)
+		resampleLoop<AVX2DotProduct>(dest_samples, dest_samples_size, args, next_base, next_phase);
+	else
+		resampleLoop<SSEDotProduct>(dest_samples, dest_samples_size, args, next_base, next_phase);
+#elif RESAMPLER_X86
+	resampleLoop<SSEDotProduct>(dest_samples, dest_samples_size, args, next_base, next_phase);
+#elif RESAMPLER_NEON
+	resampleLoop<NEONDotProduct>(dest_samples, dest_samples_size, args, next_base, next_phase);
+#else
+	resampleLoop<ScalarDotProduct>(dest_samples, dest_samples_size, args, next_base, next_phase);
 #endif
+
+	// Keep the last num_taps source samples for the next call.
+	if(src_samples_size >= (size_t)num_taps)
+		std::memcpy(history_data, src_samples + src_samples_size - num_taps, num_taps * sizeof(float));
+	else
+		std::memmove(history_data, history_data + src_samples_size, num_taps * sizeof(float)); // history_data has num_taps + src_samples_size valid samples.
+
+	num_padded_consumed += (int64)src_samples_size;
 }
 
 
@@ -208,83 +432,241 @@ void AudioResampler::resample(float* dest_samples, size_t dest_samples_size, con
 
 
 #include <utils/TestUtils.h>
+#include <utils/Timer.h>
+#include <vector>
 
 
-static void testResamplingLinearRamp(int src_sample_rate, int dest_sample_rate)
+// The previous resampler implementation, which does linear interpolation from a temporary copy of the source samples.  Used as a reference for the benchmark.
+class LinearReferenceResampler
 {
-	const int N = 10000;
-	std::vector<float> src_data(N);
-
+public:
+	LinearReferenceResampler(int src_rate_, int dest_rate_) : src_rate(src_rate_), dest_rate(dest_rate_), prev_dest_dst_coords(-1), prev_samples_0_src_coords(-2)
+	{
+		prev_samples[0] = prev_samples[1] = 0;
+	}
 
-	// Test with linear ramp
-	for(int i=0; i<N; ++i)
-		src_data[i] = (float)i;
+	size_t numSrcSamplesNeeded(size_t dest_num_samples)
+	{
+		const int64 max_dest_dst_coords = prev_dest_dst_coords + dest_num_samples;
+		const double max_dest_x_src_coords  = max_dest_dst_coords * (double)src_rate / (double)dest_rate;
+		const int64 prev_samples_1_src_coords = this->prev_samples_0_src_coords + 1;
+		return (size_t)std::ceil(max_dest_x_src_coords) - prev_samples_1_src_coords;
+	}
 
-	glare::AudioResampler resampler;
-	resampler.init(src_sample_rate, dest_sample_rate);
+	void resample(float* dest_samples, size_t dest_samples_size, const float* src_samples, size_t src_samples_size)
+	{
+		temp_buf.resizeNoCopy(src_samples_size + 2);
+		temp_buf[0] = prev_samples[0];
+		temp_buf[1] = prev_samples[1];
+		for(size_t i=0; i<src_samples_size; ++i)
+			temp_buf[2 + i] = src_samples[i];
 
-	const int dest_chunk_size = 4;
-	const int dest_N = dest_chunk_size * 10;
+		const int64 dest_0_dest_coords = prev_dest_dst_coords + 1;
+		const double dest_w = (double)src_rate / (double)dest_rate;
+		double dest_i_x = dest_0_dest_coords * dest_w - prev_samples_0_src_coords;
+		const int max_src_i = (int)temp_buf.size() - 1;
+		for(size_t i=0; i<dest_samples_size; ++i)
+		{
+			const int d_i = (int)dest_i_x;
+			const float frac = (float)(dest_i_x - d_i);
+			dest_i_x += dest_w;
+			dest_samples[i] = temp_buf[myClamp(d_i, 0, max_src_i)] * (1 - frac) + temp_buf[myClamp(d_i + 1, 0, max_src_i)] * frac;
+		}
+
+		prev_dest_dst_coords += dest_samples_size;
+		prev_samples_0_src_coords += src_samples_size;
+		prev_samples[0] = temp_buf[temp_buf.size() - 2];
+		prev_samples[1] = temp_buf[temp_buf.size() - 1];
+	}
 
+	int src_rate, dest_rate;
+	int64 prev_dest_dst_coords;
+	int64 prev_samples_0_src_coords;
+	float prev_samples[2];
 	js::Vector<float, 16> temp_buf;
+};
+
 
+static double testSignal(double t, double freq)
+{
+	return 0.5 * std::sin(2 * 3.14159265358979323846 * freq * t);
+}
+
+
+// Resamples src_data in chunks of dest_chunk_size destination samples, as the mixer does.
+template <class Resampler>
+static std::vector<float> resampleInChunks(Resampler& resampler, const std::vector<float>& src_data, size_t dest_chunk_size, size_t dest_N)
+{
 	std::vector<float> resampled(dest_N);
 	size_t src_i = 0;
-	for(int i=0; i<dest_N; i += dest_chunk_size)
+	for(size_t i=0; i + dest_chunk_size <= dest_N; i += dest_chunk_size)
 	{
 		const size_t num_src_needed = resampler.numSrcSamplesNeeded(dest_chunk_size);
 		testAssert(src_i + num_src_needed <= src_data.size());
-		resampler.resample(&resampled[i], dest_chunk_size, &src_data[src_i], num_src_needed, temp_buf);
-
+		resampler.resample(&resampled[i], dest_chunk_size, &src_data[src_i], num_src_needed);
 		src_i += num_src_needed;
 	}
+	return resampled;
+}
 
-	// Check resampled samples
-	for(int i=0; i<dest_N; ++i)
+
+// Returns the SNR in dB of resampled against the test signal.  src_delay is the delay in source samples.
+// Ignores the start, where the filter is warming up, and the end.
+static double computeSNR(const std::vector<float>& resampled, int src_sample_rate, int dest_sample_rate, double freq, double src_delay)
+{
+	const size_t margin = (size_t)((4 * src_delay + 4) * dest_sample_rate / src_sample_rate);
+
+	double signal_power = 0;
+	double noise_power = 0;
+	for(size_t i=margin; i + margin < resampled.size(); ++i)
 	{
-		const double expected = (double)i * (double)src_sample_rate / (double)dest_sample_rate;
-		testMathsApproxEq((double)resampled[i], expected);
+		const double t = (double)i / dest_sample_rate - src_delay / src_sample_rate;
+		const double expected = testSignal(t, freq);
+		signal_power += expected * expected;
+		noise_power += (resampled[i] - expected) * (resampled[i] - expected);
 	}
-
+	return 10 * std::log10(signal_power / myMax(noise_power, 1.0e-30));
 }
 
 
-void glare::AudioResampler::test()
+// Resamples a test tone, and checks the output against the tone evaluated at the destination sample times.
+static void testResamplingAccuracy(int src_sample_rate, int dest_sample_rate)
 {
-	testResamplingLinearRamp(/*src rate=*/8000, /*dest rate=*/48000);
-	testResamplingLinearRamp(/*src rate=*/12000, /*dest rate=*/48000);
-	testResamplingLinearRamp(/*src rate=*/16000, /*dest rate=*/48000);
-	testResamplingLinearRamp(/*src rate=*/24000, /*dest rate=*/48000);
-	testResamplingLinearRamp(/*src rate=*/48000, /*dest rate=*/48000);
+	const int src_N = 20000;
+	const double freq = 0.2 * myMin(src_sample_rate, dest_sample_rate); // Test tone at 40% of the lower Nyquist frequency.
 
-	// Test an integer ratio not handled as a special case:
-	testResamplingLinearRamp(/*src rate=*/6000, /*dest rate=*/48000);
+	std::vector<float> src_data(src_N);
+	for(int i=0; i<src_N; ++i)
+		src_data[i] = (float)testSignal((double)i / src_sample_rate, freq);
 
-	testResamplingLinearRamp(/*src rate=*/44100, /*dest rate=*/48000);
+	glare::AudioResampler resampler;
+	resampler.init(src_sample_rate, dest_sample_rate);
 
+	const size_t dest_chunk_size = 64;
+	const size_t dest_N = (size_t)((src_N - 600) * (double)dest_sample_rate / src_sample_rate) / dest_chunk_size * dest_chunk_size;
+	const std::vector<float> resampled = resampleInChunks(resampler, src_data, dest_chunk_size, dest_N);
 
-	testResamplingLinearRamp(/*src rate=*/8000, /*dest rate=*/44100);
-	testResamplingLinearRamp(/*src rate=*/12000, /*dest rate=*/44100);
-	testResamplingLinearRamp(/*src rate=*/16000, /*dest rate=*/44100);
-	testResamplingLinearRamp(/*src rate=*/24000, /*dest rate=*/44100);
-	testResamplingLinearRamp(/*src rate=*/48000, /*dest rate=*/44100);
-	
-	testResamplingLinearRamp(/*src rate=*/44100, /*dest rate=*/44100);
+	const double snr = computeSNR(resampled, src_sample_rate, dest_sample_rate, freq, resampler.delayInSrcSamples());
+	testAssert(snr > 70);
+}
 
 
-	{
-		
-		//// Test with 1 hz sine tone
-		//for(int i=0; i<N; ++i)
-		//{
-		//	const double x = i / 44100.0;
-		//	const double val = std::sin(1.0 * Maths::get2Pi<double>() * x);
-		//	src_data[i] = val;
-		//}
+// Check that the output doesn't depend on how the source is split into chunks.
+static void testChunkSizeIndependence(int src_sample_rate, int dest_sample_rate)
+{
+	const int src_N = 10000;
+	std::vector<float> src_data(src_N);
+	for(int i=0; i<src_N; ++i)
+		src_data[i] = (float)testSignal((double)i / src_sample_rate, 1000.0) + ((i * 7919) % 101) * 0.001f; // Add some non-bandlimited junk as well.
+
+	const size_t dest_N = 4096;
+
+	glare::AudioResampler resampler_a;
+	resampler_a.init(src_sample_rate, dest_sample_rate);
+	const std::vector<float> resampled_a = resampleInChunks(resampler_a, src_data, /*dest chunk size=*/dest_N, dest_N); // All in one go.
 
+	// Use a varying chunk size, including chunks of size 0 and 1.
+	glare::AudioResampler resampler_b;
+	resampler_b.init(src_sample_rate, dest_sample_rate);
+	std::vector<float> resampled_b(dest_N);
+	size_t src_i = 0;
+	size_t dest_i = 0;
+	for(int iter=0; dest_i < dest_N; ++iter)
+	{
+		const size_t chunk_size = myMin<size_t>((iter * 37) % 300, dest_N - dest_i);
+		const size_t num_src_needed = resampler_b.numSrcSamplesNeeded(chunk_size);
+		testAssert(src_i + num_src_needed <= src_data.size());
+		resampler_b.resample(&resampled_b[dest_i], chunk_size, src_data.data() + src_i, num_src_needed);
+		src_i += num_src_needed;
+		dest_i += chunk_size;
 	}
 
+	for(size_t i=0; i<dest_N; ++i)
+		testAssert(resampled_a[i] == resampled_b[i]);
+}
+
+
+// A constant signal should be reproduced exactly (to float precision) after the filter delay.
+static void testResamplingDC(int src_sample_rate, int dest_sample_rate)
+{
+	const size_t dest_N = 2048;
+	std::vector<float> src_data((size_t)(dest_N * (double)src_sample_rate / dest_sample_rate) + 1000, 0.75f);
+
+	glare::AudioResampler resampler;
+	resampler.init(src_sample_rate, dest_sample_rate);
+
+	const std::vector<float> resampled = resampleInChunks(resampler, src_data, /*dest chunk size=*/256, dest_N);
+
+	const size_t warmup = (size_t)std::ceil(resampler.delayInSrcSamples() * 2 * (double)dest_sample_rate / src_sample_rate) + 1;
+	for(size_t i=warmup; i<dest_N; ++i)
+		testAssert(std::fabs(resampled[i] - 0.75f) < 1.0e-5f);
+}
+
+
+// Compares throughput and SNR with the previous linear-interpolation resampler.
+static void benchmarkResampler(int src_sample_rate, int dest_sample_rate)
+{
+	const double freq = 0.2 * myMin(src_sample_rate, dest_sample_rate);
+	const int src_N = src_sample_rate * 10; // 10 seconds of audio
+	std::vector<float> src_data(src_N);
+	for(int i=0; i<src_N; ++i)
+		src_data[i] = (float)testSignal((double)i / src_sample_rate, freq);
+
+	const size_t dest_chunk_size = 256; // Same as the mixer frames per buffer.
+	const size_t dest_N = (size_t)((src_N - 600) * (double)dest_sample_rate / src_sample_rate) / dest_chunk_size * dest_chunk_size;
+
+	glare::AudioResampler resampler;
+	resampler.init(src_sample_rate, dest_sample_rate);
+	Timer timer;
+	const std::vector<float> resampled = resampleInChunks(resampler, src_data, dest_chunk_size, dest_N);
+	const double polyphase_time = timer.elapsed();
+
+	LinearReferenceResampler linear_resampler(src_sample_rate, dest_sample_rate);
+	timer.reset();
+	const std::vector<float> linear_resampled = resampleInChunks(linear_resampler, src_data, dest_chunk_size, dest_N);
+	const double linear_time = timer.elapsed();
+
+	const double polyphase_snr = computeSNR(resampled, src_sample_rate, dest_sample_rate, freq, resampler.delayInSrcSamples());
+	const double linear_snr = computeSNR(linear_resampled, src_sample_rate, dest_sample_rate, freq, /*src delay=*/0);
+
+	conPrint(toString(src_sample_rate) + " hz -> " + toString(dest_sample_rate) + " hz, " + toString((int)freq) + " hz tone:");
+	conPrint("    polyphase: " + doubleToStringNSigFigs(dest_N / polyphase_time * 1.0e-6, 4) + " M samples/s, SNR: " + doubleToStringNSigFigs(polyphase_snr, 4) + " dB");
+	conPrint("    linear:    " + doubleToStringNSigFigs(dest_N / linear_time * 1.0e-6, 4) + " M samples/s, SNR: " + doubleToStringNSigFigs(linear_snr, 4) + " dB");
+
+	testAssert(polyphase_snr > linear_snr);
+}
+
+
+void glare::AudioResampler::test()
+{
+	conPrint("AudioResampler::test()");
+
+	const int dest_rates[] = { 48000, 44100 };
+	const int src_rates[] = { 6000, 8000, 12000, 16000, 22050, 24000, 44100, 48000 };
+	for(size_t d=0; d<staticArrayNumElems(dest_rates); ++d)
+		for(size_t s=0; s<staticArrayNumElems(src_rates); ++s)
+		{
+			testResamplingAccuracy(src_rates[s], dest_rates[d]);
+			testChunkSizeIndependence(src_rates[s], dest_rates[d]);
+			testResamplingDC(src_rates[s], dest_rates[d]);
+		}
+
+	// Downsampling, as done for mic input to Opus
+	testResamplingAccuracy(/*src rate=*/48000, /*dest rate=*/16000);
+	testResamplingAccuracy(/*src rate=*/44100, /*dest rate=*/24000);
+	testResamplingDC(/*src rate=*/48000, /*dest rate=*/8000);
+
+	// A ratio with too many phases for an exact filter bank (L = 6000), so uses interpolated phases.
+	testResamplingAccuracy(/*src rate=*/44056, /*dest rate=*/48000);
+	testChunkSizeIndependence(/*src rate=*/44056, /*dest rate=*/48000);
+	testResamplingDC(/*src rate=*/44056, /*dest rate=*/48000);
+
+	benchmarkResampler(/*src rate=*/44100, /*dest rate=*/48000);
+	benchmarkResampler(/*src rate=*/48000, /*dest rate=*/44100);
+	benchmarkResampler(/*src rate=*/16000, /*dest rate=*/48000);
+
+	conPrint("AudioResampler::test() done.");
 }
 
 
-#endif // BUILD_TESTS
\ No newline at end of file
+#endif // BUILD_TESTS
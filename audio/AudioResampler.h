@@ -8,37 +8,86 @@ Copyright Glare Technologies Limited 2023 -
 
 #include <utils/MessageableThread.h>
 #include <utils/AtomicInt.h>
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
 #include <utils/Vector.h>
+#include <utils/Platform.h>
 
 
 namespace glare
 {
 
 
+// Windowed-sinc filter coefficients for each phase (fractional source position) of a resampling ratio.
+// Shared between resamplers with the same ratio, see getResamplingFilterBank() in AudioResampler.cpp.
+class ResamplingFilterBank : public ThreadSafeRefCounted
+{
+public:
+	int num_taps; // Multiple of 8.
+	int num_phases; // Equal to the dest rate / gcd if exact_phases, otherwise the number of interpolated phases.
+	bool exact_phases;
+	js::Vector<float, 32> coeffs; // (num_phases + 1) * num_taps coefficients.  Phase i is at offset i * num_taps.
+};
+typedef Reference<ResamplingFilterBank> ResamplingFilterBankRef;
+
+
 /*=====================================================================
 AudioResampler
 --------------
+Streaming polyphase resampler for mono audio, using a Kaiser-windowed sinc filter.
+
+The resampling ratio src_rate / dest_rate is reduced to M / L, and the source position of each destination sample
+is tracked exactly with integer arithmetic.  For ratios with L <= MAX_EXACT_PHASES (e.g. 44100 <-> 48000, 147 <-> 160)
+there is a precomputed filter kernel for each of the L phases.  Other ratios interpolate between 256 phases.
+
+The filter has a passband up to about 80% of the lower Nyquist frequency, ~80 dB of stopband attenuation, and delays the
+signal by num_taps / 2 source samples.  When downsampling the kernel is widened in proportion to the ratio.
 
+The last num_taps source samples are kept between calls, so resample() doesn't need to copy the source chunk, apart from
+the first few samples whose kernels straddle the previous chunk.
+
+The inner product uses AVX2/FMA when available (on Windows, detected at runtime), SSE otherwise on x86, and NEON on ARM.
 =====================================================================*/
 class AudioResampler
 {
 public:
 	AudioResampler();
 
+	// Resets the stream.  Allocates, and may take a mutex to look up the filter bank, so shouldn't be called from a real-time audio callback.
 	void init(int src_rate, int dest_rate);
 
-	size_t numSrcSamplesNeeded(size_t dest_num_samples);
+	// Returns the number of source samples that must be passed to the next call of resample() to compute dest_num_samples samples.
+	size_t numSrcSamplesNeeded(size_t dest_num_samples) const;
+
+	// src_samples_size should be the value returned by numSrcSamplesNeeded(dest_samples_size).
+	void resample(float* dest_samples, size_t dest_samples_size, const float* src_samples, size_t src_samples_size);
 
-	void resample(float* dest_samples, size_t dest_samples_size, const float* src_samples, size_t src_samples_size, js::Vector<float, 16>& temp_buf);
+	// Number of source samples that the output is delayed by.
+	int delayInSrcSamples() const { return num_taps / 2; }
+
+	static const int MAX_EXACT_PHASES = 512;
+	static const int NUM_INTERPOLATED_PHASES = 256;
 
 	static void test();
 
 private:
 	int src_rate, dest_rate;
-	int64 prev_dest_dst_coords; // Destination coord of largest dest sample we have returned.
-	
-	int64 prev_samples_0_src_coords; // Source coordinates for prev_samples[0]
-	float prev_samples[2];
+	bool passthrough; // src_rate == dest_rate, just copy samples.
+
+	// Ratio src_rate / dest_rate = M / L.
+	int64 L;
+	int64 M_div_L, M_mod_L;
+
+	ResamplingFilterBankRef filter_bank;
+	int num_taps;
+
+	// The source stream is considered to be preceded by num_taps - 1 zeroes.  Indices into this padded stream are 'padded indices'.
+	int64 next_base; // Padded index of the first source sample in the kernel window for the next destination sample.
+	int64 next_phase; // Phase of the next destination sample, in [0, L).
+	int64 num_padded_consumed; // Number of padded source samples consumed so far.  Padded index of the next source sample passed to resample().
+
+	js::Vector<float, 32> history; // Last num_taps padded source samples consumed, followed by space for the first num_taps - 1 samples of the next chunk.
+	bool use_avx2;
 };
 
 
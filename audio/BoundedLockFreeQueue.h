@@ -0,0 +1,129 @@
+/*=====================================================================
+BoundedLockFreeQueue.h
+----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/Platform.h>
+#include <vector>
+#include <atomic>
+
+
+namespace glare
+{
+
+
+/*=====================================================================
+BoundedLockFreeQueue
+--------------------
+Fixed-capacity multi-producer, multi-consumer queue, using Dmitry Vyukov's
+bounded queue algorithm (a ring of cells, each with a sequence number saying
+whether it is ready to be written or read).
+Doesn't allocate after construction, and never blocks, so can be used to send
+commands to a real-time thread.
+
+Items are copied in with tryPush() and moved out with tryPop().
+=====================================================================*/
+template <class T>
+class BoundedLockFreeQueue
+{
+public:
+	// Capacity is rounded up to a power of two.
+	BoundedLockFreeQueue(size_t min_capacity)
+	:	cells(roundUpToPowerOf2(min_capacity)),
+		mask(cells.size() - 1)
+	{
+		for(size_t i=0; i<cells.size(); ++i)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		enqueue_pos.store(0, std::memory_order_relaxed);
+		dequeue_pos.store(0, std::memory_order_relaxed);
+	}
+
+	size_t capacity() const { return cells.size(); }
+
+	// Returns false if the queue is full.
+	bool tryPush(const T& item)
+	{
+		size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+		Cell* cell;
+		while(1)
+		{
+			cell = &cells[pos & mask];
+			const size_t seq = cell->sequence.load(std::memory_order_acquire);
+			const ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+			if(diff == 0) // If the cell is ready to be written at this position:
+			{
+				if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) // Try and claim it.
+					break;
+			}
+			else if(diff < 0) // Else if the cell still holds an item from the last time round the ring:
+				return false; // Queue is full.
+			else
+				pos = enqueue_pos.load(std::memory_order_relaxed); // Another producer claimed it, try again.
+		}
+
+		cell->item = item;
+		cell->sequence.store(pos + 1, std::memory_order_release); // Mark as ready to be read.
+		return true;
+	}
+
+	// Returns false if the queue is empty.
+	bool tryPop(T& item_out)
+	{
+		size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+		Cell* cell;
+		while(1)
+		{
+			cell = &cells[pos & mask];
+			const size_t seq = cell->sequence.load(std::memory_order_acquire);
+			const ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+			if(diff == 0) // If the cell has been written at this position:
+			{
+				if(dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if(diff < 0)
+				return false; // Queue is empty.
+			else
+				pos = dequeue_pos.load(std::memory_order_relaxed);
+		}
+
+		item_out = std::move(cell->item);
+		cell->item = T(); // Release any references held by the cell.
+		cell->sequence.store(pos + mask + 1, std::memory_order_release); // Mark as ready to be written on the next time round the ring.
+		return true;
+	}
+
+private:
+	GLARE_DISABLE_COPY(BoundedLockFreeQueue)
+
+	static size_t roundUpToPowerOf2(size_t x)
+	{
+		size_t res = 2;
+		while(res < x)
+			res *= 2;
+		return res;
+	}
+
+	struct Cell
+	{
+		Cell() : sequence(0) {}
+
+		std::atomic<size_t> sequence;
+		T item;
+	};
+
+	std::vector<Cell> cells;
+	size_t mask;
+
+	uint8 padding_0[64];
+	std::atomic<size_t> enqueue_pos;
+	uint8 padding_1[64];
+	std::atomic<size_t> dequeue_pos;
+	uint8 padding_2[64];
+};
+
+
+} // end namespace glare
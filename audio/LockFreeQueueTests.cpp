@@ -0,0 +1,229 @@
+/*=====================================================================
+LockFreeQueueTests.cpp
+----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "LockFreeQueueTests.h"
+
+
+#if BUILD_TESTS
+
+
+#include "SPSCRingBuffer.h"
+#include "BoundedLockFreeQueue.h"
+#include <utils/TestUtils.h>
+#include <utils/AtomicInt.h>
+#include <maths/mathstypes.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <thread>
+
+
+static void testSPSCRingBufferSingleThreaded()
+{
+	glare::SPSCRingBuffer<int> buffer;
+	testAssert(buffer.capacity() == 0);
+	testAssert(buffer.empty());
+	{
+		const int x = 1;
+		testAssert(buffer.pushBackNItems(&x, 1) == 0); // No room before init().
+	}
+
+	buffer.init(5);
+	testAssert(buffer.capacity() == 8);
+	testAssert(buffer.freeSpace() == 8);
+
+	// Push and pop past the end of the storage a few times, to test wrapping.
+	int next_push = 0;
+	int next_pop = 0;
+	for(int iter=0; iter<100; ++iter)
+	{
+		const size_t num_to_push = 1 + iter % 7;
+		int src[8];
+		for(size_t i=0; i<num_to_push; ++i)
+			src[i] = next_push + (int)i;
+		const size_t num_pushed = buffer.pushBackNItems(src, num_to_push);
+		next_push += (int)num_pushed;
+		testAssert(buffer.size() == (size_t)(next_push - next_pop));
+		testAssert(buffer.size() <= buffer.capacity());
+
+		// Peek should return the same items as the following pop.
+		int peeked[8];
+		const size_t num_peeked = buffer.peekFrontNItems(peeked, 3);
+
+		int dest[8];
+		const size_t num_popped = buffer.popFrontNItems(dest, 3);
+		testAssert(num_peeked == num_popped);
+		for(size_t i=0; i<num_popped; ++i)
+		{
+			testAssert(dest[i] == next_pop);
+			testAssert(peeked[i] == next_pop);
+			next_pop++;
+		}
+	}
+
+	// Fill the buffer up, further pushes should be truncated.
+	buffer.popFrontNItems(buffer.size());
+	testAssert(buffer.empty());
+	int src[10] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+	testAssert(buffer.pushBackNItems(src, 10) == 8);
+	testAssert(buffer.freeSpace() == 0);
+	testAssert(buffer.pushBackNItems(src, 1) == 0);
+	testAssert(buffer.popFrontNItems(2) == 2);
+	int dest[10];
+	testAssert(buffer.popFrontNItems(dest, 10) == 6);
+	for(int i=0; i<6; ++i)
+		testAssert(dest[i] == i + 2);
+}
+
+
+// Push a sequence of ints through the buffer from one thread to another, and check they arrive in order.
+static void testSPSCRingBufferThreaded()
+{
+	glare::SPSCRingBuffer<int> buffer;
+	buffer.init(64);
+
+	const int N = 200000;
+
+	std::thread producer([&]()
+	{
+		int next = 0;
+		int src[37];
+		while(next < N)
+		{
+			const int num = myMin(37, N - next);
+			for(int i=0; i<num; ++i)
+				src[i] = next + i;
+			const size_t num_pushed = buffer.pushBackNItems(src, num);
+			if(num_pushed == 0)
+				std::this_thread::yield();
+			next += (int)num_pushed;
+		}
+	});
+
+	bool in_order = true;
+	int next_expected = 0;
+	int dest[29];
+	while(next_expected < N)
+	{
+		const size_t num = buffer.popFrontNItems(dest, 29);
+		if(num == 0)
+			std::this_thread::yield();
+		for(size_t i=0; i<num; ++i)
+			in_order = in_order && (dest[i] == next_expected++);
+	}
+
+	producer.join();
+
+	testAssert(in_order);
+	testAssert(buffer.empty());
+}
+
+
+static void testBoundedLockFreeQueueSingleThreaded()
+{
+	glare::BoundedLockFreeQueue<std::string> queue(3);
+	testAssert(queue.capacity() == 4);
+
+	std::string s;
+	testAssert(!queue.tryPop(s));
+
+	for(int iter=0; iter<10; ++iter)
+	{
+		for(int i=0; i<4; ++i)
+			testAssert(queue.tryPush(toString(iter * 4 + i)));
+		testAssert(!queue.tryPush("full"));
+
+		for(int i=0; i<4; ++i)
+		{
+			testAssert(queue.tryPop(s));
+			testAssert(s == toString(iter * 4 + i));
+		}
+		testAssert(!queue.tryPop(s));
+	}
+}
+
+
+// Multiple producers and consumers.  Check that every item is received exactly once, and that items from each producer are received in order by each consumer.
+static void testBoundedLockFreeQueueThreaded()
+{
+	const int num_producers = 4;
+	const int num_consumers = 4;
+	const int num_items_per_producer = 50000;
+
+	glare::BoundedLockFreeQueue<int> queue(256);
+
+	std::vector<std::thread> producers;
+	for(int p=0; p<num_producers; ++p)
+		producers.push_back(std::thread([&queue, p]()
+		{
+			for(int i=0; i<num_items_per_producer; ++i)
+			{
+				const int item = p * num_items_per_producer + i;
+				while(!queue.tryPush(item))
+					std::this_thread::yield();
+			}
+		}));
+
+	std::vector<std::vector<int>> received(num_consumers);
+	glare::AtomicInt num_received(0);
+	std::vector<std::thread> consumers;
+	for(int c=0; c<num_consumers; ++c)
+		consumers.push_back(std::thread([&, c]()
+		{
+			while(num_received < num_producers * num_items_per_producer)
+			{
+				int item;
+				if(queue.tryPop(item))
+				{
+					received[c].push_back(item);
+					num_received.increment();
+				}
+				else
+					std::this_thread::yield();
+			}
+		}));
+
+	for(size_t i=0; i<producers.size(); ++i)
+		producers[i].join();
+	for(size_t i=0; i<consumers.size(); ++i)
+		consumers[i].join();
+
+	std::vector<int> count(num_producers * num_items_per_producer, 0);
+	for(int c=0; c<num_consumers; ++c)
+	{
+		std::vector<int> last_from_producer(num_producers, -1);
+		for(size_t i=0; i<received[c].size(); ++i)
+		{
+			const int item = received[c][i];
+			testAssert(item >= 0 && item < num_producers * num_items_per_producer);
+			count[item]++;
+
+			const int p = item / num_items_per_producer;
+			testAssert(item > last_from_producer[p]);
+			last_from_producer[p] = item;
+		}
+	}
+
+	for(size_t i=0; i<count.size(); ++i)
+		testAssert(count[i] == 1);
+}
+
+
+void glare::testLockFreeQueues()
+{
+	conPrint("testLockFreeQueues()");
+
+	testSPSCRingBufferSingleThreaded();
+	testBoundedLockFreeQueueSingleThreaded();
+
+	Timer timer;
+	testSPSCRingBufferThreaded();
+	testBoundedLockFreeQueueThreaded();
+
+	conPrint("testLockFreeQueues() done (threaded tests took " + timer.elapsedStringNSigFigs(3) + ")");
+}
+
+
+#endif // BUILD_TESTS
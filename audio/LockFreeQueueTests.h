@@ -0,0 +1,17 @@
+/*=====================================================================
+LockFreeQueueTests.h
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+namespace glare
+{
+
+
+// Tests SPSCRingBuffer and BoundedLockFreeQueue.
+void testLockFreeQueues();
+
+
+} // end namespace glare
@@ -316,6 +316,13 @@ void MicReadThread::doRun()
 		if(opus_error != OPUS_OK)
 			throw glare::Exception("opus_encoder_create failed.");
 
+		// Enable in-band forward error correction, so the receiving VoiceJitterBuffer can recover an isolated lost packet from the packet after it.
+		// The encoder only adds FEC data if the expected packet loss percentage is non-zero.
+		if(opus_encoder_ctl(opus_encoder, OPUS_SET_INBAND_FEC(1)) != OPUS_OK)
+			throw glare::Exception("opus_encoder_ctl OPUS_SET_INBAND_FEC failed.");
+		if(opus_encoder_ctl(opus_encoder, OPUS_SET_PACKET_LOSS_PERC(10)) != OPUS_OK)
+			throw glare::Exception("opus_encoder_ctl OPUS_SET_PACKET_LOSS_PERC failed.");
+
 
 		//const int ret = opus_encoder_ctl(opus_encoder, OPUS_SET_BITRATE(512000));
 		//if(ret != OPUS_OK)
@@ -344,7 +351,7 @@ void MicReadThread::doRun()
 
 		js::Vector<float, 16> resampled_pcm_buffer;
 		glare::AudioResampler resampler;
-		js::Vector<float, 16> temp_resampling_buf;
+		resampler.init(/*src rate=*/capture_sampling_rate, /*dest rate=*/opus_sampling_rate);
 
 		std::vector<uint8> packet;
 
@@ -510,7 +517,7 @@ void MicReadThread::doRun()
 						// Resample
 						resampled_pcm_buffer.resizeNoCopy(opus_samples_per_frame);
 
-						resampler.resample(/*dest samples=*/resampled_pcm_buffer.data(), /*dest samples size=*/opus_samples_per_frame, /*src samples=*/&pcm_buffer[cur_i], /*src samples size=*/capture_samples_for_frame, temp_resampling_buf);
+						resampler.resample(/*dest samples=*/resampled_pcm_buffer.data(), /*dest samples size=*/opus_samples_per_frame, /*src samples=*/&pcm_buffer[cur_i], /*src samples size=*/capture_samples_for_frame);
 					}
 
 					// Encode the PCM data with Opus.  Writes to encoded_data.
@@ -0,0 +1,144 @@
+/*=====================================================================
+SPSCRingBuffer.h
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/Platform.h>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <cassert>
+
+
+namespace glare
+{
+
+
+/*=====================================================================
+SPSCRingBuffer
+--------------
+Fixed-capacity ring buffer for passing audio samples from one producer thread
+to one consumer thread.
+Pushing and popping are wait-free and don't allocate, so can be done from the
+real-time audio thread.
+
+The capacity is set with init(), which allocates, and must be called before
+the buffer is shared between threads.
+T must be trivially copyable.
+=====================================================================*/
+template <class T>
+class SPSCRingBuffer
+{
+public:
+	SPSCRingBuffer() : mask(0), read_index(0), write_index(0) {}
+
+	// Not threadsafe.  Capacity is rounded up to a power of two.  Discards any current contents.
+	void init(size_t min_capacity)
+	{
+		size_t capacity = 1;
+		while(capacity < min_capacity)
+			capacity *= 2;
+		data.resize(capacity);
+		mask = capacity - 1;
+		read_index.store(0, std::memory_order_relaxed);
+		write_index.store(0, std::memory_order_relaxed);
+	}
+
+	size_t capacity() const { return data.size(); }
+
+	// May be called from either thread.  The result may be out of date by the time it is used.
+	size_t size() const
+	{
+		const size_t r = read_index.load(std::memory_order_acquire); // Load read_index first, so write_index is >= it.
+		const size_t w = write_index.load(std::memory_order_acquire);
+		return w - r;
+	}
+
+	bool empty() const { return size() == 0; }
+
+	// Producer thread only.
+	size_t freeSpace() const
+	{
+		return data.size() - (write_index.load(std::memory_order_relaxed) - read_index.load(std::memory_order_acquire));
+	}
+
+	// Producer thread only.  Pushes as many of the n items as there is room for, returns the number pushed.
+	size_t pushBackNItems(const T* src, size_t n)
+	{
+		const size_t w = write_index.load(std::memory_order_relaxed);
+		const size_t r = read_index.load(std::memory_order_acquire);
+		const size_t num = myMinSize(n, data.size() - (w - r));
+
+		const size_t start = w & mask;
+		const size_t first_part = myMinSize(num, data.size() - start); // Number of items before we wrap around to the start of data.
+		if(first_part > 0)
+			std::memcpy(&data[start], src, first_part * sizeof(T));
+		if(num > first_part)
+			std::memcpy(&data[0], src + first_part, (num - first_part) * sizeof(T));
+
+		write_index.store(w + num, std::memory_order_release);
+		return num;
+	}
+
+	// Consumer thread only.  Pops up to n items, returns the number popped.
+	size_t popFrontNItems(T* dest, size_t n)
+	{
+		const size_t r = read_index.load(std::memory_order_relaxed);
+		const size_t num = copyFrom(r, dest, n);
+		read_index.store(r + num, std::memory_order_release);
+		return num;
+	}
+
+	// Consumer thread only.  Discards up to n items, returns the number discarded.
+	size_t popFrontNItems(size_t n)
+	{
+		const size_t r = read_index.load(std::memory_order_relaxed);
+		const size_t w = write_index.load(std::memory_order_acquire);
+		const size_t num = myMinSize(n, w - r);
+		read_index.store(r + num, std::memory_order_release);
+		return num;
+	}
+
+	// Copies up to n items from the front of the buffer without popping them, returns the number copied.
+	// May be called from a thread other than the consumer, as long as the producer is not running concurrently.
+	size_t peekFrontNItems(T* dest, size_t n) const
+	{
+		return copyFrom(read_index.load(std::memory_order_acquire), dest, n);
+	}
+
+private:
+	GLARE_DISABLE_COPY(SPSCRingBuffer)
+
+	static size_t myMinSize(size_t a, size_t b) { return a < b ? a : b; }
+
+	size_t copyFrom(size_t r, T* dest, size_t n) const
+	{
+		const size_t w = write_index.load(std::memory_order_acquire);
+		const size_t num = myMinSize(n, w - r);
+
+		const size_t start = r & mask;
+		const size_t first_part = myMinSize(num, data.size() - start);
+		if(first_part > 0)
+			std::memcpy(dest, &data[start], first_part * sizeof(T));
+		if(num > first_part)
+			std::memcpy(dest + first_part, &data[0], (num - first_part) * sizeof(T));
+		return num;
+	}
+
+	std::vector<T> data;
+	size_t mask;
+
+	// Indices increase monotonically, and are masked when accessing data.
+	// They are padded onto separate cache lines so the producer and consumer don't contend.  (Not using alignas, as AudioSource has its own operator new.)
+	uint8 padding_0[64];
+	std::atomic<size_t> read_index; // Written by the consumer.
+	uint8 padding_1[64];
+	std::atomic<size_t> write_index; // Written by the producer.
+	uint8 padding_2[64];
+};
+
+
+} // end namespace glare
@@ -88,15 +88,12 @@ void StreamerThread::doRun()
 						for(auto src_it = sources_playing_stream.begin(); src_it != sources_playing_stream.end(); ++src_it)
 						{
 							AudioSource* source = src_it->ptr();
-							source->buffer.pushBackNItems(mono_samples.data(), mono_samples.size());
+							source->buffer.pushBackNItems(mono_samples.data(), mono_samples.size()); // NOTE: drops samples if the buffer is full.
 							if(sample_freq_hz != 0)
 							{
-								// If we have read a sample rate from the mp3 file and it differs from the default, re-init the resampler.
-								if(source->sampling_rate != sample_freq_hz)
-								{
-									source->sampling_rate = sample_freq_hz;
-									source->resampler.init(/*src rate=*/sample_freq_hz, /*dest rate*/audio_engine->getSampleRate());
-								}
+								// If we have read a sample rate from the mp3 file, tell the mixing thread, which will re-init the resampler if it differs.
+								if(source->streamed_sampling_rate != sample_freq_hz)
+									source->streamed_sampling_rate = sample_freq_hz;
 							}
 						}
 
@@ -0,0 +1,582 @@
+/*=====================================================================
+VoiceJitterBuffer.cpp
+---------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "VoiceJitterBuffer.h"
+
+
+#include <maths/mathstypes.h>
+#include <utils/Lock.h>
+#include <utils/Exception.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <opus.h>
+#include <algorithm>
+#include <cmath>
+
+
+glare::VoiceJitterBuffer::VoiceJitterBuffer(double frame_duration_s)
+:	frame_duration(frame_duration_s)
+{
+	stats.num_packets_received = 0;
+	stats.num_packets_played = 0;
+	stats.num_late_packets = 0;
+	stats.num_duplicate_packets = 0;
+	stats.num_fec_frames = 0;
+	stats.num_plc_frames = 0;
+	stats.num_frames_dropped = 0;
+	stats.num_resets = 0;
+
+	reset();
+}
+
+
+glare::VoiceJitterBuffer::~VoiceJitterBuffer()
+{}
+
+
+void glare::VoiceJitterBuffer::reset()
+{
+	packets.clear();
+	started = false;
+	playing = false;
+	next_play_seq_num = 0;
+	num_frames_waited = 0;
+	num_underrun_concealed_frames = 0;
+	frames_since_shrink_check = 0;
+	max_buffered_frames_since_shrink_check = 0;
+	relative_delays.clear();
+	relative_delays_write_i = 0;
+	jitter_target_delay_frames = MIN_TARGET_FRAMES;
+	target_delay_frames = MIN_TARGET_FRAMES;
+	smoothed_loss_rate = 0;
+}
+
+
+void glare::VoiceJitterBuffer::updateTargetDelay(uint32 seq_num, double arrival_time)
+{
+	// The relative delay of a packet is its arrival time minus its send time, up to a constant offset (the sender clock is unknown).
+	const double relative_delay = arrival_time - seq_num * frame_duration;
+	if(relative_delays.size() < JITTER_WINDOW_SIZE)
+		relative_delays.push_back(relative_delay);
+	else
+	{
+		relative_delays[relative_delays_write_i] = relative_delay;
+		relative_delays_write_i = (relative_delays_write_i + 1) % JITTER_WINDOW_SIZE;
+	}
+
+	if(relative_delays.size() < MIN_JITTER_SAMPLES) // Keep the current target until we have enough samples.
+		return;
+
+	// Work out the spread between the least delayed packet and the 95th percentile most delayed packet.
+	temp_delays = relative_delays;
+	const size_t percentile_i = (temp_delays.size() - 1) * 95 / 100;
+	std::nth_element(temp_delays.begin(), temp_delays.begin() + percentile_i, temp_delays.end());
+	const double percentile_delay = temp_delays[percentile_i];
+	const double min_delay = *std::min_element(temp_delays.begin(), temp_delays.begin() + percentile_i + 1);
+
+	// We need to buffer the frame being played, plus enough frames to cover the spread.
+	const double spread_frames = (percentile_delay - min_delay) / frame_duration;
+	jitter_target_delay_frames = 1 + (uint32)std::ceil(spread_frames - 1.0e-6);
+	updateTargetDelayFrames();
+}
+
+
+void glare::VoiceJitterBuffer::updateTargetDelayFrames()
+{
+	// If packets are being lost, buffer an extra frame, so the following packet has usually arrived by the time we need to conceal a lost one, and its FEC data can be used.
+	const uint32 fec_frames = (smoothed_loss_rate > FEC_LOSS_RATE_THRESHOLD) ? 1 : 0;
+	target_delay_frames = myClamp<uint32>(jitter_target_delay_frames + fec_frames, MIN_TARGET_FRAMES, MAX_TARGET_FRAMES);
+}
+
+
+uint32 glare::VoiceJitterBuffer::numBufferedFrames() const
+{
+	// Number of frames from the one to be played next, to the last one received, including any missing ones.
+	return packets.empty() ? 0 : (packets.rbegin()->first + 1 - next_play_seq_num);
+}
+
+
+void glare::VoiceJitterBuffer::insertPacket(uint32 seq_num, double arrival_time, const uint8* data, size_t data_len)
+{
+	stats.num_packets_received++;
+
+	if(started && (seq_num >= next_play_seq_num + MAX_BUFFERED_FRAMES))
+	{
+		// The packet is way ahead of anything we have, the sender has probably restarted or skipped ahead.  Start again.
+		reset();
+		stats.num_resets++;
+	}
+
+	// Late packets are still used for the jitter estimate, as they indicate we need more buffering.
+	updateTargetDelay(seq_num, arrival_time);
+
+	if(started && (seq_num < next_play_seq_num))
+	{
+		stats.num_late_packets++;
+		return;
+	}
+
+	if(packets.count(seq_num) > 0)
+	{
+		stats.num_duplicate_packets++;
+		return;
+	}
+
+	packets[seq_num].assign(data, data + data_len);
+}
+
+
+glare::VoiceJitterBuffer::FrameType glare::VoiceJitterBuffer::getNextFrame(std::vector<uint8>& packet_data_out, uint32& seq_num_out)
+{
+	if(!playing)
+	{
+		if(packets.empty())
+			return FrameType_Silence;
+
+		// Wait until we have buffered up to the target delay, or have waited that long, before starting playing.
+		next_play_seq_num = packets.begin()->first;
+		const uint32 num_buffered_frames = packets.rbegin()->first + 1 - next_play_seq_num;
+		num_frames_waited++;
+		if(num_buffered_frames < target_delay_frames && num_frames_waited < target_delay_frames)
+			return FrameType_Silence;
+
+		playing = true;
+		started = true;
+		num_underrun_concealed_frames = 0;
+		frames_since_shrink_check = 0;
+		max_buffered_frames_since_shrink_check = 0;
+	}
+
+	// If we concealed frames while the buffer was empty, and later packets have arrived but not the ones for those frames, those frames are done already.
+	// Unless we are below the target delay, in which case conceal them again (using FEC if possible), which increases the delay.
+	while(num_underrun_concealed_frames > 0 && !packets.empty() && packets.count(next_play_seq_num) == 0 && numBufferedFrames() > target_delay_frames)
+	{
+		next_play_seq_num++;
+		num_underrun_concealed_frames--;
+		smoothed_loss_rate = smoothed_loss_rate * LOSS_RATE_SMOOTHING + (1 - LOSS_RATE_SMOOTHING);
+		updateTargetDelayFrames();
+	}
+
+	// The most frames buffered over the check interval is roughly our current delay, above the minimum network delay.
+	// If it's more than the target delay, drop a frame to reduce the delay.
+	const uint32 num_buffered_frames = numBufferedFrames();
+	max_buffered_frames_since_shrink_check = myMax(max_buffered_frames_since_shrink_check, num_buffered_frames);
+	frames_since_shrink_check++;
+	if(frames_since_shrink_check >= SHRINK_CHECK_INTERVAL_FRAMES)
+	{
+		if(max_buffered_frames_since_shrink_check > target_delay_frames && num_buffered_frames >= 2)
+		{
+			packets.erase(next_play_seq_num); // May be missing already, in which case we skip concealing it.
+			next_play_seq_num++;
+			stats.num_frames_dropped++;
+		}
+		frames_since_shrink_check = 0;
+		max_buffered_frames_since_shrink_check = 0;
+	}
+
+	auto res = packets.find(next_play_seq_num);
+	if(res != packets.end())
+	{
+		// We have the packet, play it.
+		packet_data_out.swap(res->second);
+		seq_num_out = next_play_seq_num;
+		packets.erase(res);
+		next_play_seq_num++;
+		num_underrun_concealed_frames = 0;
+		stats.num_packets_played++;
+		smoothed_loss_rate *= LOSS_RATE_SMOOTHING;
+		return FrameType_Packet;
+	}
+	else if(!packets.empty())
+	{
+		// The packet is missing, but later packets have arrived, so treat it as lost.
+		// Use the FEC data in the next packet if we have it, otherwise do PLC.
+		seq_num_out = next_play_seq_num;
+		next_play_seq_num++;
+		num_underrun_concealed_frames = 0;
+		smoothed_loss_rate = smoothed_loss_rate * LOSS_RATE_SMOOTHING + (1 - LOSS_RATE_SMOOTHING);
+		updateTargetDelayFrames();
+
+		auto next_res = packets.find(next_play_seq_num);
+		if(next_res != packets.end())
+		{
+			packet_data_out = next_res->second;
+			stats.num_fec_frames++;
+			return FrameType_FEC;
+		}
+		else
+		{
+			stats.num_plc_frames++;
+			return FrameType_PLC;
+		}
+	}
+	else
+	{
+		// The buffer is empty.  Conceal without advancing the playout position, so if the packet is just late it will still be played, and the delay grows.
+		if(num_underrun_concealed_frames < MAX_UNDERRUN_CONCEALED_FRAMES)
+		{
+			num_underrun_concealed_frames++;
+			stats.num_plc_frames++;
+			return FrameType_PLC;
+		}
+		else
+		{
+			// The talker has probably stopped.  Rebuffer when packets arrive again.
+			playing = false;
+			num_frames_waited = 0;
+
+			// Sequence numbers may continue from where they were when the talker starts again, so relative delays from before the silence aren't comparable.
+			relative_delays.clear();
+			relative_delays_write_i = 0;
+			return FrameType_Silence;
+		}
+	}
+}
+
+
+glare::VoiceStreamDecoder::VoiceStreamDecoder(uint32 sampling_rate)
+{
+	int opus_error = 0;
+	opus_decoder = opus_decoder_create(
+		sampling_rate, // sampling rate
+		1, // channels
+		&opus_error
+	);
+	if(opus_error != OPUS_OK)
+		throw glare::Exception("opus_decoder_create failed.");
+
+	// We are using 10ms frames.  "For the PLC and FEC cases, frame_size must be a multiple of 2.5 ms."
+	samples_per_frame = sampling_rate / 100;
+	pcm_buffer.resize(samples_per_frame);
+}
+
+
+glare::VoiceStreamDecoder::~VoiceStreamDecoder()
+{
+	opus_decoder_destroy(opus_decoder);
+}
+
+
+void glare::VoiceStreamDecoder::insertPacket(uint32 seq_num, double arrival_time, const uint8* data, size_t data_len)
+{
+	Lock lock(mutex);
+	jitter_buffer.insertPacket(seq_num, arrival_time, data, data_len);
+}
+
+
+void glare::VoiceStreamDecoder::decodeFramesInto(SPSCRingBuffer<float>& buffer, size_t num_samples_needed, float& smoothed_level)
+{
+	Lock lock(mutex);
+
+	while(buffer.size() < num_samples_needed)
+	{
+		uint32 seq_num;
+		const VoiceJitterBuffer::FrameType frame_type = jitter_buffer.getNextFrame(packet_data, seq_num);
+
+		int num_samples_decoded;
+		if(frame_type == VoiceJitterBuffer::FrameType_Packet || frame_type == VoiceJitterBuffer::FrameType_FEC)
+			num_samples_decoded = opus_decode_float(opus_decoder, packet_data.data(), (opus_int32)packet_data.size(), pcm_buffer.data(), (int)samples_per_frame,
+				/*decode_fec=*/(frame_type == VoiceJitterBuffer::FrameType_FEC) ? 1 : 0);
+		else if(frame_type == VoiceJitterBuffer::FrameType_PLC)
+			// "Lost packets can be replaced with loss concealment by calling the decoder with a null pointer and zero length for the missing packet."  https://opus-codec.org/docs/opus_api-1.3.1/group__opus__decoder.html
+			num_samples_decoded = opus_decode_float(opus_decoder, NULL, 0, pcm_buffer.data(), (int)samples_per_frame, /*decode_fec=*/0);
+		else
+			num_samples_decoded = 0;
+
+		if(num_samples_decoded != (int)samples_per_frame)
+		{
+			if(num_samples_decoded < 0)
+				conPrint("Opus decoding failed: " + toString(num_samples_decoded));
+			std::fill(pcm_buffer.begin(), pcm_buffer.end(), 0.f); // Output silence for this frame, so playout timing is maintained.
+		}
+
+		float max_val = 0;
+		for(uint32 i=0; i<samples_per_frame; ++i)
+			max_val = myMax(max_val, std::fabs(pcm_buffer[i]));
+		smoothed_level = myMax(smoothed_level * 0.95f, max_val);
+
+		buffer.pushBackNItems(pcm_buffer.data(), samples_per_frame);
+	}
+}
+
+
+glare::VoiceJitterBuffer::Stats glare::VoiceStreamDecoder::getStats() const
+{
+	Lock lock(mutex);
+	return jitter_buffer.getStats();
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <maths/PCG32.h>
+
+
+namespace glare
+{
+
+
+struct VoiceTracePacket
+{
+	uint32 seq_num;
+	double send_time;
+	double arrival_time;
+};
+
+
+struct VoiceSimResults
+{
+	double mean_latency;
+	double p95_latency;
+	double max_latency;
+	size_t num_sent;
+	size_t num_lost;
+	uint32 final_target_delay_frames;
+	VoiceJitterBuffer::Stats stats;
+};
+
+
+// Builds a trace of packets sent every frame for the given duration, with the given random loss probability and network delay, sorted by arrival time.
+static std::vector<VoiceTracePacket> makeTrace(uint32 first_seq_num, double start_time, double duration, double base_delay, double max_jitter, float loss_prob, PCG32& rng, size_t& num_lost_out)
+{
+	std::vector<VoiceTracePacket> trace;
+	num_lost_out = 0;
+	const uint32 num_packets = (uint32)(duration / 0.01);
+	for(uint32 i=0; i<num_packets; ++i)
+	{
+		const float loss_r = rng.unitRandom();
+		const float jitter_r = rng.unitRandom();
+		if(loss_r < loss_prob)
+		{
+			num_lost_out++;
+			continue;
+		}
+		VoiceTracePacket packet;
+		packet.seq_num = first_seq_num + i;
+		packet.send_time = start_time + i * 0.01;
+		packet.arrival_time = packet.send_time + base_delay + jitter_r * max_jitter;
+		trace.push_back(packet);
+	}
+	std::stable_sort(trace.begin(), trace.end(), [](const VoiceTracePacket& a, const VoiceTracePacket& b) { return a.arrival_time < b.arrival_time; });
+	return trace;
+}
+
+
+// Runs the packet trace through a jitter buffer, with the playout side pulling a frame every 10 ms.
+// Measures the mouth-to-ear latency of played packets (play time - send time), and checks frames are played in order.
+static VoiceSimResults simulate(const std::vector<VoiceTracePacket>& trace, double sim_end_time, size_t num_lost, double latency_measure_start_time = 0)
+{
+	VoiceJitterBuffer jitter_buffer;
+	std::map<uint32, double> send_times;
+	for(size_t i=0; i<trace.size(); ++i)
+		send_times[trace[i].seq_num] = trace[i].send_time;
+
+	std::vector<double> latencies;
+	std::vector<uint8> packet_data;
+	size_t trace_i = 0;
+	bool played_any = false;
+	uint32 last_played_seq_num = 0;
+	const uint8 dummy_payload[4] = { 1, 2, 3, 4 };
+
+	for(int frame=0; ; ++frame)
+	{
+		const double play_time = 0.0037 + frame * 0.01; // Some arbitrary phase relative to the sender.
+		if(play_time > sim_end_time)
+			break;
+
+		while(trace_i < trace.size() && trace[trace_i].arrival_time <= play_time)
+		{
+			jitter_buffer.insertPacket(trace[trace_i].seq_num, trace[trace_i].arrival_time, dummy_payload, sizeof(dummy_payload));
+			trace_i++;
+		}
+
+		uint32 seq_num;
+		const VoiceJitterBuffer::FrameType frame_type = jitter_buffer.getNextFrame(packet_data, seq_num);
+		if(frame_type == VoiceJitterBuffer::FrameType_Packet || frame_type == VoiceJitterBuffer::FrameType_FEC)
+		{
+			testAssert(packet_data.size() == sizeof(dummy_payload));
+			testAssert(!played_any || seq_num > last_played_seq_num);
+			played_any = true;
+			last_played_seq_num = seq_num;
+
+			if(frame_type == VoiceJitterBuffer::FrameType_Packet && play_time >= latency_measure_start_time)
+				latencies.push_back(play_time - send_times[seq_num]);
+		}
+	}
+
+	VoiceSimResults results;
+	results.num_sent = trace.size() + num_lost;
+	results.num_lost = num_lost;
+	results.stats = jitter_buffer.getStats();
+	results.final_target_delay_frames = jitter_buffer.targetDelayFrames();
+	results.mean_latency = results.p95_latency = results.max_latency = 0;
+	if(!latencies.empty())
+	{
+		double sum = 0;
+		for(size_t i=0; i<latencies.size(); ++i)
+			sum += latencies[i];
+		results.mean_latency = sum / latencies.size();
+		std::sort(latencies.begin(), latencies.end());
+		results.p95_latency = latencies[(latencies.size() - 1) * 95 / 100];
+		results.max_latency = latencies.back();
+	}
+	return results;
+}
+
+
+static void printResults(const std::string& name, const VoiceSimResults& r)
+{
+	conPrint(name + ": latency mean " + doubleToStringNSigFigs(r.mean_latency * 1.0e3, 3) + " ms, p95 " + doubleToStringNSigFigs(r.p95_latency * 1.0e3, 3) + " ms, max " + doubleToStringNSigFigs(r.max_latency * 1.0e3, 3) +
+		" ms, sent: " + toString(r.num_sent) + ", lost: " + toString(r.num_lost) + ", played: " + toString(r.stats.num_packets_played) + ", FEC: " + toString(r.stats.num_fec_frames) + ", PLC: " + toString(r.stats.num_plc_frames) +
+		", late: " + toString(r.stats.num_late_packets) + ", dropped: " + toString(r.stats.num_frames_dropped) + ", target: " + toString(r.final_target_delay_frames) + " frames");
+}
+
+
+void VoiceJitterBuffer::test()
+{
+	conPrint("VoiceJitterBuffer::test()");
+
+	std::vector<uint8> packet_data;
+	uint32 seq_num;
+	const uint8 payload[1] = { 0 };
+
+	//-------------------- Test an empty buffer outputs silence --------------------
+	{
+		VoiceJitterBuffer jitter_buffer;
+		for(int i=0; i<10; ++i)
+			testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_Silence);
+	}
+
+	//-------------------- Test reordering, duplicates and FEC --------------------
+	{
+		VoiceJitterBuffer jitter_buffer;
+		const uint8 p0[1] = { 10 };
+		const uint8 p1[1] = { 11 };
+		const uint8 p3[1] = { 13 };
+		jitter_buffer.insertPacket(1, 0.0, p1, 1);
+		jitter_buffer.insertPacket(0, 0.0, p0, 1); // Arrives out of order
+		jitter_buffer.insertPacket(1, 0.0, p1, 1); // Duplicate
+		jitter_buffer.insertPacket(3, 0.0, p3, 1); // Packet 2 is missing
+		testAssert(jitter_buffer.getStats().num_duplicate_packets == 1);
+
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_Packet && seq_num == 0 && packet_data[0] == 10);
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_Packet && seq_num == 1 && packet_data[0] == 11);
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_FEC && seq_num == 2 && packet_data[0] == 13); // Packet 2 recovered from the FEC data in packet 3.
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_Packet && seq_num == 3 && packet_data[0] == 13);
+
+		// Packet 2 arriving now is too late.
+		jitter_buffer.insertPacket(2, 0.0, payload, 1);
+		testAssert(jitter_buffer.getStats().num_late_packets == 1);
+
+		// Packets 4 and 5 are lost, 6 arrives: 4 is concealed with PLC, 5 with FEC.
+		jitter_buffer.insertPacket(6, 0.06, payload, 1);
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_PLC);
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_FEC && seq_num == 5);
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_Packet && seq_num == 6);
+
+		// A late packet that arrives while we are concealing due to the buffer being empty is still played.
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_PLC);
+		jitter_buffer.insertPacket(7, 0.08, payload, 1);
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_Packet && seq_num == 7);
+
+		// With nothing buffered, conceal for a few frames then fall silent.
+		for(uint32 i=0; i<MAX_UNDERRUN_CONCEALED_FRAMES; ++i)
+			testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_PLC);
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_Silence);
+		testAssert(jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_Silence);
+
+		// A big jump in sequence number restarts the stream.
+		jitter_buffer.insertPacket(100000, 0.3, payload, 1);
+		testAssert(jitter_buffer.getStats().num_resets == 1);
+		bool played = false;
+		for(uint32 i=0; i<MAX_TARGET_FRAMES && !played; ++i)
+			played = jitter_buffer.getNextFrame(packet_data, seq_num) == FrameType_Packet;
+		testAssert(played && seq_num == 100000);
+	}
+
+	PCG32 rng(1);
+
+	//-------------------- Test a perfect network: everything is played, no concealment, low latency --------------------
+	{
+		size_t num_lost;
+		const std::vector<VoiceTracePacket> trace = makeTrace(0, /*start time=*/0, /*duration=*/10.0, /*base delay=*/0.03, /*max jitter=*/0, /*loss prob=*/0, rng, num_lost);
+		const VoiceSimResults r = simulate(trace, 11.0, num_lost);
+		printResults("no loss, no jitter       ", r);
+		testAssert(r.stats.num_packets_played == trace.size());
+		testAssert(r.stats.num_fec_frames == 0 && r.stats.num_late_packets == 0);
+		testAssert(r.stats.num_plc_frames == MAX_UNDERRUN_CONCEALED_FRAMES); // Just at the end of the stream.
+		testAssert(r.final_target_delay_frames == 1);
+		testAssert(r.max_latency < 0.03 + 0.02);
+	}
+
+	//-------------------- Test random loss: lost frames are concealed, mostly with FEC --------------------
+	{
+		size_t num_lost;
+		const std::vector<VoiceTracePacket> trace = makeTrace(0, 0, 10.0, 0.03, /*max jitter=*/0, /*loss prob=*/0.05f, rng, num_lost);
+		const VoiceSimResults r = simulate(trace, 11.0, num_lost);
+		printResults("5% loss, no jitter       ", r);
+		testAssert(num_lost > 0);
+		testAssert(r.stats.num_packets_played == trace.size());
+		testAssert(r.stats.num_fec_frames + r.stats.num_plc_frames >= num_lost);
+		testAssert(r.stats.num_fec_frames >= num_lost * 8 / 10); // Most losses are isolated, so can be recovered with FEC.
+		testAssert(r.max_latency < 0.03 + 0.04);
+	}
+
+	//-------------------- Test jitter: the target delay grows to cover it, few packets are late --------------------
+	{
+		size_t num_lost;
+		const std::vector<VoiceTracePacket> trace = makeTrace(0, 0, 20.0, 0.03, /*max jitter=*/0.06, /*loss prob=*/0.02f, rng, num_lost);
+		const VoiceSimResults r = simulate(trace, 21.0, num_lost, /*latency measure start time=*/2.0);
+		printResults("2% loss, 60 ms jitter    ", r);
+		testAssert(r.final_target_delay_frames >= 6 && r.final_target_delay_frames <= 8);
+		testAssert(r.stats.num_late_packets < trace.size() * 3 / 100);
+		testAssert(r.stats.num_packets_played + r.stats.num_late_packets + r.stats.num_frames_dropped == trace.size());
+		testAssert(r.mean_latency < 0.03 + 0.06 + 0.03);
+	}
+
+	//-------------------- Test the delay shrinks again after a period of high jitter --------------------
+	{
+		size_t num_lost_0, num_lost_1, num_lost_2;
+		std::vector<VoiceTracePacket> trace = makeTrace(0, 0, 10.0, 0.03, /*max jitter=*/0.005, 0.01f, rng, num_lost_0);
+		const std::vector<VoiceTracePacket> trace_1 = makeTrace(1000, 10.0, 10.0, 0.03, /*max jitter=*/0.1, 0.01f, rng, num_lost_1);
+		const std::vector<VoiceTracePacket> trace_2 = makeTrace(2000, 20.0, 20.0, 0.03, /*max jitter=*/0.005, 0.01f, rng, num_lost_2);
+		trace.insert(trace.end(), trace_1.begin(), trace_1.end());
+		trace.insert(trace.end(), trace_2.begin(), trace_2.end());
+		std::stable_sort(trace.begin(), trace.end(), [](const VoiceTracePacket& a, const VoiceTracePacket& b) { return a.arrival_time < b.arrival_time; });
+		const size_t num_lost = num_lost_0 + num_lost_1 + num_lost_2;
+
+		const VoiceSimResults r_high = simulate(trace, 20.0, num_lost, /*latency measure start time=*/12.0);
+		printResults("100 ms jitter burst      ", r_high);
+		const VoiceSimResults r_after = simulate(trace, 40.0, num_lost, /*latency measure start time=*/35.0);
+		printResults("after jitter burst       ", r_after);
+
+		testAssert(r_high.mean_latency > 0.03 + 0.05);
+		testAssert(r_after.final_target_delay_frames <= 2);
+		testAssert(r_after.mean_latency < 0.03 + 0.025); // Back to low latency.
+	}
+
+	//-------------------- Test talk spurts: the buffer stops and restarts --------------------
+	{
+		size_t num_lost_0, num_lost_1;
+		std::vector<VoiceTracePacket> trace = makeTrace(0, 0, 2.0, 0.03, /*max jitter=*/0.02, 0, rng, num_lost_0);
+		const std::vector<VoiceTracePacket> trace_1 = makeTrace(200, 5.0, 2.0, 0.03, /*max jitter=*/0.02, 0, rng, num_lost_1); // Same sequence numbers continue after a silence.
+		trace.insert(trace.end(), trace_1.begin(), trace_1.end());
+		const VoiceSimResults r = simulate(trace, 8.0, 0);
+		printResults("talk spurts, 20 ms jitter", r);
+		testAssert(r.stats.num_resets == 0);
+		testAssert(r.stats.num_packets_played + r.stats.num_late_packets + r.stats.num_frames_dropped == trace.size());
+		testAssert(r.stats.num_late_packets < trace.size() * 5 / 100);
+	}
+
+	conPrint("VoiceJitterBuffer::test() done.");
+}
+
+
+} // end namespace glare
+
+
+#endif // BUILD_TESTS
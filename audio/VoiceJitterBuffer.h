@@ -0,0 +1,158 @@
+/*=====================================================================
+VoiceJitterBuffer.h
+-------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/Mutex.h>
+#include <utils/Platform.h>
+#include "SPSCRingBuffer.h"
+#include <vector>
+#include <map>
+
+
+struct OpusDecoder;
+
+
+namespace glare
+{
+
+
+/*=====================================================================
+VoiceJitterBuffer
+-----------------
+Adaptive jitter buffer for a voice chat stream of fixed-duration (10 ms) Opus frames.
+
+Packets are inserted as they arrive from the network, and are reordered by sequence number.
+The playout side calls getNextFrame() once per frame duration, and is told to either decode a packet,
+decode the in-band FEC data of the following packet (for a missing packet whose successor has arrived),
+do Opus packet loss concealment, or output silence.
+
+The target delay is derived from the measured jitter: the spread of (arrival time - send time) over the
+last JITTER_WINDOW_SIZE packets, ignoring the most delayed 5%.
+The buffered delay grows towards the target when packets arrive too late to be played (concealment is
+done without advancing the playout position, so the late packet is played when it arrives), and shrinks
+by dropping a frame when the buffer has held more than the target for a while.
+
+Not threadsafe, see VoiceStreamDecoder.
+=====================================================================*/
+class VoiceJitterBuffer
+{
+public:
+	VoiceJitterBuffer(double frame_duration_s = 0.01);
+	~VoiceJitterBuffer();
+
+	static const uint32 MIN_TARGET_FRAMES = 1;
+	static const uint32 MAX_TARGET_FRAMES = 20;
+	static const uint32 MAX_BUFFERED_FRAMES = 100; // A packet further than this ahead of the playout position restarts the stream.
+	static const uint32 MAX_UNDERRUN_CONCEALED_FRAMES = 5; // Number of frames concealed while waiting for packets before we assume the talker has stopped.
+	static const uint32 SHRINK_CHECK_INTERVAL_FRAMES = 20; // At most one frame is dropped per this many frames, when shrinking the delay.
+	static const size_t JITTER_WINDOW_SIZE = 200;
+	static const size_t MIN_JITTER_SAMPLES = 10;
+	static constexpr float LOSS_RATE_SMOOTHING = 0.995f; // Per-frame smoothing factor for the loss rate.
+	static constexpr float FEC_LOSS_RATE_THRESHOLD = 0.01f; // Above this loss rate, an extra frame is buffered so FEC can be used.
+
+	void insertPacket(uint32 seq_num, double arrival_time, const uint8* data, size_t data_len);
+
+	enum FrameType
+	{
+		FrameType_Packet, // Decode packet_data_out normally.
+		FrameType_FEC, // Decode the FEC data in packet_data_out, which is the packet after the missing one.
+		FrameType_PLC, // Do packet loss concealment.
+		FrameType_Silence // Not playing, output silence.
+	};
+
+	// Called once per frame duration by the playout side.
+	// For FrameType_Packet and FrameType_FEC, packet_data_out is set to the packet to decode, and seq_num_out to the sequence number of the played frame.
+	FrameType getNextFrame(std::vector<uint8>& packet_data_out, uint32& seq_num_out);
+
+	uint32 targetDelayFrames() const { return target_delay_frames; }
+	size_t numBufferedPackets() const { return packets.size(); }
+
+	struct Stats
+	{
+		uint64 num_packets_received;
+		uint64 num_packets_played;
+		uint64 num_late_packets; // Packets that arrived after their frame was played or concealed.
+		uint64 num_duplicate_packets;
+		uint64 num_fec_frames;
+		uint64 num_plc_frames;
+		uint64 num_frames_dropped; // Packets dropped to shrink the delay.
+		uint64 num_resets;
+	};
+	const Stats& getStats() const { return stats; }
+
+	static void test();
+
+private:
+	void reset();
+	void updateTargetDelay(uint32 seq_num, double arrival_time);
+	void updateTargetDelayFrames();
+	uint32 numBufferedFrames() const;
+
+	double frame_duration;
+
+	std::map<uint32, std::vector<uint8> > packets; // Map from sequence number to packet data, for packets not played yet.
+
+	bool started; // Have we started playing since the last reset?  Packets before next_play_seq_num are only treated as late if so.
+	bool playing;
+	uint32 next_play_seq_num;
+	uint32 num_frames_waited; // Number of frames we have waited to build up the buffer before starting playing.
+	uint32 num_underrun_concealed_frames; // Number of consecutive frames concealed due to the buffer being empty.
+
+	uint32 frames_since_shrink_check;
+	uint32 max_buffered_frames_since_shrink_check;
+
+	std::vector<double> relative_delays; // Ring buffer of (arrival time - seq_num * frame_duration) for recent packets.
+	size_t relative_delays_write_i;
+	std::vector<double> temp_delays;
+	uint32 jitter_target_delay_frames; // Target delay needed to cover the measured jitter.
+	float smoothed_loss_rate;
+	uint32 target_delay_frames;
+
+	Stats stats;
+};
+
+
+/*=====================================================================
+VoiceStreamDecoder
+------------------
+A VoiceJitterBuffer and the Opus decoder for a voice chat stream.
+Packets are inserted by ClientUDPHandlerThread, and decoded frames are pulled by the
+AudioEngine mixing thread as the audio source buffer drains, so playout is clocked by the audio device.
+
+Threadsafe.
+=====================================================================*/
+class VoiceStreamDecoder : public ThreadSafeRefCounted
+{
+public:
+	VoiceStreamDecoder(uint32 sampling_rate); // Throws glare::Exception on failure.
+	~VoiceStreamDecoder();
+
+	void insertPacket(uint32 seq_num, double arrival_time, const uint8* data, size_t data_len);
+
+	// Decodes frames and appends them to buffer, until it contains at least num_samples_needed samples.
+	// Updates smoothed_level (see AudioSource::smoothed_cur_level) with the max absolute sample value of each frame.
+	void decodeFramesInto(SPSCRingBuffer<float>& buffer, size_t num_samples_needed, float& smoothed_level);
+
+	VoiceJitterBuffer::Stats getStats() const;
+
+private:
+	GLARE_DISABLE_COPY(VoiceStreamDecoder)
+
+	mutable Mutex mutex;
+	VoiceJitterBuffer jitter_buffer			GUARDED_BY(mutex);
+	OpusDecoder* opus_decoder				GUARDED_BY(mutex);
+	uint32 samples_per_frame;
+
+	std::vector<uint8> packet_data			GUARDED_BY(mutex);
+	std::vector<float> pcm_buffer			GUARDED_BY(mutex);
+};
+typedef Reference<VoiceStreamDecoder> VoiceStreamDecoderRef;
+
+
+} // end namespace glare
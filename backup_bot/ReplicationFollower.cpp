@@ -0,0 +1,376 @@
+/*=====================================================================
+ReplicationFollower.cpp
+-----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ReplicationFollower.h"
+
+
+#include "ResourceDownloaderThread.h"
+#include "../shared/Protocol.h"
+#include <networking/networking.h>
+#include <networking/TLSSocket.h>
+#include <MySocket.h>
+#include <Database.h>
+#include <ConPrint.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <FileUtils.h>
+#include <FileOutStream.h>
+#include <Clock.h>
+#include <Timer.h>
+#include <mathstypes.h>
+#include <algorithm>
+
+
+static const int MAX_STRING_LEN = 10000;
+static const uint64 MAX_RECORD_SIZE = 1ull << 28;
+static const uint64 MAX_NUM_RECORDS_PER_ENTRY = 1ull << 26;
+static const uint64 MAX_NUM_RESOURCES = 1ull << 26;
+static const size_t MAX_CHUNK_SIZE = 1 << 16;
+
+
+ReplicationFollower::ReplicationFollower(const std::string& backup_dir_, ResourceDownloaderThread* resource_downloader_)
+:	snapshot_period(24 * 3600),
+	max_num_snapshots(7),
+	backup_dir(backup_dir_),
+	resource_downloader(resource_downloader_),
+	database(NULL),
+	epoch(0),
+	seq_num(0)
+{
+	db_path = backup_dir + "/server_state.bin";
+	checkpoint_path = backup_dir + "/replication_checkpoint.txt";
+	snapshots_dir = backup_dir + "/snapshots";
+
+	try
+	{
+		FileUtils::createDirIfDoesNotExist(backup_dir);
+		FileUtils::createDirIfDoesNotExist(snapshots_dir);
+
+		// If there is no checkpoint, we don't know what the database is a copy of, so leave epoch as 0, which will make the server send a full sync.
+		if(FileUtils::fileExists(db_path) && FileUtils::fileExists(checkpoint_path))
+		{
+			readCheckpoint();
+			openDatabase();
+		}
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+
+	last_snapshot_time = Clock::getCurTimeRealSec();
+}
+
+
+ReplicationFollower::~ReplicationFollower()
+{
+	closeDatabase();
+}
+
+
+SocketInterfaceRef ReplicationFollower::connectToServer(const std::string& server_hostname, struct tls_config* client_tls_config, uint32 connection_type)
+{
+	const int server_port = 7600;
+
+	MySocketRef plain_socket = new MySocket(server_hostname, server_port);
+	plain_socket->setUseNetworkByteOrder(false);
+
+	SocketInterfaceRef socket = new TLSSocket(plain_socket, client_tls_config, server_hostname);
+
+	socket->writeUInt32(Protocol::CyberspaceHello); // Write hello
+	socket->writeUInt32(Protocol::CyberspaceProtocolVersion); // Write protocol version
+	socket->writeUInt32(connection_type); // Write connection type
+	socket->flush();
+
+	// Read hello response from server
+	const uint32 hello_response = socket->readUInt32();
+	if(hello_response != Protocol::CyberspaceHello)
+		throw glare::Exception("Invalid hello from server: " + toString(hello_response));
+
+	// Read protocol version response from server
+	const uint32 protocol_response = socket->readUInt32();
+	if(protocol_response == Protocol::ClientProtocolTooOld)
+	{
+		const std::string msg = socket->readStringLengthFirst(MAX_STRING_LEN);
+		throw glare::Exception(msg);
+	}
+	else if(protocol_response == Protocol::ClientProtocolTooNew)
+		throw glare::Exception("Server protocol version is older than ours, server may need updating.");
+	else if(protocol_response != Protocol::ClientProtocolOK)
+		throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
+
+	const uint32 server_protocol_version = socket->readUInt32();
+	(void)server_protocol_version;
+
+	return socket;
+}
+
+
+void ReplicationFollower::openDatabase()
+{
+	assert(!database);
+
+	Timer timer;
+	database = new Database();
+	try
+	{
+		if(FileUtils::fileExists(db_path))
+		{
+			database->startReadingFromDisk(db_path);
+			database->finishReadingFromDisk();
+		}
+		else
+			database->openAndMakeOrClearDatabase(db_path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		closeDatabase();
+		throw glare::Exception(e.what());
+	}
+	catch(glare::Exception&)
+	{
+		closeDatabase();
+		throw;
+	}
+
+	conPrint("Opened database '" + db_path + "' in " + timer.elapsedStringNSigFigs(4));
+}
+
+
+void ReplicationFollower::closeDatabase()
+{
+	delete database;
+	database = NULL;
+}
+
+
+void ReplicationFollower::readCheckpoint()
+{
+	const std::vector<std::string> parts = ::split(::stripHeadAndTailWhitespace(FileUtils::readEntireFileTextMode(checkpoint_path)), ' ');
+	if(parts.size() != 2)
+		throw glare::Exception("Invalid replication checkpoint in '" + checkpoint_path + "'.");
+
+	epoch = stringToUInt64(parts[0]);
+	seq_num = stringToUInt64(parts[1]);
+}
+
+
+void ReplicationFollower::writeCheckpoint()
+{
+	// Write to a temporary file then move it into place, so the checkpoint is never left half-written.
+	try
+	{
+		FileUtils::writeEntireFileTextMode(checkpoint_path + ".tmp", toString(epoch) + " " + toString(seq_num) + "\n");
+		FileUtils::moveFile(checkpoint_path + ".tmp", checkpoint_path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+}
+
+
+void ReplicationFollower::receivePresentResources(SocketInterface& socket)
+{
+	const uint64 num_resources = socket.readUInt64();
+	if(num_resources > MAX_NUM_RESOURCES)
+		throw glare::Exception("Too many resources: " + toString(num_resources));
+
+	for(uint64 i=0; i<num_resources; ++i)
+	{
+		ResourceToDownload resource;
+		resource.URL = socket.readStringLengthFirst(MAX_STRING_LEN);
+		resource.local_path = socket.readStringLengthFirst(MAX_STRING_LEN);
+
+		if(FileUtils::isPathSafe(resource.local_path))
+			resource_downloader->enqueueResource(resource);
+		else
+			conPrint("ReplicationFollower: Ignoring resource with unsafe local path '" + resource.local_path + "'.");
+	}
+}
+
+
+void ReplicationFollower::receiveFullSync(SocketInterface& socket)
+{
+	const uint64 new_epoch = socket.readUInt64();
+	const uint64 new_seq_num = socket.readUInt64();
+	const uint64 file_size = socket.readUInt64();
+
+	conPrint("ReplicationFollower: Receiving full sync at seq num " + toString(new_seq_num) + " (database: " + toString(file_size) + " B)...");
+	Timer timer;
+
+	try
+	{
+		// Stream the database to a temporary file, so the current database stays usable until the new one is complete.
+		const std::string incoming_path = db_path + ".incoming";
+		{
+			FileOutStream file(incoming_path, std::ios::binary | std::ios::trunc);
+
+			record_buf.resize(MAX_CHUNK_SIZE);
+			uint64 offset = 0;
+			while(offset < file_size)
+			{
+				const size_t chunk_size = (size_t)myMin<uint64>(file_size - offset, MAX_CHUNK_SIZE);
+				socket.readData(record_buf.data(), chunk_size);
+				file.writeData(record_buf.data(), chunk_size);
+				offset += chunk_size;
+			}
+
+			file.close(); // Manually call close, to check for any errors via failbit.
+		}
+
+		// Remove the checkpoint before replacing the database, so if we crash in between, the old checkpoint isn't used with the new database.
+		if(FileUtils::fileExists(checkpoint_path))
+			FileUtils::deleteFile(checkpoint_path);
+
+		closeDatabase();
+		FileUtils::moveFile(incoming_path, db_path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+
+	epoch = new_epoch;
+	seq_num = new_seq_num;
+	openDatabase();
+	writeCheckpoint();
+
+	receivePresentResources(socket);
+
+	conPrint("ReplicationFollower: Full sync done in " + timer.elapsedStringNSigFigs(4));
+}
+
+
+void ReplicationFollower::receiveLogEntry(SocketInterface& socket)
+{
+	const uint64 entry_seq_num = socket.readUInt64();
+
+	if(!database)
+		throw glare::Exception("Received log entry before full sync.");
+	if(entry_seq_num != seq_num + 1)
+		throw glare::Exception("Expected log entry " + toString(seq_num + 1) + ", received " + toString(entry_seq_num));
+
+	const uint64 num_deletions = socket.readUInt64();
+	if(num_deletions > MAX_NUM_RECORDS_PER_ENTRY)
+		throw glare::Exception("Too many record deletions: " + toString(num_deletions));
+
+	// Deletions are done before updates, as on the server.
+	for(uint64 i=0; i<num_deletions; ++i)
+		database->deleteRecord(DatabaseKey(socket.readUInt64()));
+
+	const uint64 num_updates = socket.readUInt64();
+	if(num_updates > MAX_NUM_RECORDS_PER_ENTRY)
+		throw glare::Exception("Too many record updates: " + toString(num_updates));
+
+	for(uint64 i=0; i<num_updates; ++i)
+	{
+		const uint64 key = socket.readUInt64();
+		const uint64 size = socket.readUInt64();
+		if(size > MAX_RECORD_SIZE)
+			throw glare::Exception("Record too large: " + toString(size) + " B");
+
+		record_buf.resize(size);
+		socket.readData(record_buf.data(), size);
+
+		database->updateRecord(DatabaseKey(key), ArrayRef<uint8>(record_buf.data(), size));
+	}
+
+	try
+	{
+		database->flush();
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+
+	seq_num = entry_seq_num;
+	writeCheckpoint();
+
+	receivePresentResources(socket);
+}
+
+
+// Copies the database to the snapshots dir, if snapshot_period has passed since the last copy, and deletes the oldest copies.
+// The database is flushed after each log entry, and we are the only writer, so the copy is consistent.
+void ReplicationFollower::makeSnapshotIfNeeded()
+{
+	if((snapshot_period <= 0) || !database)
+		return;
+
+	const double cur_time = Clock::getCurTimeRealSec();
+	if(cur_time - last_snapshot_time < snapshot_period)
+		return;
+
+	try
+	{
+		// Name the snapshot by time, so that sorting the names sorts by time.
+		const std::string snapshot_path = snapshots_dir + "/server_state_" + toString((uint64)Clock::getSecsSince1970()) + "_" + toString(seq_num) + ".bin";
+		FileUtils::copyFile(db_path, snapshot_path);
+		conPrint("ReplicationFollower: Saved snapshot '" + snapshot_path + "'.");
+
+		std::vector<std::string> snapshot_filenames;
+		const std::vector<std::string> filenames = FileUtils::getFilesInDir(snapshots_dir);
+		for(size_t i=0; i<filenames.size(); ++i)
+			if(::hasPrefix(filenames[i], "server_state_") && ::hasSuffix(filenames[i], ".bin"))
+				snapshot_filenames.push_back(filenames[i]);
+
+		std::sort(snapshot_filenames.begin(), snapshot_filenames.end());
+		for(int i=0; i<(int)snapshot_filenames.size() - myMax(1, max_num_snapshots); ++i)
+		{
+			FileUtils::deleteFile(snapshots_dir + "/" + snapshot_filenames[i]);
+			conPrint("ReplicationFollower: Deleted old snapshot '" + snapshot_filenames[i] + "'.");
+		}
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("ReplicationFollower: Error while saving snapshot: " + e.what());
+	}
+
+	last_snapshot_time = cur_time;
+}
+
+
+void ReplicationFollower::followServer(const std::string& server_hostname, struct tls_config* client_tls_config, const std::string& password)
+{
+	SocketInterfaceRef socket = connectToServer(server_hostname, client_tls_config, Protocol::ConnectionTypeReplication);
+
+	socket->writeStringLengthFirst(password);
+	socket->writeUInt64(database ? epoch : 0);
+	socket->writeUInt64(seq_num);
+	socket->flush();
+
+	conPrint("ReplicationFollower: Connected to " + server_hostname + ", checkpoint: epoch " + toString(epoch) + ", seq num " + toString(seq_num));
+
+	while(1)
+	{
+		const uint32 msg_type = socket->readUInt32();
+		if(msg_type == Protocol::ReplicationFullSync)
+		{
+			receiveFullSync(*socket);
+		}
+		else if(msg_type == Protocol::ReplicationResumed)
+		{
+			const uint64 server_epoch = socket->readUInt64();
+			if(server_epoch != epoch)
+				throw glare::Exception("Server resumed replication with a different epoch.");
+
+			conPrint("ReplicationFollower: Resumed after seq num " + toString(seq_num));
+
+			receivePresentResources(*socket);
+		}
+		else if(msg_type == Protocol::ReplicationLogEntry)
+		{
+			receiveLogEntry(*socket);
+		}
+		else if(msg_type == Protocol::ReplicationHeartbeat)
+		{}
+		else
+			throw glare::Exception("Unhandled message type from server: " + toString(msg_type));
+
+		makeSnapshotIfNeeded();
+	}
+}
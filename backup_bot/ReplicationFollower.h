@@ -0,0 +1,78 @@
+/*=====================================================================
+ReplicationFollower.h
+---------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <SocketInterface.h>
+#include <Platform.h>
+#include <string>
+#include <vector>
+class Database;
+class ResourceDownloaderThread;
+struct tls_config;
+
+
+/*=====================================================================
+ReplicationFollower
+-------------------
+Keeps a copy of the server database and resources up to date, by following the
+server's replication stream.  See WorkerThread::handleReplicationConnection() for the protocol.
+
+The backup dir has the same layout as the server state dir, so a server can be started on it as a warm standby:
+	server_state.bin				The database.
+	server_resources/				Resource files, downloaded by a ResourceDownloaderThread.
+	replication_checkpoint.txt		Epoch and sequence number of the last log entry applied to the database.
+	snapshots/						Point-in-time copies of the database, made every snapshot_period seconds.
+
+Each log entry is applied and flushed before the checkpoint is written, so after a crash an entry may be
+applied again, which is harmless as applying an entry just sets or deletes records.
+
+Memory use is bounded by the largest single record, apart from opening the database,
+which reads it like the server does at startup.
+=====================================================================*/
+class ReplicationFollower
+{
+public:
+	// Opens the database in backup_dir if there is one, and reads the checkpoint.  Throws glare::Exception on failure.
+	ReplicationFollower(const std::string& backup_dir, ResourceDownloaderThread* resource_downloader);
+	~ReplicationFollower();
+
+	// Connects to the server and applies the replication stream until the connection fails.
+	// Throws glare::Exception on failure.
+	void followServer(const std::string& server_hostname, struct tls_config* client_tls_config, const std::string& password);
+
+	// Connects to the server, does the hello handshake, and writes the connection type.  Throws glare::Exception on failure.
+	static SocketInterfaceRef connectToServer(const std::string& server_hostname, struct tls_config* client_tls_config, uint32 connection_type);
+
+	double snapshot_period; // Time between point-in-time copies of the database, in seconds.  <= 0 to disable.
+	int max_num_snapshots; // Oldest snapshots are deleted when there are more than this.
+
+private:
+	GLARE_DISABLE_COPY(ReplicationFollower)
+
+	void openDatabase();
+	void closeDatabase();
+	void receiveFullSync(SocketInterface& socket);
+	void receiveLogEntry(SocketInterface& socket);
+	void receivePresentResources(SocketInterface& socket);
+	void readCheckpoint();
+	void writeCheckpoint();
+	void makeSnapshotIfNeeded();
+
+	std::string backup_dir;
+	std::string db_path;
+	std::string checkpoint_path;
+	std::string snapshots_dir;
+
+	ResourceDownloaderThread* resource_downloader;
+
+	Database* database; // NULL if there is no local database yet.
+	uint64 epoch; // Epoch of the server replication log the database is a copy of.  0 if there is no local database yet.
+	uint64 seq_num; // Sequence number of the last log entry applied.
+
+	double last_snapshot_time;
+	std::vector<uint8> record_buf;
+};
@@ -0,0 +1,153 @@
+/*=====================================================================
+ResourceDownloaderThread.cpp
+----------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ResourceDownloaderThread.h"
+
+
+#include "ReplicationFollower.h"
+#include "../shared/Protocol.h"
+#include <ConPrint.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <FileUtils.h>
+#include <FileOutStream.h>
+#include <PlatformUtils.h>
+#include <Lock.h>
+#include <mathstypes.h>
+
+
+static const size_t MAX_RESOURCES_PER_REQUEST = 200;
+static const size_t MAX_CHUNK_SIZE = 1 << 16;
+static const uint64 MAX_FILE_SIZE = 4000000000ull;
+
+
+ResourceDownloaderThread::ResourceDownloaderThread(const std::string& server_hostname_, struct tls_config* client_tls_config_, const std::string& resources_dir_)
+:	num_files_downloaded(0),
+	num_bytes_downloaded(0),
+	server_hostname(server_hostname_),
+	client_tls_config(client_tls_config_),
+	resources_dir(resources_dir_)
+{}
+
+
+ResourceDownloaderThread::~ResourceDownloaderThread()
+{}
+
+
+void ResourceDownloaderThread::enqueueResource(const ResourceToDownload& resource)
+{
+	queue.enqueue(resource);
+}
+
+
+bool ResourceDownloaderThread::localFileExists(const ResourceToDownload& resource)
+{
+	return FileUtils::fileExists(resources_dir + "/" + resource.local_path);
+}
+
+
+void ResourceDownloaderThread::downloadResources(SocketInterface& socket, const std::vector<ResourceToDownload>& resources)
+{
+	socket.writeUInt32(Protocol::GetFiles);
+	socket.writeUInt64(resources.size()); // Write number of files to get
+	for(size_t i=0; i<resources.size(); ++i)
+		socket.writeStringLengthFirst(resources[i].URL);
+	socket.flush();
+
+	// Read reply, which has a result code for each resource, followed by the file data if the result was OK.
+	for(size_t i=0; i<resources.size(); ++i)
+	{
+		const uint32 result = socket.readUInt32();
+		if(result == 0) // If OK:
+		{
+			const uint64 file_len = socket.readUInt64();
+			if(file_len > MAX_FILE_SIZE)
+				throw glare::Exception("downloaded file too large (len=" + toString(file_len) + ").");
+
+			// Stream to a temporary file, then move it into place, so a partially written file is never left at the final path.
+			const std::string path = resources_dir + "/" + resources[i].local_path;
+			const std::string temp_path = path + ".tmp";
+			if(resources[i].local_path.find('/') != std::string::npos)
+				FileUtils::createDirsForPath(path);
+			{
+				FileOutStream file(temp_path, std::ios::binary | std::ios::trunc);
+
+				uint64 offset = 0;
+				while(offset < file_len)
+				{
+					const size_t chunk_size = (size_t)myMin<uint64>(file_len - offset, MAX_CHUNK_SIZE);
+					socket.readData(temp_buf.data(), chunk_size);
+					file.writeData(temp_buf.data(), chunk_size);
+					offset += chunk_size;
+				}
+
+				file.close(); // Manually call close, to check for any errors via failbit.
+			}
+			FileUtils::moveFile(temp_path, path);
+
+			num_files_downloaded.increment();
+			num_bytes_downloaded.add((int64)file_len);
+		}
+		else
+		{
+			conPrint("ResourceDownloaderThread: Server couldn't send file '" + resources[i].URL + "' (Result=" + toString(result) + ")");
+		}
+	}
+}
+
+
+void ResourceDownloaderThread::run()
+{
+	PlatformUtils::setCurrentThreadName("ResourceDownloaderThread");
+
+	temp_buf.resize(MAX_CHUNK_SIZE);
+
+	SocketInterfaceRef socket;
+	std::vector<ResourceToDownload> resources;
+	while(1)
+	{
+		if(resources.empty())
+		{
+			// Block until there is a resource to download, then take any others queued, up to the request size limit.
+			ResourceToDownload resource;
+			queue.dequeue(resource);
+			if(!localFileExists(resource))
+				resources.push_back(resource);
+
+			Lock lock(queue.getMutex());
+			while(!queue.unlockedEmpty() && (resources.size() < MAX_RESOURCES_PER_REQUEST))
+			{
+				queue.unlockedDequeue(resource);
+				if(!localFileExists(resource))
+					resources.push_back(resource);
+			}
+		}
+
+		if(resources.empty())
+			continue;
+
+		try
+		{
+			if(socket.isNull())
+				socket = ReplicationFollower::connectToServer(server_hostname, client_tls_config, Protocol::ConnectionTypeDownloadResources);
+
+			downloadResources(*socket, resources);
+
+			resources.clear();
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("ResourceDownloaderThread: Error: " + e.what() + ", retrying in 10 s.");
+			socket = NULL;
+			PlatformUtils::Sleep(10000); // The resources will be requested again.
+		}
+		catch(FileUtils::FileUtilsExcep& e)
+		{
+			conPrint("ResourceDownloaderThread: File error: " + e.what() + ", retrying in 10 s.");
+			socket = NULL; // The rest of the file data wasn't read, so we can't carry on using the connection.
+			PlatformUtils::Sleep(10000);
+		}
+	}
+}
@@ -0,0 +1,62 @@
+/*=====================================================================
+ResourceDownloaderThread.h
+--------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <MyThread.h>
+#include <ThreadSafeQueue.h>
+#include <AtomicInt.h>
+#include <SocketInterface.h>
+#include <string>
+#include <vector>
+struct tls_config;
+
+
+struct ResourceToDownload
+{
+	std::string URL;
+	std::string local_path; // Relative to the resources dir.
+};
+
+
+/*=====================================================================
+ResourceDownloaderThread
+------------------------
+Downloads resource files from the server into the backup resources dir, on a
+ConnectionTypeDownloadResources connection.  Files are streamed to disk in chunks,
+to a temporary file which is renamed when complete, so a partially downloaded file
+is never taken for a complete one.
+
+Resources whose file already exists are skipped, so the same resource can be enqueued
+multiple times, e.g. after every full sync.  On errors the thread reconnects after a
+delay and retries.
+=====================================================================*/
+class ResourceDownloaderThread : public MyThread
+{
+public:
+	ResourceDownloaderThread(const std::string& server_hostname, struct tls_config* client_tls_config, const std::string& resources_dir);
+	~ResourceDownloaderThread();
+
+	virtual void run();
+
+	void enqueueResource(const ResourceToDownload& resource); // threadsafe
+
+	glare::AtomicInt num_files_downloaded;
+	glare::AtomicInt num_bytes_downloaded;
+
+private:
+	GLARE_DISABLE_COPY(ResourceDownloaderThread)
+
+	bool localFileExists(const ResourceToDownload& resource);
+	void downloadResources(SocketInterface& socket, const std::vector<ResourceToDownload>& resources);
+
+	std::string server_hostname;
+	struct tls_config* client_tls_config;
+	std::string resources_dir;
+
+	ThreadSafeQueue<ResourceToDownload> queue;
+	std::vector<uint8> temp_buf;
+};
@@ -15,6 +15,8 @@ Copyright Glare Technologies Limited 2022 -
 #include "../shared/Protocol.h"
 #include "../shared/ProtocolStructs.h"
 #include "../shared/Parcel.h"
+#include "../shared/TransformCompression.h"
+#include "../shared/MessageUtils.h"
 #include <networking/Networking.h>
 #include <vec3.h>
 #include <SocketBufferOutStream.h>
@@ -25,6 +27,8 @@ Copyright Glare Technologies Limited 2022 -
 #include <Clock.h>
 #include <PoolAllocator.h>
 #include <Timer.h>
+#include <unordered_set>
+#include <cstring>
 #if EMSCRIPTEN
 #include <networking/EmscriptenWebSocket.h>
 #endif
@@ -102,6 +106,44 @@ WorldObjectRef ClientThread::allocWorldObject()
 }
 
 
+void ClientThread::readAndInsertInitialSendObject(BufferInStream& stream)
+{
+	const UID object_uid = readUIDFromStream(stream);
+
+	// Read from network
+	WorldObjectRef ob = allocWorldObject();
+	ob->uid = object_uid;
+	readWorldObjectFromNetworkStreamGivenUID(stream, *ob);
+
+	if(!isFinite(ob->angle))
+		ob->angle = 0;
+	if(!ob->axis.isFinite())
+		ob->axis = Vec3f(1,0,0);
+
+	ob->state = WorldObject::State_InitialSend;
+	ob->from_remote_other_dirty = true;
+	ob->setTransformAndHistory(ob->pos, ob->axis, ob->angle);
+
+	// TEMP HACK: set a smaller max loading distance for CV features
+	const char* feature_prefix = "CryptoVoxels Feature, uuid: ";
+	if(hasPrefix(ob->content, feature_prefix))
+		ob->max_load_dist2 = Maths::square(100.f);
+
+	// Insert into world state.
+	{
+		::Lock lock(world_state->mutex);
+
+		// When a client moves and a new cell comes into proximity, a QueryObjects message is sent to the server.
+		// The server replies with ObjectInitialSend messages.
+		// This means that the client may already have the object inserted, when moving back into a cell previously in proximity.
+		// We want to make sure not to add the object twice or load it into the graphics engine twice.
+		const bool added = world_state->objects.insert(object_uid, ob);
+		if(added)
+			world_state->dirty_from_remote_objects.insert(ob);
+	}
+}
+
+
 void ClientThread::doRun()
 {
 	PlatformUtils::setCurrentThreadNameIfTestsEnabled("ClientThread");
@@ -175,6 +217,16 @@ void ClientThread::doRun()
 		// Read assigned client avatar UID
 		this->client_avatar_uid = readUIDFromStream(*socket);
 
+		if(peer_protocol_version >= 42) // Stream compression was added in protocol version 42.
+		{
+			// Ask the server to compress the messages it sends us.  Enqueue before ClientConnectedToServerMessage is handled, so that the initial object query response is compressed.
+			SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+			MessageUtils::initPacket(packet, Protocol::EnableStreamCompression);
+			packet.writeUInt64(StreamCompression::getDictionaryHash());
+			MessageUtils::updatePacketLengthField(packet);
+			enqueueDataToSend(ArrayRef<uint8>(packet.buf.data(), packet.buf.size()));
+		}
+
 		out_msg_queue->enqueue(new ClientConnectedToServerMessage(this->client_avatar_uid, peer_protocol_version));
 
 #if defined(EMSCRIPTEN)
@@ -220,28 +272,39 @@ void ClientThread::doRun()
 				return;
 			}
 
+			// If we have a complete message decompressed from a CompressedMessages message, handle it before reading more from the socket.
+			const bool have_decompressed_msg = stream_decompressor.nonNull() && stream_decompressor->haveCompleteMessage();
+
 #if defined(_WIN32) || defined(OSX) || defined(EMSCRIPTEN)
-			if(socket->readable(/*timeout (s)=*/0.1)) // If socket has some data to read from it:  (Use a timeout so we can check should_die occasionally)
+			if(have_decompressed_msg || socket->readable(/*timeout (s)=*/0.1)) // If socket has some data to read from it:  (Use a timeout so we can check should_die occasionally)
 #else
-			if(socket->readable(event_fd)) // Block until either the socket is readable or the event fd is signalled, which means should_die has been set.
+			if(have_decompressed_msg || socket->readable(event_fd)) // Block until either the socket is readable or the event fd is signalled, which means should_die has been set.
 #endif
 			{
-				// Read msg type and length
-				uint32 msg_type_and_len[2];
-				socket->readData(msg_type_and_len, sizeof(uint32) * 2);
-				const uint32 msg_type = msg_type_and_len[0];
-				const uint32 msg_len = msg_type_and_len[1];
+				uint32 msg_type = 0;
+				if(have_decompressed_msg)
+				{
+					stream_decompressor->takeMessage(msg_buffer, msg_type); // Copies the message to msg_buffer.  Checks the message size.
+				}
+				else
+				{
+					// Read msg type and length
+					uint32 msg_type_and_len[2];
+					socket->readData(msg_type_and_len, sizeof(uint32) * 2);
+					msg_type = msg_type_and_len[0];
+					const uint32 msg_len = msg_type_and_len[1];
 				
-				// conPrint("ClientThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
+					// conPrint("ClientThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
 
-				if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
-					throw glare::Exception("Invalid message size: " + toString(msg_len));
+					if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
+						throw glare::Exception("Invalid message size: " + toString(msg_len));
 
-				// Read entire message
-				msg_buffer.buf.resizeNoCopy(msg_len);
-				msg_buffer.read_index = sizeof(uint32) * 2;
+					// Read entire message
+					msg_buffer.buf.resizeNoCopy(msg_len);
+					msg_buffer.read_index = sizeof(uint32) * 2;
 
-				socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
+					socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
+				}
 
 				switch(msg_type)
 				{
@@ -283,28 +346,7 @@ void ClientThread::doRun()
 						const Vec3f rotation = readVec3FromStream<float>(msg_buffer);
 						const uint32 anim_state_and_input_bitflags = msg_buffer.readUInt32();
 
-						// Look up existing avatar in world state
-						{
-							Lock lock(world_state->mutex);
-							auto res = world_state->avatars.find(avatar_uid);
-							if(res != world_state->avatars.end())
-							{
-								Avatar* avatar = res->second.getPointer();
-								avatar->pos = pos;
-								avatar->rotation = rotation;
-								avatar->anim_state = anim_state_and_input_bitflags & 0xFF;
-								avatar->last_physics_input_bitflags = anim_state_and_input_bitflags >> 16;
-								avatar->transform_dirty = true;
-
-								//conPrint("updated avatar transform");
-
-								avatar->pos_snapshots      [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = pos;
-								avatar->rotation_snapshots [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = rotation;
-								avatar->snapshot_times     [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = Clock::getTimeSinceInit();
-								//avatar->last_snapshot_time = Clock::getCurTimeRealSec();
-								avatar->next_snapshot_i++;
-							}
-						}
+						handleAvatarTransformUpdate(avatar_uid, pos, rotation, anim_state_and_input_bitflags);
 						break;
 					}
 				case Protocol::AvatarFullUpdate:
@@ -313,6 +355,8 @@ void ClientThread::doRun()
 
 						const UID avatar_uid = readUIDFromStream(msg_buffer);
 
+						transform_codec.resetEntity(TransformCompression::EntityTransform::avatarEntityKey(avatar_uid)); // The server resets the transform delta baseline when it sends this message.
+
 						Avatar temp_avatar;
 						readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
 
@@ -397,6 +441,8 @@ void ClientThread::doRun()
 						conPrint("AvatarDestroyed");
 						const UID avatar_uid = readUIDFromStream(msg_buffer);
 
+						transform_codec.resetEntity(TransformCompression::EntityTransform::avatarEntityKey(avatar_uid)); // The server resets the transform delta baseline when it sends this message.
+
 						// Mark avatar as dead
 						{
 							Lock lock(world_state->mutex);
@@ -498,54 +544,7 @@ void ClientThread::doRun()
 
 						// conPrint("ClientThread: received ObjectTransformUpdate, transform_update_avatar_uid: " + toString(transform_update_avatar_uid));
 
-						if(transform_update_avatar_uid != (uint32)this->client_avatar_uid.value()) // Discard ObjectTransformUpdate messages we sent. 
-						{
-							// Look up existing object in world state
-							Lock lock(world_state->mutex);
-							auto res = world_state->objects.find(object_uid);
-							if(res != world_state->objects.end())
-							{
-								
-								WorldObject* ob = res.getValue().ptr();
-#if GUI_CLIENT
-								if(!ob->is_selected) // Don't update the selected object - we will consider the local client control authoritative while the object is selected.
-#endif
-								{
-									//conPrint("ObjectTransformUpdate: setting ob pos to " + pos.toString());
-#if GUI_CLIENT
-									//ob->last_pos = ob->pos;
-#endif
-									ob->pos = pos;
-									ob->axis = axis;
-									ob->angle = angle;
-									ob->scale = scale;
-
-									// If we had physics snapshots, reset snapshots.
-									if(ob->snapshots_are_physics_snapshots)
-									{
-										// conPrint("Resetting snapshots.");
-										ob->next_insertable_snapshot_i = 0;
-										ob->next_snapshot_i = 0;
-									}
-									ob->snapshots_are_physics_snapshots = false;
-
-									
-									ob->snapshots[ob->next_snapshot_i % (uint32)WorldObject::HISTORY_BUF_SIZE] = 
-										WorldObject::Snapshot({pos.toVec4fPoint(), Quatf::fromAxisAndAngle(normalise(axis), angle), /*linear vel=*/Vec4f(0.f), /*angular_vel=*/Vec4f(0.f), /*client time=*/0.0, /*local time=*/Clock::getTimeSinceInit()});
-
-									ob->next_snapshot_i++;
-
-									ob->from_remote_transform_dirty = true;
-									world_state->dirty_from_remote_objects.insert(ob);
-
-									//conPrint("updated object transform");
-								}
-							}
-						}
-						else
-						{
-							// conPrint("\tDiscarding ObjectTransformUpdate message, as we sent it.");
-						}
+						handleObjectTransformUpdate(object_uid, pos, axis, angle, scale, transform_update_avatar_uid);
 						break;
 					}
 					case Protocol::SummonObject:
@@ -601,57 +600,33 @@ void ClientThread::doRun()
 						//conPrint("ClientThread: received ObjectPhysicsTransformUpdate, transform_update_avatar_uid: " + toString(transform_update_avatar_uid));
 						//conPrint("transform_client_time: " + toString(transform_client_time) + ", cur global time: " + toString(world_state->getCurrentGlobalTime()));
 
-						if(transform_update_avatar_uid != (uint32)this->client_avatar_uid.value()) // Discard ObjectPhysicsTransformUpdate messages we sent.
+						handleObjectPhysicsTransformUpdate(object_uid, pos, rot, linear_vel, angular_vel, transform_update_avatar_uid, transform_client_time);
+						break;
+					}
+				case Protocol::TransformUpdateBatch:
+					{
+						transform_codec.readBatch(msg_buffer, temp_transforms);
+
+						for(size_t i=0; i<temp_transforms.size(); ++i)
 						{
-							// Look up existing object in world state
-							Lock lock(world_state->mutex);
-							auto res = world_state->objects.find(object_uid);
-							if(res != world_state->objects.end())
+							const TransformCompression::EntityTransform& t = temp_transforms[i];
+							if(t.type == TransformCompression::EntityTransform::Type_Avatar)
 							{
-								WorldObject* ob = res.getValue().ptr();
-
-								if(ob->physics_owner_id == transform_update_avatar_uid) // Only process messages that are from the physics owner of this object, discard others.
-								{
-									// If we had non-physics snapshots, reset snapshots.
-									if(!ob->snapshots_are_physics_snapshots)
-									{
-										// conPrint("Resetting snapshots.");
-										ob->next_insertable_snapshot_i = 0;
-										ob->next_snapshot_i = 0;
-									}
-									ob->snapshots_are_physics_snapshots = true;
-
-									const double local_time = Clock::getTimeSinceInit();
-
-									ob->snapshots[ob->next_snapshot_i % (uint32)WorldObject::HISTORY_BUF_SIZE] = WorldObject::Snapshot({pos.toVec4fPoint(), rot, linear_vel, angular_vel, transform_client_time, local_time});
-
-									ob->next_snapshot_i++;
-
-									// conPrint("ClientThread: Added snapshot " + toString(ob->next_snapshot_i));
-
-									//NEW: Compute transmission_time_offset: An estimate of local_clock_time - sending_clock_time.
-									// TODO: Handle a different client taking over sending messages.
-									/*if(ob->transmission_time_offset == std::numeric_limits<double>::infinity())
-									{
-										ob->transmission_time_offset = Clock::getTimeSinceInit() - last_transform_client_time;
-
-										conPrint("Storing new ob->transmission_time_offset: " + doubleToString(ob->transmission_time_offset));
-									}*/
-
-									ob->from_remote_physics_transform_dirty = true;
-									world_state->dirty_from_remote_objects.insert(ob);
-								}
-								else
-								{
-									// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as not from physics owner of object.");
-								}
+								handleAvatarTransformUpdate(t.uid, t.pos, t.avatar_rotation, t.avatar_anim_state);
+							}
+							else if(t.type == TransformCompression::EntityTransform::Type_Object)
+							{
+								Vec4f axis;
+								float angle;
+								t.rot.toAxisAndAngle(axis, angle);
+								handleObjectTransformUpdate(t.uid, t.pos, Vec3f(axis), angle, t.scale, t.transform_update_avatar_uid);
+							}
+							else
+							{
+								handleObjectPhysicsTransformUpdate(t.uid, t.pos, t.rot, Vec4f(t.linear_vel.x, t.linear_vel.y, t.linear_vel.z, 0), Vec4f(t.angular_vel.x, t.angular_vel.y, t.angular_vel.z, 0),
+									t.transform_update_avatar_uid, t.client_time);
 							}
 						}
-						else
-						{
-							// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as we sent it.");
-						}
-
 						break;
 					}
 				case Protocol::ObjectFullUpdate:
@@ -659,6 +634,8 @@ void ClientThread::doRun()
 						//conPrint("ObjectFullUpdate");
 						const UID object_uid = readUIDFromStream(msg_buffer);
 
+						transform_codec.resetEntity(TransformCompression::EntityTransform::objectEntityKey(object_uid)); // The server resets the transform delta baseline when it sends this message.
+
 						// Look up existing object in world state
 						{
 							bool read = false;
@@ -831,39 +808,44 @@ void ClientThread::doRun()
 					{
 						// NOTE: currently same code/semantics as ObjectCreated
 						//conPrint("ObjectInitialSend");
-						const UID object_uid = readUIDFromStream(msg_buffer);
-
-						// Read from network
-						WorldObjectRef ob = allocWorldObject();
-						ob->uid = object_uid;
-						readWorldObjectFromNetworkStreamGivenUID(msg_buffer, *ob);
-
-						if(!isFinite(ob->angle))
-							ob->angle = 0;
-						if(!ob->axis.isFinite())
-							ob->axis = Vec3f(1,0,0);
-
-						ob->state = WorldObject::State_InitialSend;
-						ob->from_remote_other_dirty = true;
-						ob->setTransformAndHistory(ob->pos, ob->axis, ob->angle);
+						readAndInsertInitialSendObject(msg_buffer);
+						break;
+					}
+				case Protocol::IncrementalObjectSyncDone:
+					{
+						// Sent by the server after the new and changed objects in response to QueryObjectsInAABBIncremental.
+						const TimeStamp valid_time(msg_buffer.readUInt64());
+						const uint32 num_deleted = msg_buffer.readUInt32();
+						if(num_deleted > ObjectSyncDigest::MAX_NUM_KNOWN_OBJECTS)
+							throw glare::Exception("Invalid num deleted objects: " + toString(num_deleted));
 
-						// TEMP HACK: set a smaller max loading distance for CV features
-						const char* feature_prefix = "CryptoVoxels Feature, uuid: ";
-						if(hasPrefix(ob->content, feature_prefix))
-							ob->max_load_dist2 = Maths::square(100.f);
+						std::unordered_set<UID, UIDHasher> deleted_uids;
+						for(uint32 i=0; i<num_deleted; ++i)
+							deleted_uids.insert(readUIDFromStream(msg_buffer));
 
-						// Insert into world state.
+						if(object_sync_cache.nonNull())
 						{
-							::Lock lock(world_state->mutex);
+							// Insert the cached objects that weren't deleted.
+							// Changed objects have already been inserted from the ObjectInitialSend messages, so the cached copies of them won't be inserted.
+							BufferInStream cache_stream;
+							cache_stream.buf.resizeNoCopy(object_sync_cache->ob_data.size());
+							if(!object_sync_cache->ob_data.empty())
+								std::memcpy(cache_stream.buf.data(), object_sync_cache->ob_data.data(), object_sync_cache->ob_data.size());
+
+							const std::vector<ObjectSyncDigest::KnownObject>& known_objects = object_sync_cache->digest.known_objects;
+							for(size_t i=0; i<known_objects.size(); ++i)
+								if(deleted_uids.count(known_objects[i].uid) == 0)
+								{
+									cache_stream.read_index = object_sync_cache->ob_data_offsets[i];
+									readAndInsertInitialSendObject(cache_stream);
+								}
 
-							// When a client moves and a new cell comes into proximity, a QueryObjects message is sent to the server.
-							// The server replies with ObjectInitialSend messages.
-							// This means that the client may already have the object inserted, when moving back into a cell previously in proximity.
-							// We want to make sure not to add the object twice or load it into the graphics engine twice.
-							const bool added = world_state->objects.insert(object_uid, ob);
-							if(added)
-								world_state->dirty_from_remote_objects.insert(ob);
+							conPrint("IncrementalObjectSyncDone: " + toString(known_objects.size()) + " cached object(s), " + toString(num_deleted) + " deleted.");
+
+							object_sync_cache = NULL; // Not needed any more.
 						}
+
+						out_msg_queue->enqueue(new IncrementalObjectSyncDoneMessage(valid_time));
 						break;
 					}
 				case Protocol::ObjectDestroyed:
@@ -871,6 +853,8 @@ void ClientThread::doRun()
 						conPrint("ObjectDestroyed");
 						const UID object_uid = readUIDFromStream(msg_buffer);
 
+						transform_codec.resetEntity(TransformCompression::EntityTransform::objectEntityKey(object_uid)); // The server resets the transform delta baseline when it sends this message.
+
 						// Mark object as dead
 						{
 							Lock lock(world_state->mutex);
@@ -1082,6 +1066,24 @@ void ClientThread::doRun()
 						out_msg_queue->enqueue(msg);
 						break;
 					}
+				case Protocol::StreamCompressionEnabled:
+					{
+						// All following messages from the server will be sent compressed, in CompressedMessages messages.
+						const uint32 flags = msg_buffer.readUInt32();
+						if(stream_decompressor.nonNull())
+							throw glare::Exception("Stream compression already enabled.");
+						stream_decompressor = new StreamCompression::Decompressor(/*use_dictionary=*/(flags & StreamCompression::USE_DICTIONARY_FLAG) != 0);
+						break;
+					}
+				case Protocol::CompressedMessages:
+					{
+						if(stream_decompressor.isNull())
+							throw glare::Exception("Received CompressedMessages before StreamCompressionEnabled.");
+
+						// Decompress the payload.  Any complete messages will be handled in the next loop iterations.
+						stream_decompressor->decompress(msg_buffer.buf.data() + msg_buffer.read_index, msg_buffer.buf.size() - msg_buffer.read_index);
+						break;
+					}
 				default:
 					{
 						conPrint("Unknown message id: " + ::toString(msg_type));
@@ -1117,6 +1119,149 @@ void ClientThread::doRun()
 }
 
 
+void ClientThread::handleAvatarTransformUpdate(const UID& avatar_uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state_and_input_bitflags)
+{
+	// Look up existing avatar in world state
+	Lock lock(world_state->mutex);
+	auto res = world_state->avatars.find(avatar_uid);
+	if(res != world_state->avatars.end())
+	{
+		Avatar* avatar = res->second.getPointer();
+		avatar->pos = pos;
+		avatar->rotation = rotation;
+		avatar->anim_state = anim_state_and_input_bitflags & 0xFF;
+		avatar->last_physics_input_bitflags = anim_state_and_input_bitflags >> 16;
+		avatar->transform_dirty = true;
+
+		//conPrint("updated avatar transform");
+
+		avatar->pos_snapshots      [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = pos;
+		avatar->rotation_snapshots [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = rotation;
+		avatar->snapshot_times     [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = Clock::getTimeSinceInit();
+		//avatar->last_snapshot_time = Clock::getCurTimeRealSec();
+		avatar->next_snapshot_i++;
+	}
+}
+
+
+void ClientThread::handleObjectTransformUpdate(const UID& object_uid, const Vec3d& pos, const Vec3f& axis, float angle, const Vec3f& scale, uint32 transform_update_avatar_uid)
+{
+	if(transform_update_avatar_uid != (uint32)this->client_avatar_uid.value()) // Discard ObjectTransformUpdate messages we sent. 
+	{
+		// Look up existing object in world state
+		Lock lock(world_state->mutex);
+		auto res = world_state->objects.find(object_uid);
+		if(res != world_state->objects.end())
+		{
+			
+			WorldObject* ob = res.getValue().ptr();
+#if GUI_CLIENT
+			if(!ob->is_selected) // Don't update the selected object - we will consider the local client control authoritative while the object is selected.
+#endif
+			{
+				//conPrint("ObjectTransformUpdate: setting ob pos to " + pos.toString());
+#if GUI_CLIENT
+				//ob->last_pos = ob->pos;
+#endif
+				ob->pos = pos;
+				ob->axis = axis;
+				ob->angle = angle;
+				ob->scale = scale;
+
+				// If we had physics snapshots, reset snapshots.
+				if(ob->snapshots_are_physics_snapshots)
+				{
+					// conPrint("Resetting snapshots.");
+					ob->next_insertable_snapshot_i = 0;
+					ob->next_snapshot_i = 0;
+				}
+				ob->snapshots_are_physics_snapshots = false;
+
+				
+				ob->snapshots[ob->next_snapshot_i % (uint32)WorldObject::HISTORY_BUF_SIZE] = 
+					WorldObject::Snapshot({pos.toVec4fPoint(), Quatf::fromAxisAndAngle(normalise(axis), angle), /*linear vel=*/Vec4f(0.f), /*angular_vel=*/Vec4f(0.f), /*client time=*/0.0, /*local time=*/Clock::getTimeSinceInit()});
+
+				ob->next_snapshot_i++;
+
+				ob->from_remote_transform_dirty = true;
+				world_state->dirty_from_remote_objects.insert(ob);
+
+				//conPrint("updated object transform");
+			}
+		}
+	}
+	else
+	{
+		// conPrint("\tDiscarding ObjectTransformUpdate message, as we sent it.");
+	}
+}
+
+
+void ClientThread::handleObjectPhysicsTransformUpdate(const UID& object_uid, const Vec3d& pos, const Quatf& rot, const Vec4f& linear_vel, const Vec4f& angular_vel, uint32 transform_update_avatar_uid, double transform_client_time)
+{
+	if(transform_update_avatar_uid != (uint32)this->client_avatar_uid.value()) // Discard ObjectPhysicsTransformUpdate messages we sent.
+	{
+		// Look up existing object in world state
+		Lock lock(world_state->mutex);
+		auto res = world_state->objects.find(object_uid);
+		if(res != world_state->objects.end())
+		{
+			WorldObject* ob = res.getValue().ptr();
+
+			if(ob->physics_owner_id == transform_update_avatar_uid) // Only process messages that are from the physics owner of this object, discard others.
+			{
+				// If we had non-physics snapshots, reset snapshots.
+				if(!ob->snapshots_are_physics_snapshots)
+				{
+					// conPrint("Resetting snapshots.");
+					ob->next_insertable_snapshot_i = 0;
+					ob->next_snapshot_i = 0;
+				}
+				ob->snapshots_are_physics_snapshots = true;
+
+				// The quaternion sign may differ from the previous snapshot (q and -q are the same rotation, and TransformUpdateBatch messages don't preserve the sign),
+				// so make the sign consistent with the previous snapshot, for interpolation.
+				Quatf use_rot = rot;
+				if(ob->next_snapshot_i > 0)
+				{
+					const Quatf& prev_rot = ob->snapshots[(ob->next_snapshot_i - 1) % (uint32)WorldObject::HISTORY_BUF_SIZE].rotation;
+					if(dot(prev_rot.v, use_rot.v) < 0)
+						use_rot = Quatf(use_rot.v * -1.f);
+				}
+
+				const double local_time = Clock::getTimeSinceInit();
+
+				ob->snapshots[ob->next_snapshot_i % (uint32)WorldObject::HISTORY_BUF_SIZE] = WorldObject::Snapshot({pos.toVec4fPoint(), use_rot, linear_vel, angular_vel, transform_client_time, local_time});
+
+				ob->next_snapshot_i++;
+
+				// conPrint("ClientThread: Added snapshot " + toString(ob->next_snapshot_i));
+
+				//NEW: Compute transmission_time_offset: An estimate of local_clock_time - sending_clock_time.
+				// TODO: Handle a different client taking over sending messages.
+				/*if(ob->transmission_time_offset == std::numeric_limits<double>::infinity())
+				{
+					ob->transmission_time_offset = Clock::getTimeSinceInit() - last_transform_client_time;
+
+					conPrint("Storing new ob->transmission_time_offset: " + doubleToString(ob->transmission_time_offset));
+				}*/
+
+				ob->from_remote_physics_transform_dirty = true;
+				world_state->dirty_from_remote_objects.insert(ob);
+			}
+			else
+			{
+				// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as not from physics owner of object.");
+			}
+		}
+	}
+	else
+	{
+		// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as we sent it.");
+	}
+}
+
+
 void ClientThread::enqueueDataToSend(const ArrayRef<uint8> data)
 {
 #if defined(EMSCRIPTEN)
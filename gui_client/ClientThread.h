@@ -7,7 +7,10 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "../shared/WorldSettings.h"
+#include "../shared/TransformCompression.h"
+#include "../shared/StreamCompression.h"
 #include "WorldState.h"
+#include "ObjectSyncCache.h"
 #include <MessageableThread.h>
 #include <Platform.h>
 #include <MyThread.h>
@@ -216,6 +219,15 @@ public:
 };
 
 
+// Sent by ClientThread when IncrementalObjectSyncDone is received from the server.
+class IncrementalObjectSyncDoneMessage : public ThreadMessage
+{
+public:
+	IncrementalObjectSyncDoneMessage(const TimeStamp& valid_time_) : valid_time(valid_time_) {}
+	TimeStamp valid_time; // Server time at which the client's copies of objects were up to date.  For the next ObjectSyncDigest.
+};
+
+
 class MapTilesResultReceivedMessage : public ThreadMessage
 {
 public:
@@ -247,11 +259,20 @@ public:
 
 	bool all_objects_received;
 	Reference<WorldState> world_state;
+	ObjectSyncCacheRef object_sync_cache; // Objects kept from the previous connection to the world, if any.  Inserted into the world state when IncrementalObjectSyncDone is received.  Should be set before the thread is started.
 private:
 	UID client_avatar_uid;
 
 	WorldObjectRef allocWorldObject();
 
+	// Reads an object in the format of an ObjectInitialSend message, and inserts it into the world state, if there isn't already an object with the same UID.
+	void readAndInsertInitialSendObject(BufferInStream& stream);
+
+	// Apply transform updates received in AvatarTransformUpdate, ObjectTransformUpdate, ObjectPhysicsTransformUpdate or TransformUpdateBatch messages.
+	void handleAvatarTransformUpdate(const UID& avatar_uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state_and_input_bitflags);
+	void handleObjectTransformUpdate(const UID& object_uid, const Vec3d& pos, const Vec3f& axis, float angle, const Vec3f& scale, uint32 transform_update_avatar_uid);
+	void handleObjectPhysicsTransformUpdate(const UID& object_uid, const Vec3d& pos, const Quatf& rot, const Vec4f& linear_vel, const Vec4f& angular_vel, uint32 transform_update_avatar_uid, double transform_client_time);
+
 	glare::AtomicInt should_die;
 	ThreadSafeQueue<Reference<ThreadMessage> >* out_msg_queue;
 	EventFD event_fd;
@@ -270,6 +291,11 @@ private:
 
 	BufferInStream msg_buffer;
 
+	Reference<StreamCompression::Decompressor> stream_decompressor; // Non-null once the server has enabled stream compression.
+
+	TransformCompression::TransformDeltaCodec transform_codec; // Decodes TransformUpdateBatch messages.
+	std::vector<TransformCompression::EntityTransform> temp_transforms;
+
 	Reference<glare::PoolAllocator> world_ob_pool_allocator;
 
 	ThreadManager client_sender_thread_manager;
@@ -20,7 +20,8 @@ Copyright Glare Technologies Limited 2023 -
 #include <MySocket.h>
 #include <PlatformUtils.h>
 #include <Networking.h>
-#include <opus.h>
+#include <Clock.h>
+#include <Lock.h>
 
 
 ClientUDPHandlerThread::ClientUDPHandlerThread(Reference<UDPSocket> udp_socket_, const std::string& server_hostname_, WorldState* world_state_, glare::AudioEngine* audio_engine_)
@@ -41,13 +42,19 @@ ClientUDPHandlerThread::~ClientUDPHandlerThread()
 struct AvatarVoiceStreamInfo
 {
 	Reference<glare::AudioSource> avatar_audio_source;
-	OpusDecoder* opus_decoder;
-	uint32 sampling_rate;
+	glare::VoiceStreamDecoderRef voice_stream;
 	uint32 stream_id;
-	uint32 next_seq_num_expected;
 };
 
 
+// Stop the audio source pulling audio from the voice stream.
+// This thread is the only one that sets the voice stream of avatar audio sources, so the source can't have been given a different stream.
+static void detachVoiceStream(glare::AudioEngine* audio_engine, AvatarVoiceStreamInfo& stream_info)
+{
+	audio_engine->setSourceVoiceStream(stream_info.avatar_audio_source, NULL);
+}
+
+
 void ClientUDPHandlerThread::doRun()
 {
 	PlatformUtils::setCurrentThreadNameIfTestsEnabled("ClientUDPHandlerThread");
@@ -61,7 +68,6 @@ void ClientUDPHandlerThread::doRun()
 		const IPAddress server_ip_addr = server_ips[0];
 
 		std::vector<uint8> packet_buf(4096);
-		std::vector<float> pcm_buffer(480);
 
 		while(die == 0)
 		{
@@ -81,7 +87,7 @@ void ClientUDPHandlerThread::doRun()
 					Avatar* av = it->second.ptr();
 
 					// If there is an avatar not in our avatar_stream_info map, that has an audio source, add it to our map.
-					// If we are already have stream info, but stream IDs differ: this indicates a new stream has been created.  We need to reset the expected next sequence number.  We will also recreate the Opus decoder in this case.
+					// If we are already have stream info, but stream IDs differ: this indicates a new stream has been created.  We will recreate the jitter buffer and Opus decoder in this case.
 					bool create_stream_info = false; // Should we (re)create stream info for this avatar?
 					if(av->audio_source.nonNull())
 					{
@@ -93,11 +99,8 @@ void ClientUDPHandlerThread::doRun()
 							AvatarVoiceStreamInfo& stream_info = info_res->second;
 							if(stream_info.stream_id != av->audio_stream_id) // But the stream ID is different:
 							{
-								if(stream_info.opus_decoder)
-								{
-									conPrint("Stream ID changed, destroying existing Opus decoder.");
-									opus_decoder_destroy(stream_info.opus_decoder);
-								}
+								conPrint("Stream ID changed, destroying existing voice stream decoder.");
+								detachVoiceStream(audio_engine, stream_info);
 								create_stream_info = true;
 							}
 						}
@@ -107,18 +110,12 @@ void ClientUDPHandlerThread::doRun()
 					{
 						const uint32 sampling_rate = av->audio_stream_sampling_rate;
 
-						conPrint("Creating Opus decoder for avatar, sampling_rate: " + toString(sampling_rate));
+						conPrint("Creating voice stream decoder for avatar, sampling_rate: " + toString(sampling_rate));
 
-						int opus_error = 0;
-						OpusDecoder* opus_decoder = opus_decoder_create(
-							sampling_rate, // sampling rate
-							1, // channels
-							&opus_error
-						);
-						if(opus_error != OPUS_OK)
-							throw glare::Exception("opus_decoder_create failed.");
+						glare::VoiceStreamDecoderRef voice_stream = new glare::VoiceStreamDecoder(sampling_rate);
+						audio_engine->setSourceVoiceStream(av->audio_source, voice_stream);
 
-						avatar_stream_info[(uint32)av->uid.value()] = AvatarVoiceStreamInfo({av->audio_source, opus_decoder, sampling_rate, /*stream_id=*/av->audio_stream_id, /*next_seq_num_expected=*/0});
+						avatar_stream_info[(uint32)av->uid.value()] = AvatarVoiceStreamInfo({av->audio_source, voice_stream, /*stream_id=*/av->audio_stream_id});
 					}
 				}
 
@@ -139,8 +136,8 @@ void ClientUDPHandlerThread::doRun()
 
 					if(remove)
 					{
-						conPrint("Destroying Opus decoder for avatar");
-						opus_decoder_destroy(it->second.opus_decoder);
+						conPrint("Destroying voice stream decoder for avatar");
+						detachVoiceStream(audio_engine, it->second);
 						it = avatar_stream_info.erase(it); // Remove from our stream info map
 					}
 					else
@@ -175,80 +172,9 @@ void ClientUDPHandlerThread::doRun()
 
 								//conPrint("Received voice packet for avatar (UID: " + toString(avatar_id) + ", seq num: " + toString(rcvd_seq_num) + ")");
 
-								if(rcvd_seq_num < stream_info->next_seq_num_expected)
-								{
-									// Discard packet
-									conPrint("Discarding packet.");
-								}
-								else // else seq_num >= next_seq_num_expected
-								{
-									/*
-									while(next_seq_num_expected < rcvd_seq_num)
-									{
-										conPrint("Packet was missed, doing loss concealment...");
-										// We received a packet with a sequence number (rcvd_seq_num) greater than the one we were expecting (next_seq_num_expected).  Treat the packets with sequence number < rcvd_seq_num as lost.
-										// Tell Opus we had a missing packet.
-										// "Lost packets can be replaced with loss concealment by calling the decoder with a null pointer and zero length for the missing packet."  https://opus-codec.org/docs/opus_api-1.3.1/group__opus__decoder.html
-
-										// "For the PLC and FEC cases, frame_size must be a multiple of 2.5 ms."
-										// at 48000 hz, 1 sample = 1 / 48000 s^-1 = 2.08333 e-5 s
-										// samples per 2.5 ms = 0.0025 s / 2.08333 e-5 s = 120
-										const int num_samples_decoded = opus_decode_float(stream_info->opus_decoder, NULL, 0, pcm_buffer.data(), 480,//(int)pcm_buffer.size(), 
-											0 // decode_fec
-										);
-										if(num_samples_decoded < 0)
-										{
-											conPrint("Opus decoding failed: " + toString(num_samples_decoded));
-										}
-										next_seq_num_expected++;
-									}
-									assert(rcvd_seq_num == next_seq_num_expected);
-									*/
-
-									// Decode opus packet into pcm_buffer
-									const size_t packet_header_size_B = 12;
-									const size_t opus_packet_len = packet_len - packet_header_size_B;
-									const int num_samples_decoded = opus_decode_float(stream_info->opus_decoder, packet_buf.data() + packet_header_size_B, (int32)opus_packet_len, pcm_buffer.data(), (int)pcm_buffer.size(), 
-										0 // decode_fec
-									);
-									if(num_samples_decoded < 0)
-										conPrint("Opus decoding failed: " + toString(num_samples_decoded));
-									else
-									{
-										// We are using 10ms frames, so expect sampling_rate * 0.01 samples.
-										if(num_samples_decoded != (int)stream_info->sampling_rate / 100)
-											conPrint("Unexpected number of samples");
-										else
-										{
-											// Get max abs value in decoded buffer
-											float max_val = 0;
-											for(int i=0; i<num_samples_decoded; ++i)
-												max_val = myMax(max_val, std::fabs(pcm_buffer[i]));
-											//printVar(max_val);
-
-											// Append to audio source buffer
-											Lock lock(audio_engine->mutex);
-
-											// If too much data is queued up for this audio source:
-											if(stream_info->avatar_audio_source->buffer.size() > 4096) // 4096 samples ~= 85 ms at 48 khz
-											{
-												// Pop all but 2048 items from the buffer.
-												const size_t num_samples_to_remove = stream_info->avatar_audio_source->buffer.size() - 2048;
-												conPrint("Audio source buffer too full, removing " + toString(num_samples_to_remove) + " samples");
-
-												stream_info->avatar_audio_source->buffer.popFrontNItems(num_samples_to_remove);
-											}
-
-											stream_info->avatar_audio_source->buffer.pushBackNItems(pcm_buffer.data(), num_samples_decoded);
-
-											stream_info->avatar_audio_source->smoothed_cur_level = myMax(stream_info->avatar_audio_source->smoothed_cur_level * 0.95f, max_val);
-										}
-
-										// conPrint("ClientUDPHandlerThread: decoded " + toString(num_samples_decoded) + " samples.");
-
-										stream_info->next_seq_num_expected++;
-									}
-								}
+								// Insert the opus packet into the jitter buffer.  It will be decoded when the audio engine needs more data for the avatar audio source.
+								const size_t packet_header_size_B = 12;
+								stream_info->voice_stream->insertPacket(rcvd_seq_num, Clock::getTimeSinceInit(), packet_buf.data() + packet_header_size_B, packet_len - packet_header_size_B);
 							}
 							else
 							{
@@ -279,9 +205,9 @@ void ClientUDPHandlerThread::doRun()
 		conPrint("ClientUDPHandlerThread: Caught std::bad_alloc.");
 	}
 
-	// Destroy Opus decoders
+	// Detach voice streams from the audio sources, so the Opus decoders are destroyed.
 	for(auto it = avatar_stream_info.begin(); it != avatar_stream_info.end(); ++it)
-		opus_decoder_destroy(it->second.opus_decoder);
+		detachVoiceStream(audio_engine, it->second);
 
 	udp_socket = NULL;
 }
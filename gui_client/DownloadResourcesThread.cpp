@@ -20,6 +20,11 @@ Copyright Glare Technologies Limited 2021 -
 #include <KillThreadMessage.h>
 #include <PlatformUtils.h>
 #include <FileOutStream.h>
+#include <zstd.h>
+#include <Timer.h>
+#include <SocketBufferOutStream.h>
+#include <RefCounted.h>
+#include <cmath>
 #if defined(EMSCRIPTEN)
 #include <emscripten/emscripten.h>
 #endif
@@ -115,6 +120,460 @@ void DownloadResourcesThread::killConnection()
 }
 
 
+// Decompresses a zstd-compressed file (a resource variant, see server/CompressedResourceVariants.h) received in pieces, and writes the decompressed data to a file.
+class ZstdFileDecompressor : public RefCounted
+{
+public:
+	ZstdFileDecompressor(uint64 decompressed_len_)
+	:	decompressed_len(decompressed_len_),
+		decompressed_offset(0),
+		last_result(1)
+	{
+		context = ZSTD_createDCtx();
+		if(!context)
+			throw glare::Exception("ZSTD_createDCtx failed.");
+
+		ZSTD_DCtx_setParameter(context, ZSTD_d_windowLogMax, 23); // Matches the max window size the server uses.
+
+		decompressed_buf.resize(ZSTD_DStreamOutSize());
+	}
+
+	~ZstdFileDecompressor()
+	{
+		ZSTD_freeDCtx(context);
+	}
+
+	// Throws glare::Exception on failure.
+	void decompress(const uint8* data, size_t len, FileOutStream& file)
+	{
+		ZSTD_inBuffer in_buffer = { data, len, 0 };
+		while(in_buffer.pos < in_buffer.size)
+		{
+			ZSTD_outBuffer out_buffer = { decompressed_buf.data(), decompressed_buf.size(), 0 };
+			last_result = ZSTD_decompressStream(context, &out_buffer, &in_buffer);
+			if(ZSTD_isError(last_result))
+				throw glare::Exception("Decompression of downloaded file failed: " + std::string(ZSTD_getErrorName(last_result)));
+
+			writeOutput(out_buffer.pos, file);
+		}
+	}
+
+	// Writes any output still buffered in the decompression context, and checks the decompressed size.  Throws glare::Exception on failure.
+	void finish(FileOutStream& file)
+	{
+		while(last_result != 0)
+		{
+			ZSTD_inBuffer in_buffer = { NULL, 0, 0 };
+			ZSTD_outBuffer out_buffer = { decompressed_buf.data(), decompressed_buf.size(), 0 };
+			last_result = ZSTD_decompressStream(context, &out_buffer, &in_buffer);
+			if(ZSTD_isError(last_result) || (out_buffer.pos == 0 && last_result != 0))
+				throw glare::Exception("Downloaded compressed file was truncated.");
+
+			writeOutput(out_buffer.pos, file);
+		}
+
+		if(decompressed_offset != decompressed_len)
+			throw glare::Exception("Downloaded file decompressed to " + toString(decompressed_offset) + " B, expected " + toString(decompressed_len) + " B.");
+	}
+
+private:
+	GLARE_DISABLE_COPY(ZstdFileDecompressor)
+
+	void writeOutput(size_t len, FileOutStream& file)
+	{
+		decompressed_offset += len;
+		if(decompressed_offset > decompressed_len)
+			throw glare::Exception("Downloaded file decompressed to more than the expected size.");
+
+		file.writeData(decompressed_buf.data(), len);
+	}
+
+	ZSTD_DCtx* context;
+	js::Vector<uint8, 16> decompressed_buf;
+	uint64 decompressed_len;
+	uint64 decompressed_offset;
+	size_t last_result; // Return value of the last ZSTD_decompressStream call.  0 when the frame is complete.
+};
+
+
+// Reads a zstd-compressed file (sent in response to GetFilesCompressed) from the socket, and writes the decompressed data to file.
+void DownloadResourcesThread::readCompressedFile(SocketInterface& socket_, uint64 compressed_len, uint64 decompressed_len, FileOutStream& file)
+{
+	ZstdFileDecompressor decompressor(decompressed_len);
+
+	const size_t MAX_CHUNK_SIZE = 1 << 14;
+	js::Vector<uint8, 16> compressed_buf(MAX_CHUNK_SIZE);
+
+	uint64 compressed_offset = 0;
+	std::string error_msg; // Set on a decompression or file write error.  We keep reading the compressed data after an error, so the next file can be read from the socket.
+	while(compressed_offset < compressed_len)
+	{
+		const size_t chunk_size = (size_t)myMin<uint64>(compressed_len - compressed_offset, MAX_CHUNK_SIZE);
+		socket_.readData(compressed_buf.data(), chunk_size);
+		compressed_offset += chunk_size;
+
+		if(error_msg.empty())
+		{
+			try
+			{
+				decompressor.decompress(compressed_buf.data(), chunk_size, file);
+			}
+			catch(glare::Exception& e)
+			{
+				error_msg = e.what();
+			}
+		}
+
+		if(should_die)
+			throw glare::Exception("Interrupted");
+	}
+
+	if(!error_msg.empty())
+		throw glare::Exception(error_msg);
+
+	decompressor.finish(file);
+}
+
+
+// A resource being downloaded with the framed download protocol.  See WorkerThread::handleFramedResourceDownloads() on the server for a description of the protocol.
+// The data is written to a '.part' file next to the resource, which is renamed when the download completes.  If the connection is lost, the partial file is kept,
+// and the download is resumed from the end of it next time.  (Resource URLs include a hash of the content, so the resource can't have changed in the meantime.)
+class FramedDownload : public RefCounted
+{
+public:
+	FramedDownload() : file(NULL), received_header(false), transfer_len(0), bytes_received(0) {}
+	~FramedDownload() { delete file; }
+
+	void closeFile() { delete file; file = NULL; }
+
+	DownloadQueueItem item;
+	ResourceRef resource;
+	std::string part_path; // Path of the partially downloaded file.
+	FileOutStream* file;
+	uint64 start_offset; // Offset in the file that was requested from the server.  The size of the partial file when the download started.
+	float sent_priority; // Priority last sent to the server.
+
+	bool received_header;
+	uint64 file_size; // Size of the uncompressed file.
+	uint64 transfer_len; // Number of bytes the server will send.
+	uint64 bytes_received;
+	Reference<ZstdFileDecompressor> decompressor; // Non-null if the server is sending the zstd-compressed variant of the resource.
+	std::string error_msg; // Set on a decompression or file write error.  We keep reading chunks for the download after an error, but don't write them.
+};
+
+
+static const size_t MAX_FRAMED_DOWNLOADS = 8; // Max number of resources each DownloadResourcesThread requests at once with the framed download protocol.
+static const uint32 MAX_FRAMED_CHUNK_LEN = 1 << 20;
+
+
+static void deleteFileIfExists(const std::string& path)
+{
+	try
+	{
+		if(FileUtils::fileExists(path))
+			FileUtils::deleteFile(path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("DownloadResourcesThread: Failed to delete '" + path + "': " + e.what());
+	}
+}
+
+
+// Called when all the data for a download has been received.
+void DownloadResourcesThread::finishFramedDownload(FramedDownload& download)
+{
+	try
+	{
+		if(!download.error_msg.empty())
+			throw glare::Exception(download.error_msg);
+
+		if(download.decompressor.nonNull())
+			download.decompressor->finish(*download.file);
+
+		download.file->close(); // Manually call close, to check for any errors via failbit.
+		download.closeFile();
+
+		try
+		{
+			FileUtils::moveFile(download.part_path, resource_manager->getLocalAbsPathForResource(*download.resource));
+		}
+		catch(FileUtils::FileUtilsExcep& e)
+		{
+			throw glare::Exception(e.what());
+		}
+
+		download.resource->setState(Resource::State_Present);
+		resource_manager->markAsChanged();
+
+		out_msg_queue->enqueue(new ResourceDownloadedMessage(download.item.URL));
+	}
+	catch(glare::Exception& e)
+	{
+		download.closeFile();
+		deleteFileIfExists(download.part_path); // The partial file may be corrupt, so don't try to resume from it.
+
+		download.resource->setState(Resource::State_NotPresent);
+		resource_manager->markAsChanged();
+
+		out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while writing file to disk: " + e.what()));
+	}
+
+	(*this->num_resources_downloading)--;
+}
+
+
+// Called when the connection is closed with downloads in progress.  Partial files are kept, so the downloads can be resumed.
+void DownloadResourcesThread::abortFramedDownloads(std::map<uint32, Reference<FramedDownload> >& downloads)
+{
+	for(auto it = downloads.begin(); it != downloads.end(); ++it)
+	{
+		FramedDownload& download = *it->second;
+		download.closeFile();
+		if(!download.error_msg.empty())
+			deleteFileIfExists(download.part_path);
+
+		download.resource->setState(Resource::State_NotPresent);
+		(*this->num_resources_downloading)--;
+	}
+	downloads.clear();
+	resource_manager->markAsChanged();
+}
+
+
+// Reads a ResourceDownloadHeader or ResourceDownloadChunk message from the server.
+void DownloadResourcesThread::readFramedDownloadMessage(std::map<uint32, Reference<FramedDownload> >& downloads)
+{
+	const uint32 msg_type = socket->readUInt32();
+	const uint32 request_id = socket->readUInt32();
+
+	auto res = downloads.find(request_id);
+	if(res == downloads.end())
+		throw glare::Exception("Invalid request id from server: " + toString(request_id));
+	FramedDownload& download = *res->second;
+
+	if(msg_type == Protocol::ResourceDownloadHeader)
+	{
+		if(download.received_header)
+			throw glare::Exception("Received duplicate header from server.");
+
+		const uint32 result = socket->readUInt32();
+		if(result == 0 || result == 2) // If OK (2 = OK, zstd-compressed):
+		{
+			download.file_size = socket->readUInt64();
+			const uint64 start_offset = socket->readUInt64();
+			download.transfer_len = socket->readUInt64();
+			download.received_header = true;
+
+			if(download.file_size > 1000000000)
+				throw glare::Exception("downloaded file too large (len=" + toString(download.file_size) + ").");
+			if(start_offset != download.start_offset)
+				throw glare::Exception("Server sent invalid start offset.");
+			if(result == 0 && download.transfer_len != download.file_size - start_offset)
+				throw glare::Exception("Server sent invalid transfer length.");
+			if(result == 2 && (download.transfer_len > download.file_size || start_offset != 0))
+				throw glare::Exception("Server sent invalid compressed transfer length.");
+
+			if(result == 2)
+			{
+				try
+				{
+					download.decompressor = new ZstdFileDecompressor(download.file_size);
+				}
+				catch(glare::Exception& e)
+				{
+					download.error_msg = e.what();
+				}
+			}
+
+			if(download.transfer_len == 0)
+			{
+				finishFramedDownload(download);
+				downloads.erase(res);
+			}
+		}
+		else
+		{
+			download.closeFile();
+			deleteFileIfExists(download.part_path);
+
+			resource_manager->addToDownloadFailedURLs(download.item.URL);
+
+			download.resource->setState(Resource::State_NotPresent);
+			out_msg_queue->enqueue(new LogMessage("Server couldn't send resource '" + download.item.URL + "' (resource not found)"));
+
+			(*this->num_resources_downloading)--;
+			downloads.erase(res);
+		}
+	}
+	else if(msg_type == Protocol::ResourceDownloadChunk)
+	{
+		const uint32 chunk_len = socket->readUInt32();
+		if(!download.received_header || chunk_len > MAX_FRAMED_CHUNK_LEN || chunk_len > download.transfer_len - download.bytes_received)
+			throw glare::Exception("Invalid chunk from server.");
+
+		chunk_buf.resize(chunk_len);
+		socket->readData(chunk_buf.data(), chunk_len);
+		download.bytes_received += chunk_len;
+
+		if(download.error_msg.empty())
+		{
+			try
+			{
+				if(download.decompressor.nonNull())
+					download.decompressor->decompress(chunk_buf.data(), chunk_len, *download.file);
+				else
+					download.file->writeData(chunk_buf.data(), chunk_len);
+			}
+			catch(glare::Exception& e)
+			{
+				download.error_msg = e.what();
+			}
+		}
+
+		if(download.bytes_received == download.transfer_len)
+		{
+			finishFramedDownload(download);
+			downloads.erase(res);
+		}
+	}
+	else
+		throw glare::Exception("Unexpected message type from server: " + toString(msg_type));
+}
+
+
+// Downloads resources with the framed download protocol, until the thread is killed.  Requests up to MAX_FRAMED_DOWNLOADS resources at once, which the
+// server interleaves, and sends the server updated priorities for them as the camera moves.
+void DownloadResourcesThread::doFramedDownloads()
+{
+	std::map<uint32, Reference<FramedDownload> > downloads; // Map from request id to download
+	uint32 next_request_id = 1;
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	Timer priority_update_timer;
+
+	try
+	{
+		while(1)
+		{
+			if(should_die || checkMessageQueue(getMessageQueue()))
+			{
+				abortFramedDownloads(downloads);
+				socket->writeInt32(Protocol::CyberspaceGoodbye);
+				socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the server.
+				return;
+			}
+
+			// Request more resources if we aren't downloading too many already.  If we aren't downloading anything, wait a while for something to download.
+			if(downloads.size() < MAX_FRAMED_DOWNLOADS)
+			{
+				download_queue->dequeueItemsWithTimeOut(/*wait_time_s=*/downloads.empty() ? 0.1 : 0.0, /*max_num_items=*/MAX_FRAMED_DOWNLOADS - downloads.size(), queue_items);
+
+				const Vec4f campos = download_queue->getCamPos();
+				packet.buf.resize(0);
+				uint32 num_requests = 0;
+				for(size_t i=0; i<queue_items.size(); ++i)
+				{
+					const DownloadQueueItem& item = queue_items[i];
+					if(resource_manager->isInDownloadFailedURLs(item.URL)) // Don't try to re-download if we already failed to download this session.
+						continue;
+
+					ResourceRef resource = resource_manager->getOrCreateResourceForURL(item.URL);
+					if(resource->getState() != Resource::State_NotPresent) // If we already have the file, or are downloading it:
+						continue;
+
+					Reference<FramedDownload> download = new FramedDownload();
+					download->item = item;
+					download->resource = resource;
+					download->part_path = resource_manager->getLocalAbsPathForResource(*resource) + ".part";
+					download->sent_priority = item.priority(campos);
+
+					// If there is a partial file from a previous download, resume from the end of it.
+					download->start_offset = 0;
+					try
+					{
+						if(FileUtils::fileExists(download->part_path))
+							download->start_offset = FileUtils::getFileSize(download->part_path);
+					}
+					catch(FileUtils::FileUtilsExcep&)
+					{}
+
+					try
+					{
+						download->file = new FileOutStream(download->part_path, std::ios::binary | ((download->start_offset > 0) ? std::ios::app : std::ios::trunc));
+					}
+					catch(glare::Exception& e)
+					{
+						out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while opening file: " + e.what()));
+						continue;
+					}
+
+					resource->setState(Resource::State_Transferring);
+					(*this->num_resources_downloading)++;
+
+					const uint32 request_id = next_request_id++;
+					downloads[request_id] = download;
+
+					packet.writeUInt32(request_id);
+					packet.writeStringLengthFirst(item.URL);
+					packet.writeUInt64(download->start_offset);
+					packet.writeFloat(download->sent_priority);
+					packet.writeUInt32(Protocol::RequestResourceFlag_AcceptZstd);
+					num_requests++;
+				}
+
+				if(num_requests > 0)
+				{
+					socket->writeUInt32(Protocol::RequestResources);
+					socket->writeUInt32(num_requests);
+					socket->writeData(packet.buf.data(), packet.buf.size());
+					socket->flush();
+				}
+			}
+
+			if(!downloads.empty())
+			{
+				// Send updated priorities to the server every now and then, as the camera moves.
+				if(priority_update_timer.elapsed() > 0.5)
+				{
+					const Vec4f campos = download_queue->getCamPos();
+					packet.buf.resize(0);
+					uint32 num_updates = 0;
+					for(auto it = downloads.begin(); it != downloads.end(); ++it)
+					{
+						FramedDownload& download = *it->second;
+						const float priority = download.item.priority(campos);
+						if(std::fabs(priority - download.sent_priority) > 0.1f * download.sent_priority + 0.01f) // Only send significant changes.
+						{
+							packet.writeUInt32(it->first);
+							packet.writeFloat(priority);
+							download.sent_priority = priority;
+							num_updates++;
+						}
+					}
+
+					if(num_updates > 0)
+					{
+						socket->writeUInt32(Protocol::UpdateResourcePriorities);
+						socket->writeUInt32(num_updates);
+						socket->writeData(packet.buf.data(), packet.buf.size());
+						socket->flush();
+					}
+					priority_update_timer.reset();
+				}
+
+				if(socket->readable(/*timeout (s)=*/0.05)) // Use a timeout so we can check should_die and the download queue occasionally.
+					readFramedDownloadMessage(downloads);
+			}
+		}
+	}
+	catch(...) // glare::Exception or MySocketExcep
+	{
+		abortFramedDownloads(downloads);
+		throw;
+	}
+}
+
+
 #if EMSCRIPTEN
 
 static void onLoad(unsigned int firstarg, void* userdata_arg, const char* filename)
@@ -289,7 +748,17 @@ void DownloadResourcesThread::doRun()
 			throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
 
 		// Read server protocol version
-		/*const uint32 server_protocol_version =*/ socket->readUInt32();
+		const uint32 server_protocol_version = socket->readUInt32();
+
+		// Servers with protocol version >= 44 support the framed download protocol.
+		if(server_protocol_version >= 44)
+		{
+			doFramedDownloads();
+			return;
+		}
+
+		// Servers with protocol version >= 43 can send zstd-compressed files in response to GetFilesCompressed.
+		const bool use_compressed_files = server_protocol_version >= 43;
 
 		std::set<std::string> URLs_to_get; // Set of URLs that this thread will get from the server.
 
@@ -347,7 +816,7 @@ void DownloadResourcesThread::doRun()
 
 				if(!URLs_to_get.empty())
 				{
-					socket->writeUInt32(Protocol::GetFiles);
+					socket->writeUInt32(use_compressed_files ? Protocol::GetFilesCompressed : Protocol::GetFiles);
 					socket->writeUInt64(URLs_to_get.size()); // Write number of files to get
 
 					for(auto it = URLs_to_get.begin(); it != URLs_to_get.end(); ++it)
@@ -366,10 +835,11 @@ void DownloadResourcesThread::doRun()
 
 						
 						const uint32 result = socket->readUInt32();
-						if(result == 0) // If OK:
+						if(result == 0 || result == 2) // If OK (2 = OK, zstd-compressed):
 						{
 							// Download resource
 							const uint64 file_len = socket->readUInt64();
+							const uint64 compressed_len = (result == 2) ? socket->readUInt64() : 0;
 							if(file_len > 0)
 							{
 								if(file_len > 1000000000)
@@ -383,19 +853,26 @@ void DownloadResourcesThread::doRun()
 									{
 										FileOutStream file(path, std::ios::binary | std::ios::trunc); // Remove any existing data in the file
 
-										uint64 offset = 0;
-										const uint64 MAX_CHUNK_SIZE = 1ull << 14;
-										js::Vector<uint8, 16> temp_buf(MAX_CHUNK_SIZE);
-										while(offset < file_len)
+										if(result == 2)
+										{
+											readCompressedFile(*socket, compressed_len, file_len, file);
+										}
+										else
 										{
-											const uint64 chunk_size = myMin(file_len - offset, MAX_CHUNK_SIZE);
-											assert(offset + chunk_size <= file_len);
-											socket->readData(temp_buf.data(), chunk_size);
-											file.writeData(temp_buf.data(), chunk_size);
-											offset += chunk_size;
-
-											if(should_die)
-												throw glare::Exception("Interrupted");
+											uint64 offset = 0;
+											const uint64 MAX_CHUNK_SIZE = 1ull << 14;
+											js::Vector<uint8, 16> temp_buf(MAX_CHUNK_SIZE);
+											while(offset < file_len)
+											{
+												const uint64 chunk_size = myMin(file_len - offset, MAX_CHUNK_SIZE);
+												assert(offset + chunk_size <= file_len);
+												socket->readData(temp_buf.data(), chunk_size);
+												file.writeData(temp_buf.data(), chunk_size);
+												offset += chunk_size;
+
+												if(should_die)
+													throw glare::Exception("Interrupted");
+											}
 										}
 
 										file.close(); // Manually call close, to check for any errors via failbit.
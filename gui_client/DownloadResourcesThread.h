@@ -17,6 +17,7 @@ Copyright Glare Technologies Limited 2021 -
 #include <utils/ThreadManager.h>
 #include <utils/ThreadSafeQueue.h>
 #include <set>
+#include <map>
 #include <string>
 class WorkUnit;
 class PrintOutput;
@@ -25,6 +26,8 @@ class Server;
 namespace glare { class AtomicInt; }
 struct tls_config;
 class DownloadingResourceQueue;
+class FileOutStream;
+class FramedDownload;
 
 
 class ResourceDownloadedMessage : public ThreadMessage
@@ -56,6 +59,13 @@ public:
 	void killConnection();
 
 private:
+	void readCompressedFile(SocketInterface& socket, uint64 compressed_len, uint64 decompressed_len, FileOutStream& file);
+
+	void doFramedDownloads();
+	void readFramedDownloadMessage(std::map<uint32, Reference<FramedDownload> >& downloads);
+	void finishFramedDownload(FramedDownload& download);
+	void abortFramedDownloads(std::map<uint32, Reference<FramedDownload> >& downloads);
+
 	ThreadSafeQueue<Reference<ThreadMessage> >* out_msg_queue;
 	Reference<ResourceManager> resource_manager;
 	std::string hostname;
@@ -66,6 +76,7 @@ private:
 	DownloadingResourceQueue* download_queue;
 
 	std::vector<DownloadQueueItem> queue_items; // scratch buffer
+	js::Vector<uint8, 16> chunk_buf; // scratch buffer
 
 	glare::AtomicInt should_die;
 public:
@@ -14,7 +14,8 @@ Copyright Glare Technologies Limited 2021 -
 
 
 DownloadingResourceQueue::DownloadingResourceQueue()
-:	begin_i(0)
+:	begin_i(0),
+	last_campos(0, 0, 0, 1)
 {}
 
 
@@ -54,9 +55,7 @@ struct QueueItemDistComparator
 {
 	bool operator () (const DownloadQueueItem& a, const DownloadQueueItem& b)
 	{
-		const float a_priority = a.pos.getDist(campos) * a.size_factor;
-		const float b_priority = b.pos.getDist(campos) * b.size_factor;
-		return a_priority < b_priority;
+		return a.priority(campos) < b.priority(campos);
 	}
 
 	Vec4f campos;
@@ -71,6 +70,8 @@ void DownloadingResourceQueue::sortQueue(const Vec3d& campos_) // Sort queue
 	{
 		Lock lock(mutex);
 
+		last_campos = campos;
+
 		Timer timer;
 
 		QueueItemDistComparator comparator;
@@ -90,6 +91,13 @@ void DownloadingResourceQueue::sortQueue(const Vec3d& campos_) // Sort queue
 }
 
 
+Vec4f DownloadingResourceQueue::getCamPos() const
+{
+	Lock lock(mutex);
+	return last_campos;
+}
+
+
 void DownloadingResourceQueue::dequeueItemsWithTimeOut(double wait_time_seconds, size_t max_num_items, std::vector<DownloadQueueItem>& items_out)
 {
 	items_out.resize(0);
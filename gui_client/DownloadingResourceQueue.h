@@ -34,6 +34,9 @@ struct DownloadQueueItem
 		return 1.f / myMax(min_len, aabb_ws_longest_len);
 	}
 
+	// Lower values should be downloaded first.  Also sent to the server with the framed download protocol, see ResourceDownloadScheduler.
+	float priority(const Vec4f& campos) const { return pos.getDist(campos) * size_factor; }
+
 	Vec4f pos;
 	float size_factor;
 	std::string URL;
@@ -60,6 +63,8 @@ public:
 
 	void sortQueue(const Vec3d& campos); // Sort queue (by item distance to camera)
 
+	Vec4f getCamPos() const; // Returns the camera position passed to the last sortQueue() call.
+
 	void dequeueItemsWithTimeOut(double wait_time_s, size_t max_num_items, std::vector<DownloadQueueItem>& items_out); // Blocks for up to wait_time_s
 private:
 
@@ -68,4 +73,5 @@ private:
 	size_t begin_i									GUARDED_BY(mutex);
 	js::Vector<DownloadQueueItem, 16> items			GUARDED_BY(mutex);
 	std::unordered_set<std::string> item_URL_set	GUARDED_BY(mutex);
+	Vec4f last_campos								GUARDED_BY(mutex);
 };
@@ -772,10 +772,7 @@ public:
 			{
 				Lock lock(mutex);
 				if(m_gui_client)
-				{
-					Lock audio_engine_lock(m_gui_client->audio_engine.mutex);
-					this->audio_source->buffer.pushBackNItems(temp_buf.data(), num_samples);
-				}
+					this->audio_source->buffer.pushBackNItems(temp_buf.data(), num_samples); // Lock-free, this is the only thread pushing to the buffer.
 			}
 		}
 	}
@@ -149,11 +149,12 @@ GUIClient::GUIClient(const std::string& base_dir_path_, const std::string& appda
 	last_foostep_side(0),
 	last_animated_tex_time(0),
 	last_model_and_tex_loading_time(0),
+	last_eval_script_time(0),
 	grabbed_axis(-1),
 	grabbed_angle(0),
 	force_new_undo_edit(false),
 	model_and_texture_loader_task_manager("model and texture loader task manager"),
-	task_manager(NULL), // Currently just used for LODGeneration::generateLODTexturesForMaterialsIfNotPresent().
+	task_manager(NULL),
 	url_parcel_uid(-1),
 	running_destructor(false),
 	biome_manager(NULL),
@@ -274,6 +275,17 @@ void GUIClient::initialise(const std::string& cache_dir, SettingsStore* settings
 
 	save_resources_db_thread_manager.addThread(new SaveResourcesDBThread(resource_manager, resources_db_path));
 
+#if !defined(EMSCRIPTEN)
+	try
+	{
+		mesh_disk_cache = new MeshDiskCache(cache_dir + "/mesh_cache", /*max_total_size_B=*/(uint64)2 * 1024 * 1024 * 1024);
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("WARNING: failed to create mesh disk cache: " + e.what());
+	}
+#endif
+
 
 	try
 	{
@@ -1720,18 +1732,28 @@ void GUIClient::loadModelForObject(WorldObject* ob)
 		{
 			if(ob->loaded_model_lod_level != ob_model_lod_level) // We may already have the correct LOD model loaded, don't reload if so.
 			{
-				// Do the model loading (conversion of voxel group to triangle mesh) in a different thread
-				Reference<LoadModelTask> load_model_task = new LoadModelTask();
+				// If the server has made a mesh from the voxels, and we are downloading it (startDownloadingResourcesForObject() was called above), 
+				// wait for it to download instead of meshing the voxels.  The object will be loaded when the mesh is downloaded, see ResourceDownloadedMessage handling.
+				const std::string voxel_mesh_URL = WorldObject::getLODModelURLForLevel(ob->model_url, ob_model_lod_level);
+				const bool waiting_for_voxel_mesh = ob->hasUpToDateVoxelMeshURL() && !resource_manager->isFileForURLPresent(voxel_mesh_URL) && 
+					(URL_to_downloading_info.count(voxel_mesh_URL) != 0);
+
+				if(!waiting_for_voxel_mesh)
+				{
+					// Do the model loading (conversion of voxel group to triangle mesh, or loading of the mesh made by the server) in a different thread
+					Reference<LoadModelTask> load_model_task = new LoadModelTask();
 
-				load_model_task->voxel_ob_model_lod_level = ob_model_lod_level;
-				load_model_task->opengl_engine = opengl_engine;
-				load_model_task->unit_cube_shape = this->unit_cube_shape;
-				load_model_task->result_msg_queue = &this->msg_queue;
-				load_model_task->resource_manager = resource_manager;
-				load_model_task->voxel_ob = ob;
-				load_model_task->build_dynamic_physics_ob = ob->isDynamic();
+					load_model_task->voxel_ob_model_lod_level = ob_model_lod_level;
+					load_model_task->opengl_engine = opengl_engine;
+					load_model_task->unit_cube_shape = this->unit_cube_shape;
+					load_model_task->result_msg_queue = &this->msg_queue;
+					load_model_task->resource_manager = resource_manager;
+					load_model_task->mesh_disk_cache = mesh_disk_cache;
+					load_model_task->voxel_ob = ob;
+					load_model_task->build_dynamic_physics_ob = ob->isDynamic();
 
-				load_item_queue.enqueueItem(*ob, load_model_task, max_dist_for_ob_model_lod_level);
+					load_item_queue.enqueueItem(*ob, load_model_task, max_dist_for_ob_model_lod_level);
+				}
 
 				load_placeholder = ob->getCompressedVoxels().size() != 0;
 			}
@@ -1891,6 +1913,7 @@ void GUIClient::loadModelForObject(WorldObject* ob)
 							load_model_task->unit_cube_shape = this->unit_cube_shape;
 							load_model_task->result_msg_queue = &this->msg_queue;
 							load_model_task->resource_manager = resource_manager;
+							load_model_task->mesh_disk_cache = mesh_disk_cache;
 							load_model_task->build_dynamic_physics_ob = ob->isDynamic();
 
 							load_item_queue.enqueueItem(*ob, load_model_task, max_dist_for_ob_model_lod_level);
@@ -2083,6 +2106,7 @@ void GUIClient::loadModelForAvatar(Avatar* avatar)
 					load_model_task->unit_cube_shape = this->unit_cube_shape;
 					load_model_task->result_msg_queue = &this->msg_queue;
 					load_model_task->resource_manager = resource_manager;
+					load_model_task->mesh_disk_cache = mesh_disk_cache;
 
 					load_item_queue.enqueueItem(*avatar, load_model_task, max_dist_for_ob_model_lod_level, our_avatar);
 				}
@@ -2978,6 +3002,14 @@ void GUIClient::doMoveAndRotateObject(WorldObjectRef ob, const Vec3d& new_ob_pos
 }
 
 
+glare::TaskManager& GUIClient::getOrCreateGeneralTaskManager()
+{
+	if(!task_manager)
+		task_manager = new glare::TaskManager("GUIClient general task manager", myClamp<size_t>(PlatformUtils::getNumLogicalProcessors() / 2, 1, 8));
+	return *task_manager;
+}
+
+
 void GUIClient::checkForLODChanges()
 {
 	ZoneScoped; // Tracy profiler
@@ -4251,9 +4283,15 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 	{
 		ZoneScopedN("script eval"); // Tracy profiler
 
+		glare::TaskManager* script_task_manager = NULL;
+#if !defined(EMSCRIPTEN)
+		if(!obs_with_scripts.empty())
+			script_task_manager = &getOrCreateGeneralTaskManager();
+#endif
+
 		Timer timer;
-		Scripting::evaluateObjectScripts(this->obs_with_scripts, global_time, dt, world_state.ptr(), opengl_engine.ptr(), this->physics_world.ptr(), &this->audio_engine,
-			/*num_scripts_processed_out=*/this->last_num_scripts_processed
+		batched_script_evaluator.evaluateObjectScripts(this->obs_with_scripts, global_time, dt, world_state.ptr(), opengl_engine.ptr(), this->physics_world.ptr(), &this->audio_engine,
+			script_task_manager, cam_controller.getPosition(), this->load_distance, /*stats_out=*/this->last_eval_scripts_stats
 		);
 		this->last_eval_script_time = timer.elapsed();
 	}
@@ -5452,7 +5490,14 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 	if(terrain_decal_manager.nonNull())
 		terrain_decal_manager->think((float)dt);
 	if(particle_manager.nonNull())
-		particle_manager->think((float)dt);
+	{
+		glare::TaskManager* particle_task_manager = NULL;
+#if !defined(EMSCRIPTEN)
+		if(particle_manager->numParticles() >= ParticleManager::MIN_NUM_PARTICLES_FOR_PARALLEL_THINK)
+			particle_task_manager = &getOrCreateGeneralTaskManager();
+#endif
+		particle_manager->think((float)dt, particle_task_manager);
+	}
 
 	if(opengl_engine.nonNull())
 	{
@@ -6331,6 +6376,32 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 				this->client_avatar_uid = static_cast<const ClientConnectedToServerMessage*>(msg.getPointer())->client_avatar_uid;
 				this->server_protocol_version = static_cast<const ClientConnectedToServerMessage*>(msg.getPointer())->server_protocol_version;
 
+				// Send QueryObjectsInAABB or QueryObjectsInAABBIncremental for initial volume around camera to server
+				{
+					const bool incremental = this->server_protocol_version >= 41; // QueryObjectsInAABBIncremental was introduced in protocol version 41.
+
+					MessageUtils::initPacket(scratch_packet, incremental ? Protocol::QueryObjectsInAABBIncremental : Protocol::QueryObjectsInAABB);
+					writeToStream<double>(this->cam_controller.getPosition(), scratch_packet); // Send camera position
+					scratch_packet.writeFloat((float)initial_query_aabb.min_[0]);
+					scratch_packet.writeFloat((float)initial_query_aabb.min_[1]);
+					scratch_packet.writeFloat((float)initial_query_aabb.min_[2]);
+					scratch_packet.writeFloat((float)initial_query_aabb.max_[0]);
+					scratch_packet.writeFloat((float)initial_query_aabb.max_[1]);
+					scratch_packet.writeFloat((float)initial_query_aabb.max_[2]);
+
+					if(incremental)
+					{
+						// Send the digest of objects kept from the last connection to this world, if any.  (Also passed to client_thread in connectToServer())
+						// Otherwise send an empty digest, so we still get IncrementalObjectSyncDone, and can do an incremental sync on the next reconnect.
+						if(object_sync_cache.nonNull() && object_sync_cache->isForWorld(server_hostname, server_worldname))
+							object_sync_cache->digest.writeToStream(scratch_packet);
+						else
+							ObjectSyncDigest().writeToStream(scratch_packet);
+					}
+
+					enqueueMessageToSend(*this->client_thread, scratch_packet);
+				}
+
 				// Try and log in automatically if we have saved credentials for this domain, and auto_login is true.
 				if(settings->getBoolValue("LoginDialog/auto_login", /*default=*/true))
 				{
@@ -6365,6 +6436,16 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 				audio_engine.playOneShotSound(base_dir_path + "/resources/sounds/462089__newagesoup__ethereal-woosh_normalised_mono.wav", 
 					(this->cam_controller.getFirstPersonPosition() + Vec3d(0, 0, -1)).toVec4fPoint());
 			}
+			else if(dynamic_cast<const IncrementalObjectSyncDoneMessage*>(msg.getPointer()))
+			{
+				// The objects we have are now up to date with the server, so we can keep them for an incremental sync next time we connect to this world.
+				this->new_object_sync_cache = new ObjectSyncCache();
+				this->new_object_sync_cache->server_hostname = server_hostname;
+				this->new_object_sync_cache->world_name = server_worldname;
+				this->new_object_sync_cache->digest.valid_time = static_cast<const IncrementalObjectSyncDoneMessage*>(msg.getPointer())->valid_time;
+
+				this->object_sync_cache = NULL; // client_thread has finished with any cache from the last connection.
+			}
 			else if(dynamic_cast<const AudioStreamToServerStartedMessage*>(msg.getPointer()))
 			{
 				// Sent by MicReadThread to indicate that streaming audio to the server has started.   Also sent periodically during streaming as well.
@@ -6910,6 +6991,19 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 								}
 							}
 						}
+						else if(WorldObject::isVoxelMeshURL(URL)) // Else if we downloaded a mesh made by the server from the voxels of a voxel object:
+						{
+							// Load any voxel objects waiting for this mesh.  (see loadModelForObject())
+							Lock lock(this->world_state->mutex);
+
+							for(auto it = this->world_state->objects.valuesBegin(); it != this->world_state->objects.valuesEnd(); ++it)
+							{
+								WorldObject* ob = it.getValue().ptr();
+
+								if(ob->in_proximity && (ob->object_type == WorldObject::ObjectType_VoxelGroup) && (ob->getLODModelURL(cam_controller.getPosition()) == URL))
+									loadModelForObject(ob);
+							}
+						}
 						else if(ModelLoading::hasSupportedModelExtension(local_path)) // Else we didn't download a texture, but maybe a model:
 						{
 							try
@@ -6922,6 +7016,7 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 								load_model_task->unit_cube_shape = this->unit_cube_shape;
 								load_model_task->result_msg_queue = &this->msg_queue;
 								load_model_task->resource_manager = resource_manager;
+								load_model_task->mesh_disk_cache = mesh_disk_cache;
 								load_model_task->build_dynamic_physics_ob = build_dynamic_physics_ob;
 
 								load_item_queue.enqueueItem(pos.toVec4fPoint(), size_factor, load_model_task, 
@@ -6988,9 +7083,10 @@ std::string GUIClient::getDiagnosticsString(bool do_graphics_diagnostics, bool d
 	msg += "last_animated_tex_time: " + doubleToStringNSigFigs(this->last_animated_tex_time * 1000, 3) + " ms\n";
 	msg += "last_num_gif_textures_processed: " + toString(last_num_gif_textures_processed) + "\n";
 	msg += "last_num_mp4_textures_processed: " + toString(last_num_mp4_textures_processed) + "\n";
-	msg += "last_eval_script_time: " + doubleToStringNSigFigs(last_eval_script_time * 1000, 3) + "ms\n";
+	msg += "last_eval_script_time: " + doubleToStringNSigFigs(last_eval_script_time * 1000, 3) + " ms (instance scripts CPU time: " + doubleToStringNSigFigs(last_eval_scripts_stats.instance_eval_CPU_time * 1000, 3) + " ms)\n";
 	msg += "num obs with scripts: " + toString(obs_with_scripts.size()) + "\n";
-	msg += "last_num_scripts_processed: " + toString(last_num_scripts_processed) + "\n";
+	msg += "last_num_scripts_processed: " + toString(last_eval_scripts_stats.num_scripts_processed) + " (" + toString(last_eval_scripts_stats.num_obs_deferred) + " obs deferred, " + 
+		toString(last_eval_scripts_stats.num_instance_buffer_uploads) + " instance buffer uploads)\n";
 	msg += "last_model_and_tex_loading_time: " + doubleToStringNSigFigs(this->last_model_and_tex_loading_time * 1000, 3) + " ms\n";
 	msg += "load_item_queue: " + toString(load_item_queue.size()) + "\n";
 	msg += "model_and_texture_loader_task_manager unfinished tasks: " + toString(model_and_texture_loader_task_manager.getNumUnfinishedTasks()) + "\n";
@@ -7742,12 +7838,9 @@ void GUIClient::createObject(const std::string& mesh_path, BatchedMeshRef loaded
 	// Convert texture paths on the object to URLs
 	new_world_object->convertLocalPathsToURLS(*this->resource_manager);
 
-	if(!task_manager)
-		task_manager = new glare::TaskManager("GUIClient general task manager", myClamp<size_t>(PlatformUtils::getNumLogicalProcessors() / 2, 1, 8)), // Currently just used for LODGeneration::generateLODTexturesForMaterialsIfNotPresent().
-
 	// Generate LOD textures for materials, if not already present on disk.
 	// Note that server will also generate LOD textures, however the client may want to display a particular LOD texture immediately, so generate on the client as well.
-	LODGeneration::generateLODTexturesForMaterialsIfNotPresent(new_world_object->materials, *resource_manager, *task_manager);
+	LODGeneration::generateLODTexturesForMaterialsIfNotPresent(new_world_object->materials, *resource_manager, getOrCreateGeneralTaskManager());
 
 	// Send CreateObject message to server
 	{
@@ -8684,12 +8777,9 @@ void GUIClient::objectEdited()
 
 		this->selected_ob->convertLocalPathsToURLS(*this->resource_manager);
 
-		if(!task_manager)
-			task_manager = new glare::TaskManager("GUIClient general task manager", myClamp<size_t>(PlatformUtils::getNumLogicalProcessors() / 2, 1, 8)), // Currently just used for LODGeneration::generateLODTexturesForMaterialsIfNotPresent().
-
 		// Generate LOD textures for materials, if not already present on disk.
 		// Note that server will also generate LOD textures, however the client may want to display a particular LOD texture immediately, so generate on the client as well.
-		LODGeneration::generateLODTexturesForMaterialsIfNotPresent(selected_ob->materials, *resource_manager, *task_manager);
+		LODGeneration::generateLODTexturesForMaterialsIfNotPresent(selected_ob->materials, *resource_manager, getOrCreateGeneralTaskManager());
 
 		const int ob_lod_level = this->selected_ob->getLODLevel(cam_controller.getPosition());
 		const float max_dist_for_ob_lod_level = selected_ob->getMaxDistForLODLevel(ob_lod_level);
@@ -9085,6 +9175,59 @@ void GUIClient::visitSubURL(const std::string& URL) // Visit a substrata 'sub://
 }
 
 
+// Copies the objects in the world state into the cache, with the digest to send when reconnecting.
+// Objects with local changes that may not have been sent to the server, and dynamic objects (which may have been moved by local physics), are not kept.
+void GUIClient::fillObjectSyncCache(ObjectSyncCache& cache)
+{
+	Timer timer;
+	const Vec3d cam_pos = cam_controller.getFirstPersonPosition();
+
+	std::vector<std::pair<double, WorldObject*>> obs;
+	{
+		Lock lock(this->world_state->mutex);
+
+		obs.reserve(world_state->objects.size());
+		for(auto it = world_state->objects.valuesBegin(); it != world_state->objects.valuesEnd(); ++it)
+		{
+			WorldObject* ob = it.getValue().ptr();
+			if((ob->state == WorldObject::State_InitialSend || ob->state == WorldObject::State_Alive) && !ob->from_local_transform_dirty && !ob->from_local_other_dirty && !ob->isDynamic())
+			{
+				const double dist2 = ob->pos.getDist2(cam_pos);
+				obs.push_back(std::make_pair(std::isfinite(dist2) ? dist2 : std::numeric_limits<double>::infinity(), ob));
+			}
+		}
+
+		// If there are too many objects for the digest, keep the closest ones.
+		if(obs.size() > ObjectSyncDigest::MAX_NUM_KNOWN_OBJECTS)
+		{
+			std::nth_element(obs.begin(), obs.begin() + ObjectSyncDigest::MAX_NUM_KNOWN_OBJECTS, obs.end(),
+				[](const std::pair<double, WorldObject*>& a, const std::pair<double, WorldObject*>& b) { return a.first < b.first; });
+			obs.resize(ObjectSyncDigest::MAX_NUM_KNOWN_OBJECTS);
+		}
+
+		std::sort(obs.begin(), obs.end(), [](const std::pair<double, WorldObject*>& a, const std::pair<double, WorldObject*>& b) { return a.second->uid < b.second->uid; }); // Digest is sorted by UID.
+
+		SocketBufferOutStream ob_data(SocketBufferOutStream::DontUseNetworkByteOrder);
+		cache.digest.known_objects.resize(obs.size());
+		cache.ob_data_offsets.resize(obs.size());
+		for(size_t i=0; i<obs.size(); ++i)
+		{
+			const WorldObject* ob = obs[i].second;
+			cache.digest.known_objects[i].uid = ob->uid;
+			cache.digest.known_objects[i].last_modified_time = ob->last_modified_time;
+			cache.ob_data_offsets[i] = ob_data.buf.size();
+			ob->writeToNetworkStream(ob_data);
+		}
+
+		cache.ob_data.resize(ob_data.buf.size());
+		if(!ob_data.buf.empty())
+			std::memcpy(cache.ob_data.data(), ob_data.buf.data(), ob_data.buf.size());
+	}
+
+	conPrint("Kept " + toString(cache.digest.known_objects.size()) + " object(s) (" + getNiceByteSize(cache.ob_data.size()) + ") for incremental sync, took " + timer.elapsedStringNSigFigs(3));
+}
+
+
 void GUIClient::disconnectFromServerAndClearAllObjects() // Remove any WorldObjectRefs held by GUIClient.
 {
 	udp_socket = NULL;
@@ -9164,6 +9307,15 @@ void GUIClient::disconnectFromServerAndClearAllObjects() // Remove any WorldObje
 	vehicle_controller_inside = NULL;
 	vehicle_controllers.clear();
 
+	// Keep copies of the objects, so if we reconnect to the same world, the server only needs to send new, changed and deleted objects.
+	// Only done if an incremental sync completed on this connection, since we need a valid_time from the server.
+	if(new_object_sync_cache.nonNull() && world_state.nonNull())
+	{
+		fillObjectSyncCache(*new_object_sync_cache);
+		this->object_sync_cache = new_object_sync_cache;
+		this->new_object_sync_cache = NULL;
+	}
+
 	// Remove all objects, parcels, avatars etc.. from OpenGL engine and physics engine
 	if(world_state.nonNull())
 	{
@@ -9350,6 +9502,8 @@ void GUIClient::connectToServer(const std::string& URL)
 
 	client_thread = new ClientThread(&msg_queue, server_hostname, server_port, avatar_URL, server_worldname, this->client_tls_config, this->world_ob_pool_allocator);
 	client_thread->world_state = world_state;
+	if(object_sync_cache.nonNull() && object_sync_cache->isForWorld(server_hostname, server_worldname))
+		client_thread->object_sync_cache = object_sync_cache;
 	client_thread_manager.addThread(client_thread);
 
 	for(int z=0; z<4; ++z)
@@ -9379,22 +9533,8 @@ void GUIClient::connectToServer(const std::string& URL)
 	particle_manager = new ParticleManager(this->base_dir_path, opengl_engine.ptr(), physics_world.ptr(), terrain_decal_manager.ptr());
 
 	// Note that getFirstPersonPosition() is used for consistency with proximity_loader.updateCamPos() calls, where getFirstPersonPosition() is used also.
-	const js::AABBox initial_aabb = proximity_loader.setCameraPosForNewConnection(this->cam_controller.getFirstPersonPosition().toVec4fPoint());
-
-	// Send QueryObjectsInAABB for initial volume around camera to server
-	{
-		// Make QueryObjectsInAABB packet and enqueue to send
-		MessageUtils::initPacket(scratch_packet, Protocol::QueryObjectsInAABB);
-		writeToStream<double>(this->cam_controller.getPosition(), scratch_packet); // Send camera position
-		scratch_packet.writeFloat((float)initial_aabb.min_[0]);
-		scratch_packet.writeFloat((float)initial_aabb.min_[1]);
-		scratch_packet.writeFloat((float)initial_aabb.min_[2]);
-		scratch_packet.writeFloat((float)initial_aabb.max_[0]);
-		scratch_packet.writeFloat((float)initial_aabb.max_[1]);
-		scratch_packet.writeFloat((float)initial_aabb.max_[2]);
-
-		enqueueMessageToSend(*this->client_thread, scratch_packet);
-	}
+	// The query for objects in this volume is sent when we receive ClientConnectedToServerMessage, since which query message to use depends on the server protocol version.
+	this->initial_query_aabb = proximity_loader.setCameraPosForNewConnection(this->cam_controller.getFirstPersonPosition().toVec4fPoint());
 
 	updateGroundPlane();
 
@@ -21,7 +21,10 @@ Copyright Glare Technologies Limited 2023 -
 #include "DownloadingResourceQueue.h"
 #include "LoadItemQueue.h"
 #include "MeshManager.h"
+#include "MeshDiskCache.h"
+#include "Scripting.h"
 #include "WorldState.h"
+#include "ObjectSyncCache.h"
 #include "../shared/WorldSettings.h"
 #include "../audio/AudioEngine.h"
 #include "../audio/MicReadThread.h" // For MicReadStatus
@@ -261,6 +264,7 @@ public:
 	void focusOut();
 
 	void disconnectFromServerAndClearAllObjects(); // Remove any WorldObjectRefs held by MainWindow.
+	void fillObjectSyncCache(ObjectSyncCache& cache);
 
 	void connectToServer(const std::string& URL);
 
@@ -281,6 +285,8 @@ public:
 	void updateDiagnosticAABBForObject(WorldObject* ob); // Returns if vis still valid/needed.
 	void updateObjectsWithDiagnosticVis();
 
+	glare::TaskManager& getOrCreateGeneralTaskManager(); // Creates task_manager if needed.
+
 	void processPlayerPhysicsInput(float dt, PlayerPhysicsInput& input_out);
 
 	void enableMaterialisationEffectOnOb(WorldObject& ob);
@@ -352,6 +358,7 @@ public:
 
 	std::string resources_dir;
 	Reference<ResourceManager> resource_manager;
+	MeshDiskCacheRef mesh_disk_cache; // May be null.
 
 
 	// NOTE: these object sets need to be cleared in connectToServer(), also when removing a dead object in ob->state == WorldObject::State_Dead case in timerEvent, the object needs to be removed
@@ -413,7 +420,7 @@ public:
 	Reference<OpenGLProgram> parcel_shader_prog;
 
 	StandardPrintOutput print_output;
-	glare::TaskManager* task_manager; // General purpose task manager, for quick/blocking multithreaded builds of stuff. Currently just used for LODGeneration::generateLODTexturesForMaterialsIfNotPresent(). Lazily created.
+	glare::TaskManager* task_manager; // General purpose task manager, for quick/blocking multithreaded builds of stuff. Used for LODGeneration::generateLODTexturesForMaterialsIfNotPresent() and evaluating instance scripts and particles. Lazily created by getOrCreateGeneralTaskManager().
 	
 	glare::TaskManager model_and_texture_loader_task_manager;
 
@@ -501,7 +508,9 @@ public:
 	double last_eval_script_time;
 	int last_num_gif_textures_processed;
 	int last_num_mp4_textures_processed;
-	int last_num_scripts_processed;
+	Scripting::EvalScriptsStats last_eval_scripts_stats;
+
+	Scripting::BatchedScriptEvaluator batched_script_evaluator;
 
 	Timer time_since_object_edited; // For undo edit merging.
 	bool force_new_undo_edit; // // Multiple edits using the object editor, in a short timespan, will be merged together, unless force_new_undo_edit is true (is set when undo or redo is issued).
@@ -562,6 +571,10 @@ public:
 	UID client_avatar_uid; // When we connect to a server, the server assigns a UID to the client/avatar.
 	uint32 server_protocol_version;
 
+	js::AABBox initial_query_aabb; // Volume around the camera to query objects in, once connected to the server.
+	ObjectSyncCacheRef object_sync_cache; // Objects kept from the last connection to a world.  Used for incremental sync when reconnecting to the same world.
+	ObjectSyncCacheRef new_object_sync_cache; // Created when IncrementalObjectSyncDone is received for the current connection, filled with the objects on disconnect.
+
 	uint64 frame_num;
 
 	MicReadStatus mic_read_status;
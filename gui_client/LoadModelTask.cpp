@@ -9,10 +9,12 @@ Copyright Glare Technologies Limited 2021 -
 #include "LoadTextureTask.h"
 #include "ThreadMessages.h"
 #include "ModelLoading.h"
+#include "MeshDiskCache.h"
 #include "../shared/ResourceManager.h"
 #include <indigo/TextureServer.h>
 #include <opengl/OpenGLEngine.h>
 #include <opengl/OpenGLMeshRenderData.h>
+#include <opengl/GLMeshBuilding.h>
 #include <ConPrint.h>
 #include <PlatformUtils.h>
 #include <FileUtils.h>
@@ -39,12 +41,26 @@ void LoadModelTask::run(size_t thread_index)
 		{
 			const Matrix4f ob_to_world_matrix = obToWorldMatrix(*voxel_ob);
 
+			const std::string voxel_mesh_url = WorldObject::getLODModelURLForLevel(voxel_ob->model_url, voxel_ob_model_lod_level);
+
 			if(voxel_ob->getCompressedVoxels().size() == 0)
 			{
 				// Add dummy cube marker for zero-voxel case.
 				gl_meshdata = opengl_engine->getCubeMeshData();
 				physics_shape = unit_cube_shape;
 			}
+			else if(voxel_ob->hasUpToDateVoxelMeshURL() && resource_manager->isFileForURLPresent(voxel_mesh_url))
+			{
+				// Load the mesh that the server made from the voxels, instead of meshing them here.
+				subsample_factor = WorldObject::getVoxelSubsampleFactorForLODLevel(voxel_ob_model_lod_level);
+
+				BatchedMeshRef batched_mesh;
+				gl_meshdata = ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(voxel_mesh_url, *this->resource_manager,
+					/*vert_buf_allocator=*/NULL, 
+					true, // skip_opengl_calls - we need to do these on the main thread.
+					build_dynamic_physics_ob,
+					/*physics shape out=*/physics_shape, /*batched_mesh_out=*/batched_mesh, mesh_disk_cache.ptr());
+			}
 			else
 			{
 				VoxelGroup voxel_group;
@@ -53,21 +69,39 @@ void LoadModelTask::run(size_t thread_index)
 				const int max_model_lod_level = (voxel_group.voxels.size() > 256) ? 2 : 0;
 				const int use_model_lod_level = myMin(voxel_ob_model_lod_level/*model_lod_level*/, max_model_lod_level);
 
-				if(use_model_lod_level == 1)
-					subsample_factor = 2;
-				else if(use_model_lod_level == 2)
-					subsample_factor = 4;
+				subsample_factor = WorldObject::getVoxelSubsampleFactorForLODLevel(use_model_lod_level);
 
-				js::Vector<bool, 16> mat_transparent(voxel_ob->materials.size());
-				for(size_t i=0; i<voxel_ob->materials.size(); ++i)
-					mat_transparent[i] = voxel_ob->materials[i]->opacity.val < 1.f;
+				js::Vector<bool, 16> mat_transparent;
+				voxel_ob->getVoxelMatsTransparent(mat_transparent);
 
 				// conPrint("Loading vox model for ob with UID " + voxel_ob->uid.toString() + " for LOD level " + toString(use_model_lod_level) + ", using subsample_factor " + toString(subsample_factor) + ", " + toString(voxel_group.voxels.size()) + " voxels");
 
 				const bool need_lightmap_uvs = !voxel_ob->lightmap_url.empty();
-				Indigo::MeshRef indigo_mesh;
-				gl_meshdata = ModelLoading::makeModelForVoxelGroup(voxel_group, subsample_factor, ob_to_world_matrix, /*vert_buf_allocator=*/NULL, /*do_opengl_stuff=*/false, 
-					need_lightmap_uvs, mat_transparent, build_dynamic_physics_ob, /*physics shape out=*/physics_shape, indigo_mesh);
+
+				// The cache doesn't store lightmap UVs, which depend on the object transform, so only use it if they aren't needed.
+				const std::string cache_key = (mesh_disk_cache.nonNull() && !need_lightmap_uvs) ?
+					MeshDiskCache::makeKey(WorldObject::getLODModelURLForLevel(WorldObject::makeVoxelMeshURL(voxel_ob->getCompressedVoxels(), mat_transparent), use_model_lod_level), build_dynamic_physics_ob) :
+					std::string();
+
+				BatchedMeshRef cached_mesh;
+				if(!cache_key.empty() && mesh_disk_cache->tryLoad(cache_key, /*load_mesh=*/true, cached_mesh, physics_shape))
+				{
+					gl_meshdata = GLMeshBuilding::buildBatchedMesh(/*vert_buf_allocator=*/NULL, cached_mesh, /*skip_opengl_calls=*/true, /*instancing_matrix_data=*/NULL);
+					gl_meshdata->animation_data = cached_mesh->animation_data;
+					gl_meshdata->num_materials_referenced = cached_mesh->numMaterialsReferenced();
+				}
+				else
+				{
+					Indigo::MeshRef indigo_mesh;
+					gl_meshdata = ModelLoading::makeModelForVoxelGroup(voxel_group, subsample_factor, ob_to_world_matrix, /*vert_buf_allocator=*/NULL, /*do_opengl_stuff=*/false, 
+						need_lightmap_uvs, mat_transparent, build_dynamic_physics_ob, /*physics shape out=*/physics_shape, indigo_mesh);
+
+					if(!cache_key.empty())
+					{
+						BatchedMeshRef batched_mesh = BatchedMesh::buildFromIndigoMesh(*indigo_mesh);
+						mesh_disk_cache->store(cache_key, batched_mesh.ptr(), physics_shape);
+					}
+				}
 
 				// Temp for testing: Save voxels to disk.
 				//FileUtils::writeEntireFile("d:/files/voxeldata/ob_" + voxel_ob->uid.toString() + "_voxeldata.voxdata", (const char*)voxel_group.voxels.data(), voxel_group.voxels.dataSizeBytes());
@@ -85,7 +119,7 @@ void LoadModelTask::run(size_t thread_index)
 				/*vert_buf_allocator=*/NULL, 
 				true, // skip_opengl_calls - we need to do these on the main thread.
 				build_dynamic_physics_ob,
-				/*physics shape out=*/physics_shape, /*batched_mesh_out=*/batched_mesh);
+				/*physics shape out=*/physics_shape, /*batched_mesh_out=*/batched_mesh, mesh_disk_cache.ptr());
 		}
 
 		// Send a ModelLoadedThreadMessage back to main window.
@@ -16,6 +16,7 @@ Copyright Glare Technologies Limited 2021 -
 #include <string>
 class OpenGLEngine;
 class MeshManager;
+class MeshDiskCache;
 class ResourceManager;
 
 
@@ -59,11 +60,12 @@ public:
 	std::string lod_model_url; // The URL of a model with a specific LOD level to load.  Empty when loading voxel object.
 	bool build_dynamic_physics_ob; // If true, build a convex hull shape instead of a mesh physics shape.
 	
-	WorldObjectRef voxel_ob; // If non-null, the task is to load/mesh the voxels for this object.
+	WorldObjectRef voxel_ob; // If non-null, the task is to load/mesh the voxels for this object.  Loads the mesh made by the server if it's present, see WorldObject::hasUpToDateVoxelMeshURL().
 	int voxel_ob_model_lod_level; // If we are loading a voxel model, the model LOD level of the object.
 
 	PhysicsShape unit_cube_shape;
 	Reference<OpenGLEngine> opengl_engine;
 	Reference<ResourceManager> resource_manager;
+	Reference<MeshDiskCache> mesh_disk_cache; // May be null.
 	ThreadSafeQueue<Reference<ThreadMessage> >* result_msg_queue;
 };
@@ -0,0 +1,474 @@
+/*=====================================================================
+MeshDiskCache.cpp
+-----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "MeshDiskCache.h"
+
+
+#include "PhysicsWorld.h"
+#include <utils/FileUtils.h>
+#include <utils/MemMappedFile.h>
+#include <utils/StringUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/Exception.h>
+#include <utils/Lock.h>
+#include <utils/IncludeXXHash.h>
+
+
+static const uint32 SHAPE_FILE_MAGIC_NUMBER = 0x4A534843; // "CHSJ" in little-endian byte order.
+static const uint32 SHAPE_FILE_VERSION = 1; // Increment if the format, or the way meshes or physics shapes are built, changes.
+static const size_t SHAPE_FILE_HEADER_SIZE = 8;
+
+
+MeshDiskCache::MeshDiskCache(const std::string& cache_dir_, uint64 max_total_size_B_)
+:	cache_dir(cache_dir_),
+	max_total_size_B(max_total_size_B_),
+	total_size_B(0)
+{
+	FileUtils::createDirIfDoesNotExist(cache_dir);
+
+	// Add entries already on disk.  Every entry has a shape file, so use those to find them.
+	Lock lock(mutex);
+	const std::vector<std::string> filenames = FileUtils::getFilesInDir(cache_dir);
+	for(size_t i=0; i<filenames.size(); ++i)
+	{
+		const std::string& filename = filenames[i];
+		const std::string filename_base = filename.substr(0, filename.find('.'));
+
+		if(hasExtension(filename, "tmp")) // Left over from an interrupted store().
+		{
+			try
+			{
+				FileUtils::deleteFile(cache_dir + "/" + filename);
+			}
+			catch(glare::Exception&)
+			{}
+		}
+		else if(hasExtension(filename, "jshape"))
+		{
+			try
+			{
+				uint64 size_B = FileUtils::getFileSize(shapePath(filename_base));
+				if(FileUtils::fileExists(meshPath(filename_base)))
+					size_B += FileUtils::getFileSize(meshPath(filename_base));
+
+				lru_list.push_back(filename_base);
+				Entry& entry = entries[filename_base];
+				entry.size_B = size_B;
+				entry.lru_it = std::prev(lru_list.end());
+				total_size_B += size_B;
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("MeshDiskCache: " + e.what());
+			}
+		}
+	}
+
+	evictEntriesIfNeeded();
+}
+
+
+MeshDiskCache::~MeshDiskCache()
+{}
+
+
+std::string MeshDiskCache::makeKey(const std::string& lod_model_URL, bool dynamic_physics_shape)
+{
+	return lod_model_URL + (dynamic_physics_shape ? "_dynamic" : "_static");
+}
+
+
+std::string MeshDiskCache::shapePath(const std::string& filename_base) const
+{
+	return cache_dir + "/" + filename_base + ".jshape";
+}
+
+
+std::string MeshDiskCache::meshPath(const std::string& filename_base) const
+{
+	return cache_dir + "/" + filename_base + ".bmesh";
+}
+
+
+static std::string filenameBaseForKey(const std::string& key)
+{
+	return toHexString(XXH64(key.data(), key.size(), /*seed=*/1));
+}
+
+
+bool MeshDiskCache::tryLoad(const std::string& key, bool load_mesh, BatchedMeshRef& batched_mesh_out, PhysicsShape& physics_shape_out)
+{
+	const std::string filename_base = filenameBaseForKey(key);
+	{
+		Lock lock(mutex);
+		auto res = entries.find(filename_base);
+		if(res == entries.end())
+			return false;
+
+		// Move to front of LRU list
+		lru_list.splice(lru_list.begin(), lru_list, res->second.lru_it);
+	}
+
+	// Do the loading without holding the mutex.
+	try
+	{
+		PhysicsShape physics_shape;
+		{
+			MemMappedFile file(shapePath(filename_base));
+			if(file.fileSize() < SHAPE_FILE_HEADER_SIZE)
+				throw glare::Exception("Shape file too small");
+
+			uint32 magic_number, version;
+			std::memcpy(&magic_number, (const uint8*)file.fileData() + 0, sizeof(uint32));
+			std::memcpy(&version,      (const uint8*)file.fileData() + 4, sizeof(uint32));
+			if(magic_number != SHAPE_FILE_MAGIC_NUMBER || version != SHAPE_FILE_VERSION)
+				throw glare::Exception("Invalid shape file header");
+
+			physics_shape = PhysicsWorld::readShapeFromBuffer((const uint8*)file.fileData() + SHAPE_FILE_HEADER_SIZE, file.fileSize() - SHAPE_FILE_HEADER_SIZE);
+		}
+
+		BatchedMeshRef batched_mesh;
+		if(load_mesh)
+		{
+			if(!FileUtils::fileExists(meshPath(filename_base)))
+				throw glare::Exception("Mesh file missing");
+			batched_mesh = BatchedMesh::readFromFile(meshPath(filename_base));
+			batched_mesh->checkValidAndSanitiseMesh(); // Throws glare::Exception on invalid mesh.
+		}
+
+		physics_shape_out = physics_shape;
+		batched_mesh_out = batched_mesh;
+		return true;
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("MeshDiskCache: failed to load entry for '" + key + "': " + e.what() + ", removing.");
+
+		Lock lock(mutex);
+		if(entries.count(filename_base) > 0)
+			removeEntry(filename_base);
+		return false;
+	}
+}
+
+
+void MeshDiskCache::store(const std::string& key, const BatchedMesh* batched_mesh, const PhysicsShape& physics_shape)
+{
+	const std::string filename_base = filenameBaseForKey(key);
+	{
+		Lock lock(mutex);
+		if(entries.count(filename_base) > 0 || entries_being_stored.count(filename_base) > 0)
+			return;
+		entries_being_stored.insert(filename_base);
+	}
+
+	uint64 size_B = 0;
+	bool stored = false;
+	try
+	{
+		// Write to temp files, then move into place, so that an interrupted store doesn't leave a partial entry.
+		if(batched_mesh)
+		{
+			const std::string temp_mesh_path = meshPath(filename_base) + ".tmp";
+			BatchedMesh::WriteOptions write_options;
+			write_options.compression_level = 1; // Use a low compression level, as the mesh is stored on the load path, and is only read locally.
+			batched_mesh->writeToFile(temp_mesh_path, write_options);
+			size_B += FileUtils::getFileSize(temp_mesh_path);
+			FileUtils::moveFile(temp_mesh_path, meshPath(filename_base));
+		}
+
+		js::Vector<uint8, 16> shape_data;
+		PhysicsWorld::writeShapeToBuffer(physics_shape, shape_data);
+
+		js::Vector<uint8, 16> file_data(SHAPE_FILE_HEADER_SIZE + shape_data.size());
+		std::memcpy(file_data.data() + 0, &SHAPE_FILE_MAGIC_NUMBER, sizeof(uint32));
+		std::memcpy(file_data.data() + 4, &SHAPE_FILE_VERSION,      sizeof(uint32));
+		if(!shape_data.empty())
+			std::memcpy(file_data.data() + SHAPE_FILE_HEADER_SIZE, shape_data.data(), shape_data.size());
+
+		const std::string temp_shape_path = shapePath(filename_base) + ".tmp";
+		FileUtils::writeEntireFile(temp_shape_path, (const char*)file_data.data(), file_data.size());
+		FileUtils::moveFile(temp_shape_path, shapePath(filename_base)); // Write the shape file last, as it marks the entry as complete.
+		size_B += file_data.size();
+		stored = true;
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("MeshDiskCache: failed to store entry for '" + key + "': " + e.what());
+	}
+
+	Lock lock(mutex);
+	entries_being_stored.erase(filename_base);
+	if(stored)
+	{
+		lru_list.push_front(filename_base);
+		Entry& entry = entries[filename_base];
+		entry.size_B = size_B;
+		entry.lru_it = lru_list.begin();
+		total_size_B += size_B;
+
+		evictEntriesIfNeeded();
+	}
+}
+
+
+size_t MeshDiskCache::numEntries() const
+{
+	Lock lock(mutex);
+	return entries.size();
+}
+
+
+uint64 MeshDiskCache::totalSizeB() const
+{
+	Lock lock(mutex);
+	return total_size_B;
+}
+
+
+void MeshDiskCache::removeEntry(const std::string& filename_base)
+{
+	auto res = entries.find(filename_base);
+	assert(res != entries.end());
+
+	total_size_B -= res->second.size_B;
+	lru_list.erase(res->second.lru_it);
+	entries.erase(res);
+
+	// Delete the shape file first, so a partially deleted entry isn't picked up on the next run.
+	try
+	{
+		if(FileUtils::fileExists(shapePath(filename_base)))
+			FileUtils::deleteFile(shapePath(filename_base));
+		if(FileUtils::fileExists(meshPath(filename_base)))
+			FileUtils::deleteFile(meshPath(filename_base));
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("MeshDiskCache: failed to delete entry: " + e.what());
+	}
+}
+
+
+void MeshDiskCache::evictEntriesIfNeeded()
+{
+	while(total_size_B > max_total_size_B && !lru_list.empty())
+		removeEntry(lru_list.back());
+}
+
+
+#if BUILD_TESTS
+
+
+#include "../shared/WorldObject.h"
+#include "../shared/VoxelMeshBuilding.h"
+#include <opengl/GLMeshBuilding.h>
+#include <opengl/OpenGLMeshRenderData.h>
+#include <dll/include/IndigoMesh.h>
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/Timer.h>
+#include <cmath>
+
+
+static void removeCacheDirFiles(const std::string& dir)
+{
+	if(FileUtils::fileExists(dir))
+	{
+		const std::vector<std::string> filenames = FileUtils::getFilesInDir(dir);
+		for(size_t i=0; i<filenames.size(); ++i)
+			FileUtils::deleteFile(dir + "/" + filenames[i]);
+	}
+}
+
+
+void MeshDiskCache::test()
+{
+	conPrint("MeshDiskCache::test()");
+
+	try
+	{
+		const std::string cache_dir = PlatformUtils::getTempDirPath() + "/mesh_disk_cache_test";
+		removeCacheDirFiles(cache_dir);
+
+		js::Vector<bool, 16> mats_transparent(2);
+		mats_transparent[0] = false;
+		mats_transparent[1] = true;
+
+		//------------------------------------------- Test storing and loading entries -------------------------------------------
+		{
+			VoxelGroup group;
+			group.voxels.push_back(Voxel(Vec3<int>(0, 0, 0), 0));
+			group.voxels.push_back(Voxel(Vec3<int>(1, 0, 0), 1));
+			group.voxels.push_back(Voxel(Vec3<int>(0, 0, 1), 0));
+
+			Indigo::MeshRef indigo_mesh = VoxelMeshBuilding::makeIndigoMeshForVoxelGroup(group, /*subsample_factor=*/1, /*generate_shading_normals=*/false, mats_transparent);
+			BatchedMeshRef batched_mesh = BatchedMesh::buildFromIndigoMesh(*indigo_mesh);
+			const PhysicsShape static_shape  = PhysicsWorld::createJoltShapeForBatchedMesh(*batched_mesh, /*build_dynamic_physics_ob=*/false);
+			const PhysicsShape dynamic_shape = PhysicsWorld::createJoltShapeForBatchedMesh(*batched_mesh, /*build_dynamic_physics_ob=*/true);
+
+			const std::string static_key  = makeKey("voxmesh_123.bmesh", /*dynamic_physics_shape=*/false);
+			const std::string dynamic_key = makeKey("voxmesh_123.bmesh", /*dynamic_physics_shape=*/true);
+			const std::string shape_only_key = makeKey("model_456.bmesh", /*dynamic_physics_shape=*/false);
+			testAssert(static_key != dynamic_key);
+
+			{
+				MeshDiskCacheRef cache = new MeshDiskCache(cache_dir, /*max_total_size_B=*/100000000);
+				testAssert(cache->numEntries() == 0);
+
+				BatchedMeshRef loaded_mesh;
+				PhysicsShape loaded_shape;
+				testAssert(!cache->tryLoad(static_key, /*load_mesh=*/true, loaded_mesh, loaded_shape));
+
+				cache->store(static_key, batched_mesh.ptr(), static_shape);
+				cache->store(dynamic_key, batched_mesh.ptr(), dynamic_shape);
+				cache->store(shape_only_key, /*batched_mesh=*/NULL, static_shape);
+				testAssert(cache->numEntries() == 3);
+				testAssert(cache->totalSizeB() > 0);
+
+				// Storing an existing entry again should do nothing.
+				const uint64 size_B = cache->totalSizeB();
+				cache->store(static_key, batched_mesh.ptr(), static_shape);
+				testAssert(cache->numEntries() == 3);
+				testAssert(cache->totalSizeB() == size_B);
+			}
+
+			// Make a new cache object using the same dir, as happens when the client restarts.
+			{
+				MeshDiskCacheRef cache = new MeshDiskCache(cache_dir, /*max_total_size_B=*/100000000);
+				testAssert(cache->numEntries() == 3);
+
+				BatchedMeshRef loaded_mesh;
+				PhysicsShape loaded_shape;
+				testAssert(cache->tryLoad(static_key, /*load_mesh=*/true, loaded_mesh, loaded_shape));
+				testAssert(loaded_mesh.nonNull());
+				testAssert(loaded_mesh->numVerts() == batched_mesh->numVerts());
+				testAssert(loaded_mesh->numIndices() == batched_mesh->numIndices());
+				testAssert(loaded_mesh->numMaterialsReferenced() == batched_mesh->numMaterialsReferenced());
+				testAssert(loaded_shape.jolt_shape->GetSubType() == static_shape.jolt_shape->GetSubType());
+				testAssert(loaded_shape.size_B == static_shape.size_B);
+
+				testAssert(cache->tryLoad(dynamic_key, /*load_mesh=*/true, loaded_mesh, loaded_shape));
+				testAssert(loaded_shape.jolt_shape->GetSubType() == dynamic_shape.jolt_shape->GetSubType());
+				testAssert(loaded_shape.size_B == dynamic_shape.size_B);
+
+				BatchedMeshRef shape_only_mesh;
+				testAssert(cache->tryLoad(shape_only_key, /*load_mesh=*/false, shape_only_mesh, loaded_shape));
+				testAssert(shape_only_mesh.isNull());
+
+				// Requesting a mesh from a shape-only entry should fail and remove the entry.
+				testAssert(!cache->tryLoad(shape_only_key, /*load_mesh=*/true, shape_only_mesh, loaded_shape));
+				testAssert(cache->numEntries() == 2);
+			}
+
+			// Test that a corrupted entry is removed.
+			{
+				FileUtils::writeEntireFile(cache_dir + "/" + filenameBaseForKey(dynamic_key) + ".jshape", "abcdefghijk", 11);
+
+				MeshDiskCacheRef cache = new MeshDiskCache(cache_dir, /*max_total_size_B=*/100000000);
+				testAssert(cache->numEntries() == 2);
+
+				BatchedMeshRef loaded_mesh;
+				PhysicsShape loaded_shape;
+				testAssert(!cache->tryLoad(dynamic_key, /*load_mesh=*/true, loaded_mesh, loaded_shape));
+				testAssert(cache->numEntries() == 1);
+				testAssert(!FileUtils::fileExists(cache_dir + "/" + filenameBaseForKey(dynamic_key) + ".bmesh"));
+			}
+
+			// Test eviction: with a max size that only fits one entry, storing a new entry should evict the least recently used one.
+			{
+				removeCacheDirFiles(cache_dir);
+				MeshDiskCacheRef cache = new MeshDiskCache(cache_dir, /*max_total_size_B=*/100000000);
+				cache->store(static_key, batched_mesh.ptr(), static_shape);
+				const uint64 entry_size_B = cache->totalSizeB();
+
+				cache = NULL;
+				cache = new MeshDiskCache(cache_dir, /*max_total_size_B=*/entry_size_B * 3 / 2);
+				testAssert(cache->numEntries() == 1);
+				cache->store(dynamic_key, batched_mesh.ptr(), static_shape); // Use the static shape so the entry has the same size.
+				testAssert(cache->numEntries() == 1);
+
+				BatchedMeshRef loaded_mesh;
+				PhysicsShape loaded_shape;
+				testAssert(!cache->tryLoad(static_key, /*load_mesh=*/true, loaded_mesh, loaded_shape));
+				testAssert(cache->tryLoad(dynamic_key, /*load_mesh=*/true, loaded_mesh, loaded_shape));
+			}
+		}
+
+		//------------------------------------------- Benchmark cold and warm start loading for a dense voxel world -------------------------------------------
+		// Cold start is meshing the voxels and building the physics shapes, as done by LoadModelTask, and storing the results in the cache.
+		// Warm start is loading the results from the cache.  Both include building the OpenGL mesh data (without OpenGL calls), to get the time until fully loaded.
+		{
+			removeCacheDirFiles(cache_dir);
+
+			const int num_obs = 64;
+			const int side = 32;
+			std::vector<js::Vector<uint8, 16> > compressed_voxels(num_obs);
+			for(int ob_i=0; ob_i<num_obs; ++ob_i)
+			{
+				VoxelGroup group;
+				for(int y=0; y<side; ++y)
+				for(int x=0; x<side; ++x)
+				{
+					const int height = 2 + (int)(3.f * (1 + std::sin(x * 0.3f + ob_i) * std::cos(y * 0.2f)));
+					for(int z=0; z<height; ++z)
+						group.voxels.push_back(Voxel(Vec3<int>(x, y, z), (z == height - 1) ? ((x / 4 + y / 4 + ob_i) % 2) : 0));
+				}
+				WorldObject::compressVoxelGroup(group, compressed_voxels[ob_i]);
+			}
+
+			MeshDiskCacheRef cache = new MeshDiskCache(cache_dir, /*max_total_size_B=*/1000000000);
+
+			size_t cold_num_indices = 0;
+			Timer cold_timer;
+			for(int ob_i=0; ob_i<num_obs; ++ob_i)
+			{
+				VoxelGroup group;
+				WorldObject::decompressVoxelGroup(compressed_voxels[ob_i].data(), compressed_voxels[ob_i].size(), group);
+				Indigo::MeshRef indigo_mesh = VoxelMeshBuilding::makeIndigoMeshForVoxelGroup(group, /*subsample_factor=*/1, /*generate_shading_normals=*/false, mats_transparent);
+				BatchedMeshRef batched_mesh = BatchedMesh::buildFromIndigoMesh(*indigo_mesh);
+				const PhysicsShape physics_shape = PhysicsWorld::createJoltShapeForBatchedMesh(*batched_mesh, /*build_dynamic_physics_ob=*/false);
+				Reference<OpenGLMeshRenderData> gl_meshdata = GLMeshBuilding::buildBatchedMesh(/*vert_buf_allocator=*/NULL, batched_mesh, /*skip_opengl_calls=*/true, /*instancing_matrix_data=*/NULL);
+
+				cache->store(makeKey(WorldObject::makeVoxelMeshURL(compressed_voxels[ob_i], mats_transparent), /*dynamic_physics_shape=*/false), batched_mesh.ptr(), physics_shape);
+				cold_num_indices += batched_mesh->numIndices();
+			}
+			const double cold_time = cold_timer.elapsed();
+
+			// Simulate a restart.
+			cache = NULL;
+			cache = new MeshDiskCache(cache_dir, /*max_total_size_B=*/1000000000);
+			testAssert(cache->numEntries() == (size_t)num_obs);
+
+			size_t warm_num_indices = 0;
+			Timer warm_timer;
+			for(int ob_i=0; ob_i<num_obs; ++ob_i)
+			{
+				BatchedMeshRef batched_mesh;
+				PhysicsShape physics_shape;
+				testAssert(cache->tryLoad(makeKey(WorldObject::makeVoxelMeshURL(compressed_voxels[ob_i], mats_transparent), /*dynamic_physics_shape=*/false), /*load_mesh=*/true, batched_mesh, physics_shape));
+				Reference<OpenGLMeshRenderData> gl_meshdata = GLMeshBuilding::buildBatchedMesh(/*vert_buf_allocator=*/NULL, batched_mesh, /*skip_opengl_calls=*/true, /*instancing_matrix_data=*/NULL);
+
+				warm_num_indices += batched_mesh->numIndices();
+			}
+			const double warm_time = warm_timer.elapsed();
+
+			testAssert(warm_num_indices == cold_num_indices);
+
+			conPrint("Dense voxel world (" + toString(num_obs) + " objects, " + toString(cache->totalSizeB() / 1024) + " KB cached):");
+			conPrint("    cold start (meshing + physics shapes + storing): " + doubleToStringNSigFigs(cold_time * 1.0e3, 4) + " ms");
+			conPrint("    warm start (loading from cache):                 " + doubleToStringNSigFigs(warm_time * 1.0e3, 4) + " ms (" + doubleToStringNSigFigs(cold_time / warm_time, 3) + "x faster)");
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("MeshDiskCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,85 @@
+/*=====================================================================
+MeshDiskCache.h
+---------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "PhysicsObject.h"
+#include <graphics/BatchedMesh.h>
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+
+/*=====================================================================
+MeshDiskCache
+-------------
+Persistent cache of processed meshes and Jolt physics shapes, in the client cache dir, so they don't have to be rebuilt
+every time the client starts.  MeshManager only caches them in memory.
+
+Entries are keyed by a model URL (which includes a hash of the model file contents) or a voxel mesh URL (which is a
+hash of the voxel data, see WorldObject::makeVoxelMeshURL()), with the LOD level, and the dynamic physics shape flag.
+The key is hashed to make the filenames.
+
+Each entry consists of a physics shape file (a small header then the Jolt binary shape state, see
+PhysicsWorld::writeShapeToBuffer()), which is memory-mapped when loaded, and optionally a processed mesh, stored as a bmesh.
+The mesh is not stored for models that are already bmeshes, as the model file can just be loaded directly.
+
+When the total size exceeds max_total_size_B, the least recently used entries are deleted.  Entries that were present
+on disk at startup are considered less recently used than any entry used since then.
+
+Threadsafe.
+=====================================================================*/
+class MeshDiskCache : public ThreadSafeRefCounted
+{
+public:
+	// Creates cache_dir if it doesn't exist.  Throws glare::Exception on failure.
+	MeshDiskCache(const std::string& cache_dir, uint64 max_total_size_B);
+	~MeshDiskCache();
+
+	static std::string makeKey(const std::string& lod_model_URL, bool dynamic_physics_shape);
+
+	// Loads the physics shape, and the mesh if load_mesh is true, for the entry with the given key.
+	// Returns false if there is no such entry.  Invalid entries are deleted, and false returned.
+	bool tryLoad(const std::string& key, bool load_mesh, BatchedMeshRef& batched_mesh_out, PhysicsShape& physics_shape_out);
+
+	// Adds an entry, if it isn't already present.  batched_mesh may be NULL, in which case just the physics shape is stored.
+	// Errors (e.g. disk full) are printed and otherwise ignored.
+	void store(const std::string& key, const BatchedMesh* batched_mesh, const PhysicsShape& physics_shape);
+
+	size_t numEntries() const;
+	uint64 totalSizeB() const;
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(MeshDiskCache)
+
+	struct Entry
+	{
+		uint64 size_B;
+		std::list<std::string>::iterator lru_it;
+	};
+
+	std::string shapePath(const std::string& filename_base) const;
+	std::string meshPath(const std::string& filename_base) const;
+	void removeEntry(const std::string& filename_base) REQUIRES(mutex);
+	void evictEntriesIfNeeded() REQUIRES(mutex);
+
+	std::string cache_dir;
+	uint64 max_total_size_B;
+
+	mutable Mutex mutex;
+	std::unordered_map<std::string, Entry> entries		GUARDED_BY(mutex); // Map from filename base (hash of key) to entry.
+	std::list<std::string> lru_list						GUARDED_BY(mutex); // Filename bases, most recently used at front.
+	std::unordered_set<std::string> entries_being_stored	GUARDED_BY(mutex);
+	uint64 total_size_B									GUARDED_BY(mutex);
+};
+typedef Reference<MeshDiskCache> MeshDiskCacheRef;
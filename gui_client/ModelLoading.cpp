@@ -9,6 +9,7 @@ Code By Nicholas Chapman.
 
 #include "MeshBuilding.h"
 #include "PhysicsWorld.h"
+#include "MeshDiskCache.h"
 #include "../shared/WorldObject.h"
 #include "../shared/ResourceManager.h"
 #include "../shared/VoxelMeshBuilding.h"
@@ -944,13 +945,9 @@ void ModelLoading::setMaterialTexPathsForLODLevel(GLObject& gl_ob, int ob_lod_le
 }
 
 
-Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(const std::string& lod_model_URL,
-	ResourceManager& resource_manager, VertexBufferAllocator* vert_buf_allocator,
-	bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out)
+// Load the model file at model_path and process it into a BatchedMesh.
+static BatchedMeshRef loadBatchedMeshForModelPath(const std::string& model_path)
 {
-	// Load mesh from disk:
-	const std::string model_path = resource_manager.pathForURL(lod_model_URL);
-
 	BatchedMeshRef batched_mesh;
 
 	if(hasExtension(model_path, "obj"))
@@ -1011,13 +1008,44 @@ Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForMod
 		if(batched_mesh->animation_data.vrm_data.nonNull())
 			rotateVRMMesh(*batched_mesh);
 
+	return batched_mesh;
+}
+
+
+Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(const std::string& lod_model_URL,
+	ResourceManager& resource_manager, VertexBufferAllocator* vert_buf_allocator,
+	bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out,
+	MeshDiskCache* mesh_disk_cache)
+{
+	// Load mesh from disk:
+	const std::string model_path = resource_manager.pathForURL(lod_model_URL);
+
+	// bmesh files are quick to load, so the cache just stores the physics shape for them.
+	const bool cache_mesh = !hasExtension(model_path, "bmesh");
+	const std::string cache_key = mesh_disk_cache ? MeshDiskCache::makeKey(lod_model_URL, build_dynamic_physics_ob) : std::string();
+
+	BatchedMeshRef batched_mesh;
+	PhysicsShape physics_shape;
+	const bool loaded_from_cache = mesh_disk_cache && mesh_disk_cache->tryLoad(cache_key, /*load_mesh=*/cache_mesh, batched_mesh, physics_shape);
+
+	if(batched_mesh.isNull())
+		batched_mesh = loadBatchedMeshForModelPath(model_path);
+
+	if(!loaded_from_cache)
+	{
+		physics_shape = PhysicsWorld::createJoltShapeForBatchedMesh(*batched_mesh, /*is dynamic=*/build_dynamic_physics_ob);
+
+		if(mesh_disk_cache)
+			mesh_disk_cache->store(cache_key, cache_mesh ? batched_mesh.ptr() : NULL, physics_shape);
+	}
+
 	Reference<OpenGLMeshRenderData> gl_meshdata = GLMeshBuilding::buildBatchedMesh(vert_buf_allocator, batched_mesh, /*skip opengl calls=*/skip_opengl_calls, /*instancing_matrix_data=*/NULL);
 
 	gl_meshdata->animation_data = batched_mesh->animation_data;
 
 	gl_meshdata->num_materials_referenced = batched_mesh->numMaterialsReferenced();
 
-	physics_shape_out = PhysicsWorld::createJoltShapeForBatchedMesh(*batched_mesh, /*is dynamic=*/build_dynamic_physics_ob);
+	physics_shape_out = physics_shape;
 
 	batched_mesh_out = batched_mesh;
 
@@ -21,6 +21,7 @@ class RayMesh;
 class PhysicsShape;
 class VoxelGroup;
 class VertexBufferAllocator;
+class MeshDiskCache;
 namespace Indigo { class TaskManager; }
 
 
@@ -83,9 +84,11 @@ public:
 
 
 	// Build a BatchedMesh and OpenGLMeshRenderData from a mesh on disk identified by lod_model_URL.  Also build a physics shape.
+	// If mesh_disk_cache is non-null, the processed mesh and physics shape are loaded from it if present, and stored in it otherwise.
 	static Reference<OpenGLMeshRenderData> makeGLMeshDataAndBatchedMeshForModelURL(const std::string& lod_model_URL,
 		ResourceManager& resource_manager, VertexBufferAllocator* vert_buf_allocator,
-		bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out);
+		bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out,
+		MeshDiskCache* mesh_disk_cache = NULL);
 
 	// Build OpenGLMeshRenderData from voxel data.  Also return a reference to an Indigo Mesh and physics shape.
 	static Reference<OpenGLMeshRenderData> makeModelForVoxelGroup(const VoxelGroup& voxel_group, int subsample_factor, const Matrix4f& ob_to_world, 
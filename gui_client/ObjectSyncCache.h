@@ -0,0 +1,39 @@
+/*=====================================================================
+ObjectSyncCache.h
+-----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/ObjectSyncDigest.h"
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <string>
+#include <vector>
+
+
+/*=====================================================================
+ObjectSyncCache
+---------------
+Copies of the objects the client had when it disconnected from a world.
+When reconnecting to the same world, the digest is sent with QueryObjectsInAABBIncremental,
+and the cached objects the server doesn't send again are inserted into the world state when
+IncrementalObjectSyncDone is received.  See server/IncrementalObjectSync.h
+
+Built by GUIClient::disconnectFromServerAndClearAllObjects(), then immutable, so can be shared with ClientThread.
+=====================================================================*/
+class ObjectSyncCache : public ThreadSafeRefCounted
+{
+public:
+	bool isForWorld(const std::string& server_hostname_, const std::string& world_name_) const { return server_hostname == server_hostname_ && world_name == world_name_; }
+
+	std::string server_hostname;
+	std::string world_name;
+
+	ObjectSyncDigest digest; // valid_time, and the UID and last_modified_time of each cached object, sorted by UID.
+	std::vector<size_t> ob_data_offsets; // Offset in ob_data of each object in digest.known_objects.
+	std::vector<uint8> ob_data; // Cached objects, written with WorldObject::writeToNetworkStream().
+};
+
+typedef Reference<ObjectSyncCache> ObjectSyncCacheRef;
@@ -8,24 +8,49 @@ Copyright Glare Technologies Limited 2023 -
 
 #include "PhysicsWorld.h"
 #include "TerrainDecalManager.h"
+#include <utils/TaskManager.h>
+#include <utils/Task.h>
 
 
-ParticleManager::ParticleManager(const std::string& base_dir_path_, OpenGLEngine* opengl_engine_, PhysicsWorld* physics_world_, TerrainDecalManager* terrain_decal_manager_)
-:	base_dir_path(base_dir_path_), opengl_engine(opengl_engine_), physics_world(physics_world_), terrain_decal_manager(terrain_decal_manager_)
+static const float AIR_DENSITY = 1.293f; // kg m^-3
+static const float DRAG_COEFFICIENT = 0.5f;
+
+
+ParticleManager::ParticleManager(const std::string& base_dir_path_, OpenGLEngine* opengl_engine_, PhysicsWorld* physics_world_, TerrainDecalManager* terrain_decal_manager_, 
+	size_t max_num_particles_)
+:	base_dir_path(base_dir_path_), opengl_engine(opengl_engine_), physics_world(physics_world_), terrain_decal_manager(terrain_decal_manager_),
+	water_buoyancy_enabled(false), water_z(0),
+	max_num_particles(max_num_particles_), num_particles(0)
 {
-	smoke_sprite_top	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_top.ktx2");
-	smoke_sprite_bottom = opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_bottom.ktx2");
-	smoke_sprite_left	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_left.ktx2");
-	smoke_sprite_right	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_right.ktx2");
-	smoke_sprite_rear	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_rear.ktx2");
-	smoke_sprite_front	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_front.ktx2");
-
-	foam_sprite_top	    = opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_top.ktx2");
-	foam_sprite_bottom  = opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_bottom.ktx2");
-	foam_sprite_left	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_left.ktx2");
-	foam_sprite_right	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_right.ktx2");
-	foam_sprite_rear	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_rear.ktx2");
-	foam_sprite_front	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_front.ktx2");
+	pos.resize(max_num_particles);
+	vel.resize(max_num_particles);
+	drag_factor.resize(max_num_particles);
+	restitution.resize(max_num_particles);
+	width.resize(max_num_particles);
+	dwidth_dt.resize(max_num_particles);
+	cur_opacity.resize(max_num_particles);
+	dopacity_dt.resize(max_num_particles);
+	theta.resize(max_num_particles);
+	die_when_hit_surface.resize(max_num_particles);
+	make_foam_decal.resize(max_num_particles);
+	gl_obs.resize(max_num_particles);
+
+	if(opengl_engine)
+	{
+		smoke_sprite_top	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_top.ktx2");
+		smoke_sprite_bottom = opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_bottom.ktx2");
+		smoke_sprite_left	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_left.ktx2");
+		smoke_sprite_right	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_right.ktx2");
+		smoke_sprite_rear	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_rear.ktx2");
+		smoke_sprite_front	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/smoke_sprite_front.ktx2");
+
+		foam_sprite_top	    = opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_top.ktx2");
+		foam_sprite_bottom  = opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_bottom.ktx2");
+		foam_sprite_left	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_left.ktx2");
+		foam_sprite_right	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_right.ktx2");
+		foam_sprite_rear	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_rear.ktx2");
+		foam_sprite_front	= opengl_engine->getTexture(base_dir_path + "/resources/sprites/foam_sprite_front.ktx2");
+	}
 }
 
 
@@ -37,44 +62,27 @@ ParticleManager::~ParticleManager()
 
 void ParticleManager::clear()
 {
-	for(size_t i=0; i<particles.size(); ++i)
+	for(size_t i=0; i<num_particles; ++i)
 	{
-		if(particles[i].gl_ob.nonNull())
-			opengl_engine->removeObject(particles[i].gl_ob);
+		if(gl_obs[i].nonNull())
+		{
+			opengl_engine->removeObject(gl_obs[i]);
+			gl_obs[i] = NULL;
+		}
 	}
-	particles.clear();
+	num_particles = 0;
 }
 
 
-void ParticleManager::addParticle(const Particle& particle_)
+GLObjectRef ParticleManager::makeGLObjectForParticle(const Particle& particle)
 {
-	// conPrint("addParticle, particles.size(): " + toString(particles.size()));
-
-	const size_t MAX_NUM_PARTICLES = 2048;
-
-	size_t use_index;
-	if(particles.size() >= MAX_NUM_PARTICLES) // If we have enough particles already:
-	{
-		use_index = rng.nextUInt((uint32)particles.size()); // Pick a random existing particle to replace
-
-		// Remove existing particle at this index
-		opengl_engine->removeObject(particles[use_index].gl_ob);
-	}
-	else
-	{
-		use_index = particles.size();
-		particles.resize(use_index + 1);
-	}
-
-
-	// Add gl ob
-	GLObjectRef ob = new GLObject();
+	GLObjectRef ob = opengl_engine->allocateObject();
 	ob->mesh_data = opengl_engine->getSpriteQuadMeshData();
 	ob->materials.resize(1);
-	ob->materials[0].albedo_linear_rgb = particle_.colour;
-	ob->materials[0].alpha = particle_.cur_opacity;
+	ob->materials[0].albedo_linear_rgb = particle.colour;
+	ob->materials[0].alpha = particle.cur_opacity;
 	ob->materials[0].participating_media = true;
-	if(particle_.particle_type == Particle::ParticleType_Smoke)
+	if(particle.particle_type == Particle::ParticleType_Smoke)
 	{
 		ob->materials[0].albedo_texture             = smoke_sprite_top;
 		ob->materials[0].metallic_roughness_texture = smoke_sprite_bottom;
@@ -83,7 +91,7 @@ void ParticleManager::addParticle(const Particle& particle_)
 		ob->materials[0].backface_albedo_texture    = smoke_sprite_rear;
 		ob->materials[0].transmission_texture       = smoke_sprite_front;
 	}
-	else if(particle_.particle_type == Particle::ParticleType_Foam)
+	else if(particle.particle_type == Particle::ParticleType_Foam)
 	{
 		ob->materials[0].albedo_texture             = foam_sprite_top;
 		ob->materials[0].metallic_roughness_texture = foam_sprite_bottom;
@@ -94,147 +102,359 @@ void ParticleManager::addParticle(const Particle& particle_)
 	}
 
 	ob->materials[0].materialise_start_time = opengl_engine->getCurrentTime(); // For participating media and decals: materialise_start_time = spawn time
-	ob->materials[0].materialise_upper_z = particle_.dopacity_dt; // For participating media and decals: materialise_upper_z = dopacity/dt
+	ob->materials[0].materialise_upper_z = particle.dopacity_dt; // For participating media and decals: materialise_upper_z = dopacity/dt
 
-	ob->ob_to_world_matrix = Matrix4f::translationMatrix(particle_.pos) * Matrix4f::uniformScaleMatrix(particle_.width);
-	ob->ob_to_world_matrix.e[1] = particle_.theta; // Since object-space vert positions are just (0,0,0) for particle geometry, we can store info in the model matrix.
+	ob->ob_to_world_matrix = Matrix4f::translationMatrix(particle.pos) * Matrix4f::uniformScaleMatrix(particle.width);
+	ob->ob_to_world_matrix.e[1] = particle.theta; // Since object-space vert positions are just (0,0,0) for particle geometry, we can store info in the model matrix.
 	opengl_engine->addObject(ob);
-
-	Particle particle = particle_;
-	particle.gl_ob = ob;
-
-	particles[use_index] = particle;
+	return ob;
 }
 
 
-void ParticleManager::think(const float dt)
+void ParticleManager::addParticle(const Particle& particle)
 {
-	//Timer timer;
+	// conPrint("addParticle, num_particles: " + toString(num_particles));
 
-	const bool water_buoyancy_enabled = physics_world->getWaterBuoyancyEnabled();
-	const float water_z = physics_world->getWaterZ();
+	if(max_num_particles == 0)
+		return;
 
-	for(size_t i=0; i<particles.size();)
+	size_t use_index;
+	if(num_particles >= max_num_particles) // If we have enough particles already:
 	{
-		Particle& particle = particles[i];
+		use_index = rng.nextUInt((uint32)num_particles); // Pick a random existing particle to replace
 
-		assert(particle.pos.isFinite());
+		// Remove existing particle at this index
+		if(gl_obs[use_index].nonNull())
+			opengl_engine->removeObject(gl_obs[use_index]);
+	}
+	else
+	{
+		use_index = num_particles;
+		num_particles++;
+	}
 
-		const Vec4f pos_delta = particle.vel * dt;
+	pos[use_index] = particle.pos;
+	vel[use_index] = particle.vel;
+	drag_factor[use_index] = 0.5f * AIR_DENSITY * DRAG_COEFFICIENT * particle.area / particle.mass;
+	restitution[use_index] = particle.restitution;
+	width[use_index] = particle.width;
+	dwidth_dt[use_index] = particle.dwidth_dt;
+	cur_opacity[use_index] = particle.cur_opacity;
+	dopacity_dt[use_index] = particle.dopacity_dt;
+	theta[use_index] = particle.theta;
+	die_when_hit_surface[use_index] = particle.die_when_hit_surface;
+	make_foam_decal[use_index] = 0;
+	gl_obs[use_index] = opengl_engine ? makeGLObjectForParticle(particle) : GLObjectRef();
+}
 
-		
-		RayTraceResult results;
-		results.hit_object = NULL;
-		//if(pos_delta.length2() > Maths::square(1.0e-3f))
-			physics_world->traceRay(particle.pos, particle.vel, dt, results);
 
-		float remaining_dt = dt;
-		if(results.hit_object)
+// Remove particle i by moving the last particle into its place.
+void ParticleManager::removeParticle(size_t i)
+{
+	if(gl_obs[i].nonNull())
+		opengl_engine->removeObject(gl_obs[i]);
+
+	const size_t last = num_particles - 1;
+	pos[i]                  = pos[last];
+	vel[i]                  = vel[last];
+	drag_factor[i]          = drag_factor[last];
+	restitution[i]          = restitution[last];
+	width[i]                = width[last];
+	dwidth_dt[i]            = dwidth_dt[last];
+	cur_opacity[i]          = cur_opacity[last];
+	dopacity_dt[i]          = dopacity_dt[last];
+	theta[i]                = theta[last];
+	die_when_hit_surface[i] = die_when_hit_surface[last];
+	make_foam_decal[i]      = make_foam_decal[last];
+	gl_obs[i]               = gl_obs[last];
+	gl_obs[last] = NULL;
+
+	num_particles--;
+}
+
+
+void ParticleManager::thinkBatch(size_t begin, size_t end, const float dt)
+{
+	RayTraceResult results[BATCH_SIZE];
+
+	for(size_t batch_begin = begin; batch_begin < end; batch_begin += BATCH_SIZE)
+	{
+		const size_t batch_end = myMin(batch_begin + BATCH_SIZE, end);
+
+		physics_world->traceRays(&pos[batch_begin], &vel[batch_begin], /*max_t=*/dt, batch_end - batch_begin, results);
+
+		for(size_t i=batch_begin; i<batch_end; ++i)
 		{
-			const float to_hit_dt = results.hit_t;
-			assert(to_hit_dt <= dt);
-			remaining_dt -= to_hit_dt;
+			const RayTraceResult& result = results[i - batch_begin];
 
-			const Vec4f hitpos = particle.pos + particle.vel * to_hit_dt;
+			Vec4f particle_pos = pos[i];
+			Vec4f particle_vel = vel[i];
 
-			// Reflect velocity vector in hit normal
-			particle.vel -= results.hit_normal_ws * (2 * dot(results.hit_normal_ws, particle.vel));
-			particle.vel *= particle.restitution; // Apply restitution factor for inelastic collisions.
+			assert(particle_pos.isFinite());
 
-			assert(particle.pos.isFinite());
-			assert(particle.vel.isFinite());
+			if(result.hit_object)
+			{
+				const float to_hit_dt = result.hit_t;
+				assert(to_hit_dt <= dt);
+				const float remaining_dt = dt - to_hit_dt;
 
-			particle.pos = hitpos + 
-				results.hit_normal_ws * 1.0e-3f + // nudge off surface
-				particle.vel * remaining_dt;
+				const Vec4f hitpos = particle_pos + particle_vel * to_hit_dt;
 
-			assert(particle.pos.isFinite());
-			assert(particle.vel.isFinite());
+				// Reflect velocity vector in hit normal
+				particle_vel -= result.hit_normal_ws * (2 * dot(result.hit_normal_ws, particle_vel));
+				particle_vel *= restitution[i]; // Apply restitution factor for inelastic collisions.
 
-			if(particle.die_when_hit_surface)
-				particle.cur_opacity = -1;
-		}
-		else
-		{
-			particle.pos += pos_delta;
+				particle_pos = hitpos + 
+					result.hit_normal_ws * 1.0e-3f + // nudge off surface
+					particle_vel * remaining_dt;
 
-			if(water_buoyancy_enabled && (particle.pos[2] < water_z))
+				if(die_when_hit_surface[i])
+					cur_opacity[i] = -1;
+			}
+			else
 			{
-				if(particle.die_when_hit_surface && (particle.vel[2] < 0)) // If should die when hit surface, and are moving downwards:
-				{
-					particle.cur_opacity = -1;
+				particle_pos += particle_vel * dt;
 
-					// Create foam decal at hit position
-					Vec4f foam_pos = particle.pos;
-					foam_pos[2] = water_z;
-					terrain_decal_manager->addFoamDecal(foam_pos, /*width=*/particle.width, /*opacity=*/1.f, TerrainDecalManager::DecalType_SparseFoam);
+				if(water_buoyancy_enabled && (particle_pos[2] < water_z))
+				{
+					if(die_when_hit_surface[i] && (particle_vel[2] < 0)) // If should die when hit surface, and are moving downwards:
+					{
+						cur_opacity[i] = -1;
+						make_foam_decal[i] = 1; // Create foam decal at hit position.  Done in think() as TerrainDecalManager isn't threadsafe.
+					}
+
+					// underwater
+					particle_vel[2] = myMax(particle_vel[2], 0.5f); // apply buoyancy in a hacky way while not limiting positive z velocity (e.g. for water spray shooting out of water)
 				}
+				else
+					particle_vel[2] -= 9.81f * dt; // Apply gravity
+			}
+
+			assert(particle_vel.isFinite());
+
+			// Apply wind-resistance drag force
+			const float v_mag2 = particle_vel.length2();
+			if(v_mag2 > Maths::square(1.0e-3f))
+			{
+				// ||a|| = F_d / m = 0.5 * rho * ||v||^2 * C_d * A / m = drag_factor * ||v||^2
+				const float accel_mag = myMin(10.f, drag_factor[i] * v_mag2);
 
-				// underwater
-				particle.vel[2] = myMax(particle.vel[2], 0.5f); // apply buoyancy in a hacky way while not limiting positive z velocity (e.g. for water spray shooting out of water)
+				// dvel = -vel/||vel|| * ||a|| * dt    = vel * (||a|| * dt / ||vel||)
+				// vel' = vel + dvel = vel - vel * (||a|| * dt / ||vel||)
+				// vel' = vel * (1 - (||a|| * dt / ||vel||))
+				particle_vel *= myMax(0.f, 1.f - accel_mag * dt / std::sqrt(v_mag2));
 			}
-			else
-				particle.vel[2] -= 9.81f * dt; // Apply gravity
-		}
 
-		assert(particle.vel.isFinite());
+			assert(particle_pos.isFinite());
+			assert(particle_vel.isFinite());
 
-		// Apply wind-resistance drag force
-		const float v_mag2 = particle.vel.length2();
-		if(v_mag2 > Maths::square(1.0e-3f))
-		{
-			// ||a|| = F_d rho * ||v||^2 C_d A / m
-
-			// dvel = -vel/||vel|| * ||a|| * dt    = vel * (||a|| * dt / ||v||)
-			// vel' = vel + devl = vel - vel * (||a|| * dt / ||v||)
-			// vel' = vel - vel * (F_d rho * ||v||^2 C_d A * dt / (m * ||v||))
-			// vel' = vel - vel * (F_d rho * ||v|| C_d A * dt / m)
-			// vel' = vel * (1 - F_d rho * ||v|| C_d A * dt / m)
-
-			const float rho = 1.293f; // air density, kg m^-3
-			const float projected_forwards_area = particle.area;
-			const float forwards_C_d = 0.5f; // drag coefficient
-			const float forwards_F_d = 0.5f * rho * v_mag2 * forwards_C_d * projected_forwards_area;
-			const float mass = particle.mass;
-			const float accel_mag = myMin(10.f, forwards_F_d / mass);
-
-			// dvel = -vel/||vel|| * ||a|| * dt    = vel * (||a|| * dt / ||vel||)
-			// vel' = vel + dvel = vel - vel * (||a|| * dt / ||vel||)
-			// vel' = vel * (1 - (||a|| * dt / ||vel||))
-			particle.vel *= myMax(0.f, 1.f - accel_mag * dt / std::sqrt(v_mag2));
-
-			assert(particle.vel.isFinite());
+			pos[i] = particle_pos;
+			vel[i] = particle_vel;
 		}
 
-		assert(particle.pos.isFinite());
-		assert(particle.vel.isFinite());
-		
-		particle.cur_opacity += particle.dopacity_dt * dt;
-		particle.width       += particle.dwidth_dt   * dt;
+		// These loops are simple enough for the compiler to vectorise.
+		for(size_t i=batch_begin; i<batch_end; ++i)
+			cur_opacity[i] += dopacity_dt[i] * dt;
+		for(size_t i=batch_begin; i<batch_end; ++i)
+			width[i] += dwidth_dt[i] * dt;
+	}
+}
+
+
+class ParticleThinkTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		particle_manager->thinkBatch(begin, end, dt);
+	}
+
+	ParticleManager* particle_manager;
+	size_t begin, end;
+	float dt;
+};
 
-		particle.gl_ob->ob_to_world_matrix = translationMulUniformScaleMatrix(/*translation=*/particle.pos, /*scale=*/particle.width);
-		particle.gl_ob->ob_to_world_matrix.e[1] = particle.theta; // Since object-space vert positions are just (0,0,0) for particle geometry, we can store info in the model matrix.
 
-		opengl_engine->updateObjectTransformData(*particle.gl_ob);
+void ParticleManager::think(const float dt, glare::TaskManager* task_manager)
+{
+	//Timer timer;
 
-		// NOTE: changing alpha directly in shader based on particle lifetime now.
-		//particle.gl_ob->materials[0].alpha = particle.cur_opacity;
-		//opengl_engine->updateAllMaterialDataOnGPU(*particle.gl_ob); // Since opacity changed.
+	water_buoyancy_enabled = physics_world->getWaterBuoyancyEnabled();
+	water_z = physics_world->getWaterZ();
 
-		if(particle.cur_opacity <= 0)
+	if(task_manager && (num_particles >= MIN_NUM_PARTICLES_FOR_PARALLEL_THINK))
+	{
+		// Split the particles into one contiguous range of whole batches per task.
+		const size_t num_batches = Maths::roundedUpDivide(num_particles, BATCH_SIZE);
+		const size_t num_tasks = myMin(num_batches, (size_t)64);
+		const size_t batches_per_task = Maths::roundedUpDivide(num_batches, num_tasks);
+		while(tasks.size() < num_tasks)
+			tasks.push_back(new ParticleThinkTask());
+
+		for(size_t t=0; t<num_tasks; ++t)
+		{
+			tasks[t]->particle_manager = this;
+			tasks[t]->begin = myMin(t * batches_per_task * BATCH_SIZE, num_particles);
+			tasks[t]->end = myMin((t + 1) * batches_per_task * BATCH_SIZE, num_particles);
+			tasks[t]->dt = dt;
+			task_manager->addTask(tasks[t]);
+		}
+
+		task_manager->waitForTasksToComplete();
+	}
+	else
+		thinkBatch(0, num_particles, dt);
+
+	// Make foam decals, update OpenGL objects and remove dead particles.
+	for(size_t i=0; i<num_particles;)
+	{
+		if(make_foam_decal[i])
+		{
+			make_foam_decal[i] = 0;
+			Vec4f foam_pos = pos[i];
+			foam_pos[2] = water_z;
+			if(terrain_decal_manager)
+				terrain_decal_manager->addFoamDecal(foam_pos, /*width=*/width[i], /*opacity=*/1.f, TerrainDecalManager::DecalType_SparseFoam);
+		}
+
+		if(cur_opacity[i] <= 0)
 		{
 			//conPrint("removed particle");
-			opengl_engine->removeObject(particle.gl_ob);
+			removeParticle(i);
 
-			// Remove particle: swap with last particle in array
-			mySwap(particle, particles.back());
-			particles.pop_back(); // Now remove last array element.
-			
 			// Don't increment i as we there is a new particle in position i that we want to process.
 		}
 		else
+		{
+			GLObject* gl_ob = gl_obs[i].ptr();
+			if(gl_ob)
+			{
+				gl_ob->ob_to_world_matrix = translationMulUniformScaleMatrix(/*translation=*/pos[i], /*scale=*/width[i]);
+				gl_ob->ob_to_world_matrix.e[1] = theta[i]; // Since object-space vert positions are just (0,0,0) for particle geometry, we can store info in the model matrix.
+
+				opengl_engine->updateObjectTransformData(*gl_ob);
+
+				// NOTE: changing alpha directly in shader based on particle lifetime now.
+				//gl_ob->materials[0].alpha = cur_opacity[i];
+				//opengl_engine->updateAllMaterialDataOnGPU(*gl_ob); // Since opacity changed.
+			}
 			++i;
+		}
 	}
 
-	//conPrint("ParticleManager::think() took " + timer.elapsedStringMSWIthNSigFigs(4) + " for " + toString(particles.size()) + " particles.");
+	//conPrint("ParticleManager::think() took " + timer.elapsedStringMSWIthNSigFigs(4) + " for " + toString(num_particles) + " particles.");
 }
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+
+
+// Benchmarks think() for 100k particles over a static scene of a ground box and some obstacles, without an OpenGL engine.
+void ParticleManager::test()
+{
+	conPrint("ParticleManager::test()");
+
+	// PhysicsWorld::init() needs to have been called already.
+
+	try
+	{
+		Reference<PhysicsWorld> physics_world = new PhysicsWorld();
+
+		// Make static scene
+		std::vector<Reference<PhysicsObject> > physics_obs;
+		{
+			const float ground_w = 200.f;
+			Reference<PhysicsObject> ground_ob = new PhysicsObject(/*collidable=*/true);
+			ground_ob->shape = PhysicsWorld::createGroundQuadShape(ground_w);
+			ground_ob->pos = Vec4f(0, 0, -0.5f, 1); // Top of ground box is at z = 0.
+			ground_ob->rot = Quatf::identity();
+			ground_ob->scale = Vec3f(1.f);
+			physics_world->addObject(ground_ob);
+			physics_obs.push_back(ground_ob);
+
+			const PhysicsShape box_shape = PhysicsWorld::createGroundQuadShape(1.f); // 1 x 1 x 1 box
+			PCG32 scene_rng(1);
+			for(int i=0; i<64; ++i)
+			{
+				Reference<PhysicsObject> box_ob = new PhysicsObject(/*collidable=*/true);
+				box_ob->shape = box_shape;
+				box_ob->pos = Vec4f(-20 + scene_rng.unitRandom() * 40, -20 + scene_rng.unitRandom() * 40, scene_rng.unitRandom() * 5, 1);
+				box_ob->rot = Quatf::fromAxisAndAngle(Vec4f(0, 0, 1, 0), scene_rng.unitRandom() * Maths::get2Pi<float>());
+				box_ob->scale = Vec3f(1 + scene_rng.unitRandom() * 4, 1 + scene_rng.unitRandom() * 4, 1 + scene_rng.unitRandom() * 2);
+				physics_world->addObject(box_ob);
+				physics_obs.push_back(box_ob);
+			}
+		}
+
+		const size_t N = 100000;
+		const float dt = 1.f / 60;
+		const int num_frames = 20;
+
+		glare::TaskManager task_manager("ParticleManager::test task manager", myClamp<size_t>(PlatformUtils::getNumLogicalProcessors(), 1, 16));
+
+		for(int use_task_manager=0; use_task_manager<2; ++use_task_manager)
+		{
+			Reference<ParticleManager> particle_manager = new ParticleManager(/*base_dir_path=*/"", /*opengl_engine=*/NULL, physics_world.ptr(), /*terrain_decal_manager=*/NULL, /*max_num_particles=*/N);
+
+			PCG32 rng_(1);
+			for(size_t i=0; i<N; ++i)
+			{
+				Particle particle;
+				particle.pos = Vec4f(-20 + rng_.unitRandom() * 40, -20 + rng_.unitRandom() * 40, 1 + rng_.unitRandom() * 10, 1);
+				particle.vel = Vec4f(-5 + rng_.unitRandom() * 10, -5 + rng_.unitRandom() * 10, -5 + rng_.unitRandom() * 10, 0);
+				particle.dopacity_dt = -0.1f; // Live for 10 s, so no particles die during the benchmark.
+				particle.die_when_hit_surface = (i % 4) == 0;
+				particle_manager->addParticle(particle);
+			}
+			testAssert(particle_manager->numParticles() == N);
+
+			// Adding more particles than the max should replace existing particles.
+			particle_manager->addParticle(Particle());
+			testAssert(particle_manager->numParticles() == N);
+
+			double total_time = 0;
+			double min_time = 1.0e10;
+			for(int f=0; f<num_frames; ++f)
+			{
+				Timer timer;
+				particle_manager->think(dt, use_task_manager ? &task_manager : NULL);
+				const double elapsed = timer.elapsed();
+				total_time += elapsed;
+				min_time = myMin(min_time, elapsed);
+			}
+
+			// Particles that die when hitting a surface should have been removed, but most should remain.
+			testAssert(particle_manager->numParticles() > N / 2);
+			testAssert(particle_manager->numParticles() <= N);
+			for(size_t i=0; i<particle_manager->numParticles(); ++i)
+			{
+				testAssert(particle_manager->pos[i].isFinite());
+				testAssert(particle_manager->vel[i].isFinite());
+				testAssert(particle_manager->pos[i][2] > -1.f); // Particles shouldn't have fallen through the ground.
+			}
+
+			conPrint(std::string(use_task_manager ? "parallel" : "serial  ") + " think() for " + toString(N) + " particles: mean " + 
+				doubleToStringNSigFigs(total_time / num_frames * 1.0e3, 4) + " ms, min " + doubleToStringNSigFigs(min_time * 1.0e3, 4) + " ms, " + 
+				toString(particle_manager->numParticles()) + " particles remaining");
+		}
+
+		for(size_t i=0; i<physics_obs.size(); ++i)
+			physics_world->removeObject(physics_obs[i]);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ParticleManager::test() done");
+}
+
+
+#endif // BUILD_TESTS
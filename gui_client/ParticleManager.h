@@ -13,12 +13,16 @@ Copyright Glare Technologies Limited 2023 -
 #include <maths/PCG32.h>
 #include <utils/RefCounted.h>
 #include <utils/Reference.h>
+#include <utils/Vector.h>
+#include <vector>
 class OpenGLShader;
 class OpenGLMeshRenderData;
 class VertexBufferAllocator;
 class PhysicsWorld;
 class BiomeManager;
 class TerrainDecalManager;
+class ParticleThinkTask;
+namespace glare { class TaskManager; }
 
 
 struct Particle
@@ -37,8 +41,6 @@ struct Particle
 	Vec4f pos;
 	Vec4f vel;
 
-	GLObjectRef gl_ob;
-
 	Colour3f colour;
 
 	float area; // particle cross-sectional area (m^2).  Larger area = more wind drag.  TODO: just store ratio of area to mass?
@@ -65,28 +67,75 @@ ParticleManager
 The basic idea is to simulate point particles with ray-traced collisions, and a simple physics model with 
 bouncing off surfaces and with wind resistance.
 See https://github.com/jrouwe/JoltPhysics/discussions/756 for a discussion of the approach.
+
+Particle state is stored in structure-of-arrays form, in arrays allocated for max_num_particles up front.
+Live particles are kept at the start of the arrays.
+
+think() processes particles in batches of BATCH_SIZE.  Each batch does one broad-phase query for the rays of all its
+particles (see PhysicsWorld::traceRays()), then integrates the particles.  Batches are processed in parallel on the task manager
+when there are enough particles.  Decal creation, OpenGL updates and particle removal are done afterwards on the calling thread.
+
+opengl_engine may be null, in which case no OpenGL objects are made, e.g. for benchmarking.
 =====================================================================*/
 class ParticleManager : public RefCounted
 {
 public:
 	GLARE_ALIGNED_16_NEW_DELETE
 
-	ParticleManager(const std::string& base_dir_path, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, TerrainDecalManager* terrain_decal_manager);
+	ParticleManager(const std::string& base_dir_path, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, TerrainDecalManager* terrain_decal_manager, 
+		size_t max_num_particles = DEFAULT_MAX_NUM_PARTICLES);
 	~ParticleManager();
 
+	static const size_t DEFAULT_MAX_NUM_PARTICLES = 2048;
+	static const size_t BATCH_SIZE = 64;
+	static const size_t MIN_NUM_PARTICLES_FOR_PARALLEL_THINK = 512;
+
 	void clear();
 
 	void addParticle(const Particle& particle);
 
-	void think(float dt);
+	// task_manager may be null, in which case all the work is done on the calling thread.
+	void think(float dt, glare::TaskManager* task_manager);
+
+	size_t numParticles() const { return num_particles; }
+
+	static void test();
+
+	// Processes particles [begin, end).  Used by ParticleThinkTask.
+	void thinkBatch(size_t begin, size_t end, float dt);
 
 private:
+	GLARE_DISABLE_COPY(ParticleManager)
+
+	void removeParticle(size_t i);
+	GLObjectRef makeGLObjectForParticle(const Particle& particle);
+
 	std::string base_dir_path;
 	OpenGLEngine* opengl_engine;
 	PhysicsWorld* physics_world;
 	TerrainDecalManager* terrain_decal_manager;
 	PCG32 rng;
-	std::vector<Particle> particles;
+
+	bool water_buoyancy_enabled; // Copied from physics_world at the start of think().
+	float water_z;
+
+	// Particle state
+	size_t max_num_particles;
+	size_t num_particles;
+	js::Vector<Vec4f, 16> pos;
+	js::Vector<Vec4f, 16> vel;
+	js::Vector<float, 16> drag_factor; // 0.5 * air density * drag coefficient * area / mass
+	js::Vector<float, 16> restitution;
+	js::Vector<float, 16> width;
+	js::Vector<float, 16> dwidth_dt;
+	js::Vector<float, 16> cur_opacity;
+	js::Vector<float, 16> dopacity_dt;
+	js::Vector<float, 16> theta;
+	js::Vector<uint8, 16> die_when_hit_surface;
+	js::Vector<uint8, 16> make_foam_decal; // Set by thinkBatch() when the particle hit the water surface and should make a foam decal.
+	std::vector<GLObjectRef> gl_obs;
+
+	std::vector<Reference<ParticleThinkTask> > tasks;
 
 	Reference<OpenGLTexture> smoke_sprite_top;
 	Reference<OpenGLTexture> smoke_sprite_bottom;
@@ -44,6 +44,7 @@ Copyright Glare Technologies Limited 2022 -
 #include <Jolt/Physics/Body/BodyActivationListener.h>
 #include <Jolt/Physics/Collision/Shape/MeshShape.h>
 #include <Jolt/Physics/Collision/BroadPhase/BroadPhaseQuery.h>
+#include <Jolt/Physics/Collision/CollisionCollectorImpl.h>
 #include <Jolt/Physics/Collision/RayCast.h>
 #include <Jolt/Physics/Collision/CastResult.h>
 #include <Jolt/Physics/Collision/Shape/OffsetCenterOfMassShape.h>
@@ -165,6 +166,34 @@ class MyObjectLayerPairFilter : public JPH::ObjectLayerPairFilter
 };
 
 
+// Just store the original material index, so we can recover it in traceRay().
+class SubstrataPhysicsMaterial : public JPH::PhysicsMaterial
+{
+public:
+	//JPH_DECLARE_SERIALIZABLE_VIRTUAL(SubstrataPhysicsMaterial)   // NOTE: need this?
+
+	SubstrataPhysicsMaterial(uint32 index_) : index(index_) {}
+
+	virtual const char *					GetDebugName() const override		{ return "SubstrataPhysicsMaterial"; }
+
+	// See: PhysicsMaterial::SaveBinaryState
+	//virtual void							SaveBinaryState(StreamOut &inStream) const override;
+
+protected:
+	// See: PhysicsMaterial::RestoreBinaryState
+	//virtual void							RestoreBinaryState(StreamIn &inStream) override;
+
+public:
+	uint32 index;
+};
+
+
+// Material i has index i.  Mesh shapes share these materials, instead of each shape having its own, so that when serialising shapes
+// the materials can be referred to by index, see writeShapeToBuffer().  Created in init().
+static const uint32 MAX_NUM_PHYSICS_MATERIALS = 32; // Jolt has a maximum of 32 materials per mesh
+static JPH::PhysicsMaterialList shared_physics_materials;
+
+
 #endif // USE_JOLT
 
 
@@ -183,6 +212,13 @@ void PhysicsWorld::init()
 
 	// Register all Jolt physics types
 	JPH::RegisterTypes();
+
+	if(shared_physics_materials.empty())
+	{
+		shared_physics_materials.resize(MAX_NUM_PHYSICS_MATERIALS);
+		for(uint32 i = 0; i < MAX_NUM_PHYSICS_MATERIALS; ++i)
+			shared_physics_materials[i] = new SubstrataPhysicsMaterial(i);
+	}
 #endif
 }
 
@@ -513,28 +549,6 @@ void PhysicsWorld::moveKinematicObject(PhysicsObject& object, const Vec4f& trans
 }
 
 
-// Just store the original material index, so we can recover it in traceRay().
-class SubstrataPhysicsMaterial : public JPH::PhysicsMaterial
-{
-public:
-	//JPH_DECLARE_SERIALIZABLE_VIRTUAL(SubstrataPhysicsMaterial)   // NOTE: need this?
-
-	SubstrataPhysicsMaterial(uint32 index_) : index(index_) {}
-
-	virtual const char *					GetDebugName() const override		{ return "SubstrataPhysicsMaterial"; }
-
-	// See: PhysicsMaterial::SaveBinaryState
-	//virtual void							SaveBinaryState(StreamOut &inStream) const override;
-
-protected:
-	// See: PhysicsMaterial::RestoreBinaryState
-	//virtual void							RestoreBinaryState(StreamIn &inStream) override;
-
-public:
-	uint32 index;
-};
-
-
 static size_t computeSizeBForShape(JPH::Ref<JPH::Shape> jolt_shape)
 {
 	JPH::Shape::VisitedShapes visited_shapes; // Jolt uses this to make sure it doesn't double-count sub-shapes.
@@ -611,7 +625,7 @@ PhysicsShape PhysicsWorld::createJoltShapeForIndigoMesh(const Indigo::Mesh& mesh
 		const uint32 use_num_mats = myMin(32u, mesh.num_materials_referenced); // Jolt has a maximum of 32 materials per mesh
 		JPH::PhysicsMaterialList materials(use_num_mats);
 		for(uint32 i = 0; i < use_num_mats; ++i)
-			materials[i] = new SubstrataPhysicsMaterial(i);
+			materials[i] = shared_physics_materials[i];
 	
 		JPH::Ref<JPH::MeshShapeSettings> mesh_body_settings = new JPH::MeshShapeSettings(vertex_list, tri_list, materials);
 		JPH::Result<JPH::Ref<JPH::Shape>> result = mesh_body_settings->Create();
@@ -861,7 +875,7 @@ PhysicsShape PhysicsWorld::createJoltShapeForBatchedMesh(const BatchedMesh& mesh
 		const uint32 use_num_mats = myMin(32u, (uint32)mesh.numMaterialsReferenced());
 		JPH::PhysicsMaterialList materials(use_num_mats);
 		for(uint32 i = 0; i < use_num_mats; ++i)
-			materials[i] = new SubstrataPhysicsMaterial(i);
+			materials[i] = shared_physics_materials[i];
 
 		JPH::Ref<JPH::MeshShapeSettings> mesh_body_settings = new JPH::MeshShapeSettings(vertex_list, tri_list, materials);
 		JPH::Result<JPH::Ref<JPH::Shape>> result = mesh_body_settings->Create();
@@ -945,6 +959,92 @@ PhysicsShape PhysicsWorld::createCOMOffsetShapeForShape(const PhysicsShape& orig
 }
 
 
+class PhysicsShapeBufferStreamOut : public JPH::StreamOut
+{
+public:
+	PhysicsShapeBufferStreamOut(js::Vector<uint8, 16>& buffer_) : buffer(buffer_) {}
+
+	virtual void WriteBytes(const void* data, size_t num_bytes) override
+	{
+		const size_t write_i = buffer.size();
+		buffer.resize(write_i + num_bytes);
+		std::memcpy(buffer.data() + write_i, data, num_bytes);
+	}
+
+	virtual bool IsFailed() const override { return false; }
+
+	js::Vector<uint8, 16>& buffer;
+};
+
+
+class PhysicsShapeBufferStreamIn : public JPH::StreamIn
+{
+public:
+	PhysicsShapeBufferStreamIn(const uint8* data_, size_t data_size_) : data(data_), data_size(data_size_), read_i(0), failed(false) {}
+
+	virtual void ReadBytes(void* dest, size_t num_bytes) override
+	{
+		if(failed || (num_bytes > data_size - read_i))
+		{
+			failed = true;
+			std::memset(dest, 0, num_bytes);
+			return;
+		}
+		std::memcpy(dest, data + read_i, num_bytes);
+		read_i += num_bytes;
+	}
+
+	// Like std::istream, EOF is only set after trying to read past the end.  Jolt checks it after the last read.
+	virtual bool IsEOF() const override { return failed; }
+	virtual bool IsFailed() const override { return failed; }
+
+	const uint8* data;
+	size_t data_size;
+	size_t read_i;
+	bool failed;
+};
+
+
+// Pre-populate the material maps with the shared materials, so that Jolt writes just the material index for them, instead of trying to serialise them.
+void PhysicsWorld::writeShapeToBuffer(const PhysicsShape& shape, js::Vector<uint8, 16>& buffer_out)
+{
+	assert(shared_physics_materials.size() == MAX_NUM_PHYSICS_MATERIALS);
+
+	JPH::Shape::ShapeToIDMap shape_map;
+	JPH::Shape::MaterialToIDMap material_map;
+	for(uint32 i = 0; i < (uint32)shared_physics_materials.size(); ++i)
+		material_map[shared_physics_materials[i].GetPtr()] = i;
+
+	buffer_out.clear();
+	PhysicsShapeBufferStreamOut stream(buffer_out);
+	shape.jolt_shape->SaveWithChildren(stream, shape_map, material_map);
+
+	if(material_map.size() != shared_physics_materials.size())
+		throw glare::Exception("Shape has materials that can't be serialised");
+}
+
+
+PhysicsShape PhysicsWorld::readShapeFromBuffer(const uint8* data, size_t data_size)
+{
+	assert(shared_physics_materials.size() == MAX_NUM_PHYSICS_MATERIALS);
+
+	JPH::Shape::IDToShapeMap shape_map;
+	JPH::Shape::IDToMaterialMap material_map(shared_physics_materials.begin(), shared_physics_materials.end());
+
+	PhysicsShapeBufferStreamIn stream(data, data_size);
+	JPH::Shape::ShapeResult result = JPH::Shape::sRestoreWithChildren(stream, shape_map, material_map);
+	if(result.HasError())
+		throw glare::Exception(std::string("Error reading Jolt shape: ") + result.GetError().c_str());
+	if(stream.IsFailed() || (material_map.size() != shared_physics_materials.size()))
+		throw glare::Exception("Error reading Jolt shape: invalid data");
+
+	PhysicsShape shape;
+	shape.jolt_shape = result.Get();
+	shape.size_B = computeSizeBForShape(shape.jolt_shape);
+	return shape;
+}
+
+
 void PhysicsWorld::addObject(const Reference<PhysicsObject>& object)
 {
 	assert(object->pos.isFinite());
@@ -1379,6 +1479,77 @@ void PhysicsWorld::traceRay(const Vec4f& origin, const Vec4f& dir, float max_t,
 }
 
 
+void PhysicsWorld::traceRays(const Vec4f* origins, const Vec4f* dirs, float max_t, size_t num_rays, RayTraceResult* results_out) const
+{
+	if(num_rays == 0)
+		return;
+
+	// Compute bounding box of all the ray segments.
+	Vec4f min_p = origins[0];
+	Vec4f max_p = origins[0];
+	for(size_t i=0; i<num_rays; ++i)
+	{
+		const Vec4f end = origins[i] + dirs[i] * max_t;
+		min_p = min(min_p, min(origins[i], end));
+		max_p = max(max_p, max(origins[i], end));
+	}
+
+	JPH::AllHitCollisionCollector<JPH::CollideShapeBodyCollector> collector;
+	physics_system->GetBroadPhaseQuery().CollideAABox(JPH::AABox(toJoltVec3(min_p), toJoltVec3(max_p)), collector);
+
+	// If the rays are near a lot of bodies, the broad phase is more useful, so just trace each ray separately.
+	const size_t MAX_NUM_CANDIDATE_BODIES = 16;
+	if(collector.mHits.size() > MAX_NUM_CANDIDATE_BODIES)
+	{
+		for(size_t i=0; i<num_rays; ++i)
+			traceRay(origins[i], dirs[i], max_t, results_out[i]);
+		return;
+	}
+
+	JPH::TransformedShape candidate_shapes[MAX_NUM_CANDIDATE_BODIES];
+	PhysicsObject* candidate_obs[MAX_NUM_CANDIDATE_BODIES];
+	size_t num_candidates = 0;
+	const JPH::BodyInterface& body_interface = physics_system->GetBodyInterface();
+	for(size_t z=0; z<collector.mHits.size(); ++z)
+	{
+		candidate_shapes[num_candidates] = body_interface.GetTransformedShape(collector.mHits[z]);
+		if(candidate_shapes[num_candidates].mShape == nullptr) // If body was removed:
+			continue;
+		candidate_obs[num_candidates] = (PhysicsObject*)body_interface.GetUserData(collector.mHits[z]);
+		num_candidates++;
+	}
+
+	for(size_t i=0; i<num_rays; ++i)
+	{
+		RayTraceResult& results = results_out[i];
+		results.hit_object = NULL;
+
+		if(num_candidates == 0)
+			continue;
+
+		const JPH::RRayCast ray(toJoltVec3(origins[i]), toJoltVec3(dirs[i] * max_t));
+		JPH::RayCastResult hit_result; // Initialised with mFraction > 1.  Each cast only updates it if it finds a closer hit.
+		size_t hit_candidate = num_candidates;
+		for(size_t z=0; z<num_candidates; ++z)
+			if(candidate_shapes[z].CastRay(ray, hit_result))
+				hit_candidate = z;
+
+		// As in traceRay(), a hit on a body without a PhysicsObject is treated as a miss.
+		if(hit_candidate < num_candidates && candidate_obs[hit_candidate])
+		{
+			const JPH::TransformedShape& shape = candidate_shapes[hit_candidate];
+			results.hit_object = candidate_obs[hit_candidate];
+			results.coords = Vec2f(0.f);
+			results.hit_t = hit_result.mFraction * max_t;
+			results.hit_normal_ws = toVec4fVec(shape.GetWorldSpaceSurfaceNormal(hit_result.mSubShapeID2, ray.GetPointOnRay(hit_result.mFraction)));
+
+			const SubstrataPhysicsMaterial* submat = dynamic_cast<const SubstrataPhysicsMaterial*>(shape.GetMaterial(hit_result.mSubShapeID2));
+			results.hit_mat_index = submat ? submat->index : 0;
+		}
+	}
+}
+
+
 bool PhysicsWorld::doesRayHitAnything(const Vec4f& origin, const Vec4f& dir, float max_t) const
 {
 	const JPH::RRayCast ray(toJoltVec3(origin), toJoltVec3(dir * max_t));
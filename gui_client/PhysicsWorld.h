@@ -126,6 +126,11 @@ public:
 
 	static PhysicsShape createCOMOffsetShapeForShape(const PhysicsShape& shape, const Vec4f& COM_offset);
 
+	// Serialise a shape with Jolt's binary state saving, for MeshDiskCache.  Only mesh shapes made by createJoltShapeForIndigoMesh()
+	// and createJoltShapeForBatchedMesh() and their sub-shapes are supported.  init() must have been called.
+	static void writeShapeToBuffer(const PhysicsShape& shape, js::Vector<uint8, 16>& buffer_out);
+	static PhysicsShape readShapeFromBuffer(const uint8* data, size_t data_size); // Throws glare::Exception on failure.
+
 	void think(double dt);
 
 #if USE_JOLT
@@ -169,6 +174,12 @@ public:
 
 	bool doesRayHitAnything(const Vec4f& origin, const Vec4f& dir, float max_t) const;
 
+	// Traces num_rays rays with the same max_t.  Gives the same results as calling traceRay() for each ray.
+	// Does a single broad-phase query with the bounding box of all the ray segments, then casts the rays directly against the bodies found,
+	// instead of each ray doing its own broad-phase traversal.  So should be used with batches of nearby rays.
+	// Can be called from multiple threads at once, but not while think() is running.
+	void traceRays(const Vec4f* origins, const Vec4f* dirs, float max_t, size_t num_rays, RayTraceResult* results_out) const;
+
 	void writeJoltSnapshotToDisk(const std::string& path);
 
 	static void test();
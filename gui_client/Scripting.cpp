@@ -15,6 +15,8 @@ Copyright Glare Technologies Limited 2022 -
 #include <opengl/OpenGLEngine.h>
 #include <utils/Timer.h>
 #include <utils/Lock.h>
+#include <utils/TaskManager.h>
+#include <utils/Task.h>
 #include <utils/IndigoXMLDoc.h>
 #include <utils/Parser.h>
 #include <utils/XMLParseUtils.h>
@@ -402,73 +404,142 @@ void evalObjectScript(WorldObject* ob, float use_global_time, double dt, OpenGLE
 }
 
 
-void evalObjectInstanceScript(InstanceInfo* ob, float use_global_time, double dt, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, Matrix4f& ob_to_world_out)
+// Evaluates the scripts for instances [begin, end) of ob, and builds their object-to-world matrices into ob->instance_matrices.
+// Doesn't update physics objects, as this may be run on a task manager thread, see BatchedScriptEvaluator::evaluateObjectScripts().
+// The script results are written to the rotations and translations arrays first, so the loop calling the jitted script functions is kept
+// separate from the loop building the matrices with SSE.
+static void evalInstanceScriptBatch(WorldObject* ob, size_t begin, size_t end, float use_global_time, const js::AABBox& aabb_os,
+	js::Vector<Vec4f, 16>& rotations, js::Vector<Vec4f, 16>& translations, js::AABBox& aabb_ws_out)
 {
-	CybWinterEnv winter_env;
-	winter_env.instance_index = ob->instance_index;
-	winter_env.num_instances = ob->num_instances;
+	const size_t num = end - begin;
+	rotations.resizeNoCopy(num);
+	translations.resizeNoCopy(num);
+
+	InstanceInfo* const instances = ob->instances.data() + begin;
 
 #if !defined(EMSCRIPTEN)
-	if(ob->script_evaluator->jitted_evalRotation)
+	for(size_t i=0; i<num; ++i)
 	{
-		const Vec4f rot = ob->script_evaluator->evalRotation(use_global_time, winter_env);
-		ob->angle = rot.length();
-		if(isFinite(ob->angle))
+		InstanceInfo* instance = &instances[i];
+		WinterShaderEvaluator* script_evaluator = instance->script_evaluator.ptr();
+
+		CybWinterEnv winter_env;
+		winter_env.instance_index = instance->instance_index;
+		winter_env.num_instances = instance->num_instances;
+
+		if(script_evaluator->jitted_evalRotation)
+			rotations[i] = script_evaluator->evalRotation(use_global_time, winter_env);
+		else
+			rotations[i] = Vec4f(instance->axis.x, instance->axis.y, instance->axis.z, 0) * instance->angle;
+
+		if(script_evaluator->jitted_evalTranslation)
 		{
-			if(ob->angle > 0)
-				ob->axis = Vec3f(normalise(rot));
-			else
-				ob->axis = Vec3f(1, 0, 0);
+			if(instance->prototype_object)
+				instance->pos = instance->prototype_object->pos;
+			translations[i] = script_evaluator->evalTranslation(use_global_time, winter_env);
 		}
 		else
+			translations[i] = instance->translation;
+	}
+#else
+	for(size_t i=0; i<num; ++i)
+	{
+		rotations[i]    = Vec4f(instances[i].axis.x, instances[i].axis.y, instances[i].axis.z, 0) * instances[i].angle;
+		translations[i] = instances[i].translation;
+	}
+#endif
+
+	js::AABBox aabb_ws = js::AABBox::emptyAABBox();
+	Matrix4f* const instance_matrices = ob->instance_matrices.data() + begin;
+	for(size_t i=0; i<num; ++i)
+	{
+		InstanceInfo* instance = &instances[i];
+
+		const Vec4f rot = rotations[i];
+		const float angle = rot.length();
+		if(isFinite(angle) && angle > 0)
 		{
-			ob->angle = 0;
-			ob->axis = Vec3f(1, 0, 0);
+			instance->angle = angle;
+			instance->axis = Vec3f(normalise(rot));
+		}
+		else
+		{
+			instance->angle = 0;
+			instance->axis = Vec3f(1, 0, 0);
 		}
+
+		instance->translation = translations[i];
+
+		// Compute object-to-world matrix, similarly to obToWorldMatrix().
+		const Vec4f translation = Vec4f((float)instance->pos.x, (float)instance->pos.y, (float)instance->pos.z, 1.f) + translations[i];
+
+		// Don't use a zero scale component, because it makes the matrix uninvertible, which breaks various things, including picking and normals.
+		Vec4f use_scale = instance->scale.toVec4fVector();
+		if(use_scale[0] == 0) use_scale[0] = 1.0e-6f;
+		if(use_scale[1] == 0) use_scale[1] = 1.0e-6f;
+		if(use_scale[2] == 0) use_scale[2] = 1.0e-6f;
+
+		const Matrix4f rot_matrix = Matrix4f::rotationMatrix(instance->axis.toVec4fVector(), instance->angle);
+		Matrix4f& ob_to_world = instance_matrices[i];
+		ob_to_world.setColumn(0, rot_matrix.getColumn(0) * use_scale[0]);
+		ob_to_world.setColumn(1, rot_matrix.getColumn(1) * use_scale[1]);
+		ob_to_world.setColumn(2, rot_matrix.getColumn(2) * use_scale[2]);
+		ob_to_world.setColumn(3, translation);
+
+		aabb_ws.enlargeToHoldAABBox(aabb_os.transformedAABBFast(ob_to_world));
 	}
 
-	if(ob->script_evaluator->jitted_evalTranslation)
+	aabb_ws_out = aabb_ws;
+}
+
+
+class EvalInstanceScriptsTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
 	{
-		if(ob->prototype_object)
-			ob->pos = ob->prototype_object->pos;
-		ob->translation = ob->script_evaluator->evalTranslation(use_global_time, winter_env);
+		Timer timer;
+		for(size_t i=begin; i<end; ++i)
+		{
+			BatchedScriptEvaluator::InstanceBatch& batch = (*batches)[i];
+			evalInstanceScriptBatch(batch.ob, batch.begin, batch.end, use_global_time, batch.ob->opengl_engine_ob->mesh_data->aabb_os, rotations, translations, batch.aabb_ws);
+		}
+		elapsed_time = timer.elapsed();
 	}
-#endif
 
-	// Compute object-to-world matrix, similarly to obToWorldMatrix().  Do it here so we can reuse some components of the computation.
-	const Vec4f pos((float)ob->pos.x, (float)ob->pos.y, (float)ob->pos.z, 1.f);
-	const Vec4f translation = pos + ob->translation;
+	js::Vector<BatchedScriptEvaluator::InstanceBatch, 16>* batches;
+	size_t begin, end;
+	float use_global_time;
 
-	// Don't use a zero scale component, because it makes the matrix uninvertible, which breaks various things, including picking and normals.
-	Vec4f use_scale = ob->scale.toVec4fVector();
-	if(use_scale[0] == 0) use_scale[0] = 1.0e-6f;
-	if(use_scale[1] == 0) use_scale[1] = 1.0e-6f;
-	if(use_scale[2] == 0) use_scale[2] = 1.0e-6f;
+	js::Vector<Vec4f, 16> rotations; // Scratch space
+	js::Vector<Vec4f, 16> translations;
+	double elapsed_time;
+};
 
-	const Vec4f unit_axis = normalise(ob->axis.toVec4fVector());
-	const Matrix4f rot = Matrix4f::rotationMatrix(unit_axis, ob->angle);
-	Matrix4f ob_to_world;
-	ob_to_world.setColumn(0, rot.getColumn(0) * use_scale[0]);
-	ob_to_world.setColumn(1, rot.getColumn(1) * use_scale[1]);
-	ob_to_world.setColumn(2, rot.getColumn(2) * use_scale[2]);
-	ob_to_world.setColumn(3, translation);
 
-	// Update in physics engine
-	if(ob->physics_object.nonNull())
-		physics_world->moveKinematicObject(*ob->physics_object, translation, Quatf::fromAxisAndAngle(unit_axis, ob->angle), (float)dt);
+BatchedScriptEvaluator::BatchedScriptEvaluator()
+:	frame_num(0)
+{}
 
-	ob_to_world_out = ob_to_world;
-}
+
+BatchedScriptEvaluator::~BatchedScriptEvaluator()
+{}
 
 
-void evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double global_time, double dt, WorldState* world_state, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, glare::AudioEngine* audio_engine,
-	int& num_scripts_processed_out)
+void BatchedScriptEvaluator::evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double global_time, double dt, WorldState* world_state, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world,
+	glare::AudioEngine* audio_engine, glare::TaskManager* task_manager, const Vec3d& cam_pos, float load_distance, EvalScriptsStats& stats_out)
 {
+	stats_out.num_scripts_processed = 0;
+	stats_out.num_obs_deferred = 0;
+	stats_out.num_instance_buffer_uploads = 0;
+	stats_out.instance_eval_CPU_time = 0;
+
 	// Evaluate scripts on objects
 	if(world_state)
 	{
 		PERFORMANCEAPI_INSTRUMENT("eval scripts");
-		int num_scripts_processed = 0;
+
+		frame_num++;
 
 		Lock lock(world_state->mutex);
 
@@ -477,6 +548,12 @@ void evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double gl
 		// and then cast to float.
 		const float use_global_time = (float)Maths::doubleMod(global_time, 3600);
 
+		const double load_dist2 = (double)load_distance * (double)load_distance;
+
+		instanced_obs.clear();
+		batches.clear();
+		size_t num_instances = 0;
+
 		for(auto it = obs_with_scripts.begin(); it != obs_with_scripts.end(); ++it)
 		{
 			WorldObject* ob = it->getPointer();
@@ -484,48 +561,113 @@ void evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double gl
 			assert(ob->script_evaluator.nonNull());
 			if(ob->script_evaluator.nonNull())
 			{
+				// Evaluate objects that are out of view, or beyond the load distance, less often.  Use the UID to spread them over frames.
+				// The AABB of an object with instances contains all the instances, so just use the frustum test for them.
+				const bool in_view = ob->opengl_engine_ob.nonNull() && opengl_engine->isObjectInCameraFrustum(*ob->opengl_engine_ob);
+				const bool reduced_rate = !in_view || (ob->instances.empty() && (ob->pos.getDist2(cam_pos) > load_dist2));
+				if(reduced_rate && ((frame_num + ob->uid.value()) % REDUCED_RATE_EVAL_PERIOD != 0) && (ob->last_script_eval_time >= 0))
+				{
+					stats_out.num_obs_deferred++;
+					continue;
+				}
+
+				// Use the time since the object was last evaluated for moving kinematic physics objects, so they move at the right average speed when evaluated at a reduced rate.
+				const double ob_dt = (ob->last_script_eval_time >= 0) ? myClamp(global_time - ob->last_script_eval_time, dt, 1.0) : dt;
+				ob->last_script_eval_time = global_time;
+
 				Matrix4f ob_to_world;
-				evalObjectScript(ob, use_global_time, dt, opengl_engine, physics_world, audio_engine, ob_to_world);
-				num_scripts_processed++;
+				evalObjectScript(ob, use_global_time, ob_dt, opengl_engine, physics_world, audio_engine, ob_to_world);
+				stats_out.num_scripts_processed++;
 
-				// If this object has instances (and has a graphics ob):
+				// If this object has instances (and has a graphics ob), add batches of instances to evaluate.
 				if(!ob->instances.empty() && ob->opengl_engine_ob.nonNull())
 				{
-					// Update instance ob-to-world transform based on the script.
-					// Compute AABB over all instances of the object
-					js::AABBox all_instances_aabb_ws = js::AABBox::emptyAABBox();
-					const js::AABBox aabb_os = ob->opengl_engine_ob->mesh_data->aabb_os;
-					for(size_t z=0; z<ob->instances.size(); ++z)
+					assert(ob->instance_matrices.size() == ob->instances.size());
+					ob->instance_matrices.resize(ob->instances.size());
+
+					InstancedOb instanced_ob;
+					instanced_ob.ob = ob;
+					instanced_ob.dt = ob_dt;
+					instanced_ob.batches_begin = batches.size();
+					for(size_t z=0; z<ob->instances.size(); z += INSTANCE_BATCH_SIZE)
 					{
-						InstanceInfo* instance = &ob->instances[z];
-						Matrix4f instance_ob_to_world;
-						evalObjectInstanceScript(instance, use_global_time, dt, opengl_engine, physics_world, instance_ob_to_world); // Updates instance->physics_object->ob_to_world
-						num_scripts_processed++;
+						InstanceBatch batch;
+						batch.ob = ob;
+						batch.begin = z;
+						batch.end = myMin(z + INSTANCE_BATCH_SIZE, ob->instances.size());
+						batches.push_back(batch);
+					}
+					instanced_ob.batches_end = batches.size();
+					instanced_obs.push_back(instanced_ob);
 
-						all_instances_aabb_ws.enlargeToHoldAABBox(aabb_os.transformedAABBFast(instance_ob_to_world));
+					num_instances += ob->instances.size();
+				}
+			}
+		}
 
-						ob->instance_matrices[z] = instance_ob_to_world;
-					}
+		// Evaluate instance scripts and build instance matrices.  Use the task manager if there are enough instances to make it worthwhile.
+		if(task_manager && (num_instances >= MIN_NUM_INSTANCES_FOR_PARALLEL_EVAL) && (batches.size() > 1))
+		{
+			const size_t num_tasks = myMin(batches.size(), MAX_NUM_TASKS);
+			while(tasks.size() < num_tasks)
+				tasks.push_back(new EvalInstanceScriptsTask());
 
-					// Manually set AABB of instanced object.
-					// NOTE: we will avoid opengl_engine->updateObjectTransformData(), since it doesn't handle instances currently.
-					ob->opengl_engine_ob->aabb_ws = all_instances_aabb_ws;
+			const size_t batches_per_task = Maths::roundedUpDivide(batches.size(), num_tasks);
+			for(size_t t=0; t<num_tasks; ++t)
+			{
+				tasks[t]->batches = &batches;
+				tasks[t]->begin = myMin(t * batches_per_task, batches.size());
+				tasks[t]->end = myMin((t + 1) * batches_per_task, batches.size());
+				tasks[t]->use_global_time = use_global_time;
+				tasks[t]->elapsed_time = 0;
+				task_manager->addTask(tasks[t]);
+			}
 
-					// Also update instance_matrix_vbo.
-					assert(ob->instance_matrices.size() == ob->instances.size());
-					if(ob->opengl_engine_ob->instance_matrix_vbo.nonNull())
-					{
-						ob->opengl_engine_ob->instance_matrix_vbo->updateData(ob->instance_matrices.data(), ob->instance_matrices.dataSizeBytes());
-					}
+			task_manager->waitForTasksToComplete();
+
+			for(size_t t=0; t<num_tasks; ++t)
+				stats_out.instance_eval_CPU_time += tasks[t]->elapsed_time;
+		}
+		else
+		{
+			Timer timer;
+			for(size_t i=0; i<batches.size(); ++i)
+				evalInstanceScriptBatch(batches[i].ob, batches[i].begin, batches[i].end, use_global_time, batches[i].ob->opengl_engine_ob->mesh_data->aabb_os, temp_rotations, temp_translations, batches[i].aabb_ws);
+			stats_out.instance_eval_CPU_time += timer.elapsed();
+		}
+		stats_out.num_scripts_processed += (int)num_instances;
+
+		// Update instance physics objects, AABBs, and do one instance matrix upload per object.
+		for(size_t i=0; i<instanced_obs.size(); ++i)
+		{
+			WorldObject* ob = instanced_obs[i].ob;
+
+			for(size_t z=0; z<ob->instances.size(); ++z)
+			{
+				InstanceInfo* instance = &ob->instances[z];
+				if(instance->physics_object.nonNull())
+				{
+					const Vec4f translation = ob->instance_matrices[z].getColumn(3);
+					physics_world->moveKinematicObject(*instance->physics_object, translation, Quatf::fromAxisAndAngle(instance->axis.toVec4fVector(), instance->angle), (float)instanced_obs[i].dt);
 				}
 			}
-		}
 
-		num_scripts_processed_out = num_scripts_processed;
-	}
-	else
-	{
-		num_scripts_processed_out = 0;
+			// Compute AABB over all instances of the object
+			js::AABBox all_instances_aabb_ws = js::AABBox::emptyAABBox();
+			for(size_t b=instanced_obs[i].batches_begin; b<instanced_obs[i].batches_end; ++b)
+				all_instances_aabb_ws.enlargeToHoldAABBox(batches[b].aabb_ws);
+
+			// Manually set AABB of instanced object.
+			// NOTE: we will avoid opengl_engine->updateObjectTransformData(), since it doesn't handle instances currently.
+			ob->opengl_engine_ob->aabb_ws = all_instances_aabb_ws;
+
+			// Also update instance_matrix_vbo.
+			if(ob->opengl_engine_ob->instance_matrix_vbo.nonNull())
+			{
+				ob->opengl_engine_ob->instance_matrix_vbo->updateData(ob->instance_matrices.data(), ob->instance_matrices.dataSizeBytes());
+				stats_out.num_instance_buffer_uploads++;
+			}
+		}
 	}
 }
 
@@ -7,10 +7,13 @@ Copyright Glare Technologies Limited 2022 -
 
 
 #include "../shared/WorldObject.h"
+#include <utils/Vector.h>
+#include <vector>
 class WorldState;
 class OpenGLEngine;
 class PhysicsWorld;
 namespace glare { class AudioEngine; }
+namespace glare { class TaskManager; }
 class ObjectPathController;
 
 
@@ -126,7 +129,71 @@ public:
 void parseXMLScript(WorldObjectRef ob, const std::string& script, double global_time, Reference<ObjectPathController>& path_controller_out, Reference<VehicleScript>& vehicle_script_out);
 
 
-void evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double global_time, double dt, WorldState* world_state, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, glare::AudioEngine* audio_engine,
-	int& num_scripts_processed_out);
+struct EvalScriptsStats
+{
+	EvalScriptsStats() : num_scripts_processed(0), num_obs_deferred(0), num_instance_buffer_uploads(0), instance_eval_CPU_time(0) {}
+
+	int num_scripts_processed; // Including instance scripts.
+	int num_obs_deferred; // Number of objects not evaluated this frame, because they are out of view or beyond the load distance.
+	int num_instance_buffer_uploads;
+	double instance_eval_CPU_time; // Time spent evaluating instance scripts and building instance matrices, summed over threads.
+};
+
+
+class EvalInstanceScriptsTask;
+
+
+/*=====================================================================
+BatchedScriptEvaluator
+----------------------
+Evaluates the scripts of objects once per frame.
+
+Object scripts are evaluated on the calling thread, as they update the OpenGL engine, physics and audio state.
+The instances of instanced objects are split into batches, which are evaluated in parallel on the task manager when there are
+enough instances, then instance physics objects are updated and the instance matrices are uploaded, once per object, afterwards.
+
+Objects that are out of the camera frustum, or beyond the load distance, are evaluated every REDUCED_RATE_EVAL_PERIOD frames.
+=====================================================================*/
+class BatchedScriptEvaluator
+{
+public:
+	BatchedScriptEvaluator();
+	~BatchedScriptEvaluator();
+
+	// task_manager may be NULL, in which case instance scripts are evaluated on the calling thread.
+	void evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double global_time, double dt, WorldState* world_state, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world,
+		glare::AudioEngine* audio_engine, glare::TaskManager* task_manager, const Vec3d& cam_pos, float load_distance, EvalScriptsStats& stats_out);
+
+	static const uint64 REDUCED_RATE_EVAL_PERIOD = 4;
+	static const size_t INSTANCE_BATCH_SIZE = 256;
+	static const size_t MIN_NUM_INSTANCES_FOR_PARALLEL_EVAL = 1024;
+	static const size_t MAX_NUM_TASKS = 16;
+
+	struct InstanceBatch
+	{
+		GLARE_ALIGNED_16_NEW_DELETE
+
+		js::AABBox aabb_ws; // AABB of the evaluated instances
+		WorldObject* ob;
+		size_t begin, end; // Instance index range
+	};
+
+private:
+	GLARE_DISABLE_COPY(BatchedScriptEvaluator)
+
+	struct InstancedOb
+	{
+		WorldObject* ob;
+		double dt;
+		size_t batches_begin, batches_end;
+	};
+
+	uint64 frame_num;
+	std::vector<InstancedOb> instanced_obs;
+	js::Vector<InstanceBatch, 16> batches;
+	std::vector<Reference<EvalInstanceScriptsTask> > tasks;
+	js::Vector<Vec4f, 16> temp_rotations;
+	js::Vector<Vec4f, 16> temp_translations;
+};
 
 } // end namespace Scripting
@@ -8,6 +8,8 @@ Copyright Glare Technologies Limited 2023 -
 
 #include "ModelLoading.h"
 #include "PhysicsWorld.h"
+#include "MeshDiskCache.h"
+#include "ParticleManager.h"
 #include "TerrainTests.h"
 #include "URLParser.h"
 #include "CameraController.h"
@@ -59,6 +61,8 @@ Copyright Glare Technologies Limited 2023 -
 #include "../utils/FileUtils.h"
 #include "../utils/DatabaseTests.h"
 #include "../audio/AudioResampler.h"
+#include "../audio/VoiceJitterBuffer.h"
+#include "../audio/LockFreeQueueTests.h"
 #include "../networking/URL.h"
 #include "../networking/TLSSocketTests.h"
 #include "../networking/HTTPClient.h"
@@ -139,11 +143,15 @@ void TestSuite::test()
 	runTest([&]() { SmallArrayTest::test(); });
 	runTest([&]() { SmallVectorTest::test(); });
 	runTest([&]() { glare::AudioResampler::test(); });
+	runTest([&]() { glare::VoiceJitterBuffer::test(); });
+	runTest([&]() { glare::testLockFreeQueues(); });
 	runTest([&]() { Sort::test(); });
 	runTest([&]() { glare::BestFitAllocator::test(); });
 	runTest([&]() { testSRGBUtils(); });
 	PhysicsWorld::init(); // Init before taking mem snapshot
 	runTest([&]() { PhysicsWorld::test(); });
+	runTest([&]() { MeshDiskCache::test(); });
+	runTest([&]() { ParticleManager::test(); });
 	runTest([&]() { TopologicalSort::test(); });
 	runTest([&]() { CheckedMaths::test(); });
 	runTest([&]() { LODGeneration::test(); });
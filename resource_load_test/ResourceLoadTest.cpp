@@ -0,0 +1,348 @@
+/*=====================================================================
+ResourceLoadTest.cpp
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+
+
+#include <networking/networking.h>
+#include <networking/MySocket.h>
+#include <networking/TLSSocket.h>
+#include <PlatformUtils.h>
+#include <Clock.h>
+#include <Timer.h>
+#include <MyThread.h>
+#include <PCG32.h>
+#include <ConPrint.h>
+#include <OpenSSL.h>
+#include <Exception.h>
+#include <FileUtils.h>
+#include <StringUtils.h>
+#include <ArgumentParser.h>
+#include <AtomicInt.h>
+#include <tls.h>
+#include <cstring>
+#include <cctype>
+
+
+/*
+Load test for the server's /resource/ HTTP handler (ResourceHandlers::handleResourceRequest).
+
+Each connection thread requests random resources from resource_dir (e.g. a copy of the server's resources dir) over a keep-alive
+HTTP/1.1 connection, as fast as it can, and reports requests per second and bytes served.
+
+Example:
+	resource_load_test --server localhost --port 80 --plain --resource_dir /var/www/cyberspace/server_data/server_resources --connections 32
+*/
+
+
+// Statistics, summed over all connections.
+static glare::AtomicInt total_num_requests(0);
+static glare::AtomicInt total_body_bytes(0); // Bytes of response bodies received, as sent (i.e. compressed if a compressed variant was served).
+static glare::AtomicInt total_latency_us(0); // Sum of times from sending a request to receiving the whole response, in microseconds.
+static glare::AtomicInt num_gzip_responses(0);
+static glare::AtomicInt num_zstd_responses(0);
+static glare::AtomicInt num_errors(0);
+static glare::AtomicInt num_connected(0);
+static glare::AtomicInt should_stop(0);
+
+
+// Percent-encode characters that aren't unreserved in URLs.
+static std::string escapeURLPath(const std::string& s)
+{
+	static const char* hex = "0123456789ABCDEF";
+	std::string res;
+	for(size_t i=0; i<s.size(); ++i)
+	{
+		const unsigned char c = (unsigned char)s[i];
+		if(::isAlphaNumeric(c) || c == '-' || c == '.' || c == '_' || c == '~')
+			res.push_back((char)c);
+		else
+		{
+			res.push_back('%');
+			res.push_back(hex[c >> 4]);
+			res.push_back(hex[c & 0xF]);
+		}
+	}
+	return res;
+}
+
+
+static bool equalCaseInsensitivePrefix(const std::string& s, size_t offset, const char* prefix)
+{
+	const size_t prefix_len = std::strlen(prefix);
+	if(offset + prefix_len > s.size())
+		return false;
+	for(size_t i=0; i<prefix_len; ++i)
+		if(std::tolower((unsigned char)s[offset + i]) != std::tolower((unsigned char)prefix[i]))
+			return false;
+	return true;
+}
+
+
+class ResourceLoadTestThread : public MyThread
+{
+public:
+	virtual void run()
+	{
+		try
+		{
+			MySocketRef plain_socket = new MySocket();
+			plain_socket->connect(server_hostname, server_port);
+
+			SocketInterfaceRef socket;
+			if(use_TLS)
+				socket = new TLSSocket(plain_socket, client_tls_config, server_hostname);
+			else
+				socket = plain_socket;
+
+			num_connected.increment();
+
+			PCG32 rng(seed);
+			std::vector<char> read_buf(1 << 16);
+			std::string header; // Header bytes read so far.
+
+			while(!should_stop)
+			{
+				const std::string& URL = (*URLs)[rng.nextUInt((uint32)URLs->size())];
+
+				const std::string request =
+					"GET /resource/" + escapeURLPath(URL) + " HTTP/1.1\r\n"
+					"Host: " + server_hostname + "\r\n" +
+					(accept_encoding.empty() ? std::string() : ("Accept-Encoding: " + accept_encoding + "\r\n")) +
+					"Connection: Keep-Alive\r\n"
+					"\r\n";
+
+				Timer request_timer;
+				socket->writeData(request.data(), request.size());
+
+				// Read the response header.  Any body bytes read with it are left in header after header_len.
+				header.clear();
+				size_t header_len = std::string::npos;
+				while(header_len == std::string::npos)
+				{
+					const size_t num_read = socket->readSomeBytes(read_buf.data(), read_buf.size());
+					if(num_read == 0)
+						throw glare::Exception("Connection closed by server.");
+					const size_t search_start = (header.size() >= 3) ? (header.size() - 3) : 0;
+					header.append(read_buf.data(), num_read);
+
+					const size_t end_pos = header.find("\r\n\r\n", search_start);
+					if(end_pos != std::string::npos)
+						header_len = end_pos + 4;
+					else if(header.size() > 65536)
+						throw glare::Exception("Response header too long.");
+				}
+
+				if(!::hasPrefix(header, "HTTP/1.1 200"))
+					throw glare::Exception("Unexpected response for '" + URL + "': " + header.substr(0, header.find("\r\n")));
+
+				// Parse Content-Length and Content-Encoding.
+				uint64 content_length = 0;
+				bool have_content_length = false;
+				for(size_t line_start = header.find("\r\n") + 2; line_start < header_len; )
+				{
+					const size_t line_end = header.find("\r\n", line_start);
+					if(equalCaseInsensitivePrefix(header, line_start, "content-length:"))
+					{
+						content_length = stringToUInt64(::stripHeadAndTailWhitespace(header.substr(line_start + 15, line_end - (line_start + 15))));
+						have_content_length = true;
+					}
+					else if(equalCaseInsensitivePrefix(header, line_start, "content-encoding:"))
+					{
+						const std::string encoding = ::stripHeadAndTailWhitespace(header.substr(line_start + 17, line_end - (line_start + 17)));
+						if(encoding == "gzip")
+							num_gzip_responses.increment();
+						else if(encoding == "zstd")
+							num_zstd_responses.increment();
+					}
+					line_start = line_end + 2;
+				}
+				if(!have_content_length)
+					throw glare::Exception("Response had no Content-Length.");
+
+				// Read the rest of the body.
+				const uint64 body_bytes_in_header = header.size() - header_len;
+				if(body_bytes_in_header > content_length)
+					throw glare::Exception("Received more data than Content-Length.");
+				uint64 remaining = content_length - body_bytes_in_header;
+				while(remaining > 0)
+				{
+					const size_t chunk_size = (size_t)myMin<uint64>(remaining, read_buf.size());
+					socket->readData(read_buf.data(), chunk_size);
+					remaining -= chunk_size;
+				}
+
+				total_num_requests.increment();
+				total_body_bytes.add((int64)content_length);
+				total_latency_us.add((int64)(request_timer.elapsed() * 1.0e6));
+			}
+
+			num_connected.decrement();
+		}
+		catch(MySocketExcep& e)
+		{
+			conPrint("Socket error: " + e.what());
+			num_errors.increment();
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("Error: " + e.what());
+			num_errors.increment();
+		}
+	}
+
+	struct tls_config* client_tls_config;
+	bool use_TLS;
+	std::string server_hostname;
+	int server_port;
+	std::string accept_encoding;
+	const std::vector<std::string>* URLs;
+	int seed;
+};
+
+
+int main(int argc, char* argv[])
+{
+	Clock::init();
+	Networking::createInstance();
+	PlatformUtils::ignoreUnixSignals();
+	OpenSSL::init();
+	TLSSocket::initTLS();
+
+	std::string server_hostname = "localhost";
+	int server_port = 443;
+	bool use_TLS = true;
+	std::string resource_dir;
+	int num_connections = 16;
+	double duration = 30;
+	std::string accept_encoding = "gzip, deflate, br, zstd";
+	try
+	{
+		std::map<std::string, std::vector<ArgumentParser::ArgumentType> > syntax;
+		syntax["--server"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--port"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--plain"] = std::vector<ArgumentParser::ArgumentType>(); // Use plain HTTP instead of HTTPS.
+		syntax["--resource_dir"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--connections"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--duration"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--accept_encoding"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // Use "" to not send Accept-Encoding.
+
+		std::vector<std::string> args;
+		for(int i=0; i<argc; ++i)
+			args.push_back(argv[i]);
+
+		ArgumentParser parsed_args(args, syntax, /*allow_unnamed_arg=*/false);
+
+		if(parsed_args.isArgPresent("--server"))
+			server_hostname = parsed_args.getArgStringValue("--server");
+		use_TLS = !parsed_args.isArgPresent("--plain");
+		server_port = use_TLS ? 443 : 80;
+		if(parsed_args.isArgPresent("--port"))
+			server_port = stringToInt(parsed_args.getArgStringValue("--port"));
+		if(parsed_args.isArgPresent("--resource_dir"))
+			resource_dir = parsed_args.getArgStringValue("--resource_dir");
+		if(parsed_args.isArgPresent("--connections"))
+			num_connections = stringToInt(parsed_args.getArgStringValue("--connections"));
+		if(parsed_args.isArgPresent("--duration"))
+			duration = stringToDouble(parsed_args.getArgStringValue("--duration"));
+		if(parsed_args.isArgPresent("--accept_encoding"))
+			accept_encoding = parsed_args.getArgStringValue("--accept_encoding");
+
+		if(resource_dir.empty())
+			throw glare::Exception("--resource_dir is required.");
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("Error parsing arguments: " + e.what());
+		conPrint("Usage: resource_load_test --resource_dir dir [--server hostname] [--port port] [--plain] [--connections n] [--duration seconds] [--accept_encoding value]");
+		return 1;
+	}
+
+	// Resource filenames are the resource URLs (apart from very long URLs on Windows servers, which will just 404).  Skip compressed variants and temp files.
+	std::vector<std::string> URLs;
+	try
+	{
+		const std::vector<std::string> filenames = FileUtils::getFilesInDir(resource_dir);
+		for(size_t i=0; i<filenames.size(); ++i)
+			if(!hasExtension(filenames[i], "gz") && !hasExtension(filenames[i], "zst") && !hasExtension(filenames[i], "tmp"))
+				URLs.push_back(filenames[i]);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("Error listing resource dir: " + e.what());
+		return 1;
+	}
+	if(URLs.empty())
+	{
+		conPrint("No resources found in '" + resource_dir + "'.");
+		return 1;
+	}
+
+	conPrint("Requesting " + toString(URLs.size()) + " resources from " + (use_TLS ? "https://" : "http://") + server_hostname + ":" + toString(server_port) + " over " +
+		toString(num_connections) + " connections for " + doubleToStringNSigFigs(duration, 3) + " s...");
+
+	struct tls_config* client_tls_config = tls_config_new();
+	if(!client_tls_config)
+	{
+		conPrint("Failed to initialise TLS (tls_config_new failed)");
+		return 1;
+	}
+	tls_config_insecure_noverifycert(client_tls_config); // Load tests are usually run against local or staging servers.
+	tls_config_insecure_noverifyname(client_tls_config);
+
+	std::vector<Reference<ResourceLoadTestThread>> threads;
+	for(int i=0; i<num_connections; ++i)
+	{
+		Reference<ResourceLoadTestThread> t = new ResourceLoadTestThread();
+		t->client_tls_config = client_tls_config;
+		t->use_TLS = use_TLS;
+		t->server_hostname = server_hostname;
+		t->server_port = server_port;
+		t->accept_encoding = accept_encoding;
+		t->URLs = &URLs;
+		t->seed = i;
+		t->launch();
+		threads.push_back(t);
+	}
+
+	Timer total_timer;
+	Timer report_timer;
+	int64 last_num_requests = 0;
+	int64 last_body_bytes = 0;
+	while(total_timer.elapsed() < duration)
+	{
+		PlatformUtils::Sleep(100);
+
+		if(report_timer.elapsed() > 1.0)
+		{
+			const int64 num_requests = total_num_requests;
+			const int64 body_bytes = total_body_bytes;
+			conPrint("Connected: " + toString((int64)num_connected) + ", " + doubleToStringNSigFigs((num_requests - last_num_requests) / report_timer.elapsed(), 4) + " req/s, " +
+				doubleToStringNSigFigs((body_bytes - last_body_bytes) / report_timer.elapsed() / (1024 * 1024), 4) + " MB/s");
+
+			last_num_requests = num_requests;
+			last_body_bytes = body_bytes;
+			report_timer.reset();
+		}
+	}
+
+	should_stop = glare::atomic_int(1);
+	for(size_t i=0; i<threads.size(); ++i)
+		threads[i]->join();
+
+	const double elapsed = total_timer.elapsed();
+	const int64 num_requests = total_num_requests;
+	const int64 body_bytes = total_body_bytes;
+	conPrint("");
+	conPrint("Requests:          " + toString(num_requests) + " (" + doubleToStringNSigFigs(num_requests / elapsed, 4) + " req/s)");
+	conPrint("Bytes served:      " + toString(body_bytes) + " B (" + doubleToStringNSigFigs(body_bytes / elapsed / (1024 * 1024), 4) + " MB/s)");
+	conPrint("Mean latency:      " + ((num_requests > 0) ? doubleToStringNSigFigs((double)(int64)total_latency_us / num_requests * 1.0e-3, 4) + " ms" : std::string("-")));
+	conPrint("gzip responses:    " + toString((int64)num_gzip_responses));
+	conPrint("zstd responses:    " + toString((int64)num_zstd_responses));
+	conPrint("Connection errors: " + toString((int64)num_errors));
+
+	tls_config_free(client_tls_config);
+
+	return 0;
+}
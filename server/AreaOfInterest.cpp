@@ -0,0 +1,305 @@
+/*=====================================================================
+AreaOfInterest.cpp
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "AreaOfInterest.h"
+
+
+#include <maths/mathstypes.h>
+#include <algorithm>
+
+
+static const double SWEEP_PERIOD = 25.0; // Remove state for entities we haven't heard about for a while, approx every 25 s.
+static const double MIN_PENDING_CHECK_PERIOD = 0.1;
+
+
+// Returns true if a positional update for an entity at squared distance dist2 from the client should be sent now.
+static inline bool shouldSendUpdate(const AreaOfInterestConfig& config, double dist2, double cur_time, double last_sent_time)
+{
+	if(dist2 <= (double)config.near_dist * (double)config.near_dist)
+		return true;
+
+	const bool is_mid = dist2 <= (double)config.mid_dist * (double)config.mid_dist;
+	const double period = is_mid ? config.mid_update_period : config.far_update_period;
+	if(period <= 0)
+		return is_mid; // Mid-range updates are not rate limited, far updates are held back.
+
+	return (last_sent_time < 0) || (cur_time >= last_sent_time + period);
+}
+
+
+size_t AreaOfInterest::getPacketsForClient(const AreaOfInterestConfig& config, double cur_time, const Vec3d& client_pos, const WorldTickPackets& tick_packets, ClientInterestState& state, std::vector<const PositionalPacket*>& packets_out)
+{
+	if(!config.enabled)
+	{
+		for(size_t i=0; i<tick_packets.positional_packets.size(); ++i)
+			packets_out.push_back(&tick_packets.positional_packets[i]);
+		return tick_packets.positional_packets.size();
+	}
+
+	// Full updates (which include the transform) and destroys have been sent to all clients, so any held-back updates for those entities are stale.
+	for(size_t i=0; i<tick_packets.reset_entity_keys.size(); ++i)
+	{
+		auto res = state.entities.find(tick_packets.reset_entity_keys[i]);
+		if(res != state.entities.end())
+		{
+			res->second.has_pending_packet = false;
+			res->second.last_sent_time = cur_time;
+		}
+	}
+
+	size_t num_appended = 0;
+
+	for(size_t i=0; i<tick_packets.positional_packets.size(); ++i)
+	{
+		const PositionalPacket& pp = tick_packets.positional_packets[i];
+		ClientInterestState::EntityState& entity = state.entities[pp.entity_key];
+
+		if(shouldSendUpdate(config, client_pos.getDist2(pp.pos), cur_time, entity.last_sent_time))
+		{
+			packets_out.push_back(&pp);
+			entity.has_pending_packet = false; // This update supersedes any held-back update.
+			entity.last_sent_time = cur_time;
+			num_appended++;
+		}
+		else
+		{
+			entity.pending_packet = pp; // Just keep the most recent update.
+			entity.has_pending_packet = true;
+		}
+	}
+
+	// Periodically check held-back updates, since the client or entity may have moved closer since the update was held back.
+	// Also remove state for entities that have not been updated for a while.
+	const bool do_sweep = cur_time >= state.next_sweep_time;
+	if((cur_time >= state.next_pending_check_time) || do_sweep)
+	{
+		for(auto it = state.entities.begin(); it != state.entities.end(); )
+		{
+			ClientInterestState::EntityState& entity = it->second;
+			if(entity.has_pending_packet)
+			{
+				if(shouldSendUpdate(config, client_pos.getDist2(entity.pending_packet.pos), cur_time, entity.last_sent_time))
+				{
+					packets_out.push_back(&entity.pending_packet);
+					entity.has_pending_packet = false;
+					entity.last_sent_time = cur_time;
+					num_appended++;
+				}
+				++it;
+			}
+			else if(do_sweep && (cur_time - entity.last_sent_time >= SWEEP_PERIOD))
+				it = state.entities.erase(it);
+			else
+				++it;
+		}
+
+		state.next_pending_check_time = cur_time + myMax(MIN_PENDING_CHECK_PERIOD, config.mid_update_period);
+		if(do_sweep)
+			state.next_sweep_time = cur_time + SWEEP_PERIOD;
+	}
+
+	return num_appended;
+}
+
+
+size_t AreaOfInterest::appendPacketsForClient(const AreaOfInterestConfig& config, double cur_time, const Vec3d& client_pos, const WorldTickPackets& tick_packets, ClientInterestState& state, std::string& data_out)
+{
+	std::vector<const PositionalPacket*> packets;
+	const size_t num_appended = getPacketsForClient(config, cur_time, client_pos, tick_packets, state, packets);
+	for(size_t i=0; i<packets.size(); ++i)
+		data_out += packets[i]->packet;
+	return num_appended;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+
+
+static PositionalPacket makeTestPacket(uint64 key, const Vec3d& pos, const std::string& packet)
+{
+	PositionalPacket pp;
+	pp.entity_key = key;
+	pp.pos = pos;
+	pp.packet = packet;
+	return pp;
+}
+
+
+void AreaOfInterest::test()
+{
+	conPrint("AreaOfInterest::test()");
+
+	AreaOfInterestConfig config;
+	config.near_dist = 10.f;
+	config.mid_dist = 50.f;
+	config.mid_update_period = 5.0;
+	config.far_update_period = 0;
+
+	// Times in these tests are whole numbers of seconds, to avoid rounding issues.
+
+	const Vec3d origin(0, 0, 0);
+
+	//-------------------- Test entity keys --------------------
+	{
+		testAssert(makeAvatarEntityKey(UID(1)) != makeObjectEntityKey(UID(1)));
+		testAssert(makeObjectEntityKey(UID(123)) == 123);
+	}
+
+	//-------------------- Test that near updates are sent every tick --------------------
+	{
+		ClientInterestState state;
+		WorldTickPackets tick_packets;
+		for(uint64 tick=1; tick<20; ++tick)
+		{
+			tick_packets.clear();
+			tick_packets.positional_packets.push_back(makeTestPacket(1, Vec3d(5, 0, 0), "a" + toString(tick)));
+			std::string data;
+			testAssert(appendPacketsForClient(config, /*cur time=*/(double)tick, origin, tick_packets, state, data) == 1);
+			testAssert(data == "a" + toString(tick));
+		}
+	}
+
+	//-------------------- Test that mid-range updates are rate limited, and only the most recent held-back update is sent --------------------
+	{
+		ClientInterestState state;
+		WorldTickPackets tick_packets;
+		std::string all_data;
+		for(uint64 tick=1; tick<=10; ++tick)
+		{
+			tick_packets.clear();
+			tick_packets.positional_packets.push_back(makeTestPacket(1, Vec3d(30, 0, 0), "m" + toString(tick) + ";"));
+			appendPacketsForClient(config, /*cur time=*/(double)tick, origin, tick_packets, state, all_data);
+		}
+		// First update is sent immediately, then at most once every 5 s.
+		testAssert(all_data == "m1;m6;");
+
+		// No more updates for the entity: the held-back update from tick 10 should be sent at the next check.
+		for(uint64 tick=11; tick<=15; ++tick)
+		{
+			tick_packets.clear();
+			appendPacketsForClient(config, /*cur time=*/(double)tick, origin, tick_packets, state, all_data);
+		}
+		testAssert(all_data == "m1;m6;m10;");
+	}
+
+	//-------------------- Test that far updates are held back until the client comes closer --------------------
+	{
+		ClientInterestState state;
+		WorldTickPackets tick_packets;
+		std::string data;
+		for(uint64 tick=1; tick<=20; ++tick)
+		{
+			tick_packets.clear();
+			if(tick <= 3)
+				tick_packets.positional_packets.push_back(makeTestPacket(1, Vec3d(100, 0, 0), "f" + toString(tick) + ";"));
+			appendPacketsForClient(config, /*cur time=*/(double)tick, origin, tick_packets, state, data);
+		}
+		testAssert(data.empty());
+
+		// Move the client close to the entity.  The latest update should be sent on the next check.
+		for(uint64 tick=21; tick<=25; ++tick)
+		{
+			tick_packets.clear();
+			appendPacketsForClient(config, /*cur time=*/(double)tick, Vec3d(95, 0, 0), tick_packets, state, data);
+		}
+		testAssert(data == "f3;");
+	}
+
+	//-------------------- Test that a full update discards held-back updates --------------------
+	{
+		ClientInterestState state;
+		WorldTickPackets tick_packets;
+		std::string data;
+		tick_packets.positional_packets.push_back(makeTestPacket(1, Vec3d(100, 0, 0), "f;"));
+		appendPacketsForClient(config, /*cur time=*/1, origin, tick_packets, state, data);
+		testAssert(data.empty());
+
+		tick_packets.clear();
+		tick_packets.reset_entity_keys.push_back(1);
+		appendPacketsForClient(config, /*cur time=*/2, origin, tick_packets, state, data);
+
+		for(uint64 tick=3; tick<=20; ++tick)
+		{
+			tick_packets.clear();
+			appendPacketsForClient(config, /*cur time=*/(double)tick, Vec3d(100, 0, 0), tick_packets, state, data);
+		}
+		testAssert(data.empty());
+	}
+
+	//-------------------- Test with a far update period --------------------
+	{
+		AreaOfInterestConfig far_config = config;
+		far_config.far_update_period = 10.0;
+
+		ClientInterestState state;
+		WorldTickPackets tick_packets;
+		std::string data;
+		for(uint64 tick=1; tick<=20; ++tick)
+		{
+			tick_packets.clear();
+			tick_packets.positional_packets.push_back(makeTestPacket(1, Vec3d(100, 0, 0), "f" + toString(tick) + ";"));
+			appendPacketsForClient(far_config, /*cur time=*/(double)tick, origin, tick_packets, state, data);
+		}
+		// First update is sent immediately, then at most once every 10 s.
+		testAssert(data == "f1;f11;");
+	}
+
+	//-------------------- Test with filtering disabled --------------------
+	{
+		AreaOfInterestConfig disabled_config = config;
+		disabled_config.enabled = false;
+
+		ClientInterestState state;
+		WorldTickPackets tick_packets;
+		tick_packets.positional_packets.push_back(makeTestPacket(1, Vec3d(5, 0, 0), "a;"));
+		tick_packets.positional_packets.push_back(makeTestPacket(2, Vec3d(1000, 0, 0), "b;"));
+		std::string data;
+		testAssert(appendPacketsForClient(disabled_config, /*cur time=*/1, origin, tick_packets, state, data) == 2);
+		testAssert(data == "a;b;");
+	}
+
+	//-------------------- Test getPacketsForClient() returns held-back packets with their transforms --------------------
+	{
+		ClientInterestState state;
+		WorldTickPackets tick_packets;
+		PositionalPacket pp = makeTestPacket(1, Vec3d(100, 0, 0), "f;");
+		pp.transform.uid = UID(1);
+		pp.transform.pos = pp.pos;
+		tick_packets.positional_packets.push_back(pp);
+		std::vector<const PositionalPacket*> packets;
+		getPacketsForClient(config, /*cur time=*/1, origin, tick_packets, state, packets);
+		testAssert(packets.empty());
+
+		tick_packets.clear();
+		getPacketsForClient(config, /*cur time=*/10, Vec3d(95, 0, 0), tick_packets, state, packets);
+		testAssert(packets.size() == 1);
+		testAssert(packets[0]->packet == "f;" && packets[0]->transform.uid == UID(1) && packets[0]->transform.pos == Vec3d(100, 0, 0));
+	}
+
+	//-------------------- Test that state for stale entities is removed --------------------
+	{
+		ClientInterestState state;
+		WorldTickPackets tick_packets;
+		std::string data;
+		tick_packets.positional_packets.push_back(makeTestPacket(1, Vec3d(5, 0, 0), "a;"));
+		appendPacketsForClient(config, /*cur time=*/1, origin, tick_packets, state, data);
+		testAssert(state.entities.size() == 1);
+
+		tick_packets.clear();
+		for(uint64 tick=2; tick<=(uint64)SWEEP_PERIOD * 2; ++tick)
+			appendPacketsForClient(config, /*cur time=*/(double)tick, origin, tick_packets, state, data);
+		testAssert(state.entities.empty());
+	}
+
+	conPrint("AreaOfInterest::test() done.");
+}
+
+
+#endif // BUILD_TESTS
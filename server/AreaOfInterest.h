@@ -0,0 +1,103 @@
+/*=====================================================================
+AreaOfInterest.h
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "BroadcastFrame.h"
+#include "../shared/UID.h"
+#include "../shared/TransformCompression.h"
+#include <maths/vec3.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+struct AreaOfInterestConfig
+{
+	AreaOfInterestConfig() : enabled(true), near_dist(200.f), mid_dist(600.f), mid_update_period(0.5), far_update_period(0) {}
+
+	bool enabled; // If false, all positional updates are sent to all clients in the world every tick.
+	float near_dist; // Positional updates for entities within this distance of the client avatar are sent every tick.
+	float mid_dist; // Updates for entities between near_dist and mid_dist are sent at most once every mid_update_period seconds.
+	double mid_update_period; // In seconds.  If zero, mid-range updates are sent every tick.
+	double far_update_period; // Updates for entities beyond mid_dist are sent at most once every far_update_period seconds.  If zero, they are held back until the entity is within mid_dist.
+};
+
+
+// A broadcast packet that updates the transform of an entity (avatar or object) at a known position.
+// These are the packets that area-of-interest filtering applies to.
+struct PositionalPacket
+{
+	uint64 entity_key; // See makeAvatarEntityKey() and makeObjectEntityKey().
+	Vec3d pos;
+	std::string packet; // AvatarTransformUpdate, ObjectTransformUpdate or ObjectPhysicsTransformUpdate message, for clients with protocol version < 40.
+	TransformCompression::EntityTransform transform; // The transform in the packet, for encoding in TransformUpdateBatch messages.
+};
+
+
+// All the packets for a single world generated in one main server loop iteration (tick).
+struct WorldTickPackets
+{
+	WorldTickPackets() : packets_frame(new BroadcastFrame()) {}
+
+	// Makes a new packets_frame, since worker threads may still be holding references to the old one.
+	void clear() { if(!packets_frame->empty()) packets_frame = new BroadcastFrame(); positional_packets.clear(); reset_entity_keys.clear(); avatar_positions.clear(); }
+
+	BroadcastFrameRef packets_frame; // Packets sent to all clients in the world.  Shared by all worker threads for clients in the world.
+	std::vector<PositionalPacket> positional_packets; // Sent to clients subject to area-of-interest filtering.
+	std::vector<uint64> reset_entity_keys; // Entities that had a full update or were destroyed this tick.  Any held-back positional updates for them are stale.
+	std::unordered_map<UID, Vec3d, UIDHasher> avatar_positions; // Positions of alive avatars in the world.
+};
+
+
+// State kept by the main server thread for each connected client.
+class ClientInterestState
+{
+public:
+	ClientInterestState() : last_seen_tick(0), next_pending_check_time(0), next_sweep_time(0) {}
+
+	struct EntityState
+	{
+		EntityState() : has_pending_packet(false), last_sent_time(-1) {}
+
+		PositionalPacket pending_packet; // Most recent positional update that has been held back, if has_pending_packet is true.
+		bool has_pending_packet;
+		double last_sent_time; // -1 if never sent.
+	};
+
+	UID client_avatar_uid;
+	uint64 last_seen_tick; // Main server loop iteration in which the client was last seen.  Used for removing state for disconnected clients.
+	double next_pending_check_time; // Time at which held-back updates will next be checked.
+	double next_sweep_time; // Time at which state for stale entities will next be removed.
+	std::unordered_map<uint64, EntityState> entities;
+};
+
+
+/*=====================================================================
+AreaOfInterest
+--------------
+Per-client area-of-interest filtering of avatar and object transform updates.
+
+Updates for entities far from the client avatar are sent at a reduced rate, or held back
+until the entity is closer.  Only the most recent held-back update for each entity is kept,
+so a client always ends up with the latest transform of an entity once it is in range.
+=====================================================================*/
+namespace AreaOfInterest
+{
+	inline uint64 makeAvatarEntityKey(const UID& avatar_uid) { return avatar_uid.value() | (1ull << 63); }
+	inline uint64 makeObjectEntityKey(const UID& ob_uid) { return ob_uid.value() & ~(1ull << 63); }
+
+	// Appends the positional packets from tick_packets that should be sent to the client this tick to packets_out.
+	// Also appends any held-back packets whose entities are now close enough.  Updates client state.
+	// The pointers are into tick_packets and state, so are valid until either is next modified.
+	// cur_time is in seconds.  Returns the number of packets appended.
+	size_t getPacketsForClient(const AreaOfInterestConfig& config, double cur_time, const Vec3d& client_pos, const WorldTickPackets& tick_packets, ClientInterestState& state, std::vector<const PositionalPacket*>& packets_out);
+
+	// As above, but appends the packet data to data_out.
+	size_t appendPacketsForClient(const AreaOfInterestConfig& config, double cur_time, const Vec3d& client_pos, const WorldTickPackets& tick_packets, ClientInterestState& state, std::string& data_out);
+
+	void test();
+}
@@ -0,0 +1,45 @@
+/*=====================================================================
+BroadcastFrame.h
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Vector.h>
+#include <cstring>
+
+
+/*=====================================================================
+BroadcastFrame
+--------------
+An immutable buffer of packets that is sent to many clients.
+
+The main server thread builds one frame per world per tick, then enqueues a reference to it
+with every WorkerThread connected to that world.  Worker threads write the frame data directly
+to their socket, so the data is not copied per client.
+
+Must not be modified after it has been enqueued with a WorkerThread.
+=====================================================================*/
+class BroadcastFrame : public ThreadSafeRefCounted
+{
+public:
+	void append(const void* src, size_t len)
+	{
+		if(len > 0)
+		{
+			const size_t write_i = data.size();
+			data.resize(write_i + len);
+			std::memcpy(&data[write_i], src, len);
+		}
+	}
+
+	bool empty() const { return data.empty(); }
+	size_t size() const { return data.size(); }
+
+	js::Vector<uint8, 16> data;
+};
+
+typedef Reference<BroadcastFrame> BroadcastFrameRef;
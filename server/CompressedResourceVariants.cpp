@@ -0,0 +1,615 @@
+/*=====================================================================
+CompressedResourceVariants.cpp
+------------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "CompressedResourceVariants.h"
+
+
+#include "LODGenJobQueue.h"
+#include <Clock.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <FileUtils.h>
+#include <MemMappedFile.h>
+#include <Lock.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <limits>
+
+
+const double CompressedResourceVariants::MIN_SAVING_FRACTION = 0.1;
+
+static const int ZSTD_LEVEL = 19; // Variants are made once in the background and served many times, so use a slow, strong level.
+static const int ZSTD_WINDOW_LOG = 23; // Browsers only decode zstd Content-Encoding with windows of up to 8 MB.
+
+
+CompressedResourceVariants::CompressedResourceVariants()
+:	next_generation_id(1),
+	num_variants_generated(0),
+	num_variants_discarded(0)
+{
+	for(int i=0; i<NUM_ENCODINGS; ++i)
+	{
+		num_responses[i] = 0;
+		body_bytes_sent[i] = 0;
+		identity_bytes[i] = 0;
+	}
+}
+
+
+CompressedResourceVariants::~CompressedResourceVariants()
+{}
+
+
+bool CompressedResourceVariants::isCompressibleResource(const std::string& path)
+{
+	return
+		hasExtensionStringView(path, "bmesh") ||
+		hasExtensionStringView(path, "gltf") ||
+		hasExtensionStringView(path, "glb") ||
+		hasExtensionStringView(path, "bin") || // glTF buffers
+		hasExtensionStringView(path, "obj") ||
+		hasExtensionStringView(path, "stl") ||
+		hasExtensionStringView(path, "igmesh") ||
+		hasExtensionStringView(path, "vox") ||
+		hasExtensionStringView(path, "bmp") ||
+		hasExtensionStringView(path, "tga") ||
+		hasExtensionStringView(path, "hdr");
+}
+
+
+std::string CompressedResourceVariants::variantPath(const std::string& resource_path, Encoding encoding)
+{
+	switch(encoding)
+	{
+	case Encoding_Identity: return resource_path;
+	case Encoding_Gzip: return resource_path + ".gz";
+	case Encoding_Zstd: return resource_path + ".zst";
+	}
+	return resource_path;
+}
+
+
+const char* CompressedResourceVariants::encodingName(Encoding encoding)
+{
+	switch(encoding)
+	{
+	case Encoding_Identity: return "identity";
+	case Encoding_Gzip: return "gzip";
+	case Encoding_Zstd: return "zstd";
+	}
+	return "identity";
+}
+
+
+static std::string trimmedLowerCase(const std::string& s)
+{
+	size_t begin = 0;
+	while(begin < s.size() && (s[begin] == ' ' || s[begin] == '\t'))
+		begin++;
+	size_t end = s.size();
+	while(end > begin && (s[end - 1] == ' ' || s[end - 1] == '\t'))
+		end--;
+
+	std::string res = s.substr(begin, end - begin);
+	for(size_t i=0; i<res.size(); ++i)
+		if(res[i] >= 'A' && res[i] <= 'Z')
+			res[i] = res[i] - 'A' + 'a';
+	return res;
+}
+
+
+uint32 CompressedResourceVariants::parseAcceptEncoding(const std::string& accept_encoding)
+{
+	// See https://www.rfc-editor.org/rfc/rfc9110#name-accept-encoding
+	uint32 accepted_mask = 0;
+	uint32 named_mask = 0; // Encodings named explicitly.  These aren't affected by "*".
+	bool have_wildcard = false;
+	bool wildcard_accepted = false;
+
+	size_t i = 0;
+	while(i <= accept_encoding.size())
+	{
+		size_t end = accept_encoding.find(',', i);
+		if(end == std::string::npos)
+			end = accept_encoding.size();
+
+		const std::string element = accept_encoding.substr(i, end - i);
+		i = end + 1;
+
+		// Split into coding and parameters, e.g. "gzip;q=0.5"
+		const size_t semicolon_pos = element.find(';');
+		const std::string coding = trimmedLowerCase(element.substr(0, semicolon_pos));
+		double q = 1.0;
+		if(semicolon_pos != std::string::npos)
+		{
+			const std::string param = trimmedLowerCase(element.substr(semicolon_pos + 1));
+			if(param.size() >= 2 && param[0] == 'q' && param[1] == '=')
+				q = std::strtod(param.c_str() + 2, NULL);
+		}
+
+		if(coding == "*")
+		{
+			have_wildcard = true;
+			wildcard_accepted = q > 0;
+			continue;
+		}
+
+		int encoding;
+		if(coding == "identity")
+			encoding = Encoding_Identity;
+		else if(coding == "gzip" || coding == "x-gzip")
+			encoding = Encoding_Gzip;
+		else if(coding == "zstd")
+			encoding = Encoding_Zstd;
+		else
+			continue;
+
+		named_mask |= 1u << encoding;
+		if(q > 0)
+			accepted_mask |= 1u << encoding;
+	}
+
+	for(int e=0; e<NUM_ENCODINGS; ++e)
+		if(!(named_mask & (1u << e)))
+		{
+			if(have_wildcard ? wildcard_accepted : (e == Encoding_Identity)) // Identity is acceptable unless excluded explicitly or by "*;q=0".
+				accepted_mask |= 1u << e;
+		}
+
+	return accepted_mask;
+}
+
+
+uint32 CompressedResourceVariants::lookupVariantMask(const std::string& resource_path, bool& should_queue_generation_out)
+{
+	should_queue_generation_out = false;
+	{
+		Lock lock(mutex);
+		auto res = variant_info.find(resource_path);
+		if(res != variant_info.end())
+			return res->second.variant_mask;
+	}
+
+	// We haven't seen this resource since the server started.  Check for variants made by an earlier run.
+	uint32 disk_mask = 0;
+	for(int e=Encoding_Gzip; e<NUM_ENCODINGS; ++e)
+		if(FileUtils::fileExists(variantPath(resource_path, (Encoding)e)))
+			disk_mask |= 1u << e;
+
+	Lock lock(mutex);
+	auto res = variant_info.find(resource_path);
+	if(res != variant_info.end()) // If another thread inserted info while we were checking the disk, use that.
+		return res->second.variant_mask;
+
+	VariantInfo info;
+	info.variant_mask = disk_mask;
+	info.generation_queued = true;
+	info.generation_id = 0;
+	variant_info[resource_path] = info;
+
+	// If there are no variants on disk, have the caller queue generation.  (Earlier variants may not have been worth keeping, but we can't tell)
+	should_queue_generation_out = disk_mask == 0;
+	return disk_mask;
+}
+
+
+CompressedResourceVariants::Encoding CompressedResourceVariants::findVariant(const std::string& resource_path, uint32 accepted_encodings_mask, std::string& variant_path_out,
+	bool& should_queue_generation_out)
+{
+	const uint32 variant_mask = lookupVariantMask(resource_path, should_queue_generation_out);
+
+	// zstd variants are usually smaller than gzip variants, and faster to decompress, so prefer them.
+	const Encoding preference_order[] = { Encoding_Zstd, Encoding_Gzip };
+	for(size_t i=0; i<staticArrayNumElems(preference_order); ++i)
+	{
+		const uint32 bit = 1u << preference_order[i];
+		if((variant_mask & bit) && (accepted_encodings_mask & bit))
+		{
+			variant_path_out = variantPath(resource_path, preference_order[i]);
+			return preference_order[i];
+		}
+	}
+
+	variant_path_out = resource_path;
+	return Encoding_Identity;
+}
+
+
+bool CompressedResourceVariants::markGenerationQueued(const std::string& resource_path)
+{
+	Lock lock(mutex);
+
+	auto res = variant_info.find(resource_path);
+	if(res == variant_info.end())
+	{
+		VariantInfo info;
+		info.variant_mask = 0;
+		info.generation_queued = true;
+		info.generation_id = 0;
+		variant_info[resource_path] = info;
+		return true;
+	}
+	else
+	{
+		const bool was_queued = res->second.generation_queued;
+		res->second.generation_queued = true;
+		return !was_queued;
+	}
+}
+
+
+void CompressedResourceVariants::queueGeneration(LODGenJobQueue& job_queue, const std::string& resource_URL, const std::string& resource_path)
+{
+	LODGenJob job;
+	job.type = LODGenJob::Type_CompressedVariants;
+	job.src_abs_path = resource_path;
+	job.output_URL = resource_URL + LODGenJob::COMPRESSED_VARIANTS_URL_SUFFIX;
+	job.last_request_time = Clock::getCurTimeRealSec();
+
+	job_queue.enqueueJobs(std::vector<LODGenJob>(1, job));
+}
+
+
+static void compressGzip(const uint8* data, size_t size, std::vector<uint8>& compressed_out)
+{
+	if(size > (size_t)std::numeric_limits<uInt>::max())
+		throw glare::Exception("File too large for gzip compression.");
+
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+	// Adding 16 to windowBits makes zlib write a gzip header and trailer instead of a zlib wrapper.
+	if(deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, /*windowBits=*/15 + 16, /*memLevel=*/9, Z_DEFAULT_STRATEGY) != Z_OK)
+		throw glare::Exception("deflateInit2 failed.");
+
+	compressed_out.resize(deflateBound(&stream, (uLong)size));
+
+	stream.next_in = (Bytef*)data;
+	stream.avail_in = (uInt)size;
+	stream.next_out = compressed_out.data();
+	stream.avail_out = (uInt)compressed_out.size();
+
+	const int result = deflate(&stream, Z_FINISH);
+	const size_t compressed_size = stream.total_out;
+	deflateEnd(&stream);
+
+	if(result != Z_STREAM_END)
+		throw glare::Exception("gzip compression failed.");
+
+	compressed_out.resize(compressed_size);
+}
+
+
+static void compressZstd(const uint8* data, size_t size, std::vector<uint8>& compressed_out)
+{
+	ZSTD_CCtx* context = ZSTD_createCCtx();
+	if(!context)
+		throw glare::Exception("ZSTD_createCCtx failed.");
+
+	ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, ZSTD_LEVEL);
+	ZSTD_CCtx_setParameter(context, ZSTD_c_windowLog, ZSTD_WINDOW_LOG);
+	ZSTD_CCtx_setParameter(context, ZSTD_c_contentSizeFlag, 1); // Lets native clients check the decompressed size.
+
+	compressed_out.resize(ZSTD_compressBound(size));
+	const size_t result = ZSTD_compress2(context, compressed_out.data(), compressed_out.size(), data, size);
+	ZSTD_freeCCtx(context);
+
+	if(ZSTD_isError(result))
+		throw glare::Exception("zstd compression failed: " + std::string(ZSTD_getErrorName(result)));
+
+	compressed_out.resize(result);
+}
+
+
+void CompressedResourceVariants::generateVariants(const std::string& resource_path)
+{
+	// Take a generation id, so we can tell if the resource is invalidated (e.g. overwritten by an upload) while we are compressing it.
+	uint64 generation_id;
+	{
+		Lock lock(mutex);
+		generation_id = next_generation_id++;
+		auto res = variant_info.find(resource_path);
+		if(res == variant_info.end())
+		{
+			VariantInfo info;
+			info.variant_mask = 0;
+			res = variant_info.insert(std::make_pair(resource_path, info)).first;
+		}
+		res->second.generation_queued = true;
+		res->second.generation_id = generation_id;
+	}
+
+	try
+	{
+		MemMappedFile file(resource_path);
+		const uint8* data = (const uint8*)file.fileData();
+		const size_t size = file.fileSize();
+		const size_t max_variant_size = (size_t)((double)size * (1.0 - MIN_SAVING_FRACTION));
+
+		// Write variants to temporary files.  They are renamed into place below, if the resource hasn't been invalidated in the meantime.
+		uint32 variant_mask = 0;
+		uint64 num_kept = 0;
+		uint64 num_discarded = 0;
+		std::vector<uint8> compressed;
+		for(int e=Encoding_Gzip; e<NUM_ENCODINGS; ++e)
+		{
+			if(e == Encoding_Gzip)
+				compressGzip(data, size, compressed);
+			else
+				compressZstd(data, size, compressed);
+
+			if(compressed.size() <= max_variant_size)
+			{
+				FileUtils::writeEntireFile(variantPath(resource_path, (Encoding)e) + ".tmp", (const char*)compressed.data(), compressed.size());
+				variant_mask |= 1u << e;
+				num_kept++;
+			}
+			else
+				num_discarded++;
+		}
+
+		Lock lock(mutex);
+
+		auto res = variant_info.find(resource_path);
+		const bool still_valid = (res != variant_info.end()) && (res->second.generation_id == generation_id);
+		for(int e=Encoding_Gzip; e<NUM_ENCODINGS; ++e)
+			if(variant_mask & (1u << e))
+			{
+				const std::string path = variantPath(resource_path, (Encoding)e);
+				if(still_valid)
+					FileUtils::moveFile(path + ".tmp", path);
+				else
+					FileUtils::deleteFile(path + ".tmp");
+			}
+
+		if(still_valid)
+		{
+			res->second.variant_mask = variant_mask;
+			num_variants_generated += num_kept;
+			num_variants_discarded += num_discarded;
+		}
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+}
+
+
+void CompressedResourceVariants::invalidateVariants(const std::string& resource_path)
+{
+	try
+	{
+		Lock lock(mutex);
+
+		variant_info.erase(resource_path); // Any generation currently running for the resource will discard its output.
+
+		for(int e=Encoding_Gzip; e<NUM_ENCODINGS; ++e)
+		{
+			const std::string path = variantPath(resource_path, (Encoding)e);
+			if(FileUtils::fileExists(path))
+				FileUtils::deleteFile(path);
+		}
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+}
+
+
+void CompressedResourceVariants::recordResponse(Encoding encoding, uint64 body_size, uint64 identity_size)
+{
+	Lock lock(mutex);
+
+	num_responses[encoding]++;
+	body_bytes_sent[encoding] += body_size;
+	identity_bytes[encoding] += identity_size;
+}
+
+
+std::string CompressedResourceVariants::toHTML() const
+{
+	Lock lock(mutex);
+
+	std::string s;
+	s += "<p>Resources with variant info: " + toString(variant_info.size()) + ", variants generated: " + toString(num_variants_generated) +
+		", variants discarded (not small enough): " + toString(num_variants_discarded) + "</p>";
+
+	s += "<table><tr><th>encoding</th><th>responses</th><th>bytes sent</th><th>resource bytes</th><th>saving</th></tr>";
+	for(int e=0; e<NUM_ENCODINGS; ++e)
+	{
+		const double saving = (identity_bytes[e] > 0) ? (1.0 - (double)body_bytes_sent[e] / identity_bytes[e]) : 0.0;
+		s += std::string("<tr><td>") + encodingName((Encoding)e) + "</td><td>" + toString(num_responses[e]) + "</td><td>" + toString(body_bytes_sent[e] / 1024) + " KB</td><td>" +
+			toString(identity_bytes[e] / 1024) + " KB</td><td>" + doubleToStringNSigFigs(saving * 100, 3) + " %</td></tr>";
+	}
+	s += "</table>";
+	return s;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/PlatformUtils.h>
+#include <maths/PCG32.h>
+
+
+static std::vector<uint8> readVariant(const std::string& path)
+{
+	MemMappedFile file(path);
+	return std::vector<uint8>((const uint8*)file.fileData(), (const uint8*)file.fileData() + file.fileSize());
+}
+
+
+static std::vector<uint8> decompressGzip(const std::vector<uint8>& compressed, size_t decompressed_size)
+{
+	std::vector<uint8> decompressed(decompressed_size);
+
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+	testAssert(inflateInit2(&stream, /*windowBits=*/15 + 16) == Z_OK);
+	stream.next_in = (Bytef*)compressed.data();
+	stream.avail_in = (uInt)compressed.size();
+	stream.next_out = decompressed.data();
+	stream.avail_out = (uInt)decompressed.size();
+	const int result = inflate(&stream, Z_FINISH);
+	testAssert(result == Z_STREAM_END);
+	testAssert(stream.total_out == decompressed_size);
+	inflateEnd(&stream);
+	return decompressed;
+}
+
+
+static std::vector<uint8> decompressZstd(const std::vector<uint8>& compressed)
+{
+	const unsigned long long decompressed_size = ZSTD_getFrameContentSize(compressed.data(), compressed.size());
+	testAssert(decompressed_size != ZSTD_CONTENTSIZE_UNKNOWN && decompressed_size != ZSTD_CONTENTSIZE_ERROR);
+
+	std::vector<uint8> decompressed((size_t)decompressed_size);
+	const size_t result = ZSTD_decompress(decompressed.data(), decompressed.size(), compressed.data(), compressed.size());
+	testAssert(!ZSTD_isError(result) && result == decompressed_size);
+	return decompressed;
+}
+
+
+void CompressedResourceVariants::test()
+{
+	conPrint("CompressedResourceVariants::test()");
+
+	const uint32 identity_bit = 1u << Encoding_Identity;
+	const uint32 gzip_bit = 1u << Encoding_Gzip;
+	const uint32 zstd_bit = 1u << Encoding_Zstd;
+
+	//-------------------- Test parseAcceptEncoding --------------------
+	testAssert(parseAcceptEncoding("") == identity_bit);
+	testAssert(parseAcceptEncoding("gzip") == (identity_bit | gzip_bit));
+	testAssert(parseAcceptEncoding("gzip, deflate, br, zstd") == (identity_bit | gzip_bit | zstd_bit)); // Chrome
+	testAssert(parseAcceptEncoding("gzip, deflate, br") == (identity_bit | gzip_bit)); // Firefox, Safari
+	testAssert(parseAcceptEncoding("  ZSTD ;q=0.8 ,GZip") == (identity_bit | gzip_bit | zstd_bit));
+	testAssert(parseAcceptEncoding("x-gzip") == (identity_bit | gzip_bit));
+	testAssert(parseAcceptEncoding("gzip;q=0, zstd") == (identity_bit | zstd_bit));
+	testAssert(parseAcceptEncoding("gzip;q=0.0") == identity_bit);
+	testAssert(parseAcceptEncoding("*") == (identity_bit | gzip_bit | zstd_bit));
+	testAssert(parseAcceptEncoding("gzip;q=0, *") == (identity_bit | zstd_bit));
+	testAssert(parseAcceptEncoding("zstd, *;q=0") == zstd_bit);
+	testAssert(parseAcceptEncoding("zstd, identity;q=0") == zstd_bit);
+	testAssert(parseAcceptEncoding("identity") == identity_bit);
+	testAssert(parseAcceptEncoding(",,;") == identity_bit);
+
+	//-------------------- Test isCompressibleResource --------------------
+	testAssert(isCompressibleResource("cube_5438347426447337425.bmesh"));
+	testAssert(isCompressibleResource("a/b/model.OBJ"));
+	testAssert(isCompressibleResource("tex.tga"));
+	testAssert(!isCompressibleResource("tex.jpg"));
+	testAssert(!isCompressibleResource("tex.ktx2"));
+	testAssert(!isCompressibleResource("video.mp4"));
+	testAssert(!isCompressibleResource("obj"));
+
+	//-------------------- Test generating and finding variants --------------------
+	const std::string compressible_path = PlatformUtils::getTempDirPath() + "/compressed_resource_variants_test.obj";
+	const std::string incompressible_path = PlatformUtils::getTempDirPath() + "/compressed_resource_variants_test.bmesh";
+	try
+	{
+		// Make an OBJ-like text file, which should compress well, and a random file, which shouldn't compress at all.
+		std::string obj;
+		PCG32 rng(1);
+		for(int i=0; i<20000; ++i)
+			obj += "v " + toString((int)(rng.unitRandom() * 100)) + ".5 1.0 " + toString((int)(rng.unitRandom() * 10)) + ".25\n";
+		FileUtils::writeEntireFile(compressible_path, obj.data(), obj.size());
+
+		std::vector<uint8> random_data(100000);
+		for(size_t i=0; i<random_data.size(); ++i)
+			random_data[i] = (uint8)(rng.genrand_int32() >> 24);
+		FileUtils::writeEntireFile(incompressible_path, (const char*)random_data.data(), random_data.size());
+
+		{
+			CompressedResourceVariants variants;
+			variants.invalidateVariants(compressible_path); // Remove any variants left over from earlier runs.
+			variants.invalidateVariants(incompressible_path);
+
+			// Before generation, findVariant should return identity, and ask for generation to be queued, once.
+			std::string variant_path;
+			bool should_queue;
+			testAssert(variants.findVariant(compressible_path, identity_bit | gzip_bit | zstd_bit, variant_path, should_queue) == Encoding_Identity);
+			testAssert(variant_path == compressible_path);
+			testAssert(should_queue);
+			testAssert(variants.findVariant(compressible_path, identity_bit | gzip_bit | zstd_bit, variant_path, should_queue) == Encoding_Identity);
+			testAssert(!should_queue);
+			testAssert(!variants.markGenerationQueued(compressible_path));
+
+			testAssert(variants.markGenerationQueued(incompressible_path));
+			testAssert(!variants.markGenerationQueued(incompressible_path));
+
+			variants.generateVariants(compressible_path);
+			variants.generateVariants(incompressible_path);
+
+			// zstd should be preferred if accepted.
+			testAssert(variants.findVariant(compressible_path, identity_bit | gzip_bit | zstd_bit, variant_path, should_queue) == Encoding_Zstd);
+			testAssert(variant_path == compressible_path + ".zst");
+			testAssert(!should_queue);
+			testAssert(variants.findVariant(compressible_path, identity_bit | gzip_bit, variant_path, should_queue) == Encoding_Gzip);
+			testAssert(variant_path == compressible_path + ".gz");
+			testAssert(variants.findVariant(compressible_path, identity_bit, variant_path, should_queue) == Encoding_Identity);
+			testAssert(variant_path == compressible_path);
+
+			// Check the variants decompress to the resource.
+			const std::vector<uint8> zstd_variant = readVariant(compressible_path + ".zst");
+			const std::vector<uint8> gzip_variant = readVariant(compressible_path + ".gz");
+			conPrint("OBJ size: " + toString(obj.size()) + " B, gzip: " + toString(gzip_variant.size()) + " B, zstd: " + toString(zstd_variant.size()) + " B");
+			testAssert(zstd_variant.size() < obj.size() / 2);
+			testAssert(gzip_variant.size() < obj.size() / 2);
+			testAssert(decompressZstd(zstd_variant) == std::vector<uint8>(obj.begin(), obj.end()));
+			testAssert(decompressGzip(gzip_variant, obj.size()) == std::vector<uint8>(obj.begin(), obj.end()));
+
+			// Variants of incompressible data shouldn't be kept.
+			testAssert(variants.findVariant(incompressible_path, identity_bit | gzip_bit | zstd_bit, variant_path, should_queue) == Encoding_Identity);
+			testAssert(!should_queue);
+			testAssert(!FileUtils::fileExists(incompressible_path + ".zst"));
+			testAssert(!FileUtils::fileExists(incompressible_path + ".gz"));
+			testAssert(!FileUtils::fileExists(compressible_path + ".zst.tmp"));
+		}
+
+		// A new instance (e.g. after a server restart) should find the variants on disk, and not ask for generation.
+		{
+			CompressedResourceVariants variants;
+			std::string variant_path;
+			bool should_queue;
+			testAssert(variants.findVariant(compressible_path, identity_bit | gzip_bit | zstd_bit, variant_path, should_queue) == Encoding_Zstd);
+			testAssert(!should_queue);
+
+			// Invalidating should delete the variants, and ask for generation again.
+			variants.invalidateVariants(compressible_path);
+			testAssert(!FileUtils::fileExists(compressible_path + ".zst"));
+			testAssert(!FileUtils::fileExists(compressible_path + ".gz"));
+			testAssert(variants.findVariant(compressible_path, identity_bit | gzip_bit | zstd_bit, variant_path, should_queue) == Encoding_Identity);
+			testAssert(should_queue);
+
+			variants.recordResponse(Encoding_Zstd, 100, 1000);
+			variants.recordResponse(Encoding_Identity, 1000, 1000);
+			testAssert(!variants.toHTML().empty());
+		}
+
+		FileUtils::deleteFile(compressible_path);
+		FileUtils::deleteFile(incompressible_path);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("CompressedResourceVariants::test() done.");
+}
+
+
+#endif // BUILD_TESTS
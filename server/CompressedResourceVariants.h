@@ -0,0 +1,107 @@
+/*=====================================================================
+CompressedResourceVariants.h
+----------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <Mutex.h>
+#include <string>
+#include <unordered_map>
+class LODGenJobQueue;
+
+
+/*=====================================================================
+CompressedResourceVariants
+--------------------------
+Precompressed gzip and zstd copies ('variants') of compressible resources, such as meshes
+and uncompressed textures.
+
+Variants are stored next to the resource file, with ".gz" or ".zst" appended to the path.
+They are made by LODGenWorkerThreads (LODGenJob::Type_CompressedVariants jobs), which are queued when a
+resource is uploaded, or when a variant of a resource is first requested.
+A variant is only kept if it is at least MIN_SAVING_FRACTION smaller than the resource, so resources that
+are already compressed (e.g. most bmesh files) are just served as they are.
+
+Variants are served by ResourceHandlers::handleResourceRequest to HTTP clients that accept the encoding,
+and by WorkerThread::handleResourceDownloadConnection to clients that send GetFilesCompressed.
+
+Brotli isn't available in this tree, so 'br' is never offered.
+
+Threadsafe.
+=====================================================================*/
+class CompressedResourceVariants
+{
+public:
+	CompressedResourceVariants();
+	~CompressedResourceVariants();
+
+	enum Encoding
+	{
+		Encoding_Identity = 0,
+		Encoding_Gzip = 1,
+		Encoding_Zstd = 2
+	};
+	static const int NUM_ENCODINGS = 3;
+
+	static const double MIN_SAVING_FRACTION;
+
+	static bool isCompressibleResource(const std::string& path); // Decided by the file extension.
+
+	static std::string variantPath(const std::string& resource_path, Encoding encoding);
+
+	static const char* encodingName(Encoding encoding); // Returns the Content-Encoding token, e.g. "gzip".
+
+	// Returns a mask with bit (1 << encoding) set for each encoding accepted by an Accept-Encoding header value.
+	// Identity is accepted unless explicitly excluded.
+	static uint32 parseAcceptEncoding(const std::string& accept_encoding);
+
+	// Returns the smallest-on-average encoding in accepted_encodings_mask with a variant of the resource on disk, and sets variant_path_out to the variant path.
+	// Returns Encoding_Identity if there is no such variant.
+	// Sets should_queue_generation_out to true if variants of the resource haven't been generated or queued yet, in which case the caller should queue a
+	// LODGenJob::Type_CompressedVariants job.
+	Encoding findVariant(const std::string& resource_path, uint32 accepted_encodings_mask, std::string& variant_path_out, bool& should_queue_generation_out);
+
+	// Returns true if variants of the resource haven't been generated or queued yet.  Marks them as queued, so only returns true once per resource.
+	bool markGenerationQueued(const std::string& resource_path);
+
+	// Adds a LODGenJob::Type_CompressedVariants job for the resource to job_queue.
+	static void queueGeneration(LODGenJobQueue& job_queue, const std::string& resource_URL, const std::string& resource_path);
+
+	// Writes the variants of the resource that are worth keeping.  Throws glare::Exception on failure.
+	void generateVariants(const std::string& resource_path);
+
+	// Deletes any variants of the resource, for when the resource file is about to be overwritten.
+	void invalidateVariants(const std::string& resource_path);
+
+	// Records a response, for the admin page.  identity_size is the size of the resource.
+	void recordResponse(Encoding encoding, uint64 body_size, uint64 identity_size);
+
+	std::string toHTML() const; // For the admin page.
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(CompressedResourceVariants)
+
+	uint32 lookupVariantMask(const std::string& resource_path, bool& should_queue_generation_out);
+
+	struct VariantInfo
+	{
+		uint32 variant_mask; // Bit (1 << encoding) is set if the variant is on disk.
+		bool generation_queued; // Has a generation job been queued, or run, since this process started?
+		uint64 generation_id; // Id of the most recent generateVariants() call for the resource, or 0 if none.
+	};
+
+	mutable Mutex mutex;
+	std::unordered_map<std::string, VariantInfo> variant_info	GUARDED_BY(mutex); // Map from resource path to info about its variants.
+
+	uint64 next_generation_id									GUARDED_BY(mutex);
+	uint64 num_variants_generated								GUARDED_BY(mutex);
+	uint64 num_variants_discarded								GUARDED_BY(mutex); // Number of variants not kept as they were not small enough.
+	uint64 num_responses[NUM_ENCODINGS]							GUARDED_BY(mutex);
+	uint64 body_bytes_sent[NUM_ENCODINGS]						GUARDED_BY(mutex);
+	uint64 identity_bytes[NUM_ENCODINGS]						GUARDED_BY(mutex); // Sum of resource sizes for responses with each encoding.
+};
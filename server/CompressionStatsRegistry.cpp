@@ -0,0 +1,87 @@
+/*=====================================================================
+CompressionStatsRegistry.cpp
+----------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "CompressionStatsRegistry.h"
+
+
+#include <Escaping.h>
+#include <Lock.h>
+#include <Clock.h>
+#include <StringUtils.h>
+
+
+CompressionStatsRegistry::CompressionStatsRegistry()
+:	next_connection_id(1),
+	num_closed_connections(0)
+{}
+
+
+uint64 CompressionStatsRegistry::addConnection(const std::string& description, bool using_dictionary)
+{
+	Lock lock(mutex);
+
+	const uint64 connection_id = next_connection_id++;
+	ConnectionInfo& info = connections[connection_id];
+	info.description = description;
+	info.using_dictionary = using_dictionary;
+	info.start_time = Clock::getCurTimeRealSec();
+	return connection_id;
+}
+
+
+void CompressionStatsRegistry::updateConnection(uint64 connection_id, const StreamCompression::Stats& stats)
+{
+	Lock lock(mutex);
+
+	auto res = connections.find(connection_id);
+	if(res != connections.end())
+		res->second.stats = stats;
+}
+
+
+void CompressionStatsRegistry::removeConnection(uint64 connection_id)
+{
+	Lock lock(mutex);
+
+	auto res = connections.find(connection_id);
+	if(res != connections.end())
+	{
+		closed_connection_stats.uncompressed_bytes	+= res->second.stats.uncompressed_bytes;
+		closed_connection_stats.compressed_bytes	+= res->second.stats.compressed_bytes;
+		closed_connection_stats.compress_time		+= res->second.stats.compress_time;
+		num_closed_connections++;
+
+		connections.erase(res);
+	}
+}
+
+
+static std::string statsTableCells(const StreamCompression::Stats& stats)
+{
+	const double ratio = (stats.compressed_bytes > 0) ? ((double)stats.uncompressed_bytes / stats.compressed_bytes) : 0.0;
+	const double time_per_MB = (stats.uncompressed_bytes > 0) ? (stats.compress_time / (stats.uncompressed_bytes * 1.0e-6)) : 0.0;
+
+	return "<td>" + toString(stats.uncompressed_bytes / 1024) + " KB</td><td>" + toString(stats.compressed_bytes / 1024) + " KB</td><td>" + doubleToStringNSigFigs(ratio, 3) + "</td>" +
+		"<td>" + doubleToStringNSigFigs(stats.compress_time * 1.0e3, 3) + " ms</td><td>" + doubleToStringNSigFigs(time_per_MB * 1.0e3, 3) + " ms</td>";
+}
+
+
+std::string CompressionStatsRegistry::toHTML(double cur_time) const
+{
+	Lock lock(mutex);
+
+	std::string s;
+	s += "<table><tr><th>connection</th><th>dictionary</th><th>uncompressed</th><th>compressed</th><th>ratio</th><th>compress CPU time</th><th>CPU time / MB</th><th>CPU usage</th></tr>";
+	for(auto it = connections.begin(); it != connections.end(); ++it)
+	{
+		const ConnectionInfo& info = it->second;
+		const double elapsed = cur_time - info.start_time;
+		s += "<tr><td>" + web::Escaping::HTMLEscape(info.description) + "</td><td>" + (info.using_dictionary ? "yes" : "no") + "</td>" + statsTableCells(info.stats) +
+			"<td>" + ((elapsed > 0) ? (doubleToStringNSigFigs(info.stats.compress_time / elapsed * 100, 3) + " %") : std::string("-")) + "</td></tr>";
+	}
+	s += "<tr><td>" + toString(num_closed_connections) + " closed connections</td><td></td>" + statsTableCells(closed_connection_stats) + "<td></td></tr>";
+	s += "</table>";
+	return s;
+}
@@ -0,0 +1,50 @@
+/*=====================================================================
+CompressionStatsRegistry.h
+--------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/StreamCompression.h"
+#include <Platform.h>
+#include <Mutex.h>
+#include <map>
+#include <string>
+
+
+/*=====================================================================
+CompressionStatsRegistry
+------------------------
+Stream compression stats of each client connection with compression enabled, for the admin page.
+See shared/StreamCompression.h
+
+Threadsafe.
+=====================================================================*/
+class CompressionStatsRegistry
+{
+public:
+	CompressionStatsRegistry();
+
+	// Returns an id for the connection, for passing to updateConnection() and removeConnection().
+	uint64 addConnection(const std::string& description, bool using_dictionary);
+	void updateConnection(uint64 connection_id, const StreamCompression::Stats& stats);
+	void removeConnection(uint64 connection_id); // Adds the connection stats to the totals for closed connections.
+
+	std::string toHTML(double cur_time) const; // For the admin pages.  cur_time is Clock::getCurTimeRealSec().
+
+private:
+	struct ConnectionInfo
+	{
+		std::string description;
+		bool using_dictionary;
+		double start_time; // Clock::getCurTimeRealSec() when compression was enabled.
+		StreamCompression::Stats stats;
+	};
+
+	mutable Mutex mutex;
+	std::map<uint64, ConnectionInfo> connections	GUARDED_BY(mutex);
+	uint64 next_connection_id						GUARDED_BY(mutex);
+	StreamCompression::Stats closed_connection_stats	GUARDED_BY(mutex); // Totals over closed connections.
+	uint64 num_closed_connections					GUARDED_BY(mutex);
+};
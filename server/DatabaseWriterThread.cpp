@@ -0,0 +1,123 @@
+/*=====================================================================
+DatabaseWriterThread.cpp
+------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "DatabaseWriterThread.h"
+
+
+#include "ServerWorldState.h"
+#include <ConPrint.h>
+#include <Exception.h>
+#include <Lock.h>
+#include <StringUtils.h>
+#include <mathstypes.h>
+#include <PlatformUtils.h>
+#include <Clock.h>
+#include <Timer.h>
+#include <KillThreadMessage.h>
+
+
+DatabaseWriterThread::DatabaseWriterThread(ServerAllWorldsState* world_state_)
+:	retry_period(10.0),
+	world_state(world_state_)
+{
+}
+
+
+DatabaseWriterThread::~DatabaseWriterThread()
+{
+}
+
+
+void DatabaseWriterThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("DatabaseWriterThread");
+
+	while(1)
+	{
+		// Block until we have a message.  If there are failed snapshots to retry, only wait until it's time to retry them.
+		ThreadMessageRef msg;
+		std::vector<ThreadMessageRef> msgs;
+		if(failed_snapshots.empty())
+		{
+			getMessageQueue().dequeue(msg);
+			msgs.push_back(msg);
+		}
+		else
+		{
+			if(getMessageQueue().dequeueWithTimeout(retry_period, msg))
+				msgs.push_back(msg);
+		}
+
+		// Take any other snapshots that have been queued as well, so they can be written with a single flush.
+		{
+			Lock lock(getMessageQueue().getMutex());
+			while(!getMessageQueue().unlockedEmpty())
+			{
+				getMessageQueue().unlockedDequeue(msg);
+				msgs.push_back(msg);
+			}
+		}
+
+		// Write any previously failed snapshots first, so that snapshots are written in the order they were made.
+		std::vector<Reference<DatabaseSnapshot>> snapshots;
+		snapshots.swap(failed_snapshots);
+		bool should_quit = false;
+		for(size_t i=0; i<msgs.size(); ++i)
+		{
+			if(dynamic_cast<DatabaseSnapshot*>(msgs[i].ptr()))
+				snapshots.push_back(Reference<DatabaseSnapshot>(static_cast<DatabaseSnapshot*>(msgs[i].ptr())));
+			else if(dynamic_cast<KillThreadMessage*>(msgs[i].ptr()))
+				should_quit = true; // Write any snapshots we have first.
+		}
+
+		if(!snapshots.empty())
+		{
+			Timer timer;
+			try
+			{
+				const size_t bytes_written = world_state->writeDatabaseSnapshots(snapshots);
+
+				const double cur_time = Clock::getCurTimeRealSec();
+				double max_latency = 0;
+				double total_lock_hold_time = 0;
+				std::string summary;
+				for(size_t i=0; i<snapshots.size(); ++i)
+				{
+					const double latency = cur_time - snapshots[i]->snapshot_time;
+					world_state->db_save_latency_histogram.addSample(latency);
+					world_state->db_snapshot_lock_hold_histogram.addSample(snapshots[i]->lock_hold_time);
+					max_latency = myMax(max_latency, latency);
+					total_lock_hold_time += snapshots[i]->lock_hold_time;
+					summary += ((i > 0) ? "; " : "") + snapshots[i]->summary;
+				}
+
+				world_state->db_num_saves.increment();
+				world_state->db_num_snapshots_written.add((int64)snapshots.size());
+				world_state->db_total_bytes_written.add((int64)bytes_written);
+
+				conPrint("DatabaseWriterThread: Saved " + summary + " (" + toString(snapshots.size()) + " snapshot(s), " + toString(bytes_written) + " B) in " + timer.elapsedStringNSigFigs(4) +
+					", save latency: " + doubleToStringNSigFigs(max_latency, 4) + " s, lock held for " + doubleToStringNSigFigs(total_lock_hold_time * 1.0e3, 4) + " ms");
+
+				world_state->db_num_snapshots_pending.add(-(int64)snapshots.size());
+			}
+			catch(glare::Exception& e)
+			{
+				// The dirty sets were cleared when the snapshots were made, so the snapshots are the only copy of these changes.  Keep them and try again later.
+				// They stay counted in db_num_snapshots_pending, so the main thread will defer making new snapshots if we stay behind.
+				conPrint("Warning: DatabaseWriterThread: saving world state to disk failed: " + e.what() + ".  Will retry " + toString(snapshots.size()) + " snapshot(s) in " + 
+					doubleToStringNSigFigs(retry_period, 3) + " s.");
+				world_state->db_num_write_failures.increment();
+				failed_snapshots = snapshots;
+			}
+		}
+
+		if(should_quit)
+		{
+			if(!failed_snapshots.empty())
+				conPrint("Error: DatabaseWriterThread: quitting with " + toString(failed_snapshots.size()) + " unwritten snapshot(s), changes in them have been lost.");
+			return;
+		}
+	}
+}
@@ -0,0 +1,44 @@
+/*=====================================================================
+DatabaseWriterThread.h
+----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <MessageableThread.h>
+#include <Reference.h>
+#include <vector>
+class ServerAllWorldsState;
+class DatabaseSnapshot;
+
+
+/*=====================================================================
+DatabaseWriterThread
+--------------------
+Writes DatabaseSnapshot messages to the database on disk, so that the
+main server loop doesn't have to hold the world state mutex while the
+database is written and flushed.
+
+All snapshots that are queued when the thread wakes up are written
+together, with a single flush (group commit).
+
+If a write fails, the snapshots are kept and retried every retry_period
+seconds, before any later snapshots, so no changes are lost and
+snapshots are always written in order.
+=====================================================================*/
+class DatabaseWriterThread : public MessageableThread
+{
+public:
+	DatabaseWriterThread(ServerAllWorldsState* world_state);
+
+	virtual ~DatabaseWriterThread();
+
+	virtual void doRun();
+
+	double retry_period; // Time to wait before retrying a failed write, in seconds.
+
+private:
+	ServerAllWorldsState* world_state;
+	std::vector<Reference<DatabaseSnapshot>> failed_snapshots; // Snapshots whose write failed, to be written again before any later snapshots.
+};
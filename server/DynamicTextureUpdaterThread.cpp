@@ -45,7 +45,8 @@ struct ObWithDynamicTexture
 
 
 // See if object has a server-side script, if so, add info about it to obs_with_dyn_textures_out.
-static void checkForDynamicTextureToCheck(const std::string& world_name, WorldObject* ob, ServerAllWorldsState* world_state, std::vector<ObWithDynamicTexture>& obs_with_dyn_textures_out) REQUIRES(world_state->mutex)
+// The mutex for the world containing ob should be held, as well as users_mutex.
+static void checkForDynamicTextureToCheck(const std::string& world_name, WorldObject* ob, ServerAllWorldsState* world_state, std::vector<ObWithDynamicTexture>& obs_with_dyn_textures_out) REQUIRES(world_state->users_mutex)
 {
 	if(!ob->script.empty())
 	{
@@ -136,7 +137,7 @@ static std::string fetchFileForURLAndAddAsResource(const std::string& base_URL,
 		conPrint("\tDynamicTextureUpdaterThread: current/new URL: " + URL + "");
 
 		{
-			Lock lock(world_state->mutex);
+			InstrumentedLock lock(world_state->resources_mutex);
 
 			if(!world_state->resource_manager->isFileForURLPresent(URL))
 			{
@@ -198,61 +199,83 @@ static void checkDynamicTexture(const ObWithDynamicTexture& ob_with_dyn_tex, Ser
 	else
 	{
 		{
-			Lock lock(world_state->mutex);
+			Reference<ServerWorldState> world;
+			{
+				InstrumentedLock lock(world_state->mutex);
+				world = world_state->world_states[ob_with_dyn_tex.world_name];
+			}
+
+			InstrumentedLock world_lock(world->mutex);
 
 			const std::string substrata_URL = fetch_results.substrata_URL;
 
 			// Update object to use new texture
-			const auto ob_res = world_state->world_states[ob_with_dyn_tex.world_name]->objects.find(ob_with_dyn_tex.ob_uid);
-			if(ob_res != world_state->world_states[ob_with_dyn_tex.world_name]->objects.end())
+			const auto ob_res = world->objects.find(ob_with_dyn_tex.ob_uid);
+			if(ob_res != world->objects.end())
 			{
 				WorldObject* ob = ob_res->second.ptr();
 
-				if(ob_with_dyn_tex.script->material_index < ob->materials.size())
+				if(DynamicTextureUpdaterThread::setObjectTextureURL(world_state, world.ptr(), ob, *ob_with_dyn_tex.script, substrata_URL)) // If new URL is different from existing texture URL:
 				{
-					WorldMaterial* material = ob->materials[ob_with_dyn_tex.script->material_index].ptr();
+					conPrint("\tDynamicTextureUpdaterThread: Texture is different from existing texture, updated object.");
 
-					bool tex_URL_changed = false;
-					if(ob_with_dyn_tex.script->material_texture == "colour")
-					{
-						if(substrata_URL != material->colour_texture_url) // If new URL is different from existing texture URL:
-						{
-							material->colour_texture_url = substrata_URL;
-							tex_URL_changed = true;
-						}
-					}
-					else if(ob_with_dyn_tex.script->material_texture == "emission")
-					{
-						if(substrata_URL != material->emission_texture_url) // If new URL is different from existing texture URL:
-						{
-							material->emission_texture_url = substrata_URL;
-							tex_URL_changed = true;
-						}
-					}
-					else
-						throw glare::Exception("Invalid material_texture type");
+					// Send a message to MeshLODGenThread to generate LOD textures for this new texture (if not already generated)
+					CheckGenResourcesForObject* msg = new CheckGenResourcesForObject();
+					msg->ob_uid = ob_with_dyn_tex.ob_uid;
+					server->enqueueMsgForLodGenThread(msg);
+				}
+				else
+					conPrint("\tDynamicTextureUpdaterThread: Texture is the same as existing texture on object.");
+			}
+		} // End lock scope
+	}
+}
 
-					if(tex_URL_changed) // If new URL is different from existing texture URL:
-					{
-						conPrint("\tDynamicTextureUpdaterThread: Texture is different from existing texture, updating object...");
 
-						world_state->world_states[ob_with_dyn_tex.world_name]->addWorldObjectAsDBDirty(ob);
-						world_state->markAsChanged();
+bool DynamicTextureUpdaterThread::setObjectTextureURL(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, const ServerSideScripting::ServerSideScript& script, const std::string& new_URL)
+{
+	if(script.material_index >= ob->materials.size())
+		return false;
 
-						ob->from_remote_other_dirty = true; // Set this so a ObjectFullUpdate message is sent to clients.
-						world_state->world_states[ob_with_dyn_tex.world_name]->dirty_from_remote_objects.insert(ob);
+	WorldMaterial* material = ob->materials[script.material_index].ptr();
 
-						// Send a message to MeshLODGenThread to generate LOD textures for this new texture (if not already generated)
-						CheckGenResourcesForObject* msg = new CheckGenResourcesForObject();
-						msg->ob_uid = ob_with_dyn_tex.ob_uid;
-						server->enqueueMsgForLodGenThread(msg);
-					}
-					else
-						conPrint("\tDynamicTextureUpdaterThread: Texture is the same as existing texture on object.");
-				}
-			}
-		} // End lock scope
+	bool tex_URL_changed = false;
+	if(script.material_texture == "colour")
+	{
+		if(new_URL != material->colour_texture_url) // If new URL is different from existing texture URL:
+		{
+			material->colour_texture_url = new_URL;
+			tex_URL_changed = true;
+		}
+	}
+	else if(script.material_texture == "emission")
+	{
+		if(new_URL != material->emission_texture_url) // If new URL is different from existing texture URL:
+		{
+			material->emission_texture_url = new_URL;
+			tex_URL_changed = true;
+		}
+	}
+	else
+		throw glare::Exception("Invalid material_texture type");
+
+	if(tex_URL_changed)
+	{
+		ob->last_modified_time = TimeStamp::currentTime(); // So incremental object sync sends the new texture URL to clients.
+
+		world->addWorldObjectAsDBDirty(ob);
+		{
+			InstrumentedLock resources_lock(world_state->resources_mutex);
+			world_state->object_URL_index.updateObject(ob);
+		}
+		world_state->markAsChanged();
+
+		ob->from_remote_other_dirty = true; // Set this so a ObjectFullUpdate message is sent to clients.
+		world->dirty_from_remote_objects.insert(ob);
+		world_state->notifyBroadcastNeeded();
 	}
+
+	return tex_URL_changed;
 }
 
 
@@ -280,7 +303,7 @@ void DynamicTextureUpdaterThread::doRun()
 
 				// Check if the force-update flag is set (can be set in admin web interface).  If so, abort wait.
 				{
-					Lock lock(world_state->mutex);
+					InstrumentedLock lock(world_state->mutex);
 					if(world_state->force_dyn_tex_update)
 					{
 						world_state->force_dyn_tex_update = false;
@@ -295,11 +318,13 @@ void DynamicTextureUpdaterThread::doRun()
 			std::vector<ObWithDynamicTexture> obs_with_dyn_textures;
 
 			{
-				Lock lock(world_state->mutex);
+				InstrumentedLock lock(world_state->mutex);
 
 				for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
 				{
 					ServerWorldState* world = world_it->second.ptr();
+					InstrumentedLock world_lock(world->mutex);
+					InstrumentedLock users_lock(world_state->users_mutex);
 					for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
 					{
 						WorldObject* ob = it->second.ptr();
@@ -8,8 +8,12 @@ Copyright Glare Technologies Limited 2023 -
 
 #include "../shared/UID.h"
 #include <MessageableThread.h>
+#include <string>
 class Server;
 class ServerAllWorldsState;
+class ServerWorldState;
+class WorldObject;
+namespace ServerSideScripting { class ServerSideScript; }
 
 
 /*=====================================================================
@@ -31,6 +35,11 @@ public:
 
 	virtual void doRun();
 
+	// Sets the texture URL of the material on ob that script updates.  If the URL changed, marks ob as DB-dirty and as needing to be sent to clients,
+	// and bumps its last_modified_time so incremental object sync resends it.  Returns true if the URL changed.
+	// The mutex for world should be held.  Throws glare::Exception if the script has an invalid material_texture.
+	static bool setObjectTextureURL(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, const ServerSideScripting::ServerSideScript& script, const std::string& new_URL);
+
 private:
 	Server* server;
 	ServerAllWorldsState* world_state;
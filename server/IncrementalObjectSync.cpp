@@ -0,0 +1,485 @@
+/*=====================================================================
+IncrementalObjectSync.cpp
+-------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "IncrementalObjectSync.h"
+
+
+#include "ServerWorldState.h"
+#include "../shared/Protocol.h"
+#include "../shared/MessageUtils.h"
+#include <utils/SocketBufferOutStream.h>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+
+namespace IncrementalObjectSync
+{
+
+
+static const ObjectSyncDigest::KnownObject* findKnownObject(const ObjectSyncDigest& digest, const UID& uid)
+{
+	ObjectSyncDigest::KnownObject key;
+	key.uid = uid;
+	auto res = std::lower_bound(digest.known_objects.begin(), digest.known_objects.end(), key);
+	return (res != digest.known_objects.end() && res->uid == uid) ? &(*res) : NULL;
+}
+
+
+void writeQueryObjectsInAABBResponse(const ServerWorldState& world_state, const js::AABBox& aabb, const Vec3d& cam_position, const ObjectSyncDigest* digest, const TimeStamp& cur_time,
+	SocketBufferOutStream& scratch_packet, SocketBufferOutStream& packet, std::vector<size_t>& chunk_begin_offsets_out, SyncStats& stats_out) REQUIRES(world_state.mutex)
+{
+	stats_out = SyncStats();
+
+	// Get objects with a valid position in the query AABB, using the object grid.
+	std::vector<WorldObject*> obs;
+	obs.reserve(16384);
+	world_state.object_grid.appendObjectsInAABB(aabb, obs);
+
+	std::vector<UID> deleted_uids;
+	if(digest)
+	{
+		// Remove known objects from obs.  Known objects that have changed are added back below, wherever they are.
+		size_t num_unknown = 0;
+		for(size_t i=0; i<obs.size(); ++i)
+			if(!findKnownObject(*digest, obs[i]->uid))
+				obs[num_unknown++] = obs[i];
+		obs.resize(num_unknown);
+
+		for(size_t i=0; i<digest->known_objects.size(); ++i)
+		{
+			const ObjectSyncDigest::KnownObject& known = digest->known_objects[i];
+			auto res = world_state.objects.find(known.uid);
+			if(res == world_state.objects.end())
+				deleted_uids.push_back(known.uid);
+			else if(digest->isUnchanged(known.last_modified_time, res->second->last_modified_time))
+				stats_out.num_unchanged++;
+			else
+				obs.push_back(res->second.ptr());
+		}
+	}
+
+	// Sort objects from near to far from camera.  Changed known objects may have a non-finite position, so put them last.
+	std::vector<std::pair<double, WorldObject*>> sorted_obs(obs.size());
+	for(size_t i=0; i<obs.size(); ++i)
+	{
+		const double dist2 = obs[i]->pos.getDist2(cam_position);
+		sorted_obs[i] = std::make_pair(std::isfinite(dist2) ? dist2 : std::numeric_limits<double>::infinity(), obs[i]);
+	}
+	std::sort(sorted_obs.begin(), sorted_obs.end(), [](const std::pair<double, WorldObject*>& a, const std::pair<double, WorldObject*>& b) { return a.first < b.first; });
+
+	chunk_begin_offsets_out.push_back(packet.buf.size());
+	size_t last_chunk_begin_offset = packet.buf.size();
+
+	for(size_t i=0; i<sorted_obs.size(); ++i)
+	{
+		const WorldObject* ob = sorted_obs[i].second;
+
+		// Create ObjectInitialSend packet
+		MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
+		ob->writeToNetworkStream(scratch_packet);
+		MessageUtils::updatePacketLengthField(scratch_packet);
+
+		packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Append scratch_packet with ObjectInitialSend message to packet.
+
+		if(packet.buf.size() - last_chunk_begin_offset >= 4096) // If we have written more than X bytes since last chunk start:
+		{
+			last_chunk_begin_offset = packet.buf.size();
+			chunk_begin_offsets_out.push_back(packet.buf.size()); // Record offset of start of chunk.
+		}
+	}
+	stats_out.num_obs_sent = sorted_obs.size();
+
+	if(digest)
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::IncrementalObjectSyncDone);
+		scratch_packet.writeUInt64(cur_time.time);
+		scratch_packet.writeUInt32((uint32)deleted_uids.size());
+		for(size_t i=0; i<deleted_uids.size(); ++i)
+			writeToStream(deleted_uids[i], scratch_packet);
+		MessageUtils::updatePacketLengthField(scratch_packet);
+
+		packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+
+		stats_out.num_deleted = deleted_uids.size();
+	}
+}
+
+
+} // end namespace IncrementalObjectSync
+
+
+#if BUILD_TESTS
+
+
+#include "DynamicTextureUpdaterThread.h"
+#include "ServerSideScripting.h"
+#include <maths/PCG32.h>
+#include <utils/BufferInStream.h>
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <set>
+#include <cstring>
+
+
+namespace IncrementalObjectSync
+{
+
+
+struct ParsedResponse
+{
+	ParsedResponse() : got_sync_done(false), sync_done_time(0) {}
+
+	std::vector<UID> sent_uids; // In the order sent.
+	bool got_sync_done;
+	uint64 sync_done_time;
+	std::set<UID> deleted_uids;
+};
+
+
+static ParsedResponse parseResponse(const SocketBufferOutStream& packet, const std::vector<size_t>& chunk_begin_offsets)
+{
+	ParsedResponse parsed;
+	std::set<size_t> msg_begin_offsets;
+
+	size_t offset = 0;
+	while(offset < packet.buf.size())
+	{
+		testAssert(!parsed.got_sync_done); // IncrementalObjectSyncDone should be the last message.
+		msg_begin_offsets.insert(offset);
+
+		uint32 msg_type, msg_len;
+		testAssert(offset + 8 <= packet.buf.size());
+		std::memcpy(&msg_type, &packet.buf[offset], 4);
+		std::memcpy(&msg_len, &packet.buf[offset + 4], 4);
+		testAssert(msg_len >= 8 && offset + msg_len <= packet.buf.size());
+
+		if(msg_type == Protocol::ObjectInitialSend)
+		{
+			uint64 uid;
+			std::memcpy(&uid, &packet.buf[offset + 8], 8);
+			parsed.sent_uids.push_back(UID(uid));
+		}
+		else if(msg_type == Protocol::IncrementalObjectSyncDone)
+		{
+			parsed.got_sync_done = true;
+			std::memcpy(&parsed.sync_done_time, &packet.buf[offset + 8], 8);
+			uint32 num_deleted;
+			std::memcpy(&num_deleted, &packet.buf[offset + 16], 4);
+			testAssert(msg_len == 8 + 12 + num_deleted * 8);
+			for(uint32 i=0; i<num_deleted; ++i)
+			{
+				uint64 uid;
+				std::memcpy(&uid, &packet.buf[offset + 20 + i * 8], 8);
+				parsed.deleted_uids.insert(UID(uid));
+			}
+		}
+		else
+			failTest("Unexpected message type " + toString(msg_type));
+
+		offset += msg_len;
+	}
+	testAssert(offset == packet.buf.size());
+
+	// Chunks should start at message boundaries.
+	for(size_t i=0; i<chunk_begin_offsets.size(); ++i)
+		testAssert(chunk_begin_offsets[i] == packet.buf.size() || msg_begin_offsets.count(chunk_begin_offsets[i]) == 1);
+
+	return parsed;
+}
+
+
+static WorldObjectRef makeObject(uint64 uid, const Vec3d& pos, uint64 last_modified_time)
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->uid = UID(uid);
+	ob->pos = pos;
+	ob->last_modified_time = TimeStamp(last_modified_time);
+	return ob;
+}
+
+
+static void addObject(ServerWorldState& world_state, WorldObjectRef ob) REQUIRES(world_state.mutex)
+{
+	world_state.objects[ob->uid] = ob;
+	world_state.object_grid.insert(ob.ptr());
+}
+
+
+static void addKnownObject(ObjectSyncDigest& digest, uint64 uid, uint64 last_modified_time)
+{
+	ObjectSyncDigest::KnownObject known;
+	known.uid = UID(uid);
+	known.last_modified_time = TimeStamp(last_modified_time);
+	digest.known_objects.push_back(known);
+}
+
+
+// Check that an object changed by a server thread, rather than by a client message handled in WorkerThread, is resent to a reconnecting client.
+static void testObjectChangedByServerThread()
+{
+	const js::AABBox aabb(Vec4f(-100, -100, -100, 1), Vec4f(100, 100, 100, 1));
+	const Vec3d cam_pos(0, 0, 0);
+
+	Reference<ServerAllWorldsState> all_worlds_state = new ServerAllWorldsState();
+	Reference<ServerWorldState> world_state = all_worlds_state->getRootWorldState();
+	InstrumentedLock lock(world_state->mutex);
+
+	WorldObjectRef ob = makeObject(1, Vec3d(10, 0, 0), 500);
+	ob->materials.push_back(new WorldMaterial());
+	ob->materials[0]->colour_texture_url = "old_texture.png";
+	addObject(*world_state, ob);
+
+	// The client's digest from its previous connection, which has the object as it was before the change.
+	ObjectSyncDigest digest;
+	digest.valid_time = TimeStamp(1000);
+	addKnownObject(digest, 1, 500);
+
+	// Change the object's texture as DynamicTextureUpdaterThread does.
+	ServerSideScripting::ServerSideScript script;
+	script.material_index = 0;
+	script.material_texture = "colour";
+	testAssert(DynamicTextureUpdaterThread::setObjectTextureURL(all_worlds_state.ptr(), world_state.ptr(), ob.ptr(), script, "new_texture.png"));
+	testAssert(ob->materials[0]->colour_texture_url == "new_texture.png");
+	testAssert(ob->last_modified_time.time > 500);
+	testAssert(world_state->dirty_from_remote_objects.count(ob) == 1);
+	testAssert(world_state->db_dirty_world_objects.count(ob) == 1);
+
+	// Setting the same URL again shouldn't change the object.
+	const TimeStamp last_modified_time = ob->last_modified_time;
+	testAssert(!DynamicTextureUpdaterThread::setObjectTextureURL(all_worlds_state.ptr(), world_state.ptr(), ob.ptr(), script, "new_texture.png"));
+	testAssert(ob->last_modified_time.time == last_modified_time.time);
+
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	std::vector<size_t> chunk_begin_offsets;
+	SyncStats stats;
+	writeQueryObjectsInAABBResponse(*world_state, aabb, cam_pos, &digest, TimeStamp::currentTime(), scratch_packet, packet, chunk_begin_offsets, stats);
+
+	const ParsedResponse parsed = parseResponse(packet, chunk_begin_offsets);
+	testAssert(parsed.got_sync_done);
+	testAssert(stats.num_unchanged == 0);
+	testAssert(parsed.sent_uids.size() == 1 && parsed.sent_uids[0] == UID(1));
+}
+
+
+void test()
+{
+	conPrint("IncrementalObjectSync::test()");
+
+	testObjectChangedByServerThread();
+
+	const js::AABBox aabb(Vec4f(-100, -100, -100, 1), Vec4f(100, 100, 100, 1));
+	const Vec3d cam_pos(0, 0, 0);
+	const TimeStamp cur_time(2000);
+
+	Reference<ServerWorldState> world_state = new ServerWorldState();
+	InstrumentedLock lock(world_state->mutex);
+	addObject(*world_state, makeObject(1, Vec3d(10, 0, 0),  500));	// Known, unchanged.
+	addObject(*world_state, makeObject(2, Vec3d(20, 0, 0),  1500));	// Known, changed.
+	addObject(*world_state, makeObject(3, Vec3d(5, 0, 0),   500));	// Unknown, in AABB.
+	addObject(*world_state, makeObject(4, Vec3d(500, 0, 0), 500));	// Unknown, outside AABB.
+	addObject(*world_state, makeObject(5, Vec3d(600, 0, 0), 1500));	// Known, changed, outside AABB.
+	addObject(*world_state, makeObject(6, Vec3d(700, 0, 0), 500));	// Known, unchanged, outside AABB.
+	addObject(*world_state, makeObject(7, Vec3d(30, 0, 0),  1000));	// Known, last modified in the same second as the previous sync.
+	addObject(*world_state, makeObject(8, Vec3d(std::numeric_limits<double>::quiet_NaN(), 0, 0), 1500)); // Known, changed, non-finite position.
+
+	//-------------------- Test full response --------------------
+	{
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		std::vector<size_t> chunk_begin_offsets;
+		SyncStats stats;
+		writeQueryObjectsInAABBResponse(*world_state, aabb, cam_pos, /*digest=*/NULL, cur_time, scratch_packet, packet, chunk_begin_offsets, stats);
+
+		const ParsedResponse parsed = parseResponse(packet, chunk_begin_offsets);
+		testAssert(!parsed.got_sync_done);
+		testAssert(stats.num_obs_sent == 4);
+		testAssert(parsed.sent_uids.size() == 4);
+		testAssert(parsed.sent_uids[0] == UID(3) && parsed.sent_uids[1] == UID(1) && parsed.sent_uids[2] == UID(2) && parsed.sent_uids[3] == UID(7)); // Should be sorted by distance.
+	}
+
+	//-------------------- Test incremental response --------------------
+	{
+		ObjectSyncDigest digest;
+		digest.valid_time = TimeStamp(1000);
+		addKnownObject(digest, 1, 500);
+		addKnownObject(digest, 2, 500);
+		addKnownObject(digest, 5, 500);
+		addKnownObject(digest, 6, 500);
+		addKnownObject(digest, 7, 1000);
+		addKnownObject(digest, 8, 500);
+		addKnownObject(digest, 9, 500); // Deleted.
+		addKnownObject(digest, 10, 500); // Deleted.
+
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		std::vector<size_t> chunk_begin_offsets;
+		SyncStats stats;
+		writeQueryObjectsInAABBResponse(*world_state, aabb, cam_pos, &digest, cur_time, scratch_packet, packet, chunk_begin_offsets, stats);
+
+		const ParsedResponse parsed = parseResponse(packet, chunk_begin_offsets);
+		testAssert(parsed.got_sync_done);
+		testAssert(parsed.sync_done_time == cur_time.time);
+		testAssert(stats.num_obs_sent == 5);
+		testAssert(stats.num_unchanged == 2);
+		testAssert(stats.num_deleted == 2);
+
+		testAssert(parsed.sent_uids.size() == 5);
+		testAssert(parsed.sent_uids[0] == UID(3));
+		testAssert(parsed.sent_uids[1] == UID(2));
+		testAssert(parsed.sent_uids[2] == UID(7));
+		testAssert(parsed.sent_uids[3] == UID(5));
+		testAssert(parsed.sent_uids[4] == UID(8)); // Non-finite position should be sent last.
+
+		testAssert(parsed.deleted_uids.size() == 2 && parsed.deleted_uids.count(UID(9)) && parsed.deleted_uids.count(UID(10)));
+	}
+
+	//-------------------- Test incremental response with an empty digest, as sent on a first connection --------------------
+	{
+		ObjectSyncDigest digest;
+
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		std::vector<size_t> chunk_begin_offsets;
+		SyncStats stats;
+		writeQueryObjectsInAABBResponse(*world_state, aabb, cam_pos, &digest, cur_time, scratch_packet, packet, chunk_begin_offsets, stats);
+
+		const ParsedResponse parsed = parseResponse(packet, chunk_begin_offsets);
+		testAssert(parsed.got_sync_done);
+		testAssert(parsed.sent_uids.size() == 4);
+		testAssert(parsed.deleted_uids.empty());
+	}
+
+	conPrint("IncrementalObjectSync::test() done.");
+}
+
+
+static const uint64 DAY = 24 * 60 * 60;
+
+
+static WorldObjectRef makeRandomObject(uint64 uid, float world_half_width, uint64 last_modified_time, PCG32& rng)
+{
+	WorldObjectRef ob = makeObject(uid, Vec3d(
+		(rng.unitRandom() * 2 - 1) * world_half_width,
+		(rng.unitRandom() * 2 - 1) * world_half_width,
+		rng.unitRandom() * 50.0
+	), last_modified_time);
+
+	// Give the object some typical content, so the ObjectInitialSend message sizes are realistic.
+	ob->model_url = "model_" + toString(rng.nextUInt(1000000)) + ".bmesh";
+	ob->max_model_lod_level = 2;
+	ob->materials.resize(2);
+	for(size_t i=0; i<ob->materials.size(); ++i)
+	{
+		ob->materials[i] = new WorldMaterial();
+		ob->materials[i]->colour_texture_url = "texture_" + toString(rng.nextUInt(1000000)) + ".jpg";
+	}
+	return ob;
+}
+
+
+void testReconnectPerformance()
+{
+	conPrint("IncrementalObjectSync::testReconnectPerformance()");
+
+	const size_t num_obs_values[] = { 10000, 100000, 400000 };
+	for(size_t n=0; n<staticArrayNumElems(num_obs_values); ++n)
+	{
+		const size_t num_obs = num_obs_values[n];
+		const uint64 now = 1700000000;
+
+		PCG32 rng(1);
+		Reference<ServerWorldState> world_state = new ServerWorldState();
+		InstrumentedLock lock(world_state->mutex);
+		for(size_t i=0; i<num_obs; ++i)
+			addObject(*world_state, makeRandomObject(i, /*world half width=*/4000.f, /*last modified time=*/now - DAY - (uint64)(rng.unitRandom() * 365 * DAY), rng));
+
+		// The client connects with a 2 km AABB around the camera, like QueryObjectsInAABB sent by GUIClient::connectToServer().
+		const Vec3d cam_pos(0, 0, 2);
+		const js::AABBox aabb(Vec4f(-1000, -1000, -1000, 1), Vec4f(1000, 1000, 1000, 1));
+
+		// Previous session: the client received all objects in the AABB, and the sync completed an hour ago.
+		ObjectSyncDigest digest;
+		digest.valid_time = TimeStamp(now - 3600);
+		{
+			std::vector<WorldObject*> obs;
+			world_state->object_grid.appendObjectsInAABB(aabb, obs);
+			for(size_t i=0; i<obs.size() && digest.known_objects.size() < ObjectSyncDigest::MAX_NUM_KNOWN_OBJECTS; ++i)
+				addKnownObject(digest, obs[i]->uid.value(), obs[i]->last_modified_time.time);
+			std::sort(digest.known_objects.begin(), digest.known_objects.end());
+		}
+
+		// While the client was away: modify 1% of objects, delete 0.5% and create 0.5% new ones.
+		size_t next_uid = num_obs;
+		for(size_t i=0; i<num_obs / 100; ++i)
+		{
+			auto res = world_state->objects.find(UID((uint64)(rng.unitRandom() * num_obs) % num_obs));
+			if(res != world_state->objects.end())
+				res->second->last_modified_time = TimeStamp(now - (uint64)(rng.unitRandom() * 3000));
+		}
+		for(size_t i=0; i<num_obs / 200; ++i)
+		{
+			auto res = world_state->objects.find(UID((uint64)(rng.unitRandom() * num_obs) % num_obs));
+			if(res != world_state->objects.end())
+			{
+				world_state->object_grid.remove(res->second.ptr());
+				world_state->objects.erase(res);
+			}
+			addObject(*world_state, makeRandomObject(next_uid++, /*world half width=*/4000.f, /*last modified time=*/now - 60, rng));
+		}
+
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		// Full resend
+		SocketBufferOutStream full_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SyncStats full_stats;
+		Timer timer;
+		{
+			std::vector<size_t> chunk_begin_offsets;
+			writeQueryObjectsInAABBResponse(*world_state, aabb, cam_pos, /*digest=*/NULL, TimeStamp(now), scratch_packet, full_packet, chunk_begin_offsets, full_stats);
+		}
+		const double full_time = timer.elapsed();
+
+		// Incremental sync.  Includes the time to encode and decode the digest.
+		SocketBufferOutStream inc_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SocketBufferOutStream digest_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SyncStats inc_stats;
+		timer.reset();
+		{
+			digest.writeToStream(digest_packet);
+
+			BufferInStream digest_in_stream;
+			digest_in_stream.buf.resize(digest_packet.buf.size());
+			std::memcpy(digest_in_stream.buf.data(), digest_packet.buf.data(), digest_packet.buf.size());
+			ObjectSyncDigest read_digest;
+			read_digest.readFromStream(digest_in_stream);
+
+			std::vector<size_t> chunk_begin_offsets;
+			writeQueryObjectsInAABBResponse(*world_state, aabb, cam_pos, &read_digest, TimeStamp(now), scratch_packet, inc_packet, chunk_begin_offsets, inc_stats);
+		}
+		const double inc_time = timer.elapsed();
+
+		testAssert(inc_stats.num_unchanged + inc_stats.num_deleted <= digest.known_objects.size());
+		testAssert(inc_stats.num_obs_sent < full_stats.num_obs_sent);
+
+		const size_t inc_total_bytes = digest_packet.buf.size() + inc_packet.buf.size();
+		conPrint("num obs: " + toString(num_obs) + ", obs in AABB: " + toString(full_stats.num_obs_sent) + ", known obs: " + toString(digest.known_objects.size()));
+		conPrint("    full:        sent " + toString(full_stats.num_obs_sent) + " obs, " + getNiceByteSize(full_packet.buf.size()) + ", " + doubleToStringNSigFigs(full_time * 1.0e3, 4) + " ms");
+		conPrint("    incremental: sent " + toString(inc_stats.num_obs_sent) + " obs, " + toString(inc_stats.num_deleted) + " deleted, " + toString(inc_stats.num_unchanged) + " unchanged, " +
+			getNiceByteSize(inc_total_bytes) + " (digest: " + getNiceByteSize(digest_packet.buf.size()) + "), " + doubleToStringNSigFigs(inc_time * 1.0e3, 4) + " ms");
+		conPrint("    incremental / full bytes: " + doubleToStringNSigFigs((double)inc_total_bytes / full_packet.buf.size(), 3));
+	}
+
+	conPrint("IncrementalObjectSync::testReconnectPerformance() done.");
+}
+
+
+} // end namespace IncrementalObjectSync
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,58 @@
+/*=====================================================================
+IncrementalObjectSync.h
+-----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/ObjectSyncDigest.h"
+#include <maths/vec3.h>
+#include <physics/jscol_aabbox.h>
+#include <vector>
+class ServerWorldState;
+class SocketBufferOutStream;
+
+
+/*=====================================================================
+IncrementalObjectSync
+---------------------
+Builds the response to QueryObjectsInAABB and QueryObjectsInAABBIncremental messages.
+
+For QueryObjectsInAABBIncremental, the client sends an ObjectSyncDigest of the objects it kept from
+its previous connection to the world, and only new, changed and deleted objects are sent back:
+	* Objects in the AABB that aren't in the digest are sent with ObjectInitialSend.
+	* Objects in the digest that have changed are sent with ObjectInitialSend, even if outside the AABB.
+	* Objects in the digest that are unchanged are not sent.
+	* A final IncrementalObjectSyncDone message has the current server time, which is the valid_time for the
+	  client's next digest, and the UIDs of objects in the digest that no longer exist.
+=====================================================================*/
+namespace IncrementalObjectSync
+{
+
+
+struct SyncStats
+{
+	SyncStats() : num_obs_sent(0), num_unchanged(0), num_deleted(0) {}
+
+	size_t num_obs_sent; // Number of ObjectInitialSend messages written.
+	size_t num_unchanged; // Number of known objects that were skipped since the client's copy is up to date.
+	size_t num_deleted; // Number of known objects that no longer exist.
+};
+
+
+// Writes the response to a QueryObjectsInAABB message (if digest is NULL) or a QueryObjectsInAABBIncremental message to packet.
+// Objects are sent from near to far from cam_position, so the client can start loading the closest objects first.
+// Appends the byte offsets of the start of ~4 KB chunks of the response to chunk_begin_offsets_out, so the response can be flushed in chunks.  (better for websockets)
+// The world_state mutex (the per-world mutex) should be held.
+void writeQueryObjectsInAABBResponse(const ServerWorldState& world_state, const js::AABBox& aabb, const Vec3d& cam_position, const ObjectSyncDigest* digest, const TimeStamp& cur_time,
+	SocketBufferOutStream& scratch_packet, SocketBufferOutStream& packet, std::vector<size_t>& chunk_begin_offsets_out, SyncStats& stats_out);
+
+
+void test();
+
+// Replays a reconnect against a large synthetic world, and prints the bytes sent and the time taken for full and incremental syncs.
+void testReconnectPerformance();
+
+
+} // end namespace IncrementalObjectSync
@@ -0,0 +1,161 @@
+/*=====================================================================
+InstrumentedMutex.cpp
+---------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "InstrumentedMutex.h"
+
+
+#include <Lock.h>
+#include <Clock.h>
+#include <StringUtils.h>
+#include <mathstypes.h>
+
+
+const double InstrumentedMutex::SLOW_ACQUISITION_TIME = 1.0e-3;
+
+
+InstrumentedMutex::InstrumentedMutex(const std::string& name_)
+:	name(name_),
+	lock_depth(0),
+	outermost_acquire_time(0)
+{
+	resetStats();
+}
+
+
+InstrumentedMutex::~InstrumentedMutex()
+{
+}
+
+
+void InstrumentedMutex::acquireAndRecord()
+{
+	const double start_time = Clock::getCurTimeRealSec();
+	acquire();
+	lock_depth++;
+	if(lock_depth == 1)
+	{
+		const double acquire_time = Clock::getCurTimeRealSec();
+		outermost_acquire_time = acquire_time;
+
+		const double wait_time = acquire_time - start_time;
+		Lock lock(stats_mutex);
+		stats.num_acquisitions++;
+		if(wait_time > SLOW_ACQUISITION_TIME)
+			stats.num_slow_acquisitions++;
+		stats.total_wait_time += wait_time;
+		stats.max_wait_time = myMax(stats.max_wait_time, wait_time);
+	}
+}
+
+
+void InstrumentedMutex::releaseAndRecord()
+{
+	lock_depth--;
+	if(lock_depth == 0)
+	{
+		const double hold_time = Clock::getCurTimeRealSec() - outermost_acquire_time;
+		Lock lock(stats_mutex);
+		stats.total_hold_time += hold_time;
+		stats.max_hold_time = myMax(stats.max_hold_time, hold_time);
+	}
+	release();
+}
+
+
+InstrumentedMutex::Stats InstrumentedMutex::getStats() const
+{
+	Lock lock(stats_mutex);
+	return stats;
+}
+
+
+void InstrumentedMutex::resetStats()
+{
+	Lock lock(stats_mutex);
+	stats.num_acquisitions = 0;
+	stats.num_slow_acquisitions = 0;
+	stats.total_wait_time = 0;
+	stats.max_wait_time = 0;
+	stats.total_hold_time = 0;
+	stats.max_hold_time = 0;
+}
+
+
+std::string InstrumentedMutex::statsHTMLTableHeader()
+{
+	return "<tr><th>lock</th><th>acquisitions</th><th>waits > 1 ms</th><th>mean wait</th><th>max wait</th><th>mean hold</th><th>max hold</th><th>% time held</th></tr>";
+}
+
+
+static std::string msString(double t)
+{
+	return doubleToStringNSigFigs(t * 1.0e3, 3) + " ms";
+}
+
+
+std::string InstrumentedMutex::statsToHTMLTableRow(const std::string& escaped_name, const Stats& stats, double period_s)
+{
+	const double n = (double)myMax<uint64>(1, stats.num_acquisitions);
+	std::string s = "<tr><td>" + escaped_name + "</td>";
+	s += "<td>" + toString(stats.num_acquisitions) + "</td>";
+	s += "<td>" + toString(stats.num_slow_acquisitions) + "</td>";
+	s += "<td>" + msString(stats.total_wait_time / n) + "</td>";
+	s += "<td>" + msString(stats.max_wait_time) + "</td>";
+	s += "<td>" + msString(stats.total_hold_time / n) + "</td>";
+	s += "<td>" + msString(stats.max_hold_time) + "</td>";
+	s += "<td>" + ((period_s > 0) ? doubleToStringNSigFigs(100 * stats.total_hold_time / period_s, 3) : std::string("-")) + "</td></tr>";
+	return s;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+#include <ConPrint.h>
+#include <PlatformUtils.h>
+
+
+void InstrumentedMutex::test()
+{
+	conPrint("InstrumentedMutex::test()");
+
+	{
+		InstrumentedMutex mutex("test");
+		testAssert(mutex.getName() == "test");
+		testAssert(mutex.getStats().num_acquisitions == 0);
+
+		{
+			InstrumentedLock lock(mutex);
+			PlatformUtils::Sleep(10);
+		}
+
+		Stats stats = mutex.getStats();
+		testAssert(stats.num_acquisitions == 1);
+		testAssert(stats.total_hold_time >= 0.005);
+		testAssert(stats.max_hold_time == stats.total_hold_time);
+		testAssert(stats.total_wait_time >= 0 && stats.total_wait_time < 0.005);
+
+		// Test that recursive locking only counts the outermost lock.
+		{
+			InstrumentedLock lock(mutex);
+			{
+				InstrumentedLock lock2(mutex);
+			}
+		}
+		stats = mutex.getStats();
+		testAssert(stats.num_acquisitions == 2);
+
+		mutex.resetStats();
+		stats = mutex.getStats();
+		testAssert(stats.num_acquisitions == 0);
+		testAssert(stats.total_hold_time == 0);
+	}
+
+	conPrint("InstrumentedMutex::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,80 @@
+/*=====================================================================
+InstrumentedMutex.h
+-------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <Mutex.h>
+#include <string>
+
+
+/*=====================================================================
+InstrumentedMutex
+-----------------
+A mutex that records contention statistics: the number of acquisitions,
+the time spent waiting to acquire it, and the time it was held for.
+
+Should be locked with InstrumentedLock for the statistics to be recorded.
+Recursive locking is allowed (as for Mutex), only the outermost lock is timed.
+=====================================================================*/
+class CAPABILITY("mutex") InstrumentedMutex : public ::Mutex
+{
+public:
+	InstrumentedMutex(const std::string& name);
+	~InstrumentedMutex();
+
+	struct Stats
+	{
+		uint64 num_acquisitions;
+		uint64 num_slow_acquisitions; // Number of acquisitions that waited for more than SLOW_ACQUISITION_TIME.
+		double total_wait_time; // In seconds.
+		double max_wait_time;
+		double total_hold_time;
+		double max_hold_time;
+	};
+
+	static const double SLOW_ACQUISITION_TIME; // 1 ms
+
+	void acquireAndRecord() ACQUIRE();
+	void releaseAndRecord() RELEASE();
+
+	Stats getStats() const;
+	void resetStats();
+
+	const std::string& getName() const { return name; }
+
+	static std::string statsHTMLTableHeader(); // For the admin pages.
+	// escaped_name should already be HTML-escaped.  period_s is the time over which the stats were gathered, used for computing the fraction of time the lock was held.
+	static std::string statsToHTMLTableRow(const std::string& escaped_name, const Stats& stats, double period_s);
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(InstrumentedMutex);
+
+	std::string name;
+
+	// These are only accessed by the thread holding this mutex.
+	int lock_depth;
+	double outermost_acquire_time;
+
+	mutable ::Mutex stats_mutex;
+	Stats stats GUARDED_BY(stats_mutex);
+};
+
+
+// RAII lock for InstrumentedMutex, records wait and hold time.
+class SCOPED_CAPABILITY InstrumentedLock
+{
+public:
+	InstrumentedLock(InstrumentedMutex& mutex_) ACQUIRE(mutex_) : mutex(mutex_) { mutex.acquireAndRecord(); }
+	~InstrumentedLock() RELEASE() { mutex.releaseAndRecord(); }
+
+private:
+	GLARE_DISABLE_COPY(InstrumentedLock);
+
+	InstrumentedMutex& mutex;
+};
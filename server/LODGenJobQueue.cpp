@@ -0,0 +1,367 @@
+/*=====================================================================
+LODGenJobQueue.cpp
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "LODGenJobQueue.h"
+
+
+#include <Lock.h>
+#include <maths/mathstypes.h>
+#include <cmath>
+
+
+const char* LODGenJob::COMPRESSED_VARIANTS_URL_SUFFIX = "#compressed_variants";
+
+const double LODGenJobQueue::RECENCY_DOUBLING_PERIOD = 60.0;
+
+static const double THROUGHPUT_PERIOD = 60.0; // Period over which recent_completion_times are kept, in seconds.
+
+
+const char* LODGenJob::typeName(Type type)
+{
+	switch(type)
+	{
+	case Type_LODMesh: return "LOD mesh";
+	case Type_LODTexture: return "LOD texture";
+	case Type_KTXTexture: return "KTX texture";
+	case Type_CompressedVariants: return "compressed variants";
+	case Type_VoxelMesh: return "voxel mesh";
+	}
+	return "unknown";
+}
+
+
+LODGenJobQueue::LODGenJobQueue()
+:	next_order(0),
+	shutting_down(false),
+	num_completed(0),
+	num_failed(0),
+	num_merged(0),
+	total_job_time(0)
+{}
+
+
+LODGenJobQueue::~LODGenJobQueue()
+{}
+
+
+double LODGenJobQueue::priority(const LODGenJob& job)
+{
+	return std::log2((double)myMax<size_t>(1, job.num_refs)) + job.last_request_time / RECENCY_DOUBLING_PERIOD;
+}
+
+
+void LODGenJobQueue::enqueueJobs(const std::vector<LODGenJob>& jobs)
+{
+	if(jobs.empty())
+		return;
+
+	{
+		Lock lock(mutex);
+
+		for(size_t i=0; i<jobs.size(); ++i)
+		{
+			const LODGenJob& job = jobs[i];
+
+			if(running_job_URLs.count(job.output_URL) != 0) // If a job with this output URL is already running, the output will be made by it.
+			{
+				num_merged++;
+				continue;
+			}
+
+			auto res = pending_jobs.find(job.output_URL);
+			if(res == pending_jobs.end())
+			{
+				PendingJob pending_job;
+				pending_job.job = job;
+				pending_job.order = next_order++;
+				pending_jobs.insert(std::make_pair(job.output_URL, pending_job));
+
+				priority_order.insert(PriorityKey({priority(job), pending_job.order, job.output_URL}));
+			}
+			else
+			{
+				// Merge with the existing job, and move it to the position for the new priority.
+				PendingJob& pending_job = res->second;
+				priority_order.erase(PriorityKey({priority(pending_job.job), pending_job.order, job.output_URL}));
+
+				pending_job.job.num_refs = job.num_refs; // The new reference count is more up-to-date.
+				pending_job.job.last_request_time = myMax(pending_job.job.last_request_time, job.last_request_time);
+
+				priority_order.insert(PriorityKey({priority(pending_job.job), pending_job.order, job.output_URL}));
+				num_merged++;
+			}
+		}
+	}
+
+	job_ready_condition.notify();
+}
+
+
+bool LODGenJobQueue::dequeueReadyJob(LODGenJob& job_out)
+{
+	for(auto it = priority_order.begin(); it != priority_order.end(); ++it)
+	{
+		auto res = pending_jobs.find(it->URL);
+		assert(res != pending_jobs.end());
+		const LODGenJob& job = res->second.job;
+
+		const bool ready = job.depends_on_URL.empty() || ((pending_jobs.count(job.depends_on_URL) == 0) && (running_job_URLs.count(job.depends_on_URL) == 0));
+		if(ready)
+		{
+			job_out = job;
+			running_job_URLs.insert(job.output_URL);
+			pending_jobs.erase(res);
+			priority_order.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+bool LODGenJobQueue::dequeueJob(LODGenJob& job_out)
+{
+	Lock lock(mutex);
+
+	// This code pattern approximately follows ThreadSafeQueue<T>::dequeue().
+	while(1)
+	{
+		if(shutting_down)
+			return false;
+
+		if(dequeueReadyJob(job_out))
+			return true;
+
+		job_ready_condition.wait(mutex); // Suspend until jobs are enqueued or finish, or shutdown, or we get a spurious wake up.
+	}
+}
+
+
+bool LODGenJobQueue::tryDequeueJob(LODGenJob& job_out)
+{
+	Lock lock(mutex);
+
+	if(shutting_down)
+		return false;
+
+	return dequeueReadyJob(job_out);
+}
+
+
+void LODGenJobQueue::jobFinished(const LODGenJob& job, bool succeeded, double job_time, double cur_time)
+{
+	{
+		Lock lock(mutex);
+
+		running_job_URLs.erase(job.output_URL);
+
+		if(succeeded)
+			num_completed++;
+		else
+			num_failed++;
+		total_job_time += job_time;
+
+		recent_completion_times.push_back(cur_time);
+		while(!recent_completion_times.empty() && (recent_completion_times.front() < cur_time - THROUGHPUT_PERIOD))
+			recent_completion_times.pop_front();
+	}
+
+	job_ready_condition.notify(); // Jobs depending on this one may be ready now.
+}
+
+
+void LODGenJobQueue::shutdown()
+{
+	{
+		Lock lock(mutex);
+		shutting_down = true;
+	}
+
+	job_ready_condition.notify();
+}
+
+
+LODGenJobQueueStats LODGenJobQueue::getStats(double cur_time) const
+{
+	Lock lock(mutex);
+
+	while(!recent_completion_times.empty() && (recent_completion_times.front() < cur_time - THROUGHPUT_PERIOD))
+		recent_completion_times.pop_front();
+
+	LODGenJobQueueStats stats;
+	stats.num_pending = pending_jobs.size();
+	stats.num_running = running_job_URLs.size();
+	stats.num_completed = num_completed;
+	stats.num_failed = num_failed;
+	stats.num_merged = num_merged;
+	stats.num_completed_in_last_minute = recent_completion_times.size();
+	stats.total_job_time = total_job_time;
+	return stats;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+
+
+static LODGenJob makeTestJob(const std::string& URL, size_t num_refs, double request_time, const std::string& depends_on_URL = std::string())
+{
+	LODGenJob job;
+	job.type = LODGenJob::Type_LODTexture;
+	job.output_URL = URL;
+	job.depends_on_URL = depends_on_URL;
+	job.num_refs = num_refs;
+	job.last_request_time = request_time;
+	return job;
+}
+
+
+void LODGenJobQueue::test()
+{
+	conPrint("LODGenJobQueue::test()");
+
+	//-------------------- Test that jobs are dequeued by number of references, then in enqueue order --------------------
+	{
+		LODGenJobQueue queue;
+		std::vector<LODGenJob> jobs;
+		jobs.push_back(makeTestJob("a", 1, 1000));
+		jobs.push_back(makeTestJob("b", 4, 1000));
+		jobs.push_back(makeTestJob("c", 1, 1000));
+		jobs.push_back(makeTestJob("d", 2, 1000));
+		queue.enqueueJobs(jobs);
+
+		testAssert(queue.getStats(1000).num_pending == 4);
+
+		LODGenJob job;
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "b");
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "d");
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "a");
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "c");
+		testAssert(!queue.tryDequeueJob(job));
+
+		const LODGenJobQueueStats stats = queue.getStats(1000);
+		testAssert(stats.num_pending == 0);
+		testAssert(stats.num_running == 4);
+	}
+
+	//-------------------- Test that more recently requested jobs are dequeued first --------------------
+	{
+		LODGenJobQueue queue;
+		std::vector<LODGenJob> jobs;
+		jobs.push_back(makeTestJob("old", 1, 1000));
+		jobs.push_back(makeTestJob("old_popular", 3, 1000));
+		jobs.push_back(makeTestJob("new", 1, 1000 + 4 * RECENCY_DOUBLING_PERIOD)); // Counts the same as 16 references at the old time.
+		queue.enqueueJobs(jobs);
+
+		LODGenJob job;
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "new");
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "old_popular");
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "old");
+	}
+
+	//-------------------- Test that jobs with the same output URL are merged --------------------
+	{
+		LODGenJobQueue queue;
+		std::vector<LODGenJob> jobs;
+		jobs.push_back(makeTestJob("a", 2, 1000));
+		jobs.push_back(makeTestJob("b", 1, 1000));
+		queue.enqueueJobs(jobs);
+
+		// Request b again, now that it is used by more objects than a.
+		jobs.clear();
+		jobs.push_back(makeTestJob("b", 3, 1000));
+		jobs.push_back(makeTestJob("b", 4, 1000));
+		queue.enqueueJobs(jobs);
+
+		LODGenJobQueueStats stats = queue.getStats(1000);
+		testAssert(stats.num_pending == 2);
+		testAssert(stats.num_merged == 2);
+
+		LODGenJob job;
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "b");
+		testAssert(job.num_refs == 4);
+
+		// Enqueueing a job for a running job output URL should do nothing.
+		jobs.clear();
+		jobs.push_back(makeTestJob("b", 1, 2000));
+		queue.enqueueJobs(jobs);
+		stats = queue.getStats(1000);
+		testAssert(stats.num_pending == 1);
+		testAssert(stats.num_merged == 3);
+
+		// Once finished, the job can be enqueued again.
+		queue.jobFinished(job, /*succeeded=*/true, /*job time=*/1.0, /*cur time=*/1000);
+		queue.enqueueJobs(jobs);
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "b");
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "a");
+	}
+
+	//-------------------- Test that a job isn't dequeued while its dependency is queued or running --------------------
+	{
+		LODGenJobQueue queue;
+		std::vector<LODGenJob> jobs;
+		jobs.push_back(makeTestJob("tex_lod1.ktx2", 10, 1000, /*depends on=*/"tex_lod1.jpg"));
+		jobs.push_back(makeTestJob("tex_lod1.jpg", 1, 1000));
+		jobs.push_back(makeTestJob("other.ktx2", 10, 1000, /*depends on=*/"not_queued.jpg"));
+		queue.enqueueJobs(jobs);
+
+		LODGenJob job;
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "other.ktx2");
+		LODGenJob lod_tex_job;
+		testAssert(queue.tryDequeueJob(lod_tex_job) && lod_tex_job.output_URL == "tex_lod1.jpg");
+		testAssert(!queue.tryDequeueJob(job)); // Dependency is running.
+
+		queue.jobFinished(lod_tex_job, /*succeeded=*/true, /*job time=*/1.0, /*cur time=*/1000);
+		testAssert(queue.tryDequeueJob(job) && job.output_URL == "tex_lod1.ktx2");
+	}
+
+	//-------------------- Test stats --------------------
+	{
+		LODGenJobQueue queue;
+		std::vector<LODGenJob> jobs;
+		for(int i=0; i<3; ++i)
+			jobs.push_back(makeTestJob("job " + toString(i), 1, 1000));
+		queue.enqueueJobs(jobs);
+
+		LODGenJob job;
+		testAssert(queue.tryDequeueJob(job));
+		queue.jobFinished(job, /*succeeded=*/true, /*job time=*/1.0, /*cur time=*/1000);
+		testAssert(queue.tryDequeueJob(job));
+		queue.jobFinished(job, /*succeeded=*/false, /*job time=*/2.0, /*cur time=*/1050);
+
+		LODGenJobQueueStats stats = queue.getStats(1050);
+		testAssert(stats.num_pending == 1);
+		testAssert(stats.num_running == 0);
+		testAssert(stats.num_completed == 1);
+		testAssert(stats.num_failed == 1);
+		testAssert(stats.num_completed_in_last_minute == 2);
+		testAssert(epsEqual(stats.total_job_time, 3.0));
+
+		stats = queue.getStats(1100); // First completion is now more than a minute ago.
+		testAssert(stats.num_completed_in_last_minute == 1);
+	}
+
+	//-------------------- Test shutdown --------------------
+	{
+		LODGenJobQueue queue;
+		std::vector<LODGenJob> jobs;
+		jobs.push_back(makeTestJob("a", 1, 1000));
+		queue.enqueueJobs(jobs);
+		queue.shutdown();
+
+		LODGenJob job;
+		testAssert(!queue.dequeueJob(job)); // Shouldn't block.
+		testAssert(!queue.tryDequeueJob(job));
+	}
+
+	conPrint("LODGenJobQueue::test() done.");
+}
+
+
+#endif // BUILD_TESTS
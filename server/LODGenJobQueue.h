@@ -0,0 +1,149 @@
+/*=====================================================================
+LODGenJobQueue.h
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UserID.h"
+#include <Platform.h>
+#include <Vector.h>
+#include <Mutex.h>
+#include <Condition.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+
+// A LOD mesh, LOD texture, KTX texture or voxel mesh to generate, or a resource to make compressed variants of.  (See CompressedResourceVariants)
+struct LODGenJob
+{
+	LODGenJob() : type(Type_LODMesh), lod_level(0), base_lod_level(0), num_refs(1), last_request_time(0) {}
+
+	enum Type
+	{
+		Type_LODMesh,
+		Type_LODTexture,
+		Type_KTXTexture,
+		Type_CompressedVariants, // src_abs_path is the resource, output_abs_path is unused.  output_URL is the resource URL with COMPRESSED_VARIANTS_URL_SUFFIX appended, for deduplication.
+		Type_VoxelMesh // Meshes compressed_voxels for model LOD levels 0 to lod_level.  output_abs_path and output_URL are for LOD level 0.  src_abs_path is unused.
+	};
+
+	static const char* COMPRESSED_VARIANTS_URL_SUFFIX;
+
+	Type type;
+	std::string src_abs_path; // Model or texture to read.
+	std::string output_abs_path; // Path to write the generated model or texture to.
+	std::string output_URL; // URL of the generated resource.  Jobs are deduplicated by this URL.
+	std::string depends_on_URL; // If non-empty, the job won't be started while a job with this output URL is queued or running.  (KTX textures are made from LOD textures)
+	int lod_level;
+	int base_lod_level; // Just used for KTX textures.
+	UserID owner_id;
+
+	js::Vector<uint8, 16> compressed_voxels; // Just used for voxel meshes.
+	js::Vector<bool, 16> mats_transparent; // Just used for voxel meshes.
+
+	size_t num_refs; // Number of objects using the source model or texture.
+	double last_request_time; // Time (Clock::getCurTimeRealSec()) the job was last requested.
+
+	static const char* typeName(Type type);
+};
+
+
+struct LODGenJobQueueStats
+{
+	size_t num_pending;
+	size_t num_running;
+	uint64 num_completed;
+	uint64 num_failed;
+	uint64 num_merged; // Number of enqueued jobs that were merged with a queued or running job with the same output URL.
+	uint64 num_completed_in_last_minute;
+	double total_job_time; // Sum of execution times of completed and failed jobs, in seconds.
+};
+
+
+/*=====================================================================
+LODGenJobQueue
+--------------
+Queue of LOD generation jobs, shared by the LODGenWorkerThreads.
+
+Jobs are deduplicated by output URL.  When a job is enqueued with the same output URL as a
+queued job, the queued job takes the reference count and request time of the new job.
+
+The highest priority job whose dependency (if any) is not queued or running is dequeued first.
+Priority is log2(num_refs) + last_request_time / RECENCY_DOUBLING_PERIOD, so a job requested
+RECENCY_DOUBLING_PERIOD seconds more recently counts the same as a job with twice as many references.
+This ordering doesn't change over time, so the queue can be kept sorted.
+
+Threadsafe.
+=====================================================================*/
+class LODGenJobQueue
+{
+public:
+	LODGenJobQueue();
+	~LODGenJobQueue();
+
+	static const double RECENCY_DOUBLING_PERIOD; // In seconds.
+
+	void enqueueJobs(const std::vector<LODGenJob>& jobs);
+
+	// Blocks until a job is ready to run, then removes the highest priority ready job from the queue and marks it as running.
+	// Returns false if shutdown() has been called.
+	bool dequeueJob(LODGenJob& job_out);
+
+	// Like dequeueJob() but doesn't block.  Returns false if no job is ready to run.
+	bool tryDequeueJob(LODGenJob& job_out);
+
+	// Should be called when a job returned by dequeueJob() has finished.  cur_time is Clock::getCurTimeRealSec().
+	void jobFinished(const LODGenJob& job, bool succeeded, double job_time, double cur_time);
+
+	void shutdown(); // Makes any threads blocked in dequeueJob() (and any later calls) return false.
+
+	LODGenJobQueueStats getStats(double cur_time) const;
+
+	static double priority(const LODGenJob& job);
+
+	static void test();
+
+private:
+	struct PriorityKey
+	{
+		double priority;
+		uint64 order; // Jobs with the same priority are dequeued in the order they were first enqueued.
+		std::string URL;
+
+		bool operator < (const PriorityKey& other) const
+		{
+			if(priority != other.priority)
+				return priority > other.priority; // Highest priority first.
+			return order < other.order;
+		}
+	};
+
+	struct PendingJob
+	{
+		LODGenJob job;
+		uint64 order;
+	};
+
+	bool dequeueReadyJob(LODGenJob& job_out) REQUIRES(mutex);
+
+	mutable Mutex mutex;
+	Condition job_ready_condition; // Notified when jobs are enqueued or finish (which may make dependent jobs ready), or on shutdown.
+
+	std::unordered_map<std::string, PendingJob> pending_jobs	GUARDED_BY(mutex); // Map from output URL to job.
+	std::set<PriorityKey> priority_order						GUARDED_BY(mutex);
+	std::unordered_set<std::string> running_job_URLs			GUARDED_BY(mutex);
+	uint64 next_order											GUARDED_BY(mutex);
+	bool shutting_down											GUARDED_BY(mutex);
+
+	uint64 num_completed										GUARDED_BY(mutex);
+	uint64 num_failed											GUARDED_BY(mutex);
+	uint64 num_merged											GUARDED_BY(mutex);
+	double total_job_time										GUARDED_BY(mutex);
+	mutable std::deque<double> recent_completion_times			GUARDED_BY(mutex); // For computing throughput.
+};
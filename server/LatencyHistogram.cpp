@@ -0,0 +1,158 @@
+/*=====================================================================
+LatencyHistogram.cpp
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "LatencyHistogram.h"
+
+
+#include <Lock.h>
+#include <StringUtils.h>
+#include <mathstypes.h>
+#include <cmath>
+#include <limits>
+
+
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+
+void LatencyHistogram::addSample(double latency_s)
+{
+	const int bucket = bucketForLatency(latency_s);
+
+	Lock lock(mutex);
+	data.bucket_counts[bucket]++;
+	data.num_samples++;
+	data.sum += latency_s;
+	data.max = myMax(data.max, latency_s);
+}
+
+
+void LatencyHistogram::reset()
+{
+	Lock lock(mutex);
+	for(int i=0; i<NUM_BUCKETS; ++i)
+		data.bucket_counts[i] = 0;
+	data.num_samples = 0;
+	data.sum = 0;
+	data.max = 0;
+}
+
+
+LatencyHistogram::Snapshot LatencyHistogram::getSnapshot() const
+{
+	Lock lock(mutex);
+	return data;
+}
+
+
+int LatencyHistogram::bucketForLatency(double latency_s)
+{
+	const double latency_ms = latency_s * 1.0e3;
+	if(!(latency_ms >= 1.0)) // Handles NaN as well.
+		return 0;
+
+	// Bucket i (for i >= 1) holds latencies in [2^(i-1), 2^i) ms.
+	const int bucket = 1 + (int)std::floor(std::log2(myMin(latency_ms, 1.0e9)));
+	return myMin(bucket, NUM_BUCKETS - 1);
+}
+
+
+double LatencyHistogram::bucketLowerBound(int bucket)
+{
+	return (bucket == 0) ? 0.0 : std::ldexp(1.0, bucket - 1) * 1.0e-3;
+}
+
+
+double LatencyHistogram::estimatePercentile(const Snapshot& snapshot, double fraction)
+{
+	if(snapshot.num_samples == 0)
+		return 0;
+
+	const uint64 target = (uint64)std::ceil(fraction * (double)snapshot.num_samples);
+	uint64 cumulative = 0;
+	for(int i=0; i<NUM_BUCKETS - 1; ++i)
+	{
+		cumulative += snapshot.bucket_counts[i];
+		if(cumulative >= target)
+			return myMin(bucketLowerBound(i + 1), snapshot.max);
+	}
+	return snapshot.max;
+}
+
+
+std::string LatencyHistogram::toHTMLTable(const Snapshot& snapshot)
+{
+	std::string s;
+	s += "<p>samples: " + toString(snapshot.num_samples);
+	if(snapshot.num_samples > 0)
+	{
+		s += ", mean: " + doubleToStringNSigFigs(snapshot.sum / snapshot.num_samples * 1.0e3, 3) + " ms";
+		s += ", p50: <= " + doubleToStringNSigFigs(estimatePercentile(snapshot, 0.5) * 1.0e3, 3) + " ms";
+		s += ", p99: <= " + doubleToStringNSigFigs(estimatePercentile(snapshot, 0.99) * 1.0e3, 3) + " ms";
+		s += ", max: " + doubleToStringNSigFigs(snapshot.max * 1.0e3, 3) + " ms";
+	}
+	s += "</p>";
+
+	s += "<table><tr><th>latency</th><th>count</th></tr>";
+	for(int i=0; i<NUM_BUCKETS; ++i)
+	{
+		const std::string range = (i == NUM_BUCKETS - 1) ?
+			(">= " + toString((int)(bucketLowerBound(i) * 1.0e3)) + " ms") :
+			(toString((int)(bucketLowerBound(i) * 1.0e3)) + " - " + toString((int)(bucketLowerBound(i + 1) * 1.0e3)) + " ms");
+		s += "<tr><td>" + range + "</td><td>" + toString(snapshot.bucket_counts[i]) + "</td></tr>";
+	}
+	s += "</table>";
+	return s;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+#include <ConPrint.h>
+
+
+void LatencyHistogram::test()
+{
+	conPrint("LatencyHistogram::test()");
+
+	testAssert(bucketForLatency(0.0) == 0);
+	testAssert(bucketForLatency(-1.0) == 0);
+	testAssert(bucketForLatency(0.0009) == 0);
+	testAssert(bucketForLatency(0.001) == 1);
+	testAssert(bucketForLatency(0.0019) == 1);
+	testAssert(bucketForLatency(0.002) == 2);
+	testAssert(bucketForLatency(0.0035) == 2);
+	testAssert(bucketForLatency(0.004) == 3);
+	testAssert(bucketForLatency(0.1) == 7); // [64, 128) ms
+	testAssert(bucketForLatency(1000.0) == NUM_BUCKETS - 1);
+	testAssert(bucketForLatency(std::numeric_limits<double>::infinity()) == NUM_BUCKETS - 1);
+
+	{
+		LatencyHistogram hist;
+		for(int i=0; i<99; ++i)
+			hist.addSample(0.0005);
+		hist.addSample(0.05);
+
+		const Snapshot snapshot = hist.getSnapshot();
+		testAssert(snapshot.num_samples == 100);
+		testAssert(snapshot.bucket_counts[0] == 99);
+		testAssert(snapshot.bucket_counts[bucketForLatency(0.05)] == 1);
+		testAssert(snapshot.max == 0.05);
+		testAssert(epsEqual(estimatePercentile(snapshot, 0.5), 0.001));
+		testAssert(epsEqual(estimatePercentile(snapshot, 1.0), 0.05));
+
+		hist.reset();
+		testAssert(hist.getSnapshot().num_samples == 0);
+	}
+
+	conPrint("LatencyHistogram::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,56 @@
+/*=====================================================================
+LatencyHistogram.h
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <Mutex.h>
+#include <string>
+
+
+/*=====================================================================
+LatencyHistogram
+----------------
+Histogram of latency samples, with power-of-two millisecond buckets:
+bucket 0 is [0, 1 ms), bucket 1 is [1 ms, 2 ms), bucket 2 is [2 ms, 4 ms) etc.
+The last bucket holds all samples >= 2^(NUM_BUCKETS - 2) ms.
+
+Threadsafe.
+=====================================================================*/
+class LatencyHistogram
+{
+public:
+	static const int NUM_BUCKETS = 12;
+
+	struct Snapshot
+	{
+		uint64 bucket_counts[NUM_BUCKETS];
+		uint64 num_samples;
+		double sum; // Sum of latencies, in seconds.
+		double max; // Max latency, in seconds.
+	};
+
+	LatencyHistogram();
+
+	void addSample(double latency_s);
+	void reset();
+
+	Snapshot getSnapshot() const;
+
+	static int bucketForLatency(double latency_s);
+	static double bucketLowerBound(int bucket); // In seconds.
+
+	// Returns an estimate of the given percentile (fraction in [0, 1]) in seconds, using the upper bound of the bucket the percentile falls in.
+	static double estimatePercentile(const Snapshot& snapshot, double fraction);
+
+	static std::string toHTMLTable(const Snapshot& snapshot); // For the admin pages.
+
+	static void test();
+
+private:
+	mutable Mutex mutex;
+	Snapshot data GUARDED_BY(mutex);
+};
@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2022 -
 
 
 #include "ServerWorldState.h"
+#include "LODGenJobQueue.h"
 #include "../shared/LODGeneration.h"
 #include "../shared/ImageDecoding.h"
 #include <ConPrint.h>
@@ -18,6 +19,8 @@ Copyright Glare Technologies Limited 2022 -
 #include <TaskManager.h>
 #include <FileUtils.h>
 #include <KillThreadMessage.h>
+#include <ThreadManager.h>
+#include <Clock.h>
 #include <graphics/ImageMap.h>
 
 
@@ -38,38 +41,6 @@ static bool textureHasAlphaChannel(Reference<Map2D>& map)
 }
 
 
-struct LODMeshToGen
-{
-	std::string model_abs_path;
-	std::string LOD_model_abs_path;
-	std::string lod_URL;
-	int lod_level;
-	UserID owner_id;
-};
-
-
-struct LODTextureToGen
-{
-	std::string source_tex_abs_path; // Absolute base texture path, to read texture from.
-	std::string LOD_tex_abs_path; // LOD texture path, to write LOD texture to.
-	std::string lod_URL;
-	int lod_level;
-	UserID owner_id;
-};
-
-
-struct KTXTextureToGen
-{
-	std::string source_tex_abs_path; // source texture abs path
-	std::string ktx_tex_abs_path; // abs path to write KTX texture to.
-	std::string ktx_URL;
-	int base_lod_level;
-	int lod_level;
-	UserID owner_id;
-};
-
-
-
 struct MeshLODGenThreadTexInfo
 {
 	bool has_alpha;
@@ -77,6 +48,14 @@ struct MeshLODGenThreadTexInfo
 };
 
 
+// Returns the number of objects using the resource with the given URL, for job priorities.  Locks resources_mutex.
+static size_t numObjectsUsingURL(ServerAllWorldsState* world_state, const std::string& URL)
+{
+	InstrumentedLock lock(world_state->resources_mutex);
+	return myMax<size_t>(1, world_state->object_URL_index.numObjectsUsingURL(URL));
+}
+
+
 // Set object world space AABB if not set yet, or if it's incorrect.
 static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob)
 {
@@ -118,7 +97,7 @@ static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldS
 				/*const int new_max_lod_level = (voxel_group.voxels.size() > 256) ? 2 : 0;
 				if(new_max_lod_level != ob->max_model_lod_level)
 				{
-					Lock lock(world_state->mutex);
+					InstrumentedLock lock(world_state->mutex);
 					world->addWorldObjectAsDBDirty(ob);
 				}
 
@@ -147,7 +126,7 @@ static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldS
 		// Compute and assign aabb_ws to object.
 		if(!aabb_os.isEmpty()) // If we got a valid aabb_os:
 		{
-			Lock lock(world_state->mutex);
+			InstrumentedLock lock(world->mutex);
 
 			const bool updating_aabb_ws = !(approxEq(aabb_os.min_, ob->getAABBOS().min_) && approxEq(aabb_os.max_, ob->getAABBOS().max_)); //aabb_os != ob->getAABBOS();
 			if(updating_aabb_ws)
@@ -172,7 +151,7 @@ static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldS
 }
 
 
-static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::unordered_set<std::string>& lod_URLs_considered, std::vector<LODMeshToGen>& meshes_to_gen)
+static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::unordered_set<std::string>& lod_URLs_considered, double request_time, std::vector<LODGenJob>& jobs_out)
 {
 	try
 	{
@@ -188,7 +167,7 @@ static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, Serve
 				const int new_max_lod_level = (batched_mesh->numVerts() <= 4 * 6) ? 0 : 2; // If this is a very small model (e.g. a cuboid), don't generate LOD versions of it.
 				if(new_max_lod_level != ob->max_model_lod_level)
 				{
-					Lock lock(world_state->mutex);
+					InstrumentedLock lock(world_state->mutex);
 					world->addWorldObjectAsDBDirty(ob);
 				}
 
@@ -209,13 +188,16 @@ static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, Serve
 							if(!world_state->resource_manager->isFileForURLPresent(lod_URL))
 							{
 								// Add to list of models to generate
-								LODMeshToGen mesh_to_gen;
-								mesh_to_gen.lod_level = lvl;
-								mesh_to_gen.model_abs_path = model_abs_path;
-								mesh_to_gen.LOD_model_abs_path = lod_abs_path;
-								mesh_to_gen.lod_URL = lod_URL;
-								mesh_to_gen.owner_id = world_state->resource_manager->getExistingResourceForURL(ob->model_url)->owner_id;
-								meshes_to_gen.push_back(mesh_to_gen);
+								LODGenJob job;
+								job.type = LODGenJob::Type_LODMesh;
+								job.lod_level = lvl;
+								job.src_abs_path = model_abs_path;
+								job.output_abs_path = lod_abs_path;
+								job.output_URL = lod_URL;
+								job.owner_id = world_state->resource_manager->getExistingResourceForURL(ob->model_url)->owner_id;
+								job.num_refs = numObjectsUsingURL(world_state, ob->model_url);
+								job.last_request_time = request_time;
+								jobs_out.push_back(job);
 							}
 							//else // Else if LOD model is present on disk:
 							//{
@@ -262,6 +244,80 @@ static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, Serve
 }
 
 
+// If the object is a voxel object, set model_url to the mesh URL for its voxels if the meshes have been generated, otherwise add a job to generate them.
+// obs_waiting_for_voxel_mesh maps from mesh URL to the objects to update when the meshes have been generated.
+static void checkForVoxelMeshesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::unordered_set<std::string>& lod_URLs_considered, double request_time, 
+	std::unordered_map<std::string, std::set<UID>>& obs_waiting_for_voxel_mesh, std::vector<LODGenJob>& jobs_out)
+{
+	try
+	{
+		if((ob->object_type == WorldObject::ObjectType_VoxelGroup) && !ob->getCompressedVoxels().empty() && 
+			(ob->model_url.empty() || WorldObject::isVoxelMeshURL(ob->model_url))) // Don't replace any other model URL.
+		{
+			js::Vector<bool, 16> mats_transparent;
+			ob->getVoxelMatsTransparent(mats_transparent);
+			const std::string mesh_URL = WorldObject::makeVoxelMeshURL(ob->getCompressedVoxels(), mats_transparent);
+
+			if(ob->model_url == mesh_URL)
+				return;
+
+			const int max_lod_level = myClamp(ob->max_model_lod_level, 0, 2);
+
+			bool all_present = true;
+			for(int lvl = 0; lvl <= max_lod_level; ++lvl)
+				all_present = all_present && world_state->resource_manager->isFileForURLPresent(WorldObject::getLODModelURLForLevel(mesh_URL, lvl));
+
+			if(all_present)
+			{
+				conPrint("MeshLODGenThread: Setting model URL of voxel object " + ob->uid.toString() + " to " + mesh_URL);
+
+				ob->model_url = mesh_URL;
+				ob->last_modified_time = TimeStamp::currentTime(); // So incremental object sync sends the new model URL to clients.
+				{
+					InstrumentedLock lock(world_state->resources_mutex);
+					world_state->object_URL_index.updateObject(ob);
+				}
+
+				ob->from_remote_model_url_dirty = true;
+				world->addWorldObjectAsDBDirty(ob);
+				world->dirty_from_remote_objects.insert(ob);
+				world_state->notifyBroadcastNeeded();
+				world_state->markAsChanged();
+			}
+			else
+			{
+				obs_waiting_for_voxel_mesh[mesh_URL].insert(ob->uid);
+
+				if(lod_URLs_considered.count(mesh_URL) == 0)
+				{
+					lod_URLs_considered.insert(mesh_URL);
+
+					LODGenJob job;
+					job.type = LODGenJob::Type_VoxelMesh;
+					job.lod_level = max_lod_level;
+					job.output_abs_path = world_state->resource_manager->pathForURL(mesh_URL);
+					job.output_URL = mesh_URL;
+					job.owner_id = ob->creator_id;
+					job.compressed_voxels = ob->getCompressedVoxels();
+					job.mats_transparent = mats_transparent;
+					job.num_refs = obs_waiting_for_voxel_mesh[mesh_URL].size();
+					job.last_request_time = request_time;
+					jobs_out.push_back(job);
+				}
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("MeshLODGenThread: glare::Exception: " + e.what());
+	}
+	catch(std::exception& e) // catch std::bad_alloc etc..
+	{
+		conPrint(std::string("MeshLODGenThread: Caught std::exception: ") + e.what());
+	}
+}
+
+
 static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::map<std::string, MeshLODGenThreadTexInfo>& tex_info)
 {
 	for(size_t z=0; z<ob->materials.size(); ++z)
@@ -311,7 +367,7 @@ static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldSta
 							if(mat->flags != old_flags)
 							{
 								{
-									Lock lock(world_state->mutex);
+									InstrumentedLock lock(world->mutex);
 									world->addWorldObjectAsDBDirty(ob);
 								}
 								conPrint("Updated mat flags: (for mat with tex " + tex_abs_path + "): is_hi_res: " + boolToString(is_high_res));
@@ -331,7 +387,7 @@ static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldSta
 
 // Make tasks for generating LOD level textures.
 static void checkForLODTexturesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::unordered_set<std::string>& lod_URLs_considered, //std::map<std::string, MeshLODGenThreadTexInfo>& tex_info,
-	std::vector<LODTextureToGen>& textures_to_gen)
+	double request_time, std::vector<LODGenJob>& jobs_out)
 {
 	for(size_t z=0; z<ob->materials.size(); ++z)
 	{
@@ -373,13 +429,16 @@ static void checkForLODTexturesToGenerate(ServerAllWorldsState* world_state, Ser
 									const std::string lod_abs_path = world_state->resource_manager->pathForURL(lod_URL);
 
 									// Generate the texture
-									LODTextureToGen tex_to_gen;
-									tex_to_gen.lod_level = lvl;
-									tex_to_gen.source_tex_abs_path = tex_abs_path;
-									tex_to_gen.LOD_tex_abs_path = lod_abs_path;
-									tex_to_gen.lod_URL = lod_URL;
-									tex_to_gen.owner_id = base_resource->owner_id;
-									textures_to_gen.push_back(tex_to_gen);
+									LODGenJob job;
+									job.type = LODGenJob::Type_LODTexture;
+									job.lod_level = lvl;
+									job.src_abs_path = tex_abs_path;
+									job.output_abs_path = lod_abs_path;
+									job.output_URL = lod_URL;
+									job.owner_id = base_resource->owner_id;
+									job.num_refs = numObjectsUsingURL(world_state, texture_URL);
+									job.last_request_time = request_time;
+									jobs_out.push_back(job);
 								}
 							}
 						}
@@ -393,7 +452,7 @@ static void checkForLODTexturesToGenerate(ServerAllWorldsState* world_state, Ser
 
 // Make tasks for generating KTX level textures.
 static void checkForKTXTexturesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::unordered_set<std::string>& lod_URLs_considered,
-	std::vector<KTXTextureToGen>& ktx_textures_to_gen)
+	double request_time, std::vector<LODGenJob>& jobs_out)
 {
 	for(size_t z=0; z<ob->materials.size(); ++z)
 	{
@@ -430,14 +489,19 @@ static void checkForKTXTexturesToGenerate(ServerAllWorldsState* world_state, Ser
 									const std::string ktx_abs_path = world_state->resource_manager->pathForURL(ktx_lod_URL);
 
 									// Generate the texture
-									KTXTextureToGen tex_to_gen;
-									tex_to_gen.source_tex_abs_path = lod_abs_path; // source texture abs path
-									tex_to_gen.ktx_tex_abs_path = ktx_abs_path; // abs path to write KTX texture to.
-									tex_to_gen.ktx_URL = ktx_lod_URL;
-									tex_to_gen.base_lod_level = mat->minLODLevel();
-									tex_to_gen.lod_level = lvl;
-									tex_to_gen.owner_id = base_resource->owner_id;
-									ktx_textures_to_gen.push_back(tex_to_gen);
+									LODGenJob job;
+									job.type = LODGenJob::Type_KTXTexture;
+									job.src_abs_path = lod_abs_path; // source texture abs path
+									job.output_abs_path = ktx_abs_path; // abs path to write KTX texture to.
+									job.output_URL = ktx_lod_URL;
+									if(lod_URL != texture_URL)
+										job.depends_on_URL = lod_URL; // The LOD texture may not have been generated yet.
+									job.base_lod_level = mat->minLODLevel();
+									job.lod_level = lvl;
+									job.owner_id = base_resource->owner_id;
+									job.num_refs = numObjectsUsingURL(world_state, texture_URL);
+									job.last_request_time = request_time;
+									jobs_out.push_back(job);
 								}
 							}
 						}
@@ -449,21 +513,158 @@ static void checkForKTXTexturesToGenerate(ServerAllWorldsState* world_state, Ser
 }
 
 
+// Generates the output for the job, then adds it to resources.
+static void runLODGenJob(ServerAllWorldsState* world_state, const LODGenJob& job, glare::TaskManager& task_manager)
+{
+	if(job.type == LODGenJob::Type_CompressedVariants)
+	{
+		world_state->compressed_resource_variants.generateVariants(job.src_abs_path);
+
+		// Any cached variants from an earlier generation may be out of date.
+		world_state->resource_cache.invalidate(CompressedResourceVariants::variantPath(job.src_abs_path, CompressedResourceVariants::Encoding_Gzip));
+		world_state->resource_cache.invalidate(CompressedResourceVariants::variantPath(job.src_abs_path, CompressedResourceVariants::Encoding_Zstd));
+		return; // Variants are stored alongside the resource, and aren't resources themselves.
+	}
+
+	if(job.type == LODGenJob::Type_VoxelMesh)
+	{
+		LODGeneration::generateVoxelMeshes(job.compressed_voxels, job.mats_transparent, /*max_lod_level=*/job.lod_level, job.output_abs_path);
+
+		{ // lock scope
+			InstrumentedLock lock(world_state->resources_mutex);
+
+			for(int lvl = 0; lvl <= job.lod_level; ++lvl)
+			{
+				const std::string lod_abs_path = WorldObject::getLODModelURLForLevel(job.output_abs_path, lvl);
+
+				ResourceRef resource = new Resource(
+					WorldObject::getLODModelURLForLevel(job.output_URL, lvl), // URL
+					FileUtils::getFilename(lod_abs_path), // raw local path
+					Resource::State_Present, // state
+					job.owner_id
+				);
+
+				world_state->addResourcesAsDBDirty(resource);
+				world_state->resource_manager->addResource(resource);
+			}
+		} // End lock scope
+		return;
+	}
+
+	if(job.type == LODGenJob::Type_LODMesh)
+		LODGeneration::generateLODModel(job.src_abs_path, job.lod_level, job.output_abs_path);
+	else if(job.type == LODGenJob::Type_LODTexture)
+		LODGeneration::generateLODTexture(job.src_abs_path, job.lod_level, job.output_abs_path, task_manager);
+	else if(job.type == LODGenJob::Type_KTXTexture)
+		LODGeneration::generateKTXTexture(job.src_abs_path, job.base_lod_level, job.lod_level, job.output_abs_path, task_manager);
+	else
+		throw glare::Exception("invalid job type.");
+
+	// Now that we have generated the LOD model or texture, add it to resources.
+	{ // lock scope
+		InstrumentedLock lock(world_state->resources_mutex);
+
+		const std::string raw_path = FileUtils::getFilename(job.output_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
+
+		ResourceRef resource = new Resource(
+			job.output_URL, // URL
+			raw_path, // raw local path
+			Resource::State_Present, // state
+			job.owner_id
+		);
+
+		world_state->addResourcesAsDBDirty(resource);
+		world_state->resource_manager->addResource(resource);
+
+	} // End lock scope
+}
+
+
+LODGenWorkerThread::LODGenWorkerThread(ServerAllWorldsState* world_state_, ThreadSafeQueue<ThreadMessageRef>* lod_gen_thread_msg_queue_)
+:	world_state(world_state_),
+	lod_gen_thread_msg_queue(lod_gen_thread_msg_queue_)
+{
+}
+
+
+LODGenWorkerThread::~LODGenWorkerThread()
+{
+}
+
+
+void LODGenWorkerThread::doRun()
+{
+	PlatformUtils::setCurrentThreadName("LODGenWorkerThread");
+
+	// Jobs are run concurrently on all cores by the worker threads, so don't use more than one thread for work within a job.
+	glare::TaskManager task_manager("LODGenWorkerThread task manager", /*num threads=*/1);
+
+	try
+	{
+		LODGenJob job;
+		while(world_state->lod_gen_job_queue.dequeueJob(job)) // Blocks until a job is ready, returns false when the queue is shut down.
+		{
+			Timer timer;
+			bool succeeded = false;
+			try
+			{
+				conPrint("LODGenWorkerThread: Generating " + std::string(LODGenJob::typeName(job.type)) + " with URL " + job.output_URL + " (refs: " + toString(job.num_refs) + ")");
+
+				runLODGenJob(world_state, job, task_manager);
+
+				succeeded = true;
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("\tLODGenWorkerThread: glare::Exception while generating " + std::string(LODGenJob::typeName(job.type)) + ": " + e.what());
+			}
+			catch(std::exception& e) // catch std::bad_alloc etc..
+			{
+				conPrint("\tLODGenWorkerThread: Caught std::exception while generating " + std::string(LODGenJob::typeName(job.type)) + ": " + e.what());
+			}
+
+			world_state->lod_gen_job_queue.jobFinished(job, succeeded, timer.elapsed(), Clock::getCurTimeRealSec());
+
+			// Tell the MeshLODGenThread the voxel meshes are done, even if generation failed, so it stops waiting for them.
+			// If they were generated, it will set the model URL of the objects with these voxels.
+			if(job.type == LODGenJob::Type_VoxelMesh)
+			{
+				VoxelMeshGenerated* msg = new VoxelMeshGenerated();
+				msg->voxel_mesh_URL = job.output_URL;
+				msg->succeeded = succeeded;
+				lod_gen_thread_msg_queue->enqueue(msg);
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("LODGenWorkerThread: glare::Exception: " + e.what());
+	}
+}
+
+
 void MeshLODGenThread::doRun()
 {
 	PlatformUtils::setCurrentThreadName("MeshLODGenThread");
 
-	glare::TaskManager task_manager("MeshLODGenThread task manager");
+	// Start worker threads to run the jobs we add to the job queue.
+	ThreadManager worker_thread_manager;
+	const size_t num_workers = myMax<size_t>(1, PlatformUtils::getNumLogicalProcessors());
+	for(size_t i=0; i<num_workers; ++i)
+		worker_thread_manager.addThread(new LODGenWorkerThread(world_state, &getMessageQueue()));
 
 	// When this thread starts, we will do a full scan over all objects.
-	// After that we will wait for CheckGenResourcesForObject messages, which instruct this thread to just scan a single object.
+	// After that we will wait for CheckGenResourcesForObject messages, which instruct this thread to just scan a single object,
+	// and VoxelMeshGenerated messages, after which we scan the objects waiting for the voxel meshes.
 	bool do_initial_full_scan = true;
 
+	std::unordered_map<std::string, std::set<UID>> obs_waiting_for_voxel_mesh; // Map from voxel mesh URL to objects to update when the meshes are generated.
+
 	try
 	{
 		while(1)
 		{
-			UID ob_to_scan_UID = UID::invalidUID();
+			std::vector<UID> obs_to_scan_UIDs;
 			if(!do_initial_full_scan)
 			{
 				// Block until we have a message
@@ -473,37 +674,56 @@ void MeshLODGenThread::doRun()
 				if(dynamic_cast<CheckGenResourcesForObject*>(msg.ptr()))
 				{
 					const CheckGenResourcesForObject* check_gen_msg = static_cast<CheckGenResourcesForObject*>(msg.ptr());
-					ob_to_scan_UID = check_gen_msg->ob_uid;
+					obs_to_scan_UIDs.push_back(check_gen_msg->ob_uid);
 
-					conPrint("MeshLODGenThread: Received message to scan object with UID " + ob_to_scan_UID.toString());
+					conPrint("MeshLODGenThread: Received message to scan object with UID " + check_gen_msg->ob_uid.toString());
+				}
+				else if(dynamic_cast<VoxelMeshGenerated*>(msg.ptr()))
+				{
+					const VoxelMeshGenerated* generated_msg = static_cast<VoxelMeshGenerated*>(msg.ptr());
+					auto res = obs_waiting_for_voxel_mesh.find(generated_msg->voxel_mesh_URL);
+					if(res != obs_waiting_for_voxel_mesh.end())
+					{
+						if(generated_msg->succeeded)
+							obs_to_scan_UIDs.assign(res->second.begin(), res->second.end());
+						else
+							conPrint("MeshLODGenThread: Failed to generate voxel mesh " + generated_msg->voxel_mesh_URL + " for " + toString(res->second.size()) + " object(s).  Will retry when they are next scanned.");
+						obs_waiting_for_voxel_mesh.erase(res);
+					}
 				}
 				else if(dynamic_cast<KillThreadMessage*>(msg.ptr()))
 				{
-					return;
+					break;
 				}
 			}
 
 			// Iterate over objects.
 			// Set object world space AABB.
 			// Set object max_lod_level if it is a generic model or a voxel model.
-			// Compute list of LOD meshes we need to generate.
-			std::vector<LODMeshToGen> meshes_to_gen;
-			std::vector<LODTextureToGen> lod_textures_to_gen;
-			std::vector<KTXTextureToGen> ktx_textures_to_gen;
+			// Compute list of LOD meshes and textures we need to generate.
+			std::vector<LODGenJob> jobs;
 			std::unordered_set<std::string> lod_URLs_considered;
 			std::map<std::string, MeshLODGenThreadTexInfo> tex_info; // Cached info about textures
+			const double request_time = Clock::getCurTimeRealSec();
 
 			conPrint("MeshLODGenThread: Iterating over world object(s)...");
 			Timer timer;
 			
 			{
-				Lock lock(world_state->mutex);
+				// Take a copy of the world states, so that each world can be scanned with just its own lock held.
+				std::vector<Reference<ServerWorldState>> worlds;
+				{
+					InstrumentedLock lock(world_state->mutex);
+					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+						worlds.push_back(world_it->second);
+				}
 
 				if(do_initial_full_scan)
 				{
-					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+					for(size_t w=0; w<worlds.size(); ++w)
 					{
-						ServerWorldState* world = world_it->second.ptr();
+						ServerWorldState* world = worlds[w].ptr();
+						InstrumentedLock world_lock(world->mutex);
 						for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
 						{
 							WorldObject* ob = it->second.ptr();
@@ -515,9 +735,10 @@ void MeshLODGenThread::doRun()
 								if(false)
 									checkMaterialFlags(world_state, world, ob, tex_info);
 
-								checkForLODMeshesToGenerate(world_state, world, ob, lod_URLs_considered, meshes_to_gen);
-								checkForLODTexturesToGenerate(world_state, world, ob, lod_URLs_considered, lod_textures_to_gen);
-								checkForKTXTexturesToGenerate(world_state, world, ob, lod_URLs_considered, ktx_textures_to_gen);
+								checkForLODMeshesToGenerate(world_state, world, ob, lod_URLs_considered, request_time, jobs);
+								checkForLODTexturesToGenerate(world_state, world, ob, lod_URLs_considered, request_time, jobs);
+								checkForKTXTexturesToGenerate(world_state, world, ob, lod_URLs_considered, request_time, jobs);
+								checkForVoxelMeshesToGenerate(world_state, world, ob, lod_URLs_considered, request_time, obs_waiting_for_voxel_mesh, jobs);
 							}
 							catch(glare::Exception& e)
 							{
@@ -529,19 +750,22 @@ void MeshLODGenThread::doRun()
 				}
 				else
 				{
-					// Look up object for UID
-					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+					// Look up objects for UIDs
+					for(size_t i=0; i<obs_to_scan_UIDs.size(); ++i)
+					for(size_t w=0; w<worlds.size(); ++w)
 					{
-						ServerWorldState* world = world_it->second.ptr();
-						auto res = world->objects.find(ob_to_scan_UID);
+						ServerWorldState* world = worlds[w].ptr();
+						InstrumentedLock world_lock(world->mutex);
+						auto res = world->objects.find(obs_to_scan_UIDs[i]);
 						if(res != world->objects.end())
 						{
 							WorldObject* ob = res->second.ptr();
 							try
 							{
-								checkForLODMeshesToGenerate(world_state, world, ob, lod_URLs_considered, meshes_to_gen);
-								checkForLODTexturesToGenerate(world_state, world, ob, lod_URLs_considered, lod_textures_to_gen);
-								checkForKTXTexturesToGenerate(world_state, world, ob, lod_URLs_considered, ktx_textures_to_gen);
+								checkForLODMeshesToGenerate(world_state, world, ob, lod_URLs_considered, request_time, jobs);
+								checkForLODTexturesToGenerate(world_state, world, ob, lod_URLs_considered, request_time, jobs);
+								checkForKTXTexturesToGenerate(world_state, world, ob, lod_URLs_considered, request_time, jobs);
+								checkForVoxelMeshesToGenerate(world_state, world, ob, lod_URLs_considered, request_time, obs_waiting_for_voxel_mesh, jobs);
 							}
 							catch(glare::Exception& e)
 							{
@@ -552,130 +776,10 @@ void MeshLODGenThread::doRun()
 				}
 			} // End lock scope
 
-			conPrint("MeshLODGenThread: Iterating over objects took " + timer.elapsedStringNSigFigs(4) + ", meshes_to_gen: " + toString(meshes_to_gen.size()) + ", lod_textures_to_gen: " + toString(lod_textures_to_gen.size()) + 
-				", ktx_textures_to_gen: " + toString(ktx_textures_to_gen.size()));
-
-
-			//-------------------------------------------  Generate each mesh, without holding the world lock -------------------------------------------
-			conPrint("MeshLODGenThread: Generating LOD meshes...");
-			timer.reset();
-
-			for(size_t i=0; i<meshes_to_gen.size(); ++i)
-			{
-				const LODMeshToGen& mesh_to_gen = meshes_to_gen[i];
-				try
-				{
-					conPrint("MeshLODGenThread: Generating LOD mesh with URL " + mesh_to_gen.lod_URL);
-
-					LODGeneration::generateLODModel(mesh_to_gen.model_abs_path, mesh_to_gen.lod_level, mesh_to_gen.LOD_model_abs_path);
-
-					// Now that we have generated the LOD model, add it to resources.
-					{ // lock scope
-						Lock lock(world_state->mutex);
-
-						const std::string raw_path = FileUtils::getFilename(mesh_to_gen.LOD_model_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
-
-						ResourceRef resource = new Resource(
-							mesh_to_gen.lod_URL, // URL
-							raw_path, // raw local path
-							Resource::State_Present, // state
-							mesh_to_gen.owner_id
-						);
-
-						world_state->addResourcesAsDBDirty(resource);
-						world_state->resource_manager->addResource(resource);
-						
-					} // End lock scope
-				}
-				catch(glare::Exception& e)
-				{
-					conPrint("\tMeshLODGenThread: glare::Exception while generating LOD model: " + e.what());
-				}
-			}
-
-			conPrint("MeshLODGenThread: Done generating LOD meshes. (Elapsed: " + timer.elapsedStringNSigFigs(4) + ")");
-
+			conPrint("MeshLODGenThread: Iterating over objects took " + timer.elapsedStringNSigFigs(4) + ", jobs: " + toString(jobs.size()));
 
-			//------------------------------------------- Generate each texture, without holding the world lock -------------------------------------------
-			conPrint("MeshLODGenThread: Generating LOD textures...");
-			timer.reset();
-
-			for(size_t i=0; i<lod_textures_to_gen.size(); ++i)
-			{
-				const LODTextureToGen& tex_to_gen = lod_textures_to_gen[i];
-				try
-				{
-					conPrint("MeshLODGenThread:  (LOD tex " + toString(i) + " / " + toString(lod_textures_to_gen.size()) + "): Generating LOD texture with URL " + tex_to_gen.lod_URL);
-
-					LODGeneration::generateLODTexture(tex_to_gen.source_tex_abs_path, tex_to_gen.lod_level, tex_to_gen.LOD_tex_abs_path, task_manager);
-
-					// Now that we have generated the LOD model, add it to resources.
-					{ // lock scope
-						Lock lock(world_state->mutex);
-
-						const std::string raw_path = FileUtils::getFilename(tex_to_gen.LOD_tex_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
-
-						ResourceRef resource = new Resource(
-							tex_to_gen.lod_URL, // URL
-							raw_path, // raw local path
-							Resource::State_Present, // state
-							tex_to_gen.owner_id
-						);
-
-						world_state->addResourcesAsDBDirty(resource);
-						world_state->resource_manager->addResource(resource);
-
-					} // End lock scope
-				}
-				catch(glare::Exception& e)
-				{
-					conPrint("\tMeshLODGenThread: excep while generating LOD texture: " + e.what());
-				}
-			}
-
-			conPrint("MeshLODGenThread: Done generating LOD textures. (Elapsed: " + timer.elapsedStringNSigFigs(4));
-
-			//------------------------------------------- Generate each KTX texture, without holding the world lock -------------------------------------------
-			conPrint("MeshLODGenThread: Generating KTX textures...");
-			timer.reset();
-
-			for(size_t i=0; i<ktx_textures_to_gen.size(); ++i)
-			{
-				const KTXTextureToGen& tex_to_gen = ktx_textures_to_gen[i];
-				try
-				{
-					conPrint("MeshLODGenThread: (ktx " + toString(i) + " / " + toString(ktx_textures_to_gen.size()) + "): Generating KTX texture with URL " + tex_to_gen.ktx_URL);
-
-					LODGeneration::generateKTXTexture(tex_to_gen.source_tex_abs_path, 
-						tex_to_gen.base_lod_level, tex_to_gen.lod_level, tex_to_gen.ktx_tex_abs_path, 
-						task_manager);
-
-					// Now that we have generated the LOD model, add it to resources.
-					{ // lock scope
-						Lock lock(world_state->mutex);
-
-						const std::string raw_path = FileUtils::getFilename(tex_to_gen.ktx_tex_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
-
-						ResourceRef resource = new Resource(
-							tex_to_gen.ktx_URL, // URL
-							raw_path, // raw local path
-							Resource::State_Present, // state
-							tex_to_gen.owner_id
-						);
-
-						world_state->addResourcesAsDBDirty(resource);
-						world_state->resource_manager->addResource(resource);
-
-					} // End lock scope
-				}
-				catch(glare::Exception& e)
-				{
-					conPrint("\tMeshLODGenThread: excep while generating KTX texture: " + e.what());
-				}
-			}
-
-			conPrint("MeshLODGenThread: Done generating KTX textures. (Elapsed: " + timer.elapsedStringNSigFigs(4) + ")");
-			//------------------------------------------- End Generate each KTX texture  -------------------------------------------
+			// Add the jobs to the queue, to be run by the worker threads without holding the world lock.
+			world_state->lod_gen_job_queue.enqueueJobs(jobs);
 		}
 	}
 	catch(glare::Exception& e)
@@ -686,4 +790,7 @@ void MeshLODGenThread::doRun()
 	{
 		conPrint(std::string("MeshLODGenThread: Caught std::exception: ") + e.what());
 	}
+
+	// Make the worker threads return once they have finished their current jobs.  worker_thread_manager will wait for them to terminate.
+	world_state->lod_gen_job_queue.shutdown();
 }
@@ -8,6 +8,7 @@ Copyright Glare Technologies Limited 2022 -
 
 #include "../shared/UID.h"
 #include <MessageableThread.h>
+#include <string>
 class ServerAllWorldsState;
 
 
@@ -18,10 +19,29 @@ public:
 };
 
 
+// Sent by a LODGenWorkerThread to the MeshLODGenThread when it has generated the meshes for some voxels, so the objects with those voxels can be updated to use them.
+class VoxelMeshGenerated : public ThreadMessage
+{
+public:
+	VoxelMeshGenerated() : succeeded(false) {}
+
+	std::string voxel_mesh_URL;
+	bool succeeded; // False if generating the meshes failed.  The objects waiting for the meshes are left unchanged.
+};
+
+
 /*=====================================================================
 MeshLODGenThread
 ----------------
-Does generation of LOD meshes, also LOD textures and KTX textures.
+Does generation of LOD meshes, also LOD textures and KTX textures, and meshes for voxel objects.
+
+Scans objects for LOD meshes and textures that need generating, and adds jobs for them
+to world_state->lod_gen_job_queue.  The jobs are run concurrently by LODGenWorkerThreads,
+which this thread starts.
+
+Voxel objects have their voxels meshed for each model LOD level, so clients can download the meshes
+instead of meshing the voxels themselves.  Once the meshes are generated, the object model_url is set to
+the mesh URL.  (See WorldObject::makeVoxelMeshURL)
 
 Lightmap LOD generation is done by LightMapperBot.
 =====================================================================*/
@@ -37,3 +57,23 @@ public:
 private:
 	ServerAllWorldsState* world_state;
 };
+
+
+/*=====================================================================
+LODGenWorkerThread
+------------------
+Runs jobs from world_state->lod_gen_job_queue until the queue is shut down.
+=====================================================================*/
+class LODGenWorkerThread : public MessageableThread
+{
+public:
+	LODGenWorkerThread(ServerAllWorldsState* world_state, ThreadSafeQueue<ThreadMessageRef>* lod_gen_thread_msg_queue);
+
+	virtual ~LODGenWorkerThread();
+
+	virtual void doRun();
+
+private:
+	ServerAllWorldsState* world_state;
+	ThreadSafeQueue<ThreadMessageRef>* lod_gen_thread_msg_queue; // VoxelMeshGenerated messages are sent to this queue.
+};
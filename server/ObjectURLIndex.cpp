@@ -0,0 +1,191 @@
+/*=====================================================================
+ObjectURLIndex.cpp
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ObjectURLIndex.h"
+
+
+#include "../shared/WorldObject.h"
+
+
+ObjectURLIndex::ObjectURLIndex()
+{}
+
+
+ObjectURLIndex::~ObjectURLIndex()
+{}
+
+
+void ObjectURLIndex::updateObject(const WorldObject* ob)
+{
+	removeObject(ob->uid);
+
+	temp_URLs.clear();
+	ob->appendDependencyURLsForAllLODLevels(temp_URLs);
+
+	std::vector<const std::string*>& URLs = ob_URLs[ob->uid];
+	for(size_t i=0; i<temp_URLs.size(); ++i)
+	{
+		auto res = URL_obs.insert(std::make_pair(temp_URLs[i].URL, ObUIDSet()));
+		const bool newly_inserted_ob = res.first->second.insert(ob->uid).second;
+		if(newly_inserted_ob) // The same URL may be returned more than once for an object, just store it once.
+			URLs.push_back(&res.first->first);
+	}
+}
+
+
+void ObjectURLIndex::removeObject(const UID& ob_uid)
+{
+	auto res = ob_URLs.find(ob_uid);
+	if(res == ob_URLs.end())
+		return;
+
+	const std::vector<const std::string*>& URLs = res->second;
+	for(size_t i=0; i<URLs.size(); ++i)
+	{
+		auto URL_res = URL_obs.find(*URLs[i]);
+		assert(URL_res != URL_obs.end());
+		URL_res->second.erase(ob_uid);
+		if(URL_res->second.empty())
+			URL_obs.erase(URL_res); // Invalidates the URL pointer, but we are done with it.
+	}
+
+	ob_URLs.erase(res);
+}
+
+
+void ObjectURLIndex::clear()
+{
+	URL_obs.clear();
+	ob_URLs.clear();
+}
+
+
+void ObjectURLIndex::appendObjectsUsingURL(const std::string& URL, std::vector<UID>& ob_uids_out) const
+{
+	auto res = URL_obs.find(URL);
+	if(res != URL_obs.end())
+		ob_uids_out.insert(ob_uids_out.end(), res->second.begin(), res->second.end());
+}
+
+
+size_t ObjectURLIndex::numObjectsUsingURL(const std::string& URL) const
+{
+	auto res = URL_obs.find(URL);
+	return (res != URL_obs.end()) ? res->second.size() : 0;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <algorithm>
+
+
+static WorldObjectRef makeTestObject(uint64 uid, const std::string& model_url, const std::string& colour_texture_url)
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->uid = UID(uid);
+	ob->model_url = model_url;
+	ob->max_model_lod_level = 0;
+	if(!colour_texture_url.empty())
+	{
+		ob->materials.resize(1);
+		ob->materials[0] = new WorldMaterial();
+		ob->materials[0]->colour_texture_url = colour_texture_url;
+	}
+	return ob;
+}
+
+
+static std::vector<UID> getSortedObjectsUsingURL(const ObjectURLIndex& index, const std::string& URL)
+{
+	std::vector<UID> uids;
+	index.appendObjectsUsingURL(URL, uids);
+	std::sort(uids.begin(), uids.end());
+	return uids;
+}
+
+
+void ObjectURLIndex::test()
+{
+	conPrint("ObjectURLIndex::test()");
+
+	//-------------------- Test adding and removing objects --------------------
+	{
+		ObjectURLIndex index;
+		WorldObjectRef ob1 = makeTestObject(1, "a.bmesh", "tex.jpg");
+		WorldObjectRef ob2 = makeTestObject(2, "a.bmesh", "");
+		WorldObjectRef ob3 = makeTestObject(3, "b.bmesh", "tex.jpg");
+		index.updateObject(ob1.ptr());
+		index.updateObject(ob2.ptr());
+		index.updateObject(ob3.ptr());
+
+		testAssert(index.numObjects() == 3);
+		testAssert(index.numObjectsUsingURL("a.bmesh") == 2);
+		testAssert(index.numObjectsUsingURL("b.bmesh") == 1);
+		testAssert(index.numObjectsUsingURL("tex.jpg") == 2);
+		testAssert(index.numObjectsUsingURL("c.bmesh") == 0);
+
+		std::vector<UID> uids = getSortedObjectsUsingURL(index, "a.bmesh");
+		testAssert(uids.size() == 2 && uids[0] == UID(1) && uids[1] == UID(2));
+
+		index.removeObject(UID(1));
+		testAssert(index.numObjects() == 2);
+		testAssert(index.numObjectsUsingURL("a.bmesh") == 1);
+		testAssert(index.numObjectsUsingURL("tex.jpg") == 1);
+
+		index.removeObject(UID(1)); // Removing again should do nothing.
+		testAssert(index.numObjects() == 2);
+
+		index.removeObject(UID(2));
+		index.removeObject(UID(3));
+		testAssert(index.numObjects() == 0);
+		testAssert(index.numURLs() == 0);
+	}
+
+	//-------------------- Test updating objects whose URLs have changed --------------------
+	{
+		ObjectURLIndex index;
+		WorldObjectRef ob = makeTestObject(1, "a.bmesh", "tex.jpg");
+		index.updateObject(ob.ptr());
+		index.updateObject(ob.ptr()); // Updating without changes shouldn't change anything.
+		testAssert(index.numObjects() == 1);
+		testAssert(index.numObjectsUsingURL("a.bmesh") == 1);
+
+		ob->model_url = "b.bmesh";
+		ob->materials[0]->colour_texture_url = "";
+		index.updateObject(ob.ptr());
+		testAssert(index.numObjectsUsingURL("a.bmesh") == 0);
+		testAssert(index.numObjectsUsingURL("b.bmesh") == 1);
+		testAssert(index.numObjectsUsingURL("tex.jpg") == 0);
+	}
+
+	//-------------------- Test that LOD model URLs are indexed --------------------
+	{
+		ObjectURLIndex index;
+		WorldObjectRef ob = makeTestObject(1, "a.bmesh", "");
+		ob->max_model_lod_level = 2;
+		index.updateObject(ob.ptr());
+		testAssert(index.numObjectsUsingURL(WorldObject::getLODModelURLForLevel("a.bmesh", 1)) == 1);
+		testAssert(index.numObjectsUsingURL(WorldObject::getLODModelURLForLevel("a.bmesh", 2)) == 1);
+	}
+
+	//-------------------- Test clear --------------------
+	{
+		ObjectURLIndex index;
+		WorldObjectRef ob = makeTestObject(1, "a.bmesh", "tex.jpg");
+		index.updateObject(ob.ptr());
+		index.clear();
+		testAssert(index.numObjects() == 0);
+		testAssert(index.numObjectsUsingURL("a.bmesh") == 0);
+	}
+
+	conPrint("ObjectURLIndex::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,59 @@
+/*=====================================================================
+ObjectURLIndex.h
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UID.h"
+#include "../shared/DependencyURL.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+class WorldObject;
+
+
+/*=====================================================================
+ObjectURLIndex
+--------------
+Reverse index from resource URL to the objects that use the resource, over all worlds.
+(Object UIDs are unique over all worlds)
+
+The URLs for an object are those returned by WorldObject::appendDependencyURLsForAllLODLevels(),
+so include LOD model, LOD texture and lightmap URLs.
+
+Should be updated whenever an object is created or destroyed, or any of its URLs change.
+
+Not threadsafe, should be accessed with the ServerAllWorldsState mutex held.
+=====================================================================*/
+class ObjectURLIndex
+{
+public:
+	ObjectURLIndex();
+	~ObjectURLIndex();
+
+	void updateObject(const WorldObject* ob); // Adds the object, or if it has already been added, updates the URLs for it.
+	void removeObject(const UID& ob_uid); // Does nothing if not added.
+	void clear();
+
+	// Appends the UIDs of objects using the resource with the given URL.
+	void appendObjectsUsingURL(const std::string& URL, std::vector<UID>& ob_uids_out) const;
+
+	size_t numObjectsUsingURL(const std::string& URL) const;
+
+	size_t numObjects() const { return ob_URLs.size(); }
+	size_t numURLs() const { return URL_obs.size(); }
+
+	static void test();
+
+private:
+	typedef std::unordered_set<UID, UIDHasher> ObUIDSet;
+	typedef std::unordered_map<std::string, ObUIDSet> URLObsMap;
+
+	URLObsMap URL_obs; // Map from URL to objects using the URL.  Only URLs used by at least one object are stored.
+	std::unordered_map<UID, std::vector<const std::string*>, UIDHasher> ob_URLs; // Map from object UID to the URLs it uses.  Points to keys in URL_obs, which are stable.
+
+	std::vector<DependencyURL> temp_URLs;
+};
@@ -0,0 +1,274 @@
+/*=====================================================================
+ReplicationLog.cpp
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ReplicationLog.h"
+
+
+#include "ServerWorldState.h"
+#include <Lock.h>
+#include <CryptoRNG.h>
+#include <Clock.h>
+#include <Exception.h>
+#include <Timer.h>
+
+
+static uint64 makeEpoch()
+{
+	uint64 epoch = 0;
+	try
+	{
+		CryptoRNG::getRandomBytes((uint8*)&epoch, sizeof(epoch)); // throws glare::Exception on failure
+	}
+	catch(glare::Exception&)
+	{
+		epoch = (uint64)(Clock::getSecsSince1970() * 1000000.0);
+	}
+	return (epoch != 0) ? epoch : 1; // Followers use epoch 0 to mean they have no checkpoint.
+}
+
+
+ReplicationLog::ReplicationLog(size_t max_bytes_)
+:	epoch(makeEpoch()),
+	last_seq_num(0),
+	bytes_used(0),
+	max_bytes(max_bytes_)
+{}
+
+
+ReplicationLog::~ReplicationLog()
+{}
+
+
+void ReplicationLog::setMaxBytes(size_t new_max_bytes)
+{
+	Lock lock(mutex);
+	max_bytes = new_max_bytes;
+	evictToFit();
+}
+
+
+uint64 ReplicationLog::getLastSeqNum() const
+{
+	Lock lock(mutex);
+	return last_seq_num;
+}
+
+
+size_t ReplicationLog::snapshotBytes(const DatabaseSnapshot& snapshot)
+{
+	size_t bytes = sizeof(DatabaseSnapshot) + snapshot.data.buf.size() + snapshot.records_to_delete.size() * sizeof(DatabaseKey) +
+		snapshot.record_updates.size() * sizeof(DatabaseSnapshot::RecordUpdate);
+	for(size_t i=0; i<snapshot.present_resources.size(); ++i)
+		bytes += sizeof(DatabaseSnapshot::PresentResource) + snapshot.present_resources[i].URL.size() + snapshot.present_resources[i].local_path.size();
+	return bytes;
+}
+
+
+void ReplicationLog::evictToFit()
+{
+	while((bytes_used > max_bytes) && (entries.size() > 1))
+	{
+		bytes_used -= snapshotBytes(*entries.front().snapshot);
+		entries.pop_front();
+	}
+}
+
+
+void ReplicationLog::append(const std::vector<Reference<DatabaseSnapshot>>& snapshots)
+{
+	if(snapshots.empty())
+		return;
+
+	{
+		Lock lock(mutex);
+		for(size_t i=0; i<snapshots.size(); ++i)
+		{
+			Entry entry;
+			entry.seq_num = ++last_seq_num;
+			entry.snapshot = snapshots[i];
+			entries.push_back(entry);
+			bytes_used += snapshotBytes(*snapshots[i]);
+		}
+		evictToFit();
+	}
+
+	new_entries_condition.notify();
+}
+
+
+bool ReplicationLog::getEntriesAfter(uint64 seq_num, size_t max_num_entries, double max_wait_time_s, std::vector<Entry>& entries_out)
+{
+	entries_out.clear();
+
+	Lock lock(mutex);
+
+	if(seq_num > last_seq_num)
+		return false; // Follower is ahead of us, so its checkpoint must be from somewhere else.
+
+	Timer timer;
+	while(seq_num == last_seq_num)
+	{
+		const double remaining_time = max_wait_time_s - timer.elapsed();
+		if(remaining_time <= 0)
+			return true;
+		new_entries_condition.waitWithTimeout(mutex, remaining_time); // May return early due to a spurious wakeup, in which case we wait again.
+	}
+
+	// Entries have consecutive sequence numbers, so the entry after seq_num is at a known index, if it hasn't been evicted.
+	if(entries.empty() || (seq_num + 1 < entries.front().seq_num))
+		return false;
+
+	const size_t begin = (size_t)(seq_num + 1 - entries.front().seq_num);
+	for(size_t i=begin; (i < entries.size()) && (entries_out.size() < max_num_entries); ++i)
+		entries_out.push_back(entries[i]);
+
+	return true;
+}
+
+
+ReplicationLog::Stats ReplicationLog::getStats() const
+{
+	Lock lock(mutex);
+	Stats stats;
+	stats.num_entries = entries.size();
+	stats.first_seq_num = entries.empty() ? 0 : entries.front().seq_num;
+	stats.last_seq_num = last_seq_num;
+	stats.bytes_used = bytes_used;
+	stats.max_bytes = max_bytes;
+	return stats;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/MyThread.h>
+#include <utils/PlatformUtils.h>
+
+
+static Reference<DatabaseSnapshot> makeTestSnapshot(size_t data_size)
+{
+	Reference<DatabaseSnapshot> snapshot = new DatabaseSnapshot();
+	snapshot->data.buf.resize(data_size);
+	snapshot->snapshot_time = 0;
+	snapshot->lock_hold_time = 0;
+	return snapshot;
+}
+
+
+// Appends a snapshot after a short delay, to test waiting in getEntriesAfter().
+class ReplicationLogTestAppendThread : public MyThread
+{
+public:
+	virtual void run()
+	{
+		PlatformUtils::Sleep(50);
+		log->append(std::vector<Reference<DatabaseSnapshot>>(1, makeTestSnapshot(100)));
+	}
+	ReplicationLog* log;
+};
+
+
+void ReplicationLog::test()
+{
+	conPrint("ReplicationLog::test()");
+
+	std::vector<Entry> entries;
+
+	//-------------------- Test empty log --------------------
+	{
+		ReplicationLog log(/*max bytes=*/1000000);
+		testAssert(log.getEpoch() != 0);
+		testAssert(log.getLastSeqNum() == 0);
+		testAssert(log.getEntriesAfter(0, 100, /*max wait time=*/0, entries));
+		testAssert(entries.empty());
+
+		// A checkpoint ahead of the log needs a full sync.
+		testAssert(!log.getEntriesAfter(1, 100, /*max wait time=*/0, entries));
+	}
+
+	//-------------------- Test appending and getting entries --------------------
+	{
+		ReplicationLog log(/*max bytes=*/1000000);
+
+		std::vector<Reference<DatabaseSnapshot>> snapshots;
+		for(int i=0; i<5; ++i)
+			snapshots.push_back(makeTestSnapshot(100));
+		log.append(snapshots);
+		testAssert(log.getLastSeqNum() == 5);
+
+		testAssert(log.getEntriesAfter(0, 100, /*max wait time=*/0, entries));
+		testAssert(entries.size() == 5);
+		for(size_t i=0; i<entries.size(); ++i)
+		{
+			testAssert(entries[i].seq_num == i + 1);
+			testAssert(entries[i].snapshot.ptr() == snapshots[i].ptr());
+		}
+
+		testAssert(log.getEntriesAfter(3, 100, /*max wait time=*/0, entries));
+		testAssert(entries.size() == 2 && entries[0].seq_num == 4 && entries[1].seq_num == 5);
+
+		// Test max_num_entries
+		testAssert(log.getEntriesAfter(1, 2, /*max wait time=*/0, entries));
+		testAssert(entries.size() == 2 && entries[0].seq_num == 2 && entries[1].seq_num == 3);
+
+		// Caught up
+		testAssert(log.getEntriesAfter(5, 100, /*max wait time=*/0, entries));
+		testAssert(entries.empty());
+	}
+
+	//-------------------- Test eviction --------------------
+	{
+		const size_t snapshot_bytes = snapshotBytes(*makeTestSnapshot(1000));
+		ReplicationLog log(/*max bytes=*/snapshot_bytes * 3);
+
+		for(int i=0; i<10; ++i)
+			log.append(std::vector<Reference<DatabaseSnapshot>>(1, makeTestSnapshot(1000)));
+
+		const Stats stats = log.getStats();
+		testAssert(stats.num_entries == 3);
+		testAssert(stats.first_seq_num == 8 && stats.last_seq_num == 10);
+		testAssert(stats.bytes_used <= stats.max_bytes);
+
+		testAssert(!log.getEntriesAfter(0, 100, /*max wait time=*/0, entries)); // Entry 1 has been evicted.
+		testAssert(!log.getEntriesAfter(6, 100, /*max wait time=*/0, entries)); // Entry 7 has been evicted.
+		testAssert(log.getEntriesAfter(7, 100, /*max wait time=*/0, entries));
+		testAssert(entries.size() == 3 && entries[0].seq_num == 8);
+
+		// The most recent entry is kept, even if it is larger than the budget.
+		log.append(std::vector<Reference<DatabaseSnapshot>>(1, makeTestSnapshot(snapshot_bytes * 10)));
+		testAssert(log.getStats().num_entries == 1);
+		testAssert(log.getEntriesAfter(10, 100, /*max wait time=*/0, entries));
+		testAssert(entries.size() == 1 && entries[0].seq_num == 11);
+
+		log.setMaxBytes(0);
+		testAssert(log.getStats().num_entries == 1);
+	}
+
+	//-------------------- Test waiting for new entries --------------------
+	{
+		ReplicationLog log(/*max bytes=*/1000000);
+
+		Timer timer;
+		testAssert(log.getEntriesAfter(0, 100, /*max wait time=*/0.05, entries));
+		testAssert(entries.empty());
+		testAssert(timer.elapsed() >= 0.04);
+
+		Reference<ReplicationLogTestAppendThread> thread = new ReplicationLogTestAppendThread();
+		thread->log = &log;
+		thread->launch();
+
+		testAssert(log.getEntriesAfter(0, 100, /*max wait time=*/10.0, entries));
+		testAssert(entries.size() == 1 && entries[0].seq_num == 1);
+		thread->join();
+	}
+
+	conPrint("ReplicationLog::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,90 @@
+/*=====================================================================
+ReplicationLog.h
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <Mutex.h>
+#include <Condition.h>
+#include <Reference.h>
+#include <deque>
+#include <vector>
+class DatabaseSnapshot;
+
+
+/*=====================================================================
+ReplicationLog
+--------------
+In-memory log of the database snapshots written to disk by the server, for replication followers
+(backup_bot) to apply to their copy of the database.  See WorkerThread::handleReplicationConnection().
+
+Each snapshot written gets the next sequence number.  Sequence numbers start at 1 and are only meaningful
+within an epoch, which is a random id chosen when the log is created, i.e. at server start.
+
+The log keeps the most recent entries within a byte budget.  A follower whose checkpoint is older than the
+oldest entry (or from a different epoch) has to do a full sync: copy the whole database file, then follow the log.
+
+Entries just reference the snapshots made by ServerAllWorldsState::makeDatabaseSnapshot(), which are not
+modified after they are made, so no data is copied.
+
+Threadsafe.
+=====================================================================*/
+class ReplicationLog
+{
+public:
+	ReplicationLog(size_t max_bytes = 64 * 1024 * 1024);
+	~ReplicationLog();
+
+	struct Entry
+	{
+		uint64 seq_num;
+		Reference<DatabaseSnapshot> snapshot;
+	};
+
+	// Evicts entries as needed to fit in the new budget.
+	void setMaxBytes(size_t max_bytes);
+
+	uint64 getEpoch() const { return epoch; }
+
+	uint64 getLastSeqNum() const; // Returns 0 if nothing has been appended yet.
+
+	// Appends the snapshots with consecutive sequence numbers, and evicts the oldest entries to stay within the byte budget.
+	// The most recent entry is never evicted.
+	// Called by ServerAllWorldsState::writeDatabaseSnapshots() after the snapshots are flushed, with database_mutex held, so the log order is the commit order.
+	void append(const std::vector<Reference<DatabaseSnapshot>>& snapshots);
+
+	// If there are no entries after seq_num, waits up to max_wait_time_s for some to be appended.  Then copies up to max_num_entries entries after seq_num to entries_out.
+	// Returns false if the entry after seq_num has been evicted, in which case the follower needs a full sync.
+	bool getEntriesAfter(uint64 seq_num, size_t max_num_entries, double max_wait_time_s, std::vector<Entry>& entries_out);
+
+	struct Stats
+	{
+		uint64 num_entries;
+		uint64 first_seq_num; // 0 if there are no entries.
+		uint64 last_seq_num;
+		uint64 bytes_used;
+		uint64 max_bytes;
+	};
+	Stats getStats() const;
+
+	static size_t snapshotBytes(const DatabaseSnapshot& snapshot); // Approximate memory used by a snapshot.
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ReplicationLog)
+
+	void evictToFit() REQUIRES(mutex);
+
+	const uint64 epoch;
+
+	mutable Mutex mutex;
+	Condition new_entries_condition; // Notified when entries are appended.
+	std::deque<Entry> entries		GUARDED_BY(mutex); // Oldest first.  Sequence numbers are consecutive.
+	uint64 last_seq_num				GUARDED_BY(mutex);
+	size_t bytes_used				GUARDED_BY(mutex);
+	size_t max_bytes				GUARDED_BY(mutex);
+};
@@ -0,0 +1,414 @@
+/*=====================================================================
+ResourceCache.cpp
+-----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ResourceCache.h"
+
+
+#include <Lock.h>
+#include <StringUtils.h>
+#include <functional>
+
+
+ResourceCache::Shard::Shard()
+:	bytes_used(0),
+	max_bytes(0),
+	invalidation_count(0),
+	num_hits(0),
+	num_misses(0),
+	num_insertions(0),
+	num_evictions(0),
+	num_invalidations(0)
+{}
+
+
+// Evict least recently used entries until the shard is within its budget.  Mutex must be held.
+void ResourceCache::Shard::evictToFit()
+{
+	while(bytes_used > max_bytes && !lru_list.empty())
+	{
+		auto res = items.find(lru_list.back());
+		assert(res != items.end());
+		bytes_used -= res->second.entry->data.size();
+		items.erase(res);
+		lru_list.pop_back();
+		num_evictions++;
+	}
+}
+
+
+ResourceCache::ResourceCache(uint64 max_bytes)
+{
+	setMaxBytes(max_bytes);
+}
+
+
+ResourceCache::~ResourceCache()
+{}
+
+
+void ResourceCache::setMaxBytes(uint64 max_bytes)
+{
+	for(int i=0; i<NUM_SHARDS; ++i)
+	{
+		Lock lock(shards[i].mutex);
+		shards[i].max_bytes = max_bytes / NUM_SHARDS;
+		shards[i].evictToFit();
+	}
+}
+
+
+uint64 ResourceCache::maxEntryBytes() const
+{
+	Lock lock(shards[0].mutex);
+	return shards[0].max_bytes / 2; // Don't let a single file take up most of a shard.
+}
+
+
+ResourceCache::Shard& ResourceCache::shardForPath(const std::string& path)
+{
+	return shards[std::hash<std::string>()(path) % NUM_SHARDS];
+}
+
+
+ResourceCacheEntryRef ResourceCache::lookup(const std::string& path, bool& should_load_out, uint64& load_token_out)
+{
+	Shard& shard = shardForPath(path);
+	Lock lock(shard.mutex);
+
+	auto res = shard.items.find(path);
+	if(res != shard.items.end())
+	{
+		shard.lru_list.splice(shard.lru_list.begin(), shard.lru_list, res->second.lru_it); // Move to front of LRU list.
+		shard.num_hits++;
+		should_load_out = false;
+		return res->second.entry;
+	}
+
+	shard.num_misses++;
+
+	// Age the miss counts if we are tracking too many paths.
+	if(shard.miss_counts.size() >= MAX_TRACKED_PATHS_PER_SHARD)
+	{
+		for(auto it = shard.miss_counts.begin(); it != shard.miss_counts.end(); )
+		{
+			it->second /= 2;
+			if(it->second == 0)
+				it = shard.miss_counts.erase(it);
+			else
+				++it;
+		}
+		if(shard.miss_counts.size() >= MAX_TRACKED_PATHS_PER_SHARD)
+			shard.miss_counts.clear();
+	}
+
+	const uint32 num_misses = ++shard.miss_counts[path];
+	should_load_out = num_misses >= ADMISSION_MIN_REQUESTS;
+	load_token_out = shard.invalidation_count;
+	return NULL;
+}
+
+
+void ResourceCache::insert(const std::string& path, const ResourceCacheEntryRef& entry, uint64 load_token)
+{
+	Shard& shard = shardForPath(path);
+	Lock lock(shard.mutex);
+
+	if(load_token != shard.invalidation_count) // If the path may have been invalidated since the file was read:
+		return;
+	if(entry->data.size() > shard.max_bytes / 2)
+		return;
+	if(shard.items.count(path) > 0) // If another thread has inserted it already:
+		return;
+
+	shard.lru_list.push_front(path);
+	CachedItem& item = shard.items[path];
+	item.entry = entry;
+	item.lru_it = shard.lru_list.begin();
+	shard.bytes_used += entry->data.size();
+	shard.num_insertions++;
+
+	shard.evictToFit();
+}
+
+
+void ResourceCache::invalidate(const std::string& path)
+{
+	Shard& shard = shardForPath(path);
+	Lock lock(shard.mutex);
+
+	shard.invalidation_count++;
+
+	auto res = shard.items.find(path);
+	if(res != shard.items.end())
+	{
+		shard.bytes_used -= res->second.entry->data.size();
+		shard.lru_list.erase(res->second.lru_it);
+		shard.items.erase(res);
+		shard.num_invalidations++;
+	}
+}
+
+
+ResourceCache::Stats ResourceCache::getStats() const
+{
+	Stats stats;
+	stats.num_entries = stats.bytes_used = stats.max_bytes = stats.num_hits = stats.num_misses = stats.num_insertions = stats.num_evictions = stats.num_invalidations = 0;
+
+	for(int i=0; i<NUM_SHARDS; ++i)
+	{
+		const Shard& shard = shards[i];
+		Lock lock(shard.mutex);
+		stats.num_entries		+= shard.items.size();
+		stats.bytes_used		+= shard.bytes_used;
+		stats.max_bytes			+= shard.max_bytes;
+		stats.num_hits			+= shard.num_hits;
+		stats.num_misses		+= shard.num_misses;
+		stats.num_insertions	+= shard.num_insertions;
+		stats.num_evictions		+= shard.num_evictions;
+		stats.num_invalidations	+= shard.num_invalidations;
+	}
+	return stats;
+}
+
+
+std::string ResourceCache::toHTML() const
+{
+	const Stats stats = getStats();
+	const uint64 num_lookups = stats.num_hits + stats.num_misses;
+
+	std::string s;
+	s += "<p>cached files: " + toString(stats.num_entries) + ", size: " + toString(stats.bytes_used / (1024 * 1024)) + " MB / " + toString(stats.max_bytes / (1024 * 1024)) + " MB</p>";
+	s += "<p>hits: " + toString(stats.num_hits) + ", misses: " + toString(stats.num_misses) +
+		", hit rate: " + ((num_lookups > 0) ? (doubleToStringNSigFigs((double)stats.num_hits / num_lookups * 100, 3) + " %") : std::string("-")) + "</p>";
+	s += "<p>insertions: " + toString(stats.num_insertions) + ", evictions: " + toString(stats.num_evictions) + ", invalidations: " + toString(stats.num_invalidations) + "</p>";
+	return s;
+}
+
+
+#if BUILD_TESTS
+
+
+#include "ResourceFile.h"
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/PlatformUtils.h>
+#include <utils/FileUtils.h>
+#include <utils/Exception.h>
+#include <utils/TaskManager.h>
+#include <cstring>
+
+
+static ResourceCacheEntryRef makeEntry(size_t size, uint8 val)
+{
+	ResourceCacheEntryRef entry = new ResourceCacheEntry();
+	entry->data.resize(size);
+	std::memset(entry->data.data(), val, size);
+	return entry;
+}
+
+
+// Does a lookup, and inserts an entry if the cache says to.  Returns true if it was a hit.
+static bool lookupAndInsert(ResourceCache& cache, const std::string& path, size_t size)
+{
+	bool should_load;
+	uint64 load_token;
+	if(cache.lookup(path, should_load, load_token).nonNull())
+		return true;
+	if(should_load)
+		cache.insert(path, makeEntry(size, 1), load_token);
+	return false;
+}
+
+
+class ResourceCacheTestTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		for(int i=0; i<10000; ++i)
+		{
+			const std::string path = "path_" + toString((i * 7 + thread_index * 13) % 300);
+			if(i % 100 == 0)
+				cache->invalidate(path);
+			else
+			{
+				bool should_load;
+				uint64 load_token;
+				ResourceCacheEntryRef entry = cache->lookup(path, should_load, load_token);
+				if(entry.nonNull())
+					testAssert(entry->data.size() == 1000);
+				else if(should_load)
+					cache->insert(path, makeEntry(1000, 1), load_token);
+			}
+		}
+	}
+	ResourceCache* cache;
+};
+
+
+void ResourceCache::test()
+{
+	conPrint("ResourceCache::test()");
+
+	//-------------------- Test admission --------------------
+	{
+		ResourceCache cache(/*max bytes=*/NUM_SHARDS * 1000000);
+
+		bool should_load;
+		uint64 load_token;
+		testAssert(cache.lookup("a", should_load, load_token).isNull());
+		testAssert(!should_load); // Shouldn't be admitted on the first request.
+		testAssert(cache.lookup("a", should_load, load_token).isNull());
+		testAssert(should_load);
+		cache.insert("a", makeEntry(1000, 1), load_token);
+
+		ResourceCacheEntryRef entry = cache.lookup("a", should_load, load_token);
+		testAssert(entry.nonNull() && entry->data.size() == 1000 && entry->data[0] == 1);
+
+		const Stats stats = cache.getStats();
+		testAssert(stats.num_entries == 1 && stats.bytes_used == 1000 && stats.num_hits == 1 && stats.num_misses == 2 && stats.num_insertions == 1);
+	}
+
+	//-------------------- Test invalidation --------------------
+	{
+		ResourceCache cache(/*max bytes=*/NUM_SHARDS * 1000000);
+
+		testAssert(!lookupAndInsert(cache, "a", 1000));
+		testAssert(!lookupAndInsert(cache, "a", 1000));
+		testAssert(lookupAndInsert(cache, "a", 1000));
+
+		cache.invalidate("a");
+		testAssert(cache.getStats().num_entries == 0 && cache.getStats().bytes_used == 0 && cache.getStats().num_invalidations == 1);
+
+		// An insert of data read before an invalidation should be ignored.
+		bool should_load;
+		uint64 load_token;
+		testAssert(cache.lookup("a", should_load, load_token).isNull());
+		testAssert(should_load); // Miss counts are kept over invalidations, the file is still popular.
+		cache.invalidate("a");
+		cache.insert("a", makeEntry(1000, 2), load_token);
+		testAssert(cache.lookup("a", should_load, load_token).isNull());
+	}
+
+	//-------------------- Test LRU eviction --------------------
+	{
+		// Use paths that all map to the same shard, so they share a budget.
+		ResourceCache cache(/*max bytes=*/NUM_SHARDS * 10000);
+		std::vector<std::string> paths;
+		for(int i=0; paths.size() < 6; ++i)
+		{
+			const std::string path = "path_" + toString(i);
+			if(&cache.shardForPath(path) == &cache.shards[0])
+				paths.push_back(path);
+		}
+
+		for(int i=0; i<5; ++i) // Fill the shard with 5 2000 B entries.
+		{
+			testAssert(!lookupAndInsert(cache, paths[i], 2000));
+			testAssert(!lookupAndInsert(cache, paths[i], 2000));
+		}
+		testAssert(cache.getStats().num_entries == 5 && cache.getStats().num_evictions == 0);
+
+		testAssert(lookupAndInsert(cache, paths[0], 2000)); // Make paths[0] the most recently used.
+
+		// Inserting another entry should evict the least recently used entry, paths[1].
+		testAssert(!lookupAndInsert(cache, paths[5], 2000));
+		testAssert(!lookupAndInsert(cache, paths[5], 2000));
+		testAssert(cache.getStats().num_entries == 5 && cache.getStats().num_evictions == 1 && cache.getStats().bytes_used == 10000);
+		testAssert(lookupAndInsert(cache, paths[0], 2000));
+		testAssert(lookupAndInsert(cache, paths[5], 2000));
+		bool should_load;
+		uint64 load_token;
+		testAssert(cache.lookup(paths[1], should_load, load_token).isNull());
+
+		// Entries bigger than half a shard shouldn't be inserted.
+		testAssert(cache.maxEntryBytes() == 5000);
+		cache.insert(paths[1], makeEntry(6000, 1), load_token);
+		testAssert(cache.lookup(paths[1], should_load, load_token).isNull());
+
+		// Shrinking the budget should evict entries.
+		cache.setMaxBytes(NUM_SHARDS * 4000);
+		testAssert(cache.getStats().bytes_used <= 4000 * NUM_SHARDS);
+		testAssert(cache.lookup(paths[5], should_load, load_token).nonNull()); // Most recently used should still be there.
+		testAssert(!cache.toHTML().empty());
+	}
+
+	//-------------------- Test miss counts are bounded --------------------
+	{
+		ResourceCache cache(/*max bytes=*/NUM_SHARDS * 1000000);
+		bool should_load;
+		uint64 load_token;
+		for(int i=0; i<(int)(NUM_SHARDS * MAX_TRACKED_PATHS_PER_SHARD * 3); ++i)
+			cache.lookup("path_" + toString(i), should_load, load_token);
+		for(int i=0; i<NUM_SHARDS; ++i)
+			testAssert(cache.shards[i].miss_counts.size() <= MAX_TRACKED_PATHS_PER_SHARD);
+	}
+
+	//-------------------- Test ResourceFile with a cache --------------------
+	try
+	{
+		const std::string path = PlatformUtils::getTempDirPath() + "/resource_cache_test.bin";
+		std::string contents;
+		for(int i=0; i<10000; ++i)
+			contents.push_back((char)(i * 31));
+		FileUtils::writeEntireFile(path, contents.data(), contents.size());
+
+		ResourceCache cache(/*max bytes=*/NUM_SHARDS * 1000000);
+		{
+			ResourceFile file(path, &cache);
+			testAssert(!file.isInMemory());
+			testAssert(file.fileSize() == contents.size());
+		}
+		{
+			ResourceFile file(path, &cache); // Second request should read the file into the cache.
+			testAssert(file.isInMemory());
+			testAssert(file.fileSize() == contents.size());
+		}
+		{
+			ResourceFile file(path, &cache);
+			testAssert(file.isInMemory());
+			testAssert(file.fileSize() == contents.size());
+		}
+		testAssert(cache.getStats().num_hits == 1 && cache.getStats().num_insertions == 1);
+
+		bool should_load;
+		uint64 load_token;
+		ResourceCacheEntryRef entry = cache.lookup(path, should_load, load_token);
+		testAssert(entry.nonNull() && entry->data.size() == contents.size() && std::memcmp(entry->data.data(), contents.data(), contents.size()) == 0);
+
+		FileUtils::deleteFile(path);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	//-------------------- Test concurrent use --------------------
+	{
+		ResourceCache cache(/*max bytes=*/NUM_SHARDS * 5000); // Small enough that there are lots of evictions.
+		glare::TaskManager task_manager("ResourceCache test task manager", /*num threads=*/8);
+		for(int i=0; i<8; ++i)
+		{
+			Reference<ResourceCacheTestTask> task = new ResourceCacheTestTask();
+			task->cache = &cache;
+			task_manager.addTask(task);
+		}
+		task_manager.waitForTasksToComplete();
+
+		const Stats stats = cache.getStats();
+		testAssert(stats.bytes_used <= stats.max_bytes);
+		testAssert(stats.num_hits > 0 && stats.num_evictions > 0);
+		conPrint("hits: " + toString(stats.num_hits) + ", misses: " + toString(stats.num_misses) + ", evictions: " + toString(stats.num_evictions));
+	}
+
+	conPrint("ResourceCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,123 @@
+/*=====================================================================
+ResourceCache.h
+---------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <Mutex.h>
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Vector.h>
+#include <string>
+#include <list>
+#include <unordered_map>
+
+
+// The contents of a cached file.  Immutable once inserted in the cache.
+class ResourceCacheEntry : public ThreadSafeRefCounted
+{
+public:
+	js::Vector<uint8, 16> data;
+};
+typedef Reference<ResourceCacheEntry> ResourceCacheEntryRef;
+
+
+/*=====================================================================
+ResourceCache
+-------------
+In-memory cache of the contents of resource files and their compressed variants
+(see CompressedResourceVariants), so popular resources don't have to be read
+from disk for every request.
+Used through ResourceFile, by ResourceHandlers and WorkerThread.
+
+The cache is split into NUM_SHARDS shards by path hash, each with its own mutex,
+LRU list and 1 / NUM_SHARDS of the byte budget.
+
+A file is only admitted after it has missed ADMISSION_MIN_REQUESTS times, so files
+that are only requested once don't evict popular ones.  Miss counts are kept for a
+bounded number of paths per shard, and are halved when the bound is reached, so old
+requests are forgotten.
+
+Threadsafe.
+=====================================================================*/
+class ResourceCache
+{
+public:
+	ResourceCache(uint64 max_bytes = 512 * 1024 * 1024);
+	~ResourceCache();
+
+	static const int NUM_SHARDS = 16;
+	static const uint32 ADMISSION_MIN_REQUESTS = 2;
+	static const size_t MAX_TRACKED_PATHS_PER_SHARD = 4096;
+
+	// Evicts entries as needed to fit in the new budget.
+	void setMaxBytes(uint64 max_bytes);
+
+	// Files larger than this are never cached.
+	uint64 maxEntryBytes() const;
+
+	// Returns the cached contents of the file at path, or NULL if not cached.
+	// On a miss, sets should_load_out to true if the file has been requested often enough to be cached, in which case the caller should read
+	// the file and pass the contents to insert(), along with load_token_out.
+	ResourceCacheEntryRef lookup(const std::string& path, bool& should_load_out, uint64& load_token_out);
+
+	// Inserts the contents of the file at path, unless the path was invalidated since lookup() returned load_token.
+	void insert(const std::string& path, const ResourceCacheEntryRef& entry, uint64 load_token);
+
+	// Removes the file from the cache, for when it is about to be overwritten or deleted.
+	void invalidate(const std::string& path);
+
+	struct Stats
+	{
+		uint64 num_entries;
+		uint64 bytes_used;
+		uint64 max_bytes;
+		uint64 num_hits;
+		uint64 num_misses;
+		uint64 num_insertions;
+		uint64 num_evictions;
+		uint64 num_invalidations;
+	};
+	Stats getStats() const;
+
+	std::string toHTML() const; // For the admin page.
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ResourceCache)
+
+	struct CachedItem
+	{
+		ResourceCacheEntryRef entry;
+		std::list<std::string>::iterator lru_it;
+	};
+
+	struct Shard
+	{
+		Shard();
+
+		void evictToFit();
+
+		mutable Mutex mutex;
+		std::unordered_map<std::string, CachedItem> items			GUARDED_BY(mutex); // Map from path to cached item.
+		std::list<std::string> lru_list								GUARDED_BY(mutex); // Most recently used at the front.
+		std::unordered_map<std::string, uint32> miss_counts			GUARDED_BY(mutex); // Number of misses for recently requested paths that aren't cached.
+		uint64 bytes_used											GUARDED_BY(mutex);
+		uint64 max_bytes											GUARDED_BY(mutex); // Byte budget of this shard.
+		uint64 invalidation_count									GUARDED_BY(mutex); // Incremented on each invalidation, used as the load token.
+
+		uint64 num_hits												GUARDED_BY(mutex);
+		uint64 num_misses											GUARDED_BY(mutex);
+		uint64 num_insertions										GUARDED_BY(mutex);
+		uint64 num_evictions										GUARDED_BY(mutex);
+		uint64 num_invalidations									GUARDED_BY(mutex);
+	};
+
+	Shard& shardForPath(const std::string& path);
+
+	Shard shards[NUM_SHARDS];
+};
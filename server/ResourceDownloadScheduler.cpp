@@ -0,0 +1,271 @@
+/*=====================================================================
+ResourceDownloadScheduler.cpp
+-----------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ResourceDownloadScheduler.h"
+
+
+#include <maths/mathstypes.h>
+#include <cmath>
+
+
+ResourceDownloadScheduler::ResourceDownloadScheduler()
+:	last_pass(0)
+{}
+
+
+ResourceDownloadScheduler::~ResourceDownloadScheduler()
+{}
+
+
+float ResourceDownloadScheduler::costForPriority(float priority)
+{
+	// Priorities come from the client, so sanitise them.
+	if(std::isnan(priority) || priority < 0)
+		priority = 0;
+	return 1.f + myMin(priority, 1.0e6f);
+}
+
+
+bool ResourceDownloadScheduler::addTransfer(uint32 request_id, float priority, uint64 num_bytes)
+{
+	assert(num_bytes > 0);
+	if(transfers.count(request_id) > 0)
+		return false;
+
+	Transfer& transfer = transfers[request_id];
+	transfer.pass = last_pass;
+	transfer.cost = costForPriority(priority);
+	transfer.num_bytes = num_bytes;
+	transfer.bytes_scheduled = 0;
+	return true;
+}
+
+
+bool ResourceDownloadScheduler::setPriority(uint32 request_id, float priority)
+{
+	auto res = transfers.find(request_id);
+	if(res == transfers.end())
+		return false;
+
+	res->second.cost = costForPriority(priority);
+	return true;
+}
+
+
+bool ResourceDownloadScheduler::removeTransfer(uint32 request_id)
+{
+	return transfers.erase(request_id) > 0;
+}
+
+
+bool ResourceDownloadScheduler::nextChunk(uint32& request_id_out, uint64& offset_out, size_t& chunk_size_out, bool& transfer_finished_out)
+{
+	// Find the transfer with the lowest pass.  Break ties in favour of the transfer with the fewest bytes remaining, so small transfers finish first.
+	auto best = transfers.end();
+	for(auto it = transfers.begin(); it != transfers.end(); ++it)
+	{
+		if(best == transfers.end() || it->second.pass < best->second.pass ||
+			(it->second.pass == best->second.pass && (it->second.num_bytes - it->second.bytes_scheduled) < (best->second.num_bytes - best->second.bytes_scheduled)))
+			best = it;
+	}
+
+	if(best == transfers.end())
+		return false;
+
+	Transfer& transfer = best->second;
+	const uint64 chunk_size = myMin<uint64>(transfer.num_bytes - transfer.bytes_scheduled, MAX_CHUNK_SIZE);
+
+	request_id_out = best->first;
+	offset_out = transfer.bytes_scheduled;
+	chunk_size_out = (size_t)chunk_size;
+
+	last_pass = transfer.pass;
+	transfer.pass += (double)chunk_size * transfer.cost;
+	transfer.bytes_scheduled += chunk_size;
+
+	transfer_finished_out = transfer.bytes_scheduled == transfer.num_bytes;
+	if(transfer_finished_out)
+		transfers.erase(best);
+
+	return true;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <vector>
+#include <limits>
+
+
+void ResourceDownloadScheduler::test()
+{
+	conPrint("ResourceDownloadScheduler::test()");
+
+	const uint64 chunk = MAX_CHUNK_SIZE;
+
+	//-------------------- Test an empty scheduler --------------------
+	{
+		ResourceDownloadScheduler scheduler;
+		uint32 request_id;
+		uint64 offset;
+		size_t chunk_size;
+		bool finished;
+		testAssert(scheduler.empty());
+		testAssert(!scheduler.nextChunk(request_id, offset, chunk_size, finished));
+		testAssert(!scheduler.setPriority(1, 1.f));
+		testAssert(!scheduler.removeTransfer(1));
+	}
+
+	//-------------------- Test a single transfer is split into contiguous chunks --------------------
+	{
+		ResourceDownloadScheduler scheduler;
+		const uint64 num_bytes = chunk * 3 + 123;
+		testAssert(scheduler.addTransfer(7, 1.f, num_bytes));
+		testAssert(!scheduler.addTransfer(7, 1.f, 10)); // Duplicate request id
+
+		uint64 total = 0;
+		int num_chunks = 0;
+		while(true)
+		{
+			uint32 request_id;
+			uint64 offset;
+			size_t chunk_size;
+			bool finished;
+			if(!scheduler.nextChunk(request_id, offset, chunk_size, finished))
+				break;
+			testAssert(request_id == 7);
+			testAssert(offset == total);
+			testAssert(chunk_size > 0 && chunk_size <= MAX_CHUNK_SIZE);
+			total += chunk_size;
+			num_chunks++;
+			testAssert(finished == (total == num_bytes));
+		}
+		testAssert(total == num_bytes);
+		testAssert(num_chunks == 4);
+		testAssert(scheduler.empty());
+	}
+
+	//-------------------- Test small transfers aren't blocked by a large one requested before them --------------------
+	{
+		ResourceDownloadScheduler scheduler;
+		testAssert(scheduler.addTransfer(0, /*priority=*/10.f, /*num bytes=*/100 * 1000 * 1000));
+		for(uint32 i=1; i<=10; ++i)
+			testAssert(scheduler.addTransfer(i, /*priority=*/10.f, /*num bytes=*/20 * 1000));
+
+		int num_chunks_of_large = 0;
+		int num_small_finished = 0;
+		while(num_small_finished < 10)
+		{
+			uint32 request_id;
+			uint64 offset;
+			size_t chunk_size;
+			bool finished;
+			testAssert(scheduler.nextChunk(request_id, offset, chunk_size, finished));
+			if(request_id == 0)
+				num_chunks_of_large++;
+			else
+			{
+				testAssert(finished); // Each small transfer fits in one chunk.
+				num_small_finished++;
+			}
+		}
+		testAssert(num_chunks_of_large <= 1);
+		testAssert(scheduler.numTransfers() == 1);
+	}
+
+	//-------------------- Test bandwidth is shared in inverse proportion to cost --------------------
+	{
+		ResourceDownloadScheduler scheduler;
+		testAssert(scheduler.addTransfer(1, /*priority=*/0.f, /*num bytes=*/1000 * chunk)); // cost 1
+		testAssert(scheduler.addTransfer(2, /*priority=*/9.f, /*num bytes=*/1000 * chunk)); // cost 10
+
+		std::vector<int> counts(3, 0);
+		for(int i=0; i<440; ++i)
+		{
+			uint32 request_id;
+			uint64 offset;
+			size_t chunk_size;
+			bool finished;
+			testAssert(scheduler.nextChunk(request_id, offset, chunk_size, finished));
+			counts[request_id]++;
+		}
+		testAssert(counts[1] >= 395 && counts[1] <= 405);
+		testAssert(counts[2] >= 35 && counts[2] <= 45);
+
+		// Swap priorities, check the share swaps too.
+		testAssert(scheduler.setPriority(1, 9.f));
+		testAssert(scheduler.setPriority(2, 0.f));
+
+		counts[1] = counts[2] = 0;
+		for(int i=0; i<440; ++i)
+		{
+			uint32 request_id;
+			uint64 offset;
+			size_t chunk_size;
+			bool finished;
+			testAssert(scheduler.nextChunk(request_id, offset, chunk_size, finished));
+			counts[request_id]++;
+		}
+		testAssert(counts[2] >= 395);
+
+		testAssert(scheduler.removeTransfer(2));
+		testAssert(!scheduler.removeTransfer(2));
+		testAssert(scheduler.numTransfers() == 1);
+	}
+
+	//-------------------- Test a transfer added later doesn't get to monopolise the connection --------------------
+	{
+		ResourceDownloadScheduler scheduler;
+		testAssert(scheduler.addTransfer(1, /*priority=*/1.f, /*num bytes=*/1000 * chunk));
+
+		for(int i=0; i<100; ++i)
+		{
+			uint32 request_id;
+			uint64 offset;
+			size_t chunk_size;
+			bool finished;
+			testAssert(scheduler.nextChunk(request_id, offset, chunk_size, finished));
+		}
+
+		testAssert(scheduler.addTransfer(2, /*priority=*/1.f, /*num bytes=*/1000 * chunk));
+
+		std::vector<int> counts(3, 0);
+		for(int i=0; i<20; ++i)
+		{
+			uint32 request_id;
+			uint64 offset;
+			size_t chunk_size;
+			bool finished;
+			testAssert(scheduler.nextChunk(request_id, offset, chunk_size, finished));
+			counts[request_id]++;
+		}
+		testAssert(counts[1] >= 9 && counts[2] >= 9);
+	}
+
+	//-------------------- Test invalid priorities from the client are handled --------------------
+	{
+		ResourceDownloadScheduler scheduler;
+		testAssert(scheduler.addTransfer(1, std::nanf(""), 10 * chunk));
+		testAssert(scheduler.addTransfer(2, -1.0e30f, 10 * chunk));
+		testAssert(scheduler.addTransfer(3, std::numeric_limits<float>::infinity(), 10 * chunk));
+
+		uint64 total = 0;
+		uint32 request_id;
+		uint64 offset;
+		size_t chunk_size;
+		bool finished;
+		while(scheduler.nextChunk(request_id, offset, chunk_size, finished))
+			total += chunk_size;
+		testAssert(total == 30 * chunk);
+	}
+
+	conPrint("ResourceDownloadScheduler::test() done.");
+}
+
+
+#endif // BUILD_TESTS
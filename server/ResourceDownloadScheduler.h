@@ -0,0 +1,70 @@
+/*=====================================================================
+ResourceDownloadScheduler.h
+---------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <map>
+
+
+/*=====================================================================
+ResourceDownloadScheduler
+-------------------------
+Decides which resource transfer the next chunk on a framed download connection
+(see Protocol::RequestResources) comes from.
+
+Transfers are interleaved with stride scheduling: each transfer has a 'pass' value, the
+transfer with the lowest pass is served next, and serving a chunk of n bytes advances
+the transfer's pass by n * cost, where cost = 1 + priority.
+Priorities are sent by the client, lower is more important (the client uses
+distance to the camera scaled by object size, see DownloadingResourceQueue).
+So each transfer gets a share of the bandwidth inversely proportional to its cost,
+small transfers finish after a few chunks instead of waiting behind large ones,
+and no transfer is starved.
+
+Not threadsafe, each download connection has its own scheduler.
+=====================================================================*/
+class ResourceDownloadScheduler
+{
+public:
+	ResourceDownloadScheduler();
+	~ResourceDownloadScheduler();
+
+	static const size_t MAX_CHUNK_SIZE = 1 << 16;
+
+	// num_bytes must be > 0.  Returns false if there is already a transfer with request_id.
+	bool addTransfer(uint32 request_id, float priority, uint64 num_bytes);
+
+	// Returns false if there is no transfer with request_id.
+	bool setPriority(uint32 request_id, float priority);
+
+	// Returns false if there is no transfer with request_id.
+	bool removeTransfer(uint32 request_id);
+
+	// Picks the transfer to send the next chunk from.  Returns false if there are no transfers.
+	// The chunk is bytes [offset_out, offset_out + chunk_size_out) of the transfer's num_bytes.
+	// Sets transfer_finished_out to true if this is the last chunk of the transfer, in which case the transfer is removed.
+	bool nextChunk(uint32& request_id_out, uint64& offset_out, size_t& chunk_size_out, bool& transfer_finished_out);
+
+	bool empty() const { return transfers.empty(); }
+	size_t numTransfers() const { return transfers.size(); }
+
+	static void test();
+
+private:
+	struct Transfer
+	{
+		double pass;
+		float cost;
+		uint64 num_bytes;
+		uint64 bytes_scheduled;
+	};
+
+	static float costForPriority(float priority);
+
+	std::map<uint32, Transfer> transfers; // Map from request id to transfer
+	double last_pass; // Pass of the most recently served transfer.  New transfers start here, so they don't get ahead of (or fall behind) existing ones.
+};
@@ -0,0 +1,196 @@
+/*=====================================================================
+ResourceFile.cpp
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ResourceFile.h"
+
+
+#include <MySocket.h>
+#include <SocketInterface.h>
+#include <MemMappedFile.h>
+#include <Exception.h>
+#include <PlatformUtils.h>
+#include <RuntimeCheck.h>
+#include <maths/mathstypes.h>
+#include <vector>
+#include <cstring>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+#endif
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+
+static const size_t READ_CHUNK_SIZE = 1 << 18; // Size of chunks read into the per-thread buffer, for sockets that can't use sendfile().
+
+
+ResourceFile::ResourceFile(const std::string& path_, ResourceCache* cache)
+:	path(path_)
+{
+	bool should_load = false;
+	uint64 load_token = 0;
+	if(cache)
+	{
+		cache_entry = cache->lookup(path, should_load, load_token);
+		if(cache_entry.nonNull())
+		{
+			file_size = cache_entry->data.size();
+			return;
+		}
+	}
+
+	open();
+
+	// If the file has been requested often enough, read it into the cache, and close it.
+	if(should_load && (file_size <= cache->maxEntryBytes()))
+	{
+		try
+		{
+			ResourceCacheEntryRef entry = new ResourceCacheEntry();
+			entry->data.resizeNoCopy((size_t)file_size);
+			readRange(0, (size_t)file_size, entry->data.data());
+
+			cache->insert(path, entry, load_token);
+			cache_entry = entry;
+			close();
+		}
+		catch(glare::Exception&)
+		{
+			close();
+			throw;
+		}
+	}
+}
+
+
+void ResourceFile::open()
+{
+#if defined(_WIN32)
+	mapped_file = new MemMappedFile(path);
+	file_size = mapped_file->fileSize();
+#else
+	fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd == -1)
+		throw glare::Exception("Failed to open file '" + path + "': " + PlatformUtils::getLastErrorString());
+
+	struct stat file_stat;
+	if(::fstat(fd, &file_stat) != 0)
+	{
+		const std::string error_string = PlatformUtils::getLastErrorString();
+		::close(fd);
+		throw glare::Exception("fstat failed for file '" + path + "': " + error_string);
+	}
+	file_size = (uint64)file_stat.st_size;
+#endif
+}
+
+
+ResourceFile::~ResourceFile()
+{
+	if(cache_entry.isNull())
+		close();
+}
+
+
+void ResourceFile::close()
+{
+#if defined(_WIN32)
+	delete mapped_file;
+#else
+	::close(fd);
+#endif
+}
+
+
+// Reads bytes [offset, offset + len) of the file.  Throws glare::Exception on failure.
+void ResourceFile::readRange(uint64 offset, size_t len, uint8* data_out)
+{
+#if defined(_WIN32)
+	std::memcpy(data_out, (const uint8*)mapped_file->fileData() + offset, len);
+#else
+	size_t num_done = 0;
+	while(num_done < len)
+	{
+		const ssize_t num_read = ::pread(fd, data_out + num_done, len - num_done, (off_t)(offset + num_done));
+		if(num_read < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			throw glare::Exception("Failed to read file '" + path + "': " + PlatformUtils::getLastErrorString());
+		}
+		if(num_read == 0)
+			throw glare::Exception("File '" + path + "' was truncated while reading.");
+		num_done += (size_t)num_read;
+	}
+#endif
+}
+
+
+void ResourceFile::writeRangeToSocket(SocketInterface& socket, uint64 offset, uint64 len)
+{
+	runtimeCheck((offset <= file_size) && (len <= file_size - offset));
+
+	if(cache_entry.nonNull())
+	{
+		socket.writeData(cache_entry->data.data() + offset, (size_t)len);
+		return;
+	}
+
+#if defined(_WIN32)
+	socket.writeData((const uint8*)mapped_file->fileData() + offset, len);
+#else
+
+#if defined(__linux__)
+	MySocket* plain_socket = dynamic_cast<MySocket*>(&socket);
+	if(plain_socket)
+	{
+		const int socket_handle = (int)plain_socket->getSocketHandle();
+		off_t file_offset = (off_t)offset;
+		uint64 remaining = len;
+		while(remaining > 0)
+		{
+			const ssize_t num_sent = ::sendfile(socket_handle, fd, &file_offset, (size_t)myMin<uint64>(remaining, 1ull << 30));
+			if(num_sent < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				throw glare::Exception("sendfile failed while sending '" + path + "': " + PlatformUtils::getLastErrorString());
+			}
+			if(num_sent == 0)
+				throw glare::Exception("File '" + path + "' was truncated while sending.");
+			remaining -= (uint64)num_sent;
+		}
+		return;
+	}
+#endif
+
+	static thread_local std::vector<uint8> buffer;
+	if(buffer.size() < READ_CHUNK_SIZE)
+		buffer.resize(READ_CHUNK_SIZE);
+
+	uint64 file_offset = offset;
+	const uint64 end = offset + len;
+	while(file_offset < end)
+	{
+		const size_t chunk_size = (size_t)myMin<uint64>(end - file_offset, READ_CHUNK_SIZE);
+		const ssize_t num_read = ::pread(fd, buffer.data(), chunk_size, (off_t)file_offset);
+		if(num_read < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			throw glare::Exception("Failed to read file '" + path + "': " + PlatformUtils::getLastErrorString());
+		}
+		if(num_read == 0)
+			throw glare::Exception("File '" + path + "' was truncated while sending.");
+
+		socket.writeData(buffer.data(), (size_t)num_read);
+		file_offset += (uint64)num_read;
+	}
+#endif
+}
+
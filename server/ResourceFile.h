@@ -0,0 +1,61 @@
+/*=====================================================================
+ResourceFile.h
+--------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "ResourceCache.h"
+#include <Platform.h>
+#include <string>
+class SocketInterface;
+class MemMappedFile;
+
+
+/*=====================================================================
+ResourceFile
+------------
+An open resource file (or compressed variant of one), for sending to a client.
+
+On Linux, if the socket is a plain MySocket, data is sent with sendfile(), so isn't
+copied through user space.
+Otherwise (TLS sockets), the file is read in chunks into a per-thread buffer that is then written
+to the socket, which avoids memory-mapping the file for each request.
+On Windows the file is just memory-mapped.
+
+If a ResourceCache is given, the file contents are taken from the cache if present, and the file
+is read into the cache if it has been requested often enough.  Cached contents are written straight
+from memory.
+=====================================================================*/
+class ResourceFile
+{
+public:
+	ResourceFile(const std::string& path, ResourceCache* cache = NULL); // Throws glare::Exception if the file can't be opened.
+	~ResourceFile();
+
+	uint64 fileSize() const { return file_size; }
+
+	bool isInMemory() const { return cache_entry.nonNull(); } // Is the file contents in the ResourceCache?
+
+	// Writes bytes [offset, offset + len) of the file to the socket.  Throws glare::Exception or MySocketExcep on failure.
+	void writeRangeToSocket(SocketInterface& socket, uint64 offset, uint64 len);
+
+	void writeToSocket(SocketInterface& socket) { writeRangeToSocket(socket, 0, file_size); }
+
+private:
+	GLARE_DISABLE_COPY(ResourceFile)
+
+	void open();
+	void close();
+	void readRange(uint64 offset, size_t len, uint8* data_out);
+
+	std::string path;
+	uint64 file_size;
+	ResourceCacheEntryRef cache_entry; // Non-null if the contents are in the cache.  The file isn't kept open in that case.
+#if defined(_WIN32)
+	MemMappedFile* mapped_file;
+#else
+	int fd;
+#endif
+};
@@ -10,6 +10,7 @@ Copyright Glare Technologies Limited 2023 -
 #include "UDPHandlerThread.h"
 #include "MeshLODGenThread.h"
 #include "DynamicTextureUpdaterThread.h"
+#include "DatabaseWriterThread.h"
 //#include "ChunkGenThread.h"
 #include "WorkerThread.h"
 #include "ServerTestSuite.h"
@@ -126,17 +127,29 @@ void updateMapTiles(ServerAllWorldsState& world_state)
 }
 
 
-static void enqueueMessageToBroadcast(SocketBufferOutStream& packet_buffer, std::vector<std::string>& broadcast_packets)
+static void enqueueMessageToBroadcast(SocketBufferOutStream& packet_buffer, BroadcastFrame& broadcast_frame)
 {
 	MessageUtils::updatePacketLengthField(packet_buffer);
 
-	if(packet_buffer.buf.size() > 0)
-	{
-		std::string packet_string(packet_buffer.buf.size(), '\0');
+	broadcast_frame.append(packet_buffer.buf.data(), packet_buffer.buf.size());
+}
 
-		std::memcpy(&packet_string[0], packet_buffer.buf.data(), packet_buffer.buf.size());
 
-		broadcast_packets.push_back(packet_string);
+// Enqueue a transform update for an entity.  These packets are subject to area-of-interest filtering.
+// The transform is also stored, for encoding in TransformUpdateBatch messages.
+static void enqueuePositionalMessageToBroadcast(SocketBufferOutStream& packet_buffer, const TransformCompression::EntityTransform& transform, WorldTickPackets& world_packets)
+{
+	MessageUtils::updatePacketLengthField(packet_buffer);
+
+	if(packet_buffer.buf.size() > 0)
+	{
+		world_packets.positional_packets.push_back(PositionalPacket());
+		PositionalPacket& positional_packet = world_packets.positional_packets.back();
+		positional_packet.entity_key = transform.entityKey();
+		positional_packet.pos = transform.pos;
+		positional_packet.transform = transform;
+		positional_packet.packet.resize(packet_buffer.buf.size());
+		std::memcpy(&positional_packet.packet[0], packet_buffer.buf.data(), packet_buffer.buf.size());
 	}
 }
 
@@ -183,6 +196,20 @@ static ServerConfig parseServerConfig(const std::string& config_path)
 	config.tls_private_key_path			= XMLParseUtils::parseStringWithDefault(root_elem, "tls_private_key_path", /*default val=*/"");
 	config.allow_light_mapper_bot_full_perms = XMLParseUtils::parseBoolWithDefault(root_elem, "allow_light_mapper_bot_full_perms", /*default val=*/false);
 	config.update_parcel_sales			= XMLParseUtils::parseBoolWithDefault(root_elem, "update_parcel_sales", /*default val=*/false);
+
+	const AreaOfInterestConfig default_aoi_config;
+	config.aoi_config.enabled			= XMLParseUtils::parseBoolWithDefault(root_elem, "aoi_filtering_enabled", /*default val=*/default_aoi_config.enabled);
+	config.aoi_config.near_dist			= (float)XMLParseUtils::parseDoubleWithDefault(root_elem, "aoi_near_dist", /*default val=*/default_aoi_config.near_dist);
+	config.aoi_config.mid_dist			= (float)XMLParseUtils::parseDoubleWithDefault(root_elem, "aoi_mid_dist", /*default val=*/default_aoi_config.mid_dist);
+	config.aoi_config.mid_update_period	= XMLParseUtils::parseDoubleWithDefault(root_elem, "aoi_mid_update_period_s", /*default val=*/default_aoi_config.mid_update_period);
+	config.aoi_config.far_update_period	= XMLParseUtils::parseDoubleWithDefault(root_elem, "aoi_far_update_period_s", /*default val=*/default_aoi_config.far_update_period);
+
+	config.tick_rate_hz					= XMLParseUtils::parseDoubleWithDefault(root_elem, "tick_rate_hz", /*default val=*/config.tick_rate_hz);
+	config.voice_audible_radius			= (float)XMLParseUtils::parseDoubleWithDefault(root_elem, "voice_audible_radius", /*default val=*/config.voice_audible_radius);
+	config.stream_compression_enabled	= XMLParseUtils::parseBoolWithDefault(root_elem, "stream_compression_enabled", /*default val=*/config.stream_compression_enabled);
+	config.stream_compression_level		= XMLParseUtils::parseIntWithDefault(root_elem, "stream_compression_level", /*default val=*/config.stream_compression_level);
+	config.resource_cache_max_MB		= XMLParseUtils::parseIntWithDefault(root_elem, "resource_cache_max_MB", /*default val=*/config.resource_cache_max_MB);
+	config.replication_log_max_MB		= XMLParseUtils::parseIntWithDefault(root_elem, "replication_log_max_MB", /*default val=*/config.replication_log_max_MB);
 	return config;
 }
 
@@ -203,6 +230,7 @@ int main(int argc, char *argv[])
 		syntax["--enable_dev_mode"] = std::vector<ArgumentParser::ArgumentType>();
 		syntax["--test"] = std::vector<ArgumentParser::ArgumentType>();
 		syntax["--save_sanitised_database"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // One string arg
+		syntax["--server_state_dir"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // Overrides the default server state dir.
 
 		std::vector<std::string> args;
 		for(int i=0; i<argc; ++i)
@@ -227,14 +255,17 @@ int main(int argc, char *argv[])
 
 #if defined(_WIN32)
 		const std::string substrata_appdata_dir = PlatformUtils::getOrCreateAppDataDirectory("Substrata");
-		const std::string server_state_dir = substrata_appdata_dir + "/server_data";
+		std::string server_state_dir = substrata_appdata_dir + "/server_data";
 #elif defined(OSX)
 		const std::string username = PlatformUtils::getLoggedInUserName();
-		const std::string server_state_dir = "/Users/" + username + "/cyberspace_server_state";
+		std::string server_state_dir = "/Users/" + username + "/cyberspace_server_state";
 #else
 		const std::string username = PlatformUtils::getLoggedInUserName();
-		const std::string server_state_dir = "/home/" + username + "/cyberspace_server_state";
+		std::string server_state_dir = "/home/" + username + "/cyberspace_server_state";
 #endif
+		// A backup dir kept up to date by backup_bot has the same layout as the server state dir, so a standby server can be started on it with this option.
+		if(parsed_args.isArgPresent("--server_state_dir"))
+			server_state_dir = parsed_args.getArgStringValue("--server_state_dir");
 		conPrint("server_state_dir: " + server_state_dir);
 		FileUtils::createDirIfDoesNotExist(server_state_dir);
 
@@ -254,6 +285,9 @@ int main(int argc, char *argv[])
 
 		server.config = server_config;
 
+		server.world_state->resource_cache.setMaxBytes((uint64)myMax(0, server_config.resource_cache_max_MB) * 1024 * 1024);
+		server.world_state->replication_log.setMaxBytes((size_t)myMax(0, server_config.replication_log_max_MB) * 1024 * 1024);
+
 		// Parse server credentials
 		try
 		{
@@ -461,104 +495,153 @@ int main(int argc, char *argv[])
 
 		server.dyn_tex_updater_thread_manager.addThread(new DynamicTextureUpdaterThread(&server, server.world_state.ptr()));
 
+		server.db_writer_thread_manager.addThread(new DatabaseWriterThread(server.world_state.ptr()));
+
 		Timer save_state_timer;
 
-		// A map from world name to a vector of packets to send to clients connected to that world.
-		std::map<std::string, std::vector<std::string>> broadcast_packets;
+		// If this many snapshots are waiting to be written, don't make another one.  The changes stay in the dirty sets, and are merged into a later snapshot.
+		const int64 MAX_PENDING_DB_SNAPSHOTS = 2;
+
+		// A map from world name to the packets to send to clients connected to that world.
+		std::map<std::string, WorldTickPackets> broadcast_packets;
+
+		// Area-of-interest filtering state for each connected client.  Only accessed by this thread.
+		std::map<WorkerThread*, ClientInterestState> client_interest_states;
+		std::vector<const PositionalPacket*> client_positional_packets;
+		std::vector<const TransformCompression::EntityTransform*> client_transforms;
+		std::string filtered_data;
+
+		// The main loop runs when avatars or objects are marked as dirty, but not more often than the configured tick rate.
+		// It also runs at least every MAX_IDLE_TICK_PERIOD seconds, to send held-back area-of-interest updates, time syncs etc.
+		const double min_tick_period = 1.0 / myClamp(server_config.tick_rate_hz, 1.0, 1000.0);
+		const double MAX_IDLE_TICK_PERIOD = 0.1;
+		double last_tick_time = Clock::getCurTimeRealSec();
+		Timer time_sync_timer;
+		Timer parcel_sales_timer;
 
 		// Main server loop
 		uint64 loop_iter = 0;
 		while(1)
 		{
-			PlatformUtils::Sleep(100);
+			// Wait until an avatar or object is marked as dirty, or until MAX_IDLE_TICK_PERIOD has passed.
+			server.world_state->waitForBroadcastNeeded(MAX_IDLE_TICK_PERIOD);
+
+			// Don't run more often than the tick rate.  Changes arriving while we sleep are batched into this tick.
+			const double time_since_last_tick = Clock::getCurTimeRealSec() - last_tick_time;
+			if(time_since_last_tick < min_tick_period)
+				PlatformUtils::Sleep((int)std::ceil((min_tick_period - time_since_last_tick) * 1000.0));
+			last_tick_time = Clock::getCurTimeRealSec();
+
+			// Take the broadcast-needed time before processing the dirty sets, so that changes made during processing trigger another tick.
+			const double broadcast_needed_time = server.world_state->takeBroadcastNeededTime();
 
 			SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
-			{ // Begin scope for world_state->mutex lock
+			// Take a copy of the world states, so that the global lock isn't held while processing the worlds.
+			std::vector<std::pair<std::string, Reference<ServerWorldState>>> world_states;
+			{
+				InstrumentedLock lock(server.world_state->mutex);
+				world_states.assign(server.world_state->world_states.begin(), server.world_state->world_states.end());
+			}
 
-				Lock lock(server.world_state->mutex);
+			{ // Begin scope for world_state->mutex lock
 
-				for(auto world_it = server.world_state->world_states.begin(); world_it != server.world_state->world_states.end(); ++world_it)
+				for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 				{
 					Reference<ServerWorldState> world_state = world_it->second;
 
-					std::vector<std::string>& world_packets = broadcast_packets[world_it->first];
-
-					// Generate packets for avatar changes
-					for(auto i = world_state->avatars.begin(); i != world_state->avatars.end();)
-					{
-						Avatar* avatar = i->second.getPointer();
-						if(avatar->other_dirty)
-						{
-							if(avatar->state == Avatar::State_Alive)
-							{
-								// Send AvatarFullUpdate packet
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarFullUpdate);
-								writeAvatarToNetworkStream(*avatar, scratch_packet);
-
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
-
-								avatar->other_dirty = false;
-								avatar->transform_dirty = false;
-								i++;
-							}
-							else if(avatar->state == Avatar::State_JustCreated)
-							{
-								// Send AvatarCreated packet
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarCreated);
-								writeAvatarToNetworkStream(*avatar, scratch_packet);
+					WorldTickPackets& world_tick_packets = broadcast_packets[world_it->first];
+					BroadcastFrame& world_packets = *world_tick_packets.packets_frame;
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+					// Each world is processed with just its own lock held, so a busy world doesn't hold up changes to other worlds.
+					InstrumentedLock world_lock(world_state->mutex);
 
-								avatar->state = Avatar::State_Alive;
-								avatar->other_dirty = false;
-								avatar->transform_dirty = false;
+					{ // Avatar changes
 
-								i++;
-							}
-							else if(avatar->state == Avatar::State_Dead)
+						// Generate packets for avatar changes
+						for(auto i = world_state->dirty_from_remote_avatars.begin(); i != world_state->dirty_from_remote_avatars.end(); ++i)
+						{
+							Avatar* avatar = i->ptr();
+							if(avatar->other_dirty)
 							{
-								// Send AvatarDestroyed packet
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarDestroyed);
-								writeToStream(avatar->uid, scratch_packet);
-
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
-
-								// Remove avatar from avatar map
-								auto old_avatar_iterator = i;
-								i++;
-								world_state->avatars.erase(old_avatar_iterator);
-
-								conPrint("Removed avatar from world_state->avatars");
+								if(avatar->state == Avatar::State_Alive)
+								{
+									// Send AvatarFullUpdate packet
+									MessageUtils::initPacket(scratch_packet, Protocol::AvatarFullUpdate);
+									writeAvatarToNetworkStream(*avatar, scratch_packet);
+
+									enqueueMessageToBroadcast(scratch_packet, world_packets);
+									world_tick_packets.reset_entity_keys.push_back(AreaOfInterest::makeAvatarEntityKey(avatar->uid));
+
+									avatar->other_dirty = false;
+									avatar->transform_dirty = false;
+								}
+								else if(avatar->state == Avatar::State_JustCreated)
+								{
+									// Send AvatarCreated packet
+									MessageUtils::initPacket(scratch_packet, Protocol::AvatarCreated);
+									writeAvatarToNetworkStream(*avatar, scratch_packet);
+
+									enqueueMessageToBroadcast(scratch_packet, world_packets);
+
+									avatar->state = Avatar::State_Alive;
+									avatar->other_dirty = false;
+									avatar->transform_dirty = false;
+								}
+								else if(avatar->state == Avatar::State_Dead)
+								{
+									// Send AvatarDestroyed packet
+									MessageUtils::initPacket(scratch_packet, Protocol::AvatarDestroyed);
+									writeToStream(avatar->uid, scratch_packet);
+
+									enqueueMessageToBroadcast(scratch_packet, world_packets);
+									world_tick_packets.reset_entity_keys.push_back(AreaOfInterest::makeAvatarEntityKey(avatar->uid));
+
+									// Remove avatar from avatar map
+									auto res = world_state->avatars.find(avatar->uid);
+									if(res != world_state->avatars.end() && res->second.ptr() == avatar)
+										world_state->avatars.erase(res);
+
+									conPrint("Removed avatar from world_state->avatars");
+								}
+								else
+								{
+									assert(0);
+								}
 							}
-							else
+							else if(avatar->transform_dirty)
 							{
-								assert(0);
+								if(avatar->state == Avatar::State_Alive)
+								{
+									// Send AvatarTransformUpdate packet
+									MessageUtils::initPacket(scratch_packet, Protocol::AvatarTransformUpdate);
+									writeToStream(avatar->uid, scratch_packet);
+									writeToStream(avatar->pos, scratch_packet);
+									writeToStream(avatar->rotation, scratch_packet);
+									scratch_packet.writeUInt32(avatar->anim_state);
+
+									TransformCompression::EntityTransform transform;
+									transform.type = TransformCompression::EntityTransform::Type_Avatar;
+									transform.uid = avatar->uid;
+									transform.pos = avatar->pos;
+									transform.avatar_rotation = avatar->rotation;
+									transform.avatar_anim_state = avatar->anim_state;
+
+									enqueuePositionalMessageToBroadcast(scratch_packet, transform, world_tick_packets);
+
+									avatar->transform_dirty = false;
+								}
 							}
 						}
-						else if(avatar->transform_dirty)
-						{
-							if(avatar->state == Avatar::State_Alive)
-							{
-								// Send AvatarTransformUpdate packet
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarTransformUpdate);
-								writeToStream(avatar->uid, scratch_packet);
-								writeToStream(avatar->pos, scratch_packet);
-								writeToStream(avatar->rotation, scratch_packet);
-								scratch_packet.writeUInt32(avatar->anim_state);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+						world_state->dirty_from_remote_avatars.clear();
 
-								avatar->transform_dirty = false;
-							}
-							i++;
-						}
-						else
-						{
-							i++;
-						}
-					}
 
+						// Record avatar positions, for area-of-interest filtering.
+						for(auto i = world_state->avatars.begin(); i != world_state->avatars.end(); ++i)
+							if(i->second->state == Avatar::State_Alive)
+								world_tick_packets.avatar_positions[i->first] = i->second->pos;
+					} // End avatar changes
 
 					// Generate packets for object changes
 					for(auto i = world_state->dirty_from_remote_objects.begin(); i != world_state->dirty_from_remote_objects.end(); ++i)
@@ -575,6 +658,7 @@ int main(int argc, char *argv[])
 								ob->writeToNetworkStream(scratch_packet);
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								world_tick_packets.reset_entity_keys.push_back(AreaOfInterest::makeObjectEntityKey(ob->uid));
 
 								ob->from_remote_other_dirty = false;
 								ob->from_remote_transform_dirty = false; // transform is sent in full packet also.
@@ -599,14 +683,20 @@ int main(int argc, char *argv[])
 								writeToStream(ob->uid, scratch_packet);
 
 								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								world_tick_packets.reset_entity_keys.push_back(AreaOfInterest::makeObjectEntityKey(ob->uid));
 
 								// Remove from dirty-set, so it's not updated in DB.
 								world_state->db_dirty_world_objects.erase(ob);
 
 								// Add DB record to list of records to be deleted.
-								server.world_state->db_records_to_delete.insert(ob->database_key);
-
-								// Remove ob from object map
+								server.world_state->addDatabaseRecordToDelete(ob->database_key);
+
+								// Remove ob from object grid, URL index and object map
+								world_state->object_grid.remove(ob);
+								{
+									InstrumentedLock resources_lock(server.world_state->resources_mutex);
+									server.world_state->object_URL_index.removeObject(ob->uid);
+								}
 								world_state->objects.erase(ob->uid);
 
 								conPrint("Removed object from world_state->objects");
@@ -634,7 +724,15 @@ int main(int argc, char *argv[])
 
 								scratch_packet.writeUInt32(ob->last_transform_update_avatar_uid);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								TransformCompression::EntityTransform transform;
+								transform.type = TransformCompression::EntityTransform::Type_Object;
+								transform.uid = ob->uid;
+								transform.pos = ob->pos;
+								transform.rot = Quatf::fromAxisAndAngle(ob->axis, ob->angle);
+								transform.scale = ob->scale;
+								transform.transform_update_avatar_uid = ob->last_transform_update_avatar_uid;
+
+								enqueuePositionalMessageToBroadcast(scratch_packet, transform, world_tick_packets);
 
 								ob->from_remote_transform_dirty = false;
 								server.world_state->markAsChanged();
@@ -660,7 +758,17 @@ int main(int argc, char *argv[])
 								scratch_packet.writeUInt32(ob->last_transform_update_avatar_uid);
 								scratch_packet.writeDouble(ob->last_transform_client_time);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+								TransformCompression::EntityTransform transform;
+								transform.type = TransformCompression::EntityTransform::Type_ObjectPhysics;
+								transform.uid = ob->uid;
+								transform.pos = ob->pos;
+								transform.rot = rot;
+								transform.linear_vel = Vec3f(ob->linear_vel.x[0], ob->linear_vel.x[1], ob->linear_vel.x[2]);
+								transform.angular_vel = Vec3f(ob->angular_vel.x[0], ob->angular_vel.x[1], ob->angular_vel.x[2]);
+								transform.transform_update_avatar_uid = ob->last_transform_update_avatar_uid;
+								transform.client_time = ob->last_transform_client_time;
+
+								enqueuePositionalMessageToBroadcast(scratch_packet, transform, world_tick_packets);
 
 								ob->from_remote_transform_dirty = false;
 								server.world_state->markAsChanged();
@@ -708,6 +816,7 @@ int main(int argc, char *argv[])
 					world_state->dirty_from_remote_objects.clear();
 				} // End for each server world
 
+				InstrumentedLock lock(server.world_state->mutex); // For server_admin_message
 
 				if(server.world_state->server_admin_message_changed)
 				{
@@ -732,24 +841,96 @@ int main(int argc, char *argv[])
 
 			// Enqueue packets to worker threads to send
 			// For each connected client, get packets for the world the client is connected to, and send to them.
+			// Avatar and object transform updates are filtered based on the distance from the client avatar.
 			{
 				Lock lock2(server.worker_thread_manager.getMutex());
 				for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
 				{
 					WorkerThread* worker = static_cast<WorkerThread*>(i->getPointer());
-					std::vector<std::string>& packets = broadcast_packets[worker->connected_world_name];
+					const WorldTickPackets& world_tick_packets = broadcast_packets[worker->connected_world_name];
+
+					// All workers for the world share the same frame, so the packet data is not copied per client.
+					worker->enqueueSharedDataToSend(world_tick_packets.packets_frame);
+
+					ClientInterestState& interest_state = client_interest_states[worker];
+					const UID client_avatar_uid = worker->getClientAvatarUID();
+					if(interest_state.client_avatar_uid != client_avatar_uid) // If this is a new client (possibly with a reused WorkerThread address):
+					{
+						interest_state = ClientInterestState();
+						interest_state.client_avatar_uid = client_avatar_uid;
+					}
+					interest_state.last_seen_tick = loop_iter;
+
+					client_positional_packets.clear();
+					auto pos_res = world_tick_packets.avatar_positions.find(client_avatar_uid);
+					if(pos_res != world_tick_packets.avatar_positions.end())
+					{
+						AreaOfInterest::getPacketsForClient(server_config.aoi_config, /*cur time=*/last_tick_time, /*client pos=*/pos_res->second, world_tick_packets, interest_state, client_positional_packets);
+					}
+					else
+					{
+						// The client avatar position is not known yet (client hasn't created its avatar), so just send all transform updates.
+						for(size_t z=0; z<world_tick_packets.positional_packets.size(); ++z)
+							client_positional_packets.push_back(&world_tick_packets.positional_packets[z]);
+						interest_state.entities.clear();
+					}
+
+					filtered_data.clear();
+					if(worker->getClientProtocolVersion() >= 40) // TransformUpdateBatch was added in protocol version 40.
+					{
+						// The client resets the delta baselines for these entities when it receives the full update or destroy messages in the shared frame, which is sent before the batch.
+						for(size_t z=0; z<world_tick_packets.reset_entity_keys.size(); ++z)
+							worker->transform_codec.resetEntity(world_tick_packets.reset_entity_keys[z]);
+
+						client_transforms.resize(client_positional_packets.size());
+						for(size_t z=0; z<client_positional_packets.size(); ++z)
+							client_transforms[z] = &client_positional_packets[z]->transform;
+						worker->transform_codec.writeBatchMessages(client_transforms, scratch_packet, filtered_data);
+					}
+					else
+					{
+						for(size_t z=0; z<client_positional_packets.size(); ++z)
+							filtered_data += client_positional_packets[z]->packet;
+					}
+
+					if(!filtered_data.empty())
+						worker->enqueueDataToSend(filtered_data);
+				}
+			}
+
+			if(broadcast_needed_time >= 0)
+				server.world_state->broadcast_latency_histogram.addSample(Clock::getCurTimeRealSec() - broadcast_needed_time);
+
+			// Remove area-of-interest state for clients that have disconnected.
+			for(auto it = client_interest_states.begin(); it != client_interest_states.end(); )
+			{
+				if(it->second.last_seen_tick != loop_iter)
+					it = client_interest_states.erase(it);
+				else
+					++it;
+			}
 
-					for(size_t z=0; z<packets.size(); ++z)
-						worker->enqueueDataToSend(packets[z]);
+			// Publish avatar locations for the UDPHandlerThread, for voice relaying.
+			{
+				AvatarLocationsRef avatar_locations = new AvatarLocations();
+				uint32 world_index = 0;
+				for(auto it = broadcast_packets.begin(); it != broadcast_packets.end(); ++it, ++world_index)
+				{
+					const std::unordered_map<UID, Vec3d, UIDHasher>& positions = it->second.avatar_positions;
+					for(auto z = positions.begin(); z != positions.end(); ++z)
+						avatar_locations->locations[z->first] = AvatarLocations::Location({world_index, z->second});
 				}
+				server.setAvatarLocations(avatar_locations);
 			}
 
-			// Clear broadcast_packets vectors of packets.
+			// Clear broadcast_packets of packets.
 			for(auto it = broadcast_packets.begin(); it != broadcast_packets.end(); ++it)
 				it->second.clear();
 			
-			if((loop_iter % 40) == 0) // Approx every 4 s.
+			if((loop_iter == 0) || (time_sync_timer.elapsed() > 4.0))
 			{
+				time_sync_timer.reset();
+
 				// Send out TimeSyncMessage packets to clients
 				MessageUtils::initPacket(scratch_packet, Protocol::TimeSyncMessage);
 				scratch_packet.writeDouble(server.getCurrentGlobalTime());
@@ -764,8 +945,10 @@ int main(int argc, char *argv[])
 			}
 
 #if USE_GLARE_PARCEL_AUCTION_CODE
-			if(server_config.update_parcel_sales && ((loop_iter % 512) == 0)) // Approx every 50 s.
+			if(server_config.update_parcel_sales && ((loop_iter == 0) || (parcel_sales_timer.elapsed() > 50.0)))
 			{
+				parcel_sales_timer.reset();
+
 				AuctionManagement::updateParcelSales(*server.world_state);
 
 				// Want want to list new parcels (to bring the total number being listed up to our target number) every day at midnight UTC.
@@ -793,20 +976,35 @@ int main(int argc, char *argv[])
 
 			if(server.world_state->hasChanged() && (save_state_timer.elapsed() > 10.0))
 			{
-				try
+				if(server.world_state->db_num_snapshots_pending >= MAX_PENDING_DB_SNAPSHOTS)
 				{
-					// Save world state to disk
-					Lock lock2(server.world_state->mutex);
-
-					server.world_state->serialiseToDisk();
-
-					server.world_state->clearChangedFlag();
+					// The DatabaseWriterThread is behind, try again later.
+					conPrint("Deferring save of world state, " + toString((int64)server.world_state->db_num_snapshots_pending) + " snapshot(s) waiting to be written.");
+					server.world_state->db_num_deferred_saves.increment();
 					save_state_timer.reset();
 				}
-				catch(glare::Exception& e)
+				else
 				{
-					conPrint("Warning: saving world state to disk failed: " + e.what());
-					save_state_timer.reset(); // Reset timer so we don't try again straight away.
+					try
+					{
+						// Copy changes to a snapshot, which will be written to disk by the DatabaseWriterThread.
+						Reference<DatabaseSnapshot> snapshot;
+						{
+							InstrumentedLock lock2(server.world_state->mutex);
+
+							server.world_state->clearChangedFlag();
+							snapshot = server.world_state->makeDatabaseSnapshot();
+						}
+
+						server.world_state->db_num_snapshots_pending.increment();
+						server.db_writer_thread_manager.enqueueMessage(snapshot.ptr());
+						save_state_timer.reset();
+					}
+					catch(glare::Exception& e)
+					{
+						conPrint("Warning: saving world state to disk failed: " + e.what());
+						save_state_timer.reset(); // Reset timer so we don't try again straight away.
+					}
 				}
 			}
 
@@ -886,6 +1084,20 @@ void Server::clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip
 }
 
 
+void Server::setAvatarLocations(const AvatarLocationsRef& locations)
+{
+	Lock lock(avatar_locations_mutex);
+	avatar_locations = locations;
+}
+
+
+AvatarLocationsRef Server::getAvatarLocations()
+{
+	Lock lock(avatar_locations_mutex);
+	return avatar_locations;
+}
+
+
 void Server::clientDisconnected(WorkerThread* worker_thread)
 {
 	conPrint("Server::clientDisconnected(): worker_thread: 0x" + toHexString((uint64)worker_thread));
@@ -7,6 +7,8 @@ Copyright Glare Technologies Limited 2016 -
 
 
 #include "ServerWorldState.h"
+#include "AreaOfInterest.h"
+#include "VoiceRelay.h"
 #include "ThreadManager.h"
 #include "../shared/ResourceManager.h"
 #include <IPAddress.h>
@@ -16,7 +18,7 @@ class WorkerThread;
 class ServerConfig
 {
 public:
-	ServerConfig() : allow_light_mapper_bot_full_perms(false), update_parcel_sales(false) {}
+	ServerConfig() : allow_light_mapper_bot_full_perms(false), update_parcel_sales(false), tick_rate_hz(20), voice_audible_radius(100.f), stream_compression_enabled(true), stream_compression_level(3), resource_cache_max_MB(512), replication_log_max_MB(64) {}
 	
 	std::string webserver_fragments_dir; // empty string = use default.
 	std::string webserver_public_files_dir; // empty string = use default.
@@ -28,6 +30,19 @@ public:
 	bool allow_light_mapper_bot_full_perms; // Allow lightmapper bot (User account with name "lightmapperbot" to have full write permissions.
 
 	bool update_parcel_sales; // Should we run auctions?
+
+	AreaOfInterestConfig aoi_config; // Area-of-interest filtering of avatar and object transform updates sent to clients.
+
+	double tick_rate_hz; // Max rate at which the main server loop broadcasts avatar and object changes to clients.
+
+	float voice_audible_radius; // Voice packets are only relayed to clients with avatars within this distance of the speaker, in the same world.  If <= 0, relay to all clients in the same world.
+
+	bool stream_compression_enabled; // Compress messages sent to clients that ask for it.  See shared/StreamCompression.h
+	int stream_compression_level; // zstd compression level.
+
+	int resource_cache_max_MB; // Memory budget of the in-memory cache of resource files.  See ResourceCache.h
+
+	int replication_log_max_MB; // Memory budget of the log of recent database snapshots kept for replication followers.  See ReplicationLog.h
 };
 
 
@@ -60,6 +75,10 @@ public:
 	// Called when we receive a UDP packet from a client, which allows the client remote UDP port to be known.
 	void clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip_addr, int client_UDP_port);
 
+	// Called by the main server loop each tick.
+	void setAvatarLocations(const AvatarLocationsRef& locations);
+	AvatarLocationsRef getAvatarLocations(); // Threadsafe
+
 
 	Reference<ServerAllWorldsState> world_state;
 
@@ -72,6 +91,8 @@ public:
 
 	ThreadManager dyn_tex_updater_thread_manager;
 
+	ThreadManager db_writer_thread_manager;
+
 	std::string screenshot_dir;
 
 	ServerConfig config;
@@ -79,4 +100,7 @@ public:
 	Mutex connected_clients_mutex;
 	std::map<WorkerThread*, ServerConnectedClientInfo> connected_clients;
 	glare::AtomicInt connected_clients_changed;
+
+	Mutex avatar_locations_mutex;
+	AvatarLocationsRef avatar_locations GUARDED_BY(avatar_locations_mutex);
 };
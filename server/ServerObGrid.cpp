@@ -0,0 +1,452 @@
+/*=====================================================================
+ServerObGrid.cpp
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ServerObGrid.h"
+
+
+ServerObGrid::ServerObGrid(float cell_w_)
+:	cell_w(cell_w_),
+	recip_cell_w(1 / cell_w_)
+{
+	assert(cell_w_ > 0);
+}
+
+
+ServerObGrid::~ServerObGrid()
+{
+}
+
+
+void ServerObGrid::insert(WorldObject* ob)
+{
+	if(ob_cells.count(ob) != 0)
+		return; // Already inserted.
+
+	if(!posIsFinite(ob->pos))
+	{
+		non_finite_obs.insert(ob);
+		ob_cells[ob] = Vec3<int>(0, 0, 0); // Cell is not used for non-finite objects.
+		return;
+	}
+
+	const Vec3<int> cell = cellForPos(ob->pos);
+	cells[cell].insert(ob);
+	ob_cells[ob] = cell;
+}
+
+
+void ServerObGrid::remove(WorldObject* ob)
+{
+	auto res = ob_cells.find(ob);
+	if(res == ob_cells.end())
+		return; // Not inserted.
+
+	if(non_finite_obs.erase(ob) == 0) // If the object was in a cell:
+	{
+		auto cell_res = cells.find(res->second);
+		assert(cell_res != cells.end());
+		if(cell_res != cells.end())
+		{
+			cell_res->second.erase(ob);
+			if(cell_res->second.empty())
+				cells.erase(cell_res); // Don't keep around empty cells.
+		}
+	}
+
+	ob_cells.erase(res);
+}
+
+
+void ServerObGrid::objectMoved(WorldObject* ob)
+{
+	auto res = ob_cells.find(ob);
+	if(res == ob_cells.end())
+	{
+		insert(ob);
+		return;
+	}
+
+	// Most moves stay within the same cell, handle that case without touching the cell sets.
+	const bool was_finite = non_finite_obs.count(ob) == 0;
+	if(was_finite && posIsFinite(ob->pos) && (cellForPos(ob->pos) == res->second))
+		return;
+
+	remove(ob);
+	insert(ob);
+}
+
+
+void ServerObGrid::clear()
+{
+	cells.clear();
+	ob_cells.clear();
+	non_finite_obs.clear();
+}
+
+
+void ServerObGrid::appendObjectsInCell(const Vec3<int>& cell, std::vector<WorldObject*>& obs_out) const
+{
+	auto res = cells.find(cell);
+	if(res != cells.end())
+		obs_out.insert(obs_out.end(), res->second.begin(), res->second.end());
+}
+
+
+void ServerObGrid::appendObjectsInAABB(const js::AABBox& aabb, std::vector<WorldObject*>& obs_out) const
+{
+	if(!aabb.min_.isFinite() || !aabb.max_.isFinite())
+		return;
+
+	const int begin_x = cellCoordForFloat(aabb.min_[0]);
+	const int begin_y = cellCoordForFloat(aabb.min_[1]);
+	const int begin_z = cellCoordForFloat(aabb.min_[2]);
+	const int end_x   = cellCoordForFloat(aabb.max_[0]);
+	const int end_y   = cellCoordForFloat(aabb.max_[1]);
+	const int end_z   = cellCoordForFloat(aabb.max_[2]);
+
+	if(end_x < begin_x || end_y < begin_y || end_z < begin_z)
+		return; // Empty AABB
+
+	// Compute the number of cells spanned by the AABB, using doubles to avoid overflow.
+	const double num_query_cells = ((double)end_x - begin_x + 1) * ((double)end_y - begin_y + 1) * ((double)end_z - begin_z + 1);
+
+	if(num_query_cells <= (double)cells.size())
+	{
+		// Look up each cell overlapping the AABB.
+		for(int z=begin_z; z<=end_z; ++z)
+		for(int y=begin_y; y<=end_y; ++y)
+		for(int x=begin_x; x<=end_x; ++x)
+		{
+			auto res = cells.find(Vec3<int>(x, y, z));
+			if(res != cells.end())
+			{
+				for(auto it = res->second.begin(); it != res->second.end(); ++it)
+				{
+					WorldObject* ob = *it;
+					if(aabb.contains(ob->pos.toVec4fPoint()))
+						obs_out.push_back(ob);
+				}
+			}
+		}
+	}
+	else
+	{
+		// The AABB spans more cells than there are non-empty cells, so it's faster to iterate over the non-empty cells.
+		for(auto cell_it = cells.begin(); cell_it != cells.end(); ++cell_it)
+		{
+			const Vec3<int>& c = cell_it->first;
+			if(c.x >= begin_x && c.x <= end_x && c.y >= begin_y && c.y <= end_y && c.z >= begin_z && c.z <= end_z)
+			{
+				for(auto it = cell_it->second.begin(); it != cell_it->second.end(); ++it)
+				{
+					WorldObject* ob = *it;
+					if(aabb.contains(ob->pos.toVec4fPoint()))
+						obs_out.push_back(ob);
+				}
+			}
+		}
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <maths/PCG32.h>
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <algorithm>
+#include <map>
+#include <limits>
+
+
+// Returns objects in the AABB by testing every object, as WorkerThread used to do for QueryObjectsInAABB.
+static void linearObjectsInAABB(const std::map<UID, WorldObjectRef>& objects, const js::AABBox& aabb, std::vector<WorldObject*>& obs_out)
+{
+	for(auto it = objects.begin(); it != objects.end(); ++it)
+	{
+		WorldObject* ob = it->second.ptr();
+		const Vec4f ob_pos_vec4f = ob->pos.toVec4fPoint();
+		if(ob_pos_vec4f.isFinite() && aabb.contains(ob_pos_vec4f))
+			obs_out.push_back(ob);
+	}
+}
+
+
+// Returns objects in any of the cells by testing every object against every cell AABB, as WorkerThread used to do for QueryObjects.
+static void linearObjectsInCells(const std::map<UID, WorldObjectRef>& objects, const std::vector<js::AABBox>& cell_aabbs, std::vector<WorldObject*>& obs_out)
+{
+	for(auto it = objects.begin(); it != objects.end(); ++it)
+	{
+		WorldObject* ob = it->second.ptr();
+		for(size_t i=0; i<cell_aabbs.size(); ++i)
+			if(cell_aabbs[i].contains(ob->pos.toVec4fPoint()))
+			{
+				obs_out.push_back(ob);
+				break;
+			}
+	}
+}
+
+
+static void makeRandomObjects(size_t num_obs, float world_half_width, PCG32& rng, std::map<UID, WorldObjectRef>& objects_out)
+{
+	for(size_t i=0; i<num_obs; ++i)
+	{
+		WorldObjectRef ob = new WorldObject();
+		ob->uid = UID(i);
+		ob->pos = Vec3d(
+			(rng.unitRandom() * 2 - 1) * world_half_width,
+			(rng.unitRandom() * 2 - 1) * world_half_width,
+			rng.unitRandom() * 50.0
+		);
+		objects_out[ob->uid] = ob;
+	}
+}
+
+
+static bool sameObjectSets(std::vector<WorldObject*> a, std::vector<WorldObject*> b)
+{
+	std::sort(a.begin(), a.end());
+	std::sort(b.begin(), b.end());
+	return a == b;
+}
+
+
+static js::AABBox cellAABB(int x, int y, int z, float cell_w)
+{
+	return js::AABBox(
+		Vec4f(0,0,0,1) + Vec4f((float)x,     (float)y,     (float)z,     0)*cell_w,
+		Vec4f(0,0,0,1) + Vec4f((float)(x+1), (float)(y+1), (float)(z+1), 0)*cell_w
+	);
+}
+
+
+void ServerObGrid::test()
+{
+	conPrint("ServerObGrid::test()");
+
+	//------------------------------------ Test insert, move and remove ------------------------------------
+	{
+		ServerObGrid grid(200.f);
+
+		WorldObjectRef ob = new WorldObject();
+		ob->pos = Vec3d(10, 20, 30);
+		grid.insert(ob.ptr());
+		grid.insert(ob.ptr()); // Inserting twice should be a no-op.
+		testAssert(grid.numObjects() == 1);
+		testAssert(grid.numNonEmptyCells() == 1);
+
+		std::vector<WorldObject*> obs;
+		grid.appendObjectsInCell(Vec3<int>(0, 0, 0), obs);
+		testAssert(obs.size() == 1 && obs[0] == ob.ptr());
+
+		// Move within the same cell
+		ob->pos = Vec3d(150, 20, 30);
+		grid.objectMoved(ob.ptr());
+		obs.clear();
+		grid.appendObjectsInCell(Vec3<int>(0, 0, 0), obs);
+		testAssert(obs.size() == 1);
+
+		// Move to a negative cell
+		ob->pos = Vec3d(-10, 20, 30);
+		grid.objectMoved(ob.ptr());
+		obs.clear();
+		grid.appendObjectsInCell(Vec3<int>(0, 0, 0), obs);
+		testAssert(obs.empty());
+		grid.appendObjectsInCell(Vec3<int>(-1, 0, 0), obs);
+		testAssert(obs.size() == 1);
+		testAssert(grid.numNonEmptyCells() == 1); // Old cell should have been removed.
+
+		// Move to a non-finite position.  Shouldn't be returned by any query.
+		ob->pos = Vec3d(std::numeric_limits<double>::quiet_NaN(), 0, 0);
+		grid.objectMoved(ob.ptr());
+		testAssert(grid.numObjects() == 1);
+		testAssert(grid.numNonEmptyCells() == 0);
+		obs.clear();
+		grid.appendObjectsInAABB(js::AABBox(Vec4f(-1.0e30f, -1.0e30f, -1.0e30f, 1), Vec4f(1.0e30f, 1.0e30f, 1.0e30f, 1)), obs);
+		testAssert(obs.empty());
+
+		// Move back to a finite position
+		ob->pos = Vec3d(1000, 1000, 1000);
+		grid.objectMoved(ob.ptr());
+		obs.clear();
+		grid.appendObjectsInCell(Vec3<int>(5, 5, 5), obs);
+		testAssert(obs.size() == 1);
+
+		// Test huge coordinates don't overflow
+		ob->pos = Vec3d(1.0e30, -1.0e30, 0);
+		grid.objectMoved(ob.ptr());
+		obs.clear();
+		grid.appendObjectsInAABB(js::AABBox(Vec4f(-1.0e31f, -1.0e31f, -1.0e31f, 1), Vec4f(1.0e31f, 1.0e31f, 1.0e31f, 1)), obs);
+		testAssert(obs.size() == 1);
+
+		grid.remove(ob.ptr());
+		grid.remove(ob.ptr()); // Removing twice should be a no-op.
+		testAssert(grid.numObjects() == 0);
+		testAssert(grid.numNonEmptyCells() == 0);
+	}
+
+	//------------------------------------ Test queries match the linear scans ------------------------------------
+	{
+		PCG32 rng(1);
+		std::map<UID, WorldObjectRef> objects;
+		makeRandomObjects(/*num obs=*/5000, /*world half width=*/2000.f, rng, objects);
+
+		ServerObGrid grid(200.f);
+		for(auto it = objects.begin(); it != objects.end(); ++it)
+			grid.insert(it->second.ptr());
+
+		// Put some objects exactly on cell boundaries
+		objects[UID(1)]->pos = Vec3d(0.0);
+		grid.objectMoved(objects[UID(1)].ptr());
+		objects[UID(2)]->pos = Vec3d(-200.0, 400.0, 0.0);
+		grid.objectMoved(objects[UID(2)].ptr());
+
+		for(int q=0; q<100; ++q)
+		{
+			const Vec4f centre((rng.unitRandom() * 2 - 1) * 2000.f, (rng.unitRandom() * 2 - 1) * 2000.f, 0, 1);
+			const float half_w = rng.unitRandom() * 1500.f;
+			const js::AABBox aabb(centre - Vec4f(half_w, half_w, half_w, 0), centre + Vec4f(half_w, half_w, half_w, 0));
+
+			std::vector<WorldObject*> grid_obs, linear_obs;
+			grid.appendObjectsInAABB(aabb, grid_obs);
+			linearObjectsInAABB(objects, aabb, linear_obs);
+			testAssert(sameObjectSets(grid_obs, linear_obs));
+		}
+
+		// Test a query with a huge AABB, which will use the iterate-over-non-empty-cells path.
+		{
+			const js::AABBox aabb(Vec4f(-1.0e20f, -1.0e20f, -1.0e20f, 1), Vec4f(1.0e20f, 1.0e20f, 1.0e20f, 1));
+			std::vector<WorldObject*> grid_obs, linear_obs;
+			grid.appendObjectsInAABB(aabb, grid_obs);
+			linearObjectsInAABB(objects, aabb, linear_obs);
+			testAssert(grid_obs.size() == objects.size());
+			testAssert(sameObjectSets(grid_obs, linear_obs));
+		}
+
+		// Test that each object within a cell is returned by the cell query.
+		for(int x=-3; x<3; ++x)
+		for(int y=-3; y<3; ++y)
+		{
+			const js::AABBox aabb = cellAABB(x, y, 0, 200.f);
+
+			std::vector<WorldObject*> grid_obs;
+			grid.appendObjectsInCell(Vec3<int>(x, y, 0), grid_obs);
+
+			for(size_t i=0; i<grid_obs.size(); ++i)
+				testAssert(aabb.contains(grid_obs[i]->pos.toVec4fPoint()));
+
+			// Every object strictly inside the cell must be returned.
+			for(auto it = objects.begin(); it != objects.end(); ++it)
+			{
+				const Vec4f p = it->second->pos.toVec4fPoint();
+				if(p[0] > aabb.min_[0] && p[0] < aabb.max_[0] && p[1] > aabb.min_[1] && p[1] < aabb.max_[1] && p[2] > aabb.min_[2] && p[2] < aabb.max_[2])
+					testAssert(std::find(grid_obs.begin(), grid_obs.end(), it->second.ptr()) != grid_obs.end());
+			}
+		}
+	}
+
+	conPrint("ServerObGrid::test() done");
+}
+
+
+// Compares query times of the grid against the linear scans previously done by WorkerThread.
+void ServerObGrid::benchmark()
+{
+	conPrint("ServerObGrid::benchmark()");
+
+	const float cell_w = 200.f;
+	const size_t num_obs_values[] = { 10000, 100000, 1000000 };
+
+	for(size_t n=0; n<sizeof(num_obs_values) / sizeof(size_t); ++n)
+	{
+		const size_t num_obs = num_obs_values[n];
+
+		PCG32 rng(1);
+		std::map<UID, WorldObjectRef> objects;
+		makeRandomObjects(num_obs, /*world half width=*/10000.f, rng, objects);
+
+		Timer build_timer;
+		ServerObGrid grid(cell_w);
+		for(auto it = objects.begin(); it != objects.end(); ++it)
+			grid.insert(it->second.ptr());
+		const double build_time = build_timer.elapsed();
+
+		// Query cells around a camera position, like the client does with QueryObjects.  (7 x 7 x 2 cells)
+		std::vector<js::AABBox> cell_aabbs;
+		std::vector<Vec3<int>> cell_coords;
+		for(int z=0; z<2; ++z)
+		for(int y=-3; y<=3; ++y)
+		for(int x=-3; x<=3; ++x)
+		{
+			cell_aabbs.push_back(cellAABB(x, y, z, cell_w));
+			cell_coords.push_back(Vec3<int>(x, y, z));
+		}
+
+		// Query a 2 km AABB, like the client does with QueryObjectsInAABB on connect.
+		const js::AABBox aabb(Vec4f(-1000, -1000, -1000, 1), Vec4f(1000, 1000, 1000, 1));
+
+		const int NUM_ITERS = 10;
+		std::vector<WorldObject*> obs;
+		obs.reserve(num_obs);
+
+		Timer timer;
+		size_t linear_cells_count = 0;
+		for(int i=0; i<NUM_ITERS; ++i)
+		{
+			obs.clear();
+			linearObjectsInCells(objects, cell_aabbs, obs);
+			linear_cells_count = obs.size();
+		}
+		const double linear_cells_time = timer.elapsed() / NUM_ITERS;
+
+		timer.reset();
+		size_t grid_cells_count = 0;
+		for(int i=0; i<NUM_ITERS; ++i)
+		{
+			obs.clear();
+			for(size_t c=0; c<cell_coords.size(); ++c)
+				grid.appendObjectsInCell(cell_coords[c], obs);
+			grid_cells_count = obs.size();
+		}
+		const double grid_cells_time = timer.elapsed() / NUM_ITERS;
+
+		timer.reset();
+		size_t linear_aabb_count = 0;
+		for(int i=0; i<NUM_ITERS; ++i)
+		{
+			obs.clear();
+			linearObjectsInAABB(objects, aabb, obs);
+			linear_aabb_count = obs.size();
+		}
+		const double linear_aabb_time = timer.elapsed() / NUM_ITERS;
+
+		timer.reset();
+		size_t grid_aabb_count = 0;
+		for(int i=0; i<NUM_ITERS; ++i)
+		{
+			obs.clear();
+			grid.appendObjectsInAABB(aabb, obs);
+			grid_aabb_count = obs.size();
+		}
+		const double grid_aabb_time = timer.elapsed() / NUM_ITERS;
+
+		testAssert(grid_aabb_count == linear_aabb_count);
+
+		conPrint("num obs: " + toString(num_obs) + " (grid build: " + doubleToStringNSigFigs(build_time * 1.0e3, 4) + " ms)");
+		conPrint("    QueryObjects (" + toString(cell_coords.size()) + " cells, " + toString(grid_cells_count) + " obs):   linear: " + doubleToStringNSigFigs(linear_cells_time * 1.0e3, 4) + " ms, grid: " +
+			doubleToStringNSigFigs(grid_cells_time * 1.0e3, 4) + " ms (linear found " + toString(linear_cells_count) + " obs)");
+		conPrint("    QueryObjectsInAABB (" + toString(grid_aabb_count) + " obs): linear: " + doubleToStringNSigFigs(linear_aabb_time * 1.0e3, 4) + " ms, grid: " +
+			doubleToStringNSigFigs(grid_aabb_time * 1.0e3, 4) + " ms");
+	}
+
+	conPrint("ServerObGrid::benchmark() done");
+}
+
+
+#endif // BUILD_TESTS
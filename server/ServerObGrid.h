@@ -0,0 +1,103 @@
+/*=====================================================================
+ServerObGrid.h
+--------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/WorldObject.h"
+#include <maths/vec3.h>
+#include <physics/jscol_aabbox.h>
+#include <unordered_map>
+#include <cmath>
+#include <unordered_set>
+#include <vector>
+
+
+struct ServerObGridCellHash
+{
+	size_t operator() (const Vec3<int>& c) const
+	{
+		// Do the multiplications on unsigned ints to avoid signed overflow.
+		return (size_t)(((uint32)c.x * 73856093u) ^ ((uint32)c.y * 19349663u) ^ ((uint32)c.z * 83492791u));
+	}
+};
+
+
+/*=====================================================================
+ServerObGrid
+------------
+A uniform grid spatial index over the objects in a ServerWorldState, keyed by exact integer cell coordinates.
+Used to answer QueryObjects and QueryObjectsInAABB without scanning every object in the world.
+
+Uses the same cell width as the client (see CELL_WIDTH in gui_client/ProximityLoader.cpp), so
+a QueryObjects cell maps directly to a grid cell.
+
+An object is assigned to the single cell containing floor(pos / cell_w).
+Objects with non-finite positions are tracked, but are not in any cell, so are never returned by queries.
+
+Not threadsafe, should be accessed with the world mutex held.
+=====================================================================*/
+class ServerObGrid
+{
+public:
+	ServerObGrid(float cell_w = 200.f);
+	~ServerObGrid();
+
+	void insert(WorldObject* ob); // Inserts ob into the cell for ob->pos.  Does nothing if already inserted.
+	void remove(WorldObject* ob); // Does nothing if not inserted.
+	void objectMoved(WorldObject* ob); // Call after ob->pos has changed.  Moves ob to the cell for the new position.  Inserts ob if not already inserted.
+	void clear();
+
+	bool contains(WorldObject* ob) const { return ob_cells.count(ob) != 0; }
+	size_t numObjects() const { return ob_cells.size(); }
+	size_t numNonEmptyCells() const { return cells.size(); }
+
+	// Appends objects whose position lies in the given grid cell.
+	void appendObjectsInCell(const Vec3<int>& cell, std::vector<WorldObject*>& obs_out) const;
+
+	// Appends objects with a finite position contained in aabb.  (Same test as js::AABBox::contains())
+	void appendObjectsInAABB(const js::AABBox& aabb, std::vector<WorldObject*>& obs_out) const;
+
+	inline Vec3<int> cellForPos(const Vec3d& pos) const;
+
+	float getCellWidth() const { return cell_w; }
+
+	static void test();
+	static void benchmark(); // Compares query times against linear scans of all objects, with up to 1M objects.
+
+private:
+	inline int cellCoordForFloat(float x) const;
+	inline static bool posIsFinite(const Vec3d& pos);
+
+	typedef std::unordered_set<WorldObject*> CellObSet;
+
+	float cell_w;
+	float recip_cell_w;
+	std::unordered_map<Vec3<int>, CellObSet, ServerObGridCellHash> cells; // Only non-empty cells are stored.
+	std::unordered_map<WorldObject*, Vec3<int>> ob_cells; // Map from object to the cell it is currently in.
+	std::unordered_set<WorldObject*> non_finite_obs; // Objects that are tracked but have a non-finite position, so are not in any cell.
+};
+
+
+int ServerObGrid::cellCoordForFloat(float x) const
+{
+	// Clamp so that the conversion to int can't overflow, for objects with huge coordinates.  Such objects all end up in the boundary cells.
+	const float MAX_CELL_COORD = 1.0e9f;
+	return (int)std::floor(myClamp(x * recip_cell_w, -MAX_CELL_COORD, MAX_CELL_COORD));
+}
+
+
+// Compute the cell using the single-precision position, since the queries test single-precision positions (ob->pos.toVec4fPoint()).
+Vec3<int> ServerObGrid::cellForPos(const Vec3d& pos) const
+{
+	const Vec4f p = pos.toVec4fPoint();
+	return Vec3<int>(cellCoordForFloat(p[0]), cellCoordForFloat(p[1]), cellCoordForFloat(p[2]));
+}
+
+
+bool ServerObGrid::posIsFinite(const Vec3d& pos)
+{
+	return pos.toVec4fPoint().isFinite();
+}
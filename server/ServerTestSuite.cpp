@@ -7,8 +7,25 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "AccountHandlers.h"
+#include "ServerObGrid.h"
+#include "AreaOfInterest.h"
+#include "LatencyHistogram.h"
+#include "InstrumentedMutex.h"
+#include "WorkerThreadTests.h"
+#include "ServerWorldStateTests.h"
+#include "VoiceRelay.h"
+#include "LODGenJobQueue.h"
+#include "ObjectURLIndex.h"
+#include "IncrementalObjectSync.h"
 #include "../shared/WorldObject.h"
 #include "../shared/LODGeneration.h"
+#include "../shared/TransformCompression.h"
+#include "../shared/ObjectSyncDigest.h"
+#include "../shared/StreamCompression.h"
+#include "CompressedResourceVariants.h"
+#include "ResourceDownloadScheduler.h"
+#include "ResourceCache.h"
+#include "ReplicationLog.h"
 #include "../ethereum/RLP.h"
 #include "../ethereum/Signing.h"
 #include "../ethereum/Infura.h"
@@ -100,8 +117,29 @@ void ServerTestSuite::test()
 	runTest([&]() { Signing::test();													});
 	runTest([&]() { AccountHandlers::test();											});
 	runTest([&]() { HTTPClient::test();													}, /*mem leak allowed=*/true); // Leaks due to libtls allocating globals
+	runTest([&]() { ServerObGrid::test();												});
+	runTest([&]() { AreaOfInterest::test();												});
+	runTest([&]() { LatencyHistogram::test();											});
+	runTest([&]() { InstrumentedMutex::test();											});
+	runTest([&]() { WorkerThreadTests::test();											});
+	runTest([&]() { ServerWorldStateTests::test();										});
+	runTest([&]() { VoiceRelay::test();													});
+	runTest([&]() { LODGenJobQueue::test();												});
+	runTest([&]() { ObjectURLIndex::test();												});
+	runTest([&]() { TransformCompression::TransformDeltaCodec::test();					});
+	runTest([&]() { ObjectSyncDigest::test();											});
+	runTest([&]() { IncrementalObjectSync::test();										});
+	runTest([&]() { StreamCompression::test();											});
+	runTest([&]() { CompressedResourceVariants::test();									});
+	runTest([&]() { ResourceDownloadScheduler::test();									});
+	runTest([&]() { ResourceCache::test();												});
+	runTest([&]() { ReplicationLog::test();												});
 	
 	// runTest([&]() { BatchedMeshTests::test();										}); // Uses some Indigo files
+	// runTest([&]() { ServerObGrid::benchmark();										}); // Slow, allocates up to 1M objects
+	// runTest([&]() { WorkerThreadTests::benchmarkBroadcastFanOut();					}); // Benchmark
+	// runTest([&]() { IncrementalObjectSync::testReconnectPerformance();				}); // Slow, replays reconnects against worlds of up to 400K objects
+	// runTest([&]() { ServerWorldStateTests::benchmarkStartupLoad();					}); // Slow, writes and loads a 500K object database
 	// runTest([&]() { Infura::test();													}); // Don't hit up Infura API usually
 	// runTest([&]() { web::WebWorkerThreadTests::test();								}); // Doesn't return
 
@@ -21,7 +21,20 @@ Generated at 2016-01-12 12:22:34 +1300
 #include <BufferViewInStream.h>
 
 
+void ServerWorldState::rebuildObjectGrid()
+{
+	object_grid.clear();
+	for(auto it = objects.begin(); it != objects.end(); ++it)
+		object_grid.insert(it->second.ptr());
+}
+
+
 ServerAllWorldsState::ServerAllWorldsState()
+:	mutex("global"),
+	users_mutex("users"),
+	sessions_mutex("sessions"),
+	orders_mutex("orders"),
+	resources_mutex("resources")
 {
 	next_avatar_uid = UID(0);
 	next_object_uid = UID(0);
@@ -41,9 +54,13 @@ ServerAllWorldsState::ServerAllWorldsState()
 
 	server_admin_message_changed = false;
 
-	read_only_mode = false;
+	read_only_mode = 0;
 
 	force_dyn_tex_update = false;
+
+	broadcast_needed_time = -1;
+
+	lock_stats_start_time = Clock::getCurTimeRealSec();
 }
 
 
@@ -54,7 +71,7 @@ ServerAllWorldsState::~ServerAllWorldsState()
 
 Reference<ServerWorldState> ServerAllWorldsState::getRootWorldState() // Guaranteed to return a non-null reference
 {
-	Lock lock(mutex);
+	InstrumentedLock lock(mutex);
 
 	return world_states[""]; 
 }
@@ -64,9 +81,11 @@ void ServerAllWorldsState::createNewDatabase(const std::string& path)
 {
 	conPrint("Creating new world state database at '" + path + "'...");
 
-	Lock lock(mutex);
+	InstrumentedLock lock(mutex);
+	Lock db_lock(database_mutex);
 
 	database.openAndMakeOrClearDatabase(path);
+	database_path = path;
 }
 
 
@@ -94,15 +113,129 @@ static const uint32 MAP_TILE_INFO_VERSION = 1;
 static const uint32 ETH_INFO_CHUNK_VERSION = 1;
 
 
+namespace
+{
+
+// A database record of one of the more numerous types, which are decoded in parallel.
+struct RecordToDecode
+{
+	DatabaseKey database_key;
+	const uint8* data; // Including the chunk type.
+	size_t len;
+};
+
+
+// The records decoded by a DecodeRecordsTask, in the order they were in the database.
+struct DecodedRecords
+{
+	std::vector<std::pair<std::string, WorldObjectRef>> objects; // (world name, object) pairs
+	std::vector<std::pair<std::string, ParcelRef>> parcels; // (world name, parcel) pairs
+	std::vector<UserRef> users;
+	std::vector<ResourceRef> resources;
+	std::string error_msg; // Set if an exception was thrown while decoding.
+};
+
+
+// Decodes records [begin, end) into results.  Doesn't touch any shared state, so many of these can run at once.
+class DecodeRecordsTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		try
+		{
+			for(size_t i=begin; i<end; ++i)
+			{
+				const RecordToDecode& record = (*records)[i];
+				BufferViewInStream stream(ArrayRef<uint8>(record.data, record.len));
+
+				const uint32 chunk = stream.readUInt32();
+				if(chunk == WORLD_OBJECT_CHUNK)
+				{
+					const std::string world_name = stream.readStringLengthFirst(10000);
+
+					// Deserialise object
+					WorldObjectRef world_ob = new WorldObject();
+					readWorldObjectFromStream(stream, *world_ob);
+
+					//TEMP HACK: clear lightmap needed flag
+					BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
+
+					// Objects from old serialisation versions have decompressed voxels.  Compress them, the server only uses compressed voxels, and decompresses them when needed.
+					if(!world_ob->getDecompressedVoxels().empty() && world_ob->getCompressedVoxels().empty())
+						world_ob->compressVoxels();
+					world_ob->clearDecompressedVoxels();
+
+					world_ob->database_key = record.database_key;
+					results->objects.push_back(std::make_pair(world_name, world_ob));
+				}
+				else if(chunk == USER_CHUNK)
+				{
+					// Deserialise user
+					UserRef user = new User();
+					readUserFromStream(stream, *user);
+
+					user->database_key = record.database_key;
+					results->users.push_back(user);
+				}
+				else if(chunk == PARCEL_CHUNK)
+				{
+					const std::string world_name = stream.readStringLengthFirst(10000);
+
+					// Deserialise parcel
+					ParcelRef parcel = new Parcel();
+					readFromStream(stream, *parcel);
+
+					parcel->database_key = record.database_key;
+					results->parcels.push_back(std::make_pair(world_name, parcel));
+				}
+				else if(chunk == RESOURCE_CHUNK)
+				{
+					// Deserialise resource
+					ResourceRef resource = new Resource();
+					const uint32 res_version = readFromStream(stream, *resource);
+
+					// Resource serialisation version 3 added serialisation of resource state.  If we are reading a resource before that, just assume it is present on disk,
+					// which is what addResource() used to do.
+					if(res_version < 3)
+						resource->setState(Resource::State_Present);
+
+					resource->database_key = record.database_key;
+					results->resources.push_back(resource);
+				}
+				else
+				{
+					assert(0);
+				}
+			}
+		}
+		catch(glare::Exception& e)
+		{
+			results->error_msg = e.what();
+		}
+	}
+
+	const std::vector<RecordToDecode>* records;
+	size_t begin, end;
+	DecodedRecords* results;
+};
+
+} // end anonymous namespace
+
+
 void ServerAllWorldsState::readFromDisk(const std::string& path)
 {
 	conPrint("Reading world state from '" + path + "'...");
 
-	Lock lock(mutex);
+	InstrumentedLock lock(mutex);
+	Lock db_lock(database_mutex);
+
+	database_path = path;
 
 	Timer timer;
 
 	size_t num_obs = 0;
+	size_t num_users = 0;
 	size_t num_parcels = 0;
 	size_t num_orders = 0;
 	size_t num_sessions = 0;
@@ -112,6 +245,9 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 	size_t num_tiles_read = 0;
 	size_t num_world_settings = 0;
 
+	// The per-world and table locks are taken as needed below.  database_mutex is held throughout, which is out of the usual lock order,
+	// but this is only called at startup, before any other threads access the world state.
+
 	bool is_pre_database_format = false;
 	{
 		FileInStream stream(path);
@@ -126,6 +262,11 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 		// Using database
 		database.startReadingFromDisk(path);
 
+		// Objects, users, parcels and resources make up most of the records, so are decoded in parallel below.
+		// Other records are decoded as we go.
+		std::vector<RecordToDecode> records_to_decode;
+		records_to_decode.reserve(database.getRecordMap().size());
+
 		for(auto it = database.getRecordMap().begin(); it != database.getRecordMap().end(); ++it)
 		{
 			const DatabaseKey database_key = it->first;
@@ -141,54 +282,13 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				{
 					// Not doing anything wtih this chunk.  Instead the world name is saved with each object and parcel.
 				}
-				else if(chunk == WORLD_OBJECT_CHUNK)
-				{
-					// Read world name
-					/*const*/ std::string world_name = stream.readStringLengthFirst(10000);
-
-					// Create ServerWorldState for world name if needed
-					if(world_states.count(world_name) == 0) 
-						world_states[world_name] = new ServerWorldState();
-
-					// Deserialise object
-					WorldObjectRef world_ob = new WorldObject();
-					readWorldObjectFromStream(stream, *world_ob);
-
-					//TEMP HACK: clear lightmap needed flag
-					BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
-
-					world_ob->database_key = database_key;
-					world_states[world_name]->objects[world_ob->uid] = world_ob; // Add to object map
-					num_obs++;
-
-					next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
-				}
-				else if(chunk == USER_CHUNK)
+				else if(chunk == WORLD_OBJECT_CHUNK || chunk == USER_CHUNK || chunk == PARCEL_CHUNK || chunk == RESOURCE_CHUNK)
 				{
-					// Deserialise user
-					UserRef user = new User();
-					readUserFromStream(stream, *user);
-
-					user->database_key = database_key;
-					user_id_to_users[user->id] = user; // Add to user map
-					name_to_users[user->name] = user; // Add to user map
-				}
-				else if(chunk == PARCEL_CHUNK)
-				{
-					// Read world name
-					const std::string world_name = stream.readStringLengthFirst(10000);
-
-					// Create ServerWorldState for world name if needed
-					if(world_states.count(world_name) == 0) 
-						world_states[world_name] = new ServerWorldState();
-
-					// Deserialise parcel
-					ParcelRef parcel = new Parcel();
-					readFromStream(stream, *parcel);
-
-					parcel->database_key = database_key;
-					world_states[world_name]->parcels[parcel->id] = parcel; // Add to parcel map
-					num_parcels++;
+					RecordToDecode to_decode;
+					to_decode.database_key = database_key;
+					to_decode.data = database.getInitialRecordData(record);
+					to_decode.len = record.len;
+					records_to_decode.push_back(to_decode);
 				}
 				else if(chunk == WORLD_SETTINGS_CHUNK)
 				{
@@ -199,36 +299,23 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					if(world_states.count(world_name) == 0) 
 						world_states[world_name] = new ServerWorldState();
 
+					ServerWorldState* world = world_states[world_name].ptr();
+					InstrumentedLock world_lock(world->mutex);
+
 					// NOTE: There was a bug with multiple world settings for the same world getting saved to the database.  Resolve ambiguity of which one to use by choosing the setting with the largest database key value.
 					// Use these new settings iff the existing settings are either uninitialised (in which case database_key will be invalid), or the settings we are reading from the DB have a greater key 
 					// value than the existing settings.
-					const bool use_settings = !world_states[world_name]->world_settings.database_key.valid() || (database_key.value() > world_states[world_name]->world_settings.database_key.value());
+					const bool use_settings = !world->world_settings.database_key.valid() || (database_key.value() > world->world_settings.database_key.value());
 					if(use_settings)
 					{	
 						// Deserialise world settings
-						readWorldSettingsFromStream(stream, world_states[world_name]->world_settings);
+						readWorldSettingsFromStream(stream, world->world_settings);
 
-						world_states[world_name]->world_settings.database_key = database_key;
+						world->world_settings.database_key = database_key;
 					}
 
 					num_world_settings++;
 				}
-				else if(chunk == RESOURCE_CHUNK)
-				{
-					// Deserialise resource
-					ResourceRef resource = new Resource();
-					const uint32 res_version = readFromStream(stream, *resource);
-					
-					// Resource serialisation version 3 added serialisation of resource state.  If we are reading a resource before that, just assume it is present on disk,
-					// which is what addResource() below used to do.
-					if(res_version < 3)
-						resource->setState(Resource::State_Present);
-
-					//conPrint("Loaded resource:\n  URL: '" + resource->URL + "'\n  local_path: '" + resource->getLocalPath() + "'\n  owner_id: " + resource->owner_id.toString());
-
-					resource->database_key = database_key;
-					this->resource_manager->addResource(resource);
-				}
 				else if(chunk == ORDER_CHUNK)
 				{
 					// Deserialise order
@@ -236,9 +323,14 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					readFromStream(stream, *order);
 
 					order->database_key = database_key;
-					orders[order->id] = order; // Add to order map
-
-					next_order_uid = myMax(order->id + 1, next_order_uid);
+					{
+						InstrumentedLock orders_lock(orders_mutex);
+						orders[order->id] = order; // Add to order map
+					}
+					{
+						Lock uid_lock(uid_mutex);
+						next_order_uid = myMax(order->id + 1, next_order_uid);
+					}
 					num_orders++;
 				}
 				else if(chunk == USER_WEB_SESSION_CHUNK)
@@ -248,7 +340,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					readFromStream(stream, *session);
 
 					session->database_key = database_key;
-					user_web_sessions[session->id] = session; // Add to session map
+					{
+						InstrumentedLock sessions_lock(sessions_mutex);
+						user_web_sessions[session->id] = session; // Add to session map
+					}
 					num_sessions++;
 				}
 				else if(chunk == PARCEL_AUCTION_CHUNK)
@@ -277,7 +372,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					SubEthTransactionRef trans = new SubEthTransaction();
 					readFromStream(stream, *trans);
 
-					next_sub_eth_transaction_uid = myMax(trans->id + 1, next_sub_eth_transaction_uid);
+					{
+						Lock uid_lock(uid_mutex);
+						next_sub_eth_transaction_uid = myMax(trans->id + 1, next_sub_eth_transaction_uid);
+					}
 
 					trans->database_key = database_key;
 					sub_eth_transactions[trans->id] = trans;
@@ -349,6 +447,90 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 		}
 
 
+		// Decode objects, users, parcels and resources in parallel.  Each task decodes a contiguous range of records into its own DecodedRecords.
+		{
+			Timer decode_timer;
+
+			const size_t MIN_RECORDS_PER_TASK = 256;
+			const size_t max_num_tasks = myMax<size_t>(1, PlatformUtils::getNumLogicalProcessors() * 4);
+			const size_t records_per_task = myMax(MIN_RECORDS_PER_TASK, Maths::roundedUpDivide(records_to_decode.size(), max_num_tasks));
+			const size_t num_tasks = Maths::roundedUpDivide(records_to_decode.size(), records_per_task);
+
+			std::vector<DecodedRecords> decoded(num_tasks);
+			{
+				glare::TaskManager task_manager("readFromDisk task manager");
+				for(size_t i=0; i<num_tasks; ++i)
+				{
+					Reference<DecodeRecordsTask> task = new DecodeRecordsTask();
+					task->records = &records_to_decode;
+					task->begin = i * records_per_task;
+					task->end = myMin(records_to_decode.size(), (i + 1) * records_per_task);
+					task->results = &decoded[i];
+					task_manager.addTask(task);
+				}
+				task_manager.waitForTasksToComplete();
+			}
+
+			// Merge the decoded records into the world state, in database order, so the result is the same as decoding them serially.
+			for(size_t i=0; i<num_tasks; ++i)
+			{
+				const DecodedRecords& results = decoded[i];
+				if(!results.error_msg.empty())
+					throw glare::Exception(results.error_msg);
+
+				for(size_t z=0; z<results.objects.size(); ++z)
+				{
+					const std::string& world_name = results.objects[z].first;
+					const WorldObjectRef& world_ob = results.objects[z].second;
+
+					// Create ServerWorldState for world name if needed
+					if(world_states.count(world_name) == 0) 
+						world_states[world_name] = new ServerWorldState();
+
+					{
+						ServerWorldState* world = world_states[world_name].ptr();
+						InstrumentedLock world_lock(world->mutex);
+						world->objects[world_ob->uid] = world_ob; // Add to object map
+					}
+					num_obs++;
+
+					Lock uid_lock(uid_mutex);
+					next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
+				}
+
+				{
+					InstrumentedLock users_lock(users_mutex);
+					for(size_t z=0; z<results.users.size(); ++z)
+					{
+						const UserRef& user = results.users[z];
+						user_id_to_users[user->id] = user; // Add to user map
+						name_to_users[user->name] = user; // Add to user map
+					}
+					num_users = user_id_to_users.size();
+				}
+
+				for(size_t z=0; z<results.parcels.size(); ++z)
+				{
+					const std::string& world_name = results.parcels[z].first;
+					const ParcelRef& parcel = results.parcels[z].second;
+
+					// Create ServerWorldState for world name if needed
+					if(world_states.count(world_name) == 0) 
+						world_states[world_name] = new ServerWorldState();
+
+					ServerWorldState* world = world_states[world_name].ptr();
+					InstrumentedLock world_lock(world->mutex);
+					world->parcels[parcel->id] = parcel; // Add to parcel map
+					num_parcels++;
+				}
+
+				for(size_t z=0; z<results.resources.size(); ++z)
+					this->resource_manager->addResource(results.resources[z]);
+			}
+
+			conPrint("Decoded " + toString(records_to_decode.size()) + " record(s) with " + toString(num_tasks) + " task(s) in " + decode_timer.elapsedStringNSigFigs(4));
+		}
+
 		database.finishReadingFromDisk();
 	}
 	else // Else if is_pre_database:
@@ -388,9 +570,13 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				//TEMP HACK: clear lightmap needed flag
 				BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
 
-				current_world->objects[world_ob->uid] = world_ob; // Add to object map
+				{
+					InstrumentedLock world_lock(current_world->mutex);
+					current_world->objects[world_ob->uid] = world_ob; // Add to object map
+				}
 				num_obs++;
 
+				Lock uid_lock(uid_mutex);
 				next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
 			}
 			else if(chunk == USER_CHUNK)
@@ -399,8 +585,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				UserRef user = new User();
 				readUserFromStream(stream, *user);
 
+				InstrumentedLock users_lock(users_mutex);
 				user_id_to_users[user->id] = user; // Add to user map
 				name_to_users[user->name] = user; // Add to user map
+				num_users = user_id_to_users.size();
 			}
 			else if(chunk == PARCEL_CHUNK)
 			{
@@ -408,6 +596,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				ParcelRef parcel = new Parcel();
 				readFromStream(stream, *parcel);
 
+				InstrumentedLock world_lock(current_world->mutex);
 				current_world->parcels[parcel->id] = parcel; // Add to parcel map
 				num_parcels++;
 			}
@@ -427,9 +616,14 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				OrderRef order = new Order();
 				readFromStream(stream, *order);
 
-				orders[order->id] = order; // Add to order map
-
-				next_order_uid = myMax(order->id + 1, next_order_uid);
+				{
+					InstrumentedLock orders_lock(orders_mutex);
+					orders[order->id] = order; // Add to order map
+				}
+				{
+					Lock uid_lock(uid_mutex);
+					next_order_uid = myMax(order->id + 1, next_order_uid);
+				}
 				num_orders++;
 			}
 			else if(chunk == USER_WEB_SESSION_CHUNK)
@@ -438,7 +632,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				UserWebSessionRef session = new UserWebSession();
 				readFromStream(stream, *session);
 
-				user_web_sessions[session->id] = session; // Add to session map
+				{
+					InstrumentedLock sessions_lock(sessions_mutex);
+					user_web_sessions[session->id] = session; // Add to session map
+				}
 				num_sessions++;
 			}
 			else if(chunk == PARCEL_AUCTION_CHUNK)
@@ -465,7 +662,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				SubEthTransactionRef trans = new SubEthTransaction();
 				readFromStream(stream, *trans);
 
-				next_sub_eth_transaction_uid = myMax(trans->id + 1, next_sub_eth_transaction_uid);
+				{
+					Lock uid_lock(uid_mutex);
+					next_sub_eth_transaction_uid = myMax(trans->id + 1, next_sub_eth_transaction_uid);
+				}
 
 				sub_eth_transactions[trans->id] = trans;
 				num_sub_eth_transactions++;
@@ -542,23 +742,8 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 	denormaliseData();
 
-	// Compress voxel data if needed.
-	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
-	{
-		Reference<ServerWorldState> world_state = world_it->second;
-		for(auto it = world_state->objects.begin(); it != world_state->objects.end(); ++it)
-		{
-			/*WorldObject* ob = it->second.ptr();
-			if(!ob->voxel_group.voxels.empty() && ob->compressed_voxels.empty())
-			{
-				WorldObject::compressVoxelGroup(ob->voxel_group, ob->compressed_voxels);
-			}*/
-			//ob->compressVoxels();
-		}
-	}
-
 	//conPrint("min_next_nonce: " + toString(eth_info.min_next_nonce));
-	conPrint("Loaded " + toString(num_obs) + " object(s), " + toString(user_id_to_users.size()) + " user(s), " +
+	conPrint("Loaded " + toString(num_obs) + " object(s), " + toString(num_users) + " user(s), " +
 		toString(num_parcels) + " parcel(s), " + toString(resource_manager->getResourcesForURL().size()) + " resource(s), " + toString(num_orders) + " order(s), " + 
 		toString(num_sessions) + " session(s), " + toString(num_auctions) + " auction(s), " + toString(num_screenshots) + " screenshot(s), " + 
 		toString(num_sub_eth_transactions) + " sub eth transaction(s), " + toString(num_tiles_read) + " tiles, " + toString(num_world_settings) + " world settings in " + timer.elapsedStringNSigFigs(4));
@@ -567,20 +752,12 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 void ServerAllWorldsState::addEverythingToDirtySets()
 {
-	Lock lock(mutex);
-
-	for(auto it = resource_manager->getResourcesForURL().begin(); it != resource_manager->getResourcesForURL().end(); ++it)
-		db_dirty_resources.insert(it->second);
-
-	for(auto it = user_id_to_users.begin(); it != user_id_to_users.end(); ++it)
-		db_dirty_users.insert(it->second);
-
-	for(auto it = orders.begin(); it != orders.end(); ++it)
-		db_dirty_orders.insert(it->second);
+	InstrumentedLock lock(mutex);
 
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
+		InstrumentedLock world_lock(world_state->mutex);
 
 		for(auto it = world_state->objects.begin(); it != world_state->objects.end(); ++it)
 			world_state->db_dirty_world_objects.insert(it->second);
@@ -589,8 +766,29 @@ void ServerAllWorldsState::addEverythingToDirtySets()
 			world_state->db_dirty_parcels.insert(it->second);
 	}
 
-	for(auto it = user_web_sessions.begin(); it != user_web_sessions.end(); ++it)
-		db_dirty_userwebsessions.insert(it->second);
+	{
+		InstrumentedLock users_lock(users_mutex);
+		for(auto it = user_id_to_users.begin(); it != user_id_to_users.end(); ++it)
+			db_dirty_users.insert(it->second);
+	}
+
+	{
+		InstrumentedLock sessions_lock(sessions_mutex);
+		for(auto it = user_web_sessions.begin(); it != user_web_sessions.end(); ++it)
+			db_dirty_userwebsessions.insert(it->second);
+	}
+
+	{
+		InstrumentedLock orders_lock(orders_mutex);
+		for(auto it = orders.begin(); it != orders.end(); ++it)
+			db_dirty_orders.insert(it->second);
+	}
+
+	{
+		InstrumentedLock resources_lock(resources_mutex);
+		for(auto it = resource_manager->getResourcesForURL().begin(); it != resource_manager->getResourcesForURL().end(); ++it)
+			db_dirty_resources.insert(it->second);
+	}
 
 	for(auto it = parcel_auctions.begin(); it != parcel_auctions.end(); ++it)
 		db_dirty_parcel_auctions.insert(it->second);
@@ -609,28 +807,82 @@ void ServerAllWorldsState::addEverythingToDirtySets()
 }
 
 
-bool ServerAllWorldsState::isInReadOnlyMode()
-{ 
-	Lock lock(mutex); 
-	return read_only_mode; 
+void ServerAllWorldsState::notifyBroadcastNeeded()
+{
+	Lock lock(broadcast_needed_mutex);
+	if(broadcast_needed_time < 0) // If this is the first notification since the main loop last took the broadcast-needed time:
+	{
+		broadcast_needed_time = Clock::getCurTimeRealSec();
+		broadcast_needed_condition.notify();
+	}
+}
+
+
+void ServerAllWorldsState::waitForBroadcastNeeded(double max_wait_time_s)
+{
+	Lock lock(broadcast_needed_mutex);
+	if(broadcast_needed_time < 0)
+		broadcast_needed_condition.waitWithTimeout(broadcast_needed_mutex, max_wait_time_s); // May return early due to a spurious wakeup, which is fine.
+}
+
+
+double ServerAllWorldsState::takeBroadcastNeededTime()
+{
+	Lock lock(broadcast_needed_mutex);
+	const double t = broadcast_needed_time;
+	broadcast_needed_time = -1;
+	return t;
+}
+
+
+void ServerAllWorldsState::addDatabaseRecordToDelete(const DatabaseKey& key)
+{
+	Lock lock(db_records_to_delete_mutex);
+	db_records_to_delete.insert(key);
 }
 
 
 void ServerAllWorldsState::clearAndReset() // Just for fuzzing
 {
-	Lock lock(mutex);
+	Lock lock(uid_mutex);
 	next_object_uid = UID(0);
 	next_avatar_uid = UID(0);
 }
 
 
+void ServerAllWorldsState::rebuildObjectURLIndex()
+{
+	{
+		InstrumentedLock resources_lock(resources_mutex);
+		object_URL_index.clear();
+	}
+
+	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
+	{
+		ServerWorldState* world = world_it->second.ptr();
+		InstrumentedLock world_lock(world->mutex);
+		InstrumentedLock resources_lock(resources_mutex);
+		for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
+			object_URL_index.updateObject(it->second.ptr());
+	}
+}
+
+
 void ServerAllWorldsState::denormaliseData()
 {
-	Lock lock(mutex);
+	InstrumentedLock lock(mutex);
+
+	// Build the reverse index from resource URLs to objects
+	rebuildObjectURLIndex();
 
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
+		InstrumentedLock world_lock(world_state->mutex);
+		InstrumentedLock users_lock(users_mutex);
+
+		// Build the spatial index over objects
+		world_state->rebuildObjectGrid();
 
 		// Build cached fields like WorldObject::creator_name
 		for(auto i=world_state->objects.begin(); i != world_state->objects.end(); ++i)
@@ -685,7 +937,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 {
 	conPrint("Saving sanitised world state to disk...");
 
-	Lock lock(mutex);
+	InstrumentedLock lock(mutex);
 
 	try
 	{
@@ -695,6 +947,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 		for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			InstrumentedLock world_lock(world_state->mutex);
 
 			// Sanitise parcels
 			for(auto it = world_state->parcels.begin(); it != world_state->parcels.end(); ++it)
@@ -709,6 +962,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 
 		// Sanitise users
 		{
+			InstrumentedLock users_lock(users_mutex);
 			int i = 0;
 			for(auto it=user_id_to_users.begin(); it != user_id_to_users.end(); ++it)
 			{
@@ -738,6 +992,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 
 		// Sanitise orders
 		{
+			InstrumentedLock orders_lock(orders_mutex);
 			for(auto i=orders.begin(); i != orders.end(); ++i)
 			{
 				Order* order = i->second.ptr();
@@ -754,12 +1009,13 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 
 		// Delete all UserWebSessions
 		{
+			InstrumentedLock sessions_lock(sessions_mutex);
 			for(auto i=user_web_sessions.begin(); i != user_web_sessions.end(); ++i)
 			{
 				UserWebSession* session = i->second.ptr();
 				assert(session->database_key.valid());
 				
-				db_records_to_delete.insert(session->database_key);
+				addDatabaseRecordToDelete(session->database_key);
 			}
 		}
 
@@ -770,7 +1026,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 				ParcelAuction* auction = i->second.ptr();
 				assert(auction->database_key.valid());
 
-				db_records_to_delete.insert(auction->database_key);
+				addDatabaseRecordToDelete(auction->database_key);
 			}
 		}
 
@@ -789,7 +1045,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 				SubEthTransaction* trans = i->second.ptr();
 				assert(trans->database_key.valid());
 
-				db_records_to_delete.insert(trans->database_key);
+				addDatabaseRecordToDelete(trans->database_key);
 			}
 		}
 
@@ -809,323 +1065,399 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 }
 
 
-// Write any changed data (objects in dirty set) to disk.  Mutex should be held already.
-void ServerAllWorldsState::serialiseToDisk()
+// Copies the changed data (objects in dirty sets) into a new snapshot, and clears the dirty sets.  Mutex should be held already.
+// Locks each world mutex and table mutex in turn, so each is only held while copying its own dirty set.
+// Allocates database keys for any new records, so that later deletions of those records use the right keys.
+Reference<DatabaseSnapshot> ServerAllWorldsState::makeDatabaseSnapshot()
 {
-	conPrint("Saving world state to disk...");
-
 	Timer timer;
 
-	try
+	Reference<DatabaseSnapshot> snapshot = new DatabaseSnapshot();
+
+	// Number of various type of objects that were dirty and saved.
+	size_t num_obs = 0;
+	size_t num_parcels = 0;
+	size_t num_orders = 0;
+	size_t num_sessions = 0;
+	size_t num_auctions = 0;
+	size_t num_screenshots = 0;
+	size_t num_sub_eth_transactions = 0;
+	size_t num_tiles_written = 0;
+	size_t num_users = 0;
+	size_t num_resources = 0;
+	size_t num_world_settings = 0;
+
+	// First, delete any records in db_records_to_delete.  (This has the keys of deleted objects etc..)
+	// These are taken before the dirty sets, so a record deleted after this point is deleted in a later snapshot, after any update to it in this one.
 	{
-		// Number of various type of objects that were dirty and saved.
-		size_t num_obs = 0;
-		size_t num_parcels = 0;
-		size_t num_orders = 0;
-		size_t num_sessions = 0;
-		size_t num_auctions = 0;
-		size_t num_screenshots = 0;
-		size_t num_sub_eth_transactions = 0;
-		size_t num_tiles_written = 0;
-		size_t num_users = 0;
-		size_t num_resources = 0;
-		size_t num_world_settings = 0;
-
-		// First, delete any records in db_records_to_delete.  (This has the keys of deleted objects etc..)
-		for(auto it = db_records_to_delete.begin(); it != db_records_to_delete.end(); ++it)
-		{
-			const DatabaseKey key = *it;
-			database.deleteRecord(key);
-		}
+		Lock deletions_lock(db_records_to_delete_mutex);
+		snapshot->records_to_delete.assign(db_records_to_delete.begin(), db_records_to_delete.end());
 		db_records_to_delete.clear();
+	}
 
-		
-		BufferOutStream temp_buf;
+	// Iterate over all objects, if they are dirty, write to the DB
 
-		// Iterate over all objects, if they are dirty, write to the DB
+	// For each world
+	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
+	{
+		const std::string world_name = world_it->first;
+		Reference<ServerWorldState> world_state = world_it->second;
+		InstrumentedLock world_lock(world_state->mutex);
 
-		// For each world
-		for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
+		// Write objects
 		{
-			const std::string world_name = world_it->first;
-			Reference<ServerWorldState> world_state = world_it->second;
-
-			// Write objects
+			for(auto it = world_state->db_dirty_world_objects.begin(); it != world_state->db_dirty_world_objects.end(); ++it)
 			{
-				for(auto it = world_state->db_dirty_world_objects.begin(); it != world_state->db_dirty_world_objects.end(); ++it)
-				{
-					WorldObject* ob = it->ptr();
-					temp_buf.clear();
-					temp_buf.writeUInt32(WORLD_OBJECT_CHUNK);
-					temp_buf.writeStringLengthFirst(world_name); // Write world name
-					ob->writeToStream(temp_buf); // Write object
+				WorldObject* ob = it->ptr();
+				const size_t record_offset = snapshot->data.buf.size();
+				snapshot->data.writeUInt32(WORLD_OBJECT_CHUNK);
+				snapshot->data.writeStringLengthFirst(world_name); // Write world name
+				ob->writeToStream(snapshot->data); // Write object
 
-					if(!ob->database_key.valid())
-						ob->database_key = database.allocUnusedKey(); // Get a new key
+				if(!ob->database_key.valid())
+					ob->database_key = allocDatabaseKey(); // Get a new key
 
-					database.updateRecord(ob->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				snapshot->addRecordUpdate(ob->database_key, record_offset);
 
-					num_obs++;
-				}
-
-				world_state->db_dirty_world_objects.clear();
+				num_obs++;
 			}
 
-			// Write parcels
-			{
-				for(auto it = world_state->db_dirty_parcels.begin(); it != world_state->db_dirty_parcels.end(); ++it)
-				{
-					Parcel* parcel = it->ptr();
-					temp_buf.clear();
-					temp_buf.writeUInt32(PARCEL_CHUNK);
-					temp_buf.writeStringLengthFirst(world_name); // Write world name
-					writeToStream(*parcel, temp_buf); // Write parcel
+			world_state->db_dirty_world_objects.clear();
+		}
 
-					if(!parcel->database_key.valid())
-						parcel->database_key = database.allocUnusedKey(); // Get a new key
+		// Write parcels
+		{
+			for(auto it = world_state->db_dirty_parcels.begin(); it != world_state->db_dirty_parcels.end(); ++it)
+			{
+				Parcel* parcel = it->ptr();
+				const size_t record_offset = snapshot->data.buf.size();
+				snapshot->data.writeUInt32(PARCEL_CHUNK);
+				snapshot->data.writeStringLengthFirst(world_name); // Write world name
+				writeToStream(*parcel, snapshot->data); // Write parcel
 
-					database.updateRecord(parcel->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				if(!parcel->database_key.valid())
+					parcel->database_key = allocDatabaseKey(); // Get a new key
 
-					num_parcels++;
-				}
+				snapshot->addRecordUpdate(parcel->database_key, record_offset);
 
-				world_state->db_dirty_parcels.clear();
+				num_parcels++;
 			}
 
-			// Save the world settings if dirty
-			if(world_state->world_settings.db_dirty)
-			{
-				temp_buf.clear();
-				temp_buf.writeUInt32(WORLD_SETTINGS_CHUNK);
-				temp_buf.writeStringLengthFirst(world_name); // Write world name
-				world_state->world_settings.writeToStream(temp_buf); // Write world settings to temp_buf
+			world_state->db_dirty_parcels.clear();
+		}
 
-				if(!world_state->world_settings.database_key.valid())
-					world_state->world_settings.database_key = database.allocUnusedKey(); // Get a new key
+		// Save the world settings if dirty
+		if(world_state->world_settings.db_dirty)
+		{
+			const size_t record_offset = snapshot->data.buf.size();
+			snapshot->data.writeUInt32(WORLD_SETTINGS_CHUNK);
+			snapshot->data.writeStringLengthFirst(world_name); // Write world name
+			world_state->world_settings.writeToStream(snapshot->data); // Write world settings
 
-				database.updateRecord(world_state->world_settings.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			if(!world_state->world_settings.database_key.valid())
+				world_state->world_settings.database_key = allocDatabaseKey(); // Get a new key
 
-				world_state->world_settings.db_dirty = false;
+			snapshot->addRecordUpdate(world_state->world_settings.database_key, record_offset);
 
-				num_world_settings++;
-			}
+			world_state->world_settings.db_dirty = false;
+
+			num_world_settings++;
 		}
+	}
 
-		// Write users
+	// Write users
+	{
+		InstrumentedLock users_lock(users_mutex);
+		for(auto it=db_dirty_users.begin(); it != db_dirty_users.end(); ++it)
 		{
-			for(auto it=db_dirty_users.begin(); it != db_dirty_users.end(); ++it)
-			{
-				User* user = it->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(USER_CHUNK);
-				writeUserToStream(*user, temp_buf);
-
-				if(!user->database_key.valid())
-					user->database_key = database.allocUnusedKey(); // Get a new key
+			User* user = it->ptr();
+			const size_t record_offset = snapshot->data.buf.size();
+			snapshot->data.writeUInt32(USER_CHUNK);
+			writeUserToStream(*user, snapshot->data);
 
-				database.updateRecord(user->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			if(!user->database_key.valid())
+				user->database_key = allocDatabaseKey(); // Get a new key
 
-				num_users++;
-			}
+			snapshot->addRecordUpdate(user->database_key, record_offset);
 
-			db_dirty_users.clear();
+			num_users++;
 		}
 
-		// Write resource objects
+		db_dirty_users.clear();
+	}
+
+	// Write resource objects
+	{
+		InstrumentedLock resources_lock(resources_mutex);
+		for(auto i=db_dirty_resources.begin(); i != db_dirty_resources.end(); ++i)
 		{
-			for(auto i=db_dirty_resources.begin(); i != db_dirty_resources.end(); ++i)
-			{
-				Resource* resource = i->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(RESOURCE_CHUNK);
-				resource->writeToStream(temp_buf);
+			Resource* resource = i->ptr();
+			const size_t record_offset = snapshot->data.buf.size();
+			snapshot->data.writeUInt32(RESOURCE_CHUNK);
+			resource->writeToStream(snapshot->data);
 
-				if(!resource->database_key.valid())
-					resource->database_key = database.allocUnusedKey(); // Get a new key
+			if(!resource->database_key.valid())
+				resource->database_key = allocDatabaseKey(); // Get a new key
 
-				database.updateRecord(resource->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			snapshot->addRecordUpdate(resource->database_key, record_offset);
 
-				num_resources++;
-			}
+			if(resource->getState() == Resource::State_Present)
+				snapshot->present_resources.push_back(DatabaseSnapshot::PresentResource({resource->URL, resource->getRawLocalPath()}));
 
-			db_dirty_resources.clear();
+			num_resources++;
 		}
 
-		// Write orders
-		{
-			for(auto i=db_dirty_orders.begin(); i != db_dirty_orders.end(); ++i)
-			{
-				Order* order = i->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(ORDER_CHUNK);
-				writeToStream(*order, temp_buf);
+		db_dirty_resources.clear();
+	}
 
-				if(!order->database_key.valid())
-					order->database_key = database.allocUnusedKey(); // Get a new key
+	// Write orders
+	{
+		InstrumentedLock orders_lock(orders_mutex);
+		for(auto i=db_dirty_orders.begin(); i != db_dirty_orders.end(); ++i)
+		{
+			Order* order = i->ptr();
+			const size_t record_offset = snapshot->data.buf.size();
+			snapshot->data.writeUInt32(ORDER_CHUNK);
+			writeToStream(*order, snapshot->data);
 
-				database.updateRecord(order->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			if(!order->database_key.valid())
+				order->database_key = allocDatabaseKey(); // Get a new key
 
-				num_orders++;
-			}
+			snapshot->addRecordUpdate(order->database_key, record_offset);
 
-			db_dirty_orders.clear();
+			num_orders++;
 		}
 
-		// Write UserWebSessions
-		{
-			for(auto i=db_dirty_userwebsessions.begin(); i != db_dirty_userwebsessions.end(); ++i)
-			{
-				UserWebSession* session = i->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(USER_WEB_SESSION_CHUNK);
-				writeToStream(*session, temp_buf);
+		db_dirty_orders.clear();
+	}
 
-				if(!session->database_key.valid())
-					session->database_key = database.allocUnusedKey(); // Get a new key
+	// Write UserWebSessions
+	{
+		InstrumentedLock sessions_lock(sessions_mutex);
+		for(auto i=db_dirty_userwebsessions.begin(); i != db_dirty_userwebsessions.end(); ++i)
+		{
+			UserWebSession* session = i->ptr();
+			const size_t record_offset = snapshot->data.buf.size();
+			snapshot->data.writeUInt32(USER_WEB_SESSION_CHUNK);
+			writeToStream(*session, snapshot->data);
 
-				database.updateRecord(session->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			if(!session->database_key.valid())
+				session->database_key = allocDatabaseKey(); // Get a new key
 
-				num_sessions++;
-			}
+			snapshot->addRecordUpdate(session->database_key, record_offset);
 
-			db_dirty_userwebsessions.clear();
+			num_sessions++;
 		}
 
-		// Write ParcelAuctions
-		{
-			for(auto i=db_dirty_parcel_auctions.begin(); i != db_dirty_parcel_auctions.end(); ++i)
-			{
-				ParcelAuction* auction = i->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(PARCEL_AUCTION_CHUNK);
-				writeToStream(*auction, temp_buf);
+		db_dirty_userwebsessions.clear();
+	}
 
-				if(!auction->database_key.valid())
-					auction->database_key = database.allocUnusedKey(); // Get a new key
+	// Write ParcelAuctions
+	{
+		for(auto i=db_dirty_parcel_auctions.begin(); i != db_dirty_parcel_auctions.end(); ++i)
+		{
+			ParcelAuction* auction = i->ptr();
+			const size_t record_offset = snapshot->data.buf.size();
+			snapshot->data.writeUInt32(PARCEL_AUCTION_CHUNK);
+			writeToStream(*auction, snapshot->data);
 
-				database.updateRecord(auction->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			if(!auction->database_key.valid())
+				auction->database_key = allocDatabaseKey(); // Get a new key
 
-				num_auctions++;
-			}
+			snapshot->addRecordUpdate(auction->database_key, record_offset);
 
-			db_dirty_parcel_auctions.clear();
+			num_auctions++;
 		}
 
-		// Write Screenshots
-		{
-			for(auto it=db_dirty_screenshots.begin(); it != db_dirty_screenshots.end(); ++it)
-			{
-				Screenshot* shot = it->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(SCREENSHOT_CHUNK);
-				writeScreenshotToStream(*shot, temp_buf);
+		db_dirty_parcel_auctions.clear();
+	}
 
-				if(!shot->database_key.valid())
-					shot->database_key = database.allocUnusedKey(); // Get a new key
+	// Write Screenshots
+	{
+		for(auto it=db_dirty_screenshots.begin(); it != db_dirty_screenshots.end(); ++it)
+		{
+			Screenshot* shot = it->ptr();
+			const size_t record_offset = snapshot->data.buf.size();
+			snapshot->data.writeUInt32(SCREENSHOT_CHUNK);
+			writeScreenshotToStream(*shot, snapshot->data);
 
-				database.updateRecord(shot->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			if(!shot->database_key.valid())
+				shot->database_key = allocDatabaseKey(); // Get a new key
 
-				num_screenshots++;
-			}
+			snapshot->addRecordUpdate(shot->database_key, record_offset);
 
-			db_dirty_screenshots.clear();
+			num_screenshots++;
 		}
 
-		// Write SubEthTransactions
-		{
-			for(auto i=db_dirty_sub_eth_transactions.begin(); i != db_dirty_sub_eth_transactions.end(); ++i)
-			{
-				SubEthTransaction* trans = i->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(SUB_ETH_TRANSACTIONS_CHUNK);
-				writeToStream(*trans, temp_buf);
+		db_dirty_screenshots.clear();
+	}
 
-				if(!trans->database_key.valid())
-					trans->database_key = database.allocUnusedKey(); // Get a new key
+	// Write SubEthTransactions
+	{
+		for(auto i=db_dirty_sub_eth_transactions.begin(); i != db_dirty_sub_eth_transactions.end(); ++i)
+		{
+			SubEthTransaction* trans = i->ptr();
+			const size_t record_offset = snapshot->data.buf.size();
+			snapshot->data.writeUInt32(SUB_ETH_TRANSACTIONS_CHUNK);
+			writeToStream(*trans, snapshot->data);
 
-				database.updateRecord(trans->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			if(!trans->database_key.valid())
+				trans->database_key = allocDatabaseKey(); // Get a new key
 
-				num_sub_eth_transactions++;
-			}
+			snapshot->addRecordUpdate(trans->database_key, record_offset);
 
-			db_dirty_sub_eth_transactions.clear();
+			num_sub_eth_transactions++;
 		}
 
-		// Write MAP_TILE_INFO_CHUNK
-		if(map_tile_info.db_dirty)
+		db_dirty_sub_eth_transactions.clear();
+	}
+
+	// Write MAP_TILE_INFO_CHUNK
+	if(map_tile_info.db_dirty)
+	{
+		const size_t record_offset = snapshot->data.buf.size();
+		snapshot->data.writeUInt32(MAP_TILE_INFO_CHUNK);
+		snapshot->data.writeUInt32(MAP_TILE_INFO_VERSION);
+		snapshot->data.writeInt32((int)map_tile_info.info.size());
+		for(auto it=map_tile_info.info.begin(); it != map_tile_info.info.end(); ++it)
 		{
-			temp_buf.clear();
-			temp_buf.writeUInt32(MAP_TILE_INFO_CHUNK);
-			temp_buf.writeUInt32(MAP_TILE_INFO_VERSION);
-			temp_buf.writeInt32((int)map_tile_info.info.size());
-			for(auto it=map_tile_info.info.begin(); it != map_tile_info.info.end(); ++it)
-			{
-				Vec3<int> v = it->first;
-				const TileInfo& tile_info = it->second;
+			Vec3<int> v = it->first;
+			const TileInfo& tile_info = it->second;
 
-				temp_buf.writeInt32(v.x);
-				temp_buf.writeInt32(v.y);
-				temp_buf.writeInt32(v.z);
+			snapshot->data.writeInt32(v.x);
+			snapshot->data.writeInt32(v.y);
+			snapshot->data.writeInt32(v.z);
 
-				temp_buf.writeInt32(tile_info.cur_tile_screenshot.nonNull() ? 1 : 0);
-				if(tile_info.cur_tile_screenshot.nonNull())
-					writeScreenshotToStream(*tile_info.cur_tile_screenshot, temp_buf);
+			snapshot->data.writeInt32(tile_info.cur_tile_screenshot.nonNull() ? 1 : 0);
+			if(tile_info.cur_tile_screenshot.nonNull())
+				writeScreenshotToStream(*tile_info.cur_tile_screenshot, snapshot->data);
 
-				temp_buf.writeInt32(tile_info.prev_tile_screenshot.nonNull() ? 1 : 0);
-				if(tile_info.prev_tile_screenshot.nonNull())
-					writeScreenshotToStream(*tile_info.prev_tile_screenshot, temp_buf);
-			}
+			snapshot->data.writeInt32(tile_info.prev_tile_screenshot.nonNull() ? 1 : 0);
+			if(tile_info.prev_tile_screenshot.nonNull())
+				writeScreenshotToStream(*tile_info.prev_tile_screenshot, snapshot->data);
+		}
 
-			if(!map_tile_info.database_key.valid())
-				map_tile_info.database_key = database.allocUnusedKey(); // Get a new key
+		if(!map_tile_info.database_key.valid())
+			map_tile_info.database_key = allocDatabaseKey(); // Get a new key
 
-			database.updateRecord(map_tile_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+		snapshot->addRecordUpdate(map_tile_info.database_key, record_offset);
 
-			map_tile_info.db_dirty = false;
+		map_tile_info.db_dirty = false;
 
-			num_tiles_written = map_tile_info.info.size();
-		}
+		num_tiles_written = map_tile_info.info.size();
+	}
 
-		// Write LAST_PARCEL_SALE_UPDATE_CHUNK
-		if(last_parcel_update_info.db_dirty)
-		{
-			temp_buf.clear();
-			temp_buf.writeUInt32(LAST_PARCEL_SALE_UPDATE_CHUNK);
-			temp_buf.writeUInt32(PARCEL_SALE_UPDATE_VERSION);
-			temp_buf.writeInt32(this->last_parcel_update_info.last_parcel_sale_update_hour);
-			temp_buf.writeInt32(this->last_parcel_update_info.last_parcel_sale_update_day);
-			temp_buf.writeInt32(this->last_parcel_update_info.last_parcel_sale_update_year);
+	// Write LAST_PARCEL_SALE_UPDATE_CHUNK
+	if(last_parcel_update_info.db_dirty)
+	{
+		const size_t record_offset = snapshot->data.buf.size();
+		snapshot->data.writeUInt32(LAST_PARCEL_SALE_UPDATE_CHUNK);
+		snapshot->data.writeUInt32(PARCEL_SALE_UPDATE_VERSION);
+		snapshot->data.writeInt32(this->last_parcel_update_info.last_parcel_sale_update_hour);
+		snapshot->data.writeInt32(this->last_parcel_update_info.last_parcel_sale_update_day);
+		snapshot->data.writeInt32(this->last_parcel_update_info.last_parcel_sale_update_year);
 
-			if(!last_parcel_update_info.database_key.valid())
-				last_parcel_update_info.database_key = database.allocUnusedKey(); // Get a new key
+		if(!last_parcel_update_info.database_key.valid())
+			last_parcel_update_info.database_key = allocDatabaseKey(); // Get a new key
 
-			database.updateRecord(last_parcel_update_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+		snapshot->addRecordUpdate(last_parcel_update_info.database_key, record_offset);
 
-			last_parcel_update_info.db_dirty = false;
-		}
+		last_parcel_update_info.db_dirty = false;
+	}
+
+	// Write ETH_INFO_CHUNK
+	if(eth_info.db_dirty)
+	{
+		const size_t record_offset = snapshot->data.buf.size();
+		snapshot->data.writeUInt32(ETH_INFO_CHUNK);
+		snapshot->data.writeUInt32(ETH_INFO_CHUNK_VERSION);
+		snapshot->data.writeInt32(this->eth_info.min_next_nonce);
+
+		if(!eth_info.database_key.valid())
+			eth_info.database_key = allocDatabaseKey(); // Get a new key
+
+		snapshot->addRecordUpdate(eth_info.database_key, record_offset);
+
+		eth_info.db_dirty = false;
+	}
 
-		// Write ETH_INFO_CHUNK
-		if(eth_info.db_dirty)
+	snapshot->summary = toString(num_obs) + " object(s), " + toString(num_users) + " user(s), " +
+		toString(num_parcels) + " parcel(s), " + toString(num_resources) + " resource(s), " + toString(num_orders) + " order(s), " + 
+		toString(num_sessions) + " session(s), " + toString(num_auctions) + " auction(s), " + toString(num_screenshots) + " screenshot(s), " +
+		toString(num_sub_eth_transactions) + " sub eth transction(s), " + toString(num_tiles_written) + " tiles, " + toString(num_world_settings) + " world setting(s)";
+
+	snapshot->snapshot_time = Clock::getCurTimeRealSec();
+	snapshot->lock_hold_time = timer.elapsed();
+	return snapshot;
+}
+
+
+// Writes the snapshots to the database, in order, and then flushes the database once.  Returns the number of bytes of record data written.
+// Doesn't require mutex to be held, just locks database_mutex.
+size_t ServerAllWorldsState::writeDatabaseSnapshots(const std::vector<Reference<DatabaseSnapshot>>& snapshots)
+{
+	Lock lock(database_mutex);
+
+	if(db_num_write_failures_to_inject > 0)
+	{
+		db_num_write_failures_to_inject.add(-1);
+		throw glare::Exception("Injected database write failure");
+	}
+
+	try
+	{
+		size_t bytes_written = 0;
+		for(size_t i=0; i<snapshots.size(); ++i)
 		{
-			temp_buf.clear();
-			temp_buf.writeUInt32(ETH_INFO_CHUNK);
-			temp_buf.writeUInt32(ETH_INFO_CHUNK_VERSION);
-			temp_buf.writeInt32(this->eth_info.min_next_nonce);
+			const DatabaseSnapshot* snapshot = snapshots[i].ptr();
 
-			if(!eth_info.database_key.valid())
-				eth_info.database_key = database.allocUnusedKey(); // Get a new key
+			for(size_t z=0; z<snapshot->records_to_delete.size(); ++z)
+				database.deleteRecord(snapshot->records_to_delete[z]);
 
-			database.updateRecord(eth_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			for(size_t z=0; z<snapshot->record_updates.size(); ++z)
+			{
+				const DatabaseSnapshot::RecordUpdate& update = snapshot->record_updates[z];
+				database.updateRecord(update.key, ArrayRef<uint8>(snapshot->data.buf.data() + update.offset, update.size));
+			}
 
-			eth_info.db_dirty = false;
+			bytes_written += snapshot->data.buf.size();
 		}
 
 		database.flush();
 
-		conPrint("Saved " + toString(num_obs) + " object(s), " + toString(num_users) + " user(s), " +
-			toString(num_parcels) + " parcel(s), " + toString(num_resources) + " resource(s), " + toString(num_orders) + " order(s), " + 
-			toString(num_sessions) + " session(s), " + toString(num_auctions) + " auction(s), " + toString(num_screenshots) + " screenshot(s), " +
-			toString(num_sub_eth_transactions) + " sub eth transction(s), " + toString(num_tiles_written) + " tiles, " + toString(num_world_settings) + " world setting(s) in " + timer.elapsedStringNSigFigs(4));
+		// Now that the snapshots are on disk, make them available to replication followers.
+		replication_log.append(snapshots);
+
+		// Top up the reserved keys while we hold database_mutex, so that makeDatabaseSnapshot() doesn't have to wait for us in future.
+		{
+			Lock keys_lock(reserved_db_keys_mutex);
+			while(reserved_db_keys.size() < NUM_RESERVED_DB_KEYS)
+				reserved_db_keys.push_back(database.allocUnusedKey());
+		}
+
+		return bytes_written;
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+}
+
+
+// Copies the database file, for sending to a replication follower doing a full sync.
+// database_mutex is held while copying, so the copy contains exactly the snapshots up to seq_num_out.
+// This blocks the DatabaseWriterThread while copying, but not the main server thread.
+std::string ServerAllWorldsState::copyDatabaseFileForReplication(const std::string& copy_suffix, uint64& seq_num_out)
+{
+	Lock lock(database_mutex);
+
+	try
+	{
+		const std::string copy_path = database_path + copy_suffix;
+		FileUtils::copyFile(database_path, copy_path);
+
+		seq_num_out = replication_log.getLastSeqNum();
+		return copy_path;
 	}
 	catch(FileUtils::FileUtilsExcep& e)
 	{
@@ -1134,9 +1466,42 @@ void ServerAllWorldsState::serialiseToDisk()
 }
 
 
+// Write any changed data (objects in dirty set) to disk.  Mutex should be held already.
+// Unlike the DatabaseWriterThread, this writes the changes synchronously.
+void ServerAllWorldsState::serialiseToDisk()
+{
+	conPrint("Saving world state to disk...");
+
+	Timer timer;
+
+	std::vector<Reference<DatabaseSnapshot>> snapshots(1, makeDatabaseSnapshot());
+	const size_t bytes_written = writeDatabaseSnapshots(snapshots);
+
+	conPrint("Saved " + snapshots[0]->summary + " (" + toString(bytes_written) + " B) in " + timer.elapsedStringNSigFigs(4));
+}
+
+
+DatabaseKey ServerAllWorldsState::allocDatabaseKey()
+{
+	{
+		Lock lock(reserved_db_keys_mutex);
+		if(!reserved_db_keys.empty())
+		{
+			const DatabaseKey key = reserved_db_keys.back();
+			reserved_db_keys.pop_back();
+			return key;
+		}
+	}
+
+	// No reserved keys left, allocate directly.  May have to wait for the DatabaseWriterThread to finish a write.
+	Lock lock(database_mutex);
+	return database.allocUnusedKey();
+}
+
+
 std::string ServerAllWorldsState::getCredential(const std::string& key) // Throws glare::Exception if not found
 {
-	Lock lock(mutex);
+	InstrumentedLock lock(mutex);
 
 	auto res = server_credentials.creds.find(key);
 	if(res == server_credentials.creds.end())
@@ -1147,7 +1512,7 @@ std::string ServerAllWorldsState::getCredential(const std::string& key) // Throw
 
 UID ServerAllWorldsState::getNextObjectUID()
 {
-	Lock lock(mutex);
+	Lock lock(uid_mutex);
 
 	const UID next = next_object_uid;
 	next_object_uid = UID(next_object_uid.value() + 1);
@@ -1157,7 +1522,7 @@ UID ServerAllWorldsState::getNextObjectUID()
 
 UID ServerAllWorldsState::getNextAvatarUID()
 {
-	Lock lock(mutex);
+	Lock lock(uid_mutex);
 
 	const UID next = next_avatar_uid;
 	next_avatar_uid = UID(next_avatar_uid.value() + 1);
@@ -1167,21 +1532,21 @@ UID ServerAllWorldsState::getNextAvatarUID()
 
 uint64 ServerAllWorldsState::getNextOrderUID()
 {
-	Lock lock(mutex);
+	Lock lock(uid_mutex);
 	return next_order_uid++;
 }
 
 
 uint64 ServerAllWorldsState::getNextSubEthTransactionUID()
 {
-	Lock lock(mutex);
+	Lock lock(uid_mutex);
 	return next_sub_eth_transaction_uid++;
 }
 
 
 uint64 ServerAllWorldsState::getNextScreenshotUID()
 {
-	Lock lock(mutex);
+	InstrumentedLock lock(mutex);
 
 	uint64 highest_id = 0;
 
@@ -1207,14 +1572,14 @@ uint64 ServerAllWorldsState::getNextScreenshotUID()
 
 void ServerAllWorldsState::setUserWebMessage(const UserID& user_id, const std::string& s)
 {
-	Lock lock(mutex);
+	Lock lock(user_web_messages_mutex);
 	user_web_messages[user_id] = s;
 }
 
 
 std::string ServerAllWorldsState::getAndRemoveUserWebMessage(const UserID& user_id) // returns empty string if no message or user
 {
-	Lock lock(mutex);
+	Lock lock(user_web_messages_mutex);
 	auto res = user_web_messages.find(user_id);
 	if(res != user_web_messages.end())
 	{
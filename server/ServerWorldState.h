@@ -18,10 +18,23 @@ Generated at 2016-01-12 12:22:34 +1300
 #include "ParcelAuction.h"
 #include "Screenshot.h"
 #include "SubEthTransaction.h"
+#include "ServerObGrid.h"
+#include "LatencyHistogram.h"
+#include "InstrumentedMutex.h"
+#include "LODGenJobQueue.h"
+#include "ObjectURLIndex.h"
+#include "CompressionStatsRegistry.h"
+#include "CompressedResourceVariants.h"
+#include "ResourceCache.h"
+#include "ReplicationLog.h"
 #include <ThreadSafeRefCounted.h>
 #include <Platform.h>
 #include <Mutex.h>
+#include <Condition.h>
 #include <Database.h>
+#include <ThreadMessage.h>
+#include <BufferOutStream.h>
+#include <AtomicInt.h>
 #include <map>
 #include <unordered_set>
 
@@ -29,20 +42,32 @@ Generated at 2016-01-12 12:22:34 +1300
 class ServerWorldState : public ThreadSafeRefCounted
 {
 public:
-	void addParcelAsDBDirty(const ParcelRef parcel) { db_dirty_parcels.insert(parcel); }
-	void addWorldObjectAsDBDirty(const WorldObjectRef ob) { db_dirty_world_objects.insert(ob); }
+	ServerWorldState() : mutex("world") {}
 
-	WorldSettings world_settings;
+	void addParcelAsDBDirty(const ParcelRef parcel) REQUIRES(mutex) { db_dirty_parcels.insert(parcel); }
+	void addWorldObjectAsDBDirty(const WorldObjectRef ob) REQUIRES(mutex) { db_dirty_world_objects.insert(ob); }
 
-	std::map<UID, Reference<Avatar>> avatars;
+	void rebuildObjectGrid() REQUIRES(mutex); // Clears object_grid and inserts all objects in the objects map.
 
-	std::map<UID, WorldObjectRef> objects;
-	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_remote_objects;
+	WorldSettings world_settings GUARDED_BY(mutex);
 
-	std::unordered_set<ParcelRef, ParcelRefHash> db_dirty_parcels;
-	std::unordered_set<WorldObjectRef, WorldObjectRefHash> db_dirty_world_objects;
+	std::map<UID, Reference<Avatar>> avatars GUARDED_BY(mutex);
+	std::unordered_set<AvatarRef, AvatarRefHash> dirty_from_remote_avatars GUARDED_BY(mutex); // Avatars with other_dirty or transform_dirty set, that need to be broadcast to clients.
 
-	std::map<ParcelID, ParcelRef> parcels;
+	std::map<UID, WorldObjectRef> objects GUARDED_BY(mutex);
+	ServerObGrid object_grid GUARDED_BY(mutex); // Spatial index over objects.  Should be kept in sync with the objects map and object positions.
+	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_remote_objects GUARDED_BY(mutex);
+
+	std::unordered_set<ParcelRef, ParcelRefHash> db_dirty_parcels GUARDED_BY(mutex);
+	std::unordered_set<WorldObjectRef, WorldObjectRefHash> db_dirty_world_objects GUARDED_BY(mutex);
+
+	std::map<ParcelID, ParcelRef> parcels GUARDED_BY(mutex);
+
+	// Protects all the state of this world (and the objects, parcels and avatars in it), so that changes in one world don't contend with other worlds.
+	// See ServerAllWorldsState for the lock order.
+	mutable InstrumentedMutex mutex;
+private:
+	GLARE_DISABLE_COPY(ServerWorldState);
 };
 
 
@@ -98,6 +123,37 @@ struct ServerCredentials
 };
 
 
+// An in-memory copy of the changed data from the dirty sets, made while holding the world state mutex.
+// Written to the database by DatabaseWriterThread, without the world state mutex held.
+class DatabaseSnapshot : public ThreadMessage
+{
+public:
+	struct RecordUpdate
+	{
+		DatabaseKey key;
+		size_t offset; // Offset of the serialised record in data.
+		size_t size;
+	};
+
+	void addRecordUpdate(DatabaseKey key, size_t offset) { record_updates.push_back(RecordUpdate({key, offset, data.buf.size() - offset})); }
+
+	std::vector<DatabaseKey> records_to_delete; // Deletions are done before updates.
+	std::vector<RecordUpdate> record_updates;
+	BufferOutStream data; // Serialised data for all record updates.
+
+	struct PresentResource
+	{
+		std::string URL;
+		std::string local_path; // Relative to the server resources dir.
+	};
+	std::vector<PresentResource> present_resources; // Resources saved in this snapshot whose files are present on disk, so replication followers can download them.
+
+	std::string summary; // Description of what was saved, for logging.
+	double snapshot_time; // Clock::getCurTimeRealSec() when the snapshot was made.
+	double lock_hold_time; // Time taken to make the snapshot, with the world state mutex held.  In seconds.
+};
+
+
 /*=====================================================================
 ServerWorldState
 ----------------
@@ -112,7 +168,13 @@ public:
 	void readFromDisk(const std::string& path);
 	void createNewDatabase(const std::string& path);
 	void serialiseToDisk() REQUIRES(mutex); // Write any changed data (objects in dirty set) to disk.  Mutex should be held already.
-	void denormaliseData(); // Build/update cached/denormalised fields like creator_name.  Mutex should be locked already.
+	Reference<DatabaseSnapshot> makeDatabaseSnapshot() REQUIRES(mutex); // Copy any changed data into a snapshot and clear the dirty sets.  Mutex should be held already.
+	size_t writeDatabaseSnapshots(const std::vector<Reference<DatabaseSnapshot>>& snapshots); // Write snapshots to disk and flush.  Doesn't need mutex to be held.  Returns num bytes written.
+	// Copies the database file to a new file next to it, with copy_suffix appended to the name, and returns the path of the copy.  Doesn't need mutex to be held.
+	// Sets seq_num_out to the replication log sequence number of the last snapshot in the copy.
+	std::string copyDatabaseFileForReplication(const std::string& copy_suffix, uint64& seq_num_out);
+	void denormaliseData(); // Build/update cached/denormalised fields like creator_name.  Locks mutex, then each world mutex and users_mutex in turn.
+	void rebuildObjectURLIndex() REQUIRES(mutex); // Clears object_URL_index and adds all objects in all worlds.  Locks each world mutex and resources_mutex in turn.
 
 	// Removes sensitive information from the database, such as user passwords, email addresses, billing information, web sessions etc.
 	// Then saves the updates to disk.
@@ -120,45 +182,56 @@ public:
 
 	std::string getCredential(const std::string& key); // Throws glare::Exception if not found
 
-	UID getNextObjectUID(); // Gets and then increments next_object_uid.  Locks mutex.
-	UID getNextAvatarUID(); // Gets and then increments next_avatar_uid.  Locks mutex.
-	uint64 getNextOrderUID(); // Gets and then increments next_order_uid.  Locks mutex.
-	uint64 getNextSubEthTransactionUID();
+	UID getNextObjectUID(); // Gets and then increments next_object_uid.  Locks uid_mutex, so can be called with any other locks held.
+	UID getNextAvatarUID(); // Gets and then increments next_avatar_uid.  Locks uid_mutex.
+	uint64 getNextOrderUID(); // Gets and then increments next_order_uid.  Locks uid_mutex.
+	uint64 getNextSubEthTransactionUID(); // Locks uid_mutex.
 	uint64 getNextScreenshotUID();
 
 	void markAsChanged() { changed = 1; }
 	void clearChangedFlag() { changed = 0; }
 	bool hasChanged() const { return changed != 0; }
 
-	void setUserWebMessage(const UserID& user_id, const std::string& s);
-	std::string getAndRemoveUserWebMessage(const UserID& user_id); // returns empty string if no message or user
+	void setUserWebMessage(const UserID& user_id, const std::string& s); // Locks user_web_messages_mutex, so can be called with any other locks held.
+	std::string getAndRemoveUserWebMessage(const UserID& user_id); // returns empty string if no message or user.  Locks user_web_messages_mutex.
 
 	Reference<ServerWorldState> getRootWorldState(); // Guaranteed to return a non-null reference
 
-	void addResourcesAsDBDirty(const ResourceRef resource)					REQUIRES(mutex) { db_dirty_resources.insert(resource); changed = 1; }
+	void addResourcesAsDBDirty(const ResourceRef resource)					REQUIRES(resources_mutex) { db_dirty_resources.insert(resource); changed = 1; }
 	void addSubEthTransactionAsDBDirty(const SubEthTransactionRef trans)	REQUIRES(mutex) { db_dirty_sub_eth_transactions.insert(trans); changed = 1; }
-	void addOrderAsDBDirty(const OrderRef order)							REQUIRES(mutex) { db_dirty_orders.insert(order); changed = 1; }
+	void addOrderAsDBDirty(const OrderRef order)							REQUIRES(orders_mutex) { db_dirty_orders.insert(order); changed = 1; }
 	void addParcelAuctionAsDBDirty(const ParcelAuctionRef parcel_auction)	REQUIRES(mutex) { db_dirty_parcel_auctions.insert(parcel_auction); changed = 1; }
-	void addUserWebSessionAsDBDirty(const UserWebSessionRef screenshot)		REQUIRES(mutex) { db_dirty_userwebsessions.insert(screenshot); changed = 1; }
+	void addUserWebSessionAsDBDirty(const UserWebSessionRef screenshot)		REQUIRES(sessions_mutex) { db_dirty_userwebsessions.insert(screenshot); changed = 1; }
 	void addScreenshotAsDBDirty(const ScreenshotRef screenshot)				REQUIRES(mutex) { db_dirty_screenshots.insert(screenshot); changed = 1; }
-	void addUserAsDBDirty(const UserRef user)								REQUIRES(mutex) { db_dirty_users.insert(user); changed = 1; }
+	void addUserAsDBDirty(const UserRef user)								REQUIRES(users_mutex) { db_dirty_users.insert(user); changed = 1; }
+
+	void addDatabaseRecordToDelete(const DatabaseKey& key); // Adds to db_records_to_delete.  Locks db_records_to_delete_mutex, so can be called with any other locks held.
 
 	void addEverythingToDirtySets();
 
-	bool isInReadOnlyMode();
+	// Called after adding avatars or objects to dirty_from_remote_avatars or dirty_from_remote_objects, to wake up the main server loop so the changes are broadcast promptly.  Threadsafe.
+	void notifyBroadcastNeeded();
+	// Blocks until notifyBroadcastNeeded() has been called since the last takeBroadcastNeededTime() call, or until max_wait_time_s has elapsed.
+	void waitForBroadcastNeeded(double max_wait_time_s);
+	// Returns the time (Clock::getCurTimeRealSec()) of the first notifyBroadcastNeeded() call since the last takeBroadcastNeededTime() call, or -1 if there was no call.
+	double takeBroadcastNeededTime();
+
+	bool isInReadOnlyMode() { return read_only_mode != 0; } // Threadsafe.
 
 	void clearAndReset(); // Just for fuzzing
 
 	Reference<ResourceManager> resource_manager;
 
-	std::map<UserID, Reference<User>> user_id_to_users GUARDED_BY(mutex);  // User id to user
-	std::map<std::string, Reference<User>> name_to_users GUARDED_BY(mutex); // Username to user
+	std::map<UserID, Reference<User>> user_id_to_users GUARDED_BY(users_mutex);  // User id to user
+	std::map<std::string, Reference<User>> name_to_users GUARDED_BY(users_mutex); // Username to user
 
-	std::map<uint64, OrderRef> orders GUARDED_BY(mutex); // Order ID to order
+	std::map<uint64, OrderRef> orders GUARDED_BY(orders_mutex); // Order ID to order
 
 	std::map<std::string, Reference<ServerWorldState> > world_states GUARDED_BY(mutex); // ServerWorldState contains WorldObjects and Parcels
 
-	std::map<std::string, UserWebSessionRef> user_web_sessions GUARDED_BY(mutex); // Map from key to UserWebSession
+	ObjectURLIndex object_URL_index GUARDED_BY(resources_mutex); // Map from resource URL to objects using it, over all worlds.  Should be kept in sync with the objects maps and object URLs.
+
+	std::map<std::string, UserWebSessionRef> user_web_sessions GUARDED_BY(sessions_mutex); // Map from key to UserWebSession
 	
 	std::map<uint32, ParcelAuctionRef> parcel_auctions GUARDED_BY(mutex); // ParcelAuction id to ParcelAuction
 
@@ -190,38 +263,98 @@ public:
 	std::string server_admin_message GUARDED_BY(mutex);
 	bool server_admin_message_changed GUARDED_BY(mutex);
 
-	// Ephemeral state - is the server in read-only mode?  When true, clients can't make changes to objects etc.
-	bool read_only_mode GUARDED_BY(mutex);
+	// Ephemeral state - is the server in read-only mode?  When non-zero, clients can't make changes to objects etc.  Threadsafe.
+	glare::AtomicInt read_only_mode;
 
 	// Ephemeral state - do we want to force the DynamicTextureUpdaterThread to do a run?
 	bool force_dyn_tex_update GUARDED_BY(mutex);
 
-	std::map<UserID, std::string> user_web_messages GUARDED_BY(mutex); // For displaying an informational or error message on the next webpage served to a user.
-
 	// Sets of objects that should be written to (updated) in the database.
-	std::unordered_set<ResourceRef, ResourceRefHash>					db_dirty_resources				GUARDED_BY(mutex);
+	std::unordered_set<ResourceRef, ResourceRefHash>					db_dirty_resources				GUARDED_BY(resources_mutex);
 	std::unordered_set<SubEthTransactionRef, SubEthTransactionRefHash>	db_dirty_sub_eth_transactions	GUARDED_BY(mutex);
-	std::unordered_set<OrderRef, OrderRefHash>							db_dirty_orders					GUARDED_BY(mutex);
+	std::unordered_set<OrderRef, OrderRefHash>							db_dirty_orders					GUARDED_BY(orders_mutex);
 	std::unordered_set<ParcelAuctionRef, ParcelAuctionRefHash>			db_dirty_parcel_auctions		GUARDED_BY(mutex);
-	std::unordered_set<UserWebSessionRef, UserWebSessionRefHash>		db_dirty_userwebsessions		GUARDED_BY(mutex);
+	std::unordered_set<UserWebSessionRef, UserWebSessionRefHash>		db_dirty_userwebsessions		GUARDED_BY(sessions_mutex);
 	std::unordered_set<ScreenshotRef, ScreenshotRefHash>				db_dirty_screenshots			GUARDED_BY(mutex);
-	std::unordered_set<UserRef, UserRefHash>							db_dirty_users					GUARDED_BY(mutex);
-
-	std::unordered_set<DatabaseKey, DatabaseKeyHash>					db_records_to_delete			GUARDED_BY(mutex);
+	std::unordered_set<UserRef, UserRefHash>							db_dirty_users					GUARDED_BY(users_mutex);
 
 
 	ServerCredentials server_credentials;
 
-	mutable ::Mutex mutex;
+	// Ephemeral state - time from avatar and object changes arriving from clients to being enqueued for broadcast.  Threadsafe.
+	LatencyHistogram broadcast_latency_histogram;
+
+	// Ephemeral state - database save stats, updated by DatabaseWriterThread.  Threadsafe.
+	LatencyHistogram db_save_latency_histogram; // Time from a snapshot being made to it being written and flushed to disk.
+	LatencyHistogram db_snapshot_lock_hold_histogram; // Time spent making snapshots, with the world state mutex held.
+	glare::AtomicInt db_num_saves; // Number of writes + flushes done.  A single save may write multiple snapshots.
+	glare::AtomicInt db_num_snapshots_written;
+	glare::AtomicInt db_total_bytes_written;
+	glare::AtomicInt db_num_snapshots_pending; // Number of snapshots made but not yet written.
+	glare::AtomicInt db_num_deferred_saves; // Number of times a snapshot was not made because the DatabaseWriterThread was behind.
+	glare::AtomicInt db_num_write_failures; // Number of failed writes.  The snapshots are kept and retried by the DatabaseWriterThread.
+	glare::AtomicInt db_num_write_failures_to_inject; // For testing.  If > 0, writeDatabaseSnapshots() decrements it and throws instead of writing.
+
+	// Ephemeral state - recently written database snapshots, sent to replication followers.  Appended to by writeDatabaseSnapshots().  Threadsafe.
+	ReplicationLog replication_log;
+
+	// Ephemeral state - LOD mesh and texture generation jobs, added by MeshLODGenThread and run by LODGenWorkerThreads.  Threadsafe.
+	LODGenJobQueue lod_gen_job_queue;
+
+	// Ephemeral state - stream compression stats of client connections, updated by WorkerThreads.  Threadsafe.
+	CompressionStatsRegistry compression_stats;
+
+	// Ephemeral state - which compressed variants of resources are on disk, and stats about serving them.  Threadsafe.
+	CompressedResourceVariants compressed_resource_variants;
+
+	// Ephemeral state - in-memory cache of popular resource files and compressed variants, used by WorkerThreads and the webserver.  Threadsafe.
+	ResourceCache resource_cache;
+
+	// Lock order:
+	// 1. mutex
+	// 2. ServerWorldState::mutex - only one world should be locked at a time.
+	// 3. users_mutex
+	// 4. sessions_mutex
+	// 5. orders_mutex
+	// 6. resources_mutex
+	// 7. The private mutexes below, which are never held while locking anything else (apart from database_mutex then reserved_db_keys_mutex).
+	// A thread holding a lock must not lock one earlier in the order.  Locks later in the order may be taken without the earlier ones.
+	// These all record contention stats, shown on the admin page.
+	mutable InstrumentedMutex mutex; // Protects world_states, auctions, screenshots, transactions, map tiles and the ephemeral state above.
+	mutable InstrumentedMutex users_mutex; // Protects the users maps, the User objects in them, and db_dirty_users.
+	mutable InstrumentedMutex sessions_mutex; // Protects user_web_sessions and db_dirty_userwebsessions.
+	mutable InstrumentedMutex orders_mutex; // Protects orders and db_dirty_orders.
+	mutable InstrumentedMutex resources_mutex; // Protects db_dirty_resources and object_URL_index.  (The resource map itself is protected by the ResourceManager mutex.)
+	double lock_stats_start_time; // Time (Clock::getCurTimeRealSec()) at which gathering of lock stats started.
 private:
 	GLARE_DISABLE_COPY(ServerAllWorldsState);
 
 	glare::AtomicInt changed;
 
-	UID next_object_uid GUARDED_BY(mutex);
-	UID next_avatar_uid GUARDED_BY(mutex);
-	uint64 next_order_uid GUARDED_BY(mutex);
-	uint64 next_sub_eth_transaction_uid GUARDED_BY(mutex);
+	::Mutex broadcast_needed_mutex;
+	Condition broadcast_needed_condition;
+	double broadcast_needed_time GUARDED_BY(broadcast_needed_mutex); // -1 if no broadcast needed.
+
+	DatabaseKey allocDatabaseKey(); // Takes a key from reserved_db_keys if possible, otherwise locks database_mutex and allocates one.
+
+	::Mutex uid_mutex;
+	UID next_object_uid GUARDED_BY(uid_mutex);
+	UID next_avatar_uid GUARDED_BY(uid_mutex);
+	uint64 next_order_uid GUARDED_BY(uid_mutex);
+	uint64 next_sub_eth_transaction_uid GUARDED_BY(uid_mutex);
+
+	::Mutex user_web_messages_mutex;
+	std::map<UserID, std::string> user_web_messages GUARDED_BY(user_web_messages_mutex); // For displaying an informational or error message on the next webpage served to a user.
+
+	::Mutex db_records_to_delete_mutex;
+	std::unordered_set<DatabaseKey, DatabaseKeyHash> db_records_to_delete GUARDED_BY(db_records_to_delete_mutex); // Keys of deleted objects etc., to be deleted from the database.
+
+	// Lock order is database_mutex, then reserved_db_keys_mutex.  These can be locked while holding any of the locks above.
+	::Mutex database_mutex;
+	Database database GUARDED_BY(database_mutex);
+	std::string database_path GUARDED_BY(database_mutex);
 
-	Database database GUARDED_BY(mutex);
+	static const size_t NUM_RESERVED_DB_KEYS = 1024;
+	::Mutex reserved_db_keys_mutex;
+	std::vector<DatabaseKey> reserved_db_keys GUARDED_BY(reserved_db_keys_mutex); // Keys allocated ahead of time, so making a snapshot doesn't need to wait for database_mutex.
 };
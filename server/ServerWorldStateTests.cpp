@@ -0,0 +1,310 @@
+/*=====================================================================
+ServerWorldStateTests.cpp
+-------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ServerWorldStateTests.h"
+
+
+#if BUILD_TESTS
+
+
+#include "ServerWorldState.h"
+#include "DatabaseWriterThread.h"
+#include <ThreadManager.h>
+#include <TestUtils.h>
+#include <ConPrint.h>
+#include <StringUtils.h>
+#include <PlatformUtils.h>
+#include <FileUtils.h>
+#include <Lock.h>
+#include <Timer.h>
+
+
+// Adds num_obs objects (spread over two worlds), num_users users and num_parcels parcels to world_state, marks them as DB-dirty, and saves to the database.
+static void makeAndSaveSyntheticState(ServerAllWorldsState& world_state, int num_obs, int num_users, int num_parcels)
+{
+	InstrumentedLock lock(world_state.mutex);
+
+	world_state.world_states["test_world"] = new ServerWorldState();
+
+	for(int i=0; i<num_obs; ++i)
+	{
+		Reference<ServerWorldState> world = world_state.world_states[(i % 4 == 0) ? "test_world" : ""];
+
+		WorldObjectRef ob = new WorldObject();
+		ob->uid = UID(i);
+		ob->pos = Vec3d(i * 0.5, i % 100, 1);
+		ob->model_url = "model_" + toString(i) + ".bmesh";
+		InstrumentedLock world_lock(world->mutex);
+		world->objects[ob->uid] = ob;
+		world->addWorldObjectAsDBDirty(ob);
+	}
+
+	{
+		InstrumentedLock users_lock(world_state.users_mutex);
+		for(int i=0; i<num_users; ++i)
+		{
+			UserRef user = new User();
+			user->id = UserID(i);
+			user->name = "user_" + toString(i);
+			world_state.user_id_to_users[user->id] = user;
+			world_state.name_to_users[user->name] = user;
+			world_state.addUserAsDBDirty(user);
+		}
+	}
+
+	{
+		Reference<ServerWorldState> root_world = world_state.world_states[""];
+		InstrumentedLock world_lock(root_world->mutex);
+		for(int i=0; i<num_parcels; ++i)
+		{
+			ParcelRef parcel = new Parcel();
+			parcel->id = ParcelID(i);
+			root_world->parcels[parcel->id] = parcel;
+			root_world->addParcelAsDBDirty(parcel);
+		}
+	}
+
+	world_state.serialiseToDisk();
+}
+
+
+// Makes a snapshot of the changed data and enqueues it to the DatabaseWriterThread, as the main server loop does.
+static void enqueueSnapshot(ServerAllWorldsState& world_state, ThreadManager& db_writer_thread_manager)
+{
+	Reference<DatabaseSnapshot> snapshot;
+	{
+		InstrumentedLock lock(world_state.mutex);
+		snapshot = world_state.makeDatabaseSnapshot();
+	}
+	world_state.db_num_snapshots_pending.increment();
+	db_writer_thread_manager.enqueueMessage(snapshot.ptr());
+}
+
+
+// Check that changes in snapshots whose write fails are not lost, but are written when the DatabaseWriterThread retries.
+static void testDatabaseWriteFailure(const std::string& db_path, const std::string& resources_dir)
+{
+	if(FileUtils::fileExists(db_path))
+		FileUtils::deleteFile(db_path);
+
+	{
+		Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+		world_state->resource_manager = new ResourceManager(resources_dir);
+		world_state->createNewDatabase(db_path);
+
+		ThreadManager db_writer_thread_manager;
+		DatabaseWriterThread* db_writer_thread = new DatabaseWriterThread(world_state.ptr());
+		db_writer_thread->retry_period = 0.01;
+		db_writer_thread_manager.addThread(db_writer_thread);
+
+		world_state->db_num_write_failures_to_inject = 3;
+
+		// Make a snapshot with a new object and user in it.
+		WorldObjectRef ob = new WorldObject();
+		ob->uid = UID(1);
+		ob->model_url = "model_v1.bmesh";
+		{
+			InstrumentedLock lock(world_state->mutex);
+			Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+			{
+				InstrumentedLock world_lock(root_world->mutex);
+				root_world->objects[ob->uid] = ob;
+				root_world->addWorldObjectAsDBDirty(ob);
+			}
+			{
+				InstrumentedLock users_lock(world_state->users_mutex);
+				UserRef user = new User();
+				user->id = UserID(1);
+				user->name = "user_1";
+				world_state->user_id_to_users[user->id] = user;
+				world_state->name_to_users[user->name] = user;
+				world_state->addUserAsDBDirty(user);
+			}
+		}
+		enqueueSnapshot(*world_state, db_writer_thread_manager);
+
+		// Make a later snapshot that changes the object again.  This should be written after the first snapshot, even though the first one failed.
+		{
+			InstrumentedLock lock(world_state->mutex);
+			Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
+			ob->model_url = "model_v2.bmesh";
+			root_world->addWorldObjectAsDBDirty(ob);
+		}
+		enqueueSnapshot(*world_state, db_writer_thread_manager);
+
+		// Wait for the snapshots to be written.
+		Timer timer;
+		while(world_state->db_num_snapshots_pending > 0)
+		{
+			testAssert(timer.elapsed() < 10.0);
+			PlatformUtils::Sleep(1);
+		}
+
+		testAssert(world_state->db_num_write_failures == 3);
+		testAssert(world_state->db_num_write_failures_to_inject == 0);
+		testAssert(world_state->db_num_snapshots_written == 2);
+
+		db_writer_thread_manager.killThreadsBlocking();
+	}
+
+	// Reload and check the changes survived.
+	Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+	world_state->resource_manager = new ResourceManager(resources_dir);
+	world_state->readFromDisk(db_path);
+	{
+		InstrumentedLock lock(world_state->mutex);
+		Reference<ServerWorldState> root_world = world_state->world_states[""];
+		{
+			InstrumentedLock world_lock(root_world->mutex);
+			testAssert(root_world->objects.count(UID(1)) == 1);
+			testAssert(root_world->objects[UID(1)]->model_url == "model_v2.bmesh");
+		}
+
+		InstrumentedLock users_lock(world_state->users_mutex);
+		testAssert(world_state->user_id_to_users.count(UserID(1)) == 1);
+		testAssert(world_state->user_id_to_users[UserID(1)]->name == "user_1");
+	}
+
+	world_state = NULL; // Close database
+	FileUtils::deleteFile(db_path);
+}
+
+
+void ServerWorldStateTests::test()
+{
+	conPrint("ServerWorldStateTests::test()");
+
+	const std::string db_path = PlatformUtils::getTempDirPath() + "/server_world_state_test.bin";
+	const std::string resources_dir = PlatformUtils::getTempDirPath() + "/server_world_state_test_resources";
+
+	try
+	{
+		FileUtils::createDirIfDoesNotExist(resources_dir);
+		if(FileUtils::fileExists(db_path))
+			FileUtils::deleteFile(db_path);
+
+		// Use enough objects that decoding is split over multiple tasks.
+		const int NUM_OBS = 3000;
+		const int NUM_USERS = 500;
+		const int NUM_PARCELS = 10;
+
+		{
+			Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+			world_state->resource_manager = new ResourceManager(resources_dir);
+			world_state->createNewDatabase(db_path);
+			makeAndSaveSyntheticState(*world_state, NUM_OBS, NUM_USERS, NUM_PARCELS);
+		}
+
+		Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+		world_state->resource_manager = new ResourceManager(resources_dir);
+		world_state->readFromDisk(db_path);
+
+		{
+			InstrumentedLock lock(world_state->mutex);
+
+			testAssert(world_state->world_states.size() == 2);
+			testAssert(world_state->world_states.count("test_world") == 1);
+			Reference<ServerWorldState> root_world = world_state->world_states[""];
+			Reference<ServerWorldState> test_world = world_state->world_states["test_world"];
+			size_t num_obs = 0;
+			{
+				InstrumentedLock world_lock(root_world->mutex);
+				num_obs += root_world->objects.size();
+				testAssert(root_world->parcels.size() == NUM_PARCELS);
+			}
+			{
+				InstrumentedLock world_lock(test_world->mutex);
+				num_obs += test_world->objects.size();
+			}
+			testAssert(num_obs == NUM_OBS);
+
+			for(int i=0; i<NUM_OBS; ++i)
+			{
+				Reference<ServerWorldState> world = (i % 4 == 0) ? test_world : root_world;
+				InstrumentedLock world_lock(world->mutex);
+				auto res = world->objects.find(UID(i));
+				testAssert(res != world->objects.end());
+				testAssert(res->second->pos == Vec3d(i * 0.5, i % 100, 1));
+				testAssert(res->second->model_url == "model_" + toString(i) + ".bmesh");
+				testAssert(res->second->database_key.valid());
+			}
+
+			InstrumentedLock users_lock(world_state->users_mutex);
+			testAssert(world_state->user_id_to_users.size() == NUM_USERS);
+			testAssert(world_state->name_to_users.size() == NUM_USERS);
+			for(int i=0; i<NUM_USERS; ++i)
+			{
+				testAssert(world_state->user_id_to_users.count(UserID(i)) == 1);
+				testAssert(world_state->user_id_to_users[UserID(i)]->name == "user_" + toString(i));
+				testAssert(world_state->name_to_users["user_" + toString(i)] == world_state->user_id_to_users[UserID(i)]);
+			}
+		}
+
+		// Next object UID should be one past the largest loaded object UID.
+		testAssert(world_state->getNextObjectUID() == UID(NUM_OBS));
+
+		world_state = NULL; // Close database
+		FileUtils::deleteFile(db_path);
+
+		testDatabaseWriteFailure(db_path, resources_dir);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ServerWorldStateTests::test() done.");
+}
+
+
+void ServerWorldStateTests::benchmarkStartupLoad()
+{
+	conPrint("ServerWorldStateTests::benchmarkStartupLoad()");
+
+	const std::string db_path = PlatformUtils::getTempDirPath() + "/server_world_state_benchmark.bin";
+	const std::string resources_dir = PlatformUtils::getTempDirPath() + "/server_world_state_benchmark_resources";
+
+	const int NUM_OBS = 500000;
+	const int NUM_USERS = 50000;
+	const int NUM_PARCELS = 1000;
+
+	try
+	{
+		FileUtils::createDirIfDoesNotExist(resources_dir);
+		if(FileUtils::fileExists(db_path))
+			FileUtils::deleteFile(db_path);
+
+		{
+			Timer timer;
+			Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+			world_state->resource_manager = new ResourceManager(resources_dir);
+			world_state->createNewDatabase(db_path);
+			makeAndSaveSyntheticState(*world_state, NUM_OBS, NUM_USERS, NUM_PARCELS);
+			conPrint("Generated and saved " + toString(NUM_OBS) + " objects, " + toString(NUM_USERS) + " users, " + toString(NUM_PARCELS) + " parcels in " + timer.elapsedStringNSigFigs(4) + 
+				" (" + toString(FileUtils::getFileSize(db_path) / (1024 * 1024)) + " MB)");
+		}
+
+		for(int i=0; i<3; ++i)
+		{
+			Timer timer;
+			Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+			world_state->resource_manager = new ResourceManager(resources_dir);
+			world_state->readFromDisk(db_path);
+			conPrint("Load " + toString(i) + ": " + timer.elapsedStringNSigFigs(4));
+		}
+
+		FileUtils::deleteFile(db_path);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ServerWorldStateTests::benchmarkStartupLoad() done.");
+}
+
+
+#endif // BUILD_TESTS
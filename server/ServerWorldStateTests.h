@@ -0,0 +1,20 @@
+/*=====================================================================
+ServerWorldStateTests.h
+-----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+/*=====================================================================
+ServerWorldStateTests
+---------------------
+Tests for saving and loading ServerAllWorldsState to and from the database.
+=====================================================================*/
+class ServerWorldStateTests
+{
+public:
+	static void test();
+
+	static void benchmarkStartupLoad(); // Generates a synthetic database with many objects and users, and measures the time to load it, as done at server startup.
+};
@@ -11,6 +11,7 @@ Copyright Glare Technologies Limited 2023 -
 #include <ConPrint.h>
 #include <StringUtils.h>
 #include <PlatformUtils.h>
+#include <Lock.h>
 
 
 static const int server_UDP_port = 7601;
@@ -27,6 +28,54 @@ UDPHandlerThread::~UDPHandlerThread()
 }
 
 
+// Rebuild relay_clients if the connected clients or avatar locations have changed.
+void UDPHandlerThread::updateRelayClients()
+{
+	AvatarLocationsRef new_avatar_locations = server->getAvatarLocations();
+	if((server->connected_clients_changed == 0) && (new_avatar_locations == avatar_locations))
+		return;
+
+	avatar_locations = new_avatar_locations;
+
+	if(server->connected_clients_changed != 0)
+	{
+		relay_clients.clear();
+
+		Lock lock(server->connected_clients_mutex);
+
+		for(auto it = server->connected_clients.begin(); it != server->connected_clients.end(); ++it)
+			if(it->second.client_UDP_port > 0) // If remote UDP port is known:
+			{
+				VoiceRelayClient client;
+				client.ip_addr = it->second.ip_addr;
+				client.UDP_port = it->second.client_UDP_port;
+				client.avatar_uid = it->second.client_avatar_id;
+				relay_clients.push_back(client);
+			}
+
+		server->connected_clients_changed = 0;
+	}
+
+	avatar_id_to_client_index.clear();
+	for(size_t i=0; i<relay_clients.size(); ++i)
+	{
+		VoiceRelayClient& client = relay_clients[i];
+		avatar_id_to_client_index[(uint32)client.avatar_uid.value()] = i;
+
+		client.location_known = false;
+		if(avatar_locations.nonNull())
+		{
+			auto res = avatar_locations->locations.find(client.avatar_uid);
+			if(res != avatar_locations->locations.end())
+			{
+				client.location_known = true;
+				client.location = res->second;
+			}
+		}
+	}
+}
+
+
 void UDPHandlerThread::doRun()
 {
 	PlatformUtils::setCurrentThreadNameIfTestsEnabled("UDPHandlerThread");
@@ -58,30 +107,37 @@ void UDPHandlerThread::doRun()
 				std::memcpy(&type, packet_buf.data(), 4);
 				if(type == 1) // If packet has voice type:
 				{
-					if(server->connected_clients_changed != 0)
+					// Voice packets are (type, sender avatar UID (lower 32 bits), sequence number, encoded audio)
+					if(packet_len >= 12)
 					{
-						// Rebuild our connected_clients vector.
-						connected_clients.clear();
+						updateRelayClients();
 
-						{
-							Lock lock(server->connected_clients_mutex);
-
-							for(auto it = server->connected_clients.begin(); it != server->connected_clients.end(); ++it)
-								if(it->second.client_UDP_port > 0) // If remote UDP port is known:
-									connected_clients.push_back(ConnectedClientInfo({it->second.ip_addr, it->second.client_UDP_port}));
+						uint32 sender_avatar_id;
+						std::memcpy(&sender_avatar_id, packet_buf.data() + 4, sizeof(uint32));
 
-							server->connected_clients_changed = 0;
+						// Look up the sender, and check the packet came from the sender's address, so clients can't send voice as another avatar.
+						auto res = avatar_id_to_client_index.find(sender_avatar_id);
+						if(res != avatar_id_to_client_index.end())
+						{
+							const size_t sender_index = res->second;
+							if(relay_clients[sender_index].ip_addr == sender_ip_addr && relay_clients[sender_index].UDP_port == sender_port)
+							{
+								// Relay packet to clients that can hear the sender
+								recipients.clear();
+								VoiceRelay::getRecipients(relay_clients, sender_index, server->config.voice_audible_radius, recipients);
+
+								for(size_t i=0; i<recipients.size(); ++i)
+								{
+									const VoiceRelayClient& client = relay_clients[recipients[i]];
+
+									if(num_packets_rcvd % 512 == 0) // Log occasional packets:
+										conPrint("UDPHandlerThread: Sending packet to " + client.ip_addr.toString() + ", port " + toString(client.UDP_port) + " ...");
+
+									udp_socket->sendPacket(packet_buf.data(), packet_len, client.ip_addr, client.UDP_port);
+								}
+							}
 						}
 					}
-
-					// Broadcast packet to clients
-					for(size_t i=0; i<connected_clients.size(); ++i)
-					{
-						if(num_packets_rcvd % 512 == 0) // Log occasional packets:
-							conPrint("UDPHandlerThread: Sending packet to " + connected_clients[i].ip_addr.toString() + ", port " + toString(connected_clients[i].client_UDP_port) + " ...");
-
-						udp_socket->sendPacket(packet_buf.data(), packet_len, connected_clients[i].ip_addr, connected_clients[i].client_UDP_port);
-					}
 				}
 				else if(type == 2)
 				{
@@ -6,24 +6,21 @@ Copyright Glare Technologies Limited 2023 -
 #pragma once
 
 
+#include "VoiceRelay.h"
 #include <MessageableThread.h>
 #include <UDPSocket.h>
 #include <IPAddress.h>
+#include <unordered_map>
 #include <vector>
 class Server;
 
 
-struct ConnectedClientInfo
-{
-	IPAddress ip_addr;
-	int client_UDP_port;
-};
-
-
 /*=====================================================================
 UDPHandlerThread
 ----------------
-Handles UDP messages from clients, sends back to connected clients.
+Handles UDP messages from clients.
+Voice packets are relayed to connected clients in the same world as the
+speaker, within the audible radius (see VoiceRelay).
 =====================================================================*/
 class UDPHandlerThread : public MessageableThread
 {
@@ -34,7 +31,12 @@ public:
 	void doRun() override;
 
 private:
-	std::vector<ConnectedClientInfo> connected_clients;
+	void updateRelayClients();
+
+	std::vector<VoiceRelayClient> relay_clients;
+	std::unordered_map<uint32, size_t> avatar_id_to_client_index; // Map from lower 32 bits of avatar UID (as sent in voice packets) to index in relay_clients.
+	AvatarLocationsRef avatar_locations; // Avatar locations that relay_clients was built with.
+	std::vector<size_t> recipients;
 	Reference<UDPSocket> udp_socket;
 	Server* server;
 };
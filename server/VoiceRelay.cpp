@@ -0,0 +1,90 @@
+/*=====================================================================
+VoiceRelay.cpp
+--------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "VoiceRelay.h"
+
+
+void VoiceRelay::getRecipients(const std::vector<VoiceRelayClient>& clients, size_t sender_index, float audible_radius, std::vector<size_t>& recipients_out)
+{
+	const VoiceRelayClient& sender = clients[sender_index];
+	if(!sender.location_known)
+		return; // Clients can't play voice for an avatar they don't know about, so don't relay.
+
+	const double max_dist2 = (double)audible_radius * (double)audible_radius;
+
+	for(size_t i=0; i<clients.size(); ++i)
+	{
+		const VoiceRelayClient& client = clients[i];
+		if((i != sender_index) && client.location_known && (client.location.world_index == sender.location.world_index))
+		{
+			if((audible_radius <= 0) || (client.location.pos.getDist2(sender.location.pos) <= max_dist2))
+				recipients_out.push_back(i);
+		}
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+
+
+static VoiceRelayClient makeTestClient(uint64 avatar_uid, bool location_known, uint32 world_index, const Vec3d& pos)
+{
+	VoiceRelayClient client;
+	client.UDP_port = 1000 + (int)avatar_uid;
+	client.avatar_uid = UID(avatar_uid);
+	client.location_known = location_known;
+	client.location.world_index = world_index;
+	client.location.pos = pos;
+	return client;
+}
+
+
+void VoiceRelay::test()
+{
+	conPrint("VoiceRelay::test()");
+
+	std::vector<VoiceRelayClient> clients;
+	clients.push_back(makeTestClient(0, true, 0, Vec3d(0, 0, 0))); // Sender
+	clients.push_back(makeTestClient(1, true, 0, Vec3d(10, 0, 0))); // Nearby, same world
+	clients.push_back(makeTestClient(2, true, 0, Vec3d(1000, 0, 0))); // Far away, same world
+	clients.push_back(makeTestClient(3, true, 1, Vec3d(1, 0, 0))); // Nearby, different world
+	clients.push_back(makeTestClient(4, false, 0, Vec3d(0, 0, 0))); // Location not known
+
+	{
+		std::vector<size_t> recipients;
+		getRecipients(clients, /*sender index=*/0, /*audible radius=*/100.f, recipients);
+		testAssert(recipients.size() == 1 && recipients[0] == 1);
+	}
+
+	// Test with unlimited radius
+	{
+		std::vector<size_t> recipients;
+		getRecipients(clients, /*sender index=*/0, /*audible radius=*/0.f, recipients);
+		testAssert(recipients.size() == 2 && recipients[0] == 1 && recipients[1] == 2);
+	}
+
+	// Test that a sender with an unknown location isn't relayed.
+	{
+		std::vector<size_t> recipients;
+		getRecipients(clients, /*sender index=*/4, /*audible radius=*/0.f, recipients);
+		testAssert(recipients.empty());
+	}
+
+	// Test that a sender in another world is only relayed to clients in that world.
+	{
+		std::vector<size_t> recipients;
+		getRecipients(clients, /*sender index=*/3, /*audible radius=*/100.f, recipients);
+		testAssert(recipients.empty());
+	}
+
+	conPrint("VoiceRelay::test() done.");
+}
+
+
+#endif // BUILD_TESTS
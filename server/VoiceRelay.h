@@ -0,0 +1,58 @@
+/*=====================================================================
+VoiceRelay.h
+------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UID.h"
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <IPAddress.h>
+#include <maths/vec3.h>
+#include <unordered_map>
+#include <vector>
+
+
+// Locations of alive avatars.  Made by the main server loop each tick, and read by UDPHandlerThread for voice relaying.
+// Immutable once made, so can be read by multiple threads.
+class AvatarLocations : public ThreadSafeRefCounted
+{
+public:
+	struct Location
+	{
+		uint32 world_index; // Identifies the world the avatar is in.  Only meaningful for comparison with other locations in the same AvatarLocations.
+		Vec3d pos;
+	};
+
+	std::unordered_map<UID, Location, UIDHasher> locations;
+};
+typedef Reference<AvatarLocations> AvatarLocationsRef;
+
+
+// A client that voice packets can be relayed to.
+struct VoiceRelayClient
+{
+	IPAddress ip_addr;
+	int UDP_port;
+	UID avatar_uid;
+	bool location_known; // False if the client avatar has not been created yet.
+	AvatarLocations::Location location;
+};
+
+
+/*=====================================================================
+VoiceRelay
+----------
+Selects the clients a voice packet is relayed to: clients whose avatar is
+in the same world as the sender's avatar, and within audible_radius of it.
+=====================================================================*/
+namespace VoiceRelay
+{
+	// Appends the indices of the clients that should receive a voice packet from clients[sender_index].  The sender does not receive its own packets.
+	// If audible_radius <= 0, all clients in the same world receive the packets.
+	void getRecipients(const std::vector<VoiceRelayClient>& clients, size_t sender_index, float audible_radius, std::vector<size_t>& recipients_out);
+
+	void test();
+}
@@ -11,6 +11,9 @@ Copyright Glare Technologies Limited 2018 -
 #include "Screenshot.h"
 #include "SubEthTransaction.h"
 #include "MeshLODGenThread.h"
+#include "IncrementalObjectSync.h"
+#include "ResourceFile.h"
+#include "ResourceDownloadScheduler.h"
 #include "../webserver/LoginHandlers.h"
 #include "../shared/Protocol.h"
 #include "../shared/ProtocolStructs.h"
@@ -41,8 +44,10 @@ Copyright Glare Technologies Limited 2018 -
 #include <maths/CheckedMaths.h>
 #include <openssl/err.h>
 #include <algorithm>
+#include <map>
 #include <RuntimeCheck.h>
 #include <Timer.h>
+#include <RefCounted.h>
 
 
 static const bool VERBOSE = false;
@@ -53,7 +58,10 @@ static const bool CAPTURE_TRACES = false; // If true, records a trace of data re
 WorkerThread::WorkerThread(const Reference<SocketInterface>& socket_, Server* server_)
 :	socket(socket_),
 	server(server_),
+	atomic_client_protocol_version(0),
 	scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder),
+	compressed_packets(SocketBufferOutStream::DontUseNetworkByteOrder),
+	compression_stats_id(0),
 	fuzzing(false),
 	write_trace(false)
 {
@@ -110,15 +118,24 @@ void WorkerThread::sendGetFileMessageIfNeeded(const std::string& resource_URL)
 }
 
 
-static void writeErrorMessageToClient(SocketInterfaceRef& socket, const std::string& msg)
+void WorkerThread::writeErrorMessageToClient(const std::string& msg)
 {
 	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 	MessageUtils::initPacket(packet, Protocol::ErrorMessageID);
 	packet.writeStringLengthFirst(msg);
 	MessageUtils::updatePacketLengthField(packet);
 
-	socket->writeData(packet.buf.data(), packet.buf.size());
-	socket->flush();
+	writeToClient(packet.buf.data(), packet.buf.size());
+	flushToClient();
+}
+
+
+// Removes a resource file and its compressed variants from the cache.
+static void invalidateCachedResource(ResourceCache& cache, const std::string& local_path)
+{
+	cache.invalidate(local_path);
+	cache.invalidate(CompressedResourceVariants::variantPath(local_path, CompressedResourceVariants::Encoding_Gzip));
+	cache.invalidate(CompressedResourceVariants::variantPath(local_path, CompressedResourceVariants::Encoding_Zstd));
 }
 
 
@@ -128,11 +145,15 @@ static void enqueuePacketToBroadcast(const SocketBufferOutStream& packet_buffer,
 	assert(packet_buffer.buf.size() > 0);
 	if(packet_buffer.buf.size() > 0)
 	{
+		// Copy the packet once into a shared frame, instead of once per client.
+		BroadcastFrameRef frame = new BroadcastFrame();
+		frame->append(packet_buffer.buf.data(), packet_buffer.buf.size());
+
 		Lock lock(server->worker_thread_manager.getMutex());
 		for(auto i = server->worker_thread_manager.getThreads().begin(); i != server->worker_thread_manager.getThreads().end(); ++i)
 		{
 			assert(dynamic_cast<WorkerThread*>(i->getPointer()));
-			static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(packet_buffer);
+			static_cast<WorkerThread*>(i->getPointer())->enqueueSharedDataToSend(frame);
 		}
 	}
 }
@@ -152,7 +173,7 @@ void WorkerThread::handleResourceUploadConnection()
 		UserID client_user_id = UserID::invalidUserID();
 		std::string client_user_name;
 		{
-			Lock lock(server->world_state->mutex);
+			InstrumentedLock lock(server->world_state->users_mutex);
 			auto res = server->world_state->name_to_users.find(username);
 			if(res != server->world_state->name_to_users.end())
 			{
@@ -201,7 +222,7 @@ void WorkerThread::handleResourceUploadConnection()
 		ResourceRef resource = server->world_state->resource_manager->getOrCreateResourceForURL(URL); // Will create a new Resource ob if not already inserted.
 
 		{
-			Lock lock(server->world_state->mutex);
+			InstrumentedLock lock(server->world_state->resources_mutex);
 			server->world_state->addResourcesAsDBDirty(resource);
 		}
 
@@ -253,6 +274,12 @@ void WorkerThread::handleResourceUploadConnection()
 		// Save to disk
 		const std::string local_path = server->world_state->resource_manager->pathForURL(URL);
 
+		// If the resource is being re-uploaded, any compressed variants of it will be out of date.
+		const bool compressible = CompressedResourceVariants::isCompressibleResource(local_path);
+		if(compressible && !fuzzing)
+			server->world_state->compressed_resource_variants.invalidateVariants(local_path);
+		invalidateCachedResource(server->world_state->resource_cache, local_path);
+
 		conPrintIfNotFuzzing("\tStreaming to disk at '" + local_path + "'...");
 
 		{
@@ -276,6 +303,7 @@ void WorkerThread::handleResourceUploadConnection()
 			file.close(); // Manually call close, to check for any errors via failbit.
 		} // End scope for FileOutStream
 
+		invalidateCachedResource(server->world_state->resource_cache, local_path); // In case the old contents were read into the cache while the file was being written.
 
 		conPrintIfNotFuzzing("\tReceived file with URL '" + URL + "' from client. (" + toString(file_len) + " B)");
 
@@ -283,7 +311,7 @@ void WorkerThread::handleResourceUploadConnection()
 		resource->setState(Resource::State_Present);
 
 		{
-			Lock lock(server->world_state->mutex);
+			InstrumentedLock lock(server->world_state->resources_mutex);
 			server->world_state->addResourcesAsDBDirty(resource);
 		}
 
@@ -297,28 +325,16 @@ void WorkerThread::handleResourceUploadConnection()
 		}
 
 
+		// Make compressed variants of the resource in the background, so they are ready when clients first download it.
+		if(compressible && !fuzzing && server->world_state->compressed_resource_variants.markGenerationQueued(local_path))
+			CompressedResourceVariants::queueGeneration(server->world_state->lod_gen_job_queue, URL, local_path);
+
 		// See if this is a resource that is used by an object.  If so, send a message to the MeshLodGenThread to generate LOD levels and KTX versions of it if applicable.
 		{
 			std::vector<UID> ob_uids; // UIDs of objects which use this resource
 			{
-				Lock lock(server->world_state->mutex);
-				for(auto world_it = server->world_state->world_states.begin(); world_it != server->world_state->world_states.end(); ++world_it)
-				{
-					ServerWorldState* world = world_it->second.ptr();
-
-					std::set<DependencyURL> URLs;
-					for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
-					{
-						const WorldObject* ob = it->second.ptr();
-						URLs.clear();
-						ob->getDependencyURLSetForAllLODLevels(URLs);
-
-						if(URLs.count(DependencyURL(URL)) > 0) // If the object uses the resource with this URL:
-						{
-							ob_uids.push_back(ob->uid);
-						}
-					}
-				}
+				InstrumentedLock lock(server->world_state->resources_mutex);
+				server->world_state->object_URL_index.appendObjectsUsingURL(URL, ob_uids);
 			}
 
 			for(size_t i=0; i<ob_uids.size(); ++i)
@@ -362,7 +378,7 @@ void WorkerThread::handleResourceDownloadConnection()
 		while(1)
 		{
 			const uint32 msg_type = socket->readUInt32();
-			if(msg_type == Protocol::GetFiles)
+			if(msg_type == Protocol::GetFiles || msg_type == Protocol::GetFilesCompressed)
 			{
 				const uint64 num_resources = socket->readUInt64();
 				
@@ -397,14 +413,41 @@ void WorkerThread::handleResourceDownloadConnection()
 
 							try
 							{
-								// Load resource off disk
-								MemMappedFile file(local_path);
+								ResourceFile file(local_path, &server->world_state->resource_cache);
+
+								// If the client accepts compressed files, send the zstd variant of the resource if it has been generated.
+								CompressedResourceVariants::Encoding encoding = CompressedResourceVariants::Encoding_Identity;
+								std::string variant_path;
+								if(msg_type == Protocol::GetFilesCompressed && CompressedResourceVariants::isCompressibleResource(local_path))
+								{
+									bool should_queue_generation;
+									encoding = server->world_state->compressed_resource_variants.findVariant(local_path, /*accepted encodings=*/1u << CompressedResourceVariants::Encoding_Zstd,
+										variant_path, should_queue_generation);
+									if(should_queue_generation && !fuzzing)
+										CompressedResourceVariants::queueGeneration(server->world_state->lod_gen_job_queue, URL, local_path);
+								}
+
 								// conPrint("\tSending file to client.");
-								socket->writeUInt32(0); // write OK msg to client
-								socket->writeUInt64(file.fileSize()); // Write file size
-								socket->writeData(file.fileData(), file.fileSize()); // Write file data
+								if(encoding == CompressedResourceVariants::Encoding_Zstd)
+								{
+									ResourceFile variant_file(variant_path, &server->world_state->resource_cache);
+									socket->writeUInt32(2); // write OK, zstd-compressed msg to client
+									socket->writeUInt64(file.fileSize()); // Write decompressed file size
+									socket->writeUInt64(variant_file.fileSize()); // Write compressed size
+									variant_file.writeToSocket(*socket); // Write compressed file data
+
+									server->world_state->compressed_resource_variants.recordResponse(encoding, variant_file.fileSize(), file.fileSize());
+									conPrintIfNotFuzzing("\tSent file '" + variant_path + "' to client. (" + toString(variant_file.fileSize()) + " B)");
+								}
+								else
+								{
+									socket->writeUInt32(0); // write OK msg to client
+									socket->writeUInt64(file.fileSize()); // Write file size
+									file.writeToSocket(*socket); // Write file data
 
-								conPrintIfNotFuzzing("\tSent file '" + local_path + "' to client. (" + toString(file.fileSize()) + " B)");
+									server->world_state->compressed_resource_variants.recordResponse(encoding, file.fileSize(), file.fileSize());
+									conPrintIfNotFuzzing("\tSent file '" + local_path + "' to client. (" + toString(file.fileSize()) + " B)");
+								}
 							}
 							catch(glare::Exception& e)
 							{
@@ -416,6 +459,11 @@ void WorkerThread::handleResourceDownloadConnection()
 					}
 				}
 			}
+			else if(msg_type == Protocol::RequestResources)
+			{
+				handleFramedResourceDownloads();
+				return;
+			}
 			else if(msg_type == Protocol::CyberspaceGoodbye)
 			{
 				socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
@@ -447,6 +495,210 @@ void WorkerThread::handleResourceDownloadConnection()
 }
 
 
+// A resource being sent on a framed download connection.
+class FramedResourceTransfer : public RefCounted
+{
+public:
+	FramedResourceTransfer(const std::string& path, ResourceCache& cache) : file(path, &cache) {}
+
+	ResourceFile file; // The resource file, or the zstd variant of it.
+	uint64 start_offset; // Offset in file of the first byte to send.
+};
+
+
+static const size_t MAX_FRAMED_TRANSFERS = 256; // Max number of resources a client can be downloading at once on a framed download connection.
+
+
+// Handles the rest of a resource download connection using the framed download protocol, after the client has sent the RequestResources message type.
+//
+// Client to server messages:
+// RequestResources:			uint32 num requests, then for each request: uint32 request id, string URL, uint64 start offset, float priority, uint32 flags (Protocol::RequestResourceFlag_AcceptZstd)
+// UpdateResourcePriorities:	uint32 num updates, then for each update: uint32 request id, float priority
+// CyberspaceGoodbye
+//
+// Server to client messages:
+// ResourceDownloadHeader:		uint32 request id, uint32 result (0 = OK, 1 = error, 2 = OK, zstd-compressed).  If not an error: uint64 file size, uint64 start offset, uint64 transfer length
+// ResourceDownloadChunk:		uint32 request id, uint32 chunk length, chunk data
+//
+// A header is sent for each request as soon as the request is read.  Then the transfer length bytes of the file (or of the zstd variant of it, for result 2),
+// starting at the start offset, are sent in chunks, interleaved with chunks of the other requested resources as decided by a ResourceDownloadScheduler.
+// The start offset allows clients to resume downloads after a disconnect.  Compressed variants are only sent if the start offset is 0.
+// The file size is the size of the uncompressed file.
+void WorkerThread::handleFramedResourceDownloads()
+{
+	conPrintIfNotFuzzing("handleFramedResourceDownloads()");
+
+	ResourceDownloadScheduler scheduler;
+	std::map<uint32, Reference<FramedResourceTransfer> > transfers; // Map from request id to transfer
+
+	uint32 msg_type = Protocol::RequestResources; // The type of the first message has already been read.
+	bool have_msg = true;
+	while(1)
+	{
+		if(have_msg)
+		{
+			if(msg_type == Protocol::RequestResources)
+			{
+				const uint32 num_requests = socket->readUInt32();
+				if(num_requests > MAX_FRAMED_TRANSFERS)
+					throw glare::Exception("Too many resources requested: " + toString(num_requests));
+
+				for(uint32 i=0; i<num_requests; ++i)
+				{
+					const uint32 request_id = socket->readUInt32();
+					const std::string URL = socket->readStringLengthFirst(MAX_STRING_LEN);
+					const uint64 start_offset = socket->readUInt64();
+					const float priority = socket->readFloat();
+					const uint32 flags = socket->readUInt32();
+
+					if(transfers.count(request_id) > 0)
+						throw glare::Exception("Resource request id " + toString(request_id) + " is already in use.");
+					if(transfers.size() >= MAX_FRAMED_TRANSFERS)
+						throw glare::Exception("Too many resources requested.");
+
+					conPrintIfNotFuzzing("\tRequested URL: '" + URL + "' (request id: " + toString(request_id) + ", start offset: " + toString(start_offset) + ")");
+
+					Reference<FramedResourceTransfer> transfer;
+					uint32 result = 1;
+					uint64 file_size = 0;
+					if(ResourceManager::isValidURL(URL))
+					{
+						const ResourceRef resource = server->world_state->resource_manager->getExistingResourceForURL(URL);
+						if(resource.nonNull() && (resource->getState() == Resource::State_Present))
+						{
+							const std::string local_path = server->world_state->resource_manager->getLocalAbsPathForResource(*resource);
+							try
+							{
+								transfer = new FramedResourceTransfer(local_path, server->world_state->resource_cache);
+								file_size = transfer->file.fileSize();
+								bool compressed = false;
+
+								// If the client accepts compressed files, and isn't resuming a download, send the zstd variant of the resource if it has been generated.
+								if((flags & Protocol::RequestResourceFlag_AcceptZstd) && (start_offset == 0) && CompressedResourceVariants::isCompressibleResource(local_path))
+								{
+									std::string variant_path;
+									bool should_queue_generation;
+									const CompressedResourceVariants::Encoding encoding = server->world_state->compressed_resource_variants.findVariant(local_path,
+										/*accepted encodings=*/1u << CompressedResourceVariants::Encoding_Zstd, variant_path, should_queue_generation);
+									if(should_queue_generation && !fuzzing)
+										CompressedResourceVariants::queueGeneration(server->world_state->lod_gen_job_queue, URL, local_path);
+
+									if(encoding == CompressedResourceVariants::Encoding_Zstd)
+									{
+										transfer = new FramedResourceTransfer(variant_path, server->world_state->resource_cache);
+										compressed = true;
+									}
+								}
+
+								if(start_offset <= file_size)
+								{
+									transfer->start_offset = start_offset;
+									result = compressed ? 2 : 0;
+								}
+								else
+									conPrintIfNotFuzzing("\tStart offset is past the end of the file.");
+							}
+							catch(glare::Exception& e)
+							{
+								conPrintIfNotFuzzing("\tException while trying to load file for URL: " + e.what());
+							}
+						}
+						else
+							conPrintIfNotFuzzing("\tRequested URL was not present on disk.");
+					}
+					else
+						conPrintIfNotFuzzing("\tRequested URL was invalid.");
+
+					scratch_packet.buf.resize(0);
+					scratch_packet.writeUInt32(Protocol::ResourceDownloadHeader);
+					scratch_packet.writeUInt32(request_id);
+					scratch_packet.writeUInt32(result);
+					if(result != 1)
+					{
+						const uint64 transfer_len = transfer->file.fileSize() - transfer->start_offset;
+						scratch_packet.writeUInt64(file_size);
+						scratch_packet.writeUInt64(transfer->start_offset);
+						scratch_packet.writeUInt64(transfer_len);
+
+						server->world_state->compressed_resource_variants.recordResponse((result == 2) ? CompressedResourceVariants::Encoding_Zstd : CompressedResourceVariants::Encoding_Identity,
+							transfer_len, file_size - transfer->start_offset);
+
+						if(transfer_len > 0)
+						{
+							scheduler.addTransfer(request_id, priority, transfer_len);
+							transfers[request_id] = transfer;
+						}
+					}
+					socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				}
+			}
+			else if(msg_type == Protocol::UpdateResourcePriorities)
+			{
+				const uint32 num_updates = socket->readUInt32();
+				if(num_updates > MAX_FRAMED_TRANSFERS)
+					throw glare::Exception("Too many priority updates: " + toString(num_updates));
+
+				for(uint32 i=0; i<num_updates; ++i)
+				{
+					const uint32 request_id = socket->readUInt32();
+					const float priority = socket->readFloat();
+					scheduler.setPriority(request_id, priority); // The transfer may have finished already, in which case this does nothing.
+				}
+			}
+			else if(msg_type == Protocol::CyberspaceGoodbye)
+			{
+				socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
+				socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
+				return;
+			}
+			else
+			{
+				conPrintIfNotFuzzing("handleFramedResourceDownloads(): Unhandled msg type: " + toString(msg_type));
+				return;
+			}
+		}
+
+		// Send the next chunk, if there are any transfers in progress.
+		uint32 request_id;
+		uint64 offset;
+		size_t chunk_size;
+		bool transfer_finished;
+		if(scheduler.nextChunk(request_id, offset, chunk_size, transfer_finished))
+		{
+			auto res = transfers.find(request_id);
+			runtimeCheck(res != transfers.end());
+			FramedResourceTransfer* transfer = res->second.ptr();
+
+			scratch_packet.buf.resize(0);
+			scratch_packet.writeUInt32(Protocol::ResourceDownloadChunk);
+			scratch_packet.writeUInt32(request_id);
+			scratch_packet.writeUInt32((uint32)chunk_size);
+			socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+
+			transfer->file.writeRangeToSocket(*socket, transfer->start_offset + offset, chunk_size);
+
+			if(transfer_finished)
+			{
+				conPrintIfNotFuzzing("\tFinished sending request " + toString(request_id) + " to client. (" + toString(transfer->file.fileSize() - transfer->start_offset) + " B)");
+				transfers.erase(res);
+			}
+		}
+
+		// Read any message from the client.  If there is nothing left to send, block until the client sends one.
+		if(scheduler.empty())
+		{
+			socket->flush();
+			have_msg = true;
+		}
+		else
+			have_msg = socket->readable(/*timeout (s)=*/0.0);
+
+		if(have_msg)
+			msg_type = socket->readUInt32();
+	}
+}
+
+
 void WorkerThread::handleScreenshotBotConnection()
 {
 	conPrintIfNotFuzzing("handleScreenshotBotConnection()");
@@ -463,7 +715,7 @@ void WorkerThread::handleScreenshotBotConnection()
 			ScreenshotRef screenshot;
 
 			{ // lock scope
-				Lock lock(server->world_state->mutex);
+				InstrumentedLock lock(server->world_state->mutex);
 
 				server->world_state->last_screenshot_bot_contact_time = TimeStamp::currentTime();
 
@@ -559,7 +811,7 @@ void WorkerThread::handleScreenshotBotConnection()
 						resource->setState(Resource::State_Present);
 
 						{
-							Lock lock(server->world_state->mutex);
+							InstrumentedLock lock(server->world_state->resources_mutex);
 							server->world_state->addResourcesAsDBDirty(resource);
 						}
 
@@ -571,7 +823,7 @@ void WorkerThread::handleScreenshotBotConnection()
 					screenshot->local_path = screenshot_path;
 
 					{
-						Lock lock(server->world_state->mutex);
+						InstrumentedLock lock(server->world_state->mutex);
 						server->world_state->addScreenshotAsDBDirty(screenshot);
 
 						if(screenshot->is_map_tile) // If we received a tile screenshot, mark map tile info as dirty to get it saved.
@@ -620,7 +872,7 @@ void WorkerThread::handleEthBotConnection()
 			SubEthTransactionRef trans;
 			uint64 largest_nonce_used = 0; 
 			{ // lock scope
-				Lock lock(server->world_state->mutex);
+				InstrumentedLock lock(server->world_state->mutex);
 
 				server->world_state->last_eth_bot_contact_time = TimeStamp::currentTime();
 
@@ -650,7 +902,7 @@ void WorkerThread::handleEthBotConnection()
 
 				// Update transaction nonce and submitted_time
 				{ // lock scope
-					Lock lock(server->world_state->mutex);
+					InstrumentedLock lock(server->world_state->mutex);
 
 					trans->nonce = next_nonce; 
 					trans->submitted_time = TimeStamp::currentTime();
@@ -670,19 +922,22 @@ void WorkerThread::handleEthBotConnection()
 
 					// Mark parcel as minted as an NFT
 					{ // lock scope
-						Lock lock(server->world_state->mutex);
+						InstrumentedLock lock(server->world_state->mutex);
 
 						trans->state = SubEthTransaction::State_Completed; // State_Submitted;
 						trans->transaction_hash = transaction_hash;
 
 						server->world_state->addSubEthTransactionAsDBDirty(trans);
 
-						auto parcel_res = server->world_state->getRootWorldState()->parcels.find(trans->parcel_id);
-						if(parcel_res != server->world_state->getRootWorldState()->parcels.end())
+						Reference<ServerWorldState> root_world = server->world_state->getRootWorldState();
+						InstrumentedLock world_lock(root_world->mutex);
+
+						auto parcel_res = root_world->parcels.find(trans->parcel_id);
+						if(parcel_res != root_world->parcels.end())
 						{
 							Parcel* parcel = parcel_res->second.ptr();
 							parcel->nft_status = Parcel::NFTStatus_MintedNFT;
-							server->world_state->getRootWorldState()->addParcelAsDBDirty(parcel);
+							root_world->addParcelAsDBDirty(parcel);
 							server->world_state->markAsChanged();
 						}
 					} // End lock scope
@@ -694,7 +949,7 @@ void WorkerThread::handleEthBotConnection()
 					const std::string submission_error_message = socket->readStringLengthFirst(10000);
 
 					{ // lock scope
-						Lock lock(server->world_state->mutex);
+						InstrumentedLock lock(server->world_state->mutex);
 
 						trans->state = SubEthTransaction::State_Submitted;
 						trans->transaction_hash = UInt256(0);
@@ -727,7 +982,185 @@ void WorkerThread::handleEthBotConnection()
 }
 
 
-static bool objectIsInParcelForWhichLoggedInUserHasWritePerms(const WorldObject& ob, const UserID& user_id, ServerWorldState& world_state)
+static const size_t MAX_REPLICATION_ENTRIES_PER_BATCH = 64;
+static const double REPLICATION_HEARTBEAT_PERIOD = 5.0; // Send a ReplicationHeartbeat if there have been no log entries for this long.  In seconds.
+
+
+// Writes the URL and local path of all resources whose files are present, for a replication follower to download any it doesn't have.
+static void writePresentResources(SocketInterface& socket, ResourceManager& resource_manager)
+{
+	std::vector<DatabaseSnapshot::PresentResource> present_resources;
+	{
+		Lock lock(resource_manager.getMutex());
+
+		for(auto it = resource_manager.getResourcesForURL().begin(); it != resource_manager.getResourcesForURL().end(); ++it)
+		{
+			const Resource* resource = it->second.ptr();
+			if(resource->getState() == Resource::State_Present)
+				present_resources.push_back(DatabaseSnapshot::PresentResource({resource->URL, resource->getRawLocalPath()}));
+		}
+	}
+
+	socket.writeUInt64(present_resources.size());
+	for(size_t i=0; i<present_resources.size(); ++i)
+	{
+		socket.writeStringLengthFirst(present_resources[i].URL);
+		socket.writeStringLengthFirst(present_resources[i].local_path);
+	}
+}
+
+
+// Handles a connection from a replication follower (backup_bot), which keeps a copy of the database and resources up to date.  See ReplicationLog.h
+//
+// Follower to server, after the connection type:
+// string password (the replication_password credential), uint64 epoch, uint64 seq num of the last log entry the follower has applied.  Epoch is 0 if the follower has no checkpoint.
+//
+// Server to follower messages:
+// ReplicationFullSync:		uint64 epoch, uint64 seq num, uint64 database file size, database file data, uint64 num present resources, then for each resource: string URL, string local path
+// ReplicationResumed:		uint64 epoch, uint64 num present resources, then for each resource: string URL, string local path
+// ReplicationLogEntry:		uint64 seq num, uint64 num record deletions, then for each: uint64 key.  uint64 num record updates, then for each: uint64 key, uint64 size, record data.
+//							uint64 num present resources, then for each: string URL, string local path
+// ReplicationHeartbeat
+//
+// If the follower's checkpoint is from this epoch and the entries after it are still in the log, the server sends ReplicationResumed, otherwise ReplicationFullSync.
+// Then log entries are sent as the DatabaseWriterThread writes them.  If the follower falls so far behind that the next entry it needs is evicted from the log,
+// another ReplicationFullSync is sent.
+// Local paths of resources are relative to the server resources dir.  Resource files are downloaded by the follower on a ConnectionTypeDownloadResources connection.
+// All present resources are listed on each connection, so the follower doesn't need to keep track of resources it hasn't downloaded yet.
+void WorkerThread::handleReplicationConnection()
+{
+	conPrintIfNotFuzzing("handleReplicationConnection()");
+
+	std::string db_copy_path;
+	try
+	{
+		// Do authentication
+		const std::string password = socket->readStringLengthFirst(MAX_STRING_LEN);
+		if(password != server->world_state->getCredential("replication_password"))
+			throw glare::Exception("replication password was not correct.");
+
+		const uint64 follower_epoch = socket->readUInt64();
+		uint64 seq_num = socket->readUInt64(); // Seq num of the last log entry the follower has.
+
+		ReplicationLog& log = server->world_state->replication_log;
+
+		std::vector<ReplicationLog::Entry> entries;
+		bool need_full_sync = (follower_epoch != log.getEpoch()) || !log.getEntriesAfter(seq_num, /*max num entries=*/1, /*max wait time=*/0, entries);
+		if(!need_full_sync)
+		{
+			conPrint("handleReplicationConnection: Resuming replication after seq num " + toString(seq_num));
+			socket->writeUInt32(Protocol::ReplicationResumed);
+			socket->writeUInt64(log.getEpoch());
+			writePresentResources(*socket, *server->world_state->resource_manager);
+			socket->flush();
+		}
+
+		while(1)
+		{
+			if(need_full_sync)
+			{
+				Timer timer;
+				db_copy_path = server->world_state->copyDatabaseFileForReplication("_replication_" + toString((uint64)this) + ".tmp", seq_num);
+
+				socket->writeUInt32(Protocol::ReplicationFullSync);
+				socket->writeUInt64(log.getEpoch());
+				socket->writeUInt64(seq_num);
+				uint64 db_file_size;
+				{
+					ResourceFile file(db_copy_path); // Not using the resource cache, as the file is only sent once.
+					db_file_size = file.fileSize();
+					socket->writeUInt64(db_file_size);
+					file.writeToSocket(*socket);
+				}
+
+				FileUtils::deleteFile(db_copy_path);
+				db_copy_path.clear();
+
+				// Any resources that become present after this will be in log entries after seq_num.
+				writePresentResources(*socket, *server->world_state->resource_manager);
+				socket->flush();
+
+				conPrint("handleReplicationConnection: Sent full sync at seq num " + toString(seq_num) + " (database: " + toString(db_file_size) + " B) in " + timer.elapsedStringNSigFigs(4));
+
+				need_full_sync = false;
+			}
+
+			if(!log.getEntriesAfter(seq_num, MAX_REPLICATION_ENTRIES_PER_BATCH, /*max wait time=*/REPLICATION_HEARTBEAT_PERIOD, entries))
+			{
+				conPrint("handleReplicationConnection: Follower fell behind the replication log, sending full sync.");
+				need_full_sync = true;
+				continue;
+			}
+
+			if(entries.empty())
+				socket->writeUInt32(Protocol::ReplicationHeartbeat);
+
+			for(size_t i=0; i<entries.size(); ++i)
+			{
+				const DatabaseSnapshot& snapshot = *entries[i].snapshot;
+
+				socket->writeUInt32(Protocol::ReplicationLogEntry);
+				socket->writeUInt64(entries[i].seq_num);
+
+				socket->writeUInt64(snapshot.records_to_delete.size());
+				for(size_t z=0; z<snapshot.records_to_delete.size(); ++z)
+					socket->writeUInt64(snapshot.records_to_delete[z].value());
+
+				socket->writeUInt64(snapshot.record_updates.size());
+				for(size_t z=0; z<snapshot.record_updates.size(); ++z)
+				{
+					const DatabaseSnapshot::RecordUpdate& update = snapshot.record_updates[z];
+					socket->writeUInt64(update.key.value());
+					socket->writeUInt64(update.size);
+					socket->writeData(snapshot.data.buf.data() + update.offset, update.size);
+				}
+
+				socket->writeUInt64(snapshot.present_resources.size());
+				for(size_t z=0; z<snapshot.present_resources.size(); ++z)
+				{
+					socket->writeStringLengthFirst(snapshot.present_resources[z].URL);
+					socket->writeStringLengthFirst(snapshot.present_resources[z].local_path);
+				}
+
+				seq_num = entries[i].seq_num;
+			}
+			entries.clear(); // Release our references to the snapshots, so they can be freed when evicted from the log.
+
+			socket->flush();
+		}
+	}
+	catch(MySocketExcep& e)
+	{
+		if(e.excepType() == MySocketExcep::ExcepType_ConnectionClosedGracefully)
+			conPrint("Replication follower from " + IPAddress::formatIPAddressAndPort(socket->getOtherEndIPAddress(), socket->getOtherEndPort()) + " closed connection gracefully.");
+		else
+			conPrint("handleReplicationConnection: Socket error: " + e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrintIfNotFuzzing("handleReplicationConnection: glare::Exception: " + e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("handleReplicationConnection: FileUtilsExcep: " + e.what());
+	}
+
+	// Delete the database copy if we were interrupted while sending it.
+	if(!db_copy_path.empty())
+	{
+		try
+		{
+			FileUtils::deleteFile(db_copy_path);
+		}
+		catch(FileUtils::FileUtilsExcep& e)
+		{
+			conPrint("handleReplicationConnection: Failed to delete '" + db_copy_path + "': " + e.what());
+		}
+	}
+}
+
+
+static bool objectIsInParcelForWhichLoggedInUserHasWritePerms(const WorldObject& ob, const UserID& user_id, ServerWorldState& world_state) REQUIRES(world_state.mutex)
 {
 	assert(user_id.valid());
 
@@ -745,7 +1178,7 @@ static bool objectIsInParcelForWhichLoggedInUserHasWritePerms(const WorldObject&
 
 
 // NOTE: world state mutex should be locked before calling this method.
-static bool userHasObjectWritePermissions(const WorldObject& ob, const UserID& user_id, const std::string& user_name, const std::string& connected_world_name, ServerWorldState& world_state, bool allow_light_mapper_bot_full_perms)
+static bool userHasObjectWritePermissions(const WorldObject& ob, const UserID& user_id, const std::string& user_name, const std::string& connected_world_name, ServerWorldState& world_state, bool allow_light_mapper_bot_full_perms) REQUIRES(world_state.mutex)
 {
 	if(user_id.valid())
 	{
@@ -820,6 +1253,7 @@ void WorkerThread::doRun()
 		// Read protocol version
 		const uint32 client_protocol_version = socket->readUInt32();
 		conPrintIfNotFuzzing("client protocol version: " + toString(client_protocol_version));
+		atomic_client_protocol_version = client_protocol_version;
 		if(client_protocol_version < 38) // We can't handle protocol versions < 38
 		{
 			socket->writeUInt32(Protocol::ClientProtocolTooOld);
@@ -855,6 +1289,10 @@ void WorkerThread::doRun()
 		{
 			handleEthBotConnection();
 		}
+		else if(connection_type == Protocol::ConnectionTypeReplication)
+		{
+			handleReplicationConnection();
+		}
 		else if(connection_type == Protocol::ConnectionTypeUpdates)
 		{
 			if(CAPTURE_TRACES)
@@ -866,16 +1304,18 @@ void WorkerThread::doRun()
 			
 
 			{
-				Lock lock(world_state->mutex);
 				// Create world if didn't exist before.
 				// For now only the main world ("") and personal worlds are allowed
 				if(world_name == "")
 				{}
-				else if(world_state->name_to_users.find(world_name) != world_state->name_to_users.end()) // Else if world_name is a user name, it's valid
-				{}
 				else
-					throw glare::Exception("Invalid world name '" + world_name + "'.");
+				{
+					InstrumentedLock lock(world_state->users_mutex);
+					if(world_state->name_to_users.find(world_name) == world_state->name_to_users.end()) // If world_name is a user name, it's valid
+						throw glare::Exception("Invalid world name '" + world_name + "'.");
+				}
 
+				InstrumentedLock lock(world_state->mutex);
 				if(world_state->world_states[world_name].isNull())
 					world_state->world_states[world_name] = new ServerWorldState();
 				cur_world_state = world_state->world_states[world_name];
@@ -886,11 +1326,15 @@ void WorkerThread::doRun()
 			// Write avatar UID assigned to the connected client.
 			client_avatar_uid = world_state->getNextAvatarUID();
 			writeToStream(client_avatar_uid, *socket);
+			{
+				Lock lock(avatar_uid_mutex);
+				assigned_avatar_uid = client_avatar_uid;
+			}
 
 			// If the client connected via a websocket, they can be logged in with a session cookie.
 			// Note that this may only work if the websocket connects over TLS.
 			{
-				Lock lock(world_state->mutex);
+				InstrumentedLock lock(world_state->users_mutex);
 				User* cookie_logged_in_user = LoginHandlers::getLoggedInUser(*world_state, this->websocket_request_info);
 	
 				if(cookie_logged_in_user != NULL)
@@ -927,7 +1371,7 @@ void WorkerThread::doRun()
 			// Send a ServerAdminMessage to client if we have a non-empty message.
 			std::string server_admin_msg;
 			{ // Lock scope
-				Lock lock(world_state->mutex);
+				InstrumentedLock lock(world_state->mutex);
 				server_admin_msg = world_state->server_admin_message;
 			} // End lock scope
 			if(!server_admin_msg.empty())
@@ -944,7 +1388,10 @@ void WorkerThread::doRun()
 			{
 				MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsInitialSendMessage);
 
-				cur_world_state->world_settings.writeToStream(scratch_packet);
+				{
+					InstrumentedLock lock(cur_world_state->mutex);
+					cur_world_state->world_settings.writeToStream(scratch_packet);
+				}
 
 				MessageUtils::updatePacketLengthField(scratch_packet);
 				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
@@ -956,7 +1403,7 @@ void WorkerThread::doRun()
 				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
 				{ // Lock scope
-					Lock lock(world_state->mutex);
+					InstrumentedLock lock(cur_world_state->mutex);
 					for(auto it = cur_world_state->avatars.begin(); it != cur_world_state->avatars.end(); ++it)
 					{
 						const Avatar* avatar = it->second.getPointer();
@@ -975,7 +1422,7 @@ void WorkerThread::doRun()
 
 			// Send all current object data to client
 			/*{
-				Lock lock(world_state->mutex);
+				InstrumentedLock lock(world_state->mutex);
 				for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
 				{
 					const WorldObject* ob = it->second.getPointer();
@@ -993,7 +1440,7 @@ void WorkerThread::doRun()
 				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
 				{ // Lock scope
-					Lock lock(world_state->mutex);
+					InstrumentedLock lock(cur_world_state->mutex);
 					for(auto it = cur_world_state->parcels.begin(); it != cur_world_state->parcels.end(); ++it)
 					{
 						const Parcel* parcel = it->second.getPointer();
@@ -1030,24 +1477,36 @@ void WorkerThread::doRun()
 				// See if we have any pending data to send in the data_to_send queue, and if so, send all pending data.
 				if(VERBOSE) conPrint("WorkerThread: checking for pending data to send...");
 
-				// We don't want to do network writes while holding the data_to_send_mutex.  So copy to temp_data_to_send.
-				{
-					Lock lock(data_to_send_mutex);
-					temp_data_to_send = data_to_send;
-					data_to_send.clear();
-				}
+				// We don't want to do network writes while holding the data_to_send_mutex.  So take the data into temp_data_to_send and temp_shared_frames_to_send.
+				takeDataToSend(temp_data_to_send, temp_shared_frames_to_send);
 
-				if(temp_data_to_send.nonEmpty())
+				if(temp_data_to_send.nonEmpty() || !temp_shared_frames_to_send.empty())
 				{
-					socket->writeData(temp_data_to_send.data(), temp_data_to_send.size());
-					socket->flush();
+					// Write the non-shared data, with the shared frames interleaved at the positions they were enqueued at.
+					// Shared frames are written straight from the frame buffer, without copying.
+					size_t data_i = 0;
+					for(size_t z=0; z<temp_shared_frames_to_send.size(); ++z)
+					{
+						const QueuedSharedFrame& queued_frame = temp_shared_frames_to_send[z];
+						if(queued_frame.data_offset > data_i)
+						{
+							writeToClient(&temp_data_to_send[data_i], queued_frame.data_offset - data_i);
+							data_i = queued_frame.data_offset;
+						}
+						writeToClient(queued_frame.frame->data.data(), queued_frame.frame->data.size());
+					}
+					if(data_i < temp_data_to_send.size())
+						writeToClient(&temp_data_to_send[data_i], temp_data_to_send.size() - data_i);
+
+					flushToClient();
 					temp_data_to_send.clear();
+					temp_shared_frames_to_send.clear(); // Release our references to the frames.
 				}
 
 
 				if(logged_in_user_is_lightmapper_bot)
 				{
-					Lock lock(server->world_state->mutex);
+					InstrumentedLock lock(server->world_state->mutex);
 					server->world_state->last_lightmapper_bot_contact_time = TimeStamp::currentTime(); // bit of a hack
 				}
 
@@ -1141,7 +1600,7 @@ void WorkerThread::doRun()
 
 							// Look up existing avatar in world state
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(cur_world_state->mutex); // Just the per-world lock is needed for avatar state.
 								auto res = cur_world_state->avatars.find(avatar_uid);
 								if(res != cur_world_state->avatars.end())
 								{
@@ -1150,6 +1609,8 @@ void WorkerThread::doRun()
 									avatar->rotation = rotation;
 									avatar->anim_state = anim_state;
 									avatar->transform_dirty = true;
+									cur_world_state->dirty_from_remote_avatars.insert(avatar);
+									world_state->notifyBroadcastNeeded();
 
 									//conPrint("updated avatar transform");
 								}
@@ -1166,7 +1627,7 @@ void WorkerThread::doRun()
 
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to perform a gesture.");
+								writeErrorMessageToClient("You must be logged in to perform a gesture.");
 							}
 							else
 							{
@@ -1187,7 +1648,7 @@ void WorkerThread::doRun()
 
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to stop a gesture.");
+								writeErrorMessageToClient("You must be logged in to stop a gesture.");
 							}
 							else
 							{
@@ -1210,13 +1671,15 @@ void WorkerThread::doRun()
 
 							// Look up existing avatar in world state
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock world_lock(cur_world_state->mutex);
 								auto res = cur_world_state->avatars.find(avatar_uid);
 								if(res != cur_world_state->avatars.end())
 								{
 									Avatar* avatar = res->second.getPointer();
 									avatar->copyNetworkStateFrom(temp_avatar);
 									avatar->other_dirty = true;
+									cur_world_state->dirty_from_remote_avatars.insert(avatar);
+									world_state->notifyBroadcastNeeded();
 
 
 									// Store avatar settings in the user data
@@ -1228,6 +1691,7 @@ void WorkerThread::doRun()
 										{
 											client_user_avatar_settings = avatar->avatar_settings;
 
+											InstrumentedLock users_lock(world_state->users_mutex);
 											auto res2 = world_state->user_id_to_users.find(client_user_id);
 											if(res2 != world_state->user_id_to_users.end())
 											{
@@ -1272,7 +1736,7 @@ void WorkerThread::doRun()
 
 							// Look up existing avatar in world state
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(cur_world_state->mutex);
 								auto res = cur_world_state->avatars.find(use_avatar_uid);
 								if(res == cur_world_state->avatars.end())
 								{
@@ -1282,6 +1746,8 @@ void WorkerThread::doRun()
 									avatar->copyNetworkStateFrom(temp_avatar);
 									avatar->state = Avatar::State_JustCreated;
 									avatar->other_dirty = true;
+									cur_world_state->dirty_from_remote_avatars.insert(avatar);
+									world_state->notifyBroadcastNeeded();
 									cur_world_state->avatars.insert(std::make_pair(use_avatar_uid, avatar));
 
 									conPrintIfNotFuzzing("created new avatar");
@@ -1308,13 +1774,15 @@ void WorkerThread::doRun()
 
 							// Mark avatar as dead
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(cur_world_state->mutex);
 								auto res = cur_world_state->avatars.find(avatar_uid);
 								if(res != cur_world_state->avatars.end())
 								{
 									Avatar* avatar = res->second.getPointer();
 									avatar->state = Avatar::State_Dead;
 									avatar->other_dirty = true;
+									cur_world_state->dirty_from_remote_avatars.insert(avatar);
+									world_state->notifyBroadcastNeeded();
 								}
 							}
 							break;
@@ -1366,18 +1834,18 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse object modification.
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
+								writeErrorMessageToClient("You must be logged in to modify an object.");
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+								writeErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
 							}
 							else
 							{
 								std::string err_msg_to_client;
 								// Look up existing object in world state
 								{
-									Lock lock(world_state->mutex);
+									InstrumentedLock lock(cur_world_state->mutex);
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1394,10 +1862,12 @@ void WorkerThread::doRun()
 											ob->scale = scale;
 											ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
 											ob->last_modified_time = TimeStamp::currentTime();
+											cur_world_state->object_grid.objectMoved(ob);
 
 											ob->from_remote_transform_dirty = true;
 											cur_world_state->addWorldObjectAsDBDirty(ob);
 											cur_world_state->dirty_from_remote_objects.insert(ob);
+											world_state->notifyBroadcastNeeded();
 
 											world_state->markAsChanged();
 										}
@@ -1407,7 +1877,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
+									writeErrorMessageToClient(err_msg_to_client);
 							}
 
 							break;
@@ -1421,18 +1891,18 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse object modification.
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to summon an object.");
+								writeErrorMessageToClient("You must be logged in to summon an object.");
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+								writeErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
 							}
 							else
 							{
 								std::string err_msg_to_client;
 								bool send_summon_object_msg = false;
 								{
-									Lock lock(world_state->mutex);
+									InstrumentedLock lock(cur_world_state->mutex);
 									auto res = cur_world_state->objects.find(summon_msg.object_uid); // Look up existing object in world state
 									if(res != cur_world_state->objects.end())
 									{
@@ -1452,6 +1922,7 @@ void WorkerThread::doRun()
 												ob->angle = summon_msg.angle;
 												ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
 												ob->last_modified_time = TimeStamp::currentTime();
+												cur_world_state->object_grid.objectMoved(ob);
 
 												cur_world_state->addWorldObjectAsDBDirty(ob); // Object state has changed, so save to DB.
 												world_state->markAsChanged();
@@ -1463,7 +1934,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
+									writeErrorMessageToClient(err_msg_to_client);
 
 								if(send_summon_object_msg)
 								{
@@ -1498,19 +1969,19 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse object modification.
 							/*if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
+								writeErrorMessageToClient("You must be logged in to modify an object.");
 							}
 							*/
 							if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+								writeErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
 							}
 							else
 							{
 								std::string err_msg_to_client;
 								// Look up existing object in world state
 								{
-									Lock lock(world_state->mutex);
+									InstrumentedLock lock(cur_world_state->mutex);
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1535,10 +2006,12 @@ void WorkerThread::doRun()
 											ob->last_transform_client_time = client_cur_time;
 
 											ob->last_modified_time = TimeStamp::currentTime();
+											cur_world_state->object_grid.objectMoved(ob);
 
 											ob->from_remote_physics_transform_dirty = true;
 											cur_world_state->addWorldObjectAsDBDirty(ob);
 											cur_world_state->dirty_from_remote_objects.insert(ob);
+											world_state->notifyBroadcastNeeded();
 
 											world_state->markAsChanged();
 										}
@@ -1546,7 +2019,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
+									writeErrorMessageToClient(err_msg_to_client);
 							}
 
 							break;
@@ -1562,18 +2035,19 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse object modification.
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
+								writeErrorMessageToClient("You must be logged in to modify an object.");
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+								writeErrorMessageToClient("Server is in read-only mode, you can't modify an object right now.");
 							}
 							else
 							{
 								// Look up existing object in world state
 								bool send_must_be_owner_msg = false;
+								bool check_voxel_mesh = false;
 								{
-									Lock lock(world_state->mutex);
+									InstrumentedLock lock(cur_world_state->mutex);
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1592,10 +2066,16 @@ void WorkerThread::doRun()
 											ob->audio_volume = myClamp(ob->audio_volume, 0.f, maxAudioVolumeForObject(*ob, client_user_id, client_user_name, this->connected_world_name));
 
 											ob->last_modified_time = TimeStamp::currentTime();
+											cur_world_state->object_grid.objectMoved(ob); // Position may have changed.
+											{
+												InstrumentedLock resources_lock(world_state->resources_mutex);
+												world_state->object_URL_index.updateObject(ob); // URLs may have changed.
+											}
 
 											ob->from_remote_other_dirty = true;
 											cur_world_state->addWorldObjectAsDBDirty(ob);
 											cur_world_state->dirty_from_remote_objects.insert(ob);
+											world_state->notifyBroadcastNeeded();
 
 											world_state->markAsChanged();
 
@@ -1605,12 +2085,22 @@ void WorkerThread::doRun()
 											ob->getDependencyURLSetBaseLevel(options, URLs);
 											for(auto it = URLs.begin(); it != URLs.end(); ++it)
 												sendGetFileMessageIfNeeded(it->URL);
+
+											check_voxel_mesh = ob->object_type == WorldObject::ObjectType_VoxelGroup; // Voxels or materials may have changed.
 										}
 									}
 								} // End lock scope
 
 								if(send_must_be_owner_msg)
-									writeErrorMessageToClient(socket, "You must be the owner of this object to change it.");
+									writeErrorMessageToClient("You must be the owner of this object to change it.");
+
+								if(check_voxel_mesh && !fuzzing)
+								{
+									// Get the MeshLODGenThread to mesh the new voxels, if they have changed.
+									CheckGenResourcesForObject* msg = new CheckGenResourcesForObject();
+									msg->ob_uid = object_uid;
+									server->enqueueMsgForLodGenThread(msg);
+								}
 							}
 							break;
 						}
@@ -1622,7 +2112,7 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(cur_world_state->mutex);
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
@@ -1632,10 +2122,15 @@ void WorkerThread::doRun()
 									{
 										ob->lightmap_url = new_lightmap_url;
 										ob->last_modified_time = TimeStamp::currentTime();
+										{
+											InstrumentedLock resources_lock(world_state->resources_mutex);
+											world_state->object_URL_index.updateObject(ob);
+										}
 
 										ob->from_remote_lightmap_url_dirty = true;
 										cur_world_state->addWorldObjectAsDBDirty(ob);
 										cur_world_state->dirty_from_remote_objects.insert(ob);
+										world_state->notifyBroadcastNeeded();
 
 										world_state->markAsChanged();
 									}
@@ -1651,7 +2146,7 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(cur_world_state->mutex);
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
@@ -1661,10 +2156,15 @@ void WorkerThread::doRun()
 									{
 										ob->model_url = new_model_url;
 										ob->last_modified_time = TimeStamp::currentTime();
+										{
+											InstrumentedLock resources_lock(world_state->resources_mutex);
+											world_state->object_URL_index.updateObject(ob);
+										}
 
 										ob->from_remote_model_url_dirty = true;
 										cur_world_state->addWorldObjectAsDBDirty(ob);
 										cur_world_state->dirty_from_remote_objects.insert(ob);
+										world_state->notifyBroadcastNeeded();
 
 										world_state->markAsChanged();
 									}
@@ -1680,7 +2180,7 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(cur_world_state->mutex);
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
@@ -1694,6 +2194,7 @@ void WorkerThread::doRun()
 										ob->from_remote_flags_dirty = true;
 										cur_world_state->addWorldObjectAsDBDirty(ob);
 										cur_world_state->dirty_from_remote_objects.insert(ob);
+										world_state->notifyBroadcastNeeded();
 
 										world_state->markAsChanged();
 									}
@@ -1711,7 +2212,7 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(cur_world_state->mutex);
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
@@ -1755,12 +2256,12 @@ void WorkerThread::doRun()
 								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
 								scratch_packet.writeStringLengthFirst("You must be logged in to create an object.");
 								MessageUtils::updatePacketLengthField(scratch_packet);
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't create an object right now.");
+								writeErrorMessageToClient("Server is in read-only mode, you can't create an object right now.");
 							}
 							else
 							{
@@ -1777,17 +2278,31 @@ void WorkerThread::doRun()
 
 								// Insert object into world state
 								{
-									::Lock lock(world_state->mutex);
+									::InstrumentedLock lock(cur_world_state->mutex);
 
 									new_ob->uid = world_state->getNextObjectUID();
 									new_ob->state = WorldObject::State_JustCreated;
 									new_ob->from_remote_other_dirty = true;
 									cur_world_state->addWorldObjectAsDBDirty(new_ob);
 									cur_world_state->dirty_from_remote_objects.insert(new_ob);
+									world_state->notifyBroadcastNeeded();
 									cur_world_state->objects.insert(std::make_pair(new_ob->uid, new_ob));
+									cur_world_state->object_grid.insert(new_ob.ptr());
+									{
+										InstrumentedLock resources_lock(world_state->resources_mutex);
+										world_state->object_URL_index.updateObject(new_ob.ptr());
+									}
 
 									world_state->markAsChanged();
 								}
+
+								if((new_ob->object_type == WorldObject::ObjectType_VoxelGroup) && !fuzzing)
+								{
+									// Get the MeshLODGenThread to mesh the voxels.
+									CheckGenResourcesForObject* msg = new CheckGenResourcesForObject();
+									msg->ob_uid = new_ob->uid;
+									server->enqueueMsgForLodGenThread(msg);
+								}
 							}
 
 							break;
@@ -1800,17 +2315,17 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse object modification.
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to destroy an object.");
+								writeErrorMessageToClient("You must be logged in to destroy an object.");
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't destroy an object right now.");
+								writeErrorMessageToClient("Server is in read-only mode, you can't destroy an object right now.");
 							}
 							else
 							{
 								bool send_must_be_owner_msg = false;
 								{
-									Lock lock(world_state->mutex);
+									InstrumentedLock lock(cur_world_state->mutex);
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1827,6 +2342,7 @@ void WorkerThread::doRun()
 											ob->from_remote_other_dirty = true;
 											cur_world_state->addWorldObjectAsDBDirty(ob);
 											cur_world_state->dirty_from_remote_objects.insert(ob);
+											world_state->notifyBroadcastNeeded();
 
 											world_state->markAsChanged();
 										}
@@ -1834,7 +2350,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(send_must_be_owner_msg)
-									writeErrorMessageToClient(socket, "You must be the owner of this object to destroy it.");
+									writeErrorMessageToClient("You must be the owner of this object to destroy it.");
 							}
 							break;
 						}
@@ -1845,7 +2361,7 @@ void WorkerThread::doRun()
 							SocketBufferOutStream temp_buf(SocketBufferOutStream::DontUseNetworkByteOrder); // Will contain several messages
 
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(cur_world_state->mutex);
 								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
 								{
 									const WorldObject* ob = it->second.getPointer();
@@ -1863,8 +2379,8 @@ void WorkerThread::doRun()
 							MessageUtils::updatePacketLengthField(scratch_packet);
 							temp_buf.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
 
-							socket->writeData(temp_buf.buf.data(), temp_buf.buf.size());
-							socket->flush();
+							writeToClient(temp_buf.buf.data(), temp_buf.buf.size());
+							flushToClient();
 
 							break;
 						}
@@ -1882,8 +2398,9 @@ void WorkerThread::doRun()
 
 							//conPrint("QueryObjects, num_cells=" + toString(num_cells));
 					
-							// Read cell coords from network and make AABBs for cells
-							js::Vector<js::AABBox, 16> cell_aabbs(num_cells);
+							// Read cell coords from network.
+							// NOTE: the cell width used by the client (CELL_WIDTH in gui_client/ProximityLoader.cpp) has to be the same as the object_grid cell width.
+							std::vector<Vec3<int>> cell_coords(num_cells);
 							for(uint32 i=0; i<num_cells; ++i)
 							{
 								const int x = msg_buffer.readInt32();
@@ -1893,35 +2410,31 @@ void WorkerThread::doRun()
 								//if(i < 10)
 								//	conPrint("cell " + toString(i) + " coords: " + toString(x) + ", " + toString(y) + ", " + toString(z));
 
-								const float CELL_WIDTH = 200.f; // NOTE: has to be the same value as in gui_client/ProximityLoader.cpp.
-
-								cell_aabbs[i] = js::AABBox(
-									Vec4f(0,0,0,1) + Vec4f((float)x,     (float)y,     (float)z,     0)*CELL_WIDTH,
-									Vec4f(0,0,0,1) + Vec4f((float)(x+1), (float)(y+1), (float)(z+1), 0)*CELL_WIDTH
-								);
+								cell_coords[i] = Vec3<int>(x, y, z);
 							}
 
+							// Remove any duplicate cells, so we don't send objects more than once.
+							std::sort(cell_coords.begin(), cell_coords.end());
+							cell_coords.erase(std::unique(cell_coords.begin(), cell_coords.end()), cell_coords.end());
+
 
 							SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 							int num_obs_written = 0;
 
 							{ // Lock scope
-								Lock lock(world_state->mutex);
-								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.ptr();
+								InstrumentedLock lock(cur_world_state->mutex);
 
-									// See if the object is in any of the cell AABBs
-									bool in_cell = false;
-									for(uint32 i=0; i<num_cells; ++i)
-										if(cell_aabbs[i].contains(ob->pos.toVec4fPoint()))
-										{
-											in_cell = true;
-											break;
-										}
+								// Look up the objects in each of the cells using the object grid.
+								std::vector<WorldObject*> cell_obs;
+								for(size_t i=0; i<cell_coords.size(); ++i)
+								{
+									cell_obs.clear();
+									cur_world_state->object_grid.appendObjectsInCell(cell_coords[i], cell_obs);
 
-									if(in_cell)
+									for(size_t z=0; z<cell_obs.size(); ++z)
 									{
+										const WorldObject* ob = cell_obs[z];
+
 										// Send ObjectInitialSend packet
 										MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
 										ob->writeToNetworkStream(scratch_packet);
@@ -1938,18 +2451,20 @@ void WorkerThread::doRun()
 							{
 								conPrintIfNotFuzzing("QueryObjects: Sending back info on " + toString(num_obs_written) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ") ...");
 
-								socket->writeData(packet.buf.data(), packet.buf.size()); // Write data to network
-								socket->flush();
+								writeToClient(packet.buf.data(), packet.buf.size()); // Write data to network
+								flushToClient();
 							}
 						
 							break;
 						}
 					case Protocol::QueryObjectsInAABB: // Client wants to query objects in a particular AABB
+					case Protocol::QueryObjectsInAABBIncremental: // Client wants to query objects in a particular AABB, and already has copies of some objects from a previous connection.
 						{
 							// This kind of query will be done when a client connects.
 							// Because the AABB can be quite large (>= 1km on each side), the number of objects returned can be large.
 							// Therefore we first work out the objects in the AABB, then sort by distance to camera, and send back the closer objects first.
 							// This allows the client to start loading and displaying objects before all the queried objects are returned, which can take a while.
+							// For QueryObjectsInAABBIncremental, only new, changed and deleted objects are sent.  See IncrementalObjectSync.h
 							//
 							// For sending over websocket connections, we will also flush occasionally, which sends a websocket frame.
 							// To do this we will record the offset of the start of chunks. (~= 4096 bytes)
@@ -1972,67 +2487,32 @@ void WorkerThread::doRun()
 							const float upper_z = msg_buffer.readFloat();
 
 							const js::AABBox aabb(Vec4f(lower_x, lower_y, lower_z, 1.f), Vec4f(upper_x, upper_y, upper_z, 1.f));
+
+							const bool incremental = msg_type == Protocol::QueryObjectsInAABBIncremental;
+							ObjectSyncDigest digest;
+							if(incremental)
+								digest.readFromStream(msg_buffer);
 					
-							conPrintIfNotFuzzing("QueryObjectsInAABB, aabb: " + aabb.toStringNSigFigs(4) + ", cam_position: " + cam_position.toString());
+							conPrintIfNotFuzzing("QueryObjectsInAABB, aabb: " + aabb.toStringNSigFigs(4) + ", cam_position: " + cam_position.toString() +
+								(incremental ? (", num known objects: " + toString(digest.known_objects.size())) : std::string()));
 
 							SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 							std::vector<size_t> chunk_begin_offsets; // Byte index of the start of a chunk (~= 4096 bytes).
 							chunk_begin_offsets.reserve(512);
-							chunk_begin_offsets.push_back(0);
-							size_t last_chunk_begin_offset = 0;
-
-							std::vector<const WorldObject*> obs;
-							obs.reserve(16384);
+							IncrementalObjectSync::SyncStats sync_stats;
 
 							{ // Lock scope
-								Lock lock(world_state->mutex);
-								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.ptr();
-									const Vec4f ob_pos_vec4f = ob->pos.toVec4fPoint();
-									if(ob_pos_vec4f.isFinite() && aabb.contains(ob_pos_vec4f)) // If the object position is valid, and if it's in the query AABB:
-										obs.push_back(ob);
-								}
-
-								// Sort objects from near to far from camera.
-								struct WorldObjectDistComparator
-								{
-									bool operator () (const WorldObject* a, const WorldObject* b)
-									{
-										const double a_dist2 = a->pos.getDist2(campos);
-										const double b_dist2 = b->pos.getDist2(campos);
-										return a_dist2 < b_dist2;
-									}
-									Vec3d campos;
-								};
-
-								WorldObjectDistComparator comparator;
-								comparator.campos = cam_position;
-								std::sort(obs.begin(), obs.end(), comparator);
-
-								for(size_t i=0; i<obs.size(); ++i)
-								{
-									const WorldObject* ob = obs[i];
+								InstrumentedLock lock(cur_world_state->mutex);
 
-									// Create ObjectInitialSend packet
-									MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
-									ob->writeToNetworkStream(scratch_packet);
-									MessageUtils::updatePacketLengthField(scratch_packet);
-
-									packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Append scratch_packet with ObjectInitialSend message to packet.
-
-									if(packet.buf.size() - last_chunk_begin_offset >= 4096) // If we have written more than X bytes since last chunk start:
-									{
-										last_chunk_begin_offset = packet.buf.size();
-										chunk_begin_offsets.push_back(packet.buf.size()); // Record offset of start of chunk.
-									}
-								}
+								IncrementalObjectSync::writeQueryObjectsInAABBResponse(*cur_world_state, aabb, cam_position, incremental ? &digest : NULL, TimeStamp::currentTime(),
+									scratch_packet, packet, chunk_begin_offsets, sync_stats);
 							} // End lock scope
 
 							// Send back the data, now we have released the world lock.  Send it back in chunks instead of one big write. (better for websockets)
 							if(!packet.buf.empty())
 							{
-								conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on " + toString(obs.size()) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ")...");
+								conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on " + toString(sync_stats.num_obs_sent) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ")" +
+									(incremental ? (", " + toString(sync_stats.num_unchanged) + " unchanged, " + toString(sync_stats.num_deleted) + " deleted") : std::string()) + "...");
 								Timer timer;
 
 								for(size_t i=0; i<chunk_begin_offsets.size(); ++i)
@@ -2043,8 +2523,8 @@ void WorkerThread::doRun()
 										const size_t chunk_end = ((i + 1) < chunk_begin_offsets.size()) ? chunk_begin_offsets[i + 1] : packet.buf.size();
 										const size_t chunk_size = chunk_end - chunk_offset;
 										runtimeCheck((chunk_offset < packet.buf.size()) && (CheckedMaths::addUnsignedInts(chunk_offset, chunk_size) <= packet.buf.size())); 
-										socket->writeData(&packet.buf[chunk_offset], chunk_size); // Write data to network
-										socket->flush(); // Will cause websockets to send a data frame.
+										writeToClient(&packet.buf[chunk_offset], chunk_size); // Write data to network
+										flushToClient(); // Will cause websockets to send a data frame.  Also flushes the compressed stream if enabled, so the client can handle each chunk as it arrives.
 									}
 								}
 
@@ -2060,14 +2540,14 @@ void WorkerThread::doRun()
 							// Send all current parcel data to client
 							MessageUtils::initPacket(scratch_packet, Protocol::ParcelList);
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(cur_world_state->mutex);
 								scratch_packet.writeUInt64(cur_world_state->parcels.size()); // Write num parcels
 								for(auto it = cur_world_state->parcels.begin(); it != cur_world_state->parcels.end(); ++it)
 									writeToNetworkStream(*it->second, scratch_packet, client_protocol_version); // Write parcel
 							}
 							MessageUtils::updatePacketLengthField(scratch_packet);
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Send the data
-							socket->flush();
+							writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size()); // Send the data
+							flushToClient();
 							break;
 						}
 					case Protocol::ParcelFullUpdate: // Client wants to update a parcel
@@ -2081,18 +2561,18 @@ void WorkerThread::doRun()
 							// If client is not logged in, refuse parcel modification.
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify a parcel.");
+								writeErrorMessageToClient("You must be logged in to modify a parcel.");
 							}
 							else if(world_state->isInReadOnlyMode())
 							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify a parcel right now.");
+								writeErrorMessageToClient("Server is in read-only mode, you can't modify a parcel right now.");
 							}
 							else
 							{
 								// Look up existing parcel in world state
 								std::string error_msg;
 								{
-									Lock lock(world_state->mutex);
+									InstrumentedLock lock(cur_world_state->mutex);
 									auto res = cur_world_state->parcels.find(parcel_id);
 									if(res != cur_world_state->parcels.end())
 									{
@@ -2117,7 +2597,7 @@ void WorkerThread::doRun()
 								} // End lock scope
 
 								if(!error_msg.empty())
-									writeErrorMessageToClient(socket, error_msg);
+									writeErrorMessageToClient(error_msg);
 							}
 							break;
 						}
@@ -2130,7 +2610,7 @@ void WorkerThread::doRun()
 
 							if(!client_user_id.valid())
 							{
-								writeErrorMessageToClient(socket, "You must be logged in to chat.");
+								writeErrorMessageToClient("You must be logged in to chat.");
 							}
 							else
 							{
@@ -2190,7 +2670,7 @@ void WorkerThread::doRun()
 						
 							bool logged_in = false;
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(world_state->users_mutex);
 								auto res = world_state->name_to_users.find(username);
 								if(res != world_state->name_to_users.end())
 								{
@@ -2224,8 +2704,8 @@ void WorkerThread::doRun()
 								scratch_packet.writeUInt32(client_user_flags);
 								MessageUtils::updatePacketLengthField(scratch_packet);
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
 							}
 							else
 							{
@@ -2234,8 +2714,8 @@ void WorkerThread::doRun()
 								scratch_packet.writeStringLengthFirst("Login failed: username or password incorrect.");
 								MessageUtils::updatePacketLengthField(scratch_packet);
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
 							}
 					
 							break;
@@ -2252,8 +2732,8 @@ void WorkerThread::doRun()
 							MessageUtils::initPacket(scratch_packet, Protocol::LoggedOutMessageID);
 							MessageUtils::updatePacketLengthField(scratch_packet);
 
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-							socket->flush();
+							writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+							flushToClient();
 							break;
 						}
 					case Protocol::SignUpMessage:
@@ -2285,7 +2765,7 @@ void WorkerThread::doRun()
 											msg_to_client = "Password is too short, must have at least 6 characters";
 										else
 										{
-											Lock lock(world_state->mutex);
+											InstrumentedLock lock(world_state->users_mutex);
 											auto res = world_state->name_to_users.find(username);
 											if(res == world_state->name_to_users.end())
 											{
@@ -2325,8 +2805,8 @@ void WorkerThread::doRun()
 									scratch_packet.writeStringLengthFirst(username);
 									MessageUtils::updatePacketLengthField(scratch_packet);
 
-									socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-									socket->flush();
+									writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+									flushToClient();
 								}
 								else
 								{
@@ -2337,8 +2817,8 @@ void WorkerThread::doRun()
 									scratch_packet.writeStringLengthFirst(msg_to_client);
 									MessageUtils::updatePacketLengthField(scratch_packet);
 
-									socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-									socket->flush();
+									writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+									flushToClient();
 								}
 							}
 							catch(glare::Exception& e)
@@ -2350,8 +2830,8 @@ void WorkerThread::doRun()
 								scratch_packet.writeStringLengthFirst("Signup failed: internal error.");
 								MessageUtils::updatePacketLengthField(scratch_packet);
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
 							}
 
 							break;
@@ -2369,7 +2849,7 @@ void WorkerThread::doRun()
 							//// TEMP: Send password reset email in this thread for now. 
 							//// TODO: move to another thread (make some kind of background task?)
 							//{
-							//	Lock lock(world_state->mutex);
+							//	InstrumentedLock lock(world_state->mutex);
 							//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
 							//		if(it->second->email_address == email)
 							//		{
@@ -2404,7 +2884,7 @@ void WorkerThread::doRun()
 							////conPrint("new_password: " + new_password);
 							//
 							//{
-							//	Lock lock(world_state->mutex);
+							//	InstrumentedLock lock(world_state->mutex);
 							//
 							//	// Find user with the given email address:
 							//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
@@ -2432,7 +2912,7 @@ void WorkerThread::doRun()
 							if(userConnectedToTheirPersonalWorldOrGodUser(client_user_id, client_user_name, this->connected_world_name))
 							{
 								{
-									Lock lock(server->world_state->mutex);
+									InstrumentedLock lock(cur_world_state->mutex);
 									cur_world_state->world_settings.copyNetworkStateFrom(world_settings);
 									cur_world_state->world_settings.db_dirty = true;
 									world_state->markAsChanged();
@@ -2464,8 +2944,8 @@ void WorkerThread::doRun()
 								scratch_packet.writeStringLengthFirst("You do not have permissions to set the world settings");
 								MessageUtils::updatePacketLengthField(scratch_packet);
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
 							}
 
 							break;
@@ -2486,7 +2966,7 @@ void WorkerThread::doRun()
 
 							std::vector<std::string> result_URLs(num_tiles);
 							{
-								Lock lock(world_state->mutex);
+								InstrumentedLock lock(world_state->mutex);
 
 								for(size_t i=0; i<tile_coords.size(); ++i)
 								{
@@ -2521,9 +3001,34 @@ void WorkerThread::doRun()
 
 							MessageUtils::updatePacketLengthField(scratch_packet);
 
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-							socket->flush();
+							writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+							flushToClient();
+
+							break;
+						}
+					case Protocol::EnableStreamCompression: // Client wants the messages we send to it to be compressed.
+						{
+							const uint64 client_dictionary_hash = msg_buffer.readUInt64();
+
+							if(stream_compressor.isNull() && server->config.stream_compression_enabled)
+							{
+								// Only use the dictionary if the client has the same one.
+								const bool use_dictionary = client_dictionary_hash == StreamCompression::getDictionaryHash();
+
+								MessageUtils::initPacket(scratch_packet, Protocol::StreamCompressionEnabled);
+								scratch_packet.writeUInt32(use_dictionary ? StreamCompression::USE_DICTIONARY_FLAG : 0);
+								MessageUtils::updatePacketLengthField(scratch_packet);
+								writeToClient(scratch_packet.buf.data(), scratch_packet.buf.size());
+								flushToClient();
+
+								// All data written after this point is compressed.
+								stream_compressor = new StreamCompression::Compressor(use_dictionary, server->config.stream_compression_level);
+
+								compression_stats_id = world_state->compression_stats.addConnection(IPAddress::formatIPAddressAndPort(socket->getOtherEndIPAddress(), socket->getOtherEndPort()) +
+									", world '" + world_name + "'", use_dictionary);
 
+								conPrintIfNotFuzzing("WorkerThread: Enabled stream compression" + std::string(use_dictionary ? " with dictionary." : "."));
+							}
 							break;
 						}
 					default:
@@ -2570,6 +3075,9 @@ void WorkerThread::doRun()
 	}
 
 
+	if(compression_stats_id != 0)
+		world_state->compression_stats.removeConnection(compression_stats_id);
+
 	if(write_trace)
 		socket.downcastToPtr<RecordingSocket>()->writeRecordBufToDisk("traces/worker_thread_trace_" + ::toString(Clock::getTimeSinceInit()) + ".bin");
 
@@ -2578,11 +3086,14 @@ void WorkerThread::doRun()
 	// Mark avatar corresponding to client as dead.  Note that we want to do this after catching any exceptions, so avatar is removed on broken connections etc.
 	if(cur_world_state.nonNull())
 	{
-		Lock lock(world_state->mutex);
+		InstrumentedLock lock(cur_world_state->mutex);
 		if(cur_world_state->avatars.count(client_avatar_uid) == 1)
 		{
-			cur_world_state->avatars[client_avatar_uid]->state = Avatar::State_Dead;
-			cur_world_state->avatars[client_avatar_uid]->other_dirty = true;
+			AvatarRef avatar = cur_world_state->avatars[client_avatar_uid];
+			avatar->state = Avatar::State_Dead;
+			avatar->other_dirty = true;
+			cur_world_state->dirty_from_remote_avatars.insert(avatar);
+			world_state->notifyBroadcastNeeded();
 		}
 	}
 
@@ -2597,6 +3108,69 @@ void WorkerThread::doRun()
 }
 
 
+void WorkerThread::writeToClient(const void* data, size_t len)
+{
+	if(stream_compressor.nonNull())
+	{
+		stream_compressor->compress(data, len, compressed_packets);
+		if(!compressed_packets.buf.empty())
+		{
+			socket->writeData(compressed_packets.buf.data(), compressed_packets.buf.size());
+			compressed_packets.buf.clear();
+		}
+	}
+	else
+		socket->writeData(data, len);
+}
+
+
+void WorkerThread::flushToClient()
+{
+	if(stream_compressor.nonNull())
+	{
+		stream_compressor->flush(compressed_packets);
+		socket->writeData(compressed_packets.buf.data(), compressed_packets.buf.size());
+		compressed_packets.buf.clear();
+
+		server->world_state->compression_stats.updateConnection(compression_stats_id, stream_compressor->stats);
+	}
+
+	socket->flush();
+}
+
+
+UID WorkerThread::getClientAvatarUID()
+{
+	Lock lock(avatar_uid_mutex);
+	return assigned_avatar_uid;
+}
+
+
+void WorkerThread::enqueueSharedDataToSend(const BroadcastFrameRef& frame)
+{
+	if(!frame->empty())
+	{
+		Lock lock(data_to_send_mutex);
+		QueuedSharedFrame queued_frame;
+		queued_frame.data_offset = data_to_send.size();
+		queued_frame.frame = frame;
+		shared_frames_to_send.push_back(queued_frame);
+
+		event_fd.notify();
+	}
+}
+
+
+void WorkerThread::takeDataToSend(js::Vector<uint8, 16>& data_out, std::vector<QueuedSharedFrame>& shared_frames_out)
+{
+	Lock lock(data_to_send_mutex);
+	data_out = data_to_send;
+	data_to_send.clear();
+	shared_frames_out.swap(shared_frames_to_send); // shared_frames_out should be empty, so this leaves shared_frames_to_send empty.
+	shared_frames_to_send.clear();
+}
+
+
 void WorkerThread::enqueueDataToSend(const std::string& data)
 {
 	if(VERBOSE) conPrint("WorkerThread::enqueueDataToSend(), data: '" + data + "'");
@@ -6,16 +6,22 @@ Copyright Glare Technologies Limited 2018 -
 #pragma once
 
 
+#include "BroadcastFrame.h"
+#include "../shared/UID.h"
+#include "../shared/TransformCompression.h"
+#include "../shared/StreamCompression.h"
 #include <RequestInfo.h>
 #include <MessageableThread.h>
 #include <Platform.h>
 #include <MyThread.h>
 #include <EventFD.h>
 #include <MySocket.h>
+#include <AtomicInt.h>
 #include <SocketBufferOutStream.h>
 #include <Vector.h>
 #include <BufferInStream.h>
 #include <string>
+#include <vector>
 class Server;
 
 
@@ -37,6 +43,23 @@ public:
 
 	void enqueueDataToSend(const std::string& data); // threadsafe
 	void enqueueDataToSend(const SocketBufferOutStream& packet); // threadsafe
+	void enqueueSharedDataToSend(const BroadcastFrameRef& frame); // threadsafe.  Just stores a reference to the frame, doesn't copy the data.
+
+	// Position at which a shared frame should be written, interleaved with the non-shared data to send.
+	struct QueuedSharedFrame
+	{
+		size_t data_offset; // Write frame after this many bytes of the non-shared data have been written.
+		BroadcastFrameRef frame;
+	};
+
+	// Takes all data that has been enqueued to send, leaving the queues empty.  threadsafe.
+	void takeDataToSend(js::Vector<uint8, 16>& data_out, std::vector<QueuedSharedFrame>& shared_frames_out);
+
+	UID getClientAvatarUID(); // threadsafe.  Returns the avatar UID assigned to the client, or an invalid UID if not assigned yet.
+
+	uint32 getClientProtocolVersion() const { return (uint32)atomic_client_protocol_version; } // threadsafe.  Returns 0 if not read from the client yet.
+
+	TransformCompression::TransformDeltaCodec transform_codec; // Encodes TransformUpdateBatch messages sent to this client.  Only accessed by the main server thread.
 
 	web::RequestInfo websocket_request_info; // If the client connected via a websocket, this the HTTP request data.  Is used for accessing the login cookie.
 
@@ -44,23 +67,43 @@ private:
 	void sendGetFileMessageIfNeeded(const std::string& resource_URL);
 	void handleResourceUploadConnection();
 	void handleResourceDownloadConnection();
+	void handleFramedResourceDownloads();
 	void handleScreenshotBotConnection();
 	void handleEthBotConnection();
+	void handleReplicationConnection();
 	void conPrintIfNotFuzzing(const std::string& msg);
 
+	// Write / flush data to the client on an updates connection.  If stream compression is enabled, compresses the data first.
+	void writeToClient(const void* data, size_t len);
+	void flushToClient();
+	void writeErrorMessageToClient(const std::string& msg); // Writes an ErrorMessage to the client and flushes.
+
 	Reference<SocketInterface> socket;
 	Server* server;
 	EventFD event_fd;	
 
 	Mutex data_to_send_mutex;
 	js::Vector<uint8, 16> data_to_send			GUARDED_BY(data_to_send_mutex);
+	std::vector<QueuedSharedFrame> shared_frames_to_send	GUARDED_BY(data_to_send_mutex);
 	js::Vector<uint8, 16> temp_data_to_send;
+	std::vector<QueuedSharedFrame> temp_shared_frames_to_send;
+
+	Mutex avatar_uid_mutex;
+	UID assigned_avatar_uid						GUARDED_BY(avatar_uid_mutex); // Copy of client_avatar_uid in doRun(), for reading from other threads.
+
+	glare::AtomicInt atomic_client_protocol_version; // Copy of client_protocol_version in doRun(), for reading from other threads.
 
 	SocketBufferOutStream scratch_packet;
 
+	Reference<StreamCompression::Compressor> stream_compressor; // Non-null once stream compression has been enabled by the client.
+	SocketBufferOutStream compressed_packets; // CompressedMessages messages to write to the socket.
+	uint64 compression_stats_id; // Id of this connection in the server CompressionStatsRegistry, or 0 if not added.
+
 	BufferInStream msg_buffer;
 public:
 	bool fuzzing; // Are we currently doing fuzz-testing?
 private:
 	bool write_trace; // Should we write a record of network traffic to disk for fuzz seeding?
+
+	friend class WorkerThreadTests;
 };
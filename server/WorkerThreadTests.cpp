@@ -35,7 +35,12 @@ Copyright Glare Technologies Limited 2022 -
 #include <Parser.h>
 #include <MemMappedFile.h>
 #include <PCG32.h>
+#include <Timer.h>
+#include <BufferInStream.h>
 #include "WorldCreation.h"
+#include "../shared/Protocol.h"
+#include "../shared/MessageUtils.h"
+#include "../shared/StreamCompression.h"
 
 
 #if 0
@@ -162,9 +167,162 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 #endif
 
 
+static std::string vectorToString(const js::Vector<uint8, 16>& v)
+{
+	return v.empty() ? std::string() : std::string((const char*)v.data(), v.size());
+}
+
+
 void WorkerThreadTests::test()
 {
-	
+	conPrint("WorkerThreadTests::test()");
+
+	//-------------------- Test that shared frames are interleaved with non-shared data in the order they were enqueued --------------------
+	{
+		Reference<WorkerThread> worker = new WorkerThread(Reference<SocketInterface>(), /*server=*/NULL);
+
+		BroadcastFrameRef frame = new BroadcastFrame();
+		frame->append("XY", 2);
+
+		worker->enqueueSharedDataToSend(frame); // At start
+		worker->enqueueDataToSend(std::string("ab"));
+		worker->enqueueSharedDataToSend(frame);
+		worker->enqueueSharedDataToSend(new BroadcastFrame()); // Empty frames should be ignored.
+		worker->enqueueDataToSend(std::string("cd"));
+
+		js::Vector<uint8, 16> data;
+		std::vector<WorkerThread::QueuedSharedFrame> frames;
+		worker->takeDataToSend(data, frames);
+
+		testAssert(vectorToString(data) == "abcd");
+		testAssert(frames.size() == 2);
+		testAssert(frames[0].data_offset == 0 && frames[0].frame.ptr() == frame.ptr());
+		testAssert(frames[1].data_offset == 2 && frames[1].frame.ptr() == frame.ptr());
+
+		// Queues should now be empty.
+		worker->takeDataToSend(data, frames);
+		testAssert(data.empty());
+		testAssert(frames.empty());
+	}
+
+	//-------------------- Test that error messages on a compressed connection are sent in the compressed stream, after any buffered data --------------------
+	{
+		const int port = 7611;
+		MySocketRef listen_socket = new MySocket();
+		listen_socket->bindAndListen(port, /*reuse address=*/true);
+		MySocketRef client_socket = new MySocket("localhost", port);
+		MySocketRef server_socket = listen_socket->acceptConnection();
+		server_socket->setUseNetworkByteOrder(false);
+
+		Server server;
+		Reference<WorkerThread> worker = new WorkerThread(server_socket, &server);
+		worker->stream_compressor = new StreamCompression::Compressor(/*use_dictionary=*/false, /*compression_level=*/3);
+
+		// Write a message without flushing, so it stays buffered in the compressor.
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		MessageUtils::initPacket(packet, Protocol::ServerAdminMessageID);
+		packet.writeStringLengthFirst("admin message");
+		MessageUtils::updatePacketLengthField(packet);
+		worker->writeToClient(packet.buf.data(), packet.buf.size());
+
+		worker->writeErrorMessageToClient("error message");
+
+		// Read messages from the client end.  Everything should be in CompressedMessages messages.
+		StreamCompression::Decompressor decompressor(/*use_dictionary=*/false);
+		std::vector<uint32> msg_types;
+		std::vector<std::string> msg_strings;
+		BufferInStream msg;
+		while(msg_types.size() < 2)
+		{
+			uint32 header[2];
+			client_socket->readData(header, sizeof(header));
+			testAssert(header[0] == Protocol::CompressedMessages);
+			testAssert(header[1] > sizeof(header));
+
+			std::vector<uint8> payload(header[1] - sizeof(header));
+			client_socket->readData(payload.data(), payload.size());
+			decompressor.decompress(payload.data(), payload.size());
+
+			uint32 msg_type;
+			while(decompressor.takeMessage(msg, msg_type))
+			{
+				msg_types.push_back(msg_type);
+				msg_strings.push_back(msg.readStringLengthFirst(/*max length=*/1000));
+			}
+		}
+
+		testAssert(msg_types.size() == 2);
+		testAssert(msg_types[0] == Protocol::ServerAdminMessageID && msg_strings[0] == "admin message");
+		testAssert(msg_types[1] == Protocol::ErrorMessageID && msg_strings[1] == "error message");
+		testAssert(worker->stream_compressor->stats.uncompressed_bytes == packet.buf.size() + (sizeof(uint32) * 3 + std::string("error message").size()));
+	}
+
+	conPrint("WorkerThreadTests::test() done.");
+}
+
+
+void WorkerThreadTests::benchmarkBroadcastFanOut()
+{
+	conPrint("WorkerThreadTests::benchmarkBroadcastFanOut()");
+
+	const int NUM_WORKERS = 500;
+	const int NUM_PACKETS = 300; // Number of packets broadcast in the tick, e.g. one AvatarTransformUpdate for each of 300 moving avatars.
+	const size_t PACKET_SIZE = 56;
+	const int NUM_TICKS = 20;
+
+	std::vector<Reference<WorkerThread>> workers;
+	for(int i=0; i<NUM_WORKERS; ++i)
+		workers.push_back(new WorkerThread(Reference<SocketInterface>(), /*server=*/NULL));
+
+	std::vector<std::string> packets(NUM_PACKETS, std::string(PACKET_SIZE, 'a'));
+
+	js::Vector<uint8, 16> data;
+	std::vector<WorkerThread::QueuedSharedFrame> frames;
+
+	// Per-packet, per-worker copies, as the main server loop used to do.
+	double copy_enqueue_time = 0;
+	double copy_take_time = 0;
+	for(int t=0; t<NUM_TICKS; ++t)
+	{
+		Timer timer;
+		for(int i=0; i<NUM_WORKERS; ++i)
+			for(size_t z=0; z<packets.size(); ++z)
+				workers[i]->enqueueDataToSend(packets[z]);
+		copy_enqueue_time += timer.elapsed();
+
+		timer.reset();
+		for(int i=0; i<NUM_WORKERS; ++i)
+			workers[i]->takeDataToSend(data, frames);
+		copy_take_time += timer.elapsed();
+		testAssert(data.size() == NUM_PACKETS * PACKET_SIZE);
+	}
+
+	// Shared frame built once per tick.
+	double shared_enqueue_time = 0;
+	double shared_take_time = 0;
+	for(int t=0; t<NUM_TICKS; ++t)
+	{
+		Timer timer;
+		BroadcastFrameRef frame = new BroadcastFrame();
+		for(size_t z=0; z<packets.size(); ++z)
+			frame->append(packets[z].data(), packets[z].size());
+		for(int i=0; i<NUM_WORKERS; ++i)
+			workers[i]->enqueueSharedDataToSend(frame);
+		shared_enqueue_time += timer.elapsed();
+
+		timer.reset();
+		for(int i=0; i<NUM_WORKERS; ++i)
+			workers[i]->takeDataToSend(data, frames);
+		shared_take_time += timer.elapsed();
+		testAssert(frames.size() == 1 && frames[0].frame->size() == NUM_PACKETS * PACKET_SIZE);
+		frames.clear();
+	}
+
+	conPrint(toString(NUM_WORKERS) + " workers, " + toString(NUM_PACKETS) + " packets of " + toString(PACKET_SIZE) + " B per tick:");
+	conPrint("    per-worker copies: enqueue: " + doubleToStringNSigFigs(copy_enqueue_time / NUM_TICKS * 1.0e3, 4) + " ms/tick, take: " + doubleToStringNSigFigs(copy_take_time / NUM_TICKS * 1.0e3, 4) + " ms/tick");
+	conPrint("    shared frame:      enqueue: " + doubleToStringNSigFigs(shared_enqueue_time / NUM_TICKS * 1.0e3, 4) + " ms/tick, take: " + doubleToStringNSigFigs(shared_take_time / NUM_TICKS * 1.0e3, 4) + " ms/tick");
+
+	conPrint("WorkerThreadTests::benchmarkBroadcastFanOut() done.");
 }
 
 
@@ -16,4 +16,6 @@ class WorkerThreadTests
 public:
 	
 	static void test();
+
+	static void benchmarkBroadcastFanOut(); // Measures the cost of enqueuing a tick's broadcast packets with 500 worker threads.
 };
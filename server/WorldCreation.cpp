@@ -599,7 +599,7 @@ static void updateToUseImageCubeMeshes(ServerAllWorldsState& all_worlds_state)
 
 	size_t num_updated = 0;
 	{
-		Lock lock(all_worlds_state.mutex);
+		InstrumentedLock lock(all_worlds_state.mutex);
 		
 		for(auto world_it = all_worlds_state.world_states.begin(); world_it != all_worlds_state.world_states.end(); ++world_it)
 		{
@@ -654,11 +654,12 @@ void WorldCreation::removeHypercardMaterials(ServerAllWorldsState& all_worlds_st
 
 	size_t num_updated = 0;
 	{
-		Lock lock(all_worlds_state.mutex);
+		InstrumentedLock lock(all_worlds_state.mutex);
 
 		for(auto world_it = all_worlds_state.world_states.begin(); world_it != all_worlds_state.world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			InstrumentedLock world_lock(world_state->mutex);
 
 			for(auto i = world_state->objects.begin(); i != world_state->objects.end(); ++i)
 			{
@@ -1221,6 +1222,13 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 			);
 		}
 	}
+
+	// Objects may have been added or removed above, so rebuild the object grid.
+	{
+		Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+		InstrumentedLock lock(root_world->mutex);
+		root_world->rebuildObjectGrid();
+	}
 }
 
 
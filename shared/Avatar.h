@@ -172,6 +172,15 @@ public:
 typedef Reference<Avatar> AvatarRef;
 
 
+struct AvatarRefHash
+{
+	size_t operator() (const AvatarRef& ob) const
+	{
+		return (size_t)ob.ptr() >> 3; // Assuming 8-byte aligned, get rid of lower zero bits.
+	}
+};
+
+
 const Matrix4f obToWorldMatrix(const Avatar& ob);
 
 
@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2021 -
 
 
 #include "ImageDecoding.h"
+#include "VoxelMeshBuilding.h"
 #include "../server/ServerWorldState.h"
 #include <ConPrint.h>
 #include <Exception.h>
@@ -128,6 +129,23 @@ void generateLODModel(const std::string& model_path, int lod_level, const std::s
 }
 
 
+void generateVoxelMeshes(const js::Vector<uint8, 16>& compressed_voxels, const js::Vector<bool, 16>& mats_transparent, int max_lod_level, const std::string& voxel_mesh_path)
+{
+	VoxelGroup voxel_group;
+	WorldObject::decompressVoxelGroup(compressed_voxels.data(), compressed_voxels.size(), voxel_group);
+
+	for(int lvl = 0; lvl <= max_lod_level; ++lvl)
+	{
+		// Make the same mesh as ModelLoading::makeModelForVoxelGroup() does on the client.  Vertex positions are in units of subsampled voxels, the client scales by the subsample factor.
+		Indigo::MeshRef indigo_mesh = VoxelMeshBuilding::makeIndigoMeshForVoxelGroup(voxel_group, WorldObject::getVoxelSubsampleFactorForLODLevel(lvl), /*generate_shading_normals=*/false, mats_transparent);
+
+		BatchedMeshRef batched_mesh = BatchedMesh::buildFromIndigoMesh(*indigo_mesh);
+
+		batched_mesh->writeToFile(WorldObject::getLODModelURLForLevel(voxel_mesh_path, lvl));
+	}
+}
+
+
 bool textureHasAlphaChannel(const std::string& tex_path)
 {
 	if(hasExtension(tex_path, "gif") || hasExtension(tex_path, "jpg"))
@@ -543,6 +561,73 @@ void LODGeneration::test()
 		}
 #endif
 
+		//------------------------------------------- Test voxel mesh generation -------------------------------------------
+		// Also benchmarks the client load time for a voxel-heavy parcel set, when meshing the voxels on the client vs. loading the meshes baked by the server.
+		{
+			const int num_obs = 16;
+			const int side = 64;
+			std::vector<js::Vector<uint8, 16> > compressed_voxels(num_obs);
+			js::Vector<bool, 16> mats_transparent(4);
+			for(size_t i=0; i<mats_transparent.size(); ++i)
+				mats_transparent[i] = (i == 3);
+
+			size_t total_num_voxels = 0;
+			for(int ob_i=0; ob_i<num_obs; ++ob_i)
+			{
+				// Make a terrain-like heightfield of voxels, with a few materials.
+				VoxelGroup group;
+				for(int y=0; y<side; ++y)
+				for(int x=0; x<side; ++x)
+				{
+					const int height = 2 + (int)(3.f * (1 + std::sin(x * 0.2f + ob_i) * std::cos(y * 0.15f)));
+					for(int z=0; z<height; ++z)
+						group.voxels.push_back(Voxel(Vec3<int>(x, y, z), (z == height - 1) ? ((x / 8 + y / 8 + ob_i) % 4) : 0));
+				}
+				total_num_voxels += group.voxels.size();
+				WorldObject::compressVoxelGroup(group, compressed_voxels[ob_i]);
+			}
+
+			// Bake the meshes, as the server does.
+			std::vector<std::string> mesh_paths(num_obs);
+			Timer bake_timer;
+			for(int ob_i=0; ob_i<num_obs; ++ob_i)
+			{
+				mesh_paths[ob_i] = PlatformUtils::getTempDirPath() + "/" + WorldObject::makeVoxelMeshURL(compressed_voxels[ob_i], mats_transparent);
+				generateVoxelMeshes(compressed_voxels[ob_i], mats_transparent, /*max_lod_level=*/2, mesh_paths[ob_i]);
+			}
+			const double bake_time = bake_timer.elapsed();
+
+			for(int ob_i=0; ob_i<num_obs; ++ob_i)
+				for(int lvl=0; lvl<=2; ++lvl)
+					testAssert(FileUtils::fileExists(WorldObject::getLODModelURLForLevel(mesh_paths[ob_i], lvl)));
+
+			// Client-side meshing: decompress the voxels, mesh them and build a batched mesh.  (This is the CPU work done by LoadModelTask without baked meshes, apart from building the physics shape)
+			std::vector<size_t> meshed_num_indices(num_obs);
+			Timer meshing_timer;
+			for(int ob_i=0; ob_i<num_obs; ++ob_i)
+			{
+				VoxelGroup group;
+				WorldObject::decompressVoxelGroup(compressed_voxels[ob_i].data(), compressed_voxels[ob_i].size(), group);
+				Indigo::MeshRef indigo_mesh = VoxelMeshBuilding::makeIndigoMeshForVoxelGroup(group, /*subsample_factor=*/1, /*generate_shading_normals=*/false, mats_transparent);
+				BatchedMeshRef batched_mesh = BatchedMesh::buildFromIndigoMesh(*indigo_mesh);
+				meshed_num_indices[ob_i] = batched_mesh->numIndices();
+			}
+			const double meshing_time = meshing_timer.elapsed();
+
+			// Loading the baked meshes.
+			Timer loading_timer;
+			for(int ob_i=0; ob_i<num_obs; ++ob_i)
+			{
+				BatchedMeshRef batched_mesh = BatchedMesh::readFromFile(mesh_paths[ob_i]);
+				testAssert(batched_mesh->numIndices() == meshed_num_indices[ob_i]);
+			}
+			const double loading_time = loading_timer.elapsed();
+
+			conPrint("Voxel mesh benchmark: " + toString(num_obs) + " objects, " + toString(total_num_voxels) + " voxels");
+			conPrint("    Server baking (LOD 0-2): " + doubleToStringNSigFigs(bake_time, 4) + " s");
+			conPrint("    Client meshing (LOD 0):  " + doubleToStringNSigFigs(meshing_time, 4) + " s");
+			conPrint("    Client loading baked:    " + doubleToStringNSigFigs(loading_time, 4) + " s (" + doubleToStringNSigFigs(meshing_time / loading_time, 3) + "x faster)");
+		}
 	}
 	catch(glare::Exception& e)
 	{
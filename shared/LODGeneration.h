@@ -32,6 +32,9 @@ void generateLODModel(BatchedMeshRef batched_mesh, int lod_level, const std::str
 
 void generateLODModel(const std::string& model_path, int lod_level, const std::string& LOD_model_path);
 
+// Meshes the voxels for each model LOD level from 0 to max_lod_level, and writes the meshes to voxel_mesh_path and the corresponding LOD paths. (see WorldObject::makeVoxelMeshURL)
+void generateVoxelMeshes(const js::Vector<uint8, 16>& compressed_voxels, const js::Vector<bool, 16>& mats_transparent, int max_lod_level, const std::string& voxel_mesh_path);
+
 bool textureHasAlphaChannel(const std::string& tex_path, Map2DRef map);
 
 void generateLODTexture(const std::string& base_tex_path, int lod_level, const std::string& LOD_tex_path, glare::TaskManager& task_manager);
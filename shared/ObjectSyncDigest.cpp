@@ -0,0 +1,226 @@
+/*=====================================================================
+ObjectSyncDigest.cpp
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ObjectSyncDigest.h"
+
+
+#include "VarIntUtils.h"
+#include <utils/SocketBufferOutStream.h>
+#include <utils/BufferInStream.h>
+#include <utils/Exception.h>
+#include <utils/StringUtils.h>
+#include <cassert>
+
+
+ObjectSyncDigest::ObjectSyncDigest()
+{}
+
+
+ObjectSyncDigest::~ObjectSyncDigest()
+{}
+
+
+void ObjectSyncDigest::writeToStream(SocketBufferOutStream& stream) const
+{
+	assert(known_objects.size() <= MAX_NUM_KNOWN_OBJECTS);
+
+	stream.writeUInt64(valid_time.time);
+	stream.writeUInt32((uint32)known_objects.size());
+
+	uint64 prev_uid = 0;
+	for(size_t i=0; i<known_objects.size(); ++i)
+	{
+		assert(i == 0 || known_objects[i - 1].uid < known_objects[i].uid);
+
+		const uint64 uid = known_objects[i].uid.value();
+		VarIntUtils::writeVarUInt(uid - prev_uid, stream);
+		VarIntUtils::writeVarUInt(VarIntUtils::zigZagEncode((int64)(valid_time.time - known_objects[i].last_modified_time.time)), stream); // Usually in the past, so small and positive.
+		prev_uid = uid;
+	}
+}
+
+
+void ObjectSyncDigest::readFromStream(BufferInStream& stream)
+{
+	valid_time.time = stream.readUInt64();
+
+	const uint32 num = stream.readUInt32();
+	if(num > MAX_NUM_KNOWN_OBJECTS)
+		throw glare::Exception("Too many known objects: " + toString(num));
+
+	known_objects.resize(num);
+
+	uint64 prev_uid = 0;
+	for(uint32 i=0; i<num; ++i)
+	{
+		const uint64 uid_delta = VarIntUtils::readVarUInt(stream);
+		if((i > 0 && uid_delta == 0) || (uid_delta >= UID::invalidUID().value() - prev_uid))
+			throw glare::Exception("Invalid UID in digest");
+		prev_uid += uid_delta;
+
+		known_objects[i].uid = UID(prev_uid);
+		known_objects[i].last_modified_time.time = valid_time.time - (uint64)VarIntUtils::zigZagDecode(VarIntUtils::readVarUInt(stream));
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <cstring>
+
+
+static void copyToInStream(const SocketBufferOutStream& stream, size_t len, BufferInStream& in_stream_out)
+{
+	in_stream_out.buf.resize(len);
+	if(len > 0)
+		std::memcpy(in_stream_out.buf.data(), stream.buf.data(), len);
+	in_stream_out.read_index = 0;
+}
+
+
+void ObjectSyncDigest::test()
+{
+	conPrint("ObjectSyncDigest::test()");
+
+	//-------------------- Test isUnchanged --------------------
+	{
+		ObjectSyncDigest digest;
+		digest.valid_time = TimeStamp(1000);
+
+		testAssert(digest.isUnchanged(TimeStamp(500), TimeStamp(500)));
+		testAssert(digest.isUnchanged(TimeStamp(999), TimeStamp(999)));
+		testAssert(!digest.isUnchanged(TimeStamp(500), TimeStamp(501))); // Modified since the client's copy.
+		testAssert(!digest.isUnchanged(TimeStamp(1000), TimeStamp(1000))); // Modified in the same second as the previous sync, so may have been modified again afterwards.
+		testAssert(!digest.isUnchanged(TimeStamp(1001), TimeStamp(1001)));
+	}
+
+	//-------------------- Test round trip --------------------
+	{
+		ObjectSyncDigest digest;
+		digest.valid_time = TimeStamp(1700000000);
+		const uint64 uids[] = { 0, 1, 2, 100, 1000000, 1ull << 40, UID::invalidUID().value() - 1 };
+		for(size_t i=0; i<staticArrayNumElems(uids); ++i)
+		{
+			KnownObject known;
+			known.uid = UID(uids[i]);
+			known.last_modified_time = TimeStamp(1700000000 - i * 12345 + 1); // The first object was modified after valid_time.
+			digest.known_objects.push_back(known);
+		}
+
+		SocketBufferOutStream stream(SocketBufferOutStream::DontUseNetworkByteOrder);
+		digest.writeToStream(stream);
+
+		BufferInStream in_stream;
+		copyToInStream(stream, stream.buf.size(), in_stream);
+		ObjectSyncDigest digest2;
+		digest2.readFromStream(in_stream);
+		testAssert(in_stream.endOfStream());
+
+		testAssert(digest2.valid_time.time == digest.valid_time.time);
+		testAssert(digest2.known_objects.size() == digest.known_objects.size());
+		for(size_t i=0; i<digest.known_objects.size(); ++i)
+		{
+			testAssert(digest2.known_objects[i].uid == digest.known_objects[i].uid);
+			testAssert(digest2.known_objects[i].last_modified_time.time == digest.known_objects[i].last_modified_time.time);
+		}
+	}
+
+	//-------------------- Test size of a typical digest --------------------
+	{
+		ObjectSyncDigest digest;
+		digest.valid_time = TimeStamp(1700000000);
+		for(size_t i=0; i<10000; ++i)
+		{
+			KnownObject known;
+			known.uid = UID(100000 + i * 3);
+			known.last_modified_time = TimeStamp(1700000000 - 86400 * 30 - i * 100); // Modified a month or more ago.
+			digest.known_objects.push_back(known);
+		}
+
+		SocketBufferOutStream stream(SocketBufferOutStream::DontUseNetworkByteOrder);
+		digest.writeToStream(stream);
+		conPrint("Digest size for " + toString(digest.known_objects.size()) + " objects: " + toString(stream.buf.size()) + " B");
+		testAssert(stream.buf.size() <= 16 + digest.known_objects.size() * 5);
+	}
+
+	//-------------------- Test invalid data --------------------
+	{
+		// Too many known objects
+		{
+			SocketBufferOutStream stream(SocketBufferOutStream::DontUseNetworkByteOrder);
+			stream.writeUInt64(1000);
+			stream.writeUInt32((uint32)MAX_NUM_KNOWN_OBJECTS + 1);
+
+			BufferInStream in_stream;
+			copyToInStream(stream, stream.buf.size(), in_stream);
+			ObjectSyncDigest digest;
+			try
+			{
+				digest.readFromStream(in_stream);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		// Duplicate UID
+		{
+			SocketBufferOutStream stream(SocketBufferOutStream::DontUseNetworkByteOrder);
+			stream.writeUInt64(1000);
+			stream.writeUInt32(2);
+			const uint8 data[] = { 5, 0, /*zero delta:*/0, 0 };
+			stream.writeData(data, sizeof(data));
+
+			BufferInStream in_stream;
+			copyToInStream(stream, stream.buf.size(), in_stream);
+			ObjectSyncDigest digest;
+			try
+			{
+				digest.readFromStream(in_stream);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		// Truncated data
+		{
+			ObjectSyncDigest digest;
+			for(size_t i=0; i<10; ++i)
+			{
+				KnownObject known;
+				known.uid = UID(i * 1000);
+				known.last_modified_time = TimeStamp(0);
+				digest.known_objects.push_back(known);
+			}
+			digest.valid_time = TimeStamp(1700000000);
+
+			SocketBufferOutStream stream(SocketBufferOutStream::DontUseNetworkByteOrder);
+			digest.writeToStream(stream);
+
+			for(size_t len=0; len<stream.buf.size(); ++len)
+			{
+				BufferInStream in_stream;
+				copyToInStream(stream, len, in_stream);
+				ObjectSyncDigest digest2;
+				try
+				{
+					digest2.readFromStream(in_stream);
+					failTest("Expected exception");
+				}
+				catch(glare::Exception&)
+				{}
+			}
+		}
+	}
+
+	conPrint("ObjectSyncDigest::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,67 @@
+/*=====================================================================
+ObjectSyncDigest.h
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "UID.h"
+#include "TimeStamp.h"
+#include <utils/Platform.h>
+#include <vector>
+class SocketBufferOutStream;
+class BufferInStream;
+
+
+/*=====================================================================
+ObjectSyncDigest
+----------------
+The objects a client already has a copy of, sent by a reconnecting client in a
+QueryObjectsInAABBIncremental message, so the server only needs to send new, changed and deleted objects.
+
+Each known object is the UID and last_modified_time of the client's copy.
+
+last_modified_time only has a resolution of one second, so an object modified twice in the same second
+can have the same last_modified_time for both versions.
+To handle this, valid_time is the server time at which the client's copies were known to be up to date
+(the time the server sent the IncrementalObjectSyncDone message for the previous sync).
+A copy is only considered unchanged if its last_modified_time matches and is strictly before valid_time,
+so every modification in that second happened before the previous sync.
+
+Encoded as UID deltas and valid_time - last_modified_time as varints, so each known object takes about 5 bytes.
+=====================================================================*/
+class ObjectSyncDigest
+{
+public:
+	ObjectSyncDigest();
+	~ObjectSyncDigest();
+
+	struct KnownObject
+	{
+		UID uid;
+		TimeStamp last_modified_time;
+
+		bool operator < (const KnownObject& other) const { return uid < other.uid; }
+	};
+
+	// Is the client's copy of an object, last modified at known_last_modified_time, the same as the current object?
+	bool isUnchanged(const TimeStamp& known_last_modified_time, const TimeStamp& cur_last_modified_time) const
+	{
+		return (known_last_modified_time.time == cur_last_modified_time.time) && (cur_last_modified_time.time < valid_time.time);
+	}
+
+	// known_objects must be sorted by UID, with no duplicates.
+	void writeToStream(SocketBufferOutStream& stream) const;
+
+	// Throws glare::Exception on invalid data.  known_objects will be sorted by UID, with no duplicates.
+	void readFromStream(BufferInStream& stream);
+
+	// Limits the digest size to about 500 KB, which is well under the max message size.
+	static const size_t MAX_NUM_KNOWN_OBJECTS = 100000;
+
+	TimeStamp valid_time;
+	std::vector<KnownObject> known_objects;
+
+	static void test();
+};
@@ -33,13 +33,18 @@ CyberspaceProtocolVersion
 	Added scale to ObjectTransformUpdate message.
 38: Use length-prefixed serialisation for WorldMaterial, sending server version to client.
 39: Added QueryMapTiles, MapTilesResult
+40: Added TransformUpdateBatch
+41: Added QueryObjectsInAABBIncremental, IncrementalObjectSyncDone
+42: Added EnableStreamCompression, StreamCompressionEnabled, CompressedMessages
+43: Added GetFilesCompressed
+44: Added RequestResources, UpdateResourcePriorities, ResourceDownloadHeader, ResourceDownloadChunk
 */
 namespace Protocol
 {
 
 const uint32 CyberspaceHello = 1357924680;
 
-const uint32 CyberspaceProtocolVersion = 39;
+const uint32 CyberspaceProtocolVersion = 44;
 
 const uint32 ClientProtocolOK		= 10000;
 const uint32 ClientProtocolTooOld	= 10001;
@@ -56,6 +61,7 @@ const uint32 ConnectionTypeDownloadResources	= 502;
 //const uint32 ConnectionTypeWebsite				= 503; // A connection from the webserver.
 const uint32 ConnectionTypeScreenshotBot		= 504; // A connection from the screenshot bot.
 const uint32 ConnectionTypeEthBot				= 505; // A connection from the Ethereum bot.
+const uint32 ConnectionTypeReplication			= 506; // A connection from a replication follower (backup_bot).  See WorkerThread::handleReplicationConnection().
 
 
 const uint32 AvatarCreated			= 1000;
@@ -81,6 +87,7 @@ const uint32 ObjectFlagsChanged		= 3011;
 const uint32 ObjectModelURLChanged	= 3012;
 const uint32 ObjectPhysicsOwnershipTaken	= 3013;
 const uint32 ObjectPhysicsTransformUpdate	= 3016;
+const uint32 TransformUpdateBatch	= 3017; // Sent instead of the 3 transform update messages above to clients with protocol version >= 40.  See TransformCompression.h
 const uint32 SummonObject			= 3030;
 
 const uint32 CreateObject			= 3004; // Client wants to create an object.
@@ -89,6 +96,8 @@ const uint32 DestroyObject			= 3005; // Client wants to destroy an object.
 const uint32 QueryObjects			= 3020; // Client wants to query objects in certain grid cells
 const uint32 ObjectInitialSend		= 3021;
 const uint32 QueryObjectsInAABB		= 3022; // Client wants to query objects in a particular AABB
+const uint32 QueryObjectsInAABBIncremental	= 3023; // Like QueryObjectsInAABB, but with a digest of the objects the client already has.  See IncrementalObjectSync.h
+const uint32 IncrementalObjectSyncDone	= 3024; // Server has sent all new and changed objects in response to QueryObjectsInAABBIncremental.
 
 
 const uint32 ParcelCreated			= 3100;
@@ -111,6 +120,14 @@ const uint32 MapTilesResult			= 3801; // Server is sending back a list of tile i
 //TEMP HACK move elsewhere
 const uint32 GetFile				= 4000;
 const uint32 GetFiles				= 4001; // Client wants to download multiple resources from the server.
+const uint32 GetFilesCompressed		= 4002; // Like GetFiles, but the server may reply with result 2 and send a zstd-compressed file.  See CompressedResourceVariants.h
+
+// Framed download protocol.  The server interleaves chunks of the requested resources, see ResourceDownloadScheduler.h
+const uint32 RequestResources			= 4003; // Client wants to download resources, starting from a byte offset of each, with a priority for each.
+const uint32 UpdateResourcePriorities	= 4004; // Client is changing the priorities of resources it has requested.
+const uint32 ResourceDownloadHeader		= 4005; // Server is sending the result and size of a requested resource.
+const uint32 ResourceDownloadChunk		= 4006; // Server is sending a chunk of a requested resource.
+const uint32 RequestResourceFlag_AcceptZstd = 1; // Flag in RequestResources: the server may send the zstd-compressed variant of the resource.
 
 const uint32 NewResourceOnServer	= 4100; // A file has been uploaded to the server
 
@@ -154,4 +171,13 @@ const uint32 EthTransactionSubmissionFailed		= 12003;
 
 const uint32 KeepAlive				= 13000; // A message that doesn't do anything apart from provide a means for the client or server to check a connection is still working by making a socket call.
 
+const uint32 EnableStreamCompression	= 14000; // Client wants the server to compress the messages it sends.  See StreamCompression.h
+const uint32 StreamCompressionEnabled	= 14001; // All following messages from the server will be compressed, and sent in CompressedMessages messages.
+const uint32 CompressedMessages		= 14002; // Part of the zstd stream of compressed messages from the server.
+
+const uint32 ReplicationFullSync		= 15000; // Server is sending a copy of its database file, followed by the list of present resources.
+const uint32 ReplicationResumed			= 15001; // Server will send the log entries after the follower's checkpoint.
+const uint32 ReplicationLogEntry		= 15002; // A database snapshot written by the server: record deletions, record updates, and resources that became present.
+const uint32 ReplicationHeartbeat		= 15003; // Sent when there have been no log entries for a while, so the follower can tell the connection is still working.
+
 } // end namespace Protocol
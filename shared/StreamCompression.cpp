@@ -0,0 +1,615 @@
+/*=====================================================================
+StreamCompression.cpp
+---------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "StreamCompression.h"
+
+
+#include "Protocol.h"
+#include "WorldObject.h"
+#include "MessageUtils.h"
+#include <utils/SocketBufferOutStream.h>
+#include <utils/BufferInStream.h>
+#include <utils/Exception.h>
+#include <utils/StringUtils.h>
+#include <utils/IncludeXXHash.h>
+#include <utils/Timer.h>
+#include <maths/mathstypes.h>
+#include <zstd.h>
+#include <cstring>
+#include <limits>
+
+
+namespace StreamCompression
+{
+
+
+static const int WINDOW_LOG = 20; // Use a 1 MB window, to limit the memory used per connection.
+
+static const size_t MAX_BUFFERED_DECOMPRESSED_SIZE = 64 * 1024 * 1024; // Max size of decompressed data not taken yet.  Guards against decompression bombs.
+
+
+// Appends an ObjectInitialSend message for the object to dict.
+static void appendObjectInitialSendMessage(const WorldObject& ob, SocketBufferOutStream& scratch_packet, std::vector<uint8>& dict)
+{
+	MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
+	ob.writeToNetworkStream(scratch_packet);
+	MessageUtils::updatePacketLengthField(scratch_packet);
+
+	dict.insert(dict.end(), scratch_packet.buf.data(), scratch_packet.buf.data() + scratch_packet.buf.size());
+}
+
+
+// Sets all serialised fields to fixed values, so the dictionary is deterministic.
+static void initDictionaryObject(WorldObject& ob, uint32 object_type, uint64 uid)
+{
+	ob.uid = UID(uid);
+	ob.object_type = object_type;
+	ob.pos = Vec3d(10.0, 20.0, 1.0);
+	ob.axis = Vec3f(0, 0, 1);
+	ob.angle = 0;
+	ob.scale = Vec3f(1.f);
+	ob.created_time = TimeStamp(1680000000);
+	ob.last_modified_time = TimeStamp(1680000000);
+	ob.creator_id = UserID(1);
+	ob.flags = WorldObject::COLLIDABLE_FLAG;
+	ob.setAABBOS(js::AABBox(Vec4f(-0.5f, -0.5f, -0.5f, 1), Vec4f(0.5f, 0.5f, 0.5f, 1)));
+	ob.max_model_lod_level = 0;
+	ob.mass = 50.f;
+	ob.friction = 0.5f;
+	ob.restitution = 0.2f;
+	ob.centre_of_mass_offset_os = Vec3f(0.f);
+	ob.physics_owner_id = std::numeric_limits<uint32>::max();
+	ob.last_physics_ownership_change_global_time = 0;
+	ob.audio_volume = 1;
+}
+
+
+static WorldMaterialRef makeDictionaryMaterial(const std::string& colour_texture_url, const std::string& metallic_roughness_url, const std::string& normal_map_url)
+{
+	WorldMaterialRef mat = new WorldMaterial();
+	mat->colour_texture_url = colour_texture_url;
+	mat->roughness.texture_url = metallic_roughness_url;
+	mat->normal_map_url = normal_map_url;
+	return mat;
+}
+
+
+// Builds the dictionary from ObjectInitialSend messages for typical objects.
+// zstd finds matches at small offsets cheaper to encode, so the most common kinds of objects are written last.
+static std::vector<uint8> buildDictionary()
+{
+	std::vector<uint8> dict;
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+	{
+		WorldObject ob;
+		initDictionaryObject(ob, WorldObject::ObjectType_Video, 100000);
+		ob.target_url = "https://www.youtube.com/watch?v=";
+		ob.flags |= WorldObject::VIDEO_AUTOPLAY | WorldObject::VIDEO_LOOP;
+		ob.materials.push_back(makeDictionaryMaterial("", "", ""));
+		appendObjectInitialSendMessage(ob, scratch_packet, dict);
+	}
+	{
+		WorldObject ob;
+		initDictionaryObject(ob, WorldObject::ObjectType_WebView, 100001);
+		ob.target_url = "https://substrata.info/";
+		ob.materials.push_back(makeDictionaryMaterial("", "", ""));
+		appendObjectInitialSendMessage(ob, scratch_packet, dict);
+	}
+	{
+		WorldObject ob;
+		initDictionaryObject(ob, WorldObject::ObjectType_Spotlight, 100002);
+		ob.model_url = "Spotlight_2_3582940713948167298.bmesh";
+		ob.materials.push_back(makeDictionaryMaterial("", "", ""));
+		ob.materials.push_back(makeDictionaryMaterial("", "", ""));
+		ob.materials[1]->emission_lum_flux_or_lum = 10000.f;
+		appendObjectInitialSendMessage(ob, scratch_packet, dict);
+	}
+	{
+		WorldObject ob;
+		initDictionaryObject(ob, WorldObject::ObjectType_Hypercard, 100003);
+		ob.content = "Select the object \nto edit this text";
+		ob.scale = Vec3f(0.4f, 0.5f, 0.4f);
+		ob.materials.push_back(makeDictionaryMaterial("", "", ""));
+		appendObjectInitialSendMessage(ob, scratch_packet, dict);
+	}
+	{
+		WorldObject ob;
+		initDictionaryObject(ob, WorldObject::ObjectType_VoxelGroup, 100004);
+		ob.lightmap_url = "lightmap_8276345218364581273.ktx2";
+		for(int i=0; i<4; ++i)
+			ob.materials.push_back(makeDictionaryMaterial((i == 0) ? "stone_jpg_5432165498712345678.jpg" : "", "", ""));
+		appendObjectInitialSendMessage(ob, scratch_packet, dict);
+	}
+	{
+		WorldObject ob;
+		initDictionaryObject(ob, WorldObject::ObjectType_Generic, 100005);
+		ob.model_url = "scene_glb_12345678901234567890.bmesh";
+		ob.lightmap_url = "lightmap_12345678901234567890.ktx2";
+		ob.audio_source_url = "sound_mp3_12345678901234567890.mp3";
+		ob.max_model_lod_level = 2;
+		ob.materials.push_back(makeDictionaryMaterial("BaseColor_png_1234567890123456789.png", "Metallic_Roughness_png_1234567890123456789.png", "Normal_png_1234567890123456789.png"));
+		ob.materials.push_back(makeDictionaryMaterial("Texture_jpg_9876543210987654321.jpg", "", ""));
+		ob.materials[1]->flags = WorldMaterial::COLOUR_TEX_HAS_ALPHA_FLAG | WorldMaterial::MIN_LOD_LEVEL_IS_NEGATIVE_1;
+		appendObjectInitialSendMessage(ob, scratch_packet, dict);
+	}
+	{
+		WorldObject ob;
+		initDictionaryObject(ob, WorldObject::ObjectType_Generic, 100006);
+		ob.model_url = "Cube_5438360946709763578.bmesh";
+		ob.max_model_lod_level = 0;
+		ob.materials.push_back(makeDictionaryMaterial("", "", ""));
+		appendObjectInitialSendMessage(ob, scratch_packet, dict);
+	}
+	{
+		WorldObject ob;
+		initDictionaryObject(ob, WorldObject::ObjectType_Generic, 100007);
+		ob.model_url = "model_glb_1234567890123456789.bmesh";
+		ob.max_model_lod_level = 2;
+		ob.materials.push_back(makeDictionaryMaterial("model_jpg_1234567890123456789.jpg", "", ""));
+		ob.materials.push_back(makeDictionaryMaterial("", "", ""));
+		appendObjectInitialSendMessage(ob, scratch_packet, dict);
+	}
+
+	return dict;
+}
+
+
+const std::vector<uint8>& getDictionary()
+{
+	static const std::vector<uint8> dict = buildDictionary(); // Function-local static initialisation is threadsafe.
+	return dict;
+}
+
+
+uint64 getDictionaryHash()
+{
+	static const uint64 hash = XXH64(getDictionary().data(), getDictionary().size(), /*seed=*/1);
+	return hash;
+}
+
+
+Compressor::Compressor(bool use_dictionary, int compression_level)
+:	compressed_size(0)
+{
+	context = ZSTD_createCCtx();
+	if(!context)
+		throw glare::Exception("ZSTD_createCCtx failed.");
+
+	size_t res = ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, compression_level);
+	if(!ZSTD_isError(res))
+		res = ZSTD_CCtx_setParameter(context, ZSTD_c_windowLog, WINDOW_LOG);
+	if(!ZSTD_isError(res) && use_dictionary)
+		res = ZSTD_CCtx_loadDictionary(context, getDictionary().data(), getDictionary().size()); // Dictionary persists over all frames, but we only use one frame anyway.
+	if(ZSTD_isError(res))
+	{
+		ZSTD_freeCCtx(context);
+		throw glare::Exception("Failed to init compression context: " + std::string(ZSTD_getErrorName(res)));
+	}
+}
+
+
+Compressor::~Compressor()
+{
+	ZSTD_freeCCtx(context);
+}
+
+
+void Compressor::compress(const void* data, size_t len, SocketBufferOutStream& packets_out)
+{
+	Timer timer;
+
+	ZSTD_inBuffer in_buf = { data, len, 0 };
+	while(in_buf.pos < in_buf.size)
+	{
+		if(compressed.size() - compressed_size < ZSTD_CStreamOutSize())
+			compressed.resize(compressed_size + ZSTD_CStreamOutSize());
+
+		ZSTD_outBuffer out_buf = { compressed.data() + compressed_size, compressed.size() - compressed_size, 0 };
+		const size_t res = ZSTD_compressStream2(context, &out_buf, &in_buf, ZSTD_e_continue);
+		if(ZSTD_isError(res))
+			throw glare::Exception("Compression failed: " + std::string(ZSTD_getErrorName(res)));
+		compressed_size += out_buf.pos;
+	}
+
+	stats.uncompressed_bytes += len;
+
+	// Write out full CompressedMessages messages, so the buffered compressed output doesn't get too large.
+	appendCompressedMessages(/*max_remaining_bytes=*/MAX_COMPRESSED_MSG_PAYLOAD_SIZE - 1, packets_out);
+
+	stats.compress_time += timer.elapsed();
+}
+
+
+void Compressor::flush(SocketBufferOutStream& packets_out)
+{
+	Timer timer;
+
+	ZSTD_inBuffer in_buf = { NULL, 0, 0 };
+	while(1)
+	{
+		if(compressed.size() - compressed_size < ZSTD_CStreamOutSize())
+			compressed.resize(compressed_size + ZSTD_CStreamOutSize());
+
+		ZSTD_outBuffer out_buf = { compressed.data() + compressed_size, compressed.size() - compressed_size, 0 };
+		const size_t remaining = ZSTD_compressStream2(context, &out_buf, &in_buf, ZSTD_e_flush);
+		if(ZSTD_isError(remaining))
+			throw glare::Exception("Compression failed: " + std::string(ZSTD_getErrorName(remaining)));
+		compressed_size += out_buf.pos;
+		if(remaining == 0) // If everything has been flushed:
+			break;
+	}
+
+	appendCompressedMessages(/*max_remaining_bytes=*/0, packets_out);
+
+	stats.compress_time += timer.elapsed();
+}
+
+
+// Writes buffered compressed output as CompressedMessages messages, until there are at most max_remaining_bytes left.
+void Compressor::appendCompressedMessages(size_t max_remaining_bytes, SocketBufferOutStream& packets_out)
+{
+	size_t i = 0;
+	while(compressed_size - i > max_remaining_bytes)
+	{
+		const size_t payload_size = myMin(compressed_size - i, MAX_COMPRESSED_MSG_PAYLOAD_SIZE);
+
+		packets_out.writeUInt32(Protocol::CompressedMessages);
+		packets_out.writeUInt32((uint32)(sizeof(uint32) * 2 + payload_size));
+		packets_out.writeData(&compressed[i], payload_size);
+
+		stats.compressed_bytes += sizeof(uint32) * 2 + payload_size;
+		i += payload_size;
+	}
+
+	if(i > 0)
+	{
+		// Move any remaining compressed output to the start of the buffer.
+		if(compressed_size - i > 0)
+			std::memmove(compressed.data(), &compressed[i], compressed_size - i);
+		compressed_size -= i;
+	}
+}
+
+
+Decompressor::Decompressor(bool use_dictionary)
+:	decompressed_size(0),
+	read_i(0)
+{
+	context = ZSTD_createDCtx();
+	if(!context)
+		throw glare::Exception("ZSTD_createDCtx failed.");
+
+	size_t res = ZSTD_DCtx_setParameter(context, ZSTD_d_windowLogMax, WINDOW_LOG);
+	if(!ZSTD_isError(res) && use_dictionary)
+		res = ZSTD_DCtx_loadDictionary(context, getDictionary().data(), getDictionary().size());
+	if(ZSTD_isError(res))
+	{
+		ZSTD_freeDCtx(context);
+		throw glare::Exception("Failed to init decompression context: " + std::string(ZSTD_getErrorName(res)));
+	}
+}
+
+
+Decompressor::~Decompressor()
+{
+	ZSTD_freeDCtx(context);
+}
+
+
+void Decompressor::decompress(const void* data, size_t len)
+{
+	// Remove taken messages from the start of the buffer.
+	if(read_i > 0)
+	{
+		if(decompressed_size - read_i > 0)
+			std::memmove(decompressed.data(), &decompressed[read_i], decompressed_size - read_i);
+		decompressed_size -= read_i;
+		read_i = 0;
+	}
+
+	ZSTD_inBuffer in_buf = { data, len, 0 };
+	while(1)
+	{
+		if(decompressed.size() - decompressed_size < ZSTD_DStreamOutSize())
+			decompressed.resize(decompressed_size + ZSTD_DStreamOutSize());
+
+		ZSTD_outBuffer out_buf = { decompressed.data() + decompressed_size, decompressed.size() - decompressed_size, 0 };
+		const size_t res = ZSTD_decompressStream(context, &out_buf, &in_buf);
+		if(ZSTD_isError(res))
+			throw glare::Exception("Decompression failed: " + std::string(ZSTD_getErrorName(res)));
+		decompressed_size += out_buf.pos;
+
+		if(decompressed_size > MAX_BUFFERED_DECOMPRESSED_SIZE)
+			throw glare::Exception("Too much decompressed data.");
+
+		// If all input has been consumed, and the output buffer wasn't filled, then all decompressed data that can be output has been.
+		if(in_buf.pos == in_buf.size && out_buf.pos < out_buf.size)
+			break;
+	}
+}
+
+
+bool Decompressor::haveCompleteMessage() const
+{
+	if(decompressed_size - read_i < sizeof(uint32) * 2)
+		return false;
+
+	uint32 msg_len;
+	std::memcpy(&msg_len, &decompressed[read_i + sizeof(uint32)], sizeof(uint32));
+	return (msg_len < sizeof(uint32) * 2) || (msg_len > MAX_MSG_SIZE) || (decompressed_size - read_i >= msg_len);
+}
+
+
+bool Decompressor::takeMessage(BufferInStream& msg_buffer_out, uint32& msg_type_out)
+{
+	if(decompressed_size - read_i < sizeof(uint32) * 2)
+		return false;
+
+	uint32 msg_type_and_len[2];
+	std::memcpy(msg_type_and_len, &decompressed[read_i], sizeof(uint32) * 2);
+	const uint32 msg_type = msg_type_and_len[0];
+	const uint32 msg_len = msg_type_and_len[1];
+
+	if((msg_len < sizeof(uint32) * 2) || (msg_len > MAX_MSG_SIZE))
+		throw glare::Exception("Invalid message size: " + toString(msg_len));
+
+	if(msg_type == Protocol::CompressedMessages || msg_type == Protocol::StreamCompressionEnabled)
+		throw glare::Exception("Invalid message type in compressed stream: " + toString(msg_type));
+
+	if(decompressed_size - read_i < msg_len)
+		return false;
+
+	msg_buffer_out.buf.resizeNoCopy(msg_len);
+	std::memcpy(msg_buffer_out.buf.data(), &decompressed[read_i], msg_len);
+	msg_buffer_out.read_index = sizeof(uint32) * 2;
+	read_i += msg_len;
+
+	msg_type_out = msg_type;
+	return true;
+}
+
+
+} // end namespace StreamCompression
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <maths/PCG32.h>
+
+
+// Handles the messages in packets, like ClientThread.  Decompressed messages are appended to decompressed_msgs_out.
+static void receivePackets(const SocketBufferOutStream& packets, StreamCompression::Decompressor& decompressor, std::vector<uint8>& decompressed_msgs_out)
+{
+	size_t i = 0;
+	while(i < packets.buf.size())
+	{
+		uint32 msg_type_and_len[2];
+		testAssert(packets.buf.size() - i >= sizeof(uint32) * 2);
+		std::memcpy(msg_type_and_len, &packets.buf[i], sizeof(uint32) * 2);
+		testAssert(msg_type_and_len[0] == Protocol::CompressedMessages);
+		testAssert(msg_type_and_len[1] <= sizeof(uint32) * 2 + StreamCompression::Compressor::MAX_COMPRESSED_MSG_PAYLOAD_SIZE);
+		testAssert(packets.buf.size() - i >= msg_type_and_len[1]);
+
+		decompressor.decompress(&packets.buf[i + sizeof(uint32) * 2], msg_type_and_len[1] - sizeof(uint32) * 2);
+		i += msg_type_and_len[1];
+
+		BufferInStream msg_buffer;
+		uint32 msg_type;
+		while(decompressor.haveCompleteMessage())
+		{
+			testAssert(decompressor.takeMessage(msg_buffer, msg_type));
+			decompressed_msgs_out.insert(decompressed_msgs_out.end(), msg_buffer.buf.data(), msg_buffer.buf.data() + msg_buffer.buf.size());
+		}
+		testAssert(!decompressor.takeMessage(msg_buffer, msg_type));
+	}
+}
+
+
+static void makeTestObject(WorldObject& ob, PCG32& rng, uint64 uid)
+{
+	ob.uid = UID(uid);
+	ob.object_type = WorldObject::ObjectType_Generic;
+	ob.pos = Vec3d(rng.unitRandom() * 1000, rng.unitRandom() * 1000, rng.unitRandom() * 10);
+	ob.axis = Vec3f(0, 0, 1);
+	ob.angle = rng.unitRandom() * 6.28f;
+	ob.scale = Vec3f(1.f);
+	ob.created_time = TimeStamp(1680000000 + rng.nextUInt(10000000));
+	ob.last_modified_time = ob.created_time;
+	ob.creator_id = UserID(rng.nextUInt(1000));
+	ob.setAABBOS(js::AABBox(Vec4f(-0.5f, -0.5f, -0.5f, 1), Vec4f(0.5f, 0.5f, 0.5f, 1)));
+
+	const uint32 model_i = rng.nextUInt(100); // Use a limited set of models, so there is repetition like in real worlds.
+	ob.model_url = "model_" + toString(model_i) + "_glb_" + toString(1000000000000000000ull + model_i * 7919) + ".bmesh";
+	ob.max_model_lod_level = (model_i % 2 == 0) ? 2 : 0;
+	const uint32 num_mats = 1 + model_i % 4;
+	for(uint32 z=0; z<num_mats; ++z)
+	{
+		WorldMaterialRef mat = new WorldMaterial();
+		if(z % 2 == 0)
+			mat->colour_texture_url = "texture_" + toString(model_i) + "_" + toString(z) + "_jpg_" + toString(2000000000000000000ull + model_i * 104729 + z) + ".jpg";
+		mat->roughness.val = 0.1f * (z % 10);
+		ob.materials.push_back(mat);
+	}
+}
+
+
+// Writes messages like those sent to a client when it connects: ObjectInitialSend messages, and some other small messages.
+static void makeTestMessages(size_t num_obs, std::vector<uint8>& msgs_out)
+{
+	PCG32 rng(1);
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	for(size_t i=0; i<num_obs; ++i)
+	{
+		WorldObject ob;
+		makeTestObject(ob, rng, 1000 + i * 3);
+
+		MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
+		ob.writeToNetworkStream(scratch_packet);
+		MessageUtils::updatePacketLengthField(scratch_packet);
+		msgs_out.insert(msgs_out.end(), scratch_packet.buf.data(), scratch_packet.buf.data() + scratch_packet.buf.size());
+
+		if(i % 50 == 0)
+		{
+			MessageUtils::initPacket(scratch_packet, Protocol::TimeSyncMessage);
+			scratch_packet.writeDouble(1.0e6 + i);
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			msgs_out.insert(msgs_out.end(), scratch_packet.buf.data(), scratch_packet.buf.data() + scratch_packet.buf.size());
+		}
+	}
+}
+
+
+// Compresses msgs, flushing every flush_interval bytes, then decompresses and checks the result is the same.  Returns the total size of the CompressedMessages messages.
+static size_t testRoundTrip(const std::vector<uint8>& msgs, bool use_dictionary, size_t write_size, size_t flush_interval)
+{
+	StreamCompression::Compressor compressor(use_dictionary, /*compression level=*/3);
+	StreamCompression::Decompressor decompressor(use_dictionary);
+
+	SocketBufferOutStream packets(SocketBufferOutStream::DontUseNetworkByteOrder);
+	std::vector<uint8> decompressed_msgs;
+	size_t total_packet_size = 0;
+	size_t last_flush_i = 0;
+	for(size_t i=0; i<msgs.size(); i += write_size)
+	{
+		compressor.compress(&msgs[i], myMin(write_size, msgs.size() - i), packets);
+
+		if(i + write_size - last_flush_i >= flush_interval || i + write_size >= msgs.size())
+		{
+			compressor.flush(packets);
+			last_flush_i = i + write_size;
+
+			// After a flush, all data compressed so far should be decompressable.
+			receivePackets(packets, decompressor, decompressed_msgs);
+			total_packet_size += packets.buf.size();
+			packets.buf.clear();
+
+			// The decompressed messages should be a prefix of the messages compressed so far.
+			testAssert(decompressed_msgs.size() <= myMin(i + write_size, msgs.size()));
+			testAssert(decompressed_msgs.empty() || std::memcmp(decompressed_msgs.data(), msgs.data(), decompressed_msgs.size()) == 0);
+		}
+	}
+
+	testAssert(decompressed_msgs.size() == msgs.size());
+	testAssert(decompressed_msgs == msgs);
+
+	testAssert(compressor.stats.uncompressed_bytes == msgs.size());
+	testAssert(compressor.stats.compressed_bytes == total_packet_size);
+	return total_packet_size;
+}
+
+
+void StreamCompression::test()
+{
+	conPrint("StreamCompression::test()");
+
+	//-------------------- Test the dictionary is deterministic --------------------
+	{
+		const std::vector<uint8> dict = buildDictionary();
+		testAssert(dict == getDictionary());
+		testAssert(dict.size() > 1000 && dict.size() < 65536);
+		testAssert(getDictionaryHash() == XXH64(dict.data(), dict.size(), /*seed=*/1));
+	}
+
+	std::vector<uint8> msgs;
+	makeTestMessages(/*num_obs=*/2000, msgs);
+
+	//-------------------- Test round trips with various write sizes and flush intervals --------------------
+	for(int use_dict=0; use_dict<2; ++use_dict)
+	{
+		testRoundTrip(msgs, use_dict != 0, /*write_size=*/1, /*flush_interval=*/1000000000); // Tiny writes
+		testRoundTrip(msgs, use_dict != 0, /*write_size=*/37, /*flush_interval=*/37); // Flushing after every write, with messages split across writes.
+		testRoundTrip(msgs, use_dict != 0, /*write_size=*/1000, /*flush_interval=*/4096);
+		testRoundTrip(msgs, use_dict != 0, /*write_size=*/msgs.size(), /*flush_interval=*/msgs.size()); // One big write, will be split into multiple CompressedMessages messages.
+	}
+
+	//-------------------- Test compression ratio, and time taken --------------------
+	{
+		for(int use_dict=0; use_dict<2; ++use_dict)
+		{
+			for(size_t num_obs = 10; num_obs <= 10000; num_obs *= 10)
+			{
+				std::vector<uint8> query_response_msgs;
+				makeTestMessages(num_obs, query_response_msgs);
+
+				Timer timer;
+				const size_t compressed_size = testRoundTrip(query_response_msgs, use_dict != 0, /*write_size=*/4096, /*flush_interval=*/4096); // Flush at each ~4 KB chunk, like a QueryObjectsInAABB response.
+				conPrint((use_dict ? "With dictionary, " : "No dictionary,   ") + toString(num_obs) + " objects: " + toString(query_response_msgs.size()) + " B -> " + toString(compressed_size) + " B, ratio: " +
+					doubleToStringNSigFigs((double)query_response_msgs.size() / compressed_size, 3) + ", round trip took " + timer.elapsedStringNSigFigs(3));
+				testAssert(compressed_size < query_response_msgs.size());
+			}
+		}
+
+		// With only a few objects the dictionary should help.
+		std::vector<uint8> few_msgs;
+		makeTestMessages(/*num_obs=*/10, few_msgs);
+		testAssert(testRoundTrip(few_msgs, /*use_dictionary=*/true, 4096, 4096) < testRoundTrip(few_msgs, /*use_dictionary=*/false, 4096, 4096));
+	}
+
+	//-------------------- Test invalid compressed data --------------------
+	{
+		Decompressor decompressor(/*use_dictionary=*/false);
+		const uint8 data[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+		try
+		{
+			decompressor.decompress(data, sizeof(data));
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+	}
+
+	//-------------------- Test dictionary mismatch --------------------
+	{
+		Compressor compressor(/*use_dictionary=*/true, 3);
+		Decompressor decompressor(/*use_dictionary=*/false);
+		SocketBufferOutStream packets(SocketBufferOutStream::DontUseNetworkByteOrder);
+		compressor.compress(msgs.data(), 10000, packets);
+		compressor.flush(packets);
+		try
+		{
+			std::vector<uint8> decompressed_msgs;
+			receivePackets(packets, decompressor, decompressed_msgs);
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+	}
+
+	//-------------------- Test invalid messages in the decompressed stream --------------------
+	{
+		const uint32 invalid_msgs[][2] = {
+			{ Protocol::TimeSyncMessage, 4 }, // Too short
+			{ Protocol::TimeSyncMessage, (uint32)MAX_MSG_SIZE + 1 }, // Too long
+			{ Protocol::CompressedMessages, 8 }, // Nested CompressedMessages
+			{ Protocol::StreamCompressionEnabled, 12 }
+		};
+		for(size_t i=0; i<staticArrayNumElems(invalid_msgs); ++i)
+		{
+			Compressor compressor(/*use_dictionary=*/false, 3);
+			Decompressor decompressor(/*use_dictionary=*/false);
+			SocketBufferOutStream packets(SocketBufferOutStream::DontUseNetworkByteOrder);
+			compressor.compress(invalid_msgs[i], sizeof(uint32) * 2, packets);
+			compressor.compress(msgs.data(), 100, packets);
+			compressor.flush(packets);
+			try
+			{
+				std::vector<uint8> decompressed_msgs;
+				receivePackets(packets, decompressor, decompressed_msgs);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+	}
+
+	conPrint("StreamCompression::test() done.");
+}
+
+
+#endif // BUILD_TESTS
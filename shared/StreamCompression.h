@@ -0,0 +1,134 @@
+/*=====================================================================
+StreamCompression.h
+-------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <RefCounted.h>
+#include <Reference.h>
+#include <utils/Platform.h>
+#include <vector>
+class SocketBufferOutStream;
+class BufferInStream;
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+
+/*=====================================================================
+StreamCompression
+-----------------
+Optional zstd compression of the messages the server sends on a ConnectionTypeUpdates connection.
+
+Negotiation (protocol version >= 42):
+	* The client sends EnableStreamCompression, with the hash of its built-in dictionary.
+	* If the server has stream compression enabled, it replies with StreamCompressionEnabled, with USE_DICTIONARY_FLAG set
+	  if the dictionary hashes match.  Every message the server sends after that is part of a single zstd stream,
+	  sent in CompressedMessages messages.
+	* The client decompresses the payloads of CompressedMessages messages, and handles the decompressed messages as if
+	  they had been read from the socket.
+
+The server flushes the zstd stream whenever it would have flushed the socket, e.g. after each ~4 KB chunk of a
+QueryObjectsInAABB response, so the client can decompress and handle everything sent so far.
+
+The dictionary is built from serialised ObjectInitialSend messages for typical objects and materials, and
+is loaded as a raw-content dictionary.  It mostly helps the start of the stream, before the zstd window has
+filled with earlier messages.
+The dictionary depends on the WorldObject serialisation code, so client and server only use it if the hashes match.
+=====================================================================*/
+namespace StreamCompression
+{
+
+
+const uint32 USE_DICTIONARY_FLAG = 1; // Flag in StreamCompressionEnabled messages.
+
+const size_t MAX_MSG_SIZE = 1000000; // Max size of a decompressed message.  Matches the max message size read from the socket.
+
+
+// Returns the built-in dictionary.  Threadsafe.
+const std::vector<uint8>& getDictionary();
+uint64 getDictionaryHash();
+
+
+struct Stats
+{
+	Stats() : uncompressed_bytes(0), compressed_bytes(0), compress_time(0) {}
+
+	uint64 uncompressed_bytes; // Total size of messages passed to compress().
+	uint64 compressed_bytes; // Total size of CompressedMessages messages written, including the message headers.
+	double compress_time; // Total time spent in compress() and flush(), in seconds.
+};
+
+
+/*=====================================================================
+Compressor
+----------
+Used by the server, one per connection.  Not threadsafe.
+=====================================================================*/
+class Compressor : public RefCounted
+{
+public:
+	// Throws glare::Exception on failure.
+	Compressor(bool use_dictionary, int compression_level);
+	~Compressor();
+
+	// Compresses data.  Appends any compressed output to packets_out, as CompressedMessages messages.
+	// Compressed output is buffered, so may not be written until flush() is called.
+	// packets_out should use DontUseNetworkByteOrder.
+	void compress(const void* data, size_t len, SocketBufferOutStream& packets_out);
+
+	// Appends all remaining compressed output to packets_out, so the peer can decompress everything passed to compress() so far.
+	void flush(SocketBufferOutStream& packets_out);
+
+	Stats stats;
+
+	static const size_t MAX_COMPRESSED_MSG_PAYLOAD_SIZE = 65536;
+
+private:
+	GLARE_DISABLE_COPY(Compressor)
+
+	void appendCompressedMessages(size_t max_remaining_bytes, SocketBufferOutStream& packets_out);
+
+	ZSTD_CCtx_s* context;
+	std::vector<uint8> compressed; // Compressed output not written to packets_out yet.
+	size_t compressed_size; // Number of bytes of compressed output in compressed.
+};
+
+
+/*=====================================================================
+Decompressor
+------------
+Used by the client.  Not threadsafe.
+=====================================================================*/
+class Decompressor : public RefCounted
+{
+public:
+	// Throws glare::Exception on failure.
+	Decompressor(bool use_dictionary);
+	~Decompressor();
+
+	// Decompresses the payload of a CompressedMessages message.  Throws glare::Exception on invalid data.
+	void decompress(const void* data, size_t len);
+
+	// Have enough bytes been decompressed for a complete message (or an invalid message header)?  If so, takeMessage() will take it (or throw).
+	bool haveCompleteMessage() const;
+
+	// If a complete message has been decompressed, copies it to msg_buffer_out, with read_index set after the message header, and returns true.
+	// Throws glare::Exception if the message header is invalid.
+	bool takeMessage(BufferInStream& msg_buffer_out, uint32& msg_type_out);
+
+private:
+	GLARE_DISABLE_COPY(Decompressor)
+
+	ZSTD_DCtx_s* context;
+	std::vector<uint8> decompressed; // Decompressed messages.
+	size_t decompressed_size; // Number of bytes of decompressed data in decompressed.
+	size_t read_i; // Index in decompressed of the next message to take.
+};
+
+
+void test();
+
+
+} // end namespace StreamCompression
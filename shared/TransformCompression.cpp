@@ -0,0 +1,781 @@
+/*=====================================================================
+TransformCompression.cpp
+------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "TransformCompression.h"
+
+
+#include "Protocol.h"
+#include "MessageUtils.h"
+#include "VarIntUtils.h"
+#include <utils/SocketBufferOutStream.h>
+#include <utils/BufferInStream.h>
+#include <utils/Exception.h>
+#include <utils/StringUtils.h>
+#include <maths/mathstypes.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+namespace TransformCompression
+{
+
+
+// Field mask bits for each update in a TransformUpdateBatch message.
+static const uint8 FIELD_POS					= 1;
+static const uint8 FIELD_ROT					= 2; // Avatar rotation for avatars, packed quaternion for objects.
+static const uint8 FIELD_SCALE					= 4;
+static const uint8 FIELD_LINEAR_VEL				= 8;
+static const uint8 FIELD_ANGULAR_VEL			= 16;
+static const uint8 FIELD_ANIM_STATE				= 32;
+static const uint8 FIELD_TRANSFORM_AVATAR_UID	= 64;
+static const uint8 FIELD_CLIENT_TIME			= 128;
+
+static const size_t MAX_UPDATE_SIZE = 160; // Upper bound on the encoded size of a single update.
+
+static const float QUAT_COMPONENT_BOUND = 0.70710678f; // 1/sqrt(2): bound on the magnitude of the non-largest quaternion components.
+static const uint32 QUAT_COMPONENT_MAX = (1 << 15) - 1;
+
+
+static inline int64 quantise(double x, double step)
+{
+	if(!std::isfinite(x))
+		return 0;
+	const double q = std::floor(x / step + 0.5);
+	return (int64)myClamp(q, -1.0e15, 1.0e15); // Clamp to avoid overflow when converting to int64 and computing deltas.
+}
+
+
+static inline uint8 readUInt8(BufferInStream& stream)
+{
+	uint8 x;
+	stream.readData(&x, 1);
+	return x;
+}
+
+
+// Deltas are computed with wrapping unsigned arithmetic, so any UID delta can be encoded.
+static inline void writeDelta(int64 new_val, int64 old_val, SocketBufferOutStream& stream) { VarIntUtils::writeVarUInt(VarIntUtils::zigZagEncode((int64)((uint64)new_val - (uint64)old_val)), stream); }
+static inline int64 readDelta(int64 old_val, BufferInStream& stream) { return (int64)((uint64)old_val + (uint64)VarIntUtils::zigZagDecode(VarIntUtils::readVarUInt(stream))); }
+
+
+static inline void writeDelta3(const int64* new_vals, const int64* old_vals, SocketBufferOutStream& stream)
+{
+	for(int i=0; i<3; ++i)
+		writeDelta(new_vals[i], old_vals[i], stream);
+}
+
+
+static inline void readDelta3(int64* vals, BufferInStream& stream)
+{
+	for(int i=0; i<3; ++i)
+		vals[i] = readDelta(vals[i], stream);
+}
+
+
+static inline bool equal3(const int64* a, const int64* b) { return a[0] == b[0] && a[1] == b[1] && a[2] == b[2]; }
+
+
+uint64 packQuat(const Quatf& q_)
+{
+	float q[4] = { q_.v.x[0], q_.v.x[1], q_.v.x[2], q_.v.x[3] };
+	const float len2 = q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3];
+	if(!(len2 > 1.0e-12f) || !std::isfinite(len2)) // Degenerate quaternion, use identity instead.
+	{
+		q[0] = q[1] = q[2] = 0;
+		q[3] = 1;
+	}
+	else
+	{
+		const float recip_len = 1 / std::sqrt(len2);
+		for(int i=0; i<4; ++i)
+			q[i] *= recip_len;
+	}
+
+	int largest = 0;
+	for(int i=1; i<4; ++i)
+		if(std::fabs(q[i]) > std::fabs(q[largest]))
+			largest = i;
+
+	// q and -q are the same rotation, so make the largest component positive, then it can be reconstructed from the other three.
+	const float sign = (q[largest] < 0) ? -1.f : 1.f;
+
+	uint64 packed = (uint64)largest << 45;
+	int shift = 30;
+	for(int i=0; i<4; ++i)
+		if(i != largest)
+		{
+			const float c = myClamp(q[i] * sign, -QUAT_COMPONENT_BOUND, QUAT_COMPONENT_BOUND);
+			const uint32 qc = (uint32)((c / QUAT_COMPONENT_BOUND * 0.5f + 0.5f) * QUAT_COMPONENT_MAX + 0.5f);
+			packed |= (uint64)myMin(qc, QUAT_COMPONENT_MAX) << shift;
+			shift -= 15;
+		}
+	return packed;
+}
+
+
+Quatf unpackQuat(uint64 packed)
+{
+	const int largest = (int)((packed >> 45) & 0x3);
+
+	float q[4];
+	float sum2 = 0;
+	int shift = 30;
+	for(int i=0; i<4; ++i)
+		if(i != largest)
+		{
+			const uint32 qc = (uint32)((packed >> shift) & QUAT_COMPONENT_MAX);
+			q[i] = ((float)qc / QUAT_COMPONENT_MAX * 2.f - 1.f) * QUAT_COMPONENT_BOUND;
+			sum2 += q[i] * q[i];
+			shift -= 15;
+		}
+	q[largest] = std::sqrt(myMax(0.f, 1.f - sum2));
+
+	return Quatf(Vec4f(q[0], q[1], q[2], q[3]));
+}
+
+
+TransformDeltaCodec::QuantisedTransform::QuantisedTransform()
+:	packed_rot(packQuat(Quatf::identity())),
+	scale(1, 1, 1),
+	avatar_anim_state(0),
+	transform_update_avatar_uid(0),
+	client_time(0)
+{
+	for(int i=0; i<3; ++i)
+	{
+		pos[i] = 0;
+		avatar_rot[i] = 0;
+		linear_vel[i] = 0;
+		angular_vel[i] = 0;
+	}
+}
+
+
+TransformDeltaCodec::TransformDeltaCodec()
+{}
+
+
+TransformDeltaCodec::~TransformDeltaCodec()
+{}
+
+
+static bool uidLessThan(const EntityTransform* a, const EntityTransform* b)
+{
+	return a->uid.value() < b->uid.value();
+}
+
+
+void TransformDeltaCodec::writeBatchMessages(const std::vector<const EntityTransform*>& transforms_, SocketBufferOutStream& scratch_packet, std::string& data_out)
+{
+	if(transforms_.empty())
+		return;
+
+	// Sort by UID so that UID deltas are small.  Use a stable sort so that multiple updates for an entity stay in order.
+	std::vector<const EntityTransform*> transforms = transforms_;
+	std::stable_sort(transforms.begin(), transforms.end(), uidLessThan);
+
+	size_t i = 0;
+	while(i < transforms.size())
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::TransformUpdateBatch);
+		const size_t num_updates_offset = scratch_packet.buf.size();
+		scratch_packet.writeUInt32(0); // Write dummy number of updates, will be updated when known.
+
+		uint64 prev_uid = 0;
+		uint32 num_updates = 0;
+		for(; (i < transforms.size()) && (scratch_packet.buf.size() + MAX_UPDATE_SIZE <= MAX_BATCH_MSG_SIZE); ++i)
+		{
+			const EntityTransform& t = *transforms[i];
+
+			QuantisedTransform& baseline = baselines[t.entityKey()];
+			QuantisedTransform q = baseline;
+
+			for(int c=0; c<3; ++c)
+				q.pos[c] = quantise(t.pos[c], POS_STEP);
+
+			if(t.type == EntityTransform::Type_Avatar)
+			{
+				for(int c=0; c<3; ++c)
+					q.avatar_rot[c] = quantise(t.avatar_rotation[c], AVATAR_ROT_STEP);
+				q.avatar_anim_state = t.avatar_anim_state;
+			}
+			else
+			{
+				q.packed_rot = packQuat(t.rot);
+				q.transform_update_avatar_uid = t.transform_update_avatar_uid;
+
+				if(t.type == EntityTransform::Type_Object)
+					q.scale = t.scale;
+				else
+				{
+					for(int c=0; c<3; ++c)
+					{
+						q.linear_vel[c]  = quantise(t.linear_vel[c],  VEL_STEP);
+						q.angular_vel[c] = quantise(t.angular_vel[c], VEL_STEP);
+					}
+					q.client_time = quantise(t.client_time, CLIENT_TIME_STEP);
+				}
+			}
+
+			uint8 mask = 0;
+			if(!equal3(q.pos, baseline.pos))											mask |= FIELD_POS;
+			if(t.type == EntityTransform::Type_Avatar)
+			{
+				if(!equal3(q.avatar_rot, baseline.avatar_rot))							mask |= FIELD_ROT;
+				if(q.avatar_anim_state != baseline.avatar_anim_state)					mask |= FIELD_ANIM_STATE;
+			}
+			else
+			{
+				if(q.packed_rot != baseline.packed_rot)									mask |= FIELD_ROT;
+				if(q.transform_update_avatar_uid != baseline.transform_update_avatar_uid)	mask |= FIELD_TRANSFORM_AVATAR_UID;
+				if(std::memcmp(&q.scale, &baseline.scale, sizeof(Vec3f)) != 0)			mask |= FIELD_SCALE;
+				if(!equal3(q.linear_vel, baseline.linear_vel))							mask |= FIELD_LINEAR_VEL;
+				if(!equal3(q.angular_vel, baseline.angular_vel))						mask |= FIELD_ANGULAR_VEL;
+				if(q.client_time != baseline.client_time)								mask |= FIELD_CLIENT_TIME;
+			}
+
+			const uint8 type = (uint8)t.type;
+			scratch_packet.writeData(&type, 1);
+			writeDelta((int64)t.uid.value(), (int64)prev_uid, scratch_packet);
+			scratch_packet.writeData(&mask, 1);
+
+			if(mask & FIELD_POS)
+				writeDelta3(q.pos, baseline.pos, scratch_packet);
+			if(mask & FIELD_ROT)
+			{
+				if(t.type == EntityTransform::Type_Avatar)
+					writeDelta3(q.avatar_rot, baseline.avatar_rot, scratch_packet);
+				else
+				{
+					const uint8 packed_rot_bytes[6] = { (uint8)q.packed_rot, (uint8)(q.packed_rot >> 8), (uint8)(q.packed_rot >> 16), (uint8)(q.packed_rot >> 24), (uint8)(q.packed_rot >> 32), (uint8)(q.packed_rot >> 40) };
+					scratch_packet.writeData(packed_rot_bytes, 6);
+				}
+			}
+			if(mask & FIELD_SCALE)
+				scratch_packet.writeData(&q.scale.x, sizeof(float) * 3);
+			if(mask & FIELD_LINEAR_VEL)
+				writeDelta3(q.linear_vel, baseline.linear_vel, scratch_packet);
+			if(mask & FIELD_ANGULAR_VEL)
+				writeDelta3(q.angular_vel, baseline.angular_vel, scratch_packet);
+			if(mask & FIELD_ANIM_STATE)
+				VarIntUtils::writeVarUInt(q.avatar_anim_state, scratch_packet);
+			if(mask & FIELD_TRANSFORM_AVATAR_UID)
+				VarIntUtils::writeVarUInt(q.transform_update_avatar_uid, scratch_packet);
+			if(mask & FIELD_CLIENT_TIME)
+				writeDelta(q.client_time, baseline.client_time, scratch_packet);
+
+			baseline = q;
+			prev_uid = t.uid.value();
+			num_updates++;
+		}
+
+		std::memcpy(&scratch_packet.buf[num_updates_offset], &num_updates, sizeof(uint32));
+		MessageUtils::updatePacketLengthField(scratch_packet);
+
+		data_out.append((const char*)scratch_packet.buf.data(), scratch_packet.buf.size());
+	}
+}
+
+
+void TransformDeltaCodec::readBatch(BufferInStream& msg_buffer, std::vector<EntityTransform>& transforms_out)
+{
+	transforms_out.clear();
+
+	const uint32 num_updates = msg_buffer.readUInt32();
+	if(num_updates > (msg_buffer.buf.size() - msg_buffer.read_index) / 3) // Each update is at least 3 bytes.
+		throw glare::Exception("Invalid number of updates in TransformUpdateBatch: " + ::toString(num_updates));
+
+	transforms_out.resize(num_updates);
+
+	uint64 prev_uid = 0;
+	for(uint32 i=0; i<num_updates; ++i)
+	{
+		EntityTransform& t = transforms_out[i];
+
+		const uint8 type = readUInt8(msg_buffer);
+		if(type > EntityTransform::Type_ObjectPhysics)
+			throw glare::Exception("Invalid entity type in TransformUpdateBatch: " + ::toString(type));
+		t.type = (EntityTransform::Type)type;
+		t.uid = UID((uint64)readDelta((int64)prev_uid, msg_buffer));
+		prev_uid = t.uid.value();
+
+		const uint8 mask = readUInt8(msg_buffer);
+
+		QuantisedTransform& q = baselines[t.entityKey()];
+
+		if(mask & FIELD_POS)
+			readDelta3(q.pos, msg_buffer);
+		if(mask & FIELD_ROT)
+		{
+			if(t.type == EntityTransform::Type_Avatar)
+				readDelta3(q.avatar_rot, msg_buffer);
+			else
+			{
+				uint8 packed_rot_bytes[6];
+				msg_buffer.readData(packed_rot_bytes, 6);
+				q.packed_rot = 0;
+				for(int b=0; b<6; ++b)
+					q.packed_rot |= (uint64)packed_rot_bytes[b] << (8 * b);
+			}
+		}
+		if(mask & FIELD_SCALE)
+			msg_buffer.readData(&q.scale.x, sizeof(float) * 3);
+		if(mask & FIELD_LINEAR_VEL)
+			readDelta3(q.linear_vel, msg_buffer);
+		if(mask & FIELD_ANGULAR_VEL)
+			readDelta3(q.angular_vel, msg_buffer);
+		if(mask & FIELD_ANIM_STATE)
+			q.avatar_anim_state = (uint32)VarIntUtils::readVarUInt(msg_buffer);
+		if(mask & FIELD_TRANSFORM_AVATAR_UID)
+			q.transform_update_avatar_uid = (uint32)VarIntUtils::readVarUInt(msg_buffer);
+		if(mask & FIELD_CLIENT_TIME)
+			q.client_time = readDelta(q.client_time, msg_buffer);
+
+		// Dequantise
+		t.pos = Vec3d(q.pos[0] * POS_STEP, q.pos[1] * POS_STEP, q.pos[2] * POS_STEP);
+		t.avatar_rotation = Vec3f((float)(q.avatar_rot[0] * AVATAR_ROT_STEP), (float)(q.avatar_rot[1] * AVATAR_ROT_STEP), (float)(q.avatar_rot[2] * AVATAR_ROT_STEP));
+		t.avatar_anim_state = q.avatar_anim_state;
+		t.rot = unpackQuat(q.packed_rot);
+		t.scale = q.scale;
+		t.linear_vel  = Vec3f((float)(q.linear_vel[0]  * VEL_STEP), (float)(q.linear_vel[1]  * VEL_STEP), (float)(q.linear_vel[2]  * VEL_STEP));
+		t.angular_vel = Vec3f((float)(q.angular_vel[0] * VEL_STEP), (float)(q.angular_vel[1] * VEL_STEP), (float)(q.angular_vel[2] * VEL_STEP));
+		t.transform_update_avatar_uid = q.transform_update_avatar_uid;
+		t.client_time = q.client_time * CLIENT_TIME_STEP;
+	}
+}
+
+
+void TransformDeltaCodec::resetEntity(uint64 entity_key)
+{
+	baselines.erase(entity_key);
+}
+
+
+void TransformDeltaCodec::clear()
+{
+	baselines.clear();
+}
+
+
+} // end namespace TransformCompression
+
+
+#if BUILD_TESTS
+
+
+#include <maths/PCG32.h>
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+
+
+namespace TransformCompression
+{
+
+
+// Decode all the TransformUpdateBatch messages in data.
+static void decodeMessages(const std::string& data, TransformDeltaCodec& decoder, std::vector<EntityTransform>& transforms_out, size_t& num_messages_out)
+{
+	transforms_out.clear();
+	num_messages_out = 0;
+
+	std::vector<EntityTransform> msg_transforms;
+	size_t offset = 0;
+	while(offset < data.size())
+	{
+		testAssert(offset + sizeof(uint32) * 2 <= data.size());
+		uint32 msg_type_and_len[2];
+		std::memcpy(msg_type_and_len, &data[offset], sizeof(uint32) * 2);
+		testAssert(msg_type_and_len[0] == Protocol::TransformUpdateBatch);
+		const uint32 msg_len = msg_type_and_len[1];
+		testAssert(msg_len <= TransformDeltaCodec::MAX_BATCH_MSG_SIZE && offset + msg_len <= data.size());
+
+		BufferInStream msg_buffer;
+		msg_buffer.buf.resize(msg_len);
+		std::memcpy(msg_buffer.buf.data(), &data[offset], msg_len);
+		msg_buffer.read_index = sizeof(uint32) * 2;
+
+		decoder.readBatch(msg_buffer, msg_transforms);
+		testAssert(msg_buffer.endOfStream());
+		transforms_out.insert(transforms_out.end(), msg_transforms.begin(), msg_transforms.end());
+
+		offset += msg_len;
+		num_messages_out++;
+	}
+}
+
+
+// Returns the size of the AvatarTransformUpdate, ObjectTransformUpdate or ObjectPhysicsTransformUpdate message that would be sent for the transform.
+static size_t legacyMessageSize(const EntityTransform& t)
+{
+	const size_t header_size = sizeof(uint32) * 2 + sizeof(uint64) + sizeof(double) * 3; // Header, UID, pos.
+	switch(t.type)
+	{
+	case EntityTransform::Type_Avatar: return header_size + sizeof(float) * 3 + sizeof(uint32);
+	case EntityTransform::Type_Object: return header_size + sizeof(float) * (3 + 1 + 3) + sizeof(uint32);
+	case EntityTransform::Type_ObjectPhysics: return header_size + sizeof(float) * (4 + 3 + 3) + sizeof(uint32) + sizeof(double);
+	}
+	return 0;
+}
+
+
+// Returns true if a and b represent approximately the same rotation.  (q and -q are the same rotation)
+static bool quatsEquivalent(const Quatf& a, const Quatf& b, float tol)
+{
+	float dot = 0, a_len2 = 0, b_len2 = 0;
+	for(int i=0; i<4; ++i)
+	{
+		dot += a.v.x[i] * b.v.x[i];
+		a_len2 += a.v.x[i] * a.v.x[i];
+		b_len2 += b.v.x[i] * b.v.x[i];
+	}
+	return std::fabs(dot) >= (1 - tol) * std::sqrt(a_len2 * b_len2);
+}
+
+
+static void checkDecodedTransform(const EntityTransform& decoded, const EntityTransform& t)
+{
+	testAssert(decoded.type == t.type);
+	testAssert(decoded.uid == t.uid);
+	for(int c=0; c<3; ++c)
+		testAssert(std::fabs(decoded.pos[c] - t.pos[c]) <= POS_STEP * 0.5 + 1.0e-9);
+
+	if(t.type == EntityTransform::Type_Avatar)
+	{
+		for(int c=0; c<3; ++c)
+			testAssert(std::fabs(decoded.avatar_rotation[c] - t.avatar_rotation[c]) <= AVATAR_ROT_STEP * 0.5 + 1.0e-5);
+		testAssert(decoded.avatar_anim_state == t.avatar_anim_state);
+	}
+	else
+	{
+		testAssert(quatsEquivalent(decoded.rot, t.rot, 1.0e-4f));
+		testAssert(decoded.transform_update_avatar_uid == t.transform_update_avatar_uid);
+		if(t.type == EntityTransform::Type_Object)
+			testAssert(decoded.scale == t.scale);
+		else
+		{
+			for(int c=0; c<3; ++c)
+			{
+				testAssert(std::fabs(decoded.linear_vel[c]  - t.linear_vel[c])  <= VEL_STEP * 0.5 + 1.0e-5);
+				testAssert(std::fabs(decoded.angular_vel[c] - t.angular_vel[c]) <= VEL_STEP * 0.5 + 1.0e-5);
+			}
+			testAssert(std::fabs(decoded.client_time - t.client_time) <= CLIENT_TIME_STEP * 0.5 + 1.0e-9);
+		}
+	}
+}
+
+
+static Quatf randomQuat(PCG32& rng)
+{
+	const Vec3f axis = normalise(Vec3f(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f) + Vec3f(1.0e-3f, 0, 0));
+	return Quatf::fromAxisAndAngle(axis, (rng.unitRandom() * 2 - 1) * Maths::pi<float>());
+}
+
+
+static EntityTransform makeRandomTransform(PCG32& rng, EntityTransform::Type type, uint64 uid)
+{
+	EntityTransform t;
+	t.type = type;
+	t.uid = UID(uid);
+	t.pos = Vec3d((rng.unitRandom() * 2 - 1) * 10000.0, (rng.unitRandom() * 2 - 1) * 10000.0, rng.unitRandom() * 100.0);
+	t.avatar_rotation = Vec3f(0, (rng.unitRandom() - 0.5f) * 3.f, (rng.unitRandom() * 2 - 1) * 10.f);
+	t.avatar_anim_state = (uint32)(rng.unitRandom() * 8) | (1u << 16);
+	t.rot = randomQuat(rng);
+	t.scale = Vec3f(1.f + rng.unitRandom(), 1.f, 2.f);
+	t.linear_vel = Vec3f(rng.unitRandom() * 10.f, -rng.unitRandom(), 0.f);
+	t.angular_vel = Vec3f(0.f, rng.unitRandom(), -rng.unitRandom() * 3.f);
+	t.transform_update_avatar_uid = 1 + (uint32)(rng.unitRandom() * 100);
+	t.client_time = 1000.0 + rng.unitRandom() * 100.0;
+	return t;
+}
+
+
+static std::vector<const EntityTransform*> getPointers(const std::vector<EntityTransform>& transforms)
+{
+	std::vector<const EntityTransform*> pointers(transforms.size());
+	for(size_t i=0; i<transforms.size(); ++i)
+		pointers[i] = &transforms[i];
+	return pointers;
+}
+
+
+static const EntityTransform* findTransformForUID(const std::vector<EntityTransform>& transforms, const UID& uid)
+{
+	for(size_t i=0; i<transforms.size(); ++i)
+		if(transforms[i].uid == uid)
+			return &transforms[i];
+	return NULL;
+}
+
+
+void TransformDeltaCodec::test()
+{
+	conPrint("TransformDeltaCodec::test()");
+
+	PCG32 rng(1);
+
+	//-------------------- Test zigzag and varint encoding --------------------
+	{
+		const int64 vals[] = { 0, 1, -1, 63, -64, 64, 1000000, -1000000, (int64)1.0e15, (int64)-1.0e15, std::numeric_limits<int64>::max(), std::numeric_limits<int64>::min() };
+		SocketBufferOutStream stream(SocketBufferOutStream::DontUseNetworkByteOrder);
+		for(size_t i=0; i<staticArrayNumElems(vals); ++i)
+		{
+			testAssert(VarIntUtils::zigZagDecode(VarIntUtils::zigZagEncode(vals[i])) == vals[i]);
+			VarIntUtils::writeVarUInt(VarIntUtils::zigZagEncode(vals[i]), stream);
+		}
+		testAssert(stream.buf[0] == 0); // 0 should be encoded in a single byte
+
+		BufferInStream in_stream;
+		in_stream.buf.resize(stream.buf.size());
+		std::memcpy(in_stream.buf.data(), stream.buf.data(), stream.buf.size());
+		for(size_t i=0; i<staticArrayNumElems(vals); ++i)
+			testAssert(VarIntUtils::zigZagDecode(VarIntUtils::readVarUInt(in_stream)) == vals[i]);
+		testAssert(in_stream.endOfStream());
+	}
+
+	//-------------------- Test smallest-three quaternion packing --------------------
+	{
+		for(int i=0; i<10000; ++i)
+		{
+			const Quatf q = randomQuat(rng);
+			const Quatf unpacked = unpackQuat(packQuat(q));
+			testAssert(quatsEquivalent(unpacked, q, 1.0e-4f));
+
+			// Since q and -q are the same rotation, they should pack to the same value.
+			testAssert(packQuat(Quatf(Vec4f(-q.v.x[0], -q.v.x[1], -q.v.x[2], -q.v.x[3]))) == packQuat(q));
+		}
+
+		// Test max per-component error for some axis-aligned rotations, where the largest component may be any of the 4.
+		const Quatf test_quats[] = { Quatf::identity(), Quatf(Vec4f(1, 0, 0, 0)), Quatf(Vec4f(0, 1, 0, 0)), Quatf(Vec4f(0, 0, -1, 0)), Quatf::fromAxisAndAngle(Vec3f(0, 0, 1), 1.f) };
+		for(size_t i=0; i<staticArrayNumElems(test_quats); ++i)
+		{
+			const Quatf unpacked = unpackQuat(packQuat(test_quats[i]));
+			testAssert(quatsEquivalent(unpacked, test_quats[i], 1.0e-6f));
+		}
+
+		// Degenerate quaternions should be encoded as the identity.
+		testAssert(packQuat(Quatf(Vec4f(0, 0, 0, 0))) == packQuat(Quatf::identity()));
+		testAssert(packQuat(Quatf(Vec4f(std::numeric_limits<float>::quiet_NaN(), 0, 0, 1))) == packQuat(Quatf::identity()));
+	}
+
+	//-------------------- Test round-tripping over multiple ticks, for all entity types --------------------
+	{
+		TransformDeltaCodec encoder, decoder;
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		std::vector<EntityTransform> transforms;
+		for(uint64 i=0; i<30; ++i)
+			transforms.push_back(makeRandomTransform(rng, (EntityTransform::Type)(i % 3), /*uid=*/100 + i * 7));
+
+		std::vector<EntityTransform> decoded;
+		for(int tick=0; tick<20; ++tick)
+		{
+			// Move some of the entities, change some other fields.
+			for(size_t i=0; i<transforms.size(); ++i)
+			{
+				if(rng.unitRandom() < 0.5f)
+					transforms[i].pos += Vec3d(rng.unitRandom() * 0.1, 0.01, -0.05);
+				if(rng.unitRandom() < 0.2f)
+					transforms[i].rot = randomQuat(rng);
+				if(rng.unitRandom() < 0.1f)
+					transforms[i].avatar_anim_state = (uint32)(rng.unitRandom() * 8);
+				transforms[i].client_time += 0.1;
+			}
+
+			std::string data;
+			encoder.writeBatchMessages(getPointers(transforms), scratch_packet, data);
+
+			size_t num_messages;
+			decodeMessages(data, decoder, decoded, num_messages);
+			testAssert(num_messages == 1);
+			testAssert(decoded.size() == transforms.size());
+			for(size_t i=0; i<transforms.size(); ++i)
+			{
+				const EntityTransform* decoded_t = findTransformForUID(decoded, transforms[i].uid);
+				testAssert(decoded_t != NULL);
+				checkDecodedTransform(*decoded_t, transforms[i]);
+			}
+		}
+
+		testAssert(encoder.numEntities() == transforms.size());
+		testAssert(decoder.numEntities() == transforms.size());
+	}
+
+	//-------------------- Test that quantisation errors don't accumulate --------------------
+	{
+		TransformDeltaCodec encoder, decoder;
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		EntityTransform t = makeRandomTransform(rng, EntityTransform::Type_Avatar, 1);
+		std::vector<EntityTransform> decoded;
+		for(int tick=0; tick<1000; ++tick)
+		{
+			t.pos += Vec3d(0.0003, -0.0007, 0.00011); // Moves less than the quantisation step each tick.
+			std::string data;
+			encoder.writeBatchMessages(std::vector<const EntityTransform*>(1, &t), scratch_packet, data);
+			size_t num_messages;
+			decodeMessages(data, decoder, decoded, num_messages);
+			testAssert(decoded.size() == 1);
+			checkDecodedTransform(decoded[0], t);
+		}
+	}
+
+	//-------------------- Test that batched updates are much smaller than the legacy messages --------------------
+	{
+		TransformDeltaCodec encoder, decoder;
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		std::vector<EntityTransform> transforms;
+		for(uint64 i=0; i<100; ++i)
+			transforms.push_back(makeRandomTransform(rng, (i < 50) ? EntityTransform::Type_Avatar : EntityTransform::Type_ObjectPhysics, /*uid=*/1000 + i));
+
+		size_t legacy_size = 0;
+		size_t batched_size = 0;
+		std::vector<EntityTransform> decoded;
+		for(int tick=0; tick<100; ++tick)
+		{
+			// Walking avatars and moving physics objects.
+			for(size_t i=0; i<transforms.size(); ++i)
+			{
+				transforms[i].pos += Vec3d(0.05, 0.02, 0);
+				transforms[i].avatar_rotation.z += 0.01f;
+				transforms[i].rot = Quatf::fromAxisAndAngle(Vec3f(0, 0, 1), tick * 0.01f);
+				transforms[i].linear_vel.x += 0.01f;
+				transforms[i].client_time += 0.1;
+				legacy_size += legacyMessageSize(transforms[i]);
+			}
+
+			std::string data;
+			encoder.writeBatchMessages(getPointers(transforms), scratch_packet, data);
+			batched_size += data.size();
+
+			size_t num_messages;
+			decodeMessages(data, decoder, decoded, num_messages);
+			testAssert(decoded.size() == transforms.size());
+		}
+
+		conPrint("legacy size: " + toString(legacy_size) + " B, batched size: " + toString(batched_size) + " B (" + doubleToStringNSigFigs((double)batched_size / legacy_size * 100, 3) + " %)");
+		testAssert(batched_size * 3 < legacy_size);
+	}
+
+	//-------------------- Test resetEntity --------------------
+	{
+		TransformDeltaCodec encoder, decoder;
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		EntityTransform t = makeRandomTransform(rng, EntityTransform::Type_Object, 12);
+		std::vector<const EntityTransform*> transforms(1, &t);
+		std::vector<EntityTransform> decoded;
+		size_t num_messages;
+
+		std::string data;
+		encoder.writeBatchMessages(transforms, scratch_packet, data);
+		const size_t first_update_size = data.size();
+		decodeMessages(data, decoder, decoded, num_messages);
+
+		// An unchanged update should just be the entity type, UID and mask.
+		data.clear();
+		encoder.writeBatchMessages(transforms, scratch_packet, data);
+		testAssert(data.size() == sizeof(uint32) * 3 + 3); // Header, number of updates, then type, UID and mask bytes.
+		decodeMessages(data, decoder, decoded, num_messages);
+		checkDecodedTransform(decoded[0], t);
+
+		// After a reset, the full update should be sent again.
+		encoder.resetEntity(t.entityKey());
+		decoder.resetEntity(t.entityKey());
+		testAssert(encoder.numEntities() == 0 && decoder.numEntities() == 0);
+		data.clear();
+		encoder.writeBatchMessages(transforms, scratch_packet, data);
+		testAssert(data.size() == first_update_size);
+		decodeMessages(data, decoder, decoded, num_messages);
+		checkDecodedTransform(decoded[0], t);
+
+		// Avatars and objects with the same UID should have separate baselines.
+		EntityTransform avatar_t = makeRandomTransform(rng, EntityTransform::Type_Avatar, 12);
+		data.clear();
+		encoder.writeBatchMessages(std::vector<const EntityTransform*>(1, &avatar_t), scratch_packet, data);
+		decodeMessages(data, decoder, decoded, num_messages);
+		checkDecodedTransform(decoded[0], avatar_t);
+		testAssert(encoder.numEntities() == 2 && decoder.numEntities() == 2);
+	}
+
+	//-------------------- Test that large batches are split into multiple messages --------------------
+	{
+		TransformDeltaCodec encoder, decoder;
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		std::vector<EntityTransform> transforms;
+		for(uint64 i=0; i<5000; ++i)
+			transforms.push_back(makeRandomTransform(rng, EntityTransform::Type_ObjectPhysics, /*uid=*/i * 1000));
+
+		std::string data;
+		encoder.writeBatchMessages(getPointers(transforms), scratch_packet, data);
+
+		std::vector<EntityTransform> decoded;
+		size_t num_messages;
+		decodeMessages(data, decoder, decoded, num_messages);
+		testAssert(num_messages > 1);
+		testAssert(decoded.size() == transforms.size());
+		for(size_t i=0; i<transforms.size(); ++i)
+			checkDecodedTransform(decoded[i], transforms[i]); // UIDs were already in sorted order.
+	}
+
+	//-------------------- Test that invalid data throws an exception --------------------
+	{
+		TransformDeltaCodec encoder;
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		std::vector<EntityTransform> transforms;
+		for(uint64 i=0; i<10; ++i)
+			transforms.push_back(makeRandomTransform(rng, EntityTransform::Type_Avatar, i));
+		std::string data;
+		encoder.writeBatchMessages(getPointers(transforms), scratch_packet, data);
+
+		// Truncate the message at each possible point.
+		for(size_t len=sizeof(uint32) * 2; len<data.size(); ++len)
+		{
+			TransformDeltaCodec decoder;
+			BufferInStream msg_buffer;
+			msg_buffer.buf.resize(len);
+			std::memcpy(msg_buffer.buf.data(), data.data(), len);
+			msg_buffer.read_index = sizeof(uint32) * 2;
+			std::vector<EntityTransform> decoded;
+			try
+			{
+				decoder.readBatch(msg_buffer, decoded);
+				failTest("Expected exception.");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		// Test an invalid entity type
+		{
+			TransformDeltaCodec decoder;
+			BufferInStream msg_buffer;
+			msg_buffer.buf.resize(data.size());
+			std::memcpy(msg_buffer.buf.data(), data.data(), data.size());
+			msg_buffer.buf[sizeof(uint32) * 3] = 100; // Type of first update
+			msg_buffer.read_index = sizeof(uint32) * 2;
+			std::vector<EntityTransform> decoded;
+			try
+			{
+				decoder.readBatch(msg_buffer, decoded);
+				failTest("Expected exception.");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+	}
+
+	conPrint("TransformDeltaCodec::test() done.");
+}
+
+
+} // end namespace TransformCompression
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,129 @@
+/*=====================================================================
+TransformCompression.h
+----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "UID.h"
+#include <maths/vec3.h>
+#include <maths/Quat.h>
+#include <utils/Platform.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+class SocketBufferOutStream;
+class BufferInStream;
+
+
+namespace TransformCompression
+{
+
+
+// The transform part of an AvatarTransformUpdate, ObjectTransformUpdate or ObjectPhysicsTransformUpdate message.
+struct EntityTransform
+{
+	EntityTransform() : type(Type_Avatar), pos(0, 0, 0), avatar_rotation(0, 0, 0), avatar_anim_state(0), rot(Quatf::identity()), scale(1, 1, 1), linear_vel(0, 0, 0), angular_vel(0, 0, 0),
+		transform_update_avatar_uid(0), client_time(0) {}
+
+	enum Type
+	{
+		Type_Avatar = 0,
+		Type_Object = 1,
+		Type_ObjectPhysics = 2
+	};
+
+	Type type;
+	UID uid;
+	Vec3d pos;
+	Vec3f avatar_rotation; // (roll, pitch, heading).  Avatars only.
+	uint32 avatar_anim_state; // Avatars only.
+	Quatf rot; // Objects only.
+	Vec3f scale; // Objects only, not physics updates.
+	Vec3f linear_vel; // Physics updates only.
+	Vec3f angular_vel; // Physics updates only.
+	uint32 transform_update_avatar_uid; // Objects only.
+	double client_time; // Physics updates only.
+
+	// Key for the delta baseline of the entity.  Matches AreaOfInterest::makeAvatarEntityKey() and makeObjectEntityKey().
+	uint64 entityKey() const { return (type == Type_Avatar) ? avatarEntityKey(uid) : objectEntityKey(uid); }
+
+	static uint64 avatarEntityKey(const UID& avatar_uid) { return avatar_uid.value() | (1ull << 63); }
+	static uint64 objectEntityKey(const UID& ob_uid) { return ob_uid.value() & ~(1ull << 63); }
+};
+
+
+// Quantisation steps.
+const double POS_STEP = 1.0 / 1024; // In metres.
+const double AVATAR_ROT_STEP = 1.0 / 4096; // In radians.
+const double VEL_STEP = 1.0 / 256; // In m/s and rad/s.
+const double CLIENT_TIME_STEP = 1.0 / 65536; // In seconds.
+
+
+// Smallest-three quaternion encoding: index of the largest magnitude component in the top 2 bits, then the other three components, 15 bits each.
+// Max error per component is about 2.2e-5.
+uint64 packQuat(const Quatf& q);
+Quatf unpackQuat(uint64 packed);
+
+
+/*=====================================================================
+TransformDeltaCodec
+-------------------
+Encodes and decodes TransformUpdateBatch messages.
+
+Each update is quantised, and only the quantised fields that changed since the last update
+sent for the same entity on the connection are written, as variable-length deltas.
+The baseline for an entity with no previous update is all zeroes (and identity rotation, unit scale).
+
+The server keeps one encoder per client connection, and the client keeps one decoder.
+Since the updates connection is TCP, the last sent update is the last received update, so no acks are needed.
+Both ends must call resetEntity() at the same point in the message stream: the baseline for an entity is reset
+when an AvatarFullUpdate, AvatarDestroyed, ObjectFullUpdate or ObjectDestroyed message for it is sent or received.
+
+Not threadsafe.
+=====================================================================*/
+class TransformDeltaCodec
+{
+public:
+	TransformDeltaCodec();
+	~TransformDeltaCodec();
+
+	// Appends one or more TransformUpdateBatch messages encoding the given transforms to data_out, and updates the baselines.
+	// Messages are split so that each is at most about MAX_BATCH_MSG_SIZE bytes.
+	void writeBatchMessages(const std::vector<const EntityTransform*>& transforms, SocketBufferOutStream& scratch_packet, std::string& data_out);
+
+	// Reads the body of a TransformUpdateBatch message (after the message header), and updates the baselines.
+	// Throws glare::Exception on invalid data.
+	void readBatch(BufferInStream& msg_buffer, std::vector<EntityTransform>& transforms_out);
+
+	void resetEntity(uint64 entity_key); // Removes the baseline for the entity.
+	void clear();
+
+	size_t numEntities() const { return baselines.size(); }
+
+	static const size_t MAX_BATCH_MSG_SIZE = 65536;
+
+	static void test();
+
+private:
+	struct QuantisedTransform
+	{
+		QuantisedTransform();
+
+		int64 pos[3];
+		int64 avatar_rot[3];
+		uint64 packed_rot;
+		Vec3f scale;
+		int64 linear_vel[3];
+		int64 angular_vel[3];
+		uint32 avatar_anim_state;
+		uint32 transform_update_avatar_uid;
+		int64 client_time;
+	};
+
+	std::unordered_map<uint64, QuantisedTransform> baselines; // Map from entity key to last sent or received quantised transform.
+};
+
+
+} // end namespace TransformCompression
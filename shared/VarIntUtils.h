@@ -0,0 +1,60 @@
+/*=====================================================================
+VarIntUtils.h
+-------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/SocketBufferOutStream.h>
+#include <utils/BufferInStream.h>
+#include <utils/Exception.h>
+
+
+/*=====================================================================
+VarIntUtils
+-----------
+Zig-zag and LEB128-style variable length integer encoding, shared by the
+TransformUpdateBatch and ObjectSyncDigest wire formats.
+=====================================================================*/
+namespace VarIntUtils
+{
+
+
+// Maps signed integers to unsigned integers so that values of small magnitude have small encodings: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+inline uint64 zigZagEncode(int64 x) { return ((uint64)x << 1) ^ (uint64)(x >> 63); }
+inline int64 zigZagDecode(uint64 x) { return (int64)(x >> 1) ^ -(int64)(x & 1); }
+
+
+// Writes x in 7-bit groups, least significant first, with the high bit set on all bytes but the last.  Writes 1 to 10 bytes.
+inline void writeVarUInt(uint64 x, SocketBufferOutStream& stream)
+{
+	uint8 buf[10];
+	size_t n = 0;
+	while(x >= 0x80)
+	{
+		buf[n++] = (uint8)(x | 0x80);
+		x >>= 7;
+	}
+	buf[n++] = (uint8)x;
+	stream.writeData(buf, n);
+}
+
+
+// Throws glare::Exception if the varint is longer than 10 bytes, or if the stream ends.
+inline uint64 readVarUInt(BufferInStream& stream)
+{
+	uint64 x = 0;
+	for(int shift=0; shift<64; shift += 7)
+	{
+		uint8 b;
+		stream.readData(&b, 1);
+		x |= (uint64)(b & 0x7F) << shift;
+		if((b & 0x80) == 0)
+			return x;
+	}
+	throw glare::Exception("Invalid varint");
+}
+
+
+} // end namespace VarIntUtils
@@ -32,6 +32,7 @@ Copyright Glare Technologies Limited 2016 -
 #endif // GUI_CLIENT
 #include "../shared/ResourceManager.h"
 #include <zstd.h>
+#include <IncludeXXHash.h>
 
 
 InstanceInfo::~InstanceInfo()
@@ -76,6 +77,7 @@ WorldObject::WorldObject() noexcept
 	is_path_controlled = false;
 	use_materialise_effect_on_load = false;
 	materialise_effect_start_time = -1000.f;
+	last_script_eval_time = -1;
 
 	waypoint_index = 0;
 	dist_along_segment = 0;
@@ -138,6 +140,56 @@ std::string WorldObject::getLODModelURLForLevel(const std::string& base_model_ur
 }
 
 
+std::string WorldObject::makeVoxelMeshURL(const js::Vector<uint8, 16>& compressed_voxels, const js::Vector<bool, 16>& mats_transparent)
+{
+	// Faces between opaque and transparent voxels are not culled, so the mesh depends on the material transparency as well.
+	js::Vector<uint8, 16> transparent_flags(mats_transparent.size());
+	for(size_t i=0; i<mats_transparent.size(); ++i)
+		transparent_flags[i] = mats_transparent[i] ? 1 : 0;
+
+	const uint64 voxels_hash = XXH64(compressed_voxels.data(), compressed_voxels.size(), /*seed=*/1);
+	const uint64 hash = XXH64(transparent_flags.data(), transparent_flags.size(), /*seed=*/voxels_hash);
+
+	return ResourceManager::URLForNameAndExtensionAndHash("voxmesh", "bmesh", hash);
+}
+
+
+bool WorldObject::isVoxelMeshURL(const std::string& URL)
+{
+	return hasPrefix(URL, "voxmesh_");
+}
+
+
+int WorldObject::getVoxelSubsampleFactorForLODLevel(int model_lod_level)
+{
+	if(model_lod_level == 1)
+		return 2;
+	else if(model_lod_level == 2)
+		return 4;
+	else
+		return 1;
+}
+
+
+void WorldObject::getVoxelMatsTransparent(js::Vector<bool, 16>& mats_transparent_out) const
+{
+	mats_transparent_out.resize(materials.size());
+	for(size_t i=0; i<materials.size(); ++i)
+		mats_transparent_out[i] = materials[i].nonNull() && (materials[i]->opacity.val < 1.f);
+}
+
+
+bool WorldObject::hasUpToDateVoxelMeshURL() const
+{
+	if(object_type != ObjectType_VoxelGroup || !lightmap_url.empty() || !isVoxelMeshURL(model_url))
+		return false;
+
+	js::Vector<bool, 16> mats_transparent;
+	getVoxelMatsTransparent(mats_transparent);
+	return model_url == makeVoxelMeshURL(compressed_voxels, mats_transparent);
+}
+
+
 int WorldObject::getLODLevelForURL(const std::string& URL) // Identifies _lod1 etc. suffix.
 {
 	const std::string base = removeDotAndExtension(URL);
@@ -1354,6 +1406,49 @@ void WorldObject::test()
 			readWorldObjectFromStream(instream, ob2);
 			testAssert(ob2.materials.size() == ob.materials.size());
 		}
+
+		// Test voxel mesh URLs
+		{
+			WorldObject ob;
+			ob.object_type = WorldObject::ObjectType_VoxelGroup;
+			ob.materials.push_back(new WorldMaterial());
+			ob.materials.push_back(new WorldMaterial());
+			ob.getDecompressedVoxels().push_back(Voxel(Vec3<int>(0,1,2), 0));
+			ob.getDecompressedVoxels().push_back(Voxel(Vec3<int>(4,5,6), 1));
+			ob.compressVoxels();
+
+			js::Vector<bool, 16> mats_transparent;
+			ob.getVoxelMatsTransparent(mats_transparent);
+			const std::string URL = makeVoxelMeshURL(ob.getCompressedVoxels(), mats_transparent);
+			testAssert(isVoxelMeshURL(URL));
+			testAssert(hasExtension(URL, "bmesh"));
+			testAssert(URL == makeVoxelMeshURL(ob.getCompressedVoxels(), mats_transparent));
+			testAssert(getLODLevelForURL(getLODModelURLForLevel(URL, 2)) == 2);
+
+			testAssert(!ob.hasUpToDateVoxelMeshURL());
+			ob.model_url = URL;
+			testAssert(ob.hasUpToDateVoxelMeshURL());
+
+			// Changing material transparency should change the URL.
+			ob.materials[1]->opacity.val = 0.5f;
+			testAssert(!ob.hasUpToDateVoxelMeshURL());
+			ob.materials[1]->opacity.val = 1.f;
+			testAssert(ob.hasUpToDateVoxelMeshURL());
+
+			// Changing the voxels should change the URL.
+			ob.getDecompressedVoxels().push_back(Voxel(Vec3<int>(4,5,7), 1));
+			ob.compressVoxels();
+			testAssert(!ob.hasUpToDateVoxelMeshURL());
+
+			// Objects with lightmaps need lightmap UVs, which baked meshes don't have.
+			ob.getVoxelMatsTransparent(mats_transparent);
+			ob.model_url = makeVoxelMeshURL(ob.getCompressedVoxels(), mats_transparent);
+			testAssert(ob.hasUpToDateVoxelMeshURL());
+			ob.lightmap_url = "lightmap.ktx2";
+			testAssert(!ob.hasUpToDateVoxelMeshURL());
+
+			testAssert(!isVoxelMeshURL("monkey.glb"));
+		}
 	}
 	catch(glare::Exception& e)
 	{
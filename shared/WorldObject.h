@@ -153,6 +153,14 @@ public:
 	static int getLODLevelForURL(const std::string& URL); // Identifies _lod1 etc. suffix.
 	static std::string getLODLightmapURL(const std::string& base_lightmap_url, int level);
 
+	// Voxel objects have their voxels meshed by the server (see MeshLODGenThread), which sets model_url to the mesh URL once the meshes for all model LOD levels are generated.
+	// The URL is keyed by a hash of the compressed voxels and material transparency, so changes when the voxels do.  Use getLODModelURLForLevel() for the other LOD levels.
+	static std::string makeVoxelMeshURL(const js::Vector<uint8, 16>& compressed_voxels, const js::Vector<bool, 16>& mats_transparent);
+	static bool isVoxelMeshURL(const std::string& URL);
+	static int getVoxelSubsampleFactorForLODLevel(int model_lod_level); // Voxel meshes for LOD levels 1 and 2 are made at reduced resolution.
+	void getVoxelMatsTransparent(js::Vector<bool, 16>& mats_transparent_out) const;
+	bool hasUpToDateVoxelMeshURL() const; // Is this a voxel object with model_url set to the mesh URL for the current voxels?  Baked meshes lack lightmap UVs, so returns false if the object has a lightmap.
+
 	inline int getLODLevel(const Vec3d& campos) const;
 	inline int getLODLevel(const Vec4f& campos) const;
 	inline float getMaxDistForLODLevel(int level);
@@ -386,6 +394,7 @@ public:
 	float materialise_effect_start_time;
 
 	Reference<WinterShaderEvaluator> script_evaluator;
+	double last_script_eval_time; // Global time when the script was last evaluated, or -1 if not evaluated yet.  See Scripting::BatchedScriptEvaluator.
 
 	Reference<Scripting::VehicleScript> vehicle_script;
 
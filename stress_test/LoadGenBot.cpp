@@ -0,0 +1,815 @@
+/*=====================================================================
+LoadGenBot.cpp
+--------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "LoadGenBot.h"
+
+
+#if defined(__linux__)
+
+
+#include "../shared/Protocol.h"
+#include "../shared/MessageUtils.h"
+#include "../shared/Avatar.h"
+#include "../shared/WorldObject.h"
+#include "../shared/ObjectSyncDigest.h"
+#include <networking/TLSSocket.h>
+#include <utils/Exception.h>
+#include <utils/StringUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/ConPrint.h>
+#include <tls.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <limits>
+
+
+static const double TRANSFORM_UPDATE_PERIOD = 0.1; // The real client sends avatar transform updates at 10 Hz.
+static const double VOICE_PACKET_PERIOD = 0.02; // 20 ms Opus frames, as in MicReadThread.
+static const size_t VOICE_PAYLOAD_SIZE = 60; // About the size of a 20 ms Opus frame at 24 kbit/s.
+static const double UDP_DISCOVERY_PERIOD = 2.0; // As in GUIClient.
+static const double VOICE_STREAM_RENEW_PERIOD = 5.0;
+static const size_t MAX_MSG_SIZE = 1000000; // Same as the client.
+static const size_t MAX_SEND_BUF_SIZE = 8 * 1024 * 1024; // If the server stops reading, consider the connection failed.
+
+
+LoadGenBot::LoadGenBot(size_t bot_index_, const LoadGenConfig& config_, LoadGenStats& stats_, AvatarUpdateTracker& tracker_)
+:	bot_index(bot_index_),
+	reconnect_time(0),
+	config(config_),
+	stats(stats_),
+	tracker(tracker_),
+	rng((uint64)bot_index_ + 1),
+	epoll_fd(-1),
+	epoll_id(0),
+	tcp_fd(-1),
+	udp_fd(-1),
+	tls_context(NULL),
+	registered_epoll_events(0),
+	tls_wants_pollout(false),
+	connection_state(ConnectionState_NotConnected),
+	login_state(LoginState_NotLoggedIn),
+	connect_start_time(0),
+	initial_load_done(false),
+	recv_buf_read_i(0),
+	recv_buf_size(0),
+	send_buf_write_i(0),
+	scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder),
+	create_object_sent(false),
+	voice_stream_id(0),
+	voice_seq_num(0),
+	voice_stream_started(false)
+{
+	streams_voice = rng.unitRandom() < config.voice_fraction;
+
+	recv_buf.resize(65536);
+
+	voice_packet.resize(sizeof(uint32) * 3 + VOICE_PAYLOAD_SIZE);
+	for(size_t i=sizeof(uint32) * 3; i<voice_packet.size(); ++i)
+		voice_packet[i] = (uint8)rng.nextUInt(256); // Random data, so it doesn't compress unrealistically well anywhere.
+}
+
+
+LoadGenBot::~LoadGenBot()
+{
+	close();
+}
+
+
+void LoadGenBot::connect(int epoll_fd_, uint64 epoll_id_, double cur_time)
+{
+	assert(tcp_fd < 0);
+
+	epoll_fd = epoll_fd_;
+	epoll_id = epoll_id_;
+	connect_start_time = cur_time;
+
+	tcp_fd = ::socket(config.server_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(tcp_fd < 0)
+		throw glare::Exception("Failed to create TCP socket: " + PlatformUtils::getLastErrorString());
+
+	const int one = 1;
+	::setsockopt(tcp_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Messages are small and latency-sensitive, like the client's.
+
+	if(::connect(tcp_fd, (const sockaddr*)&config.server_addr, config.server_addr_len) != 0 && errno != EINPROGRESS)
+		throw glare::Exception("connect failed: " + PlatformUtils::getLastErrorString());
+
+	udp_fd = ::socket(config.server_UDP_addr.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(udp_fd < 0)
+		throw glare::Exception("Failed to create UDP socket: " + PlatformUtils::getLastErrorString());
+
+	// Connect the UDP socket to the server voice port, so send() can be used, and only packets from the server are received.
+	if(::connect(udp_fd, (const sockaddr*)&config.server_UDP_addr, config.server_addr_len) != 0)
+		throw glare::Exception("UDP connect failed: " + PlatformUtils::getLastErrorString());
+
+	// The low bit of the epoll data says which socket the event is for.
+	epoll_event event;
+	std::memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLOUT; // EPOLLOUT to find out when the connect has completed.
+	event.data.u64 = epoll_id * 2;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, tcp_fd, &event) != 0)
+		throw glare::Exception("epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+	registered_epoll_events = event.events;
+
+	event.events = EPOLLIN;
+	event.data.u64 = epoll_id * 2 + 1;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, udp_fd, &event) != 0)
+		throw glare::Exception("epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+
+	connection_state = ConnectionState_ConnectingTCP;
+}
+
+
+void LoadGenBot::close()
+{
+	if(connection_state == ConnectionState_Connected)
+	{
+		stats.num_connected.decrement();
+		tracker.removeBotAvatarUID(client_avatar_uid);
+	}
+	if(login_state == LoginState_LoggedIn)
+		stats.num_logged_in.decrement();
+
+	if(tls_context)
+	{
+		tls_close(tls_context); // Non-blocking, so may not complete, which is fine.
+		tls_free(tls_context);
+		tls_context = NULL;
+	}
+
+	// Closing the sockets removes them from epoll.
+	if(tcp_fd >= 0)
+		::close(tcp_fd);
+	if(udp_fd >= 0)
+		::close(udp_fd);
+	tcp_fd = -1;
+	udp_fd = -1;
+	registered_epoll_events = 0;
+	tls_wants_pollout = false;
+
+	connection_state = ConnectionState_NotConnected;
+	login_state = LoginState_NotLoggedIn;
+	initial_load_done = false;
+
+	recv_buf_read_i = 0;
+	recv_buf_size = 0;
+	send_buf.clear();
+	send_buf_write_i = 0;
+
+	transform_codec.clear();
+	stream_decompressor = NULL;
+	avatar_record_cache.clear();
+
+	client_avatar_uid = UID::invalidUID();
+	user_id = UserID::invalidUserID();
+	own_object_uid = UID::invalidUID();
+	create_object_sent = false;
+	voice_stream_started = false;
+}
+
+
+void LoadGenBot::handleTCPSocketEvents(uint32 events, double cur_time)
+{
+	if(connection_state == ConnectionState_ConnectingTCP)
+	{
+		if((events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) == 0)
+			return;
+
+		int err = 0;
+		socklen_t err_len = sizeof(err);
+		if(::getsockopt(tcp_fd, SOL_SOCKET, SO_ERROR, &err, &err_len) != 0)
+			throw glare::Exception("getsockopt failed: " + PlatformUtils::getLastErrorString());
+		if(err != 0)
+			throw glare::Exception("connect failed: " + std::string(std::strerror(err)));
+
+		// TCP connection is established, start TLS.  The handshake is done by the first tls_read() or tls_write() calls.
+		tls_context = tls_client();
+		if(!tls_context)
+			throw glare::Exception("Failed to create TLS context.");
+		if(tls_configure(tls_context, config.client_tls_config) != 0)
+			throw glare::Exception("tls_configure failed: " + getTLSErrorString(tls_context));
+		if(tls_connect_socket(tls_context, tcp_fd, config.server_hostname.c_str()) != 0)
+			throw glare::Exception("tls_connect_socket failed: " + getTLSErrorString(tls_context));
+
+		connection_state = ConnectionState_WaitingForHello;
+
+		// Write hello, protocol version, connection type and world name.  These aren't length-prefixed messages.
+		scratch_packet.buf.clear();
+		scratch_packet.writeUInt32(Protocol::CyberspaceHello);
+		scratch_packet.writeUInt32(Protocol::CyberspaceProtocolVersion);
+		scratch_packet.writeUInt32(Protocol::ConnectionTypeUpdates);
+		scratch_packet.writeStringLengthFirst(""); // World name
+		send_buf.insert(send_buf.end(), scratch_packet.buf.begin(), scratch_packet.buf.end());
+	}
+
+	tls_wants_pollout = false;
+
+	readFromSocket(cur_time); // Reads until TLS wants to wait for the socket.  Also progresses the TLS handshake.
+
+	flushSendBuffer();
+}
+
+
+void LoadGenBot::readFromSocket(double cur_time)
+{
+	while(tcp_fd >= 0)
+	{
+		// Make sure there is a reasonable amount of space to read into.
+		if(recv_buf.size() - recv_buf_size < 16384)
+		{
+			if(recv_buf_read_i > 0)
+			{
+				std::memmove(recv_buf.data(), recv_buf.data() + recv_buf_read_i, recv_buf_size - recv_buf_read_i);
+				recv_buf_size -= recv_buf_read_i;
+				recv_buf_read_i = 0;
+			}
+			if(recv_buf.size() - recv_buf_size < 16384)
+				recv_buf.resize(recv_buf.size() * 2);
+		}
+
+		const ssize_t num_read = tls_read(tls_context, recv_buf.data() + recv_buf_size, recv_buf.size() - recv_buf_size);
+		if(num_read == TLS_WANT_POLLIN)
+			break;
+		if(num_read == TLS_WANT_POLLOUT)
+		{
+			tls_wants_pollout = true;
+			break;
+		}
+		if(num_read < 0)
+			throw glare::Exception("tls_read failed: " + getTLSErrorString(tls_context));
+		if(num_read == 0)
+			throw glare::Exception("Connection closed by server.");
+
+		recv_buf_size += (size_t)num_read;
+		stats.tcp_bytes_received.add(num_read);
+
+		processReceivedData(cur_time);
+	}
+}
+
+
+void LoadGenBot::processReceivedData(double cur_time)
+{
+	while(1)
+	{
+		const size_t num_avail = recv_buf_size - recv_buf_read_i;
+		const uint8* data = recv_buf.data() + recv_buf_read_i;
+
+		if(connection_state == ConnectionState_WaitingForHello)
+		{
+			// Hello response: hello (uint32), protocol response (uint32), server protocol version (uint32), avatar UID (uint64).
+			// If the protocol response isn't OK, there is a message string before the version, but we just give up in that case.
+			if(num_avail < sizeof(uint32) * 2)
+				break;
+
+			uint32 hello, protocol_response;
+			std::memcpy(&hello, data, sizeof(uint32));
+			std::memcpy(&protocol_response, data + 4, sizeof(uint32));
+			if(hello != Protocol::CyberspaceHello)
+				throw glare::Exception("Invalid hello from server: " + toString(hello));
+			if(protocol_response != Protocol::ClientProtocolOK)
+				throw glare::Exception("Server did not accept protocol version: " + toString(protocol_response));
+
+			if(num_avail < sizeof(uint32) * 3 + sizeof(uint64))
+				break;
+
+			uint64 avatar_uid;
+			std::memcpy(&avatar_uid, data + 12, sizeof(uint64));
+			client_avatar_uid = UID(avatar_uid);
+			recv_buf_read_i += sizeof(uint32) * 3 + sizeof(uint64);
+
+			onConnected(cur_time);
+		}
+		else
+		{
+			if(num_avail < sizeof(uint32) * 2)
+				break;
+
+			uint32 msg_type, msg_len;
+			std::memcpy(&msg_type, data, sizeof(uint32));
+			std::memcpy(&msg_len, data + 4, sizeof(uint32));
+			if((msg_len < sizeof(uint32) * 2) || (msg_len > MAX_MSG_SIZE))
+				throw glare::Exception("Invalid message size: " + toString(msg_len));
+
+			if(num_avail < msg_len)
+				break;
+
+			msg_buffer.buf.resizeNoCopy(msg_len);
+			std::memcpy(msg_buffer.buf.data(), data, msg_len);
+			msg_buffer.read_index = sizeof(uint32) * 2;
+			recv_buf_read_i += msg_len;
+
+			handleMessage(msg_type, msg_buffer, cur_time);
+		}
+	}
+
+	if(recv_buf_read_i == recv_buf_size)
+	{
+		recv_buf_read_i = 0;
+		recv_buf_size = 0;
+	}
+}
+
+
+void LoadGenBot::onConnected(double cur_time)
+{
+	connection_state = ConnectionState_Connected;
+	stats.num_connected.increment();
+	tracker.setBotAvatarUID(bot_index, client_avatar_uid);
+
+	// Spawn at a random position in a disc of radius spawn_radius around the origin.
+	const float spawn_r = std::sqrt(rng.unitRandom()) * config.spawn_radius;
+	const float spawn_theta = rng.unitRandom() * Maths::get2Pi<float>();
+	cur_pos = Vec3d(std::cos(spawn_theta) * spawn_r, std::sin(spawn_theta) * spawn_r, 1.67);
+	const float heading = rng.unitRandom() * Maths::get2Pi<float>();
+	cur_angles = Vec3f(0, Maths::pi_2<float>(), heading);
+	cur_vel = Vec3d(std::cos(heading), std::sin(heading), 0) * 2;
+
+	last_think_time = cur_time;
+	next_change_dir_time = cur_time + 1 + rng.unitRandom() * 2;
+	next_transform_update_time = cur_time + rng.unitRandom() * TRANSFORM_UPDATE_PERIOD; // Spread updates from different bots over the period.
+	next_chat_time = cur_time + config.chat_period * (0.5 + rng.unitRandom());
+	next_edit_time = cur_time + config.edit_period * (0.5 + rng.unitRandom());
+	next_udp_discovery_time = cur_time;
+	next_voice_stream_started_time = cur_time + rng.unitRandom();
+	next_voice_packet_time = next_voice_stream_started_time;
+
+	// Send CreateAvatar message
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::CreateAvatar);
+		Avatar avatar;
+		avatar.uid = client_avatar_uid;
+		avatar.pos = cur_pos;
+		avatar.rotation = cur_angles;
+		writeAvatarToNetworkStream(avatar, scratch_packet);
+		enqueueMessage(scratch_packet);
+	}
+
+	if(config.use_stream_compression)
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::EnableStreamCompression);
+		scratch_packet.writeUInt64(StreamCompression::getDictionaryHash());
+		enqueueMessage(scratch_packet);
+	}
+
+	// Query objects around the spawn point.  Use an incremental query with an empty digest, so that the end of the response is marked by an IncrementalObjectSyncDone message.
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::QueryObjectsInAABBIncremental);
+		writeToStream(cur_pos, scratch_packet); // Camera position
+		scratch_packet.writeFloat((float)cur_pos.x - config.query_radius);
+		scratch_packet.writeFloat((float)cur_pos.y - config.query_radius);
+		scratch_packet.writeFloat((float)cur_pos.z - config.query_radius);
+		scratch_packet.writeFloat((float)cur_pos.x + config.query_radius);
+		scratch_packet.writeFloat((float)cur_pos.y + config.query_radius);
+		scratch_packet.writeFloat((float)cur_pos.z + config.query_radius);
+		ObjectSyncDigest empty_digest;
+		empty_digest.writeToStream(scratch_packet);
+		enqueueMessage(scratch_packet);
+	}
+
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::QueryParcels);
+		enqueueMessage(scratch_packet);
+	}
+
+	// Sign up.  If the user already exists (from a previous run), the server will send an error message, and we will log in instead.
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::SignUpMessage);
+		scratch_packet.writeStringLengthFirst("loadgen_" + toString(bot_index));
+		scratch_packet.writeStringLengthFirst("loadgen_" + toString(bot_index) + "@localhost");
+		scratch_packet.writeStringLengthFirst("loadgen_password");
+		enqueueMessage(scratch_packet);
+		login_state = LoginState_SigningUp;
+	}
+
+	// Tell the server we have a UDP socket for voice.
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::ClientUDPSocketOpen);
+		scratch_packet.writeUInt32(0);
+		enqueueMessage(scratch_packet);
+	}
+}
+
+
+void LoadGenBot::handleMessage(uint32 msg_type, BufferInStream& msg, double cur_time)
+{
+	switch(msg_type)
+	{
+	case Protocol::AvatarTransformUpdate: // Only sent to clients with protocol version < 40, but handle anyway.
+		{
+			const UID avatar_uid = readUIDFromStream(msg);
+			const Vec3d pos = readVec3FromStream<double>(msg);
+			handleAvatarTransform(avatar_uid, pos, cur_time);
+			break;
+		}
+	case Protocol::TransformUpdateBatch:
+		{
+			transform_codec.readBatch(msg, temp_transforms);
+			for(size_t i=0; i<temp_transforms.size(); ++i)
+				if(temp_transforms[i].type == TransformCompression::EntityTransform::Type_Avatar)
+					handleAvatarTransform(temp_transforms[i].uid, temp_transforms[i].pos, cur_time);
+			break;
+		}
+	case Protocol::AvatarFullUpdate:
+	case Protocol::AvatarDestroyed:
+		{
+			const UID avatar_uid = readUIDFromStream(msg);
+			transform_codec.resetEntity(TransformCompression::EntityTransform::avatarEntityKey(avatar_uid)); // The server resets the transform delta baseline when it sends this message.
+			break;
+		}
+	case Protocol::ObjectFullUpdate:
+	case Protocol::ObjectDestroyed:
+		{
+			const UID object_uid = readUIDFromStream(msg);
+			transform_codec.resetEntity(TransformCompression::EntityTransform::objectEntityKey(object_uid)); // The server resets the transform delta baseline when it sends this message.
+			if(msg_type == Protocol::ObjectDestroyed && object_uid == own_object_uid)
+				own_object_uid = UID::invalidUID();
+			break;
+		}
+	case Protocol::ObjectCreated:
+		{
+			const UID object_uid = readUIDFromStream(msg);
+			if(create_object_sent && !own_object_uid.valid())
+			{
+				// See if this is the object we created.
+				WorldObjectRef ob = new WorldObject();
+				ob->uid = object_uid;
+				readWorldObjectFromNetworkStreamGivenUID(msg, *ob);
+				if(ob->creator_id == user_id)
+					own_object_uid = object_uid;
+			}
+			break;
+		}
+	case Protocol::ObjectInitialSend:
+		{
+			stats.num_objects_received.increment();
+			break;
+		}
+	case Protocol::IncrementalObjectSyncDone:
+		{
+			if(!initial_load_done)
+			{
+				initial_load_done = true;
+				stats.num_initial_loads_done.increment();
+				stats.addInitialLoadTime((float)(cur_time - connect_start_time));
+			}
+			break;
+		}
+	case Protocol::ChatMessageID:
+		{
+			stats.num_chat_messages_received.increment();
+			break;
+		}
+	case Protocol::LoggedInMessageID:
+	case Protocol::SignedUpMessageID:
+		{
+			user_id = readUserIDFromStream(msg);
+			if(login_state != LoginState_LoggedIn)
+				stats.num_logged_in.increment();
+			login_state = LoginState_LoggedIn;
+			break;
+		}
+	case Protocol::ErrorMessageID:
+		{
+			const std::string error_msg = msg.readStringLengthFirst(10000);
+			if(login_state == LoginState_SigningUp)
+			{
+				// Sign up failed, presumably because the user already exists, so log in.
+				MessageUtils::initPacket(scratch_packet, Protocol::LogInMessage);
+				scratch_packet.writeStringLengthFirst("loadgen_" + toString(bot_index));
+				scratch_packet.writeStringLengthFirst("loadgen_password");
+				enqueueMessage(scratch_packet);
+				login_state = LoginState_LoggingIn;
+			}
+			else
+			{
+				if(login_state == LoginState_LoggingIn)
+					login_state = LoginState_NotLoggedIn;
+
+				stats.num_error_messages.increment();
+				if(stats.num_error_messages <= 10) // Print the first few errors
+					conPrint("Bot " + toString(bot_index) + " received error message: " + error_msg);
+			}
+			break;
+		}
+	case Protocol::StreamCompressionEnabled:
+		{
+			// All following messages from the server will be sent compressed, in CompressedMessages messages.
+			const uint32 flags = msg.readUInt32();
+			if(stream_decompressor.nonNull())
+				throw glare::Exception("Stream compression already enabled.");
+			stream_decompressor = new StreamCompression::Decompressor(/*use_dictionary=*/(flags & StreamCompression::USE_DICTIONARY_FLAG) != 0);
+			break;
+		}
+	case Protocol::CompressedMessages:
+		{
+			if(stream_decompressor.isNull())
+				throw glare::Exception("Received CompressedMessages before StreamCompressionEnabled.");
+
+			stream_decompressor->decompress(msg.buf.data() + msg.read_index, msg.buf.size() - msg.read_index);
+
+			BufferInStream decompressed_msg;
+			uint32 decompressed_msg_type;
+			while(stream_decompressor->haveCompleteMessage())
+			{
+				stream_decompressor->takeMessage(decompressed_msg, decompressed_msg_type);
+				handleMessage(decompressed_msg_type, decompressed_msg, cur_time);
+			}
+			break;
+		}
+	default:
+		break;
+	}
+}
+
+
+void LoadGenBot::handleAvatarTransform(const UID& avatar_uid, const Vec3d& pos, double cur_time)
+{
+	stats.num_avatar_updates_received.increment();
+
+	if(avatar_uid == client_avatar_uid)
+		return;
+
+	AvatarUpdateTracker::AvatarRecord* record;
+	auto res = avatar_record_cache.find(avatar_uid.value());
+	if(res != avatar_record_cache.end())
+		record = res->second;
+	else
+	{
+		record = tracker.getRecordForAvatar(avatar_uid);
+		if(record)
+			avatar_record_cache[avatar_uid.value()] = record;
+	}
+
+	if(record)
+	{
+		const double send_time = record->lookUpSendTime(pos);
+		if(send_time >= 0)
+			update_latencies.push_back((float)(cur_time - send_time));
+	}
+}
+
+
+void LoadGenBot::think(double cur_time)
+{
+	if(connection_state != ConnectionState_Connected)
+		return;
+
+	const double dt = myMin(0.1, cur_time - last_think_time);
+	last_think_time = cur_time;
+
+	// Change heading to a random value every couple of seconds
+	if(cur_time >= next_change_dir_time)
+	{
+		const float heading = rng.unitRandom() * Maths::get2Pi<float>();
+		cur_angles = Vec3f(0, Maths::pi_2<float>(), heading);
+		cur_vel = Vec3d(std::cos(heading), std::sin(heading), 0) * 2;
+		next_change_dir_time = cur_time + 1 + rng.unitRandom() * 2;
+	}
+
+	cur_pos += cur_vel * dt;
+
+	if(cur_time >= next_transform_update_time)
+	{
+		sendAvatarTransformUpdate(cur_time);
+		next_transform_update_time += TRANSFORM_UPDATE_PERIOD;
+		if(next_transform_update_time < cur_time) // If we have fallen behind (e.g. the event loop is overloaded), don't try and catch up.
+			next_transform_update_time = cur_time + TRANSFORM_UPDATE_PERIOD;
+	}
+
+	if(login_state == LoginState_LoggedIn)
+	{
+		if(config.edit_period > 0)
+		{
+			if(!create_object_sent)
+				sendCreateObject();
+
+			if(own_object_uid.valid() && (cur_time >= next_edit_time))
+			{
+				sendObjectTransformUpdate();
+				next_edit_time = cur_time + config.edit_period * (0.5 + rng.unitRandom());
+			}
+		}
+
+		if((config.chat_period > 0) && (cur_time >= next_chat_time))
+		{
+			sendChatMessage();
+			next_chat_time = cur_time + config.chat_period * (0.5 + rng.unitRandom());
+		}
+	}
+
+	// Send a UDP packet to the server occasionally, so the server can work out which UDP port we are listening on.
+	if(cur_time >= next_udp_discovery_time)
+	{
+		scratch_packet.buf.clear();
+		scratch_packet.writeUInt32(2); // Packet type
+		writeToStream(client_avatar_uid, scratch_packet);
+		sendUDPPacket(scratch_packet.buf.data(), scratch_packet.buf.size());
+		next_udp_discovery_time = cur_time + UDP_DISCOVERY_PERIOD;
+	}
+
+	if(streams_voice && (cur_time >= next_voice_stream_started_time))
+	{
+		// Sent when streaming starts, and periodically during streaming with the renew flag set.
+		if(!voice_stream_started)
+			voice_stream_id = rng.nextUInt(std::numeric_limits<uint32>::max());
+
+		MessageUtils::initPacket(scratch_packet, Protocol::AudioStreamToServerStarted);
+		scratch_packet.writeUInt32(48000); // sampling rate
+		scratch_packet.writeUInt32(voice_stream_started ? 1 : 0); // flags: renew flag
+		scratch_packet.writeUInt32(voice_stream_id);
+		enqueueMessage(scratch_packet);
+
+		voice_stream_started = true;
+		next_voice_stream_started_time = cur_time + VOICE_STREAM_RENEW_PERIOD;
+	}
+
+	if(voice_stream_started)
+		sendVoicePackets(cur_time);
+
+	flushSendBuffer();
+}
+
+
+void LoadGenBot::startShutdown()
+{
+	if(connection_state == ConnectionState_Connected && own_object_uid.valid())
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::DestroyObject);
+		writeToStream(own_object_uid, scratch_packet);
+		enqueueMessage(scratch_packet);
+		flushSendBuffer();
+	}
+}
+
+
+void LoadGenBot::sendAvatarTransformUpdate(double cur_time)
+{
+	const uint32 anim_state = 0;
+
+	MessageUtils::initPacket(scratch_packet, Protocol::AvatarTransformUpdate);
+	writeToStream(client_avatar_uid, scratch_packet);
+	writeToStream(cur_pos, scratch_packet);
+	writeToStream(cur_angles, scratch_packet);
+	scratch_packet.writeUInt32(anim_state);
+	enqueueMessage(scratch_packet);
+
+	tracker.getRecordForBot(bot_index).addSentUpdate(cur_pos, cur_time);
+}
+
+
+void LoadGenBot::sendCreateObject()
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->object_type = WorldObject::ObjectType_Hypercard;
+	ob->pos = cur_pos + Vec3d(0, 0, 1);
+	ob->axis = Vec3f(0, 0, 1);
+	ob->angle = 0;
+	ob->scale = Vec3f(0.4f);
+	ob->content = "Load generator bot " + toString(bot_index);
+	ob->setAABBOS(js::AABBox(Vec4f(0,0,0,1), Vec4f(1,0,1,1)));
+
+	MessageUtils::initPacket(scratch_packet, Protocol::CreateObject);
+	ob->writeToNetworkStream(scratch_packet);
+	enqueueMessage(scratch_packet);
+
+	create_object_sent = true;
+}
+
+
+void LoadGenBot::sendObjectTransformUpdate()
+{
+	// Move the object to near the avatar.
+	const Vec3d pos = cur_pos + Vec3d(-1 + rng.unitRandom() * 2, -1 + rng.unitRandom() * 2, 1);
+
+	MessageUtils::initPacket(scratch_packet, Protocol::ObjectTransformUpdate);
+	writeToStream(own_object_uid, scratch_packet);
+	writeToStream(pos, scratch_packet);
+	writeToStream(Vec3f(0, 0, 1), scratch_packet); // axis
+	scratch_packet.writeFloat(rng.unitRandom() * Maths::get2Pi<float>()); // angle
+	writeToStream(Vec3f(0.4f), scratch_packet); // scale
+	enqueueMessage(scratch_packet);
+}
+
+
+void LoadGenBot::sendChatMessage()
+{
+	MessageUtils::initPacket(scratch_packet, Protocol::ChatMessageID);
+	scratch_packet.writeStringLengthFirst("Hello from load generator bot " + toString(bot_index) + ", the time is " + doubleToStringNDecimalPlaces(last_think_time, 2));
+	enqueueMessage(scratch_packet);
+}
+
+
+void LoadGenBot::sendVoicePackets(double cur_time)
+{
+	// Voice packets are (type, sender avatar UID (lower 32 bits), sequence number, encoded audio), see UDPHandlerThread.
+	const uint32 packet_type = 1;
+	const uint32 client_avatar_uid_uint32 = (uint32)client_avatar_uid.value();
+	std::memcpy(voice_packet.data(), &packet_type, sizeof(uint32));
+	std::memcpy(voice_packet.data() + 4, &client_avatar_uid_uint32, sizeof(uint32));
+
+	for(int i=0; (i < 4) && (next_voice_packet_time <= cur_time); ++i) // Send the packets due since the last think, like the mic read thread does after a late wakeup.
+	{
+		std::memcpy(voice_packet.data() + 8, &voice_seq_num, sizeof(uint32));
+		voice_seq_num++;
+		sendUDPPacket(voice_packet.data(), voice_packet.size());
+		next_voice_packet_time += VOICE_PACKET_PERIOD;
+	}
+	if(next_voice_packet_time <= cur_time) // If we have fallen a long way behind, don't try and catch up.
+		next_voice_packet_time = cur_time + VOICE_PACKET_PERIOD;
+}
+
+
+void LoadGenBot::enqueueMessage(SocketBufferOutStream& packet)
+{
+	MessageUtils::updatePacketLengthField(packet);
+	send_buf.insert(send_buf.end(), packet.buf.begin(), packet.buf.end());
+
+	if(send_buf.size() - send_buf_write_i > MAX_SEND_BUF_SIZE)
+		throw glare::Exception("Send buffer is full, server is not reading.");
+}
+
+
+void LoadGenBot::flushSendBuffer()
+{
+	if(connection_state == ConnectionState_NotConnected || connection_state == ConnectionState_ConnectingTCP)
+		return;
+
+	while(send_buf_write_i < send_buf.size())
+	{
+		const ssize_t num_written = tls_write(tls_context, send_buf.data() + send_buf_write_i, send_buf.size() - send_buf_write_i);
+		if(num_written == TLS_WANT_POLLIN)
+			break;
+		if(num_written == TLS_WANT_POLLOUT)
+		{
+			tls_wants_pollout = true;
+			break;
+		}
+		if(num_written < 0)
+			throw glare::Exception("tls_write failed: " + getTLSErrorString(tls_context));
+
+		send_buf_write_i += (size_t)num_written;
+		stats.tcp_bytes_sent.add(num_written);
+	}
+
+	if(send_buf_write_i == send_buf.size())
+	{
+		send_buf.clear();
+		send_buf_write_i = 0;
+	}
+	else if(send_buf_write_i >= 65536) // Remove written data from the front occasionally.
+	{
+		send_buf.erase(send_buf.begin(), send_buf.begin() + send_buf_write_i);
+		send_buf_write_i = 0;
+	}
+
+	updateEpollEvents();
+}
+
+
+void LoadGenBot::updateEpollEvents()
+{
+	// Only ask for EPOLLOUT when we are waiting to write, otherwise epoll would keep reporting the socket as writable.
+	const bool want_pollout = (connection_state == ConnectionState_ConnectingTCP) || (send_buf_write_i < send_buf.size()) || tls_wants_pollout;
+	const uint32 events = EPOLLIN | (want_pollout ? EPOLLOUT : 0);
+	if(events != registered_epoll_events)
+	{
+		epoll_event event;
+		std::memset(&event, 0, sizeof(event));
+		event.events = events;
+		event.data.u64 = epoll_id * 2;
+		if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, tcp_fd, &event) != 0)
+			throw glare::Exception("epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+		registered_epoll_events = events;
+	}
+}
+
+
+void LoadGenBot::sendUDPPacket(const void* data, size_t len)
+{
+	// UDP is unreliable anyway, so just drop the packet if the send fails, e.g. because the socket buffer is full.
+	const ssize_t num_sent = ::send(udp_fd, data, len, 0);
+	if(num_sent > 0)
+		stats.udp_bytes_sent.add(num_sent);
+}
+
+
+void LoadGenBot::handleUDPSocketEvents(uint32 events)
+{
+	uint8 packet_buf[4096];
+	while(udp_fd >= 0)
+	{
+		const ssize_t num_read = ::recv(udp_fd, packet_buf, sizeof(packet_buf), 0);
+		if(num_read < 0)
+			break; // EAGAIN, or an error such as ECONNREFUSED from an ICMP message, which we ignore.
+		stats.udp_bytes_received.add(num_read);
+	}
+}
+
+
+#endif // defined(__linux__)
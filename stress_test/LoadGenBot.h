@@ -0,0 +1,195 @@
+/*=====================================================================
+LoadGenBot.h
+------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "LoadGenStats.h"
+#include "../shared/UID.h"
+#include "../shared/UserID.h"
+#include "../shared/TransformCompression.h"
+#include "../shared/StreamCompression.h"
+#include <maths/vec3.h>
+#include <maths/PCG32.h>
+#include <utils/BufferInStream.h>
+#include <utils/SocketBufferOutStream.h>
+#include <utils/Platform.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+struct tls;
+struct tls_config;
+
+
+// Settings shared by all bots.
+struct LoadGenConfig
+{
+	std::string server_hostname; // Used for TLS SNI.
+#if defined(__linux__)
+	sockaddr_storage server_addr; // Server address, with the updates port.
+	sockaddr_storage server_UDP_addr; // Server address, with the voice UDP port.
+	socklen_t server_addr_len;
+#endif
+	struct tls_config* client_tls_config;
+
+	float spawn_radius; // Bots spawn in a disc of this radius around the origin.
+	float query_radius; // Half-width of the AABB of the initial object query.
+	float voice_fraction; // Fraction of bots that stream voice.
+	double chat_period; // Mean time between chat messages, per bot.  <= 0 to disable chat.
+	double edit_period; // Mean time between edits of the bot's object.  <= 0 to disable object creation and editing.
+	bool use_stream_compression;
+};
+
+
+#if defined(__linux__)
+
+
+/*=====================================================================
+LoadGenBot
+----------
+A simulated avatar, with a non-blocking TLS connection to the server's updates port, and a UDP socket for voice.
+Driven by a LoadGenEventLoop: the loop calls handleTCPSocketEvents() and handleUDPSocketEvents() when epoll reports the sockets are ready,
+and think() periodically.
+
+Behaviour, roughly following the real client:
+	* Connects and creates its avatar, asks the server to enable stream compression (if enabled in the config), and queries the
+	  objects around its spawn point with an empty QueryObjectsInAABBIncremental, so the end of the response is marked by IncrementalObjectSyncDone.
+	* Signs up as loadgen_<index>, or logs in if that user already exists.
+	* Walks around, changing direction every few seconds, and sends an AvatarTransformUpdate every 0.1 s.
+	* Creates a hypercard object, and moves it occasionally with ObjectTransformUpdate.  Destroys it on shutdown.
+	* Sends occasional chat messages.
+	* For a fraction of bots, streams voice: one UDP packet every 20 ms, with a random payload the size of an Opus frame.
+
+Errors throw glare::Exception; the event loop then closes the bot and reconnects it later.
+
+Not threadsafe, owned by a single event loop.
+=====================================================================*/
+class LoadGenBot
+{
+public:
+	LoadGenBot(size_t bot_index, const LoadGenConfig& config, LoadGenStats& stats, AvatarUpdateTracker& tracker);
+	~LoadGenBot();
+
+	// Starts a non-blocking connect, and registers the sockets with epoll_fd.
+	// The epoll data for the TCP socket is epoll_id * 2, and for the UDP socket epoll_id * 2 + 1.  Throws glare::Exception on failure.
+	void connect(int epoll_fd, uint64 epoll_id, double cur_time);
+
+	// Closes the sockets (which removes them from epoll) and resets the connection state.
+	void close();
+
+	bool isConnectionOpen() const { return tcp_fd >= 0; }
+
+	// Handles epoll events for the TCP socket.  Throws glare::Exception on failure.
+	void handleTCPSocketEvents(uint32 events, double cur_time);
+	void handleUDPSocketEvents(uint32 events);
+
+	// Sends periodic messages.  Throws glare::Exception on failure.
+	void think(double cur_time);
+
+	// Sends a DestroyObject message for the bot's object, if it has one.
+	void startShutdown();
+
+	size_t bot_index;
+	double reconnect_time; // Time at which the event loop should reconnect the bot, if it isn't connected.
+
+	std::vector<float> update_latencies; // Latency samples not passed to stats yet.  Taken by the event loop.
+
+private:
+	GLARE_DISABLE_COPY(LoadGenBot)
+
+	void readFromSocket(double cur_time);
+	void processReceivedData(double cur_time);
+	void handleMessage(uint32 msg_type, BufferInStream& msg, double cur_time);
+	void handleAvatarTransform(const UID& avatar_uid, const Vec3d& pos, double cur_time);
+	void onConnected(double cur_time);
+
+	void enqueueMessage(SocketBufferOutStream& packet); // Updates the packet length field and appends to the send buffer.
+	void flushSendBuffer();
+	void updateEpollEvents();
+	void sendUDPPacket(const void* data, size_t len);
+
+	void sendAvatarTransformUpdate(double cur_time);
+	void sendCreateObject();
+	void sendObjectTransformUpdate();
+	void sendChatMessage();
+	void sendVoicePackets(double cur_time);
+
+	enum ConnectionState
+	{
+		ConnectionState_NotConnected,
+		ConnectionState_ConnectingTCP, // Waiting for the non-blocking connect to complete.
+		ConnectionState_WaitingForHello, // TLS handshake and hello exchange.
+		ConnectionState_Connected // Exchanging messages.
+	};
+
+	enum LoginState
+	{
+		LoginState_NotLoggedIn,
+		LoginState_SigningUp,
+		LoginState_LoggingIn,
+		LoginState_LoggedIn
+	};
+
+	const LoadGenConfig& config;
+	LoadGenStats& stats;
+	AvatarUpdateTracker& tracker;
+	PCG32 rng;
+	bool streams_voice;
+
+	int epoll_fd;
+	uint64 epoll_id;
+	int tcp_fd;
+	int udp_fd;
+	struct tls* tls_context;
+	uint32 registered_epoll_events;
+	bool tls_wants_pollout; // The last TLS read or write returned TLS_WANT_POLLOUT.
+
+	ConnectionState connection_state;
+	LoginState login_state;
+	double connect_start_time;
+	bool initial_load_done;
+
+	std::vector<uint8> recv_buf; // Data read from the socket and not processed yet, from recv_buf_read_i to recv_buf_size.
+	size_t recv_buf_read_i;
+	size_t recv_buf_size;
+	std::vector<uint8> send_buf; // Data not written to the socket yet, from send_buf_write_i to the end.
+	size_t send_buf_write_i;
+
+	BufferInStream msg_buffer;
+	SocketBufferOutStream scratch_packet;
+	TransformCompression::TransformDeltaCodec transform_codec;
+	std::vector<TransformCompression::EntityTransform> temp_transforms;
+	Reference<StreamCompression::Decompressor> stream_decompressor;
+
+	// Cache of the tracker records of other bots' avatars, to avoid taking the tracker lock for every update received.
+	std::unordered_map<uint64, AvatarUpdateTracker::AvatarRecord*> avatar_record_cache;
+
+	UID client_avatar_uid;
+	UserID user_id;
+	UID own_object_uid; // The hypercard object the bot created, or invalid if not created yet.
+	bool create_object_sent;
+
+	Vec3d cur_pos;
+	Vec3d cur_vel;
+	Vec3f cur_angles;
+	double last_think_time;
+	double next_change_dir_time;
+	double next_transform_update_time;
+	double next_chat_time;
+	double next_edit_time;
+	double next_udp_discovery_time;
+	double next_voice_stream_started_time;
+	double next_voice_packet_time;
+	uint32 voice_stream_id;
+	uint32 voice_seq_num;
+	bool voice_stream_started;
+	std::vector<uint8> voice_packet;
+};
+
+
+#endif // defined(__linux__)
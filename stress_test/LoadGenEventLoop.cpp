@@ -0,0 +1,165 @@
+/*=====================================================================
+LoadGenEventLoop.cpp
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "LoadGenEventLoop.h"
+
+
+#if defined(__linux__)
+
+
+#include <utils/Clock.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Exception.h>
+#include <utils/PlatformUtils.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+
+const double LoadGenEventLoop::THINK_PERIOD = 0.01;
+
+static const double RECONNECT_DELAY = 5.0; // Time to wait before reconnecting after a connection error, in seconds.
+static const double LATENCY_SAMPLE_FLUSH_PERIOD = 0.25;
+static const double SHUTDOWN_TIME = 0.5; // Time to keep running after should_quit is set, so that DestroyObject messages are sent.
+
+
+LoadGenEventLoop::LoadGenEventLoop(const std::vector<LoadGenBot*>& bots_, LoadGenStats& stats_)
+:	should_quit(0), bots(bots_), stats(stats_), epoll_fd(-1)
+{}
+
+
+LoadGenEventLoop::~LoadGenEventLoop()
+{
+	for(size_t i=0; i<bots.size(); ++i)
+		delete bots[i];
+
+	if(epoll_fd >= 0)
+		::close(epoll_fd);
+}
+
+
+void LoadGenEventLoop::handleBotError(LoadGenBot& bot, const std::string& msg, double cur_time)
+{
+	stats.num_connection_errors.increment();
+	if(stats.num_connection_errors <= 20) // Print the first few errors, after that they are probably all the same.
+		conPrint("Bot " + toString(bot.bot_index) + ": " + msg);
+
+	bot.close();
+	bot.reconnect_time = cur_time + RECONNECT_DELAY * (1 + 0.5 * ((bot.bot_index % 16) / 16.0)); // Spread reconnections out a bit.
+}
+
+
+void LoadGenEventLoop::run()
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(epoll_fd < 0)
+	{
+		conPrint("epoll_create1 failed: " + PlatformUtils::getLastErrorString());
+		return;
+	}
+
+	std::vector<epoll_event> events(1024);
+
+	double next_think_time = 0;
+	double next_latency_flush_time = 0;
+	double quit_time = -1;
+
+	while(1)
+	{
+		const int num_events = epoll_wait(epoll_fd, events.data(), (int)events.size(), /*timeout (ms)=*/(int)(THINK_PERIOD * 1000));
+		if(num_events < 0 && errno != EINTR)
+		{
+			conPrint("epoll_wait failed: " + PlatformUtils::getLastErrorString());
+			break;
+		}
+
+		const double cur_time = Clock::getCurTimeRealSec();
+
+		for(int i=0; i<num_events; ++i)
+		{
+			const uint64 epoll_id = events[i].data.u64 / 2;
+			const bool is_UDP_socket = (events[i].data.u64 % 2) == 1;
+			LoadGenBot* bot = bots[epoll_id];
+			try
+			{
+				if(is_UDP_socket)
+					bot->handleUDPSocketEvents(events[i].events);
+				else
+					bot->handleTCPSocketEvents(events[i].events, cur_time);
+			}
+			catch(glare::Exception& e)
+			{
+				handleBotError(*bot, e.what(), cur_time);
+			}
+		}
+
+		if(cur_time >= next_think_time)
+		{
+			for(size_t i=0; i<bots.size(); ++i)
+			{
+				LoadGenBot* bot = bots[i];
+				try
+				{
+					if(!bot->isConnectionOpen())
+					{
+						if(quit_time < 0 && cur_time >= bot->reconnect_time)
+							bot->connect(epoll_fd, /*epoll_id=*/i, cur_time);
+					}
+					else
+						bot->think(cur_time);
+				}
+				catch(glare::Exception& e)
+				{
+					handleBotError(*bot, e.what(), cur_time);
+				}
+
+				if(!bot->update_latencies.empty())
+				{
+					update_latencies.insert(update_latencies.end(), bot->update_latencies.begin(), bot->update_latencies.end());
+					bot->update_latencies.clear();
+				}
+			}
+
+			next_think_time = cur_time + THINK_PERIOD;
+		}
+
+		if(cur_time >= next_latency_flush_time)
+		{
+			if(!update_latencies.empty())
+			{
+				stats.addUpdateLatencySamples(update_latencies);
+				update_latencies.clear();
+			}
+			next_latency_flush_time = cur_time + LATENCY_SAMPLE_FLUSH_PERIOD;
+		}
+
+		if(should_quit != 0)
+		{
+			if(quit_time < 0)
+			{
+				quit_time = cur_time;
+				for(size_t i=0; i<bots.size(); ++i)
+				{
+					try
+					{
+						bots[i]->startShutdown();
+					}
+					catch(glare::Exception& e)
+					{
+						handleBotError(*bots[i], e.what(), cur_time);
+					}
+				}
+			}
+			else if(cur_time - quit_time > SHUTDOWN_TIME)
+				break;
+		}
+	}
+
+	for(size_t i=0; i<bots.size(); ++i)
+		bots[i]->close();
+}
+
+
+#endif // defined(__linux__)
@@ -0,0 +1,56 @@
+/*=====================================================================
+LoadGenEventLoop.h
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "LoadGenBot.h"
+#include <utils/MyThread.h>
+#include <utils/AtomicInt.h>
+#include <vector>
+
+
+#if defined(__linux__)
+
+
+/*=====================================================================
+LoadGenEventLoop
+----------------
+Thread running a single epoll event loop for a set of bots.
+
+Each bot connects at its reconnect_time, so the caller can spread out the initial connections.
+Bots whose connection fails are closed and reconnected a few seconds later.
+
+Every THINK_PERIOD the loop calls think() on each connected bot, which sends any messages that are due.
+Update latency samples are passed to the stats in batches.
+
+Set should_quit to make the loop destroy the bots' objects, and return shortly after.
+=====================================================================*/
+class LoadGenEventLoop : public MyThread
+{
+public:
+	// Takes ownership of the bots.
+	LoadGenEventLoop(const std::vector<LoadGenBot*>& bots, LoadGenStats& stats);
+	~LoadGenEventLoop();
+
+	virtual void run();
+
+	glare::AtomicInt should_quit;
+
+	static const double THINK_PERIOD; // In seconds.
+
+private:
+	GLARE_DISABLE_COPY(LoadGenEventLoop)
+
+	void handleBotError(LoadGenBot& bot, const std::string& msg, double cur_time);
+
+	std::vector<LoadGenBot*> bots;
+	LoadGenStats& stats;
+	int epoll_fd;
+	std::vector<float> update_latencies; // Samples not passed to stats yet.
+};
+
+
+#endif // defined(__linux__)
@@ -0,0 +1,142 @@
+/*=====================================================================
+LoadGenStats.cpp
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "LoadGenStats.h"
+
+
+#include "../shared/TransformCompression.h"
+#include <utils/Lock.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+LoadGenStats::LoadGenStats()
+:	num_connected(0), num_logged_in(0), num_initial_loads_done(0), num_connection_errors(0), num_error_messages(0),
+	tcp_bytes_received(0), tcp_bytes_sent(0), udp_bytes_received(0), udp_bytes_sent(0),
+	num_objects_received(0), num_avatar_updates_received(0), num_chat_messages_received(0)
+{}
+
+
+void LoadGenStats::addUpdateLatencySamples(const std::vector<float>& samples)
+{
+	Lock lock(mutex);
+	update_latencies.insert(update_latencies.end(), samples.begin(), samples.end());
+}
+
+
+void LoadGenStats::addInitialLoadTime(float load_time)
+{
+	Lock lock(mutex);
+	initial_load_times.push_back(load_time);
+}
+
+
+void LoadGenStats::takeUpdateLatencySamples(std::vector<float>& samples_out)
+{
+	samples_out.clear();
+
+	Lock lock(mutex);
+	samples_out.swap(update_latencies);
+}
+
+
+void LoadGenStats::getInitialLoadTimes(std::vector<float>& load_times_out) const
+{
+	Lock lock(mutex);
+	load_times_out = initial_load_times;
+}
+
+
+float LoadGenStats::percentile(std::vector<float>& samples, float fraction)
+{
+	if(samples.empty())
+		return 0;
+
+	const size_t index = std::min(samples.size() - 1, (size_t)(fraction * samples.size()));
+	std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+	return samples[index];
+}
+
+
+AvatarUpdateTracker::AvatarRecord::AvatarRecord()
+{
+	clear();
+}
+
+
+void AvatarUpdateTracker::AvatarRecord::clear()
+{
+	Lock lock(mutex);
+	for(int i=0; i<NUM_RECORDED_UPDATES; ++i)
+	{
+		updates[i].pos = Vec3d(std::numeric_limits<double>::infinity());
+		updates[i].send_time = -1;
+	}
+	next_i = 0;
+}
+
+
+void AvatarUpdateTracker::AvatarRecord::addSentUpdate(const Vec3d& pos, double send_time)
+{
+	Lock lock(mutex);
+	updates[next_i].pos = pos;
+	updates[next_i].send_time = send_time;
+	next_i = (next_i + 1) % NUM_RECORDED_UPDATES;
+}
+
+
+double AvatarUpdateTracker::AvatarRecord::lookUpSendTime(const Vec3d& pos) const
+{
+	const double max_error = TransformCompression::POS_STEP; // Quantisation error is at most half a step, allow some slack.
+
+	Lock lock(mutex);
+	for(int z=1; z<=NUM_RECORDED_UPDATES; ++z) // Search from most recent update backwards
+	{
+		const SentUpdate& update = updates[(next_i + NUM_RECORDED_UPDATES - z) % NUM_RECORDED_UPDATES];
+		if(std::fabs(update.pos.x - pos.x) <= max_error && std::fabs(update.pos.y - pos.y) <= max_error && std::fabs(update.pos.z - pos.z) <= max_error)
+			return update.send_time;
+	}
+	return -1;
+}
+
+
+AvatarUpdateTracker::AvatarUpdateTracker(size_t num_bots)
+{
+	bot_records.resize(num_bots);
+	for(size_t i=0; i<num_bots; ++i)
+		bot_records[i] = new AvatarRecord();
+}
+
+
+AvatarUpdateTracker::~AvatarUpdateTracker()
+{
+	for(size_t i=0; i<bot_records.size(); ++i)
+		delete bot_records[i];
+}
+
+
+void AvatarUpdateTracker::setBotAvatarUID(size_t bot_index, const UID& avatar_uid)
+{
+	bot_records[bot_index]->clear();
+
+	Lock lock(mutex);
+	avatar_records[avatar_uid.value()] = bot_records[bot_index];
+}
+
+
+void AvatarUpdateTracker::removeBotAvatarUID(const UID& avatar_uid)
+{
+	Lock lock(mutex);
+	avatar_records.erase(avatar_uid.value());
+}
+
+
+AvatarUpdateTracker::AvatarRecord* AvatarUpdateTracker::getRecordForAvatar(const UID& avatar_uid) const
+{
+	Lock lock(mutex);
+	auto res = avatar_records.find(avatar_uid.value());
+	return (res != avatar_records.end()) ? res->second : NULL;
+}
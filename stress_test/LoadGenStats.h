@@ -0,0 +1,133 @@
+/*=====================================================================
+LoadGenStats.h
+--------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UID.h"
+#include <maths/vec3.h>
+#include <utils/AtomicInt.h>
+#include <utils/Mutex.h>
+#include <utils/Platform.h>
+#include <vector>
+#include <unordered_map>
+
+
+/*=====================================================================
+LoadGenStats
+------------
+Statistics for the load generator, summed over all bots.
+The counters are updated by the event loop threads and read by the main thread.
+
+Latency samples are buffered by each event loop and added in batches, see addUpdateLatencySamples().
+
+Threadsafe.
+=====================================================================*/
+class LoadGenStats
+{
+public:
+	LoadGenStats();
+
+	glare::AtomicInt num_connected; // Number of bots that have received the hello response from the server.
+	glare::AtomicInt num_logged_in;
+	glare::AtomicInt num_initial_loads_done; // Number of bots that have received the whole response to their initial object query.
+	glare::AtomicInt num_connection_errors;
+	glare::AtomicInt num_error_messages; // Number of ErrorMessageID messages received, apart from expected ones during sign up.
+
+	glare::AtomicInt tcp_bytes_received; // Bytes of application data received on the updates connections, as sent by the server (i.e. compressed if stream compression is enabled).
+	glare::AtomicInt tcp_bytes_sent;
+	glare::AtomicInt udp_bytes_received; // Relayed voice packets.
+	glare::AtomicInt udp_bytes_sent;
+
+	glare::AtomicInt num_objects_received; // ObjectInitialSend messages.
+	glare::AtomicInt num_avatar_updates_received;
+	glare::AtomicInt num_chat_messages_received;
+
+	// Latency of an avatar transform update, from the sending bot writing it, to a receiving bot reading it.  In seconds.
+	void addUpdateLatencySamples(const std::vector<float>& samples);
+
+	// Time from a bot starting to connect, to receiving the whole response to its initial object query.  In seconds.
+	void addInitialLoadTime(float load_time);
+
+	// Moves the update latency samples added since the last call to samples_out.
+	void takeUpdateLatencySamples(std::vector<float>& samples_out);
+
+	// Copies all initial load times so far.
+	void getInitialLoadTimes(std::vector<float>& load_times_out) const;
+
+	// Partially sorts samples, and returns the value at the given percentile (fraction in [0, 1]).  Returns 0 if there are no samples.
+	static float percentile(std::vector<float>& samples, float fraction);
+
+private:
+	GLARE_DISABLE_COPY(LoadGenStats)
+
+	mutable Mutex mutex;
+	std::vector<float> update_latencies		GUARDED_BY(mutex);
+	std::vector<float> initial_load_times	GUARDED_BY(mutex);
+};
+
+
+/*=====================================================================
+AvatarUpdateTracker
+-------------------
+Records the positions and send times of the last few AvatarTransformUpdate messages
+sent by each bot, so a bot receiving a transform update for another bot's avatar can
+work out the end-to-end latency of the update.
+
+The update is matched by position, since the server only forwards the avatar position,
+quantised to TransformCompression::POS_STEP.  Moving avatars send a different position in each update.
+The server sends at most the latest update per avatar each tick, so not every sent update is received.
+
+Threadsafe.
+=====================================================================*/
+class AvatarUpdateTracker
+{
+public:
+	static const int NUM_RECORDED_UPDATES = 16;
+
+	struct SentUpdate
+	{
+		Vec3d pos;
+		double send_time;
+	};
+
+	// The sent updates for one bot.
+	class AvatarRecord
+	{
+	public:
+		AvatarRecord();
+
+		void clear();
+		void addSentUpdate(const Vec3d& pos, double send_time);
+
+		// Returns the send time of the most recent recorded update with position pos (to within quantisation error), or -1 if there is none.
+		double lookUpSendTime(const Vec3d& pos) const;
+
+	private:
+		mutable Mutex mutex;
+		SentUpdate updates[NUM_RECORDED_UPDATES]	GUARDED_BY(mutex);
+		int next_i									GUARDED_BY(mutex);
+	};
+
+	AvatarUpdateTracker(size_t num_bots);
+	~AvatarUpdateTracker();
+
+	AvatarRecord& getRecordForBot(size_t bot_index) { return *bot_records[bot_index]; }
+
+	// Called when a bot connects and is assigned an avatar UID.  Clears the bot's record.
+	void setBotAvatarUID(size_t bot_index, const UID& avatar_uid);
+	void removeBotAvatarUID(const UID& avatar_uid);
+
+	// Returns NULL if the avatar isn't one of ours.  Records are valid for the lifetime of the tracker.
+	AvatarRecord* getRecordForAvatar(const UID& avatar_uid) const;
+
+private:
+	GLARE_DISABLE_COPY(AvatarUpdateTracker)
+
+	std::vector<AvatarRecord*> bot_records;
+
+	mutable Mutex mutex;
+	std::unordered_map<uint64, AvatarRecord*> avatar_records GUARDED_BY(mutex); // Map from avatar UID to record of the bot with that avatar.
+};
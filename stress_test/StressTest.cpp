@@ -8,6 +8,9 @@ Copyright Glare Technologies Limited 2021 -
 #include "../shared/Protocol.h"
 #include "../shared/UID.h"
 #include "../shared/Avatar.h"
+#include "LoadGenBot.h"
+#include "LoadGenEventLoop.h"
+#include "LoadGenStats.h"
 #include <networking/networking.h>
 #include <networking/TLSSocket.h>
 #include <networking/url.h>
@@ -27,7 +30,14 @@ Copyright Glare Technologies Limited 2021 -
 #include <StringUtils.h>
 #include <GlareProcess.h>
 #include <CryptoRNG.h>
+#include <ArgumentParser.h>
+#include <AtomicInt.h>
 #include <tls.h>
+#include <algorithm>
+#if defined(__linux__)
+#include <netdb.h>
+#include <cstring>
+#endif
 
 
 // TODO: do authentication
@@ -47,6 +57,11 @@ static void updatePacketLengthField(SocketBufferOutStream& packet)
 }
 
 
+// Bandwidth statistics, summed over all bots.
+static glare::AtomicInt total_bytes_received(0);
+static glare::AtomicInt num_bots_connected(0);
+
+
 static void initPacket(SocketBufferOutStream& scratch_packet, uint32 message_id)
 {
 	scratch_packet.buf.resize(sizeof(uint32) * 2);
@@ -60,11 +75,11 @@ class StressTestBotThread : public MyThread
 public:
 	virtual void run()
 	{
+		bool connected = false;
+
 		// Connect to substrata server
 		try
 		{
-			//const std::string server_hostname = "localhost";
-			const std::string server_hostname = "substrata.info";
 			const int server_port = 7600;
 
 			conPrint("Connecting to " + server_hostname + ":" + toString(server_port) + "...");
@@ -105,20 +120,23 @@ public:
 			else
 				throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
 
-			const uint32 peer_protocol_version = Protocol::CyberspaceProtocolVersion; // Just assume server is speaking the latest procotol version we know about, for now.
-			// TODO: Send server protocol version from the server.
+			const uint32 peer_protocol_version = socket->readUInt32(); // Read server protocol version.  Sent by servers since protocol version 38.
+			(void)peer_protocol_version;
 
 
 			// Read assigned client avatar UID
 			const UID client_avatar_uid = readUIDFromStream(*socket);
 
 
-			Vec3d cur_pos(0,0,1.67);
+			PCG32 rng(seed);
+
+			// Spawn at a random position in a disc of radius spawn_radius around the origin.
+			const float spawn_r = std::sqrt(rng.unitRandom()) * spawn_radius;
+			const float spawn_theta = rng.unitRandom() * Maths::get2Pi<float>();
+			Vec3d cur_pos(cos(spawn_theta) * spawn_r, sin(spawn_theta) * spawn_r, 1.67);
 			Vec3d cur_vel(0.5,0,0);
 			Vec3f cur_angles(0, Maths::pi_2<float>(), 0);
 
-
-			PCG32 rng(seed);
 			float heading = rng.unitRandom() * Maths::get2Pi<float>();
 			cur_angles = Vec3f(0, Maths::pi_2<float>(), heading);
 			cur_vel = Vec3d(cos(heading), sin(heading), 0) * 2;
@@ -150,6 +168,9 @@ public:
 
 			double last_think_time = Clock::getCurTimeRealSec();
 
+			num_bots_connected.increment();
+			connected = true;
+
 			while(1)
 			{
 				if(socket->readable(/*timeout_s=*/0.05))
@@ -171,6 +192,8 @@ public:
 
 					socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
 
+					total_bytes_received.add(msg_len);
+
 					//conPrint("Read msg of type " + toString(msg_type));
 
 					switch(msg_type)
@@ -222,23 +245,171 @@ public:
 		{
 			// Connection failed.
 			conPrint("Error: " + e.what());
+			if(connected)
+				num_bots_connected.decrement();
 			//PlatformUtils::Sleep(1000);
 		}
 	}
 
 	struct tls_config* client_tls_config;
+	std::string server_hostname;
+	float spawn_radius;
 	int seed;
 };
 
 
+#if defined(__linux__)
+
+// Resolves hostname, and writes the address with the given port to addr_out.
+static void resolveServerAddress(const std::string& hostname, int port, sockaddr_storage& addr_out, socklen_t& addr_len_out)
+{
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* results = NULL;
+	const int res = getaddrinfo(hostname.c_str(), toString(port).c_str(), &hints, &results);
+	if(res != 0 || !results)
+		throw glare::Exception("Failed to resolve '" + hostname + "': " + std::string(gai_strerror(res)));
+
+	std::memcpy(&addr_out, results->ai_addr, results->ai_addrlen);
+	addr_len_out = (socklen_t)results->ai_addrlen;
+	freeaddrinfo(results);
+}
+
+
+static void printLoadGenReport(LoadGenStats& stats, double elapsed, int64& last_tcp_bytes_received, int64& last_udp_bytes_received, std::vector<float>& temp_samples)
+{
+	const int64 num_connected = stats.num_connected;
+	const int64 tcp_bytes_received = stats.tcp_bytes_received;
+	const int64 udp_bytes_received = stats.udp_bytes_received;
+	const double tcp_bytes_per_sec = (double)(tcp_bytes_received - last_tcp_bytes_received) / elapsed;
+	const double udp_bytes_per_sec = (double)(udp_bytes_received - last_udp_bytes_received) / elapsed;
+	last_tcp_bytes_received = tcp_bytes_received;
+	last_udp_bytes_received = udp_bytes_received;
+
+	conPrint("Bots connected: " + toString(num_connected) + ", logged in: " + toString((int64)stats.num_logged_in) + 
+		", initial loads done: " + toString((int64)stats.num_initial_loads_done) + ", connection errors: " + toString((int64)stats.num_connection_errors));
+	conPrint("    received per bot: TCP " + doubleToStringNSigFigs(tcp_bytes_per_sec / myMax<int64>(1, num_connected) / 1024, 4) + " KB/s, " + 
+		"UDP " + doubleToStringNSigFigs(udp_bytes_per_sec / myMax<int64>(1, num_connected) / 1024, 4) + " KB/s");
+
+	stats.takeUpdateLatencySamples(temp_samples);
+	if(!temp_samples.empty())
+	{
+		const size_t num_samples = temp_samples.size();
+		const float p50 = LoadGenStats::percentile(temp_samples, 0.5f);
+		const float p90 = LoadGenStats::percentile(temp_samples, 0.9f);
+		const float p99 = LoadGenStats::percentile(temp_samples, 0.99f);
+		const float max_latency = *std::max_element(temp_samples.begin(), temp_samples.end());
+		conPrint("    avatar update latency (" + toString(num_samples) + " samples): p50 " + doubleToStringNSigFigs(p50 * 1.0e3, 3) + " ms, p90 " + doubleToStringNSigFigs(p90 * 1.0e3, 3) + 
+			" ms, p99 " + doubleToStringNSigFigs(p99 * 1.0e3, 3) + " ms, max " + doubleToStringNSigFigs(max_latency * 1.0e3, 3) + " ms");
+	}
+
+	stats.getInitialLoadTimes(temp_samples);
+	if(!temp_samples.empty())
+	{
+		const size_t num_samples = temp_samples.size();
+		const float p50 = LoadGenStats::percentile(temp_samples, 0.5f);
+		const float p90 = LoadGenStats::percentile(temp_samples, 0.9f);
+		const float p99 = LoadGenStats::percentile(temp_samples, 0.99f);
+		conPrint("    initial load time (" + toString(num_samples) + " loads): p50 " + doubleToStringNSigFigs(p50, 3) + " s, p90 " + doubleToStringNSigFigs(p90, 3) + 
+			" s, p99 " + doubleToStringNSigFigs(p99, 3) + " s");
+	}
+}
+
+#endif // defined(__linux__)
+
+
+// Usage: stress_test [--server hostname] [--num_bots n] [--spawn_radius r] [--report_bandwidth]
+//        stress_test --load_gen [--server hostname] [--num_bots n] [--spawn_radius r] [--num_event_loops n] [--connect_rate n] [--voice_fraction f]
+//                    [--chat_period s] [--edit_period s] [--query_radius r] [--no_compression] [--duration s]
+//
+// --report_bandwidth prints the average number of bytes received per connected bot per second, every 5 seconds.
+// To measure the effect of server-side area-of-interest filtering, run with the same number of bots and spawn radius
+// against a server with aoi_filtering_enabled set to true and to false in substrata_server_config.xml.
+//
+// --load_gen (Linux only) runs the bots on a few epoll event loop threads instead of a thread per bot, so that thousands of bots can be simulated
+// from one machine.  See LoadGenBot.h for what each bot does.  Bots connect at --connect_rate bots per second (default 50), and every 5 seconds
+// the connection counts, received bandwidth per bot, avatar update latency percentiles, and initial load time percentiles are printed.
+// --duration runs for the given number of seconds then exits, deleting the objects the bots created.
+//
+// For example, against a local server:
+//     stress_test --load_gen --server localhost --num_bots 2000 --spawn_radius 200 --num_event_loops 4 --duration 300
 int main(int argc, char* argv[])
 {
 	Clock::init();
 	Networking::createInstance();
-	PlatformUtils::ignoreUnixSignals();
-	OpenSSL::init();
+	PlatformUtils::ignoreUnixSignals();
+	OpenSSL::init();
 	TLSSocket::initTLS();
 
+	std::string server_hostname = "localhost";
+	int num_bots = 300;
+	float spawn_radius = 0;
+	bool report_bandwidth = false;
+	bool load_gen = false;
+	int num_event_loops = 4;
+	double connect_rate = 50;
+	float voice_fraction = 0.1f;
+	double chat_period = 60;
+	double edit_period = 30;
+	float query_radius = 100;
+	bool use_stream_compression = true;
+	double duration = -1;
+	try
+	{
+		std::map<std::string, std::vector<ArgumentParser::ArgumentType> > syntax;
+		syntax["--server"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--num_bots"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--spawn_radius"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--report_bandwidth"] = std::vector<ArgumentParser::ArgumentType>();
+		syntax["--load_gen"] = std::vector<ArgumentParser::ArgumentType>();
+		syntax["--num_event_loops"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--connect_rate"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--voice_fraction"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--chat_period"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--edit_period"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--query_radius"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--no_compression"] = std::vector<ArgumentParser::ArgumentType>();
+		syntax["--duration"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+
+		std::vector<std::string> args;
+		for(int i=0; i<argc; ++i)
+			args.push_back(argv[i]);
+
+		ArgumentParser parsed_args(args, syntax, /*allow_unnamed_arg=*/false);
+
+		if(parsed_args.isArgPresent("--server"))
+			server_hostname = parsed_args.getArgStringValue("--server");
+		if(parsed_args.isArgPresent("--num_bots"))
+			num_bots = stringToInt(parsed_args.getArgStringValue("--num_bots"));
+		if(parsed_args.isArgPresent("--spawn_radius"))
+			spawn_radius = (float)stringToDouble(parsed_args.getArgStringValue("--spawn_radius"));
+		report_bandwidth = parsed_args.isArgPresent("--report_bandwidth");
+		load_gen = parsed_args.isArgPresent("--load_gen");
+		if(parsed_args.isArgPresent("--num_event_loops"))
+			num_event_loops = myMax(1, stringToInt(parsed_args.getArgStringValue("--num_event_loops")));
+		if(parsed_args.isArgPresent("--connect_rate"))
+			connect_rate = myMax(0.01, stringToDouble(parsed_args.getArgStringValue("--connect_rate")));
+		if(parsed_args.isArgPresent("--voice_fraction"))
+			voice_fraction = (float)stringToDouble(parsed_args.getArgStringValue("--voice_fraction"));
+		if(parsed_args.isArgPresent("--chat_period"))
+			chat_period = stringToDouble(parsed_args.getArgStringValue("--chat_period"));
+		if(parsed_args.isArgPresent("--edit_period"))
+			edit_period = stringToDouble(parsed_args.getArgStringValue("--edit_period"));
+		if(parsed_args.isArgPresent("--query_radius"))
+			query_radius = (float)stringToDouble(parsed_args.getArgStringValue("--query_radius"));
+		use_stream_compression = !parsed_args.isArgPresent("--no_compression");
+		if(parsed_args.isArgPresent("--duration"))
+			duration = stringToDouble(parsed_args.getArgStringValue("--duration"));
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("Error parsing arguments: " + e.what());
+		return 1;
+	}
+
 
 	// Create and init TLS client config
 	struct tls_config* client_tls_config = tls_config_new();
@@ -248,20 +419,116 @@ int main(int argc, char* argv[])
 	tls_config_insecure_noverifyname(client_tls_config);
 
 
-	const int NUM_THREADS = 300;
+	if(load_gen)
+	{
+#if defined(__linux__)
+		try
+		{
+			LoadGenConfig config;
+			config.server_hostname = server_hostname;
+			socklen_t udp_addr_len;
+			resolveServerAddress(server_hostname, /*port=*/7600, config.server_addr, config.server_addr_len);
+			resolveServerAddress(server_hostname, /*port=*/7601, config.server_UDP_addr, udp_addr_len);
+			config.client_tls_config = client_tls_config;
+			config.spawn_radius = spawn_radius;
+			config.query_radius = query_radius;
+			config.voice_fraction = voice_fraction;
+			config.chat_period = chat_period;
+			config.edit_period = edit_period;
+			config.use_stream_compression = use_stream_compression;
+
+			LoadGenStats stats;
+			AvatarUpdateTracker tracker(num_bots);
+
+			// Assign bots to event loops round-robin, and stagger the initial connections so we don't overwhelm the server with TLS handshakes.
+			const double start_time = Clock::getCurTimeRealSec();
+			std::vector<std::vector<LoadGenBot*>> loop_bots(num_event_loops);
+			for(int i=0; i<num_bots; ++i)
+			{
+				LoadGenBot* bot = new LoadGenBot(/*bot_index=*/i, config, stats, tracker);
+				bot->reconnect_time = start_time + i / connect_rate;
+				loop_bots[i % num_event_loops].push_back(bot);
+			}
+
+			std::vector<Reference<LoadGenEventLoop>> event_loops;
+			for(int i=0; i<num_event_loops; ++i)
+			{
+				Reference<LoadGenEventLoop> loop = new LoadGenEventLoop(loop_bots[i], stats);
+				loop->launch();
+				event_loops.push_back(loop);
+			}
+
+			conPrint("Running " + toString(num_bots) + " bots on " + toString(num_event_loops) + " event loops against " + server_hostname + "...");
+
+			Timer report_timer;
+			int64 last_tcp_bytes_received = 0;
+			int64 last_udp_bytes_received = 0;
+			std::vector<float> temp_samples;
+			while((duration < 0) || (Clock::getCurTimeRealSec() - start_time < duration))
+			{
+				PlatformUtils::Sleep(100);
+
+				if(report_timer.elapsed() > 5.0)
+				{
+					printLoadGenReport(stats, report_timer.elapsed(), last_tcp_bytes_received, last_udp_bytes_received, temp_samples);
+					report_timer.reset();
+				}
+			}
+
+			// Shut down event loops, so the bots delete their objects.
+			for(size_t i=0; i<event_loops.size(); ++i)
+				event_loops[i]->should_quit = 1;
+			for(size_t i=0; i<event_loops.size(); ++i)
+				event_loops[i]->join();
+
+			printLoadGenReport(stats, report_timer.elapsed(), last_tcp_bytes_received, last_udp_bytes_received, temp_samples);
+
+			event_loops.clear();
+			tls_config_free(client_tls_config);
+			return 0;
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("Error: " + e.what());
+			return 1;
+		}
+#else
+		conPrint("--load_gen is only supported on Linux.");
+		return 1;
+#endif
+	}
+
+
 	std::vector<Reference<StressTestBotThread>> threads;
-	for(int i=0; i<NUM_THREADS; ++i)
+	for(int i=0; i<num_bots; ++i)
 	{
 		Reference<StressTestBotThread> t = new StressTestBotThread();
 		t->client_tls_config = client_tls_config;
+		t->server_hostname = server_hostname;
+		t->spawn_radius = spawn_radius;
 		t->seed = i;
 		t->launch();
 		threads.push_back(t);
 	}
 
+	Timer report_timer;
+	int64 last_total_bytes = 0;
 	while(1)
 	{
 		PlatformUtils::Sleep(100);
+
+		if(report_bandwidth && (report_timer.elapsed() > 5.0))
+		{
+			const int64 total_bytes = total_bytes_received;
+			const int64 num_connected = num_bots_connected;
+			const double bytes_per_sec = (double)(total_bytes - last_total_bytes) / report_timer.elapsed();
+
+			conPrint("Bots connected: " + toString(num_connected) + ", total received: " + doubleToStringNSigFigs(bytes_per_sec / 1024, 4) + " KB/s" + 
+				", per bot: " + doubleToStringNSigFigs(bytes_per_sec / myMax<int64>(1, num_connected) / 1024, 4) + " KB/s");
+
+			last_total_bytes = total_bytes;
+			report_timer.reset();
+		}
 	}
 	//while(1) // While stress-test bot should keep running:
 	//{
@@ -44,8 +44,11 @@ void renderUserAccountPage(ServerAllWorldsState& world_state, const web::Request
 {
 	std::string page;
 
+	Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock world_lock(root_world->mutex); // For the parcels
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -75,8 +78,6 @@ void renderUserAccountPage(ServerAllWorldsState& world_state, const web::Request
 
 		page += "<h2>Parcels</h2>\n";
 
-		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
-
 		for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
 		{
 			const Parcel* parcel = it->second.ptr();
@@ -133,7 +134,7 @@ void renderProveEthAddressOwnerPage(ServerAllWorldsState& world_state, const web
 	std::string page;
 
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.users_mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -195,7 +196,7 @@ void renderProveParcelOwnerByNFT(ServerAllWorldsState& world_state, const web::R
 	std::string page;
 
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.users_mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -246,7 +247,7 @@ void handleEthSignMessagePost(ServerAllWorldsState& world_state, const web::Requ
 	 const web::UnsafeString sig = request_info.getURLParam("sig");
 
 	 { // lock scope
-		 Lock lock(world_state.mutex);
+		 InstrumentedLock lock(world_state.users_mutex);
 
 		 User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 		 if(logged_in_user == NULL)
@@ -298,8 +299,11 @@ void renderMakeParcelIntoNFTPage(ServerAllWorldsState& world_state, const web::R
 
 	const ParcelID parcel_id(request.getURLIntParam("parcel_id"));
 
+	Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock world_lock(root_world->mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -312,8 +316,8 @@ void renderMakeParcelIntoNFTPage(ServerAllWorldsState& world_state, const web::R
 		}
 
 		// Lookup parcel
-		auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-		if(res == world_state.getRootWorldState()->parcels.end())
+		auto res = root_world->parcels.find(parcel_id);
+		if(res == root_world->parcels.end())
 			throw glare::Exception("No such parcel");
 		
 		const Parcel* parcel = res->second.ptr();
@@ -471,7 +475,10 @@ void handleMakeParcelIntoNFTPost(ServerAllWorldsState& world_state, const web::R
 
 		const ParcelID parcel_id(request_info.getPostIntField("parcel_id"));
 
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex); // For sub_eth_transactions
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		InstrumentedLock world_lock(root_world->mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 		if(logged_in_user == NULL)
@@ -486,8 +493,8 @@ void handleMakeParcelIntoNFTPost(ServerAllWorldsState& world_state, const web::R
 			throw glare::Exception("controlled eth address must be valid.");
 
 		// Lookup parcel
-		auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-		if(res == world_state.getRootWorldState()->parcels.end())
+		auto res = root_world->parcels.find(parcel_id);
+		if(res == root_world->parcels.end())
 			throw glare::Exception("No such parcel");
 
 		Parcel* parcel = res->second.ptr();
@@ -514,7 +521,7 @@ void handleMakeParcelIntoNFTPost(ServerAllWorldsState& world_state, const web::R
 		world_state.addSubEthTransactionAsDBDirty(transaction);
 
 		parcel->minting_transaction_id = transaction->id;
-		world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+		root_world->addParcelAsDBDirty(parcel);
 
 		world_state.sub_eth_transactions[transaction->id] = transaction;
 
@@ -551,7 +558,9 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 
 		parcel_id = ParcelID(request_info.getPostIntField("parcel_id"));
 
-		Lock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		InstrumentedLock world_lock(root_world->mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 		if(logged_in_user == NULL)
@@ -563,8 +572,8 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 		user_controlled_eth_address = logged_in_user->controlled_eth_address;
 
 		// Lookup parcel
-		auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-		if(res == world_state.getRootWorldState()->parcels.end())
+		auto res = root_world->parcels.find(parcel_id);
+		if(res == root_world->parcels.end())
 			throw glare::Exception("No such parcel");
 
 		Parcel* parcel = res->second.ptr();
@@ -602,16 +611,19 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 		{
 			// The logged in user does indeed own the parcel NFT.  So assign ownership of the parcel.
 
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+
 			{ // lock scope
-				Lock lock(world_state.mutex);
+				InstrumentedLock world_lock(root_world->mutex);
+				InstrumentedLock users_lock(world_state.users_mutex);
 
 				User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 				if(logged_in_user == NULL)
 					throw glare::Exception("logged_in_user == NULL.");
 
 				// Lookup parcel
-				auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-				if(res == world_state.getRootWorldState()->parcels.end())
+				auto res = root_world->parcels.find(parcel_id);
+				if(res == root_world->parcels.end())
 					throw glare::Exception("No such parcel");
 
 				Parcel* parcel = res->second.ptr();
@@ -622,16 +634,16 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 				parcel->admin_ids  = std::vector<UserID>(1, UserID(logged_in_user->id));
 				parcel->writer_ids = std::vector<UserID>(1, UserID(logged_in_user->id));
 				
-				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+				root_world->addParcelAsDBDirty(parcel);
 
 				// TODO: Log ownership change?
 
-				world_state.denormaliseData();
-				world_state.markAsChanged();
-
 				succeeded = true;
 
 			} // End lock scope
+
+			world_state.denormaliseData(); // Done after releasing the locks above, as it locks each world then users_mutex itself.
+			world_state.markAsChanged();
 		}
 	}
 	catch(glare::Exception& e)
@@ -16,6 +16,7 @@ Copyright Glare Technologies Limited 2021 -
 #include <ConPrint.h>
 #include <Exception.h>
 #include <Lock.h>
+#include <Clock.h>
 #include <Parser.h>
 #include <Escaping.h>
 
@@ -48,7 +49,7 @@ void renderMainAdminPage(ServerAllWorldsState& world_state, const web::RequestIn
 	page_out += "<p>Welcome!</p><br/><br/>";
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
 		if(world_state.server_admin_message.empty())
 		{
 			page_out += "<p>No server admin message set.</p>";
@@ -64,25 +65,82 @@ void renderMainAdminPage(ServerAllWorldsState& world_state, const web::RequestIn
 	page_out += "<input type=\"submit\" value=\"Set server admin message\" onclick=\"return confirm('Are you sure you want set the server admin message?');\" >";
 	page_out += "</form>";
 
-	{ // Lock scope
-		Lock lock(world_state.mutex);
-
-		if(world_state.read_only_mode)
+	{
+		const bool read_only_mode = world_state.isInReadOnlyMode();
+		if(read_only_mode)
 			page_out += "<p>Server is in read-only mode!</p>";
 		else
 			page_out += "<p>Server is not in read-only mode.</p>";
 
 		page_out += "<form action=\"/admin_set_read_only_mode_post\" method=\"post\">";
-		page_out += "<input type=\"number\" name=\"read_only_mode\" value=\"" + toString(world_state.read_only_mode ? 1 : 0) + "\">";
+		page_out += "<input type=\"number\" name=\"read_only_mode\" value=\"" + toString(read_only_mode ? 1 : 0) + "\">";
 		page_out += "<input type=\"submit\" value=\"Set server read-only mode (1 / 0)\" onclick=\"return confirm('Are you sure you want set the server read-only mode?');\" >";
 		page_out += "</form>";
-	} // End Lock scope
+	}
 
 	page_out += "<br/><br/>";
 	page_out += "<form action=\"/admin_force_dyn_tex_update_post\" method=\"post\">";
 	page_out += "<input type=\"submit\" value=\"Force dynamic texture update checker to run\" onclick=\"return confirm('Are you sure you want to force the dynamic texture update checker to run?');\" >";
 	page_out += "</form>";
 
+	page_out += "<h2>Update-to-broadcast latency</h2>";
+	page_out += "<p>Time from the first avatar or object change arriving from a client, to the change being enqueued for broadcast by the main server loop.</p>";
+	page_out += LatencyHistogram::toHTMLTable(world_state.broadcast_latency_histogram.getSnapshot());
+
+	page_out += "<h2>Lock contention</h2>";
+	page_out += "<p>Wait and hold times for the global lock, the per-world locks and the table locks since the server started.</p>";
+	{
+		const double stats_period = Clock::getCurTimeRealSec() - world_state.lock_stats_start_time;
+		const InstrumentedMutex::Stats global_stats = world_state.mutex.getStats(); // Get before locking, so this page's own acquisition isn't included.
+
+		page_out += "<table>" + InstrumentedMutex::statsHTMLTableHeader();
+		page_out += InstrumentedMutex::statsToHTMLTableRow("global", global_stats, stats_period);
+		page_out += InstrumentedMutex::statsToHTMLTableRow("users", world_state.users_mutex.getStats(), stats_period);
+		page_out += InstrumentedMutex::statsToHTMLTableRow("sessions", world_state.sessions_mutex.getStats(), stats_period);
+		page_out += InstrumentedMutex::statsToHTMLTableRow("orders", world_state.orders_mutex.getStats(), stats_period);
+		page_out += InstrumentedMutex::statsToHTMLTableRow("resources", world_state.resources_mutex.getStats(), stats_period);
+
+		InstrumentedLock lock(world_state.mutex);
+		for(auto it = world_state.world_states.begin(); it != world_state.world_states.end(); ++it)
+			page_out += InstrumentedMutex::statsToHTMLTableRow("world '" + web::Escaping::HTMLEscape(it->first) + "'", it->second->mutex.getStats(), stats_period);
+		page_out += "</table>";
+	}
+
+	page_out += "<h2>Database saves</h2>";
+	page_out += "<p>saves: " + toString((int64)world_state.db_num_saves) + ", snapshots written: " + toString((int64)world_state.db_num_snapshots_written) +
+		", snapshots pending: " + toString((int64)world_state.db_num_snapshots_pending) + , deferred saves: " + toString((int64)world_state.db_num_deferred_saves) +
+		", write failures: " + toString((int64)world_state.db_num_write_failures) +
+		", total written: " + toString((int64)world_state.db_total_bytes_written / 1024) + " KB</p>";
+	page_out += "<h3>Save latency</h3>";
+	page_out += "<p>Time from a snapshot of the changed data being made, to it being written and flushed to disk.</p>";
+	page_out += LatencyHistogram::toHTMLTable(world_state.db_save_latency_histogram.getSnapshot());
+	page_out += "<h3>Snapshot lock hold time</h3>";
+	page_out += "<p>Time spent making snapshots, with the global lock held.</p>";
+	page_out += LatencyHistogram::toHTMLTable(world_state.db_snapshot_lock_hold_histogram.getSnapshot());
+
+	{
+		const LODGenJobQueueStats stats = world_state.lod_gen_job_queue.getStats(Clock::getCurTimeRealSec());
+		const uint64 num_finished = stats.num_completed + stats.num_failed;
+		page_out += "<h2>LOD generation</h2>";
+		page_out += "<p>Generation of LOD meshes, LOD textures and KTX textures.</p>";
+		page_out += "<p>queued jobs: " + toString((uint64)stats.num_pending) + ", running jobs: " + toString((uint64)stats.num_running) +
+			", completed: " + toString(stats.num_completed) + ", failed: " + toString(stats.num_failed) + ", merged duplicate jobs: " + toString(stats.num_merged) + "</p>";
+		page_out += "<p>throughput: " + doubleToStringNSigFigs(stats.num_completed_in_last_minute / 60.0, 3) + " jobs/s (over last minute), mean job time: " +
+			((num_finished > 0) ? doubleToStringNSigFigs(stats.total_job_time / num_finished, 3) + " s" : std::string("-")) + "</p>";
+	}
+
+	page_out += "<h2>Stream compression</h2>";
+	page_out += "<p>zstd compression of messages sent to clients.  CPU usage is compression time as a fraction of the time since compression was enabled.</p>";
+	page_out += world_state.compression_stats.toHTML(Clock::getCurTimeRealSec());
+
+	page_out += "<h2>Compressed resource variants</h2>";
+	page_out += "<p>Precompressed copies of compressible resources, served over HTTP and to native clients.</p>";
+	page_out += world_state.compressed_resource_variants.toHTML();
+
+	page_out += "<h2>Resource cache</h2>";
+	page_out += "<p>In-memory cache of popular resource files and compressed variants.  Files are cached after their second request.</p>";
+	page_out += world_state.resource_cache.toHTML();
+
 	web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page_out);
 }
 
@@ -98,7 +156,7 @@ void renderUsersPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.users_mutex);
 
 		// Print out users
 		page_out += "<h2>Users</h2>\n";
@@ -148,7 +206,7 @@ void renderAdminUserPage(ServerAllWorldsState& world_state, const web::RequestIn
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.users_mutex);
 
 		page_out += "<h2>User " + toString(user_id) + "</h2>\n";
 
@@ -209,7 +267,10 @@ void renderParcelsPage(ServerAllWorldsState& world_state, const web::RequestInfo
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		InstrumentedLock world_lock(root_world->mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		page_out += "<h2>Root world Parcels</h2>\n";
 
@@ -225,8 +286,6 @@ void renderParcelsPage(ServerAllWorldsState& world_state, const web::RequestInfo
 
 
 
-		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
-
 		for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
 		{
 			const Parcel* parcel = it->second.ptr();
@@ -284,7 +343,7 @@ void renderParcelAuctionsPage(ServerAllWorldsState& world_state, const web::Requ
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
 
 		page_out += "<h2>Parcel auctions</h2>\n";
 
@@ -348,7 +407,8 @@ void renderAdminParcelAuctionPage(ServerAllWorldsState& world_state, const web::
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		auto res = world_state.parcel_auctions.find(auction_id);
 		if(res != world_state.parcel_auctions.end())
@@ -434,7 +494,8 @@ void renderOrdersPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.users_mutex);
+		InstrumentedLock orders_lock(world_state.orders_mutex);
 
 		page_out += "<h2>Orders</h2>\n";
 
@@ -482,7 +543,8 @@ void renderSubEthTransactionsPage(ServerAllWorldsState& world_state, const web::
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 
 		page_out += "<form action=\"/admin_set_min_next_nonce_post\" method=\"post\">";
@@ -554,7 +616,8 @@ void renderAdminSubEthTransactionPage(ServerAllWorldsState& world_state, const w
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		page_out += "<h2>Eth transaction " + toString(transaction_id) + "</h2>\n";
 
@@ -662,7 +725,7 @@ void renderMapPage(ServerAllWorldsState& world_state, const web::RequestInfo& re
 	page_out += "</form>";
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
 
 		page_out += "<h2>Map Info</h2>\n";
 
@@ -704,7 +767,8 @@ void renderAdminOrderPage(ServerAllWorldsState& world_state, const web::RequestI
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.users_mutex);
+		InstrumentedLock orders_lock(world_state.orders_mutex);
 
 		page_out += "<h2>Order " + toString(order_id) + "</h2>\n";
 
@@ -803,11 +867,13 @@ void createParcelAuctionPost(ServerAllWorldsState& world_state, const web::Reque
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID((uint32)parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				// Found user for username
 				Parcel* parcel = res->second.ptr();
@@ -872,7 +938,7 @@ void createParcelAuctionPost(ServerAllWorldsState& world_state, const web::Reque
 				parcel->parcel_auction_ids.push_back(auction->id);
 
 				world_state.addParcelAuctionAsDBDirty(auction);
-				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+				root_world->addParcelAsDBDirty(parcel);
 
 				web::ResponseUtils::writeRedirectTo(reply_info, "/parcel_auction/" + toString(auction->id));
 			}
@@ -914,11 +980,14 @@ void renderSetParcelOwnerPage(ServerAllWorldsState& world_state, const web::Requ
 
 	{ // Lock scope
 
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		InstrumentedLock world_lock(root_world->mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		// Lookup parcel
-		const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-		if(res != world_state.getRootWorldState()->parcels.end())
+		const auto res = root_world->parcels.find(parcel_id);
+		if(res != root_world->parcels.end())
 		{
 			// Found user for username
 			Parcel* parcel = res->second.ptr();
@@ -958,13 +1027,16 @@ void handleSetParcelOwnerPost(ServerAllWorldsState& world_state, const web::Requ
 		const int parcel_id    = request.getPostIntField("parcel_id");
 		const int new_owner_id = request.getPostIntField("new_owner_id");
 
+		bool updated_parcel = false;
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID((uint32)parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				// Found user for username
 				Parcel* parcel = res->second.ptr();
@@ -974,15 +1046,20 @@ void handleSetParcelOwnerPost(ServerAllWorldsState& world_state, const web::Requ
 				// Set parcel admins and writers to the new user as well.
 				parcel->admin_ids  = std::vector<UserID>(1, UserID(new_owner_id));
 				parcel->writer_ids = std::vector<UserID>(1, UserID(new_owner_id));
-				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+				root_world->addParcelAsDBDirty(parcel);
 
-				world_state.denormaliseData(); // Update denormalised data which includes parcel owner name
-
-				world_state.markAsChanged();
-
-				web::ResponseUtils::writeRedirectTo(reply_info, "/parcel/" + toString(parcel_id));
+				updated_parcel = true;
 			}
 		} // End lock scope
+
+		if(updated_parcel)
+		{
+			world_state.denormaliseData(); // Update denormalised data which includes parcel owner name.  Done after releasing the locks above, as it locks each world then users_mutex itself.
+
+			world_state.markAsChanged();
+
+			web::ResponseUtils::writeRedirectTo(reply_info, "/parcel/" + toString(parcel_id));
+		}
 	}
 	catch(glare::Exception& e)
 	{
@@ -1006,11 +1083,13 @@ void handleMarkParcelAsNFTMintedPost(ServerAllWorldsState& world_state, const we
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID((uint32)parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 				parcel->nft_status = Parcel::NFTStatus_MintedNFT;
@@ -1043,15 +1122,17 @@ void handleMarkParcelAsNotNFTPost(ServerAllWorldsState& world_state, const web::
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID((uint32)parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 				parcel->nft_status = Parcel::NFTStatus_NotNFT;
-				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+				root_world->addParcelAsDBDirty(parcel);
 
 				world_state.markAsChanged();
 
@@ -1081,13 +1162,15 @@ void handleRetryParcelMintPost(ServerAllWorldsState& world_state, const web::Req
 		const int parcel_id = request.getPostIntField("parcel_id");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
 
 			User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID((uint32)parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 
@@ -1116,7 +1199,7 @@ void handleRetryParcelMintPost(ServerAllWorldsState& world_state, const web::Req
 
 				parcel->minting_transaction_id = transaction->id;
 				
-				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+				root_world->addParcelAsDBDirty(parcel);
 
 				world_state.sub_eth_transactions[transaction->id] = transaction;
 
@@ -1148,7 +1231,7 @@ void handleSetTransactionStateToNewPost(ServerAllWorldsState& world_state, const
 		const int transaction_id = request.getPostIntField("transaction_id");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			// Lookup transaction
 			const auto res = world_state.sub_eth_transactions.find(transaction_id);
@@ -1186,7 +1269,7 @@ void handleSetTransactionStateToCompletedPost(ServerAllWorldsState& world_state,
 		const int transaction_id = request.getPostIntField("transaction_id");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			// Lookup transaction
 			const auto res = world_state.sub_eth_transactions.find(transaction_id);
@@ -1225,7 +1308,7 @@ void handleSetTransactionHashPost(ServerAllWorldsState& world_state, const web::
 		const UInt256 hash = UInt256::parseFromHexString(hash_str.str());
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			// Lookup transaction
 			const auto res = world_state.sub_eth_transactions.find(transaction_id);
@@ -1264,7 +1347,7 @@ void handleSetTransactionNoncePost(ServerAllWorldsState& world_state, const web:
 		const int nonce = request.getPostIntField("nonce");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			// Lookup transaction
 			const auto res = world_state.sub_eth_transactions.find(transaction_id);
@@ -1303,7 +1386,7 @@ void handleDeleteTransactionPost(ServerAllWorldsState& world_state, const web::R
 		const int transaction_id = request.getPostIntField("transaction_id");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			// Lookup transaction
 			auto res = world_state.sub_eth_transactions.find(transaction_id);
@@ -1313,7 +1396,7 @@ void handleDeleteTransactionPost(ServerAllWorldsState& world_state, const web::R
 
 				world_state.db_dirty_sub_eth_transactions.erase(trans); // Remove from dirty set so it doesn't get written to the DB
 
-				world_state.db_records_to_delete.insert(trans->database_key);
+				world_state.addDatabaseRecordToDelete(trans->database_key);
 
 				world_state.sub_eth_transactions.erase(transaction_id);
 
@@ -1346,7 +1429,9 @@ void handleRegenerateParcelAuctionScreenshots(ServerAllWorldsState& world_state,
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
 
 			// Lookup parcel auction
 			const auto res = world_state.parcel_auctions.find(parcel_auction_id);
@@ -1355,8 +1440,8 @@ void handleRegenerateParcelAuctionScreenshots(ServerAllWorldsState& world_state,
 				ParcelAuction* auction = res->second.ptr();
 
 				// Lookup parcel
-				const auto res2 = world_state.getRootWorldState()->parcels.find(auction->parcel_id);
-				if(res2 != world_state.getRootWorldState()->parcels.end())
+				const auto res2 = root_world->parcels.find(auction->parcel_id);
+				if(res2 != root_world->parcels.end())
 				{
 					const Parcel* parcel = res2->second.ptr();
 
@@ -1413,11 +1498,13 @@ void handleRegenerateParcelScreenshots(ServerAllWorldsState& world_state, const
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(parcel_id);
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 
@@ -1477,9 +1564,11 @@ void handleRegenerateMultipleParcelScreenshots(ServerAllWorldsState& world_state
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
 
-			for(auto it = world_state.getRootWorldState()->parcels.begin(); it != world_state.getRootWorldState()->parcels.end(); ++it)
+			for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
 			{
 				Parcel* parcel = it->second.ptr();
 
@@ -1522,7 +1611,7 @@ void handleRegenerateMultipleParcelScreenshots(ServerAllWorldsState& world_state
 							world_state.addScreenshotAsDBDirty(shot);
 						}
 
-						world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+						root_world->addParcelAsDBDirty(parcel);
 						world_state.markAsChanged();
 
 						conPrint("Created screenshots for parcel " + parcel->id.toString());
@@ -1588,7 +1677,7 @@ void handleTerminateParcelAuction(ServerAllWorldsState& world_state, const web::
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			// Lookup parcel auction
 			const auto res = world_state.parcel_auctions.find(parcel_auction_id);
@@ -1625,7 +1714,7 @@ void handleRegenMapTilesPost(ServerAllWorldsState& world_state, const web::Reque
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			// Mark all tile sceenshots as not done.
 			for(auto it = world_state.map_tile_info.info.begin(); it != world_state.map_tile_info.info.end(); ++it)
@@ -1667,7 +1756,7 @@ void handleRecreateMapTilesPost(ServerAllWorldsState& world_state, const web::Re
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			uint64 next_shot_id = world_state.getNextScreenshotUID();
 
@@ -1716,7 +1805,7 @@ void handleSetMinNextNoncePost(ServerAllWorldsState& world_state, const web::Req
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			world_state.eth_info.min_next_nonce = request.getPostIntField("min_next_nonce");
 			world_state.eth_info.db_dirty = true;
@@ -1748,7 +1837,7 @@ void handleSetServerAdminMessagePost(ServerAllWorldsState& world_state, const we
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			world_state.server_admin_message = request.getPostField("msg").str();
 			world_state.server_admin_message_changed = true;
@@ -1778,13 +1867,7 @@ void handleSetReadOnlyModePost(ServerAllWorldsState& world_state, const web::Req
 
 	try
 	{
-		{ // Lock scope
-
-			Lock lock(world_state.mutex);
-
-			world_state.read_only_mode = request.getPostIntField("read_only_mode") != 0;
-
-		} // End lock scope
+		world_state.read_only_mode = (request.getPostIntField("read_only_mode") != 0) ? 1 : 0;
 
 		//world_state.setUserWebMessage("Set server admin message.");
 
@@ -1810,7 +1893,7 @@ void handleForceDynTexUpdatePost(ServerAllWorldsState& world_state, const web::R
 	try
 	{
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 			world_state.force_dyn_tex_update = true;
 		} // End lock scope
 
@@ -1840,7 +1923,7 @@ void handleSetUserAsWorldGardenerPost(ServerAllWorldsState& world_state, const w
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.users_mutex);
 
 			// Lookup user
 			const auto res = world_state.user_id_to_users.find(UserID(user_id));
@@ -1880,7 +1963,7 @@ void handleSetUserAllowDynTexUpdatePost(ServerAllWorldsState& world_state, const
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.users_mutex);
 
 			// Lookup user
 			const auto res = world_state.user_id_to_users.find(UserID(user_id));
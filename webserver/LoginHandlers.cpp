@@ -47,7 +47,7 @@ site-b cookie currently stores session ID.
 
 bool isLoggedIn(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::UnsafeString& logged_in_username_out, bool& is_user_admin_out)
 {
-	Lock lock(world_state.mutex);
+	InstrumentedLock lock(world_state.users_mutex);
 
 	const User* user = getLoggedInUser(world_state, request_info);
 	if(user == NULL)
@@ -75,7 +75,7 @@ bool loggedInUserHasAdminPrivs(ServerAllWorldsState& world_state, const web::Req
 
 
 // Returns NULL if not logged in as a valid user.
-// ServerAllWorldsState should be locked
+// users_mutex should be held.  Locks sessions_mutex for the session lookup.
 User* getLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo& request_info)
 {
 	for(size_t i=0; i<request_info.cookies.size(); ++i)
@@ -85,20 +85,21 @@ User* getLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo&
 			try
 			{
 				// Lookup session
-				const auto res = world_state.user_web_sessions.find(request_info.cookies[i].value);
-				if(res == world_state.user_web_sessions.end())
-					return NULL; // Session not found
-				else
+				UserID session_user_id;
 				{
-					const UserWebSession* session = res->second.ptr();
-
-					// Lookup user from session
-					const auto user_res = world_state.user_id_to_users.find(session->user_id);
-					if(user_res == world_state.user_id_to_users.end())
-						return NULL; // User not found
-					else
-						return user_res->second.ptr();
+					InstrumentedLock sessions_lock(world_state.sessions_mutex);
+					const auto res = world_state.user_web_sessions.find(request_info.cookies[i].value);
+					if(res == world_state.user_web_sessions.end())
+						return NULL; // Session not found
+					session_user_id = res->second->user_id;
 				}
+
+				// Lookup user from session
+				const auto user_res = world_state.user_id_to_users.find(session_user_id);
+				if(user_res == world_state.user_id_to_users.end())
+					return NULL; // User not found
+				else
+					return user_res->second.ptr();
 			}
 			catch(glare::Exception& e)
 			{
@@ -113,7 +114,7 @@ User* getLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo&
 
 void setUserWebMessageForLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, const std::string& message)
 {
-	Lock lock(world_state.mutex);
+	InstrumentedLock lock(world_state.users_mutex);
 	User* user = getLoggedInUser(world_state, request_info);
 	if(user)
 	{
@@ -198,7 +199,7 @@ void handleLoginPost(ServerAllWorldsState& world_state, const web::RequestInfo&
 		std::string session_id;
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.users_mutex);
 
 			// Lookup user by username
 			const auto res = world_state.name_to_users.find(username.str());
@@ -215,9 +216,11 @@ void handleLoginPost(ServerAllWorldsState& world_state, const web::RequestInfo&
 					session->user_id = user.id;
 					session->created_time = TimeStamp::currentTime();
 					
-					world_state.addUserWebSessionAsDBDirty(session);
-
-					world_state.user_web_sessions[session->id] = session;
+					{
+						InstrumentedLock sessions_lock(world_state.sessions_mutex);
+						world_state.addUserWebSessionAsDBDirty(session);
+						world_state.user_web_sessions[session->id] = session;
+					}
 					world_state.markAsChanged();
 
 					session_id = session->id;
@@ -347,7 +350,7 @@ void handleSignUpPost(ServerAllWorldsState& world_state, const web::RequestInfo&
 		std::string reply;
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.users_mutex);
 			auto res = world_state.name_to_users.find(username.str()); // Find existing user with username
 			if(res != world_state.name_to_users.end())
 				throw InvalidCredentialsExcep("That username is not available."); // Username already used.
@@ -379,8 +382,11 @@ void handleSignUpPost(ServerAllWorldsState& world_state, const web::RequestInfo&
 			session->id = UserWebSession::generateRandomKey();
 			session->user_id = new_user->id;
 			session->created_time = TimeStamp::currentTime();
-			world_state.addUserWebSessionAsDBDirty(session);
-			world_state.user_web_sessions[session->id] = session;
+			{
+				InstrumentedLock sessions_lock(world_state.sessions_mutex);
+				world_state.addUserWebSessionAsDBDirty(session);
+				world_state.user_web_sessions[session->id] = session;
+			}
 
 			reply += "HTTP/1.1 302 Redirect" + CRLF;
 			reply += "Location: " + return_URL + CRLF;
@@ -451,7 +457,7 @@ void handleResetPasswordPost(ServerAllWorldsState& world_state, const web::Reque
 			const std::string email_addr = username_or_email.str();
 
 			{ // Lock scope
-				Lock lock(world_state.mutex);
+				InstrumentedLock lock(world_state.users_mutex);
 				for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
 					if(it->second->email_address == email_addr)
 					{
@@ -465,7 +471,7 @@ void handleResetPasswordPost(ServerAllWorldsState& world_state, const web::Reque
 			const std::string username = username_or_email.str();
 
 			{ // Lock scope
-				Lock lock(world_state.mutex);
+				InstrumentedLock lock(world_state.users_mutex);
 				for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
 					if(it->second->name == username)
 					{
@@ -491,7 +497,7 @@ void handleResetPasswordPost(ServerAllWorldsState& world_state, const web::Reque
 
 				matching_user->sendPasswordResetEmail(sending_info);
 
-				Lock lock(world_state.mutex);
+				InstrumentedLock lock(world_state.users_mutex);
 				world_state.addUserAsDBDirty(matching_user);
 				
 				conPrint("Sent user password reset email to '" + matching_user->email_address + ", username '" + matching_user->name + "'");
@@ -550,7 +556,7 @@ void renderResetPasswordFromEmailPage(ServerAllWorldsState& world_state, const w
 
 		bool valid_token = false;
 		{
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.users_mutex);
 
 			// Find user with the given email address:
 			for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
@@ -620,7 +626,7 @@ void handleSetNewPasswordPost(ServerAllWorldsState& world_state, const web::Requ
 
 		bool password_reset = false;
 		{
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.users_mutex);
 
 			// Find user with the given email address:
 			for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
@@ -671,7 +677,7 @@ void renderChangePasswordPage(ServerAllWorldsState& world_state, const web::Requ
 
 		// Display any messages for the user
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.users_mutex);
 
 			const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 			if(logged_in_user)
@@ -731,7 +737,7 @@ void handleChangePasswordPost(ServerAllWorldsState& world_state, const web::Requ
 
 		bool password_changed = false;
 		{
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.users_mutex);
 
 			User* user = getLoggedInUser(world_state, request_info);
 			if(!user)
@@ -27,14 +27,14 @@ LoginHandlers
 namespace LoginHandlers
 {
 	bool isLoggedIn(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::UnsafeString& logged_in_username_out,
-		bool& is_user_admin_out); // Locks ServerAllWorldsState
+		bool& is_user_admin_out); // Locks users_mutex
 
 	bool loggedInUserHasAdminPrivs(ServerAllWorldsState& world_state, const web::RequestInfo& request_info);
 
 
 	// Returns NULL if not logged in as a valid user.
-	// ServerAllWorldsState should be locked
-	User* getLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo& request_info) REQUIRES(world_state.mutex);
+	// users_mutex should be held.  Locks sessions_mutex for the session lookup.
+	User* getLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo& request_info) REQUIRES(world_state.users_mutex);
 
 	void renderLoginPage(const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
 	void handleLoginPost(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
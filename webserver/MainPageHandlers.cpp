@@ -63,9 +63,10 @@ void renderRootPage(ServerAllWorldsState& world_state, WebDataStore& data_store,
 
 	std::string auction_html;
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
 
 		ServerWorldState* root_world = world_state.getRootWorldState().ptr();
+		InstrumentedLock world_lock(root_world->mutex);
 
 		int num_auctions_shown = 0; // Num substrata auctions shown
 		const TimeStamp now = TimeStamp::currentTime();
@@ -805,7 +806,7 @@ void renderBotStatusPage(ServerAllWorldsState& world_state, const web::RequestIn
 	std::string page = WebServerResponseUtils::standardHeader(world_state, request_info, /*page title=*/"Bot Status");
 
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
 		page += "<h3>Screenshot bot</h3>";
 		if(world_state.last_screenshot_bot_contact_time.time == 0)
 			page += "No contact from screenshot bot since last server start.";
@@ -48,9 +48,11 @@ void renderParcelPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 		page += "<div class=\"main\">   \n";
 
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
+			InstrumentedLock users_lock(world_state.users_mutex);
 
 			auto res = root_world->parcels.find(ParcelID(parcel_id));
 			if(res == root_world->parcels.end())
@@ -313,11 +315,14 @@ void renderEditParcelDescriptionPage(ServerAllWorldsState& world_state, const we
 
 	{ // Lock scope
 
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		InstrumentedLock world_lock(root_world->mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		// Lookup parcel
-		const auto res = world_state.getRootWorldState()->parcels.find(ParcelID(parcel_id));
-		if(res != world_state.getRootWorldState()->parcels.end())
+		const auto res = root_world->parcels.find(ParcelID(parcel_id));
+		if(res != root_world->parcels.end())
 		{
 			Parcel* parcel = res->second.ptr();
 
@@ -347,7 +352,10 @@ void renderAddParcelWriterPage(ServerAllWorldsState& world_state, const web::Req
 
 	{ // Lock scope
 
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		InstrumentedLock world_lock(root_world->mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user)
@@ -358,8 +366,8 @@ void renderAddParcelWriterPage(ServerAllWorldsState& world_state, const web::Req
 		}
 
 		// Lookup parcel
-		const auto res = world_state.getRootWorldState()->parcels.find(ParcelID(parcel_id));
-		if(res != world_state.getRootWorldState()->parcels.end())
+		const auto res = root_world->parcels.find(ParcelID(parcel_id));
+		if(res != root_world->parcels.end())
 		{
 			page += "<form action=\"/add_parcel_writer_post\" method=\"post\" id=\"usrform\">";
 			page += "<input type=\"hidden\" name=\"parcel_id\" value=\"" + toString(parcel_id) + "\"><br>";
@@ -386,7 +394,10 @@ void renderRemoveParcelWriterPage(ServerAllWorldsState& world_state, const web::
 
 	{ // Lock scope
 
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		InstrumentedLock world_lock(root_world->mutex);
+		InstrumentedLock users_lock(world_state.users_mutex);
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user)
@@ -403,8 +414,8 @@ void renderRemoveParcelWriterPage(ServerAllWorldsState& world_state, const web::
 			page += "Are you sure you want to remove the user " + web::Escaping::HTMLEscape(writer_res->second->name) + " as a writer from the parcel?";
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID(parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID(parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				page += "<form action=\"/remove_parcel_writer_post\" method=\"post\" id=\"usrform\">";
 				page += "<input type=\"hidden\" name=\"parcel_id\" value=\"" + toString(parcel_id) + "\"><br>";
@@ -443,9 +454,11 @@ void renderMetadata(ServerAllWorldsState& world_state, const web::RequestInfo& r
 			;
 
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
 
 			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
+			InstrumentedLock users_lock(world_state.users_mutex);
 
 			auto res = root_world->parcels.find(ParcelID(parcel_id));
 			if(res == root_world->parcels.end())
@@ -519,11 +532,14 @@ void handleRegenerateParcelScreenshots(ServerAllWorldsState& world_state, const
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
+			InstrumentedLock users_lock(world_state.users_mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(parcel_id);
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 
@@ -584,11 +600,14 @@ void handleEditParcelDescriptionPost(ServerAllWorldsState& world_state, const we
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
+			InstrumentedLock users_lock(world_state.users_mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(parcel_id);
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 
@@ -596,7 +615,7 @@ void handleEditParcelDescriptionPost(ServerAllWorldsState& world_state, const we
 				if(logged_in_user && parcel->owner_id == logged_in_user->id) // If the user is logged in and owns this parcel:
 				{
 					parcel->description = new_descrip.str();
-					world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+					root_world->addParcelAsDBDirty(parcel);
 
 					world_state.markAsChanged();
 
@@ -631,11 +650,14 @@ void handleAddParcelWriterPost(ServerAllWorldsState& world_state, const web::Req
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
+			InstrumentedLock users_lock(world_state.users_mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(parcel_id);
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 
@@ -654,7 +676,7 @@ void handleAddParcelWriterPost(ServerAllWorldsState& world_state, const web::Req
 						{
 							added_writer = true;
 							parcel->writer_ids.push_back(new_writer_user->id);
-							world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+							root_world->addParcelAsDBDirty(parcel);
 							message = "Added user as writer.";
 						}
 						else
@@ -667,17 +689,17 @@ void handleAddParcelWriterPost(ServerAllWorldsState& world_state, const web::Req
 						message = "Could not find a user with that name.";
 					}
 
-					if(added_writer)
-					{
-						world_state.denormaliseData(); // Update parcel writer names
-						world_state.markAsChanged();
-					}
-
 					world_state.setUserWebMessage(logged_in_user->id, message);
 				}
 			}
 		} // End lock scope
 
+		if(added_writer)
+		{
+			world_state.denormaliseData(); // Update parcel writer names.  Done after releasing the locks above, as it locks each world then users_mutex itself.
+			world_state.markAsChanged();
+		}
+
 		if(added_writer)
 			web::ResponseUtils::writeRedirectTo(reply_info, "/parcel/" + parcel_id.toString());
 		else
@@ -702,12 +724,16 @@ void handleRemoveParcelWriterPost(ServerAllWorldsState& world_state, const web::
 		const ParcelID parcel_id = ParcelID(request.getPostIntField("parcel_id"));
 		const UserID writer_id = UserID(request.getPostIntField("writer_id"));
 
+		bool updated_parcel = false;
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			InstrumentedLock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			InstrumentedLock world_lock(root_world->mutex);
+			InstrumentedLock users_lock(world_state.users_mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(parcel_id);
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 
@@ -721,14 +747,18 @@ void handleRemoveParcelWriterPost(ServerAllWorldsState& world_state, const web::
 					else
 						world_state.setUserWebMessage(logged_in_user->id, "User was not a writer.");
 
-					world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
-
-					world_state.denormaliseData(); // Update parcel writer names
-					world_state.markAsChanged();
+					root_world->addParcelAsDBDirty(parcel);
+					updated_parcel = true;
 				}
 			}
 		} // End lock scope
 
+		if(updated_parcel)
+		{
+			world_state.denormaliseData(); // Update parcel writer names.  Done after releasing the locks above, as it locks each world then users_mutex itself.
+			world_state.markAsChanged();
+		}
+
 		web::ResponseUtils::writeRedirectTo(reply_info, "/parcel/" + parcel_id.toString());
 	}
 	catch(glare::Exception& e)
@@ -14,6 +14,7 @@ Copyright Glare Technologies Limited 2021 -
 #include "WebServerResponseUtils.h"
 #include "../server/ServerWorldState.h"
 #include "../server/Order.h"
+#include "../server/ResourceFile.h"
 #include <graphics/FormatDecoderGLTF.h>
 #include <graphics/BatchedMesh.h>
 #include <ConPrint.h>
@@ -21,7 +22,6 @@ Copyright Glare Technologies Limited 2021 -
 #include <Lock.h>
 #include <StringUtils.h>
 #include <PlatformUtils.h>
-#include <MemMappedFile.h>
 #include <FileUtils.h>
 #include <RuntimeCheck.h>
 
@@ -30,6 +30,24 @@ namespace ResourceHandlers
 {
 
 
+static void writeOKResponse(web::ReplyInfo& reply_info, ResourceFile& body_file, const std::string& content_type, CompressedResourceVariants::Encoding encoding, bool vary_on_accept_encoding)
+{
+	const std::string response =
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: " + content_type + "\r\n" +
+		((encoding != CompressedResourceVariants::Encoding_Identity) ? ("Content-Encoding: " + std::string(CompressedResourceVariants::encodingName(encoding)) + "\r\n") : std::string()) +
+		(vary_on_accept_encoding ? "Vary: Accept-Encoding\r\n" : "") + // Tell caches the response depends on Accept-Encoding.
+		"Cache-Control: max-age=100000000\r\n"
+		"Connection: Keep-Alive\r\n"
+		"Content-Length: " + toString(body_file.fileSize()) + "\r\n"
+		"\r\n";
+
+	reply_info.socket->writeData(response.c_str(), response.size());
+
+	body_file.writeToSocket(*reply_info.socket); // Writes from memory if the file is cached, otherwise uses sendfile() for non-TLS connections.
+}
+
+
 void handleResourceRequest(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
 {
 	try
@@ -134,11 +152,12 @@ void handleResourceRequest(ServerAllWorldsState& world_state, const web::Request
 
 				const std::string content_type = web::ResponseUtils::getContentTypeForPath(local_path); // Guess content type
 
-				MemMappedFile file(local_path);
-
 				// NOTE: only handle a single range for now, because the response content types (and encoding?) get different for multiple ranges.
 				if(request.ranges.size() == 1)
 				{
+					// Ranges are always of the uncompressed resource, so clients can resume downloads and seek in media files.
+					ResourceFile file(local_path, &world_state.resource_cache);
+
 					for(size_t i=0; i<request.ranges.size(); ++i)
 					{
 						const web::Range range = request.ranges[i];
@@ -175,16 +194,47 @@ void handleResourceRequest(ServerAllWorldsState& world_state, const web::Request
 						// Sanity check range.start and range_size.  Should be valid by here.
 						runtimeCheck((range.start >= 0) && (range.start <= (int64)file.fileSize()) && (range.start + range_size <= (int64)file.fileSize()));
 
-						reply_info.socket->writeData((const uint8*)file.fileData() + range.start, range_size);
+						file.writeRangeToSocket(*reply_info.socket, range.start, range_size);
+
+						world_state.compressed_resource_variants.recordResponse(CompressedResourceVariants::Encoding_Identity, range_size, range_size);
 				
 						// conPrint("\thandleResourceRequest: sent data range. (len: " + toString(range_size) + ")");
 					}
 				}
 				else
 				{
-					// conPrint("handleResourceRequest: serving data for '" + resource_URL + "' (len: " + toString(file.fileSize()) + " B)");
+					// If the resource is compressible, serve a precompressed variant of it if the client accepts one and it has been generated.
+					const bool compressible = CompressedResourceVariants::isCompressibleResource(local_path);
+					CompressedResourceVariants::Encoding encoding = CompressedResourceVariants::Encoding_Identity;
+					std::string variant_path;
+					if(compressible)
+					{
+						uint32 accepted_encodings = 1u << CompressedResourceVariants::Encoding_Identity;
+						for(size_t i=0; i<request.headers.size(); ++i)
+							if(StringUtils::equalCaseInsensitive(request.headers[i].key, "accept-encoding"))
+								accepted_encodings = CompressedResourceVariants::parseAcceptEncoding(request.headers[i].value);
+
+						bool should_queue_generation;
+						encoding = world_state.compressed_resource_variants.findVariant(local_path, accepted_encodings, variant_path, should_queue_generation);
+						if(should_queue_generation)
+							CompressedResourceVariants::queueGeneration(world_state.lod_gen_job_queue, resource_URL, local_path);
+					}
+
+					ResourceFile file(local_path, &world_state.resource_cache);
 
-					web::ResponseUtils::writeHTTPOKHeaderAndDataWithCacheMaxAge(reply_info, file.fileData(), file.fileSize(), content_type.c_str(), /*max age(s)=*/100000000);
+					// conPrint("handleResourceRequest: serving data for '" + resource_URL + "' (len: " + toString(file.fileSize()) + " B, encoding: " + CompressedResourceVariants::encodingName(encoding) + ")");
+
+					if(encoding == CompressedResourceVariants::Encoding_Identity)
+					{
+						writeOKResponse(reply_info, file, content_type, encoding, /*vary on accept-encoding=*/compressible);
+						world_state.compressed_resource_variants.recordResponse(encoding, file.fileSize(), file.fileSize());
+					}
+					else
+					{
+						ResourceFile variant_file(variant_path, &world_state.resource_cache);
+						writeOKResponse(reply_info, variant_file, content_type, encoding, /*vary on accept-encoding=*/true);
+						world_state.compressed_resource_variants.recordResponse(encoding, variant_file.fileSize(), file.fileSize());
+					}
 
 					// conPrint("\thandleResourceRequest: sent data. (len: " + toString(file.fileSize()) + ")");
 				}
@@ -139,9 +139,10 @@ const std::string getMapEmbedCode(ServerAllWorldsState& world_state, ParcelID hi
 	const TimeStamp now = TimeStamp::currentTime();
 
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		InstrumentedLock lock(world_state.mutex); // For parcel_auctions
 
 		ServerWorldState* root_world = world_state.getRootWorldState().ptr();
+		InstrumentedLock world_lock(root_world->mutex);
 
 
 		poly_verts.reserve(44 * 4);